@@ -12,40 +12,159 @@ void App1::init(HINSTANCE hinstance, HWND hwnd, int screenWidth, int screenHeigh
 	// Call super/parent init function (required!)
 	BaseApplication::init(hinstance, hwnd, screenWidth, screenHeight, in, VSYNC, FULL_SCREEN);
 
+	// Create the state cache first, as every shader takes its samplers and depth states from it, and the memory tracker before anything
+	// it should count is created. The framework's back buffer already exists, so is tracked once it's bound
+	StateCache::create(renderer->getDevice());
+	MemoryTracker::create();
+
+	// Create the command recorder, which stands between the frame and the renderer's context only while it records
+	commandRecorder = new CommandRecorder(renderer->getDeviceContext());
+
 	// Create Shader objects
 	tessellationShader = new TessellationShader(renderer->getDevice(), hwnd);
 	depthTessellationShader = new DepthTessellationShader(renderer->getDevice(), hwnd);
 	basicShader = new BasicShader(renderer->getDevice(), hwnd);
 	combinedBlurShader = new CombinedBlurShader(renderer->getDevice(), hwnd);
 	depthOfFieldShader = new DepthOfFieldShader(renderer->getDevice(), hwnd);
+	bokehDofShader = new BokehDofShader(renderer->getDevice(), hwnd, screenWidth, screenHeight);
+	autofocusShader = new AutofocusShader(renderer->getDevice(), hwnd, bokehSettings.focusDistance);
+	postStackShader = new PostStackShader(renderer->getDevice(), hwnd, screenWidth, screenHeight);
 	depthShader = new DepthShader(renderer->getDevice(), hwnd);
+	virtualTextureFeedbackShader = new VirtualTextureFeedbackShader(renderer->getDevice(), hwnd);
 
 	// Create Mesh objects
-	TplaneMesh = new TPlane(renderer->getDevice(), renderer->getDeviceContext(), 100);
-	pointlightMesh = new SphereMesh(renderer->getDevice(), renderer->getDeviceContext(), 20);
-	spotlightMesh = new SphereMesh(renderer->getDevice(), renderer->getDeviceContext(), 20);
-
-	// Create empty shadow maps with high resolution
-	shadowMap[0] = new ShadowMap(renderer->getDevice(), 8192, 8192);
-	shadowMap[1] = new ShadowMap(renderer->getDevice(), 8192, 8192);
+	TplaneMesh = new TPlane(renderer->getDevice(), getDeviceContext(), 100);
+	geometry = new GeometryRegistry();
+	pointlightMesh = geometry->addSphere(20);
+	spotlightMesh = geometry->addSphere(20);
+
+	// Create a single shadow atlas shared by the Directional, Spot and Point Light, starting with high resolution hard shadows
+	shadowAtlas = 0;
+	shadowMoments = new ShadowMomentShader(renderer->getDevice(), hwnd);
+	shadowFilter = ShadowMoments::getDefaultSettings(SHADOW_FILTER_HARD);
+	createShadowAtlas();
+
+	// Create the point light's cube shadow map, and the shaders drawing the terrain and meshes into all of its faces at once
+	pointShadow = new PointShadowMap(renderer->getDevice(), 0.1f, 200.0f);
+	cubeShadowShader = new CubeShadowShader(renderer->getDevice(), hwnd);
+	cubeShadowTessShader = new CubeShadowShader(renderer->getDevice(), hwnd, true);
 
 	// Create new render textures with same size as the screen
 	screenTexture = new RenderTexture(renderer->getDevice(), screenWidth, screenHeight, SCREEN_NEAR, SCREEN_DEPTH);
 	blurTexture = new RenderTexture(renderer->getDevice(), screenWidth, screenHeight, SCREEN_NEAR, SCREEN_DEPTH);
-	depthTexture = new RenderTexture(renderer->getDevice(), screenWidth, screenHeight, SCREEN_NEAR, SCREEN_DEPTH);
+
+	// The render textures keep their textures to themselves, so they are tracked through what binding them puts on the output merger
+	screenTexture->setRenderTarget(getDeviceContext());
+	MemoryTracker::trackBoundTargets(getDeviceContext(), MEMORY_RENDER_TARGET, "Screen texture");
+	blurTexture->setRenderTarget(getDeviceContext());
+	MemoryTracker::trackBoundTargets(getDeviceContext(), MEMORY_RENDER_TARGET, "Blur texture");
+	renderer->setBackBufferRenderTarget();
+	MemoryTracker::trackBoundTargets(getDeviceContext(), MEMORY_RENDER_TARGET, "Back buffer");
+
+	// The camera depth is stored linearly in a compact format, with a report of what each format gives up
+	depthTexture = new CameraDepthTarget(renderer->getDevice(), screenWidth, screenHeight, SCREEN_NEAR, SCREEN_DEPTH, (DepthStorageFormat)depthStorageFormat);
+	depthStorageReport = CameraDepthTarget::buildReport(screenWidth, screenHeight, SCREEN_NEAR, SCREEN_DEPTH);
 
 	// Create new ortho mesh to display the screen
-	screenOrthoMesh = new OrthoMesh(renderer->getDevice(), renderer->getDeviceContext(), screenWidth, screenHeight);
+	screenOrthoMesh = new OrthoMesh(renderer->getDevice(), getDeviceContext(), screenWidth, screenHeight);
 
 	// Load textures to the texture manager
 	textureMgr->loadTexture(L"heightMap", L"res/height.png");
 	textureMgr->loadTexture(L"brick", L"res/brick1.dds");
+	MemoryTracker::track(textureMgr->getTexture(L"heightMap"), MEMORY_TEXTURE, "Heightmap");
+	MemoryTracker::track(textureMgr->getTexture(L"brick"), MEMORY_TEXTURE, "Brick");
+
+	// Read the heightmap back to the CPU, for cooking the virtual texture and bounding the terrain
+	heightField = new HeightField();
+	bool heightsLoaded = heightField->loadFromTexture(renderer->getDevice(), getDeviceContext(), textureMgr->getTexture(L"heightMap"));
+
+	// Cook the heightmap into a tiled virtual texture if that hasn't been done yet, then open it for streaming
+	VirtualTextureFile cookedHeightMap;
+	if (!cookedHeightMap.open(L"res/height.vtex") && heightsLoaded)
+	{
+		VirtualTextureFile::build(*heightField, L"res/height.vtex");
+	}
+	cookedHeightMap.close();
+	virtualHeightMap = new VirtualTexture(renderer->getDevice(), L"res/height.vtex", 8, screenWidth, screenHeight);
+
+	// Bound each terrain patch by its displaced heights, and build the coarse occluder used by the software rasterizer
+	if (heightsLoaded)
+	{
+		TplaneMesh->computePatchBounds(*heightField, 30.0f);
+		TplaneMesh->buildOccluderMesh(*heightField, 30.0f, 32, occluderVertices, occluderIndices);
+	}
+
+	// Create the horizon map the terrain shadows itself with, a quarter of the heightmap's resolution. It is built on the first frame
+	horizonMap = new HorizonMap(renderer->getDevice(), heightField, 100.0f, 30.0f, 4);
+
+	// Create the terrain query's quadtree over the same heights and scale the domain shader uses
+	terrainQuery = new TerrainQuery(heightField, 100.0f, 30.0f);
+
+	// Create the terrain editor's height and normal textures from the same heights, only bound once the terrain has been painted
+	terrainEditor = new TerrainEditor(renderer->getDevice(), heightField, 100.0f, 30.0f);
+
+	// Create the frame pipeline, colliding the camera with the terrain query. Its update thread only runs while it's turned on
+	framePipeline = new FramePipeline(terrainQuery);
+
+	// Create the Hi-Z pyramid builder at screen size, and a small depth buffer for the software occlusion path
+	hiZBuildShader = new HiZBuildShader(renderer->getDevice(), hwnd, screenWidth, screenHeight);
+	occlusionRasterizer = new SoftwareOcclusionRasterizer(256, 144);
+	XMStoreFloat4x4(&hiZViewProjection, XMMatrixIdentity());
+	objectBoundsStart = TplaneMesh->getPatchCount();
+	flythrough.addDefaultPath();
+
+	// Create the GPU driven scene with a view for the camera and each shadow casting light, holding the terrain patches and any objects
+	gpuCullShader = new GpuCullShader(renderer->getDevice(), hwnd);
+	gpuTessellationShader = new TessellationShader(renderer->getDevice(), hwnd, true);
+	gpuDepthTessellationShader = new DepthTessellationShader(renderer->getDevice(), hwnd, true);
+	gpuBasicShader = new BasicShader(renderer->getDevice(), hwnd, true);
+	gpuDepthShader = new DepthShader(renderer->getDevice(), hwnd, true);
+	lodSphereMesh = new LodSphereMesh(renderer->getDevice(), getDeviceContext());
+	gpuScene = new GpuDrivenScene(renderer->getDevice(), GPU_VIEW_COUNT);
+	gpuPatchesValid = gpuScene->setPatches(TplaneMesh, 100.0f);
+	gpuScene->setObjectMesh(lodSphereMesh);
+
+	// Load the cooked heightmap, baked normal map and brick texture, cooking any that are missing. Both terrain shaders take the normal map
+	loadCookedTextures(false);
+
+	// Create the pass timer, and the resolution controller working within the screen sized render textures
+	gpuProfiler = new GpuProfiler(renderer->getDevice());
+
+	// Create the frame capture, writing next to the benchmark logs
+	frameCapture = new FrameCapture("capture_");
+	colourCaptureStream = frameCapture->addStream("colour");
+	depthCaptureStream = frameCapture->addStream("depth");
+	softwareDepthCaptureStream = frameCapture->addStream("software_depth");
+
+	// Create the constant ring the per draw shaders upload through
+	constantRing = new ConstantRing(renderer->getDevice(), renderer->getDeviceContext());
+	setConstantRing(constantRing);
+
+	// Create the screen pass's render queue, building on every core
+	renderQueue = new RenderQueue();
+	dynamicResolution = new DynamicResolution(screenWidth, screenHeight);
+	qualityGovernor.setPolicy(&costWeightedPolicy);
+
+	// Load the scene, converting the text scene if there is no binary one. With neither, the built in scene is written out as both
+	if (!loadScene(L"res/scene.scnb"))
+	{
+		if (!SceneJson::convert(L"res/scene.json", L"res/scene.scnb"))
+		{
+			saveScene();
+		}
+		loadScene(L"res/scene.scnb");
+	}
 
-	// Initialize Lights
+	// Initialize Lights, and the state the first frame is drawn from
 	initLight(screenWidth, screenHeight);
+	frameState = captureFrameState();
+	memset(&framePacket, 0, sizeof(framePacket));
+
+	// Initialize Mesh, then pack it and the light spheres into the registry's shared buffers
+	cube1 = geometry->addCube(20);
+	geometry->build(renderer->getDevice(), optimizeGeometry);
 
-	// Initialize Mesh
-	cube1 = new CubeMesh(renderer->getDevice(), renderer->getDeviceContext(), 20);
+	applyMemoryBudgets();
 }
 
 void App1::initLight(float sceneWidth, float sceneHeight)
@@ -57,7 +176,6 @@ void App1::initLight(float sceneWidth, float sceneHeight)
 	lightArray[0]->setDirection(lightDir1[0], lightDir1[1], lightDir1[2]);
 	lightArray[0]->setPosition(0, 0, 0);
 	lightArray[0]->generateOrthoMatrix(sceneWidth, sceneHeight, 0.1f, 150.0f);
-	activeLight[0] = true;
 
 	// Configure Point Light
 	lightArray[1] = new Light();
@@ -65,7 +183,6 @@ void App1::initLight(float sceneWidth, float sceneHeight)
 	lightArray[1]->setDiffuseColour(lightDif2[0], lightDif2[1], lightDif2[2], lightDif2[3]);
 	lightArray[1]->setDirection(0, -1, 0);
 	lightArray[1]->setPosition(lightPos2[0], lightPos2[1], lightPos2[2]);
-	activeLight[1] = true;
 
 	// Configure Spot Light
 	lightArray[2] = new Light();
@@ -73,7 +190,6 @@ void App1::initLight(float sceneWidth, float sceneHeight)
 	lightArray[2]->setDiffuseColour(lightDif3[0], lightDif3[1], lightDif3[2], lightDif3[3]);
 	lightArray[2]->setDirection(lightDir3[0], lightDir3[1], lightDir3[2]);
 	lightArray[2]->setPosition(lightPos3[0], lightPos3[1], lightPos3[2]);
-	activeLight[2] = true;
 }
 
 App1::~App1()
@@ -107,11 +223,61 @@ App1::~App1()
 		delete depthOfFieldShader;
 		depthOfFieldShader = 0;
 	}
+	if (bokehDofShader)
+	{
+		delete bokehDofShader;
+		bokehDofShader = 0;
+	}
+	if (autofocusShader)
+	{
+		delete autofocusShader;
+		autofocusShader = 0;
+	}
+	if (postStackShader)
+	{
+		delete postStackShader;
+		postStackShader = 0;
+	}
 	if (depthShader)
 	{
 		delete depthShader;
 		depthShader = 0;
 	}
+	if (virtualTextureFeedbackShader)
+	{
+		delete virtualTextureFeedbackShader;
+		virtualTextureFeedbackShader = 0;
+	}
+	if (hiZBuildShader)
+	{
+		delete hiZBuildShader;
+		hiZBuildShader = 0;
+	}
+	if (gpuCullShader)
+	{
+		delete gpuCullShader;
+		gpuCullShader = 0;
+	}
+	if (gpuTessellationShader)
+	{
+		delete gpuTessellationShader;
+		gpuTessellationShader = 0;
+	}
+	if (gpuDepthTessellationShader)
+	{
+		delete gpuDepthTessellationShader;
+		gpuDepthTessellationShader = 0;
+	}
+	if (gpuBasicShader)
+	{
+		delete gpuBasicShader;
+		gpuBasicShader = 0;
+	}
+	if (gpuDepthShader)
+	{
+		delete gpuDepthShader;
+		gpuDepthShader = 0;
+	}
 
 	// Delete the mesh pointers, to prevent memory leak
 	if (TplaneMesh)
@@ -119,105 +285,1219 @@ App1::~App1()
 		delete TplaneMesh;
 		TplaneMesh = 0;
 	}
-	if (pointlightMesh)
+
+	// The light spheres and cube belong to the geometry registry
+	if (geometry)
+	{
+		delete geometry;
+		geometry = 0;
+	}
+	pointlightMesh = 0;
+	spotlightMesh = 0;
+	cube1 = 0;
+	if (lodSphereMesh)
+	{
+		delete lodSphereMesh;
+		lodSphereMesh = 0;
+	}
+
+	// Delete screen textures and depth map pointers, to prevent memory leak
+	if (shadowAtlas)
+	{
+		delete shadowAtlas;
+		shadowAtlas = 0;
+	}
+	if (shadowMoments)
+	{
+		delete shadowMoments;
+		shadowMoments = 0;
+	}
+	if (pointShadow)
+	{
+		delete pointShadow;
+		pointShadow = 0;
+	}
+	if (cubeShadowShader)
+	{
+		delete cubeShadowShader;
+		cubeShadowShader = 0;
+	}
+	if (cubeShadowTessShader)
+	{
+		delete cubeShadowTessShader;
+		cubeShadowTessShader = 0;
+	}
+	if (screenTexture)
+	{
+		delete screenTexture;
+		screenTexture = 0;
+	}
+	if (blurTexture)
+	{
+		delete blurTexture;
+		blurTexture = 0;
+	}
+	if (depthTexture)
+	{
+		delete depthTexture;
+		depthTexture = 0;
+	}
+
+	// Delete the virtual texture, which also stops its streaming thread
+	if (virtualHeightMap)
+	{
+		delete virtualHeightMap;
+		virtualHeightMap = 0;
+	}
+
+	// Stop the frame pipeline's update thread before deleting the terrain query it collides the camera with
+	if (framePipeline)
+	{
+		delete framePipeline;
+		framePipeline = 0;
+	}
+
+	// Delete the horizon map, terrain query and terrain editor before the CPU heightmap they read, and the occlusion buffers
+	if (horizonMap)
+	{
+		delete horizonMap;
+		horizonMap = 0;
+	}
+	if (terrainQuery)
+	{
+		delete terrainQuery;
+		terrainQuery = 0;
+	}
+	if (terrainEditor)
+	{
+		delete terrainEditor;
+		terrainEditor = 0;
+	}
+	if (heightField)
+	{
+		delete heightField;
+		heightField = 0;
+	}
+
+	// Release the cooked textures, which are loaded outside the texture manager
+	if (cookedHeightTexture)
+	{
+		cookedHeightTexture->Release();
+		cookedHeightTexture = 0;
+	}
+	if (cookedNormalTexture)
+	{
+		cookedNormalTexture->Release();
+		cookedNormalTexture = 0;
+	}
+	if (cookedBrickTexture)
+	{
+		cookedBrickTexture->Release();
+		cookedBrickTexture = 0;
+	}
+	if (occlusionRasterizer)
+	{
+		delete occlusionRasterizer;
+		occlusionRasterizer = 0;
+	}
+	occlusionLog.close();
+
+	// Delete the GPU driven scene's buffers
+	if (gpuScene)
+	{
+		delete gpuScene;
+		gpuScene = 0;
+	}
+
+	if (renderQueue)
+	{
+		delete renderQueue;
+		renderQueue = 0;
+	}
+
+	// Delete the pass timer's queries and the resolution controller, which closes its trace
+	if (gpuProfiler)
+	{
+		delete gpuProfiler;
+		gpuProfiler = 0;
+	}
+
+	// Delete the frame capture, which finishes writing the frames it has already read back
+	if (frameCapture)
+	{
+		delete frameCapture;
+		frameCapture = 0;
+	}
+	if (dynamicResolution)
+	{
+		delete dynamicResolution;
+		dynamicResolution = 0;
+	}
+
+	// Delete the constant ring, after the shaders uploading through it
+	if (constantRing)
+	{
+		delete constantRing;
+		constantRing = 0;
+	}
+
+	// Drop the trace's references to everything it drew with, then the recorder
+	commandTrace.clear();
+	replayLog.close();
+	if (commandRecorder)
+	{
+		delete commandRecorder;
+		commandRecorder = 0;
+	}
+
+	// Destroy the state cache last, once every shader has released its references to the shared states, then the memory tracker. The
+	// framework's own resources go after it, and find nobody to tell
+	StateCache::destroy();
+	MemoryTracker::destroy();
+}
+
+void App1::beginPass(const char* name)
+{
+	// Render targets change between passes and may unbind what the filter thinks is bound, so it starts each pass knowing nothing
+	StateCache::get()->invalidate();
+	commandRecorder->beginPass(name);
+	gpuProfiler->beginPass(getDeviceContext(), name);
+}
+
+void App1::endPass(const char* name)
+{
+	gpuProfiler->endPass(getDeviceContext(), name);
+}
+
+void App1::setConstantRing(ConstantRing* ring)
+{
+	tessellationShader->setConstantRing(ring);
+	depthTessellationShader->setConstantRing(ring);
+	basicShader->setConstantRing(ring);
+	depthShader->setConstantRing(ring);
+	gpuTessellationShader->setConstantRing(ring);
+	gpuDepthTessellationShader->setConstantRing(ring);
+	gpuBasicShader->setConstantRing(ring);
+	gpuDepthShader->setConstantRing(ring);
+}
+
+ID3D11DeviceContext* App1::getDeviceContext()
+{
+	if (commandRecorder && commandRecorder->isRecording())
+	{
+		return commandRecorder;
+	}
+	return renderer->getDeviceContext();
+}
+
+void App1::replayTrace()
+{
+	// Frames still being captured are read back first, as the replay would write over the copies
+	frameCapture->flush(renderer->getDeviceContext());
+
+	// Straight onto the renderer's context, as the application draws nothing while it runs
+	bool replayed = commandTrace.replay(renderer->getDeviceContext(), replayIterations, replayStats);
+
+	// The replay writes the traced frames' uploads, copies and draws over resources that are kept from frame to frame, so everything
+	// holding state on the GPU sends it again or redraws it, and drops read-backs that now hold the replay's results
+	gpuScene->invalidateGpuState();
+	virtualHeightMap->invalidateGpuState();
+	horizonMap->invalidateGpuState();
+	terrainEditor->invalidateGpuState();
+	shadowAtlas->invalidateAll();
+	autofocusShader->invalidateGpuState();
+	hiZBuildShader->invalidateGpuState();
+	bokehDofShader->invalidateGpuState();
+	replayFailed = !replayed;
+	if (!replayed)
+	{
+		return;
+	}
+
+	// A row per replay, beside what the same frames cost the CPU when the application rendered them
+	if (!replayLog.isOpen())
+	{
+		replayLog.open("command_replay.csv", { "frames", "iterations", "commands", "draws", "trace_kb", "live_ms_per_frame", "replay_submit_ms_per_frame", "replay_total_ms_per_frame", "replay_fps", "commands_per_second", "mb_per_second" });
+	}
+	const CommandTraceStats& traceStats = commandTrace.getStats();
+	double frames = max(replayStats.frames, 1);
+	replayLog.addRow({ (double)traceStats.frames, (double)replayStats.iterations, (double)traceStats.commands, (double)traceStats.draws, commandTrace.getBytes() / 1024.0,
+		tracedMilliseconds / max(traceStats.frames, 1), replayStats.submitMilliseconds / frames, replayStats.totalMilliseconds / frames, replayStats.framesPerSecond,
+		replayStats.commandsPerSecond, replayStats.megabytesPerSecond });
+}
+
+bool App1::frame()
+{
+	bool result;
+
+	// The frame is timed from before its input is sampled to after it is presented
+	framePipeline->beginRender();
+
+	result = BaseApplication::frame();
+	if (!result)
+	{
+		return false;
+	}
+
+	// Checks the memory budgets before anything is drawn, so a downgrade they trigger applies to the whole frame
+	updateMemory();
+
+	// Moves the camera along the benchmark path while it's running, and writes out the results once it finishes
+	if (flythrough.isActive() && !flythrough.update(timer->getTime(), camera))
+	{
+		if (occlusionLog.isOpen())
+		{
+			averageOccludedFraction = occlusionLog.getRowCount() > 0 ? (float)(occludedFractionSum / occlusionLog.getRowCount()) : 0.0f;
+			occlusionLog.close();
+		}
+		qualityGovernor.stopLog();
+	}
+
+	// Starts the update thread from the current state when the pipeline is turned on, and stops it when turned off. The flythrough
+	// places the camera itself, so the pipeline stops while it runs and starts again from wherever the camera is left
+	bool pipelined = pipelinedUpdate && !flythrough.isActive();
+	if (pipelined && !framePipeline->isRunning())
+	{
+		frameState = captureFrameState();
+		framePipeline->start(frameState);
+	}
+	else if (!pipelined && framePipeline->isRunning())
+	{
+		framePipeline->stop();
+	}
+
+	// The camera has been moved by this frame's input, from where it was drawn last frame
+	XMFLOAT3 position = camera->getPosition();
+	XMFLOAT3 rotation = camera->getRotation();
+	XMFLOAT3 move(position.x - frameState.cameraPosition.x, position.y - frameState.cameraPosition.y, position.z - frameState.cameraPosition.z);
+	XMFLOAT3 turn(rotation.x - frameState.cameraRotation.x, rotation.y - frameState.cameraRotation.y, rotation.z - frameState.cameraRotation.z);
+	bool moved = move.x != 0.0f || move.y != 0.0f || move.z != 0.0f || turn.x != 0.0f || turn.y != 0.0f || turn.z != 0.0f;
+
+	// Hands the movement and the GUI's edits to the update thread, and draws the state it has interpolated to
+	if (pipelined)
+	{
+		framePipeline->addInput(move, turn);
+		framePipeline->setCameraCollision(cameraCollision, cameraClearance);
+		framePipeline->setEdits(captureFrameState());
+		frameState = framePipeline->acquire(framePacket);
+		camera->setPosition(frameState.cameraPosition.x, frameState.cameraPosition.y, frameState.cameraPosition.z);
+		camera->setRotation(frameState.cameraRotation.x, frameState.cameraRotation.y, frameState.cameraRotation.z);
+		camera->update();
+		shownInputTime = framePacket.inputTime;
+		cameraInputTime = -1.0;
+	}
+	else
+	{
+		// The camera's view is only updated at the end of the frame, so last frame's move is the one this frame shows
+		shownInputTime = cameraInputTime;
+		cameraInputTime = moved ? framePipeline->now() : -1.0;
+		frameState = captureFrameState();
+	}
+	applyFrameState();
+
+	// Replays the trace between frames, so nothing the application does is in its timing
+	if (replayRequested)
+	{
+		replayRequested = false;
+		replayTrace();
+	}
+
+	// Renders through the recorder while a trace is being taken. The constant ring binds through a context of its own that the recorder
+	// never sees, so the shaders map their own buffers until it's done
+	bool tracing = traceFramesLeft > 0;
+	if (tracing && !commandRecorder->isRecording())
+	{
+		setConstantRing(NULL);
+		commandRecorder->begin(&commandTrace);
+		tracedMilliseconds = 0.0;
+	}
+	chrono::high_resolution_clock::time_point renderStart = chrono::high_resolution_clock::now();
+
+	// Render the graphics.
+	result = render();
+	if (tracing)
+	{
+		tracedMilliseconds += chrono::duration<double, milli>(chrono::high_resolution_clock::now() - renderStart).count();
+		commandRecorder->endFrame();
+		if (--traceFramesLeft == 0)
+		{
+			commandRecorder->end();
+			setConstantRing(useConstantRing ? constantRing : NULL);
+		}
+	}
+	if (!result)
+	{
+		return false;
+	}
+
+	// Steps the scaling benchmark, moving to the next object count once each step has been measured
+	if (scalingBenchmark.isActive())
+	{
+		double visibleObjects = objectCount;
+		if (gpuDriven)
+		{
+			visibleObjects = 0;
+			for (int lod = 0; lod < GpuDrivenScene::LOD_COUNT; lod++)
+			{
+				visibleObjects += gpuScene->getVisibleObjects(GPU_VIEW_CAMERA, lod);
+			}
+		}
+		if (scalingBenchmark.addFrame(submitMilliseconds, timer->getTime() * 1000.0, visibleObjects) && scalingBenchmark.isActive())
+		{
+			populateObjects(scalingBenchmark.getStepValue());
+		}
+	}
+
+	// Steps the bokeh benchmark, narrowing the focus range once each step has been measured and restoring it at the end
+	if (bokehBenchmark.isActive())
+	{
+		if (bokehBenchmark.addFrame(gpuProfiler->getPassTime("Bokeh"), gpuProfiler->getFrameTime(), bokehDofShader->getOutOfFocusFraction()))
+		{
+			if (bokehBenchmark.isActive())
+			{
+				bokehSettings.focusRange = (float)bokehBenchmark.getStepValue();
+			}
+			else
+			{
+				bokehSettings.focusRange = bokehBenchmarkRange;
+			}
+		}
+	}
+
+	return true;
+}
+
+bool App1::render()
+{
+	chrono::high_resolution_clock::time_point submitStart = chrono::high_resolution_clock::now();
+
+	// Reads back the pass timings from a few frames ago, and picks this frame's resolution from them
+	gpuProfiler->beginFrame(getDeviceContext());
+	constantRing->beginFrame(getDeviceContext());
+	StateCache::get()->invalidate();
+	float blurMilliseconds = fusedPost ? gpuProfiler->getPassTime("Post Stack") : 0.0f;
+	if (activeDOF && bokehDOF)
+	{
+		blurMilliseconds += gpuProfiler->getPassTime("Bokeh");
+	}
+	else if (!fusedPost)
+	{
+		blurMilliseconds += gpuProfiler->getPassTime("Blur");
+	}
+	postPathTimes[fusedPost ? 1 : 0] = blurMilliseconds + gpuProfiler->getPassTime("Final");
+	screenPassTimes[useCookedTextures ? 1 : 0] = gpuProfiler->getPassTime("Screen");
+	float scaledMilliseconds = gpuProfiler->getPassTime("Camera Depth") + gpuProfiler->getPassTime("Screen") + blurMilliseconds;
+	dynamicResolution->update(scaledMilliseconds, max(gpuProfiler->getFrameTime() - scaledMilliseconds, 0.0f));
+	if (!dynamicResolution->enabled)
+	{
+		dynamicResolution->setScale(manualScale);
+	}
+
+	// Lets the quality governor adjust the tessellation, shadow and blur settings from the same timings
+	QualityTimings qualityTimings;
+	qualityTimings.frameMilliseconds = gpuProfiler->getFrameTime();
+	qualityTimings.targetMilliseconds = qualityGovernor.targetMilliseconds;
+	qualityTimings.shadowMilliseconds = gpuProfiler->getPassTime("Directional Shadow") + gpuProfiler->getPassTime("Spot Shadow") + gpuProfiler->getPassTime(pointShadowSixPass ? "Point Shadow (Six Pass)" : "Point Shadow");
+	// The shadow passes are counted once, in shadowMilliseconds, so the two savings the policy weighs don't both claim them
+	qualityTimings.tessellationMilliseconds = gpuProfiler->getPassTime("Camera Depth") + gpuProfiler->getPassTime("Screen");
+	qualityTimings.blurMilliseconds = blurMilliseconds;
+	qualityGovernor.update(qualityTimings);
+
+	// While every shadow tile is being redrawn, notes what the directional and spot passes cost with and without the terrain in them
+	if (shadowRedraw)
+	{
+		shadowPassTimes[horizonShadows ? 1 : 0] = gpuProfiler->getPassTime("Directional Shadow") + gpuProfiler->getPassTime("Spot Shadow");
+	}
+	renderTessFactor = max(1, (int)(frameState.tessFactor * qualityGovernor.getTessellationBias() + 0.5f));
+	shadowAtlas->setMaxTileSize(qualityGovernor.getShadowResolution(shadowAtlas->getAtlasSize() / 2));
+
+	// Decides which terrain patches and objects are visible before anything is drawn
+	occlusionPass();
+
+	// Uploads any GPU driven records that changed, and resets the draw arguments for this frame's culling
+	if (gpuDriven)
+	{
+		gpuScene->beginFrame(getDeviceContext());
+	}
+
+	// Upload the virtual texture pages requested by previous frames, then record which pages are visible this frame
+	if (useVirtualTexture)
+	{
+		virtualHeightMap->update(getDeviceContext());
+		beginPass("Virtual Texture");
+		virtualTexturePass();
+		endPass("Virtual Texture");
+	}
+
+	// Rebuilds whatever part of the horizon map the heightmap has changed under
+	horizonMap->update(getDeviceContext());
+
+	// Uploads the tiles of the heightmap and its normals painted since the last frame
+	terrainEditor->update(getDeviceContext());
+
+	// Sizes the lights' shadow tiles, then only redraws the tiles whose light or scene has changed
+	updateShadowLights();
+
+	// Depth pass for Directional Light
+	beginPass("Directional Shadow");
+	if (frameState.lightActive[0] && shadowAtlas->needsRender(0))
+	{
+		depthPass1();
+	}
+	endPass("Directional Shadow");
+
+	// Depth pass for Spot Light
+	beginPass("Spot Shadow");
+	if (frameState.lightActive[2] && shadowAtlas->needsRender(1))
+	{
+		depthPass2();
+	}
+	endPass("Spot Shadow");
+
+	// Depth pass for Point Light, timed separately when drawn as six passes so the two can be compared
+	// All six faces are redrawn together, so any one of them needing it redraws the lot
+	const char* pointPass = pointShadowSixPass ? "Point Shadow (Six Pass)" : "Point Shadow";
+	beginPass(pointPass);
+	bool pointShadowDirty = false;
+	for (int face = 0; face < PointShadowMap::FACE_COUNT; face++)
+	{
+		pointShadowDirty = pointShadowDirty || shadowAtlas->needsRender(POINT_SHADOW_TILE + face);
+	}
+	if (frameState.lightActive[1] && pointShadows && pointShadowDirty)
+	{
+		depthPass3();
+	}
+
+	// Rebuilds the moment mips once every light's tiles have been filtered
+	shadowMoments->generateMips(getDeviceContext());
+	endPass(pointPass);
+
+	// Depth pass for Camera
+	beginPass("Camera Depth");
+	cameraDepthPass();
+	endPass("Camera Depth");
+
+	// Settles this frame's focus from the camera depth, or holds it at the manual focus
+	if (autofocus)
+	{
+		autofocusShader->releaseManualFocus();
+		autofocusShader->update(getDeviceContext(), depthTexture->getShaderResourceView(), dynamicResolution->getWidth(), dynamicResolution->getHeight(), depthTexture->getNearPlane(), depthTexture->getFarPlane(), depthTexture->isLinear(), timer->getTime());
+	}
+	else
+	{
+		autofocusShader->setManualFocus(getDeviceContext(), bokehSettings.focusDistance);
+	}
+
+	// Render pass to screen texture
+	beginPass("Screen");
+	screenPass();
+	endPass("Screen");
+
+	// Copies the scene and camera depth before the post processing reads them, to be read back a few frames later
+	if (captureColour || captureDepth)
+	{
+		beginPass("Capture");
+		if (captureColour)
+		{
+			frameCapture->capture(getDeviceContext(), colourCaptureStream, screenTexture->getShaderResourceView(), dynamicResolution->getWidth(), dynamicResolution->getHeight());
+		}
+		if (captureDepth)
+		{
+			frameCapture->capture(getDeviceContext(), depthCaptureStream, depthTexture->getShaderResourceView(), dynamicResolution->getWidth(), dynamicResolution->getHeight());
+		}
+		endPass("Capture");
+	}
+	frameCapture->update(getDeviceContext());
+
+	// Blur pass, or the bokeh pass which only blurs what is out of focus. The blur pass is left to the post stack when it runs
+	if (activeDOF && bokehDOF)
+	{
+		beginPass("Bokeh");
+		bokehPass();
+		endPass("Bokeh");
+	}
+	else if (!fusedPost)
+	{
+		beginPass("Blur");
+		blurPass();
+		endPass("Blur");
+	}
+
+	// The fused path blurs, blends and grades the scene in one dispatch, leaving the final pass only to upsample it
+	if (fusedPost)
+	{
+		beginPass("Post Stack");
+		postStackPass();
+		endPass("Post Stack");
+	}
+
+	// Queues the draw arguments for reading back the visible counts, and notes how long the CPU spent submitting the scene
+	if (gpuDriven)
+	{
+		gpuScene->readStats(getDeviceContext());
+	}
+	submitMilliseconds = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - submitStart).count();
+
+	// Depth of Field pass and render to screen
+	finalPass();
+
+	return true;
+}
+
+void App1::occlusionPass()
+{
+	XMMATRIX viewProjection = camera->getViewMatrix() * renderer->getProjectionMatrix();
+
+	// Gathers the bounds of every patch, followed by the point light, spot light and cube (which can be moved through the UI)
+	occlusionBounds.resize(objectBoundsStart + 3);
+	for (int patch = 0; patch < objectBoundsStart; patch++)
+	{
+		occlusionBounds[patch] = TplaneMesh->getPatchBounds(patch);
+	}
+	occlusionBounds[objectBoundsStart] = BoundingBox(XMFLOAT3(frameState.lightPosition[1][0], frameState.lightPosition[1][1], frameState.lightPosition[1][2]), XMFLOAT3(1.0f, 1.0f, 1.0f));
+	occlusionBounds[objectBoundsStart + 1] = BoundingBox(XMFLOAT3(frameState.lightPosition[2][0], frameState.lightPosition[2][1], frameState.lightPosition[2][2]), XMFLOAT3(1.0f, 1.0f, 1.0f));
+	occlusionBounds[objectBoundsStart + 2] = BoundingBox(XMFLOAT3(frameState.cubePosition[0], frameState.cubePosition[1], frameState.cubePosition[2]), XMFLOAT3(1.0f, 1.0f, 1.0f));
+
+	// With culling off everything is drawn
+	if (!occlusionCulling)
+	{
+		visibleFlags.assign(occlusionBounds.size(), 1);
+		visiblePatches.resize(objectBoundsStart);
+		for (int patch = 0; patch < objectBoundsStart; patch++)
+		{
+			visiblePatches[patch] = patch;
+		}
+		return;
+	}
+
+	if (softwareOcclusion)
+	{
+		// Rasterizes the occluder mesh from this frame's view, so the pyramid matches the current camera exactly
+		occlusionRasterizer->clear();
+		occlusionRasterizer->rasterize(occluderVertices, occluderIndices, viewProjection);
+		hiZ.build(occlusionRasterizer->getDepth(), occlusionRasterizer->getWidth(), occlusionRasterizer->getHeight(), occlusionRasterizer->getRowPitch());
+		XMStoreFloat4x4(&hiZViewProjection, viewProjection);
+		if (captureSoftwareDepth)
+		{
+			frameCapture->captureCpu(softwareDepthCaptureStream, occlusionRasterizer->getDepth(), occlusionRasterizer->getWidth(), occlusionRasterizer->getHeight(), occlusionRasterizer->getRowPitch() * sizeof(float), DXGI_FORMAT_R32_FLOAT);
+		}
+	}
+	else
+	{
+		// Picks up the newest pyramid the GPU has finished with, along with the view it was rendered from
+		XMMATRIX readbackViewProjection;
+		if (hiZBuildShader->readback(getDeviceContext(), hiZ, readbackViewProjection))
+		{
+			XMStoreFloat4x4(&hiZViewProjection, readbackViewProjection);
+		}
+	}
+
+	// Culls everything and compacts the visible patches into the draw list
+	occlusionCuller.cull(occlusionBounds, viewProjection, hiZ, XMLoadFloat4x4(&hiZViewProjection), visibleList, visibleFlags);
+	visiblePatches.clear();
+	for (int index : visibleList)
+	{
+		if (index < objectBoundsStart)
+		{
+			visiblePatches.push_back(index);
+		}
+	}
+
+	// Records the results along the benchmark flythrough
+	if (flythrough.isActive())
+	{
+		const OcclusionStats& stats = occlusionCuller.getStats();
+		float occludedFraction = occlusionCuller.getOccludedFraction();
+		occlusionLog.addRow({ flythrough.getTime(), (double)flythrough.getSegment(), (double)stats.tested, (double)stats.frustumCulled, (double)stats.occluded, (double)occludedFraction });
+		occludedFractionSum += occludedFraction;
+	}
+}
+
+bool App1::loadScene(const wchar_t* filename)
+{
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+	SceneFile scene;
+	if (!scene.open(filename))
+	{
+		return false;
+	}
+	sceneMapMilliseconds = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+	start = chrono::high_resolution_clock::now();
+
+	const SceneSettings& settings = scene.getSettings();
+	tessFactor = settings.tessFactor;
+	pixelNormals = settings.pixelNormals != 0;
+	specIntensity = settings.specIntensity;
+	specExponent = settings.specExponent;
+	activeDOF = settings.depthOfField != 0;
+	weighting = settings.dofWeighting;
+	cutoff = settings.dofCutoff;
+	percentage = settings.dofPercentage;
+	horizonShadows = settings.horizonShadows != 0;
+	pointShadows = settings.pointShadows != 0;
+
+	// Light types are numbered the same as the light array, so each type's first light fills its slot
+	bool lightLoaded[SCENE_LIGHT_TYPE_COUNT] = { false, false, false };
+	for (int i = 0; i < scene.getLightCount(); i++)
+	{
+		const SceneLight& light = scene.getLights()[i];
+		if (light.type >= SCENE_LIGHT_TYPE_COUNT || lightLoaded[light.type])
+		{
+			continue;
+		}
+		lightLoaded[light.type] = true;
+		activeLight[light.type] = light.active != 0;
+		switch (light.type)
+		{
+		case SCENE_LIGHT_DIRECTIONAL:
+			memcpy(lightDir1, &light.direction, sizeof(lightDir1));
+			memcpy(lightDif1, &light.diffuse, sizeof(lightDif1));
+			memcpy(lightAmb1, &light.ambient, sizeof(lightAmb1));
+			break;
+		case SCENE_LIGHT_POINT:
+			memcpy(lightPos2, &light.position, sizeof(lightPos2));
+			memcpy(lightDif2, &light.diffuse, sizeof(lightDif2));
+			memcpy(lightAmb2, &light.ambient, sizeof(lightAmb2));
+			dropoff2 = light.dropoff;
+			break;
+		case SCENE_LIGHT_SPOT:
+			memcpy(lightDir3, &light.direction, sizeof(lightDir3));
+			memcpy(lightPos3, &light.position, sizeof(lightPos3));
+			memcpy(lightDif3, &light.diffuse, sizeof(lightDif3));
+			memcpy(lightAmb3, &light.ambient, sizeof(lightAmb3));
+			cutOffAngle = light.cutoff;
+			break;
+		}
+	}
+
+	// Objects are added straight from the mapped instances, the only copy being into the GPU driven scene's records
+	const SceneInstance* instances = scene.getInstances();
+	bool cubeLoaded = false;
+	gpuScene->clearObjects();
+	gpuScene->reserveObjects(scene.getInstanceCount());
+	for (int i = 0; i < scene.getInstanceCount(); i++)
+	{
+		if (instances[i].mesh == SCENE_MESH_SPHERE)
+		{
+			gpuScene->addObject(instances[i].position, instances[i].scale);
+		}
+		else if (instances[i].mesh == SCENE_MESH_CUBE && !cubeLoaded)
+		{
+			memcpy(cubePos, &instances[i].position, sizeof(cubePos));
+			cubeLoaded = true;
+		}
+	}
+	objectCount = gpuScene->getObjectCount();
+	shadowAtlas->invalidateAll();
+
+	sceneApplyMilliseconds = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+	sceneInstanceCount = scene.getInstanceCount();
+	sceneBytes = scene.getBytes();
+	return true;
+}
+
+SceneData App1::buildScene()
+{
+	SceneData scene;
+	SceneSettings& settings = scene.settings;
+	settings.tessFactor = tessFactor;
+	settings.pixelNormals = pixelNormals ? 1 : 0;
+	settings.specIntensity = specIntensity;
+	settings.specExponent = specExponent;
+	settings.depthOfField = activeDOF ? 1 : 0;
+	settings.dofWeighting = weighting;
+	settings.dofCutoff = cutoff;
+	settings.dofPercentage = percentage;
+	settings.horizonShadows = horizonShadows ? 1 : 0;
+	settings.pointShadows = pointShadows ? 1 : 0;
+
+	// Every light is written with all of its fields, the ones its type doesn't use left at zero
+	scene.lights.resize(SCENE_LIGHT_TYPE_COUNT);
+	memset(scene.lights.data(), 0, sizeof(SceneLight) * scene.lights.size());
+	for (int type = 0; type < SCENE_LIGHT_TYPE_COUNT; type++)
+	{
+		scene.lights[type].type = type;
+		scene.lights[type].active = activeLight[type] ? 1 : 0;
+	}
+	memcpy(&scene.lights[SCENE_LIGHT_DIRECTIONAL].direction, lightDir1, sizeof(lightDir1));
+	memcpy(&scene.lights[SCENE_LIGHT_DIRECTIONAL].diffuse, lightDif1, sizeof(lightDif1));
+	memcpy(&scene.lights[SCENE_LIGHT_DIRECTIONAL].ambient, lightAmb1, sizeof(lightAmb1));
+	memcpy(&scene.lights[SCENE_LIGHT_POINT].position, lightPos2, sizeof(lightPos2));
+	memcpy(&scene.lights[SCENE_LIGHT_POINT].diffuse, lightDif2, sizeof(lightDif2));
+	memcpy(&scene.lights[SCENE_LIGHT_POINT].ambient, lightAmb2, sizeof(lightAmb2));
+	scene.lights[SCENE_LIGHT_POINT].dropoff = dropoff2;
+	memcpy(&scene.lights[SCENE_LIGHT_SPOT].direction, lightDir3, sizeof(lightDir3));
+	memcpy(&scene.lights[SCENE_LIGHT_SPOT].position, lightPos3, sizeof(lightPos3));
+	memcpy(&scene.lights[SCENE_LIGHT_SPOT].diffuse, lightDif3, sizeof(lightDif3));
+	memcpy(&scene.lights[SCENE_LIGHT_SPOT].ambient, lightAmb3, sizeof(lightAmb3));
+	scene.lights[SCENE_LIGHT_SPOT].cutoff = cutOffAngle;
+
+	// The cube, then every object
+	scene.instances.resize(gpuScene->getObjectCount() + 1);
+	scene.instances[0].position = XMFLOAT3(cubePos[0], cubePos[1], cubePos[2]);
+	scene.instances[0].scale = 1.0f;
+	scene.instances[0].mesh = SCENE_MESH_CUBE;
+	scene.instances[0].padding = 0;
+	for (int object = 0; object < gpuScene->getObjectCount(); object++)
+	{
+		const GpuDrawRecord& record = gpuScene->getObject(object);
+		SceneInstance& instance = scene.instances[object + 1];
+		instance.position = record.center;
+		instance.scale = record.radius;
+		instance.mesh = SCENE_MESH_SPHERE;
+		instance.padding = 0;
+	}
+	return scene;
+}
+
+bool App1::saveScene()
+{
+	SceneData scene = buildScene();
+	bool saved = SceneJson::save(L"res/scene.json", scene);
+	return SceneFile::write(L"res/scene.scnb", scene) && saved;
+}
+
+FrameState App1::captureFrameState()
+{
+	FrameState state;
+	state.cameraPosition = camera->getPosition();
+	state.cameraRotation = camera->getRotation();
+
+	// The directional light has no position of its own and the point light always faces down, so those are left as the lights hold them
+	const float* directions[3] = { lightDir1, 0, lightDir3 };
+	const float* positions[3] = { 0, lightPos2, lightPos3 };
+	const float* diffuse[3] = { lightDif1, lightDif2, lightDif3 };
+	const float* ambient[3] = { lightAmb1, lightAmb2, lightAmb3 };
+	for (int light = 0; light < 3; light++)
+	{
+		XMFLOAT3 direction = lightArray[light]->getDirection();
+		XMFLOAT3 position = lightArray[light]->getPosition();
+		state.lightActive[light] = activeLight[light];
+		memcpy(state.lightDirection[light], directions[light] ? directions[light] : &direction.x, sizeof(state.lightDirection[light]));
+		memcpy(state.lightPosition[light], positions[light] ? positions[light] : &position.x, sizeof(state.lightPosition[light]));
+		memcpy(state.lightDiffuse[light], diffuse[light], sizeof(state.lightDiffuse[light]));
+		memcpy(state.lightAmbient[light], ambient[light], sizeof(state.lightAmbient[light]));
+	}
+	state.pointDropoff = dropoff2;
+	state.spotCutoff = cutOffAngle;
+	memcpy(state.cubePosition, cubePos, sizeof(state.cubePosition));
+
+	state.tessFactor = tessFactor;
+	state.pixelNormals = pixelNormals;
+	state.specIntensity = specIntensity;
+	state.specExponent = specExponent;
+	return state;
+}
+
+void App1::applyFrameState()
+{
+	lightArray[0]->setDirection(frameState.lightDirection[0][0], frameState.lightDirection[0][1], frameState.lightDirection[0][2]);
+	lightArray[1]->setPosition(frameState.lightPosition[1][0], frameState.lightPosition[1][1], frameState.lightPosition[1][2]);
+	lightArray[2]->setDirection(frameState.lightDirection[2][0], frameState.lightDirection[2][1], frameState.lightDirection[2][2]);
+	lightArray[2]->setPosition(frameState.lightPosition[2][0], frameState.lightPosition[2][1], frameState.lightPosition[2][2]);
+	for (int light = 0; light < 3; light++)
+	{
+		const float* diffuse = frameState.lightDiffuse[light];
+		const float* ambient = frameState.lightAmbient[light];
+		lightArray[light]->setDiffuseColour(diffuse[0], diffuse[1], diffuse[2], diffuse[3]);
+		lightArray[light]->setAmbientColour(ambient[0], ambient[1], ambient[2], ambient[3]);
+	}
+}
+
+void App1::loadCookedTextures(bool recook)
+{
+	ID3D11Device* device = renderer->getDevice();
+	if (cookedHeightTexture)
+	{
+		cookedHeightTexture->Release();
+		cookedHeightTexture = 0;
+	}
+	if (cookedNormalTexture)
+	{
+		cookedNormalTexture->Release();
+		cookedNormalTexture = 0;
+	}
+	if (cookedBrickTexture)
+	{
+		cookedBrickTexture->Release();
+		cookedBrickTexture = 0;
+	}
+
+	// Cooks a texture only when asked to or when its file won't load, so a normal start just reads the three files
+	if (!recook)
+	{
+		cookedHeightTexture = TextureCooker::load(device, L"res/height.ctex");
+		cookedNormalTexture = TextureCooker::load(device, L"res/height_normal.ctex");
+		cookedBrickTexture = TextureCooker::load(device, L"res/brick1.ctex");
+	}
+
+	// Each texture cooked adds a row of its encode to decode error, the texture being 0 for the heightmap, 1 its normals and 2 the brick
+	auto logCook = [this](int texture)
+	{
+		if (!cookLog.isOpen())
+		{
+			cookLog.open("texture_cook.csv", { "texture", "format", "width", "height", "mips", "encode_ms", "rms_error", "max_error", "psnr_db", "mip_max_error", "worst_mip", "worst_mip_psnr_db" });
+		}
+		const CookReport& report = cookReports[texture];
+		cookLog.addRow({ (double)texture, (double)report.format, (double)report.width, (double)report.height, (double)report.mipCount, report.encodeMilliseconds,
+			report.rmsError, report.maxError, report.psnr, report.mipMaxError, (double)report.worstMip, report.worstMipPsnr });
+	};
+	if (!cookedHeightTexture && heightField->getWidth() > 0)
+	{
+		DXGI_FORMAT heightFormat = cookedHeightFormat == 1 ? DXGI_FORMAT_BC4_UNORM : DXGI_FORMAT_R16_UNORM;
+		if (TextureCooker::cookHeightMap(*heightField, L"res/height.ctex", heightFormat, TextureCooker::getTextureBytes(textureMgr->getTexture(L"heightMap")), cookReports[0]))
+		{
+			logCook(0);
+		}
+		cookedHeightTexture = TextureCooker::load(device, L"res/height.ctex");
+	}
+	if (!cookedNormalTexture && heightField->getWidth() > 0)
+	{
+		if (TextureCooker::cookNormalMap(*heightField, 100.0f, 30.0f, L"res/height_normal.ctex", cookReports[1]))
+		{
+			logCook(1);
+		}
+		cookedNormalTexture = TextureCooker::load(device, L"res/height_normal.ctex");
+	}
+	if (!cookedBrickTexture)
+	{
+		if (TextureCooker::cookColour(device, getDeviceContext(), textureMgr->getTexture(L"brick"), L"res/brick1.ctex", cookReports[2]))
+		{
+			logCook(2);
+		}
+		cookedBrickTexture = TextureCooker::load(device, L"res/brick1.ctex");
+	}
+	tessellationShader->setNormalMap(getNormalMap());
+	gpuTessellationShader->setNormalMap(getNormalMap());
+}
+
+ID3D11ShaderResourceView* App1::getHeightMap()
+{
+	if (terrainEditor->hasEdits())
+	{
+		return terrainEditor->getHeightSRV();
+	}
+	return useCookedTextures && cookedHeightTexture ? cookedHeightTexture : textureMgr->getTexture(L"heightMap");
+}
+
+ID3D11ShaderResourceView* App1::getNormalMap()
+{
+	if (!useCookedTextures)
+	{
+		return NULL;
+	}
+	return terrainEditor->hasEdits() ? terrainEditor->getNormalSRV() : cookedNormalTexture;
+}
+
+void App1::editTerrain(TerrainBrush brush, float x, float z, float strength)
+{
+	// The update thread reads the heights through the terrain query when colliding the camera, so waits out the brush and refit
+	TerrainEditRegion region;
+	bool firstEdit = !terrainEditor->hasEdits();
 	{
-		delete pointlightMesh;
-		pointlightMesh = 0;
+		lock_guard<mutex> guard(framePipeline->getTerrainLock());
+		if (!terrainEditor->applyBrush(brush, x, z, brushRadius, strength, region))
+		{
+			return;
+		}
+		terrainQuery->invalidate(region.x0, region.y0, region.x1, region.y1);
 	}
-	if (spotlightMesh)
+
+	// Everything else built from the heights is refitted over just the texels the brush changed
+	horizonMap->invalidate(region.x0, region.y0, region.x1, region.y1);
+	TplaneMesh->refitPatchBounds(*heightField, 30.0f, region.x0, region.y0, region.x1, region.y1, refittedPatches);
+	for (int patch : refittedPatches)
 	{
-		delete spotlightMesh;
-		spotlightMesh = 0;
+		gpuScene->updatePatch(patch);
 	}
-	if (cube1)
+	TplaneMesh->refitOccluderMesh(*heightField, 30.0f, 32, occluderVertices, region.x0, region.y0, region.x1, region.y1);
+	terrainEdited = true;
+	useVirtualTexture = false;
+	if (firstEdit)
 	{
-		delete cube1;
-		cube1 = 0;
+		tessellationShader->setNormalMap(getNormalMap());
+		gpuTessellationShader->setNormalMap(getNormalMap());
 	}
+}
 
-	// Delete screen textures and depth map pointers, to prevent memory leak
-	if (shadowMap[0])
+ID3D11ShaderResourceView* App1::getBrickTexture()
+{
+	return useCookedTextures && cookedBrickTexture ? cookedBrickTexture : textureMgr->getTexture(L"brick");
+}
+
+void App1::populateObjects(int count)
+{
+	objectCount = count;
+	gpuScene->clearObjects();
+	shadowAtlas->invalidateAll();
+	if (heightField->getWidth() == 0)
 	{
-		delete shadowMap[0];
-		shadowMap[0] = 0;
+		return;
 	}
-	if (shadowMap[1])
+
+	// Scatters the objects across the terrain with a fixed seed so every run places them identically, resting each one on the surface
+	mt19937 random(1234);
+	uniform_real_distribution<float> position(0.0f, 99.0f);
+	uniform_real_distribution<float> size(0.2f, 0.6f);
+	for (int object = 0; object < count; object++)
 	{
-		delete shadowMap[1];
-		shadowMap[1] = 0;
+		float x = position(random);
+		float z = position(random);
+		float radius = size(random);
+		float height = terrainQuery->getHeight(x, z);
+		gpuScene->addObject(XMFLOAT3(x, height + radius, z), radius);
 	}
-	if (screenTexture)
+}
+
+void App1::runShadowQualityComparison()
+{
+	if (heightField->getWidth() == 0)
 	{
-		delete screenTexture;
-		screenTexture = 0;
+		return;
 	}
-	if (blurTexture)
+
+	// A finer grid than the occlusion culler's, which casts the shadows and is also shaded as the receivers
+	vector<XMFLOAT3> vertices;
+	vector<unsigned int> indices;
+	TplaneMesh->buildOccluderMesh(*heightField, 30.0f, 128, vertices, indices);
+
+	// Every filter at its tuned settings, apart from the one currently selected which uses the settings in the UI
+	vector<ShadowFilterSettings> settings;
+	for (int mode = 0; mode < SHADOW_FILTER_MODES; mode++)
 	{
-		delete blurTexture;
-		blurTexture = 0;
+		settings.push_back(mode == shadowFilter.mode ? shadowFilter : ShadowMoments::getDefaultSettings((ShadowFilterMode)mode));
 	}
-	if (depthTexture)
+
+	// Measured against the largest tile the hard shadows are given, from the Directional Light
+	XMMATRIX lightViewProjection = lightArray[0]->getViewMatrix() * lightArray[0]->getOrthoMatrix();
+	shadowQualityBenchmark.run("shadow_quality.csv", vertices, indices, vertices, lightViewProjection, { 256, 512, 1024, 2048 }, settings, SHADOW_MAP_SIZE / 2);
+}
+
+void App1::renderSceneDepth(GpuView view, const XMMATRIX& viewMatrix, const XMMATRIX& projectionMatrix, bool cpuCulledPatches, bool drawTerrain)
+{
+	XMMATRIX worldMatrix = renderer->getWorldMatrix();
+
+	if (gpuDriven)
 	{
-		delete depthTexture;
-		depthTexture = 0;
+		// Culls the patches and objects for this view, against last frame's Hi-Z pyramid if it's the camera
+		bool useHiZ = view == GPU_VIEW_CAMERA && occlusionCulling && !softwareOcclusion && hiZBuildShader->hasBuilt();
+		gpuCullShader->cull(getDeviceContext(), gpuScene, view, viewMatrix * projectionMatrix, camera->getPosition(), renderTessFactor, XMFLOAT4(lodDistances), useHiZ ? hiZBuildShader : NULL, hiZBuildShader->getBuiltViewProjection());
+
+		// Draws every visible patch with a single indirect draw
+		if (drawTerrain)
+		{
+			TplaneMesh->sendData(getDeviceContext(), D3D_PRIMITIVE_TOPOLOGY_4_CONTROL_POINT_PATCHLIST);
+			gpuDepthTessellationShader->setShaderParameters(getDeviceContext(), worldMatrix, viewMatrix, projectionMatrix, getHeightMap(), renderTessFactor);
+			gpuDepthTessellationShader->setVirtualTexture(getDeviceContext(), virtualHeightMap, renderTessFactor, useVirtualTexture);
+			gpuDepthTessellationShader->bindStages(getDeviceContext());
+			gpuScene->drawPatches(getDeviceContext(), view);
+		}
+
+		// Draws the visible objects with one indirect draw per level of detail
+		lodSphereMesh->sendData(getDeviceContext());
+		gpuDepthShader->setShaderParameters(getDeviceContext(), worldMatrix, viewMatrix, projectionMatrix);
+		gpuDepthShader->bindStages(getDeviceContext());
+		gpuScene->drawObjects(getDeviceContext(), view);
+		return;
 	}
+
+	renderSceneDepthDirect(viewMatrix, projectionMatrix, cpuCulledPatches, drawTerrain);
 }
 
-bool App1::frame()
+void App1::renderSceneDepthDirect(const XMMATRIX& viewMatrix, const XMMATRIX& projectionMatrix, bool cpuCulledPatches, bool drawTerrain)
 {
-	bool result;
+	XMMATRIX worldMatrix = renderer->getWorldMatrix();
 
-	result = BaseApplication::frame();
-	if (!result)
+	// Sends the plane data to the Depth Tessellation Shader and returns a depth value
+	if (drawTerrain)
 	{
-		return false;
+		TplaneMesh->sendData(getDeviceContext(), D3D_PRIMITIVE_TOPOLOGY_4_CONTROL_POINT_PATCHLIST);
+		depthTessellationShader->setShaderParameters(getDeviceContext(), worldMatrix, viewMatrix, projectionMatrix, getHeightMap(), renderTessFactor);
+		depthTessellationShader->setVirtualTexture(getDeviceContext(), virtualHeightMap, renderTessFactor, useVirtualTexture);
+		if (cpuCulledPatches)
+		{
+			depthTessellationShader->renderPatches(getDeviceContext(), TplaneMesh, visiblePatches);
+		}
+		else
+		{
+			depthTessellationShader->render(getDeviceContext(), TplaneMesh->getIndexCount());
+		}
 	}
-	
-	// Render the graphics.
-	result = render();
-	if (!result)
+
+	// Draws every object one at a time
+	lodSphereMesh->sendData(getDeviceContext());
+	for (int object = 0; object < gpuScene->getObjectCount(); object++)
 	{
-		return false;
+		const GpuDrawRecord& record = gpuScene->getObject(object);
+		XMMATRIX objectMatrix = XMMatrixScaling(record.radius, record.radius, record.radius) * XMMatrixTranslation(record.center.x, record.center.y, record.center.z);
+		depthShader->setShaderParameters(getDeviceContext(), worldMatrix * objectMatrix, viewMatrix, projectionMatrix);
+		depthShader->render(getDeviceContext(), lodSphereMesh->getLodIndexCount(0));
 	}
-
-	return true;
 }
 
-bool App1::render()
+void App1::virtualTexturePass()
 {
-	// Depth pass for Directional Light
-	depthPass1();
+	// Empties the feedback target and sets it as render target
+	virtualHeightMap->beginFeedback(getDeviceContext());
 
-	// Depth pass for Spot Light
-	depthPass2();
+	// Generates a view matrix from the camera's perspective, as well as a projection and world matrix from the renderer
+	XMMATRIX worldMatrix = renderer->getWorldMatrix();
+	XMMATRIX viewMatrix = camera->getViewMatrix();
+	XMMATRIX projectionMatrix = renderer->getProjectionMatrix();
 
-	// Depth pass for Camera
-	cameraDepthPass();
+	// Sends the plane data to the Feedback Shader, which writes out the page each pixel of the terrain needs
+	TplaneMesh->sendData(getDeviceContext(), D3D_PRIMITIVE_TOPOLOGY_4_CONTROL_POINT_PATCHLIST);
+	virtualTextureFeedbackShader->setShaderParameters(getDeviceContext(), worldMatrix, viewMatrix, projectionMatrix, getHeightMap(), renderTessFactor, virtualHeightMap, useVirtualTexture);
+	virtualTextureFeedbackShader->render(getDeviceContext(), TplaneMesh->getIndexCount());
 
-	// Render pass to screen texture
-	screenPass();
+	// Queues the feedback for reading back, and stops writing to it
+	virtualHeightMap->endFeedback(getDeviceContext());
+	renderer->setBackBufferRenderTarget();
+	renderer->resetViewport();
+}
 
-	// Blur pass
-	blurPass();
+void App1::applyMemoryBudgets()
+{
+	MemoryTracker* memory = MemoryTracker::get();
+	const unsigned long long MB = 1024 * 1024;
 
-	// Depth of Field pass and render to screen
-	finalPass();
+	// The hard filter needs the full resolution atlas, so the moment filters' smaller atlas and blurred moments are the saving to make
+	MemoryBudgetCallback shrinkShadows = [this](const MemoryBudgetEvent& event)
+	{
+		if (shadowFilter.mode == SHADOW_FILTER_HARD)
+		{
+			shadowFilter = ShadowMoments::getDefaultSettings(SHADOW_FILTER_VSM);
+			createShadowAtlas();
+			memoryDowngrades.push_back(string(event.category == MEMORY_CATEGORIES ? "GPU" : "Shadow") + " budget: shadows switched to VSM");
+		}
+	};
+	for (int i = 0; i < MEMORY_CATEGORIES; i++)
+	{
+		memory->setBudget((MemoryCategory)i, memoryBudgets[i] * MB);
+	}
+	memory->setBudget(MEMORY_SHADOW, memoryBudgets[MEMORY_SHADOW] * MB, shrinkShadows);
+	memory->setGpuBudget(gpuMemoryBudget * MB, shrinkShadows);
 
-	return true;
+	memory->setBudget(MEMORY_TEXTURE, memoryBudgets[MEMORY_TEXTURE] * MB, [this](const MemoryBudgetEvent& event)
+	{
+		if (cookedHeightFormat == 0)
+		{
+			cookedHeightFormat = 1;
+			loadCookedTextures(true);
+			memoryDowngrades.push_back("Texture budget: heightmap recooked as BC4");
+		}
+	});
+
+	// Captures already read back keep their staging textures until they're written, but no more are taken
+	memory->setBudget(MEMORY_STAGING, memoryBudgets[MEMORY_STAGING] * MB, [this](const MemoryBudgetEvent& event)
+	{
+		if (captureColour || captureDepth || captureSoftwareDepth)
+		{
+			captureColour = false;
+			captureDepth = false;
+			captureSoftwareDepth = false;
+			memoryDowngrades.push_back("Staging budget: frame capture stopped");
+		}
+	});
 }
 
-void App1::depthPass1()
+void App1::updateMemory()
 {
-	// Empties the shadow map and prepares it for use
-	shadowMap[0]->BindDsvAndSetNullRenderTarget(renderer->getDeviceContext());
+	MemoryTracker::setHostBytes("Height field", (unsigned long long)heightField->getWidth() * heightField->getHeight() * sizeof(float));
+	MemoryTracker::setHostBytes("Terrain query", terrainQuery->getBytes());
+	MemoryTracker::setHostBytes("Terrain editor mips", terrainEditor->getCpuBytes());
+	MemoryTracker::setHostBytes("Occlusion rasterizer", occlusionRasterizer->getBytes());
+	MemoryTracker::setHostBytes("Occluder mesh", occluderVertices.capacity() * sizeof(XMFLOAT3) + occluderIndices.capacity() * sizeof(unsigned int));
+
+	// Settling again after a later change rewrites the snapshot with the new steady state, and adds a row beside the last
+	MemoryTracker* memory = MemoryTracker::get();
+	if (memory->update())
+	{
+		memory->writeSnapshot("memory_steady.json");
+
+		if (!memoryLog.isOpen())
+		{
+			memoryLog.open("memory_steady.csv", { "frame", "steady_frame", "peak_gpu_mb", "peak_host_mb", "steady_gpu_mb", "steady_host_mb", "steady_resized_kb" });
+		}
+		const double MB = 1024.0 * 1024.0;
+		memoryLog.addRow({ (double)memory->getFrame(), (double)memory->getSteadyFrame(), memory->getPeakGpuBytes() / MB, memory->getPeakHostBytes() / MB,
+			memory->getSteadyGpuBytes() / MB, memory->getSteadyHostBytes() / MB, memory->getSteadyResizedBytes() / 1024.0 });
+	}
+}
 
-	// Generates a view matrix from the light's perspective
-	lightArray[0]->generateViewMatrix();
+void App1::createShadowAtlas()
+{
+	// Moment filtering hides the aliasing the hard filter can only fight with resolution, so a far smaller atlas gives the same quality
+	int atlasSize = shadowFilter.mode == SHADOW_FILTER_HARD ? SHADOW_MAP_SIZE : MOMENT_SHADOW_MAP_SIZE;
+	if (!shadowAtlas || shadowAtlas->getAtlasSize() != atlasSize)
+	{
+		if (shadowAtlas)
+		{
+			delete shadowAtlas;
+		}
+		shadowAtlas = new ShadowAtlas(renderer->getDevice(), hwnd, atlasSize, POINT_SHADOW_TILE + PointShadowMap::FACE_COUNT);
+	}
+	shadowMoments->resize(shadowFilter.mode == SHADOW_FILTER_HARD ? 0 : atlasSize);
+	shadowAtlas->invalidateAll();
+}
 
-	// Offsets the direction light depending on it's direction, so the shadow map covers the screen
+void App1::updateShadowLights()
+{
+	// Offsets the direction light depending on it's direction, so the shadow map covers the screen, then generates a view matrix from the light's perspective
 	XMFLOAT3 lightOffset = lightArray[0]->getDirection();
 	lightOffset = XMFLOAT3(-lightOffset.x * 50, -lightOffset.y * 50, -lightOffset.z * 50);
 	lightArray[0]->setPosition(lightOffset.x + 50.0f, lightOffset.y, lightOffset.z + 50.0f);
+	lightArray[0]->generateViewMatrix();
+
+	// Generates a view and projection matrix from the Spot Light's perspective, using the SCREEN_NEAR and SCREEN_FAR values
+	lightArray[2]->generateViewMatrix();
+	lightArray[2]->generateProjectionMatrix(0.1f, 200.0f);
+
+	// A light that moved or turned needs its tile redrawn
+	shadowAtlas->setLightViewProjection(0, lightArray[0]->getViewMatrix() * lightArray[0]->getOrthoMatrix());
+	shadowAtlas->setLightViewProjection(1, lightArray[2]->getViewMatrix() * lightArray[2]->getProjectionMatrix());
+
+	// The directional light reaches everything on screen, so always asks for the largest tile
+	// The spot light asks for a tile in proportion to how much of the screen the near part of its cone covers
+	XMVECTOR spotDirection = XMVector3Normalize(XMVectorSet(frameState.lightDirection[2][0], frameState.lightDirection[2][1], frameState.lightDirection[2][2], 0.0f));
+	XMFLOAT3 spotCentre;
+	XMStoreFloat3(&spotCentre, XMVectorSet(frameState.lightPosition[2][0], frameState.lightPosition[2][1], frameState.lightPosition[2][2], 1.0f) + spotDirection * (spotShadowRange * 0.5f));
+	float spotImportance = ShadowAtlas::screenCoverage(BoundingSphere(spotCentre, spotShadowRange * 0.5f), camera->getViewMatrix(), renderer->getProjectionMatrix());
+	shadowAtlas->setImportance(0, frameState.lightActive[0] ? 1.0f : 0.0f);
+	shadowAtlas->setImportance(1, frameState.lightActive[2] ? spotImportance : 0.0f);
+
+	// The point light's attenuation reaches zero 1 / dropoff units away, so its faces only need to reach that far
+	// Every face asks for a tile in proportion to how much of the screen the light's reach covers
+	float pointRange = frameState.pointDropoff > 0.0f ? min(1.0f / frameState.pointDropoff, 200.0f) : 200.0f;
+	XMFLOAT3 pointPosition(frameState.lightPosition[1][0], frameState.lightPosition[1][1], frameState.lightPosition[1][2]);
+	pointShadow->setLight(pointPosition, pointRange);
+	float pointImportance = ShadowAtlas::screenCoverage(BoundingSphere(pointPosition, pointRange), camera->getViewMatrix(), renderer->getProjectionMatrix());
+	for (int face = 0; face < PointShadowMap::FACE_COUNT; face++)
+	{
+		shadowAtlas->setLightViewProjection(POINT_SHADOW_TILE + face, pointShadow->getFaceViewProjection(face));
+		shadowAtlas->setImportance(POINT_SHADOW_TILE + face, frameState.lightActive[1] && pointShadows ? pointImportance : 0.0f);
+	}
+
+	// Redraws every tile when anything casting shadows has changed, including the heights streamed in or painted since the last frame
+	// The filter settings the moments are encoded and blurred with count as part of the scene, as does the point light's reach, which decides the faces it culls,
+	// and whether the terrain is drawn into the shadow maps or shadows itself through the horizon map. Everything is redrawn every frame when measuring the passes
+	float scene[12] = { frameState.cubePosition[0], frameState.cubePosition[1], frameState.cubePosition[2], (float)renderTessFactor, (float)(useVirtualTexture ? 1 : 0), (float)(gpuDriven ? 1 : 0),
+		(float)shadowFilter.mode, (float)shadowFilter.blurRadius, shadowFilter.positiveExponent, shadowFilter.negativeExponent, pointRange, (float)(horizonShadows ? 1 : 0) };
+	bool heightsStreamed = useVirtualTexture && virtualHeightMap->getStats().pagesUploaded > 0;
+	if (memcmp(scene, shadowScene, sizeof(scene)) != 0 || heightsStreamed || terrainEdited || shadowRedraw)
+	{
+		memcpy(shadowScene, scene, sizeof(scene));
+		shadowAtlas->invalidateAll();
+		terrainEdited = false;
+	}
+
+	shadowAtlas->update();
+}
+
+void App1::depthPass1()
+{
+	// Empties the Directional Light's tile of the shadow atlas and prepares it for use
+	shadowAtlas->beginTile(getDeviceContext(), 0);
 
 	// Generates an ortho and view matrix from the Direction Light, and gets the world matrix
 	XMMATRIX lightViewMatrix = lightArray[0]->getViewMatrix();
@@ -225,35 +1505,34 @@ void App1::depthPass1()
 	XMMATRIX worldMatrix = renderer->getWorldMatrix();
 	XMMATRIX translate = XMMatrixIdentity();
 
-	// Sends the data to the Depth Tessellation Shader and returns a depth value
-	TplaneMesh->sendData(renderer->getDeviceContext(), D3D_PRIMITIVE_TOPOLOGY_4_CONTROL_POINT_PATCHLIST);
-	depthTessellationShader->setShaderParameters(renderer->getDeviceContext(), worldMatrix, lightViewMatrix, lightProjectionMatrix, textureMgr->getTexture(L"heightMap"), tessFactor);
-	depthTessellationShader->render(renderer->getDeviceContext(), TplaneMesh->getIndexCount());
+	// Draws the objects from the Directional Light's view, and the terrain unless it shadows itself through the horizon map
+	renderSceneDepth(GPU_VIEW_DIRECTIONAL, lightViewMatrix, lightProjectionMatrix, false, !horizonShadows);
 
 	// Moves to the cube mesh's position
-	translate *= XMMatrixTranslation(cubePos[0], cubePos[1], cubePos[2]);
+	translate *= XMMatrixTranslation(frameState.cubePosition[0], frameState.cubePosition[1], frameState.cubePosition[2]);
 	worldMatrix = worldMatrix * translate;
 
 	// Sends the data to the Depth Shader and returns a depth value
-	cube1->sendData(renderer->getDeviceContext());
-	depthShader->setShaderParameters(renderer->getDeviceContext(), worldMatrix, lightViewMatrix, lightProjectionMatrix);
-	depthShader->render(renderer->getDeviceContext(), cube1->getIndexCount());
+	cube1->sendData(getDeviceContext());
+	depthShader->setShaderParameters(getDeviceContext(), worldMatrix, lightViewMatrix, lightProjectionMatrix);
+	depthShader->render(getDeviceContext(), cube1->getIndexCount());
 
-	// Resets the viewport and stops writing to the Shadow Map
+	// Resets the viewport and stops writing to the Shadow Atlas, which holds this light's shadows until something changes
 	renderer->setBackBufferRenderTarget();
 	renderer->resetViewport();
+	shadowAtlas->endTile(0);
+
+	// Turns the new depths into blurred moments when a moment filter is in use
+	if (shadowFilter.mode != SHADOW_FILTER_HARD)
+	{
+		shadowMoments->filterTile(getDeviceContext(), shadowAtlas->getShaderResourceView(), shadowAtlas->getTile(0), shadowFilter, false);
+	}
 }
 
 void App1::depthPass2()
 {
-	// Empties the shadow map and prepares it for use
-	shadowMap[1]->BindDsvAndSetNullRenderTarget(renderer->getDeviceContext());
-
-	// Generates a view matrix from the light's perspective
-	lightArray[2]->generateViewMatrix();
-
-	// Generates a projection matrix from the light's perspective, using the SCREEN_NEAR and SCREEN_FAR values 
-	lightArray[2]->generateProjectionMatrix(0.1f, 200.0f);
+	// Empties the Spot Light's tile of the shadow atlas and prepares it for use
+	shadowAtlas->beginTile(getDeviceContext(), 1);
 
 	// Generates an projection and view matrix from the Spot Light, and gets the world matrix
 	XMMATRIX lightViewMatrix = lightArray[2]->getViewMatrix();
@@ -261,30 +1540,126 @@ void App1::depthPass2()
 	XMMATRIX worldMatrix = renderer->getWorldMatrix();
 	XMMATRIX translate = XMMatrixIdentity();
 
-	// Sends the plane data to the Depth Tessellation Shader and returns a depth value
-	TplaneMesh->sendData(renderer->getDeviceContext(), D3D_PRIMITIVE_TOPOLOGY_4_CONTROL_POINT_PATCHLIST);
-	depthTessellationShader->setShaderParameters(renderer->getDeviceContext(), worldMatrix, lightViewMatrix, lightProjectionMatrix, textureMgr->getTexture(L"heightMap"), tessFactor);
-	depthTessellationShader->render(renderer->getDeviceContext(), TplaneMesh->getIndexCount());
+	// Draws the objects from the Spot Light's view, and the terrain unless it shadows itself through the horizon map
+	renderSceneDepth(GPU_VIEW_SPOT, lightViewMatrix, lightProjectionMatrix, false, !horizonShadows);
 
 	// Moves to the cube mesh's position
-	translate *= XMMatrixTranslation(cubePos[0], cubePos[1], cubePos[2]);
+	translate *= XMMatrixTranslation(frameState.cubePosition[0], frameState.cubePosition[1], frameState.cubePosition[2]);
 	worldMatrix = worldMatrix * translate;
 
 	// Sends the data to the Depth Shader and returns a depth value
-	cube1->sendData(renderer->getDeviceContext());
-	depthShader->setShaderParameters(renderer->getDeviceContext(), worldMatrix, lightViewMatrix, lightProjectionMatrix);
-	depthShader->render(renderer->getDeviceContext(), cube1->getIndexCount());
+	cube1->sendData(getDeviceContext());
+	depthShader->setShaderParameters(getDeviceContext(), worldMatrix, lightViewMatrix, lightProjectionMatrix);
+	depthShader->render(getDeviceContext(), cube1->getIndexCount());
 
-	// Resets the viewport and stops writing to the Shadow Map
+	// Resets the viewport and stops writing to the Shadow Atlas, which holds this light's shadows until something changes
+	renderer->setBackBufferRenderTarget();
+	renderer->resetViewport();
+	shadowAtlas->endTile(1);
+
+	// Turns the new depths into blurred moments when a moment filter is in use, linearizing the spot light's perspective depths first
+	if (shadowFilter.mode != SHADOW_FILTER_HARD)
+	{
+		shadowMoments->filterTile(getDeviceContext(), shadowAtlas->getShaderResourceView(), shadowAtlas->getTile(1), shadowFilter, true);
+	}
+}
+
+void App1::depthPass3()
+{
+	// Gathers everything that casts shadows, the terrain patches, objects and cube, and keeps only the faces they reach
+	pointShadowCasters.clear();
+	for (int patch = 0; patch < TplaneMesh->getPatchCount(); patch++)
+	{
+		pointShadowCasters.push_back(TplaneMesh->getPatchBounds(patch));
+	}
+	for (int object = 0; object < gpuScene->getObjectCount(); object++)
+	{
+		const GpuDrawRecord& record = gpuScene->getObject(object);
+		pointShadowCasters.push_back(BoundingBox(record.center, XMFLOAT3(record.radius, record.radius, record.radius)));
+	}
+	pointShadowCasters.push_back(BoundingBox(XMFLOAT3(frameState.cubePosition[0], frameState.cubePosition[1], frameState.cubePosition[2]), XMFLOAT3(1.0f, 1.0f, 1.0f)));
+	pointShadow->cullFaces(pointShadowCasters);
+
+	// Empties all six of the Point Light's tiles, culled faces included, and binds a viewport for each
+	shadowAtlas->beginTiles(getDeviceContext(), POINT_SHADOW_TILE, PointShadowMap::FACE_COUNT);
+
+	// Gets the world matrix, and the cube's from its position
+	XMMATRIX worldMatrix = renderer->getWorldMatrix();
+	XMMATRIX cubeMatrix = worldMatrix * XMMatrixTranslation(frameState.cubePosition[0], frameState.cubePosition[1], frameState.cubePosition[2]);
+	XMMATRIX lightProjectionMatrix = pointShadow->getProjection();
+
+	// Both versions draw from the CPU, as the GPU driven scene has no views for the point light's faces
+	if (pointShadowSixPass)
+	{
+		// The naive version, drawing the whole scene into each face in turn with no face culling
+		for (int face = 0; face < PointShadowMap::FACE_COUNT; face++)
+		{
+			shadowAtlas->setTileViewport(getDeviceContext(), POINT_SHADOW_TILE + face);
+			XMMATRIX lightViewMatrix = pointShadow->getFaceView(face);
+			renderSceneDepthDirect(lightViewMatrix, lightProjectionMatrix, false, true);
+
+			cube1->sendData(getDeviceContext());
+			depthShader->setShaderParameters(getDeviceContext(), cubeMatrix, lightViewMatrix, lightProjectionMatrix);
+			depthShader->render(getDeviceContext(), cube1->getIndexCount());
+		}
+		pointShadowFacesDrawn = PointShadowMap::FACE_COUNT;
+		pointShadowDraws = PointShadowMap::FACE_COUNT * (gpuScene->getObjectCount() + 2);
+	}
+	else
+	{
+		// Each draw is instanced once per surviving face, and the geometry shader sends every instance to its own face's viewport
+		pointShadowFacesDrawn = (int)pointShadow->getActiveFaces().size();
+		pointShadowDraws = 0;
+		if (pointShadowFacesDrawn > 0)
+		{
+			// Sends the plane data to the tessellated Cube Shadow Shader
+			TplaneMesh->sendData(getDeviceContext(), D3D_PRIMITIVE_TOPOLOGY_4_CONTROL_POINT_PATCHLIST);
+			cubeShadowTessShader->setFaces(getDeviceContext(), *pointShadow);
+			cubeShadowTessShader->setWorldMatrix(getDeviceContext(), worldMatrix);
+			cubeShadowTessShader->setHeightMap(getDeviceContext(), getHeightMap(), renderTessFactor);
+			cubeShadowTessShader->setVirtualTexture(getDeviceContext(), virtualHeightMap, renderTessFactor, useVirtualTexture);
+			cubeShadowTessShader->renderFaces(getDeviceContext(), TplaneMesh->getIndexCount());
+
+			// Draws every object one at a time, each into all of the faces
+			lodSphereMesh->sendData(getDeviceContext());
+			cubeShadowShader->setFaces(getDeviceContext(), *pointShadow);
+			for (int object = 0; object < gpuScene->getObjectCount(); object++)
+			{
+				const GpuDrawRecord& record = gpuScene->getObject(object);
+				XMMATRIX objectMatrix = XMMatrixScaling(record.radius, record.radius, record.radius) * XMMatrixTranslation(record.center.x, record.center.y, record.center.z);
+				cubeShadowShader->setWorldMatrix(getDeviceContext(), worldMatrix * objectMatrix);
+				cubeShadowShader->renderFaces(getDeviceContext(), lodSphereMesh->getLodIndexCount(0));
+			}
+
+			// Sends the cube's data to the Cube Shadow Shader
+			cube1->sendData(getDeviceContext());
+			cubeShadowShader->setWorldMatrix(getDeviceContext(), cubeMatrix);
+			cubeShadowShader->renderFaces(getDeviceContext(), cube1->getIndexCount());
+			pointShadowDraws = gpuScene->getObjectCount() + 2;
+		}
+	}
+
+	// Resets the viewport and stops writing to the Shadow Atlas, which holds this light's shadows until something changes
 	renderer->setBackBufferRenderTarget();
 	renderer->resetViewport();
+	shadowAtlas->endTiles(POINT_SHADOW_TILE, PointShadowMap::FACE_COUNT);
+
+	// Turns each face's new depths into blurred moments when a moment filter is in use, linearizing them as for the spot light
+	if (shadowFilter.mode != SHADOW_FILTER_HARD)
+	{
+		for (int face = 0; face < PointShadowMap::FACE_COUNT; face++)
+		{
+			shadowMoments->filterTile(getDeviceContext(), shadowAtlas->getShaderResourceView(), shadowAtlas->getTile(POINT_SHADOW_TILE + face), shadowFilter, true);
+		}
+	}
 }
 
 void App1::cameraDepthPass()
 {
 	// Empties the depth texture and sets it as render target
-	depthTexture->setRenderTarget(renderer->getDeviceContext());
-	depthTexture->clearRenderTarget(renderer->getDeviceContext(), 0.0f, 0.0f, 0.0f, 0.0f);
+	depthTexture->setRenderTarget(getDeviceContext());
+	depthTexture->clearRenderTarget(getDeviceContext());
+	setRenderViewport();
 	
 	// Generates a view matrix from the camera's perspective, as well as a projection and world matrix from the renderer
 	XMMATRIX worldMatrix, viewMatrix, projectionMatrix;
@@ -293,30 +1668,58 @@ void App1::cameraDepthPass()
 	projectionMatrix = renderer->getProjectionMatrix();
 	XMMATRIX translate = XMMatrixIdentity();
 
-	// Sends the plane data to the Depth Tessellation Shader and returns a depth value
-	TplaneMesh->sendData(renderer->getDeviceContext(), D3D_PRIMITIVE_TOPOLOGY_4_CONTROL_POINT_PATCHLIST);
-	depthTessellationShader->setShaderParameters(renderer->getDeviceContext(), worldMatrix, viewMatrix, projectionMatrix, textureMgr->getTexture(L"heightMap"), tessFactor);
-	depthTessellationShader->render(renderer->getDeviceContext(), TplaneMesh->getIndexCount());
+	// Draws the terrain and objects from the Camera's view, only drawing the patches that passed occlusion culling
+	renderSceneDepth(GPU_VIEW_CAMERA, viewMatrix, projectionMatrix, true, true);
 
 	// Moves to the cube mesh's position
-	translate *= XMMatrixTranslation(cubePos[0], cubePos[1], cubePos[2]);
+	translate *= XMMatrixTranslation(frameState.cubePosition[0], frameState.cubePosition[1], frameState.cubePosition[2]);
 	worldMatrix = worldMatrix * translate;
 
-	// Sends the data to the Depth Shader and returns a depth value
-	cube1->sendData(renderer->getDeviceContext());
-	depthShader->setShaderParameters(renderer->getDeviceContext(), worldMatrix, viewMatrix, projectionMatrix);
-	depthShader->render(renderer->getDeviceContext(), cube1->getIndexCount());
+	// Sends the data to the Depth Shader and returns a depth value, unless the cube is hidden
+	if (visibleFlags[objectBoundsStart + 2])
+	{
+		cube1->sendData(getDeviceContext());
+		depthShader->setShaderParameters(getDeviceContext(), worldMatrix, viewMatrix, projectionMatrix);
+		depthShader->render(getDeviceContext(), cube1->getIndexCount());
+	}
 
 	// Resets the viewport and stops writing to the Shadow Map
 	renderer->setBackBufferRenderTarget();
 	renderer->resetViewport();
+
+	// Builds the Hi-Z pyramid from this depth, to be read back and used for culling a few frames from now
+	if (occlusionCulling && !softwareOcclusion)
+	{
+		float depthFar = depthTexture->isLinear() ? depthTexture->getFarPlane() : 0.0f;
+		hiZBuildShader->build(getDeviceContext(), depthTexture->getShaderResourceView(), viewMatrix * projectionMatrix, dynamicResolution->getWidth(), dynamicResolution->getHeight(), depthTexture->getNearPlane(), depthFar);
+	}
+}
+
+void App1::setRenderViewport()
+{
+	// The projection is unchanged, so the whole view is squeezed into the smaller rectangle and stretched back out by the final pass
+	D3D11_VIEWPORT viewport;
+	viewport.TopLeftX = 0.0f;
+	viewport.TopLeftY = 0.0f;
+	viewport.Width = (float)dynamicResolution->getWidth();
+	viewport.Height = (float)dynamicResolution->getHeight();
+	viewport.MinDepth = 0.0f;
+	viewport.MaxDepth = 1.0f;
+	getDeviceContext()->RSSetViewports(1, &viewport);
 }
 
 void App1::screenPass()
 {
 	// Empties the screen texture and sets it as render target
-	screenTexture->setRenderTarget(renderer->getDeviceContext());
-	screenTexture->clearRenderTarget(renderer->getDeviceContext(), 0.39f, 0.58f, 0.92f, 1.0f);
+	screenTexture->setRenderTarget(getDeviceContext());
+	screenTexture->clearRenderTarget(getDeviceContext(), 0.39f, 0.58f, 0.92f, 1.0f);
+	setRenderViewport();
+
+	// Tells the lit shaders where each light's tile sits in the shadow atlas and how to filter it, for the rest of the frame
+	shadowAtlas->setShaderParameters(getDeviceContext());
+	shadowMoments->setShaderParameters(getDeviceContext(), shadowFilter);
+	pointShadow->setShaderParameters(getDeviceContext(), frameState.lightActive[1] && pointShadows);
+	horizonMap->setShaderParameters(getDeviceContext(), horizonShadows, horizonSoftness);
 
 	// Generates a view matrix from the camera's perspective, as well as a projection and world matrix from the renderer
 	XMMATRIX worldMatrix, viewMatrix, projectionMatrix, translate;
@@ -324,67 +1727,225 @@ void App1::screenPass()
 	viewMatrix = camera->getViewMatrix();
 	projectionMatrix = renderer->getProjectionMatrix();
 
-	// Sends the plane data to the Tessellation Shader, which tessellates the height map and appropriately calculates lighting and shadows
-	TplaneMesh->sendData(renderer->getDeviceContext(), D3D_PRIMITIVE_TOPOLOGY_4_CONTROL_POINT_PATCHLIST);
-	tessellationShader->setShaderParameters(renderer->getDeviceContext(), worldMatrix, viewMatrix, projectionMatrix, textureMgr->getTexture(L"heightMap"), shadowMap[0]->getDepthMapSRV(), shadowMap[1]->getDepthMapSRV(), tessFactor, lightArray, activeLight, dropoff2, pixelNormals, specIntensity, specExponent, camera, cutOffAngle);
-	tessellationShader->render(renderer->getDeviceContext(), TplaneMesh->getIndexCount());
-
-	// Place the point light mesh at the Point Light's Position
-	translate = XMMatrixIdentity();
-	translate *= XMMatrixTranslation(lightPos2[0], lightPos2[1], lightPos2[2]);
-	worldMatrix = worldMatrix * translate;
-
-	// Only render the point light if it's active
-	if (activeLight[1])
+	if (gpuDriven)
 	{
-		pointlightMesh->sendData(renderer->getDeviceContext());
-		basicShader->setShaderParameters(renderer->getDeviceContext(), worldMatrix, viewMatrix, projectionMatrix, textureMgr->getTexture(L"brick"), shadowMap[0]->getDepthMapSRV(), shadowMap[1]->getDepthMapSRV(), lightArray, activeLight, dropoff2, pixelNormals, specIntensity, specExponent, camera, cutOffAngle);
-		basicShader->render(renderer->getDeviceContext(), pointlightMesh->getIndexCount());
+		// Draws the patches the camera's depth pass found visible, reusing its list, in a single indirect draw
+		TplaneMesh->sendData(getDeviceContext(), D3D_PRIMITIVE_TOPOLOGY_4_CONTROL_POINT_PATCHLIST);
+		gpuTessellationShader->setShaderParameters(getDeviceContext(), worldMatrix, viewMatrix, projectionMatrix, getHeightMap(), shadowAtlas->getShaderResourceView(), shadowMoments->getShaderResourceView(), renderTessFactor, lightArray, frameState.lightActive, frameState.pointDropoff, frameState.pixelNormals, frameState.specIntensity, frameState.specExponent, camera, frameState.spotCutoff);
+		gpuTessellationShader->setVirtualTexture(getDeviceContext(), virtualHeightMap, renderTessFactor, useVirtualTexture);
+		gpuTessellationShader->bindStages(getDeviceContext());
+		gpuScene->drawPatches(getDeviceContext(), GPU_VIEW_CAMERA);
+
+		// Draws the visible objects with one indirect draw per level of detail
+		lodSphereMesh->sendData(getDeviceContext());
+		gpuBasicShader->setShaderParameters(getDeviceContext(), worldMatrix, viewMatrix, projectionMatrix, getBrickTexture(), shadowAtlas->getShaderResourceView(), shadowMoments->getShaderResourceView(), lightArray, frameState.lightActive, frameState.pointDropoff, frameState.pixelNormals, frameState.specIntensity, frameState.specExponent, camera, frameState.spotCutoff);
+		gpuBasicShader->bindStages(getDeviceContext());
+		gpuScene->drawObjects(getDeviceContext(), GPU_VIEW_CAMERA);
 	}
-
-	// Translate back to original coordinates
-	translate = XMMatrixIdentity();
-	translate *= XMMatrixTranslation(-lightPos2[0], -lightPos2[1], -lightPos2[2]);
-	worldMatrix = worldMatrix * translate;
-
-	// Place the spot light mesh at the Spot Light's Position
-	translate = XMMatrixIdentity();
-	translate *= XMMatrixTranslation(lightPos3[0], lightPos3[1], lightPos3[2]);
-	worldMatrix = worldMatrix * translate;
-
-	// Only render the spot light if it's active
-	if (activeLight[2])
+	else if (useRenderQueue)
 	{
-		spotlightMesh->sendData(renderer->getDeviceContext());
-		basicShader->setShaderParameters(renderer->getDeviceContext(), worldMatrix, viewMatrix, projectionMatrix, textureMgr->getTexture(L"brick"), shadowMap[0]->getDepthMapSRV(), shadowMap[1]->getDepthMapSRV(), lightArray, activeLight, dropoff2, pixelNormals, specIntensity, specExponent, camera, cutOffAngle);
-		basicShader->render(renderer->getDeviceContext(), spotlightMesh->getIndexCount());
+		// Sorts the terrain, objects, light meshes and cube by shader, texture and mesh, then nearest first, and draws them in that order
+		buildScreenQueue(viewMatrix);
+		executeScreenQueue(worldMatrix, viewMatrix, projectionMatrix);
+	}
+	else
+	{
+		// Sends the plane data to the Tessellation Shader, which tessellates the height map and appropriately calculates lighting and shadows
+		TplaneMesh->sendData(getDeviceContext(), D3D_PRIMITIVE_TOPOLOGY_4_CONTROL_POINT_PATCHLIST);
+		tessellationShader->setShaderParameters(getDeviceContext(), worldMatrix, viewMatrix, projectionMatrix, getHeightMap(), shadowAtlas->getShaderResourceView(), shadowMoments->getShaderResourceView(), renderTessFactor, lightArray, frameState.lightActive, frameState.pointDropoff, frameState.pixelNormals, frameState.specIntensity, frameState.specExponent, camera, frameState.spotCutoff);
+		tessellationShader->setVirtualTexture(getDeviceContext(), virtualHeightMap, renderTessFactor, useVirtualTexture);
+		tessellationShader->renderPatches(getDeviceContext(), TplaneMesh, visiblePatches);
+
+		// Draws every object one at a time
+		lodSphereMesh->sendData(getDeviceContext());
+		for (int object = 0; object < gpuScene->getObjectCount(); object++)
+		{
+			const GpuDrawRecord& record = gpuScene->getObject(object);
+			XMMATRIX objectMatrix = XMMatrixScaling(record.radius, record.radius, record.radius) * XMMatrixTranslation(record.center.x, record.center.y, record.center.z);
+			basicShader->setShaderParameters(getDeviceContext(), worldMatrix * objectMatrix, viewMatrix, projectionMatrix, getBrickTexture(), shadowAtlas->getShaderResourceView(), shadowMoments->getShaderResourceView(), lightArray, frameState.lightActive, frameState.pointDropoff, frameState.pixelNormals, frameState.specIntensity, frameState.specExponent, camera, frameState.spotCutoff);
+			basicShader->render(getDeviceContext(), lodSphereMesh->getLodIndexCount(0));
+		}
 	}
 
-	// Translate back to original coordinates
-	translate = XMMatrixIdentity();
-	translate *= XMMatrixTranslation(-lightPos3[0], -lightPos3[1], -lightPos3[2]);
-	worldMatrix = worldMatrix * translate;
-
-	// Translate to cube's position
-	translate = XMMatrixIdentity();
-	translate *= XMMatrixTranslation(cubePos[0], cubePos[1], cubePos[2]);
-	worldMatrix = worldMatrix * translate;
-
-	// Sends the data to the Basic Shader and calculates lighting/shadows
-	cube1->sendData(renderer->getDeviceContext());
-	basicShader->setShaderParameters(renderer->getDeviceContext(), worldMatrix, viewMatrix, projectionMatrix, textureMgr->getTexture(L"brick"), shadowMap[0]->getDepthMapSRV(), shadowMap[1]->getDepthMapSRV(), lightArray, activeLight, dropoff2, pixelNormals, specIntensity, specExponent, camera, cutOffAngle);
-	basicShader->render(renderer->getDeviceContext(), cube1->getIndexCount());
+	// The light meshes and cube are in the queue when it's used, and drawn here in a fixed order otherwise
+	if (gpuDriven || !useRenderQueue)
+	{
+		// Place the point light mesh at the Point Light's Position
+		translate = XMMatrixIdentity();
+		translate *= XMMatrixTranslation(frameState.lightPosition[1][0], frameState.lightPosition[1][1], frameState.lightPosition[1][2]);
+		worldMatrix = worldMatrix * translate;
+
+		// Only render the point light if it's active and not occluded
+		if (frameState.lightActive[1] && visibleFlags[objectBoundsStart])
+		{
+			pointlightMesh->sendData(getDeviceContext());
+			basicShader->setShaderParameters(getDeviceContext(), worldMatrix, viewMatrix, projectionMatrix, getBrickTexture(), shadowAtlas->getShaderResourceView(), shadowMoments->getShaderResourceView(), lightArray, frameState.lightActive, frameState.pointDropoff, frameState.pixelNormals, frameState.specIntensity, frameState.specExponent, camera, frameState.spotCutoff);
+			basicShader->render(getDeviceContext(), pointlightMesh->getIndexCount());
+		}
+
+		// Translate back to original coordinates
+		translate = XMMatrixIdentity();
+		translate *= XMMatrixTranslation(-frameState.lightPosition[1][0], -frameState.lightPosition[1][1], -frameState.lightPosition[1][2]);
+		worldMatrix = worldMatrix * translate;
+
+		// Place the spot light mesh at the Spot Light's Position
+		translate = XMMatrixIdentity();
+		translate *= XMMatrixTranslation(frameState.lightPosition[2][0], frameState.lightPosition[2][1], frameState.lightPosition[2][2]);
+		worldMatrix = worldMatrix * translate;
+
+		// Only render the spot light if it's active and not occluded
+		if (frameState.lightActive[2] && visibleFlags[objectBoundsStart + 1])
+		{
+			spotlightMesh->sendData(getDeviceContext());
+			basicShader->setShaderParameters(getDeviceContext(), worldMatrix, viewMatrix, projectionMatrix, getBrickTexture(), shadowAtlas->getShaderResourceView(), shadowMoments->getShaderResourceView(), lightArray, frameState.lightActive, frameState.pointDropoff, frameState.pixelNormals, frameState.specIntensity, frameState.specExponent, camera, frameState.spotCutoff);
+			basicShader->render(getDeviceContext(), spotlightMesh->getIndexCount());
+		}
+
+		// Translate back to original coordinates
+		translate = XMMatrixIdentity();
+		translate *= XMMatrixTranslation(-frameState.lightPosition[2][0], -frameState.lightPosition[2][1], -frameState.lightPosition[2][2]);
+		worldMatrix = worldMatrix * translate;
+
+		// Translate to cube's position
+		translate = XMMatrixIdentity();
+		translate *= XMMatrixTranslation(frameState.cubePosition[0], frameState.cubePosition[1], frameState.cubePosition[2]);
+		worldMatrix = worldMatrix * translate;
+
+		// Sends the data to the Basic Shader and calculates lighting/shadows, unless the cube is occluded
+		if (visibleFlags[objectBoundsStart + 2])
+		{
+			cube1->sendData(getDeviceContext());
+			basicShader->setShaderParameters(getDeviceContext(), worldMatrix, viewMatrix, projectionMatrix, getBrickTexture(), shadowAtlas->getShaderResourceView(), shadowMoments->getShaderResourceView(), lightArray, frameState.lightActive, frameState.pointDropoff, frameState.pixelNormals, frameState.specIntensity, frameState.specExponent, camera, frameState.spotCutoff);
+			basicShader->render(getDeviceContext(), cube1->getIndexCount());
+		}
+	}
 
 	// Resets the viewport and stops writing to the Shadow Map
 	renderer->setBackBufferRenderTarget();
 	renderer->resetViewport();
 }
 
+void App1::buildScreenQueue(const XMMATRIX& viewMatrix)
+{
+	renderQueue->clear();
+	float farPlane = depthTexture->getFarPlane();
+	XMFLOAT4X4 view;
+	XMStoreFloat4x4(&view, viewMatrix);
+
+	// The terrain is one packet, drawn patch by patch when executed
+	renderQueue->submit(RenderQueue::makeKey(0, SCREEN_SHADER_TERRAIN, SCREEN_MATERIAL_HEIGHT_MAP, SCREEN_MESH_TERRAIN, 0.0f), 0);
+
+	// The light meshes and cube are queued with their world matrices, where visible, keyed by their distance along the view direction
+	queueWorlds.clear();
+	const float* positions[3] = { frameState.lightPosition[1], frameState.lightPosition[2], frameState.cubePosition };
+	const ScreenMesh meshes[3] = { SCREEN_MESH_POINT_LIGHT, SCREEN_MESH_SPOT_LIGHT, SCREEN_MESH_CUBE };
+	const bool shown[3] = { frameState.lightActive[1] && visibleFlags[objectBoundsStart], frameState.lightActive[2] && visibleFlags[objectBoundsStart + 1], visibleFlags[objectBoundsStart + 2] != 0 };
+	for (int i = 0; i < 3; i++)
+	{
+		if (!shown[i])
+		{
+			continue;
+		}
+		XMFLOAT4X4 world;
+		XMStoreFloat4x4(&world, XMMatrixTranslation(positions[i][0], positions[i][1], positions[i][2]));
+		float viewZ = positions[i][0] * view._13 + positions[i][1] * view._23 + positions[i][2] * view._33 + view._43;
+		renderQueue->submit(RenderQueue::makeKey(0, SCREEN_SHADER_BASIC, SCREEN_MATERIAL_BRICK, meshes[i], viewZ / farPlane), (unsigned int)queueWorlds.size());
+		queueWorlds.push_back(world);
+	}
+
+	// Objects are keyed on the worker threads, each reading the records and writing only its own packets
+	GpuDrivenScene* scene = gpuScene;
+	renderQueue->build(gpuScene->getObjectCount(), [scene, view, farPlane](int first, int last, vector<DrawPacket>& packets)
+	{
+		for (int object = first; object <= last; object++)
+		{
+			const GpuDrawRecord& record = scene->getObject(object);
+			float viewZ = record.center.x * view._13 + record.center.y * view._23 + record.center.z * view._33 + view._43;
+			DrawPacket packet;
+			packet.key = RenderQueue::makeKey(0, SCREEN_SHADER_BASIC, SCREEN_MATERIAL_BRICK, SCREEN_MESH_OBJECT, (viewZ - record.radius) / farPlane);
+			packet.item = object;
+			packet.padding = 0;
+			packets.push_back(packet);
+		}
+	});
+	renderQueue->sort();
+}
+
+void App1::executeScreenQueue(const XMMATRIX& worldMatrix, const XMMATRIX& viewMatrix, const XMMATRIX& projectionMatrix)
+{
+	chrono::high_resolution_clock::time_point submitStart = chrono::high_resolution_clock::now();
+	ID3D11DeviceContext* deviceContext = getDeviceContext();
+	const vector<DrawPacket>& packets = renderQueue->getPackets();
+	bool geometryBound = false;
+	for (size_t i = 0; i < packets.size(); i++)
+	{
+		const DrawPacket& packet = packets[i];
+		unsigned long long previous = i > 0 ? packets[i - 1].key : ~packet.key;
+		unsigned int shader = RenderQueue::getShader(packet.key);
+		unsigned int mesh = RenderQueue::getMesh(packet.key);
+		bool shaderChanged = shader != RenderQueue::getShader(previous);
+		bool meshChanged = shaderChanged || mesh != RenderQueue::getMesh(previous);
+
+		if (shader == SCREEN_SHADER_TERRAIN)
+		{
+			TplaneMesh->sendData(deviceContext, D3D_PRIMITIVE_TOPOLOGY_4_CONTROL_POINT_PATCHLIST);
+			geometryBound = false;
+			tessellationShader->setShaderParameters(deviceContext, worldMatrix, viewMatrix, projectionMatrix, getHeightMap(), shadowAtlas->getShaderResourceView(), shadowMoments->getShaderResourceView(), renderTessFactor, lightArray, frameState.lightActive, frameState.pointDropoff, frameState.pixelNormals, frameState.specIntensity, frameState.specExponent, camera, frameState.spotCutoff);
+			tessellationShader->setVirtualTexture(deviceContext, virtualHeightMap, renderTessFactor, useVirtualTexture);
+			tessellationShader->renderPatches(deviceContext, TplaneMesh, visiblePatches);
+			continue;
+		}
+
+		// Lights, shadows and the shader stages are set once for every basic draw
+		if (shaderChanged)
+		{
+			basicShader->setFrameParameters(deviceContext, viewMatrix, projectionMatrix, shadowAtlas->getShaderResourceView(), shadowMoments->getShaderResourceView(), lightArray, frameState.lightActive, frameState.pointDropoff, frameState.pixelNormals, frameState.specIntensity, frameState.specExponent, camera, frameState.spotCutoff);
+			basicShader->bindStages(deviceContext);
+		}
+
+		// The registry's meshes share one pair of buffers, bound the first time any of them is drawn and left bound until the objects' mesh
+		XMMATRIX objectMatrix;
+		UINT indexCount = 0;
+		UINT startIndex = 0;
+		INT baseVertex = 0;
+		if (mesh == SCREEN_MESH_OBJECT)
+		{
+			const GpuDrawRecord& record = gpuScene->getObject(packet.item);
+			objectMatrix = XMMatrixScaling(record.radius, record.radius, record.radius) * XMMatrixTranslation(record.center.x, record.center.y, record.center.z);
+			if (meshChanged)
+			{
+				lodSphereMesh->sendData(deviceContext);
+				geometryBound = false;
+			}
+			indexCount = lodSphereMesh->getLodIndexCount(0);
+		}
+		else
+		{
+			RegisteredMesh* registered = mesh == SCREEN_MESH_POINT_LIGHT ? pointlightMesh : mesh == SCREEN_MESH_SPOT_LIGHT ? spotlightMesh : cube1;
+			objectMatrix = XMLoadFloat4x4(&queueWorlds[packet.item]);
+			if (!geometryBound)
+			{
+				geometry->bind(deviceContext);
+				geometryBound = true;
+			}
+			indexCount = registered->getIndexCount();
+			startIndex = registered->getStartIndex();
+			baseVertex = registered->getBaseVertex();
+		}
+
+		// Only the world matrix and texture change from one object to the next, and the state cache drops the texture bind when it's the same
+		basicShader->setObjectParameters(deviceContext, worldMatrix * objectMatrix, getBrickTexture());
+		deviceContext->DrawIndexed(indexCount, startIndex, baseVertex);
+	}
+	renderQueue->setSubmitTime(chrono::duration<double, milli>(chrono::high_resolution_clock::now() - submitStart).count());
+}
+
 void App1::blurPass()
 {
 	// Empties the blur texture and sets it as the render target
-	blurTexture->setRenderTarget(renderer->getDeviceContext());
-	blurTexture->clearRenderTarget(renderer->getDeviceContext(), 0.0f, 0.0f, 0.0f, 1.0f);
+	blurTexture->setRenderTarget(getDeviceContext());
+	blurTexture->clearRenderTarget(getDeviceContext(), 0.0f, 0.0f, 0.0f, 1.0f);
+	setRenderViewport();
 
 	// Gets the screen's size based on the blurTexture's height and width
 	float screenSizeX = (float)blurTexture->getTextureWidth();
@@ -399,14 +1960,60 @@ void App1::blurPass()
 	orthoMatrix = blurTexture->getOrthoMatrix();
 
 	// Sends the screen texture to be blurred with the depth buffer turned off
-	renderer->setZBuffer(false);
-	screenOrthoMesh->sendData(renderer->getDeviceContext());
-	combinedBlurShader->setShaderParameters(renderer->getDeviceContext(), worldMatrix, baseViewMatrix, orthoMatrix, screenTexture->getShaderResourceView(), screenSizeX, screenSizeY);
-	combinedBlurShader->render(renderer->getDeviceContext(), screenOrthoMesh->getIndexCount());
-	renderer->setZBuffer(true);
+	StateCache::get()->setDepthTest(getDeviceContext(), false);
+	screenOrthoMesh->sendData(getDeviceContext());
+	combinedBlurShader->setShaderParameters(getDeviceContext(), worldMatrix, baseViewMatrix, orthoMatrix, screenTexture->getShaderResourceView(), screenSizeX, screenSizeY, XMFLOAT2(dynamicResolution->getUVScaleX(), dynamicResolution->getUVScaleY()), qualityGovernor.getSettings().blurRadius);
+	combinedBlurShader->render(getDeviceContext(), screenOrthoMesh->getIndexCount());
+	StateCache::get()->setDepthTest(getDeviceContext(), true);
 
 	// Reset the render target back to the original back buffer and not the render to texture anymore.
 	renderer->setBackBufferRenderTarget();
+	renderer->resetViewport();
+}
+
+void App1::bokehPass()
+{
+	// Halves the rendered region of the screen texture, then gathers only the tiles the camera depth says are out of focus
+	autofocusShader->setComputeParameters(getDeviceContext(), BokehDofShader::FOCUS_SLOT);
+	bokehDofShader->apply(getDeviceContext(), screenTexture->getShaderResourceView(), depthTexture->getShaderResourceView(), dynamicResolution->getWidth(), dynamicResolution->getHeight(), bokehSettings, depthTexture->getNearPlane(), depthTexture->getFarPlane(), depthTexture->isLinear());
+}
+
+vector<PostEffect> App1::buildPostEffects()
+{
+	// The depth of field lerps towards a blur taken first, or composites the bokeh result, then the colour steps run on what it leaves
+	vector<PostEffect> effects;
+	if (activeDOF)
+	{
+		if (bokehDOF)
+		{
+			effects.push_back(POST_EFFECT_BOKEH);
+		}
+		else
+		{
+			effects.push_back(POST_EFFECT_BLUR);
+			effects.push_back(POST_EFFECT_DEPTH_OF_FIELD);
+		}
+	}
+	if (postTonemap)
+	{
+		effects.push_back(POST_EFFECT_TONEMAP);
+	}
+	if (postColourGrade)
+	{
+		effects.push_back(POST_EFFECT_COLOUR_GRADE);
+	}
+	return effects;
+}
+
+void App1::postStackPass()
+{
+	// Shares the depth of field settings and blur radius with the two pass path, so the two look the same
+	postSettings.dofWeight = weighting;
+	postSettings.dofCutoff = cutoff;
+	postSettings.blurRadius = (float)qualityGovernor.getSettings().blurRadius;
+
+	autofocusShader->setComputeParameters(getDeviceContext(), PostStackShader::FOCUS_SLOT);
+	postStackShader->apply(getDeviceContext(), buildPostEffects(), postSettings, screenTexture->getShaderResourceView(), depthTexture->getShaderResourceView(), bokehDofShader->getShaderResourceView(), bokehDofShader->getUVScale(), dynamicResolution->getWidth(), dynamicResolution->getHeight(), depthTexture->getNearPlane(), depthTexture->getFarPlane(), depthTexture->isLinear());
 }
 
 void App1::finalPass()
@@ -424,34 +2031,94 @@ void App1::finalPass()
 	// Renders the heightmap to expose it to wireframe mode
 	if (wireframeToggle)
 	{
-		TplaneMesh->sendData(renderer->getDeviceContext(), D3D_PRIMITIVE_TOPOLOGY_4_CONTROL_POINT_PATCHLIST);
-		tessellationShader->setShaderParameters(renderer->getDeviceContext(), worldMatrix, viewMatrix, projectionMatrix, textureMgr->getTexture(L"heightMap"), shadowMap[0]->getDepthMapSRV(), shadowMap[1]->getDepthMapSRV(), tessFactor, lightArray, activeLight, dropoff2, pixelNormals, specIntensity, specExponent, camera, cutOffAngle);
-		tessellationShader->render(renderer->getDeviceContext(), TplaneMesh->getIndexCount());
+		TplaneMesh->sendData(getDeviceContext(), D3D_PRIMITIVE_TOPOLOGY_4_CONTROL_POINT_PATCHLIST);
+		tessellationShader->setShaderParameters(getDeviceContext(), worldMatrix, viewMatrix, projectionMatrix, getHeightMap(), shadowAtlas->getShaderResourceView(), shadowMoments->getShaderResourceView(), renderTessFactor, lightArray, frameState.lightActive, frameState.pointDropoff, frameState.pixelNormals, frameState.specIntensity, frameState.specExponent, camera, frameState.spotCutoff);
+		tessellationShader->setVirtualTexture(getDeviceContext(), virtualHeightMap, renderTessFactor, useVirtualTexture);
+		tessellationShader->render(getDeviceContext(), TplaneMesh->getIndexCount());
 	}
 
 	// Renders the screen orthomesh to the screen, ignoring the z buffer
-	// and uses the Post Processing technique Depth of Field to lerp between the original and blurred texture
-	renderer->setZBuffer(false);
-	screenOrthoMesh->sendData(renderer->getDeviceContext());
-	depthOfFieldShader->setShaderParameters(renderer->getDeviceContext(), worldMatrix, orthoViewMatrix, orthoMatrix, screenTexture->getShaderResourceView(), blurTexture->getShaderResourceView(), depthTexture->getShaderResourceView(), weighting, cutoff, percentage, activeDOF);
-	depthOfFieldShader->render(renderer->getDeviceContext(), screenOrthoMesh->getIndexCount());
-	renderer->setZBuffer(true);
-
-	// Move the camera based on user input
+	// and uses the Post Processing technique Depth of Field to lerp between the original and blurred texture, upsampling them if rendered at a lower resolution
+	beginPass("Final");
+	StateCache::get()->setDepthTest(getDeviceContext(), false);
+	screenOrthoMesh->sendData(getDeviceContext());
+	// The post stack's result has had the depth of field applied already, so is only upsampled
+	if (fusedPost)
+	{
+		depthOfFieldShader->setShaderParameters(getDeviceContext(), worldMatrix, orthoViewMatrix, orthoMatrix, postStackShader->getShaderResourceView(), postStackShader->getShaderResourceView(), depthTexture->getShaderResourceView(), weighting, cutoff, percentage, false, XMFLOAT2(dynamicResolution->getUVScaleX(), dynamicResolution->getUVScaleY()), bicubicUpsample);
+	}
+	else
+	{
+		depthOfFieldShader->setShaderParameters(getDeviceContext(), worldMatrix, orthoViewMatrix, orthoMatrix, screenTexture->getShaderResourceView(), blurTexture->getShaderResourceView(), depthTexture->getShaderResourceView(), weighting, cutoff, percentage, activeDOF, XMFLOAT2(dynamicResolution->getUVScaleX(), dynamicResolution->getUVScaleY()), bicubicUpsample);
+	}
+	depthTexture->setShaderParameters(getDeviceContext(), 1);
+	autofocusShader->setShaderParameters(getDeviceContext(), DepthOfFieldShader::FOCUS_SLOT);
+	depthOfFieldShader->setBokeh(getDeviceContext(), bokehDofShader->getShaderResourceView(), bokehDofShader->getUVScale(), bokehDOF);
+	depthOfFieldShader->render(getDeviceContext(), screenOrthoMesh->getIndexCount());
+	StateCache::get()->setDepthTest(getDeviceContext(), true);
+	endPass("Final");
+
+	// Move the camera based on user input, then lift it back out of the terrain if it has been flown into it
+	// The frame pipeline's update thread does the lifting while it's drawn from
 	camera->update();
+	if (cameraCollision && !framePipeline->isRunning())
+	{
+		XMFLOAT3 position = camera->getPosition();
+		float ground = terrainQuery->getHeight(position.x, position.z) + cameraClearance;
+		if (position.y < ground)
+		{
+			camera->setPosition(position.x, ground, position.z);
+		}
+	}
 
 	gui();
 
-	// Ends rendering the scene
+	// Fences the constant ring's uploads and closes the frame's timings before presenting
+	constantRing->endFrame(getDeviceContext());
+	const ConstantRingStats& ringStats = constantRing->getStats();
+	gpuProfiler->setCounter("Constant Ring KB / Frame", ringStats.frameBytes / 1024.0);
+	gpuProfiler->setCounter("Constant Ring Peak KB", ringStats.peakFrameBytes / 1024.0);
+	gpuProfiler->setCounter("Constant Ring Uploads", ringStats.frameAllocations);
+	gpuProfiler->setCounter("Constant Ring Fallbacks", ringStats.frameFallbacks);
+	gpuProfiler->setCounter("Constant Ring Wraps", ringStats.wraps);
+	gpuProfiler->setCounter("Constant Ring Stalls", ringStats.stalls);
+	const RenderQueueStats& queueStats = renderQueue->getStats();
+	gpuProfiler->setCounter("Queue Packets", queueStats.packets);
+	gpuProfiler->setCounter("Queue Shader Changes", queueStats.shaderChanges);
+	gpuProfiler->setCounter("Queue Mesh Changes", queueStats.meshChanges);
+	gpuProfiler->setCounter("Queue Build ms", queueStats.buildMilliseconds);
+	gpuProfiler->setCounter("Queue Sort ms", queueStats.sortMilliseconds);
+	gpuProfiler->setCounter("Queue Submit ms", queueStats.submitMilliseconds);
+	StateCache::get()->endFrame();
+	const StateCacheStats& cacheStats = StateCache::get()->getStats();
+	gpuProfiler->setCounter("Elided Binds", cacheStats.frameElidedCalls);
+	gpuProfiler->setCounter("Issued Binds", cacheStats.frameIssuedCalls);
+	gpuProfiler->setCounter("States Created", cacheStats.statesCreated);
+	gpuProfiler->setCounter("State Cache Hits", cacheStats.cacheHits);
+	FrameCaptureStats captureStats = frameCapture->getStats();
+	gpuProfiler->setCounter("Capture ms", captureStats.frameMilliseconds);
+	gpuProfiler->setCounter("Capture Encode ms", captureStats.encodeMilliseconds);
+	gpuProfiler->setCounter("Capture Queue", captureStats.queued);
+	gpuProfiler->setCounter("Captures Dropped", captureStats.dropped);
+	FramePipelineStats pipelineStats = framePipeline->getStats();
+	gpuProfiler->setCounter("Update Tick ms", pipelineStats.updateMilliseconds);
+	gpuProfiler->setCounter("Render CPU ms", pipelineStats.renderMilliseconds);
+	gpuProfiler->setCounter("Update Overlap ms", pipelineStats.overlapMilliseconds);
+	gpuProfiler->setCounter("Input To Photon ms", pipelineStats.inputToPhotonMilliseconds);
+	gpuProfiler->endFrame(getDeviceContext());
+
+	// Ends rendering the scene, and closes the frame's CPU timing once it has been presented
 	renderer->endScene();
+	framePipeline->endRender(shownInputTime, gpuProfiler->getFrameTime());
+	inputLatencies[framePipeline->isRunning() ? 1 : 0] = (float)framePipeline->getStats().inputToPhotonMilliseconds;
 }
 
 void App1::gui()
 {
 	// Force turn off unnecessary shader stages.
-	renderer->getDeviceContext()->GSSetShader(NULL, NULL, 0);
-	renderer->getDeviceContext()->HSSetShader(NULL, NULL, 0);
-	renderer->getDeviceContext()->DSSetShader(NULL, NULL, 0);
+	getDeviceContext()->GSSetShader(NULL, NULL, 0);
+	getDeviceContext()->HSSetShader(NULL, NULL, 0);
+	getDeviceContext()->DSSetShader(NULL, NULL, 0);
 
 	// Information too small to put in a Collapsing Header
 	ImGui::Text("FPS: %.2f", timer->getFPS());
@@ -468,9 +2135,6 @@ void App1::gui()
 		ImGui::DragFloat4("D. Diffuse", lightDif1, 0.01f, 0.0f, 1.0f);
 		ImGui::DragFloat4("D. Ambient", lightAmb1, 0.01f, 0.01f, 1.0f);
 	}
-	lightArray[0]->setDirection(lightDir1[0], lightDir1[1], lightDir1[2]);
-	lightArray[0]->setAmbientColour(lightAmb1[0], lightAmb1[1], lightAmb1[2], lightAmb1[3]);
-	lightArray[0]->setDiffuseColour(lightDif1[0], lightDif1[1], lightDif1[2], lightDif1[3]);
 
 	// Point Light UI attributes
 	if (ImGui::CollapsingHeader("Point Light"))
@@ -483,9 +2147,6 @@ void App1::gui()
 		ImGui::DragFloat("P. Spec Intensity", &specIntensity, 0.01f, 0.0f, 5.0f);
 		ImGui::DragFloat("P. Spec Exponent", &specExponent, 0.01f, 0.0f, 5.0f);
 	}
-	lightArray[1]->setPosition(lightPos2[0], lightPos2[1], lightPos2[2]);
-	lightArray[1]->setAmbientColour(lightAmb2[0], lightAmb2[1], lightAmb2[2], lightAmb2[3]);
-	lightArray[1]->setDiffuseColour(lightDif2[0], lightDif2[1], lightDif2[2], lightDif2[3]);
 
 	// Spot Light UI attributes
 	if (ImGui::CollapsingHeader("Spot Light"))
@@ -497,10 +2158,6 @@ void App1::gui()
 		ImGui::DragFloat4("S. Ambient", lightAmb3, 0.01f, 0.0f, 1.0f);
 		ImGui::DragFloat("S. Cutoff", &cutOffAngle, 1.0f, 0.0f, 360.0f);
 	}
-	lightArray[2]->setDirection(lightDir3[0], lightDir3[1], lightDir3[2]);
-	lightArray[2]->setPosition(lightPos3[0], lightPos3[1], lightPos3[2]);
-	lightArray[2]->setAmbientColour(lightAmb3[0], lightAmb3[1], lightAmb3[2], lightAmb3[3]);
-	lightArray[2]->setDiffuseColour(lightDif3[0], lightDif3[1], lightDif3[2], lightDif3[3]);
 
 	// Depth Of Field UI attributes
 	if (ImGui::CollapsingHeader("Depth Of Field"))
@@ -508,6 +2165,775 @@ void App1::gui()
 		ImGui::Checkbox("Activate Depth Of Field", &activeDOF);
 		ImGui::DragFloat("Weighting", &weighting, 0.1f, 0.0f, 15.0f);
 		ImGui::DragFloat("Cutoff", &cutoff, 0.01f, 0.0f, 1.0f);
+
+		// The bokeh path replaces the full screen blur, and only blurs the tiles that are out of focus
+		ImGui::Checkbox("Half Resolution Bokeh", &bokehDOF);
+		ImGui::Checkbox("Autofocus", &autofocus);
+		if (autofocus)
+		{
+			ImGui::SliderFloat("Autofocus Region", &autofocusShader->regionSize, 0.01f, 1.0f);
+			ImGui::DragFloat("Autofocus Speed", &autofocusShader->smoothing, 0.1f, 0.0f, 50.0f);
+			ImGui::Text("Focus: %.1f, heading for %.1f", autofocusShader->getFocusDistance(), autofocusShader->getTargetDistance());
+		}
+		else
+		{
+			ImGui::DragFloat("Focus Distance", &bokehSettings.focusDistance, 0.5f, 0.1f, SCREEN_DEPTH);
+		}
+		ImGui::DragFloat("Focus Range", &bokehSettings.focusRange, 0.5f, 0.5f, SCREEN_DEPTH);
+		ImGui::SliderFloat("Max Bokeh Radius", &bokehSettings.maxRadius, 1.0f, (float)BokehDepthOfField::MAX_RADIUS);
+		ImGui::DragFloat("In Focus Threshold", &bokehSettings.inFocusThreshold, 0.05f, 0.1f, 4.0f);
+		ImGui::Text("Tiles: %d / %d blurred (%d near), %.2f ms", bokehDofShader->getBlurredTiles(), bokehDofShader->getTileCount(), bokehDofShader->getNearTiles(), gpuProfiler->getPassTime("Bokeh"));
+		ImGui::Text("Full Screen Blur: %.2f ms", gpuProfiler->getPassTime("Blur"));
+
+		// The fused stack in place of the blur pass and final blend, with the full screen traffic of each path for the current effects
+		ImGui::Checkbox("Fused Post Stack", &fusedPost);
+		ImGui::Checkbox("Tonemap", &postTonemap);
+		ImGui::SameLine();
+		ImGui::Checkbox("Colour Grade", &postColourGrade);
+		if (postTonemap)
+		{
+			ImGui::DragFloat("Exposure", &postSettings.exposure, 0.01f, 0.0f, 8.0f);
+		}
+		if (postColourGrade)
+		{
+			ImGui::DragFloat("Saturation", &postSettings.saturation, 0.01f, 0.0f, 2.0f);
+			ImGui::DragFloat("Contrast", &postSettings.contrast, 0.01f, 0.0f, 2.0f);
+		}
+		vector<PostEffect> postEffects = buildPostEffects();
+		string postList;
+		for (PostEffect effect : postEffects)
+		{
+			postList += postList.empty() ? PostStack::getName(effect) : string(", ") + PostStack::getName(effect);
+		}
+		ImGui::Text("Stack: %s", postList.empty() ? "empty" : postList.c_str());
+		// The framework's render textures hold four 32 bit floats a texel
+		PostBandwidthEstimate postBandwidth = PostStack::estimateBandwidth(postEffects, dynamicResolution->getWidth(), dynamicResolution->getHeight(), dynamicResolution->getFullWidth(), dynamicResolution->getFullHeight(), 16, CameraDepthTarget::getBytesPerTexel(depthTexture->getFormat()), PostStackShader::RESULT_BYTES);
+		ImGui::Text("Two pass: %.2f MB (%d reads, %d writes), %.2f ms", postBandwidth.twoPassBytes / (1024.0 * 1024.0), postBandwidth.twoPassReads, postBandwidth.twoPassWrites, postPathTimes[0]);
+		ImGui::Text("Fused:    %.2f MB (%d reads, %d writes), %.2f ms", postBandwidth.fusedBytes / (1024.0 * 1024.0), postBandwidth.fusedReads, postBandwidth.fusedWrites, postPathTimes[1]);
+
+		if (bokehDOF && activeDOF && ImGui::Button("Compare With CPU Reference"))
+		{
+			bokehCompared = bokehDofShader->compareWithReference(getDeviceContext(), bokehSettings, bokehComparison);
+
+			// A row per comparison, with the settings it was made at, so runs can be checked against each other later
+			if (bokehCompared)
+			{
+				if (!bokehComparisonLog.isOpen())
+				{
+					bokehComparisonLog.open("bokeh_comparison.csv", { "focus_distance", "focus_range", "max_radius", "in_focus_threshold", "width", "height", "gpu_tiles", "cpu_tiles", "mean_error", "max_error" });
+				}
+				bokehComparisonLog.addRow({ bokehSettings.focusDistance, bokehSettings.focusRange, bokehSettings.maxRadius, bokehSettings.inFocusThreshold, (double)bokehComparison.width, (double)bokehComparison.height,
+					(double)bokehComparison.gpuTiles, (double)bokehComparison.cpuTiles, bokehComparison.meanError, bokehComparison.maxError });
+			}
+		}
+		if (bokehCompared)
+		{
+			ImGui::Text("%d x %d: %d GPU / %d CPU tiles, mean %.5f, max %.4f", bokehComparison.width, bokehComparison.height, bokehComparison.gpuTiles, bokehComparison.cpuTiles, bokehComparison.meanError, bokehComparison.maxError);
+		}
+
+		if (bokehBenchmark.isActive())
+		{
+			ImGui::Text("Benchmark: focus range %d (step %d / %d)", bokehBenchmark.getStepValue(), bokehBenchmark.getStep() + 1, bokehBenchmark.getStepCount());
+			if (ImGui::Button("Stop Bokeh Benchmark"))
+			{
+				bokehBenchmark.stop();
+				bokehSettings.focusRange = bokehBenchmarkRange;
+			}
+		}
+		else if (bokehDOF && activeDOF && ImGui::Button("Run Bokeh Benchmark"))
+		{
+			// Each halving of the focus range pushes more of the screen out of focus, from nearly none of it to nearly all of it
+			vector<int> steps = { 1000, 200, 100, 50, 25, 12, 6, 3, 1 };
+			bokehBenchmarkRange = bokehSettings.focusRange;
+			if (bokehBenchmark.start("bokeh_dof.csv", steps, 30, 120, { "focus_range", "bokeh_ms", "frame_ms", "out_of_focus_fraction" }))
+			{
+				bokehSettings.focusRange = (float)steps[0];
+			}
+		}
+		for (const ScalingResult& result : bokehBenchmark.getResults())
+		{
+			ImGui::Text("Range %4d: %.1f%% out of focus, %.3f ms bokeh, %.2f ms frame", result.value, result.visible * 100.0, result.cpuMilliseconds, result.frameMilliseconds);
+		}
+	}
+
+	// Camera depth storage format, swapped by recreating the target, and how each format compares
+	if (ImGui::CollapsingHeader("Camera Depth Storage"))
+	{
+		const char* formats[DEPTH_STORAGE_FORMAT_COUNT];
+		for (int format = 0; format < DEPTH_STORAGE_FORMAT_COUNT; format++)
+		{
+			formats[format] = CameraDepthTarget::getName((DepthStorageFormat)format);
+		}
+		if (ImGui::Combo("Depth Format", &depthStorageFormat, formats, DEPTH_STORAGE_FORMAT_COUNT))
+		{
+			delete depthTexture;
+			depthTexture = new CameraDepthTarget(renderer->getDevice(), dynamicResolution->getFullWidth(), dynamicResolution->getFullHeight(), SCREEN_NEAR, SCREEN_DEPTH, (DepthStorageFormat)depthStorageFormat);
+		}
+		ImGui::Text("Error in world units over %.1f to %.0f, bandwidth at full resolution:", SCREEN_NEAR, SCREEN_DEPTH);
+		for (const DepthStorageReport& row : depthStorageReport)
+		{
+			ImGui::Text("%s: mean %.5f, max %.5f, near max %.5f, %.1f MB/frame", CameraDepthTarget::getName(row.format), row.meanError, row.maxError, row.maxNearError, row.bytesPerFrame / (1024.0 * 1024.0));
+		}
+	}
+
+	// Virtual texture UI attributes and page cache counters
+	if (ImGui::CollapsingHeader("Virtual Texture"))
+	{
+		if (virtualHeightMap->isValid())
+		{
+			const VirtualTextureStats& vtStats = virtualHeightMap->getStats();
+			ImGui::Checkbox("Stream Heightmap", &useVirtualTexture);
+			ImGui::DragInt("Uploads Per Frame", &virtualHeightMap->maxUploadsPerFrame, 1, 1, 256);
+			ImGui::Text("Page Hits: %d  Misses: %d", vtStats.pageHits, vtStats.pageMisses);
+			ImGui::Text("Resident: %d / %d  Pending: %d", vtStats.residentPages, virtualHeightMap->getCacheSize() * virtualHeightMap->getCacheSize(), vtStats.pendingPages);
+			ImGui::Text("Upload: %.1f KB/frame (%.2f MB total)", vtStats.uploadBytes / 1024.0f, vtStats.totalUploadBytes / (1024.0f * 1024.0f));
+			ImGui::Text("Physical Cache: %.2f MB", virtualHeightMap->getPhysicalBytes() / (1024.0f * 1024.0f));
+		}
+		else
+		{
+			ImGui::Text("res/height.vtex could not be opened");
+		}
+	}
+
+	// Occlusion culling UI attributes, results and the benchmark flythrough
+	if (ImGui::CollapsingHeader("Occlusion Culling"))
+	{
+		const OcclusionStats& occlusionStats = occlusionCuller.getStats();
+		ImGui::Checkbox("Activate Occlusion Culling", &occlusionCulling);
+		ImGui::Checkbox("Software Rasterized Occluders", &softwareOcclusion);
+		ImGui::Text("Tested: %d  Frustum Culled: %d", occlusionStats.tested, occlusionStats.frustumCulled);
+		ImGui::Text("Occluded: %d  Visible: %d", occlusionStats.occluded, occlusionStats.visible);
+		ImGui::Text("Occluded Fraction: %.1f%%", occlusionCuller.getOccludedFraction() * 100.0f);
+		ImGui::Text("Patches Drawn: %d / %d", (int)visiblePatches.size(), objectBoundsStart);
+		if (softwareOcclusion)
+		{
+			ImGui::Text("Occluder Triangles: %d", occlusionRasterizer->getTrianglesRasterized());
+		}
+
+		if (flythrough.isActive())
+		{
+			ImGui::Text("Flythrough: %.1f / %.1f s", flythrough.getTime(), flythrough.getDuration());
+			if (ImGui::Button("Stop Flythrough"))
+			{
+				flythrough.stop(camera);
+				occlusionLog.close();
+				qualityGovernor.stopLog();
+			}
+		}
+		else if (ImGui::Button("Run Benchmark Flythrough"))
+		{
+			// Logs every frame of the flythrough to a CSV file, which can be compared between the GPU and software paths
+			occlusionLog.open(softwareOcclusion ? "occlusion_software.csv" : "occlusion_hiz.csv", { "time", "segment", "tested", "frustum_culled", "occluded", "occluded_fraction" });
+			occludedFractionSum = 0.0;
+			averageOccludedFraction = -1.0f;
+			occlusionCulling = true;
+			flythrough.start(camera);
+		}
+		if (averageOccludedFraction >= 0.0f)
+		{
+			ImGui::Text("Flythrough Average Occluded: %.1f%%", averageOccludedFraction * 100.0f);
+		}
+	}
+
+	// GPU driven rendering UI attributes, visible counts and the object scaling benchmark
+	if (ImGui::CollapsingHeader("GPU Driven Rendering"))
+	{
+		if (gpuPatchesValid)
+		{
+			ImGui::Checkbox("Activate GPU Driven", &gpuDriven);
+		}
+		else
+		{
+			ImGui::Text("Terrain patches aren't all the same size, GPU driven path unavailable");
+			gpuDriven = false;
+		}
+		ImGui::DragFloat4("LOD Distances", lodDistances, 1.0f, 1.0f, 1000.0f);
+		ImGui::DragInt("Objects", &objectCount, 1000.0f, 0, 1000000);
+		if (ImGui::Button("Place Objects"))
+		{
+			populateObjects(objectCount);
+		}
+		ImGui::Text("CPU Submit: %.3f ms", submitMilliseconds);
+		ImGui::Text("Record Buffers: %.2f MB", gpuScene->getGpuBytes() / (1024.0f * 1024.0f));
+
+		// The CPU driven path can draw through the render queue, sorted by state, or object by object in a fixed order
+		if (!gpuDriven)
+		{
+			ImGui::Checkbox("Render Queue", &useRenderQueue);
+			if (useRenderQueue)
+			{
+				const RenderQueueStats& queueStats = renderQueue->getStats();
+				ImGui::Text("Queue: %d packets on %d threads, %d shader / %d mesh changes", queueStats.packets, renderQueue->getThreadCount(), queueStats.shaderChanges, queueStats.meshChanges);
+				ImGui::Text("Build %.3f ms, Sort %.3f ms, Submit %.3f ms", queueStats.buildMilliseconds, queueStats.sortMilliseconds, queueStats.submitMilliseconds);
+			}
+		}
+		if (ImGui::Button("Run Render Queue Benchmark"))
+		{
+			renderQueueBenchmark.run("render_queue.csv");
+		}
+		for (const RenderQueueResult& result : renderQueueBenchmark.getResults())
+		{
+			ImGui::Text("%7d packets: build %.2f, sort %.2f (std::sort %.2f), submit %.2f ms, changes %d -> %d", result.packets, result.buildMilliseconds, result.sortMilliseconds, result.comparisonSortMilliseconds, result.submitMilliseconds, result.unsortedChanges, result.sortedChanges);
+		}
+		if (gpuDriven)
+		{
+			ImGui::Text("Camera Patches: %d / %d", gpuScene->getVisiblePatches(GPU_VIEW_CAMERA), gpuScene->getPatchCount());
+			ImGui::Text("Camera Objects: %d / %d / %d (LOD 0 / 1 / 2)", gpuScene->getVisibleObjects(GPU_VIEW_CAMERA, 0), gpuScene->getVisibleObjects(GPU_VIEW_CAMERA, 1), gpuScene->getVisibleObjects(GPU_VIEW_CAMERA, 2));
+			ImGui::Text("Shadow Patches: %d directional, %d spot", gpuScene->getVisiblePatches(GPU_VIEW_DIRECTIONAL), gpuScene->getVisiblePatches(GPU_VIEW_SPOT));
+		}
+
+		if (scalingBenchmark.isActive())
+		{
+			ImGui::Text("Benchmark: %d objects (step %d / %d)", scalingBenchmark.getStepValue(), scalingBenchmark.getStep() + 1, scalingBenchmark.getStepCount());
+			if (ImGui::Button("Stop Benchmark"))
+			{
+				scalingBenchmark.stop();
+			}
+		}
+		else if (ImGui::Button("Run Scaling Benchmark"))
+		{
+			// Drawing a million objects one at a time would take minutes per frame, so the CPU path stops at a hundred thousand
+			vector<int> steps = { 1000, 10000, 100000 };
+			if (gpuDriven)
+			{
+				steps.push_back(1000000);
+			}
+			if (scalingBenchmark.start(gpuDriven ? "gpu_driven_scaling.csv" : "cpu_driven_scaling.csv", steps))
+			{
+				populateObjects(steps[0]);
+			}
+		}
+		for (const ScalingResult& result : scalingBenchmark.getResults())
+		{
+			ImGui::Text("%7d objects: %.3f ms CPU, %.2f ms frame, %.0f visible", result.value, result.cpuMilliseconds, result.frameMilliseconds, result.visible);
+		}
+	}
+
+	// Dynamic resolution UI attributes, the controller's last decision and the GPU time of every pass
+	if (ImGui::CollapsingHeader("Dynamic Resolution"))
+	{
+		ImGui::Checkbox("Activate Dynamic Resolution", &dynamicResolution->enabled);
+		if (dynamicResolution->enabled)
+		{
+			ImGui::DragFloat("Target Frame Time (ms)", &dynamicResolution->targetMilliseconds, 0.1f, 1.0f, 100.0f);
+			ImGui::DragFloat("Min Scale", &dynamicResolution->minScale, 0.01f, 0.25f, dynamicResolution->maxScale);
+			ImGui::DragFloat("Max Scale", &dynamicResolution->maxScale, 0.01f, dynamicResolution->minScale, 1.0f);
+			ImGui::DragFloat("Headroom", &dynamicResolution->headroom, 0.01f, 0.5f, 1.0f);
+			ImGui::DragInt("Cooldown Frames", &dynamicResolution->cooldownFrames, 1, 0, 120);
+		}
+		else
+		{
+			ImGui::SliderFloat("Render Scale", &manualScale, 0.25f, 1.0f);
+		}
+		ImGui::Checkbox("Bicubic Upsampling", &bicubicUpsample);
+
+		const char* decisions[] = { "Down", "Hold", "Up" };
+		ImGui::Text("Scale: %.2f (%d x %d)", dynamicResolution->getScale(), dynamicResolution->getWidth(), dynamicResolution->getHeight());
+		ImGui::Text("Decision: %s, %s", decisions[dynamicResolution->getDecision() + 1], dynamicResolution->getReason());
+		ImGui::Text("Predicted Scale: %.2f", dynamicResolution->getPredictedScale());
+		ImGui::Text("GPU Frame: %.2f ms", gpuProfiler->getFrameTime());
+		for (int pass = 0; pass < gpuProfiler->getPassCount(); pass++)
+		{
+			ImGui::Text("  %s: %.2f ms", gpuProfiler->getPassName(pass).c_str(), gpuProfiler->getPassTime(pass));
+		}
+
+		// The ring only helps where the 11.1 runtime can bind constant buffers at an offset, and can be turned off to compare
+		if (!constantRing->isSupported())
+		{
+			ImGui::Text("Constant ring unsupported, shaders map their own buffers");
+		}
+		else if (ImGui::Checkbox("Constant Ring", &useConstantRing))
+		{
+			setConstantRing(useConstantRing ? constantRing : NULL);
+		}
+		for (int counter = 0; counter < gpuProfiler->getCounterCount(); counter++)
+		{
+			ImGui::Text("  %s: %.1f", gpuProfiler->getCounterName(counter).c_str(), gpuProfiler->getCounterValue(counter));
+		}
+
+		if (dynamicResolution->isTracing())
+		{
+			if (ImGui::Button("Stop Trace"))
+			{
+				dynamicResolution->stopTrace();
+			}
+		}
+		else if (ImGui::Button("Start Trace"))
+		{
+			// Logs every decision alongside the timings it was based on
+			dynamicResolution->startTrace("dynamic_resolution_trace.csv");
+		}
+	}
+
+	// Shadow atlas tiles, occupancy and the memory saved against a full map per light
+	if (ImGui::CollapsingHeader("Shadow Atlas"))
+	{
+		const char* lightNames[] = { "Directional", "Spot", "Point +X", "Point -X", "Point +Y", "Point -Y", "Point +Z", "Point -Z" };
+		ImGui::DragFloat("Spot Shadow Range", &spotShadowRange, 1.0f, 1.0f, 200.0f);
+		ImGui::DragInt("Resize Frames", &shadowAtlas->resizeFrames, 1, 1, 120);
+		ImGui::Checkbox("Redraw Every Frame", &shadowRedraw);
+		for (int light = 0; light < shadowAtlas->getLightCount(); light++)
+		{
+			const ShadowAtlasTile& tile = shadowAtlas->getTile(light);
+			ImGui::Text("%s: %d x %d at (%d, %d)", lightNames[light], tile.size, tile.size, tile.x, tile.y);
+		}
+		ImGui::Text("Occupancy: %.1f%% of %d x %d", shadowAtlas->getOccupancy() * 100.0f, shadowAtlas->getAtlasSize(), shadowAtlas->getAtlasSize());
+		ImGui::Text("Memory: %.0f MB atlas vs %.0f MB separate maps (%.0f MB saved)", shadowAtlas->getAtlasBytes() / (1024.0f * 1024.0f), shadowAtlas->getSeparateMapBytes() / (1024.0f * 1024.0f), (shadowAtlas->getSeparateMapBytes() - shadowAtlas->getAtlasBytes()) / (1024.0f * 1024.0f));
+		ImGui::Text("Tiles Redrawn: %d this frame, %d repacks", shadowAtlas->getTilesRendered(), shadowAtlas->getRepackCount());
+	}
+
+	// Horizon map UI attributes, how long it took to build and the shadow pass time saved by leaving the terrain out of them
+	if (ImGui::CollapsingHeader("Horizon Shadows"))
+	{
+		ImGui::Checkbox("Terrain Horizon Shadows", &horizonShadows);
+		ImGui::DragFloat("Horizon Softness", &horizonSoftness, 0.005f, 0.0f, 0.5f);
+		if (ImGui::DragFloat("Horizon Distance", &horizonMap->maxDistance, 1.0f, 1.0f, 100.0f))
+		{
+			horizonMap->invalidateAll();
+		}
+		ImGui::Text("Horizon Map: %d x %d, %d directions, %.1f MB", horizonMap->getSize(), horizonMap->getSize(), HorizonMap::DIRECTIONS, horizonMap->getBytes() / (1024.0f * 1024.0f));
+		ImGui::Text("Last Rebuild: %d texels in %.1f ms on %d threads", horizonMap->getLastRebuildTexels(), horizonMap->getLastBuildMilliseconds(), horizonMap->getThreadCount());
+		if (ImGui::Button("Rebuild Horizon Map"))
+		{
+			horizonMap->invalidateAll();
+		}
+		ImGui::Text("Turn on Redraw Every Frame under Shadow Atlas, then toggle horizon shadows to measure both");
+		ImGui::Text("Directional + Spot Shadow: %.3f ms with terrain, %.3f ms with horizon map", shadowPassTimes[0], shadowPassTimes[1]);
+		if (shadowPassTimes[0] > 0.0f && shadowPassTimes[1] > 0.0f)
+		{
+			ImGui::Text("Saved: %.3f ms (%.0f%%)", shadowPassTimes[0] - shadowPassTimes[1], (1.0f - shadowPassTimes[1] / shadowPassTimes[0]) * 100.0f);
+		}
+	}
+
+	// Frame capture UI attributes, and what recording costs the render thread each frame
+	if (ImGui::CollapsingHeader("Frame Capture"))
+	{
+		bool wasCapturing = captureColour || captureDepth || captureSoftwareDepth;
+		ImGui::Checkbox("Capture Colour", &captureColour);
+		ImGui::Checkbox("Capture Depth", &captureDepth);
+		ImGui::Checkbox("Capture Software Occlusion Depth", &captureSoftwareDepth);
+		const char* fileFormats[CAPTURE_FILE_FORMAT_COUNT];
+		for (int format = 0; format < CAPTURE_FILE_FORMAT_COUNT; format++)
+		{
+			fileFormats[format] = FrameCapture::getName((CaptureFileFormat)format);
+		}
+		if (ImGui::Combo("Capture Format", &captureFileFormat, fileFormats, CAPTURE_FILE_FORMAT_COUNT))
+		{
+			frameCapture->fileFormat = (CaptureFileFormat)captureFileFormat;
+		}
+		const char* policies[] = { "Drop When Behind", "Block When Behind" };
+		if (ImGui::Combo("Capture Policy", &capturePolicy, policies, 2))
+		{
+			frameCapture->policy = (CapturePolicy)capturePolicy;
+		}
+
+		// Stopping a recording waits for the last few copies and the encoder, so every frame captured ends up on disk
+		if (wasCapturing && !(captureColour || captureDepth || captureSoftwareDepth))
+		{
+			frameCapture->flush(getDeviceContext());
+		}
+		if (captureSoftwareDepth && !softwareOcclusion)
+		{
+			ImGui::Text("Software occlusion depth is only captured while software occlusion is on");
+		}
+		FrameCaptureStats captureStats = frameCapture->getStats();
+		ImGui::Text("Render Thread: %.3f ms this frame, %.3f ms peak", captureStats.frameMilliseconds, captureStats.peakFrameMilliseconds);
+		ImGui::Text("Encoder: %.2f ms per frame, %d queued, %d copies in flight", captureStats.encodeMilliseconds, captureStats.queued, captureStats.inFlight);
+		ImGui::Text("Captured %d, written %d (%.1f MB), dropped %d, failed %d", captureStats.captured, captureStats.written, captureStats.bytesWritten / (1024.0 * 1024.0), captureStats.dropped, captureStats.failed);
+	}
+
+	// Texture cooking UI attributes, what each cooked texture costs in memory and per texel read against the texture it replaces
+	if (ImGui::CollapsingHeader("Texture Cooking"))
+	{
+		if (ImGui::Checkbox("Use Cooked Textures", &useCookedTextures))
+		{
+			tessellationShader->setNormalMap(getNormalMap());
+			gpuTessellationShader->setNormalMap(getNormalMap());
+		}
+		const char* heightFormats[] = { "R16", "BC4" };
+		ImGui::Combo("Height Format", &cookedHeightFormat, heightFormats, 2);
+		if (ImGui::Button("Recook Textures"))
+		{
+			loadCookedTextures(true);
+		}
+
+		// Sources are what the texture manager loaded, the normal map replacing the heightmap reads CalculatePixelNormal makes instead
+		ID3D11ShaderResourceView* sources[3] = { textureMgr->getTexture(L"heightMap"), NULL, textureMgr->getTexture(L"brick") };
+		ID3D11ShaderResourceView* cooked[3] = { cookedHeightTexture, cookedNormalTexture, cookedBrickTexture };
+		const char* names[3] = { "Height Map", "Normal Map", "Brick" };
+		for (int i = 0; i < 3; i++)
+		{
+			if (!cooked[i])
+			{
+				ImGui::Text("%s: not cooked", names[i]);
+				continue;
+			}
+			D3D11_SHADER_RESOURCE_VIEW_DESC cookedDesc;
+			cooked[i]->GetDesc(&cookedDesc);
+			if (sources[i])
+			{
+				D3D11_SHADER_RESOURCE_VIEW_DESC sourceDesc;
+				sources[i]->GetDesc(&sourceDesc);
+				ImGui::Text("%s: %s %.2f MB -> %s %.2f MB, %.1f -> %.1f bytes per texel", names[i], TextureCooker::getFormatName(sourceDesc.Format), TextureCooker::getTextureBytes(sources[i]) / (1024.0 * 1024.0),
+					TextureCooker::getFormatName(cookedDesc.Format), TextureCooker::getTextureBytes(cooked[i]) / (1024.0 * 1024.0), TextureCooker::getBytesPerTexel(sourceDesc.Format), TextureCooker::getBytesPerTexel(cookedDesc.Format));
+			}
+			else
+			{
+				ImGui::Text("%s: %s %.2f MB, one read in place of five height reads", names[i], TextureCooker::getFormatName(cookedDesc.Format), TextureCooker::getTextureBytes(cooked[i]) / (1024.0 * 1024.0));
+			}
+
+			// Only textures cooked since starting have timings, the rest were loaded from their files
+			const CookReport& report = cookReports[i];
+			if (report.mipCount > 0)
+			{
+				ImGui::Text("  %d mips encoded in %.1f ms, %.1f MTexels/s on %d threads", report.mipCount, report.encodeMilliseconds, report.megatexelsPerSecond, report.threads);
+				if (i == 0)
+				{
+					ImGui::Text("  Error: %.5f RMS, %.5f max (%.4f, %.4f world units)", report.rmsError, report.maxError, report.rmsError * 30.0, report.maxError * 30.0);
+				}
+				else
+				{
+					ImGui::Text("  Error: %.5f RMS, %.5f max", report.rmsError, report.maxError);
+				}
+				ImGui::Text("  PSNR: %.1f dB, worst mip %d at %.1f dB, %.5f max over every mip", report.psnr, report.worstMip, report.worstMipPsnr, report.mipMaxError);
+			}
+		}
+		ImGui::Text("Screen Pass: %.3f ms with source textures, %.3f ms with cooked", screenPassTimes[0], screenPassTimes[1]);
+	}
+
+	// Geometry registry UI attributes, how much sharing saved and each mesh's post-transform cache misses before and after optimizing
+	if (ImGui::CollapsingHeader("Geometry Registry"))
+	{
+		if (ImGui::Checkbox("Optimize Meshes", &optimizeGeometry))
+		{
+			geometry->build(renderer->getDevice(), optimizeGeometry);
+		}
+		ImGui::Text("%d requests sharing %d meshes, built in %.2f ms", geometry->getRequestCount(), geometry->getMeshCount(), geometry->getBuildMilliseconds());
+		ImGui::Text("Shared Buffers: %.1f KB, %.1f KB as separate meshes", geometry->getBufferBytes() / 1024.0, geometry->getSourceBytes() / 1024.0);
+		ImGui::Text("ACMR and ATVR through a %d entry FIFO cache:", MeshOptimizer::SIMULATED_CACHE_SIZE);
+		for (const GeometryReport& report : geometry->getReports())
+		{
+			ImGui::Text("%-10s x%d %5d tris, %5d -> %5d verts, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f%s", report.name.c_str(), report.requests, report.triangles, report.sourceVertices, report.vertices,
+				report.before.acmr, report.after.acmr, report.before.atvr, report.after.atvr, report.overdrawSorted ? ", sorted for overdraw" : "");
+		}
+	}
+
+	// Memory UI attributes, usage by category against its budget, the peak and steady state, and the largest allocations
+	if (ImGui::CollapsingHeader("Memory"))
+	{
+		MemoryTracker* memory = MemoryTracker::get();
+		const double MB = 1024.0 * 1024.0;
+		ImGui::Text("GPU: %.1f MB, peak %.1f MB", memory->getGpuBytes() / MB, memory->getPeakGpuBytes() / MB);
+		ImGui::Text("Host: %.1f MB, peak %.1f MB", memory->getHostBytes() / MB, memory->getPeakHostBytes() / MB);
+		if (memory->isSteady())
+		{
+			ImGui::Text("Steady State: %.1f MB GPU, %.1f MB host since frame %llu", memory->getSteadyGpuBytes() / MB, memory->getSteadyHostBytes() / MB, memory->getSteadyFrame());
+			ImGui::Text("  host containers resized by %.1f KB while settling", memory->getSteadyResizedBytes() / 1024.0);
+		}
+		else
+		{
+			ImGui::Text("Steady State: waiting for %d frames without an allocation", MemoryTracker::STEADY_FRAMES);
+		}
+
+		bool budgetsChanged = ImGui::DragInt("GPU Budget (MB)", &gpuMemoryBudget, 1.0f, 0, 16384);
+		for (int i = 0; i < MEMORY_CATEGORIES; i++)
+		{
+			MemoryCategoryStats stats = memory->getCategoryStats((MemoryCategory)i);
+			ImGui::Text("%-14s %8.2f MB in %3d, peak %8.2f MB, %llu released%s", MemoryTracker::getCategoryName((MemoryCategory)i), stats.bytes / MB, stats.count,
+				stats.peakBytes / MB, stats.released, stats.overBudget ? ", OVER BUDGET" : "");
+			string label = string(MemoryTracker::getCategoryName((MemoryCategory)i)) + " Budget (MB)";
+			budgetsChanged |= ImGui::DragInt(label.c_str(), &memoryBudgets[i], 1.0f, 0, 16384);
+		}
+		if (budgetsChanged)
+		{
+			applyMemoryBudgets();
+		}
+		for (const string& downgrade : memoryDowngrades)
+		{
+			ImGui::Text("%s", downgrade.c_str());
+		}
+
+		if (ImGui::Button("Write Memory Snapshot"))
+		{
+			memory->writeSnapshot("memory_snapshot.json");
+		}
+		vector<MemoryAllocation> allocations = memory->getAllocations();
+		ImGui::Text("Largest of %d allocations:", (int)allocations.size());
+		for (size_t i = 0; i < allocations.size() && i < 8; i++)
+		{
+			ImGui::Text("  %-32s %-14s %8.2f MB", allocations[i].name.c_str(), MemoryTracker::getCategoryName(allocations[i].category), allocations[i].bytes / MB);
+		}
+	}
+
+	// Command trace UI attributes, recording frames of what the renderer issues, what the trace holds, and how fast it replays
+	if (ImGui::CollapsingHeader("Command Trace"))
+	{
+		if (traceFramesLeft > 0)
+		{
+			ImGui::Text("Recording: %d of %d frames left", traceFramesLeft, traceFrames);
+		}
+		else
+		{
+			ImGui::SliderInt("Frames To Record", &traceFrames, 1, 600);
+			if (ImGui::Button("Record Trace"))
+			{
+				traceFramesLeft = traceFrames;
+			}
+		}
+
+		if (!commandTrace.isEmpty() && traceFramesLeft == 0)
+		{
+			const CommandTraceStats& traceStats = commandTrace.getStats();
+			const double KB = 1024.0;
+			int frames = max(traceStats.frames, 1);
+			ImGui::Text("Trace: %d frames, %llu commands, %d objects", traceStats.frames, traceStats.commands, traceStats.objects);
+			ImGui::Text("Size: %.1f KB, %.1f KB per frame (%.1f KB commands, %.1f KB uploaded data)", commandTrace.getBytes() / KB, commandTrace.getBytes() / KB / frames,
+				traceStats.commandBytes / KB / frames, traceStats.dataBytes / KB / frames);
+			ImGui::Text("Per Frame: %llu draws, %llu dispatches, %llu bindings, %llu uploads", traceStats.draws / frames, traceStats.dispatches / frames, traceStats.bindings / frames, traceStats.uploads / frames);
+			ImGui::Text("Average Command: %.1f bytes", (double)traceStats.commandBytes / max(traceStats.commands, 1ull));
+			for (int op = 0; op < COMMAND_OPS; op++)
+			{
+				if (traceStats.opCounts[op] > 0)
+				{
+					ImGui::Text("  %-32s %8llu", CommandTrace::getOpName((CommandOp)op), traceStats.opCounts[op]);
+				}
+			}
+			if (ImGui::Button("Save Trace"))
+			{
+				commandTrace.save("command_trace.ctr");
+			}
+
+			// The recorded frames' time includes the application's logic and the recorder itself, the replay's only the commands
+			ImGui::SliderInt("Replay Iterations", &replayIterations, 1, 100);
+			if (ImGui::Button("Replay Trace"))
+			{
+				replayRequested = true;
+			}
+			ImGui::Text("Recorded: %.2f ms CPU per frame", tracedMilliseconds / frames);
+			if (replayFailed)
+			{
+				ImGui::Text("Replay stopped: the trace is truncated or corrupt");
+			}
+			if (replayStats.frames > 0)
+			{
+				double replayFrames = replayStats.frames;
+				ImGui::Text("Replay: %.3f ms submitting, %.3f ms until the GPU finished, per frame", replayStats.submitMilliseconds / replayFrames, replayStats.totalMilliseconds / replayFrames);
+				ImGui::Text("Throughput: %.0f fps, %.2f M commands/s, %.1f MB/s", replayStats.framesPerSecond, replayStats.commandsPerSecond / 1000000.0, replayStats.megabytesPerSecond);
+			}
+		}
+	}
+
+	// Scene UI attributes, saving what's been changed and reloading it, and how long the binary scene takes to load against its JSON
+	if (ImGui::CollapsingHeader("Scene"))
+	{
+		if (ImGui::Button("Save Scene"))
+		{
+			saveScene();
+		}
+		ImGui::SameLine();
+		if (ImGui::Button("Load Scene"))
+		{
+			loadScene(L"res/scene.scnb");
+		}
+		ImGui::SameLine();
+		if (ImGui::Button("Convert scene.json"))
+		{
+			if (SceneJson::convert(L"res/scene.json", L"res/scene.scnb"))
+			{
+				loadScene(L"res/scene.scnb");
+			}
+		}
+		ImGui::Text("Last Load: %d instances, %.2f MB, mapped in %.3f ms, applied in %.3f ms", sceneInstanceCount, sceneBytes / (1024.0 * 1024.0), sceneMapMilliseconds, sceneApplyMilliseconds);
+		if (ImGui::Button("Run Scene Load Benchmark"))
+		{
+			sceneLoadBenchmark.run("scene_load.csv", buildScene());
+		}
+		for (const SceneLoadResult& result : sceneLoadBenchmark.getResults())
+		{
+			ImGui::Text("%7d instances: JSON %.2f ms (%.1f MB), binary %.3f ms open, %.3f ms read (%.1f MB)%s", result.instances, result.jsonMilliseconds, result.jsonBytes / (1024.0 * 1024.0),
+				result.binaryOpenMilliseconds, result.binaryReadMilliseconds, result.binaryBytes / (1024.0 * 1024.0), result.matched ? "" : ", mismatched");
+		}
+	}
+
+	// Terrain query UI attributes, the ground under the camera and what the centre of the screen is looking at
+	if (ImGui::CollapsingHeader("Terrain Query"))
+	{
+		ImGui::Checkbox("Camera Collision", &cameraCollision);
+		ImGui::DragFloat("Camera Clearance", &cameraClearance, 0.1f, 0.0f, 10.0f);
+		XMFLOAT3 position = camera->getPosition();
+		ImGui::Text("Ground Under Camera: %.2f (camera at %.2f)", terrainQuery->getHeight(position.x, position.z), position.y);
+
+		// The view matrix's inverse holds the camera's forward axis in its third row
+		XMFLOAT4X4 cameraWorld;
+		XMStoreFloat4x4(&cameraWorld, XMMatrixInverse(NULL, camera->getViewMatrix()));
+		TerrainHit hit;
+		if (terrainQuery->raycast(position, XMFLOAT3(cameraWorld._31, cameraWorld._32, cameraWorld._33), 1000.0f, hit))
+		{
+			ImGui::Text("Looking At: (%.2f, %.2f, %.2f), %.2f away", hit.position.x, hit.position.y, hit.position.z, hit.distance);
+		}
+		else
+		{
+			ImGui::Text("Looking At: nothing");
+		}
+		ImGui::Text("Quadtree: %d levels, %d nodes and %d leaves visited", terrainQuery->getLevelCount(), terrainQuery->getLastNodesVisited(), terrainQuery->getLastLeavesTested());
+		if (ImGui::Button("Run Terrain Query Benchmark"))
+		{
+			terrainQueryBenchmark.run("terrain_query.csv", *terrainQuery);
+		}
+		for (const TerrainQueryResult& result : terrainQueryBenchmark.getResults())
+		{
+			ImGui::Text("%-12s %7d in %.2f ms, %.2f M/s, %d hits", result.name.c_str(), result.count, result.milliseconds, result.perSecond / 1000000.0, result.hits);
+		}
+		if (!terrainQueryBenchmark.getResults().empty())
+		{
+			ImGui::Text("Largest quadtree / march difference: %.4f, %d grazing hits stepped over", terrainQueryBenchmark.getMaxRayDifference(), terrainQueryBenchmark.getSteppedOver());
+		}
+	}
+
+	// Terrain editing UI attributes. Holding a brush's button paints it where the centre of the screen meets the terrain, scaled by the frame time
+	if (ImGui::CollapsingHeader("Terrain Editing"))
+	{
+		const char* brushes[TERRAIN_BRUSHES] = { "Raise", "Lower", "Smooth" };
+		ImGui::Combo("Brush", &brushType, brushes, TERRAIN_BRUSHES);
+		ImGui::SliderFloat("Brush Radius", &brushRadius, 0.5f, 20.0f);
+		if (brushType == TERRAIN_BRUSH_SMOOTH)
+		{
+			ImGui::SliderFloat("Brush Smoothing", &brushSmoothing, 0.1f, 10.0f);
+		}
+		else
+		{
+			ImGui::SliderFloat("Brush Strength", &brushStrength, 0.01f, 1.0f);
+		}
+		ImGui::Button("Hold To Paint");
+		if (ImGui::IsItemActive())
+		{
+			XMFLOAT3 position = camera->getPosition();
+			XMFLOAT4X4 cameraWorld;
+			XMStoreFloat4x4(&cameraWorld, XMMatrixInverse(NULL, camera->getViewMatrix()));
+			TerrainHit hit;
+			if (terrainQuery->raycast(position, XMFLOAT3(cameraWorld._31, cameraWorld._32, cameraWorld._33), 1000.0f, hit))
+			{
+				float strength = brushType == TERRAIN_BRUSH_SMOOTH ? brushSmoothing : brushStrength;
+				editTerrain((TerrainBrush)brushType, hit.position.x, hit.position.z, strength * timer->getTime());
+			}
+		}
+
+		const TerrainEditStats& stats = terrainEditor->getStats();
+		ImGui::Text("Edits: %llu, %d this frame changing %d texels in %.3f ms", stats.totalEdits, stats.edits, stats.texelsChanged, stats.brushMilliseconds);
+		ImGui::Text("Uploaded: %d of %d tiles, %.1f KB across %d mips", stats.tilesUploaded, terrainEditor->getTileCount(), stats.bytesUploaded / 1024.0, terrainEditor->getMipCount());
+		ImGui::Text("Encode %.3f ms, upload %.3f ms", stats.encodeMilliseconds, stats.uploadMilliseconds);
+		ImGui::Text("Textures: %.1f MB on the GPU, %.1f MB of mips kept on the CPU", terrainEditor->getGpuBytes() / (1024.0 * 1024.0), terrainEditor->getCpuBytes() / (1024.0 * 1024.0));
+		if (ImGui::Button("Run Terrain Edit Benchmark"))
+		{
+			terrainEditBenchmark.run("terrain_edit.csv", renderer->getDevice(), getDeviceContext());
+		}
+		for (const TerrainEditResult& result : terrainEditBenchmark.getResults())
+		{
+			ImGui::Text("%5d x %-5d %.0f edits/s, per edit: brush %.3f, quadtree %.3f, bounds %.3f, horizon %.3f, encode %.3f, upload %.3f ms, %.1f tiles, %.1f KB", result.size, result.size,
+				result.editsPerSecond, result.brushMilliseconds, result.queryMilliseconds, result.boundsMilliseconds, result.horizonMilliseconds, result.encodeMilliseconds, result.uploadMilliseconds,
+				result.tilesPerEdit, result.uploadKilobytesPerEdit);
+		}
+	}
+
+	// Frame pipeline UI attributes, how much of each frame the update thread ran alongside and how long input took to reach the screen
+	if (ImGui::CollapsingHeader("Frame Pipeline"))
+	{
+		ImGui::Checkbox("Pipelined Update", &pipelinedUpdate);
+		FramePipelineStats stats = framePipeline->getStats();
+		ImGui::Text("Update Thread: %s at %d Hz, %llu ticks, %llu skipped", framePipeline->isRunning() ? "running" : "stopped", framePipeline->getTickRate(), (unsigned long long)stats.ticks, (unsigned long long)stats.skippedTicks);
+		ImGui::Text("Update: %.3f ms per tick, Render: %.3f ms CPU per frame", stats.updateMilliseconds, stats.renderMilliseconds);
+		ImGui::Text("Overlap: %.3f ms (%.1f%% of the frame)", stats.overlapMilliseconds, stats.overlapFraction * 100.0);
+		ImGui::Text("Input To Present: %.2f ms, To Photon: %.2f ms (estimated)", stats.inputToPresentMilliseconds, stats.inputToPhotonMilliseconds);
+		ImGui::Text("Input To Photon: %.2f ms serialized, %.2f ms pipelined", inputLatencies[0], inputLatencies[1]);
+		if (framePipeline->isRunning())
+		{
+			ImGui::Text("Drawing tick %llu, %.2f of the way from the previous", (unsigned long long)framePacket.tick, stats.interpolation);
+		}
+	}
+
+	// Point light shadow UI attributes, and the cost of drawing its faces in one pass against six
+	if (ImGui::CollapsingHeader("Point Light Shadows"))
+	{
+		ImGui::Checkbox("Point Light Shadows", &pointShadows);
+		ImGui::Checkbox("Naive Six Pass", &pointShadowSixPass);
+		ImGui::Text("Faces Drawn: %d of %d", pointShadowFacesDrawn, PointShadowMap::FACE_COUNT);
+		ImGui::Text("Draw Calls: %d", pointShadowDraws);
+		ImGui::Text("GPU Time: %.3f ms single pass, %.3f ms six pass", gpuProfiler->getPassTime("Point Shadow"), gpuProfiler->getPassTime("Point Shadow (Six Pass)"));
+	}
+
+	// Shadow filtering UI attributes, and the CPU comparison of quality against resolution for each filter
+	if (ImGui::CollapsingHeader("Shadow Filtering"))
+	{
+		const char* filters[] = { "Hard", "VSM", "EVSM", "MSM" };
+		int filterMode = (int)shadowFilter.mode;
+		if (ImGui::Combo("Filter", &filterMode, filters, SHADOW_FILTER_MODES))
+		{
+			shadowFilter = ShadowMoments::getDefaultSettings((ShadowFilterMode)filterMode);
+			createShadowAtlas();
+		}
+		if (shadowFilter.mode != SHADOW_FILTER_HARD)
+		{
+			ImGui::SliderInt("Moment Blur Radius", &shadowFilter.blurRadius, 0, 8);
+			ImGui::DragFloat("Light Bleed Reduction", &shadowFilter.lightBleedReduction, 0.01f, 0.0f, 0.95f);
+			ImGui::InputFloat("Moment Bias", &shadowFilter.momentBias, 0.00001f, 0.0001f, "%.6f");
+			ImGui::InputFloat("Moment Depth Bias", &shadowFilter.depthBias, 0.0001f, 0.001f, "%.4f");
+		}
+		if (shadowFilter.mode == SHADOW_FILTER_EVSM)
+		{
+			ImGui::DragFloat("Positive Exponent", &shadowFilter.positiveExponent, 0.5f, 1.0f, 42.0f);
+			ImGui::DragFloat("Negative Exponent", &shadowFilter.negativeExponent, 0.5f, 1.0f, 42.0f);
+		}
+		ImGui::Text("Shadow Memory: %.0f MB depth + %.0f MB moments", shadowAtlas->getAtlasBytes() / (1024.0f * 1024.0f), shadowMoments->getBytes() / (1024.0f * 1024.0f));
+
+		if (ImGui::Button("Run Shadow Quality Comparison"))
+		{
+			runShadowQualityComparison();
+		}
+		for (const ShadowQualityResult& result : shadowQualityBenchmark.getResults())
+		{
+			ImGui::Text("%s %d: mean %.3f, max %.2f, artefacts %.1f%%, %.0f MB", ShadowMoments::getName(result.mode), result.resolution, result.meanError, result.maxError, result.artefactFraction * 100.0, result.bytes / (1024.0 * 1024.0));
+		}
+	}
+
+	// Quality governor UI attributes, the settings it has chosen and a benchmark flythrough logging them
+	if (ImGui::CollapsingHeader("Quality Governor"))
+	{
+		const QualitySettings& quality = qualityGovernor.getSettings();
+		ImGui::Checkbox("Activate Quality Governor", &qualityGovernor.enabled);
+		ImGui::DragFloat("Governor Target (ms)", &qualityGovernor.targetMilliseconds, 0.1f, 1.0f, 100.0f);
+		ImGui::DragFloat("Over Band", &qualityGovernor.overBand, 0.01f, 0.0f, 0.5f);
+		ImGui::DragFloat("Under Band", &qualityGovernor.underBand, 0.01f, 0.0f, 0.5f);
+		ImGui::DragInt("Frames Before Lowering", &qualityGovernor.lowerFrames, 1, 1, 120);
+		ImGui::DragInt("Frames Before Raising", &qualityGovernor.raiseFrames, 1, 1, 600);
+		const char* policies[] = { "Cost Weighted", "Fixed Order" };
+		if (ImGui::Combo("Policy", &qualityPolicy, policies, 2))
+		{
+			qualityGovernor.setPolicy(qualityPolicy == 0 ? (QualityPolicy*)&costWeightedPolicy : (QualityPolicy*)&fixedOrderPolicy);
+		}
+		if (ImGui::Button("Reset Quality"))
+		{
+			qualityGovernor.reset();
+		}
+		if (qualityGovernor.enabled && dynamicResolution->enabled)
+		{
+			ImGui::Text("Dynamic resolution is also active, give it a lower target so they don't compete");
+		}
+
+		ImGui::Text("Tessellation: %d (bias %.2f)", renderTessFactor, qualityGovernor.getTessellationBias());
+		ImGui::Text("Largest Shadow Tile: %d x %d", shadowAtlas->getMaxTileSize(), shadowAtlas->getMaxTileSize());
+		ImGui::Text("Blur Radius: %d", quality.blurRadius);
+		ImGui::Text("Changes: %d  Raise Delay: %d frames", qualityGovernor.getChangeCount(), qualityGovernor.getRaiseDelay());
+
+		if (qualityGovernor.isLogging())
+		{
+			ImGui::Text("Logging: %.1f / %.1f s", flythrough.getTime(), flythrough.getDuration());
+		}
+		else if (!flythrough.isActive() && ImGui::Button("Run Governor Benchmark"))
+		{
+			// Logs the settings the governor picks at every frame along the flythrough
+			qualityGovernor.startLog("quality_governor.csv");
+			flythrough.start(camera);
+		}
 	}
 
 	// Render UI
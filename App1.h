@@ -11,6 +11,60 @@
 #include "CombinedBlurShader.h"
 #include "DepthOfFieldShader.h"
 #include "DepthShader.h"
+#include "HeightField.h"
+#include "VirtualTexture.h"
+#include "VirtualTextureFeedbackShader.h"
+#include "HiZBuffer.h"
+#include "HiZBuildShader.h"
+#include "OcclusionCuller.h"
+#include "SoftwareOcclusionRasterizer.h"
+#include "CameraFlythrough.h"
+#include "BenchmarkLog.h"
+#include "ScalingBenchmark.h"
+#include "GpuDrivenScene.h"
+#include "GpuCullShader.h"
+#include "LodSphereMesh.h"
+#include "GeometryRegistry.h"
+#include "GpuProfiler.h"
+#include "FrameCapture.h"
+#include "MemoryTracker.h"
+#include "CommandRecorder.h"
+#include "ConstantRing.h"
+#include "StateCache.h"
+#include "RenderQueue.h"
+#include "RenderQueueBenchmark.h"
+#include "DynamicResolution.h"
+#include "QualityGovernor.h"
+#include "ShadowAtlas.h"
+#include "ShadowMomentShader.h"
+#include "ShadowQualityBenchmark.h"
+#include "PointShadowMap.h"
+#include "CubeShadowShader.h"
+#include "HorizonMap.h"
+#include "TerrainQuery.h"
+#include "TerrainQueryBenchmark.h"
+#include "TerrainEditor.h"
+#include "TerrainEditBenchmark.h"
+#include "TextureCooker.h"
+#include "SceneFile.h"
+#include "SceneJson.h"
+#include "SceneLoadBenchmark.h"
+#include "FramePipeline.h"
+#include "CameraDepthTarget.h"
+#include "BokehDofShader.h"
+#include "AutofocusShader.h"
+#include "PostStackShader.h"
+#include <chrono>
+#include <random>
+
+// Views the GPU driven path culls each frame, each with its own visible lists and draw arguments
+enum GpuView
+{
+	GPU_VIEW_CAMERA,
+	GPU_VIEW_DIRECTIONAL,
+	GPU_VIEW_SPOT,
+	GPU_VIEW_COUNT
+};
 
 class App1 : public BaseApplication
 {
@@ -26,24 +80,111 @@ public:
 	bool frame();
 
 protected:
+	// Tests the terrain patches and objects against the Hi-Z buffer, producing the list of patches and objects to draw this frame
+	void occlusionPass();
+
+	// Scatters the given number of objects across the terrain, replacing any already there
+	void populateObjects(int count);
+
+	// Draws the terrain and objects into the currently bound depth target, culling and drawing on the GPU or drawing everything from the CPU
+	// The terrain is left out when drawTerrain isn't set, for shadow maps that leave it to the horizon map
+	void renderSceneDepth(GpuView view, const XMMATRIX& viewMatrix, const XMMATRIX& projectionMatrix, bool cpuCulledPatches, bool drawTerrain);
+
+	// Draws the terrain and objects into the currently bound depth target from the CPU, one draw per object
+	void renderSceneDepthDirect(const XMMATRIX& viewMatrix, const XMMATRIX& projectionMatrix, bool cpuCulledPatches, bool drawTerrain);
+
+	// Records which pages of the virtual heightmap are visible from the Camera's Viewpoint
+	void virtualTexturePass();
+
+	// Creates the shadow atlas and moment atlas at the size the current shadow filter needs
+	void createShadowAtlas();
+
+	// Generates every shadow casting light's matrices, sizes their atlas tiles and works out which tiles need redrawing
+	void updateShadowLights();
+
+	// Compares every shadow filter mode at a range of resolutions against a high resolution reference on the CPU, logging shadow_quality.csv
+	void runShadowQualityComparison();
+
 	// Calculates depth from the Directional Light's Viewpoint
 	void depthPass1();
 
 	// Calculates depth from the Spot Light's Viewpoint
 	void depthPass2();
 
+	// Calculates depth from the Point Light's Viewpoint, into all six faces of its cube shadow map
+	void depthPass3();
+
 	// Calculates depth from the Camera's Viewpoint
 	void cameraDepthPass();
 
+	// Restricts drawing to the part of the current render texture the dynamic resolution has chosen
+	void setRenderViewport();
+
 	// Renders the screen to a texture for use in Post Processing
 	void screenPass();
 
 	// Blurs the screen texture
 	void blurPass();
 
+	// Blurs only the out of focus tiles at half resolution, in place of blurPass
+	void bokehPass();
+
+	// Runs the listed post effects in one compute dispatch, in place of blurPass and the final pass's depth of field blend
+	void postStackPass();
+	vector<PostEffect> buildPostEffects();
+
+	// Times a pass, marks it in a trace being recorded, and has the state cache forget its binds at the start of it
+	void beginPass(const char* name);
+	void endPass(const char* name);
+
+	// Queues the screen pass's terrain, objects and light meshes, then draws them in key order, setting each shader, texture and mesh only when it changes
+	void buildScreenQueue(const XMMATRIX& viewMatrix);
+	void executeScreenQueue(const XMMATRIX& worldMatrix, const XMMATRIX& viewMatrix, const XMMATRIX& projectionMatrix);
+
+	// Gives the per draw shaders the constant ring, or takes it away so they map their own buffers again
+	void setConstantRing(ConstantRing* ring);
+
+	// The context the frame is drawn through, which is the command recorder's while a trace is being recorded
+	ID3D11DeviceContext* getDeviceContext();
+
+	// Replays the recorded trace and logs how fast it went against the frames it was recorded from
+	void replayTrace();
+
+	// Applies a binary scene's settings, lights and instances, reading them straight from the mapped file. The first light of each type
+	// becomes the directional, point or spot light and the first cube the cube, with every sphere placed as an object
+	bool loadScene(const wchar_t* filename);
+
+	// Gathers the current settings, lights, cube and objects into a scene, and writes it out as res/scene.json and res/scene.scnb
+	SceneData buildScene();
+	bool saveScene();
+
+	// Gathers the camera, lights, cube and settings as they are now, for drawing from directly or handing to the frame pipeline
+	FrameState captureFrameState();
+
+	// Points the lights at the state being drawn
+	void applyFrameState();
+
+	// Loads the cooked textures, cooking any whose file is missing, or all of them again when recook is set
+	void loadCookedTextures(bool recook);
+
+	// The heightmap and brick texture the passes bind, cooked or as the texture manager loaded them, the heightmap being the editor's once
+	// it has been painted. The normal map is the cooked or edited baked normals, or none when the shader works them out from the heights
+	ID3D11ShaderResourceView* getHeightMap();
+	ID3D11ShaderResourceView* getNormalMap();
+	ID3D11ShaderResourceView* getBrickTexture();
+
 	// Passes through Depth Of Field shader and determines final screen texture to render
 	void finalPass();
 
+	// Paints a brush into the heightmap at world (x, z), then refits the quadtree, horizon map, patch bounds and occluder grid under it
+	void editTerrain(TerrainBrush brush, float x, float z, float strength);
+
+	// Hands the memory tracker the budgets set in the GUI, with the downgrade each one triggers when it's exceeded
+	void applyMemoryBudgets();
+
+	// Gives the tracker the size of each CPU side structure, then checks the budgets and writes a snapshot once usage settles
+	void updateMemory();
+
 	bool render();
 	void gui();
 
@@ -52,15 +193,72 @@ private:
 	TessellationShader* tessellationShader;
 	TPlane* TplaneMesh;
 
-	// Simple Depth Shader, Tessellation Shader and shadowmaps for both Spot Light and Directional Light
+	// Simple Depth Shader, Tessellation Shader and a shadow atlas holding a tile for the Directional Light (0), Spot Light (1)
+	// and each face of the Point Light's cube shadow map (2 to 7)
 	DepthShader* depthShader;
 	DepthTessellationShader* depthTessellationShader;
-	ShadowMap* shadowMap[2];
+	ShadowAtlas* shadowAtlas;
+
+	// The spot light's tile is sized by how much of the screen the first spotShadowRange units of its cone cover
+	// The shadow scene is what was last drawn into the tiles, any change to it meaning every tile is redrawn
+	// Redrawing every frame keeps the shadow passes' timings measurable while nothing moves
+	float spotShadowRange = 60.0f;
+	float shadowScene[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+	bool shadowRedraw = false;
+
+	// How the shadows are filtered. The moment filters blur away aliasing, so they use a far smaller atlas than the hard filter needs
+	ShadowMomentShader* shadowMoments;
+	ShadowFilterSettings shadowFilter;
+	ShadowQualityBenchmark shadowQualityBenchmark;
+	static const int MOMENT_SHADOW_MAP_SIZE = 2048;
+
+	// Precomputed horizons the terrain shadows itself with, so the directional and spot shadow maps only need the objects and cube
+	// Holds the directional and spot pass times measured with the terrain drawn into them (0) and left to the horizon map (1)
+	HorizonMap* horizonMap;
+	bool horizonShadows = true;
+	float horizonSoftness = 0.05f;
+	float shadowPassTimes[2] = { 0.0f, 0.0f };
+
+	// The point light's cube shadow map, every face drawn in one instanced submission with a geometry shader picking each face's tile
+	// The six pass version draws the whole scene once per face instead, for comparing the cost of the two
+	PointShadowMap* pointShadow;
+	CubeShadowShader* cubeShadowShader;
+	CubeShadowShader* cubeShadowTessShader;
+	vector<BoundingBox> pointShadowCasters;
+	bool pointShadows = true;
+	bool pointShadowSixPass = false;
+	int pointShadowFacesDrawn = 0;
+	int pointShadowDraws = 0;
+	static const int POINT_SHADOW_TILE = 2;
 
 	// DepthOfField and Combined Blur shaders used for Post Processing
 	DepthOfFieldShader* depthOfFieldShader;
 	CombinedBlurShader* combinedBlurShader;
 
+	// Half resolution compute depth of field, its check against the CPU reference, and a benchmark stepping the focus range down
+	// so more of the screen is out of focus at each step
+	BokehDofShader* bokehDofShader;
+	bool bokehDOF = true;
+	BokehSettings bokehSettings;
+	BokehComparison bokehComparison;
+	bool bokehCompared = false;
+	BenchmarkLog bokehComparisonLog;
+	ScalingBenchmark bokehBenchmark;
+	float bokehBenchmarkRange = 0.0f;
+
+	// Finds the focus both depth of field paths use once a frame on the GPU, unless fixed at bokehSettings.focusDistance by turning it off
+	AutofocusShader* autofocusShader;
+	bool autofocus = true;
+
+	// Runs the blur, depth of field (or bokeh composite), tonemap and colour grade in one compute dispatch in place of the blur pass and the
+	// final pass's blend. Holds the blur and final pass times measured on the two pass path (0) and the fused path (1), for comparing them
+	PostStackShader* postStackShader;
+	bool fusedPost = true;
+	bool postTonemap = false;
+	bool postColourGrade = false;
+	PostStackSettings postSettings;
+	float postPathTimes[2] = { 0.0f, 0.0f };
+
 	// Variables used to affect the Depth Of Field post process
 	// Weighting multiplies the lerp value, cutoff decides how far percentage wise a pixel's depth must be before it's completely blurred
 	bool activeDOF = true;
@@ -68,18 +266,27 @@ private:
 	float cutoff = 0.15f;
 	float percentage = 0.001f;
 
-	// Render Textures used for camera depth, screen texture and screen blur
-	RenderTexture* depthTexture;
+	// Camera depth, stored in the chosen DepthStorageFormat, and the precision and bandwidth of each format
+	CameraDepthTarget* depthTexture;
+	int depthStorageFormat = DEPTH_STORAGE_LINEAR_R16_UNORM;
+	vector<DepthStorageReport> depthStorageReport;
+
+	// Render Textures used for screen texture and screen blur
 	RenderTexture* screenTexture;
 	RenderTexture* blurTexture;
 
 	// Orthomesh used for showing post process to screen
 	OrthoMesh* screenOrthoMesh;
 
-	// Meshes to show the positions of point light and spot light, and Simple Shader to show them
+	// Meshes to show the positions of point light and spot light, and Simple Shader to show them. Both lights ask the geometry registry
+	// for the same sphere, so share one copy of it
 	BasicShader* basicShader;
-	SphereMesh* pointlightMesh;
-	SphereMesh* spotlightMesh;
+	RegisteredMesh* pointlightMesh;
+	RegisteredMesh* spotlightMesh;
+
+	// Holds the light spheres and the cube in one vertex and index buffer, welded and ordered for the vertex cache unless turned off
+	GeometryRegistry* geometry;
+	bool optimizeGeometry = true;
 
 	// Light array and specific values setup in arrays, so that the values can be changed easily
 	Light* lightArray[3];
@@ -105,15 +312,185 @@ private:
 	float cutOffAngle = 60.0f;
 
 	// Boolean array passed to the pixel shader allows for specific lights to be turned on or off
-	bool activeLight[3];
+	bool activeLight[3] = { true, true, true };
 
 	// Decides the inside and outside factor when tessellating, decides whether to use bumpmap or vertex normals
+	// The factor actually rendered with is the set one scaled by the quality governor's tessellation bias
 	int tessFactor = 10;
+	int renderTessFactor = 10;
 	bool pixelNormals = true;
 
 	// Mesh and it's position
-	CubeMesh* cube1;
+	RegisteredMesh* cube1;
 	float cubePos[3] = { 37, 18, 46 };
+
+	// Streams the heightmap through a fixed-size page cache instead of binding the whole texture, and the shader that records visible pages
+	VirtualTexture* virtualHeightMap;
+	VirtualTextureFeedbackShader* virtualTextureFeedbackShader;
+	bool useVirtualTexture = false;
+
+	// CPU copy of the heightmap, used to bound the terrain patches and build the occluder mesh
+	HeightField* heightField;
+
+	// Height and ray queries against the terrain surface, for resting objects on it, keeping the camera above it and picking
+	TerrainQuery* terrainQuery;
+	bool cameraCollision = false;
+	float cameraClearance = 1.0f;
+	TerrainQueryBenchmark terrainQueryBenchmark;
+
+	// Paints the heightmap with the brush under the centre of the screen, uploading just the tiles it touched. Strength is how far raising
+	// or lowering moves the heights a second, or how much of the way smoothing moves them a second, and the radius is in world units
+	// Painting stops the heightmap streaming, as the virtual texture's pages are cooked from the file
+	TerrainEditor* terrainEditor;
+	int brushType = TERRAIN_BRUSH_RAISE;
+	float brushRadius = 4.0f;
+	float brushStrength = 0.1f;
+	float brushSmoothing = 2.0f;
+	bool terrainEdited = false;
+	vector<int> refittedPatches;
+	TerrainEditBenchmark terrainEditBenchmark;
+
+	// The scene's lights, instances and settings are loaded from res/scene.scnb, with the values above as the built in scene written out
+	// when there isn't one. Holds how long the last load took to map and to apply, and the benchmark against loading the JSON
+	double sceneMapMilliseconds = 0.0;
+	double sceneApplyMilliseconds = 0.0;
+	int sceneInstanceCount = 0;
+	unsigned long long sceneBytes = 0;
+	SceneLoadBenchmark sceneLoadBenchmark;
+
+	// Steps the camera, lights and cube on an update thread at a fixed rate while this thread renders the previous tick, drawing a state
+	// interpolated between the last two. Without it the frame state is captured from the members above each frame and drawn directly
+	// The serialized path shows a camera move on the frame after it, so holds when the move was sampled until then
+	// Holds the input to photon estimate drawing directly (0) and through the pipeline (1), for comparing them
+	FramePipeline* framePipeline;
+	bool pipelinedUpdate = false;
+	FrameState frameState;
+	FramePacket framePacket;
+	double cameraInputTime = -1.0;
+	double shownInputTime = -1.0;
+	float inputLatencies[2] = { 0.0f, 0.0f };
+
+	// Textures cooked offline into the formats the shaders read, the heightmap as R16 (0) or BC4 (1), its per pixel normals baked into BC5
+	// and the brick texture in BC7. Holds the screen pass time with the source textures (0) and the cooked ones (1), for comparing them
+	ID3D11ShaderResourceView* cookedHeightTexture = 0;
+	ID3D11ShaderResourceView* cookedNormalTexture = 0;
+	ID3D11ShaderResourceView* cookedBrickTexture = 0;
+	bool useCookedTextures = true;
+	int cookedHeightFormat = 0;
+	CookReport cookReports[3] = {};
+	float screenPassTimes[2] = { 0.0f, 0.0f };
+
+	// A row for every texture cooked, with how far its decoded mips are from what they were cooked from
+	BenchmarkLog cookLog;
+
+	// Hi-Z occlusion culling. The pyramid is either built on the GPU from the camera depth and read back a few frames later,
+	// or rasterized on the CPU from a coarse occluder mesh of the terrain
+	HiZBuildShader* hiZBuildShader;
+	SoftwareOcclusionRasterizer* occlusionRasterizer;
+	OcclusionCuller occlusionCuller;
+	HiZBuffer hiZ;
+	XMFLOAT4X4 hiZViewProjection;
+	vector<XMFLOAT3> occluderVertices;
+	vector<unsigned int> occluderIndices;
+	bool occlusionCulling = true;
+	bool softwareOcclusion = false;
+
+	// Bounds of every terrain patch followed by the point light, spot light and cube, and the results of the last cull
+	vector<BoundingBox> occlusionBounds;
+	vector<int> visibleList;
+	vector<char> visibleFlags;
+	vector<int> visiblePatches;
+	int objectBoundsStart;
+
+	// Benchmark flythrough, logging the occluded fraction at every frame along the path
+	CameraFlythrough flythrough;
+	BenchmarkLog occlusionLog;
+	double occludedFractionSum = 0.0;
+	float averageOccludedFraction = -1.0f;
+
+	// GPU driven rendering. Patches and objects live in a persistent record buffer, a compute shader culls them and picks their
+	// level of detail for each view, and indirect draws use the instance counts the GPU wrote itself
+	GpuDrivenScene* gpuScene;
+	GpuCullShader* gpuCullShader;
+	TessellationShader* gpuTessellationShader;
+	DepthTessellationShader* gpuDepthTessellationShader;
+	BasicShader* gpuBasicShader;
+	DepthShader* gpuDepthShader;
+	LodSphereMesh* lodSphereMesh;
+	bool gpuDriven = false;
+	bool gpuPatchesValid = false;
+
+	// Object levels of detail switch at x and y times the object's radius, and patches drop tessellation between z and w units away
+	float lodDistances[4] = { 40.0f, 120.0f, 20.0f, 120.0f };
+	int objectCount = 0;
+
+	// CPU time spent submitting the scene each frame, and the benchmark scaling the object count up
+	double submitMilliseconds = 0.0;
+	ScalingBenchmark scalingBenchmark;
+
+	// Ids packed into the screen queue's keys. The terrain's shader sorts first, so it is drawn before what it hides
+	enum ScreenShader { SCREEN_SHADER_TERRAIN, SCREEN_SHADER_BASIC };
+	enum ScreenMaterial { SCREEN_MATERIAL_HEIGHT_MAP, SCREEN_MATERIAL_BRICK };
+	enum ScreenMesh { SCREEN_MESH_TERRAIN, SCREEN_MESH_OBJECT, SCREEN_MESH_POINT_LIGHT, SCREEN_MESH_SPOT_LIGHT, SCREEN_MESH_CUBE };
+
+	// Render queue for the CPU driven screen pass. Objects' packets index their records, and the light meshes' and cube's their world matrix here
+	RenderQueue* renderQueue;
+	bool useRenderQueue = true;
+	vector<XMFLOAT4X4> queueWorlds;
+	RenderQueueBenchmark renderQueueBenchmark;
+
+	// GPU timings of every pass, and the controller that uses them to pick the resolution the camera passes render at
+	// The screen, blur and depth textures stay screen sized, with only the chosen sub-rectangle drawn to and then upsampled in the final pass
+	GpuProfiler* gpuProfiler;
+	DynamicResolution* dynamicResolution;
+
+	// Records the scene and camera depth as rendered, and the software occlusion depth for runs without the GPU pyramid, to disk
+	FrameCapture* frameCapture;
+	int colourCaptureStream;
+	int depthCaptureStream;
+	int softwareDepthCaptureStream;
+	bool captureColour = false;
+	bool captureDepth = false;
+	bool captureSoftwareDepth = false;
+	int captureFileFormat = CAPTURE_PNG;
+	int capturePolicy = CAPTURE_DROP;
+
+	// One dynamic constant buffer the per draw shaders sub-allocate each frame, in place of each mapping its own with WRITE_DISCARD
+	ConstantRing* constantRing;
+	bool useConstantRing = true;
+	bool bicubicUpsample = true;
+	float manualScale = 1.0f;
+
+	// Budgets in MB for each memory category and for all GPU memory together, 0 for none. Going over the shadow or whole GPU budget
+	// switches the shadows to a moment filter and its smaller atlas, the texture budget recooks the heightmap as BC4, and the staging
+	// budget stops the frame capture. Every category's budget shows when it's exceeded, and the downgrades made are listed
+	int memoryBudgets[MEMORY_CATEGORIES] = {};
+	int gpuMemoryBudget = 0;
+	vector<string> memoryDowngrades;
+
+	// A row each time memory usage settles, with the peak reached before it and the steady state it settled at
+	BenchmarkLog memoryLog;
+
+	// Records everything render() sends to the GPU for a number of frames, so it can be replayed at full speed with none of the application
+	// in front of it. Replays run between frames, and the CPU time the recorded frames took to render is kept to compare them against
+	CommandRecorder* commandRecorder;
+	CommandTrace commandTrace;
+	int traceFrames = 60;
+	int traceFramesLeft = 0;
+	double tracedMilliseconds = 0.0;
+	int replayIterations = 10;
+	bool replayRequested = false;
+	bool replayFailed = false;
+	CommandReplayStats replayStats = {};
+	BenchmarkLog replayLog;
+
+	// Trades tessellation, shadow map resolution and blur radius for frame time, using one of the built in policies
+	// Each shadow resolution tier halves the largest tile the shadow atlas may hand out
+	QualityGovernor qualityGovernor;
+	CostWeightedPolicy costWeightedPolicy;
+	FixedOrderPolicy fixedOrderPolicy;
+	int qualityPolicy = 0;
+	static const int SHADOW_MAP_SIZE = 8192;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,52 @@
+#include "BenchmarkLog.h"
+
+BenchmarkLog::BenchmarkLog()
+{
+	rowCount = 0;
+}
+
+BenchmarkLog::~BenchmarkLog()
+{
+	close();
+}
+
+bool BenchmarkLog::open(const char* filename, const vector<string>& columns)
+{
+	close();
+	file.open(filename, ios::trunc);
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	for (size_t i = 0; i < columns.size(); i++)
+	{
+		file << (i > 0 ? "," : "") << columns[i];
+	}
+	file << "\n";
+	rowCount = 0;
+	return true;
+}
+
+void BenchmarkLog::close()
+{
+	if (file.is_open())
+	{
+		file.close();
+	}
+}
+
+void BenchmarkLog::addRow(const vector<double>& values)
+{
+	if (!file.is_open())
+	{
+		return;
+	}
+
+	for (size_t i = 0; i < values.size(); i++)
+	{
+		file << (i > 0 ? "," : "") << values[i];
+	}
+	file << "\n";
+	rowCount++;
+}
@@ -0,0 +1,29 @@
+// Writes benchmark results out as comma separated values, one row per sample, so runs can be compared in a spreadsheet
+#pragma once
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+class BenchmarkLog
+{
+public:
+	BenchmarkLog();
+	~BenchmarkLog();
+
+	// Creates the file and writes the column names as the first row
+	bool open(const char* filename, const vector<string>& columns);
+	void close();
+	bool isOpen() const { return file.is_open(); }
+
+	// Writes a row of values, in the same order as the columns
+	void addRow(const vector<double>& values);
+
+	int getRowCount() const { return rowCount; }
+
+private:
+	ofstream file;
+	int rowCount;
+};
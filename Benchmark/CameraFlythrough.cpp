@@ -0,0 +1,104 @@
+#include "CameraFlythrough.h"
+
+CameraFlythrough::CameraFlythrough()
+{
+	active = false;
+	time = 0.0f;
+	segment = 0;
+	savedPosition = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	savedRotation = XMFLOAT3(0.0f, 0.0f, 0.0f);
+}
+
+void CameraFlythrough::addDefaultPath()
+{
+	// Starts outside the terrain, flies low between the mountains and finishes looking back across the whole scene
+	addKeyframe(XMFLOAT3(-20.0f, 40.0f, -20.0f), XMFLOAT3(25.0f, 45.0f, 0.0f), 0.0f);
+	addKeyframe(XMFLOAT3(30.0f, 25.0f, 10.0f), XMFLOAT3(15.0f, 30.0f, 0.0f), 4.0f);
+	addKeyframe(XMFLOAT3(50.0f, 12.0f, 40.0f), XMFLOAT3(5.0f, 0.0f, 0.0f), 4.0f);
+	addKeyframe(XMFLOAT3(70.0f, 10.0f, 70.0f), XMFLOAT3(0.0f, -60.0f, 0.0f), 4.0f);
+	addKeyframe(XMFLOAT3(40.0f, 15.0f, 90.0f), XMFLOAT3(10.0f, -150.0f, 0.0f), 4.0f);
+	addKeyframe(XMFLOAT3(110.0f, 45.0f, 110.0f), XMFLOAT3(25.0f, -135.0f, 0.0f), 4.0f);
+}
+
+void CameraFlythrough::addKeyframe(const XMFLOAT3& position, const XMFLOAT3& rotation, float duration)
+{
+	Keyframe keyframe;
+	keyframe.position = position;
+	keyframe.rotation = rotation;
+	keyframe.duration = duration;
+	keyframes.push_back(keyframe);
+}
+
+void CameraFlythrough::start(Camera* camera)
+{
+	if (keyframes.size() < 2)
+	{
+		return;
+	}
+
+	savedPosition = camera->getPosition();
+	savedRotation = camera->getRotation();
+	active = true;
+	time = 0.0f;
+	segment = 0;
+	update(0.0f, camera);
+}
+
+void CameraFlythrough::stop(Camera* camera)
+{
+	if (!active)
+	{
+		return;
+	}
+
+	active = false;
+	camera->setPosition(savedPosition.x, savedPosition.y, savedPosition.z);
+	camera->setRotation(savedRotation.x, savedRotation.y, savedRotation.z);
+}
+
+bool CameraFlythrough::update(float deltaTime, Camera* camera)
+{
+	if (!active)
+	{
+		return false;
+	}
+
+	time += deltaTime;
+
+	// Find the segment the current time falls in
+	float segmentStart = 0.0f;
+	segment = 0;
+	while (segment + 1 < (int)keyframes.size() && time > segmentStart + keyframes[segment + 1].duration)
+	{
+		segmentStart += keyframes[segment + 1].duration;
+		segment++;
+	}
+	if (segment + 1 >= (int)keyframes.size())
+	{
+		stop(camera);
+		return false;
+	}
+
+	// Smoothly interpolate the position and rotation between the two keyframes
+	const Keyframe& from = keyframes[segment];
+	const Keyframe& to = keyframes[segment + 1];
+	float t = to.duration > 0.0f ? (time - segmentStart) / to.duration : 1.0f;
+	t = t * t * (3.0f - 2.0f * t);
+
+	XMFLOAT3 position, rotation;
+	XMStoreFloat3(&position, XMVectorLerp(XMLoadFloat3(&from.position), XMLoadFloat3(&to.position), t));
+	XMStoreFloat3(&rotation, XMVectorLerp(XMLoadFloat3(&from.rotation), XMLoadFloat3(&to.rotation), t));
+	camera->setPosition(position.x, position.y, position.z);
+	camera->setRotation(rotation.x, rotation.y, rotation.z);
+	return true;
+}
+
+float CameraFlythrough::getDuration() const
+{
+	float duration = 0.0f;
+	for (size_t i = 1; i < keyframes.size(); i++)
+	{
+		duration += keyframes[i].duration;
+	}
+	return duration;
+}
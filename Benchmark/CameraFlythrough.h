@@ -0,0 +1,48 @@
+// Moves the camera along a fixed path of keyframes, so that benchmark runs always see the same views in the same order
+#pragma once
+
+#include "DXF.h"
+#include <vector>
+
+using namespace std;
+using namespace DirectX;
+
+class CameraFlythrough
+{
+public:
+	// A position and rotation (in degrees, as used by the Camera) to pass through, and how long it takes to get there from the previous keyframe
+	struct Keyframe
+	{
+		XMFLOAT3 position;
+		XMFLOAT3 rotation;
+		float duration;
+	};
+
+	CameraFlythrough();
+
+	// Adds the default path, which circles the terrain and passes behind the mountains
+	void addDefaultPath();
+	void addKeyframe(const XMFLOAT3& position, const XMFLOAT3& rotation, float duration);
+
+	// Starts from the first keyframe, the camera's own position is restored when the run ends
+	void start(Camera* camera);
+	void stop(Camera* camera);
+
+	// Moves the camera along the path by the frame time, returns false once the path is finished
+	bool update(float deltaTime, Camera* camera);
+
+	bool isActive() const { return active; }
+	float getTime() const { return time; }
+	float getDuration() const;
+
+	// Index of the keyframe the camera is currently heading away from
+	int getSegment() const { return segment; }
+
+private:
+	vector<Keyframe> keyframes;
+	bool active;
+	float time;
+	int segment;
+	XMFLOAT3 savedPosition;
+	XMFLOAT3 savedRotation;
+};
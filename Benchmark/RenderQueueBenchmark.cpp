@@ -0,0 +1,137 @@
+#include "RenderQueueBenchmark.h"
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+RenderQueueBenchmark::RenderQueueBenchmark()
+{
+}
+
+bool RenderQueueBenchmark::run(const char* filename, const vector<int>& packetCounts, int repeats, int threadCount)
+{
+	if (packetCounts.empty() || !log.open(filename, { "packets", "build_ms", "sort_ms", "std_sort_ms", "submit_ms", "unsorted_changes", "sorted_changes" }))
+	{
+		return false;
+	}
+	results.clear();
+	repeats = max(repeats, 1);
+
+	// The camera looks across a scene a thousand units wide from above its near edge
+	XMMATRIX view = XMMatrixLookAtLH(XMVectorSet(0.0f, 50.0f, -500.0f, 1.0f), XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+	XMMATRIX viewProjection = view * XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.1f, 2000.0f);
+	const float farPlane = 2000.0f;
+
+	mt19937 random(7);
+	uniform_real_distribution<float> position(-500.0f, 500.0f);
+	RenderQueue queue(threadCount);
+	vector<DrawPacket> comparison;
+	volatile float checksum = 0.0f;
+	for (int count : packetCounts)
+	{
+		// Objects arrive in the order they were made, with shaders, materials and meshes mixed as they would be in a scene file
+		vector<SceneObject> objects(count);
+		for (SceneObject& object : objects)
+		{
+			object.position = XMFLOAT3(position(random), position(random) * 0.1f, position(random));
+			object.scale = 1.0f + (random() % 100) * 0.05f;
+			object.shader = random() % SHADERS;
+			object.material = random() % MATERIALS;
+			object.mesh = random() % MESHES;
+		}
+
+		RenderQueueResult result = {};
+		result.packets = count;
+		for (int run = 0; run <= repeats; run++)
+		{
+			queue.clear();
+			queue.build(count, [&](int first, int last, vector<DrawPacket>& packets)
+			{
+				for (int i = first; i <= last; i++)
+				{
+					const SceneObject& object = objects[i];
+					XMVECTOR viewPosition = XMVector3Transform(XMLoadFloat3(&object.position), view);
+					DrawPacket packet;
+					packet.key = RenderQueue::makeKey(0, object.shader, object.material, object.mesh, XMVectorGetZ(viewPosition) / farPlane);
+					packet.item = i;
+					packet.padding = 0;
+					packets.push_back(packet);
+				}
+			});
+
+			// A shuffled copy of the sorted packets stands in for drawing without a queue, for the change count and the comparison sort
+			queue.sort();
+			comparison = queue.getPackets();
+			shuffle(comparison.begin(), comparison.end(), random);
+			int unsortedChanges = countChanges(comparison);
+			chrono::high_resolution_clock::time_point comparisonStart = chrono::high_resolution_clock::now();
+			std::sort(comparison.begin(), comparison.end(), [](const DrawPacket& a, const DrawPacket& b) { return a.key < b.key; });
+			double comparisonMilliseconds = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - comparisonStart).count();
+
+			chrono::high_resolution_clock::time_point submitStart = chrono::high_resolution_clock::now();
+			checksum = checksum + submit(queue.getPackets(), objects, viewProjection);
+			double submitMilliseconds = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - submitStart).count();
+
+			// The first run only warms the caches and grows the buffers
+			if (run == 0)
+			{
+				continue;
+			}
+			const RenderQueueStats& stats = queue.getStats();
+			result.buildMilliseconds += stats.buildMilliseconds / repeats;
+			result.sortMilliseconds += stats.sortMilliseconds / repeats;
+			result.comparisonSortMilliseconds += comparisonMilliseconds / repeats;
+			result.submitMilliseconds += submitMilliseconds / repeats;
+			result.unsortedChanges = unsortedChanges;
+			result.sortedChanges = countChanges(queue.getPackets());
+		}
+		results.push_back(result);
+		log.addRow({ (double)result.packets, result.buildMilliseconds, result.sortMilliseconds, result.comparisonSortMilliseconds, result.submitMilliseconds, (double)result.unsortedChanges, (double)result.sortedChanges });
+	}
+
+	log.close();
+	return true;
+}
+
+int RenderQueueBenchmark::countChanges(const vector<DrawPacket>& packets)
+{
+	int changes = 0;
+	for (size_t i = 0; i < packets.size(); i++)
+	{
+		unsigned long long key = packets[i].key;
+		unsigned long long previous = i > 0 ? packets[i - 1].key : ~key;
+		changes += RenderQueue::getShader(key) != RenderQueue::getShader(previous);
+		changes += RenderQueue::getMaterial(key) != RenderQueue::getMaterial(previous);
+		changes += RenderQueue::getMesh(key) != RenderQueue::getMesh(previous);
+	}
+	return changes;
+}
+
+float RenderQueueBenchmark::submit(const vector<DrawPacket>& packets, const vector<SceneObject>& objects, const XMMATRIX& viewProjection)
+{
+	// One slot per shader, material and mesh bind, and one for each draw's matrices, as the executor would map them
+	constants.resize(4);
+	unsigned long long previous = packets.empty() ? 0 : ~packets[0].key;
+	float checksum = 0.0f;
+	for (const DrawPacket& packet : packets)
+	{
+		if (RenderQueue::getShader(packet.key) != RenderQueue::getShader(previous))
+		{
+			XMStoreFloat4x4(&constants[0], XMMatrixTranspose(viewProjection));
+		}
+		if (RenderQueue::getMaterial(packet.key) != RenderQueue::getMaterial(previous))
+		{
+			constants[1]._11 = (float)RenderQueue::getMaterial(packet.key);
+		}
+		if (RenderQueue::getMesh(packet.key) != RenderQueue::getMesh(previous))
+		{
+			constants[2]._11 = (float)RenderQueue::getMesh(packet.key);
+		}
+		previous = packet.key;
+
+		const SceneObject& object = objects[packet.item];
+		XMMATRIX world = XMMatrixScaling(object.scale, object.scale, object.scale) * XMMatrixTranslation(object.position.x, object.position.y, object.position.z);
+		XMStoreFloat4x4(&constants[3], XMMatrixTranspose(world));
+		checksum += constants[3]._14;
+	}
+	return checksum;
+}
@@ -0,0 +1,66 @@
+// Measures what the render queue costs per frame at packet counts far beyond the scene's, entirely on the CPU so the numbers are the queue's
+// and not the driver's. A random scene of objects spread over a few shaders, materials and meshes is built into the queue, sorted, and walked
+// the way the screen pass executes it, writing each draw's transposed matrices and noting each state change without calling the device
+#pragma once
+
+#include "BenchmarkLog.h"
+#include "RenderQueue.h"
+#include <DirectXMath.h>
+#include <vector>
+
+using namespace std;
+using namespace DirectX;
+
+// Averaged timings for one packet count
+struct RenderQueueResult
+{
+	int packets;
+	double buildMilliseconds;
+	double sortMilliseconds;
+
+	// The same packets sorted by std::sort, as a baseline for the radix sort
+	double comparisonSortMilliseconds;
+	double submitMilliseconds;
+
+	// State changes walking the packets as built and as sorted
+	int unsortedChanges;
+	int sortedChanges;
+};
+
+class RenderQueueBenchmark
+{
+public:
+	RenderQueueBenchmark();
+
+	// Runs every packet count repeats times after one warm up run, writing one row of averages per count to filename
+	bool run(const char* filename, const vector<int>& packetCounts = { 10000, 100000, 1000000 }, int repeats = 5, int threadCount = 0);
+
+	const vector<RenderQueueResult>& getResults() const { return results; }
+
+private:
+	// Ids the random scene picks from
+	static const int SHADERS = 4;
+	static const int MATERIALS = 64;
+	static const int MESHES = 16;
+
+	struct SceneObject
+	{
+		XMFLOAT3 position;
+		float scale;
+		unsigned int shader;
+		unsigned int material;
+		unsigned int mesh;
+	};
+
+	// Shader, material and mesh changes walking packets in the order given
+	static int countChanges(const vector<DrawPacket>& packets);
+
+	// Walks sorted packets as an executor would, returning a checksum so the work can't be optimised away
+	float submit(const vector<DrawPacket>& packets, const vector<SceneObject>& objects, const XMMATRIX& viewProjection);
+
+	BenchmarkLog log;
+	vector<RenderQueueResult> results;
+
+	// Stands in for the constant buffers the executor would write
+	vector<XMFLOAT4X4> constants;
+};
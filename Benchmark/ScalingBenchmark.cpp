@@ -0,0 +1,83 @@
+#include "ScalingBenchmark.h"
+#include <algorithm>
+
+ScalingBenchmark::ScalingBenchmark()
+{
+	active = false;
+	step = 0;
+	frame = 0;
+	warmupFrames = 0;
+	measuredFrames = 0;
+	cpuTotal = 0.0;
+	frameTotal = 0.0;
+	visibleTotal = 0.0;
+}
+
+bool ScalingBenchmark::start(const char* filename, const vector<int>& lsteps, int lwarmupFrames, int lmeasuredFrames, const vector<string>& columns)
+{
+	if (lsteps.empty() || !log.open(filename, columns))
+	{
+		return false;
+	}
+
+	steps = lsteps;
+	warmupFrames = lwarmupFrames;
+	measuredFrames = max(1, lmeasuredFrames);
+	results.clear();
+	active = true;
+	step = 0;
+	frame = 0;
+	cpuTotal = 0.0;
+	frameTotal = 0.0;
+	visibleTotal = 0.0;
+	return true;
+}
+
+void ScalingBenchmark::stop()
+{
+	active = false;
+	log.close();
+}
+
+bool ScalingBenchmark::addFrame(double cpuMilliseconds, double frameMilliseconds, double visible)
+{
+	if (!active)
+	{
+		return false;
+	}
+
+	// The first frames after a step change are skipped, while buffers grow and caches settle
+	frame++;
+	if (frame <= warmupFrames)
+	{
+		return false;
+	}
+
+	cpuTotal += cpuMilliseconds;
+	frameTotal += frameMilliseconds;
+	visibleTotal += visible;
+	if (frame < warmupFrames + measuredFrames)
+	{
+		return false;
+	}
+
+	// Average the step, log it and move on to the next
+	ScalingResult result;
+	result.value = steps[step];
+	result.cpuMilliseconds = cpuTotal / measuredFrames;
+	result.frameMilliseconds = frameTotal / measuredFrames;
+	result.visible = visibleTotal / measuredFrames;
+	results.push_back(result);
+	log.addRow({ (double)result.value, result.cpuMilliseconds, result.frameMilliseconds, result.visible });
+
+	step++;
+	frame = 0;
+	cpuTotal = 0.0;
+	frameTotal = 0.0;
+	visibleTotal = 0.0;
+	if (step >= (int)steps.size())
+	{
+		stop();
+	}
+	return true;
+}
@@ -0,0 +1,53 @@
+// Steps a benchmark through a list of sizes (such as object counts), averaging the timings at each step after a warm up
+// and logging one row per step, so cost can be plotted against scene size
+#pragma once
+
+#include "BenchmarkLog.h"
+#include <vector>
+
+using namespace std;
+
+// Averaged timings for one step
+struct ScalingResult
+{
+	int value;
+	double cpuMilliseconds;
+	double frameMilliseconds;
+	double visible;
+};
+
+class ScalingBenchmark
+{
+public:
+	ScalingBenchmark();
+
+	// Starts at the first step, writing the averaged results of every step to filename. The columns name the step value and the three timings
+	// or counts added each frame, for benchmarks measuring something other than object counts
+	bool start(const char* filename, const vector<int>& steps, int warmupFrames = 30, int measuredFrames = 120, const vector<string>& columns = { "value", "cpu_ms", "frame_ms", "visible" });
+	void stop();
+
+	// Adds one frame's timings. Returns true when a step has finished, so the caller can resize its scene for the next one
+	bool addFrame(double cpuMilliseconds, double frameMilliseconds, double visible);
+
+	bool isActive() const { return active; }
+	int getStep() const { return step; }
+	int getStepCount() const { return (int)steps.size(); }
+	int getStepValue() const { return active ? steps[step] : 0; }
+	int getFrame() const { return frame; }
+	const vector<ScalingResult>& getResults() const { return results; }
+
+private:
+	BenchmarkLog log;
+	vector<int> steps;
+	vector<ScalingResult> results;
+	bool active;
+	int step;
+	int frame;
+	int warmupFrames;
+	int measuredFrames;
+
+	// Totals for the step in progress
+	double cpuTotal;
+	double frameTotal;
+	double visibleTotal;
+};
@@ -0,0 +1,89 @@
+#include "SceneLoadBenchmark.h"
+#include "SceneJson.h"
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+static const wchar_t* BENCHMARK_JSON = L"scene_benchmark.json";
+static const wchar_t* BENCHMARK_BINARY = L"scene_benchmark.scnb";
+
+bool SceneLoadBenchmark::run(const char* filename, const SceneData& base, const vector<int>& instanceCounts)
+{
+	if (!log.open(filename, { "instances", "json_bytes", "binary_bytes", "json_ms", "binary_open_ms", "binary_read_ms", "matched" }))
+	{
+		return false;
+	}
+	results.clear();
+
+	for (int count : instanceCounts)
+	{
+		// The same spheres every run, written out in both formats
+		SceneData scene = base;
+		scene.instances.resize(count);
+		mt19937 random(4321);
+		uniform_real_distribution<float> position(0.0f, 100.0f);
+		uniform_real_distribution<float> size(0.2f, 0.6f);
+		for (SceneInstance& instance : scene.instances)
+		{
+			instance.position.x = position(random);
+			instance.position.y = position(random) * 0.3f;
+			instance.position.z = position(random);
+			instance.scale = size(random);
+			instance.mesh = SCENE_MESH_SPHERE;
+			instance.padding = 0;
+		}
+		if (!SceneJson::save(BENCHMARK_JSON, scene) || !SceneFile::write(BENCHMARK_BINARY, scene))
+		{
+			log.close();
+			return false;
+		}
+
+		SceneLoadResult result;
+		result.instances = count;
+
+		chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+		SceneData loaded;
+		bool jsonLoaded = SceneJson::load(BENCHMARK_JSON, loaded);
+		result.jsonMilliseconds = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+
+		// Opening alone only maps the file, so the second timing reads every instance as applying the scene would
+		SceneFile file;
+		start = chrono::high_resolution_clock::now();
+		bool binaryOpened = file.open(BENCHMARK_BINARY);
+		result.binaryOpenMilliseconds = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+		result.binaryBytes = file.getBytes();
+		file.close();
+
+		start = chrono::high_resolution_clock::now();
+		binaryOpened = binaryOpened && file.open(BENCHMARK_BINARY);
+		double binarySum = 0.0;
+		int binaryCount = binaryOpened ? file.getInstanceCount() : 0;
+		const SceneInstance* instances = binaryOpened ? file.getInstances() : 0;
+		for (int i = 0; i < binaryCount; i++)
+		{
+			binarySum += instances[i].position.x + instances[i].position.y + instances[i].position.z + instances[i].scale;
+		}
+		result.binaryReadMilliseconds = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+		file.close();
+
+		// The JSON holds every float to nine digits, so both loads should give back exactly what was written
+		double jsonSum = 0.0;
+		for (const SceneInstance& instance : loaded.instances)
+		{
+			jsonSum += instance.position.x + instance.position.y + instance.position.z + instance.scale;
+		}
+		result.matched = jsonLoaded && binaryOpened && (int)loaded.instances.size() == count && binaryCount == count && jsonSum == binarySum;
+
+		ifstream json(BENCHMARK_JSON, ios::binary | ios::ate);
+		result.jsonBytes = json.is_open() ? (unsigned long long)json.tellg() : 0;
+		json.close();
+
+		results.push_back(result);
+		log.addRow({ (double)result.instances, (double)result.jsonBytes, (double)result.binaryBytes, result.jsonMilliseconds, result.binaryOpenMilliseconds, result.binaryReadMilliseconds, result.matched ? 1.0 : 0.0 });
+	}
+	log.close();
+
+	_wremove(BENCHMARK_JSON);
+	_wremove(BENCHMARK_BINARY);
+	return true;
+}
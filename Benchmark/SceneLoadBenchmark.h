@@ -0,0 +1,39 @@
+// Measures how long a scene takes to load from JSON against the memory mapped binary format, for scenes of increasing instance counts.
+// Each scene is the given one with its instances replaced by spheres scattered from a fixed seed, written out both ways first so both are
+// read from the file cache rather than the disk
+#pragma once
+
+#include "BenchmarkLog.h"
+#include "SceneFile.h"
+#include <string>
+#include <vector>
+
+using namespace std;
+
+struct SceneLoadResult
+{
+	int instances;
+	unsigned long long jsonBytes;
+	unsigned long long binaryBytes;
+
+	// Parsing the JSON into a SceneData, mapping and validating the binary file, and mapping it and reading every instance
+	double jsonMilliseconds;
+	double binaryOpenMilliseconds;
+	double binaryReadMilliseconds;
+
+	// Whether both loads gave the same instances
+	bool matched;
+};
+
+class SceneLoadBenchmark
+{
+public:
+	// Runs one row per instance count, using the settings and lights of base
+	bool run(const char* filename, const SceneData& base, const vector<int>& instanceCounts = { 1000, 10000, 100000, 1000000 });
+
+	const vector<SceneLoadResult>& getResults() const { return results; }
+
+private:
+	BenchmarkLog log;
+	vector<SceneLoadResult> results;
+};
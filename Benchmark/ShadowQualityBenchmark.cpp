@@ -0,0 +1,195 @@
+#include "ShadowQualityBenchmark.h"
+#include <algorithm>
+#include <cmath>
+#include <map>
+
+ShadowQualityBenchmark::ShadowQualityBenchmark()
+{
+}
+
+bool ShadowQualityBenchmark::run(const char* filename, const vector<XMFLOAT3>& vertices, const vector<unsigned int>& indices, const vector<XMFLOAT3>& receivers, const XMMATRIX& lightViewProjection, const vector<int>& resolutions, const vector<ShadowFilterSettings>& settings, int referenceResolution)
+{
+	results.clear();
+	if (!log.open(filename, { "mode", "resolution", "mean_error", "max_error", "artefact_fraction", "megabytes" }))
+	{
+		return false;
+	}
+
+	// Projects every receiver into the light once, dropping any outside the shadow map
+	vector<XMFLOAT3> projected;
+	projected.reserve(receivers.size());
+	for (const XMFLOAT3& receiver : receivers)
+	{
+		XMFLOAT4 clip;
+		XMStoreFloat4(&clip, XMVector4Transform(XMVectorSetW(XMLoadFloat3(&receiver), 1.0f), lightViewProjection));
+		float u = clip.x / clip.w * 0.5f + 0.5f;
+		float v = 0.5f - clip.y / clip.w * 0.5f;
+		if (u >= 0.0f && u <= 1.0f && v >= 0.0f && v <= 1.0f)
+		{
+			projected.push_back(XMFLOAT3(u, v, clip.z / clip.w));
+		}
+	}
+
+	// The reference uses the same bias as the hard shadows, so neither side suffers from acne
+	float referenceBias = ShadowMoments::getDefaultSettings(SHADOW_FILTER_HARD).depthBias;
+	SoftwareOcclusionRasterizer reference(referenceResolution, referenceResolution);
+	reference.rasterize(vertices, indices, lightViewProjection);
+
+	// References are shared between tests that filter over the same area, the hard reference being radius zero
+	map<int, vector<float>> referenceVisibility;
+
+	vector<XMFLOAT4> moments;
+	for (int resolution : resolutions)
+	{
+		SoftwareOcclusionRasterizer shadowMap(resolution, resolution);
+		shadowMap.rasterize(vertices, indices, lightViewProjection);
+
+		for (const ShadowFilterSettings& setting : settings)
+		{
+			// A moment map blurred over 2r + 1 texels covers the same area as a box of that many texels scaled up to the reference's resolution
+			int referenceRadius = 0;
+			if (setting.mode != SHADOW_FILTER_HARD)
+			{
+				float footprint = (setting.blurRadius * 2 + 1) * (float)referenceResolution / resolution;
+				referenceRadius = max(0, (int)floorf((footprint - 1.0f) * 0.5f + 0.5f));
+				buildMoments(shadowMap, setting, moments);
+			}
+
+			vector<float>& expected = referenceVisibility[referenceRadius];
+			if (expected.empty())
+			{
+				expected.resize(projected.size());
+				for (size_t i = 0; i < projected.size(); i++)
+				{
+					const XMFLOAT3& p = projected[i];
+					expected[i] = referenceRadius == 0 ? hardVisibility(reference, p.x, p.y, p.z, referenceBias) : filteredVisibility(reference, p.x, p.y, p.z, referenceBias, referenceRadius);
+				}
+			}
+
+			// Shades every receiver with this mode and resolution, and measures how far it is from the reference
+			ShadowQualityResult result;
+			result.mode = setting.mode;
+			result.resolution = resolution;
+			result.meanError = 0.0;
+			result.maxError = 0.0;
+			result.artefactFraction = 0.0;
+			for (size_t i = 0; i < projected.size(); i++)
+			{
+				const XMFLOAT3& p = projected[i];
+				float visibility;
+				if (setting.mode == SHADOW_FILTER_HARD)
+				{
+					visibility = hardVisibility(shadowMap, p.x, p.y, p.z, setting.depthBias);
+				}
+				else
+				{
+					visibility = ShadowMoments::visibility(sampleMoments(moments, resolution, p.x, p.y), p.z, setting);
+				}
+				double error = fabs((double)visibility - expected[i]);
+				result.meanError += error;
+				result.maxError = max(result.maxError, error);
+				result.artefactFraction += error > 0.25 ? 1.0 : 0.0;
+			}
+			if (!projected.empty())
+			{
+				result.meanError /= projected.size();
+				result.artefactFraction /= projected.size();
+			}
+
+			// The depth map is always needed to render into, moment modes add the moments and their mips
+			unsigned long long texels = (unsigned long long)resolution * resolution;
+			result.bytes = texels * ShadowMoments::getBytesPerTexel(SHADOW_FILTER_HARD);
+			if (setting.mode != SHADOW_FILTER_HARD)
+			{
+				result.bytes += texels * ShadowMoments::getBytesPerTexel(setting.mode) * 4 / 3;
+			}
+
+			results.push_back(result);
+			log.addRow({ (double)result.mode, (double)result.resolution, result.meanError, result.maxError, result.artefactFraction, result.bytes / (1024.0 * 1024.0) });
+		}
+	}
+
+	log.close();
+	return true;
+}
+
+float ShadowQualityBenchmark::hardVisibility(const SoftwareOcclusionRasterizer& map, float u, float v, float depth, float bias)
+{
+	int x = min(max((int)(u * map.getWidth()), 0), map.getWidth() - 1);
+	int y = min(max((int)(v * map.getHeight()), 0), map.getHeight() - 1);
+	return depth - bias < map.getDepth()[y * map.getRowPitch() + x] ? 1.0f : 0.0f;
+}
+
+float ShadowQualityBenchmark::filteredVisibility(const SoftwareOcclusionRasterizer& map, float u, float v, float depth, float bias, int radius)
+{
+	int centreX = (int)(u * map.getWidth());
+	int centreY = (int)(v * map.getHeight());
+	int lit = 0;
+	for (int y = centreY - radius; y <= centreY + radius; y++)
+	{
+		const float* row = map.getDepth() + min(max(y, 0), map.getHeight() - 1) * map.getRowPitch();
+		for (int x = centreX - radius; x <= centreX + radius; x++)
+		{
+			lit += depth - bias < row[min(max(x, 0), map.getWidth() - 1)] ? 1 : 0;
+		}
+	}
+	return (float)lit / ((radius * 2 + 1) * (radius * 2 + 1));
+}
+
+void ShadowQualityBenchmark::buildMoments(const SoftwareOcclusionRasterizer& map, const ShadowFilterSettings& settings, vector<XMFLOAT4>& moments)
+{
+	int size = map.getWidth();
+	int radius = max(settings.blurRadius, 0);
+	float weight = 1.0f / (radius * 2 + 1);
+
+	// Encodes and blurs across, clamping at the edges as the moment shader does at the edges of a tile
+	vector<XMFLOAT4> across((size_t)size * size);
+	for (int y = 0; y < size; y++)
+	{
+		const float* row = map.getDepth() + y * map.getRowPitch();
+		for (int x = 0; x < size; x++)
+		{
+			XMVECTOR total = XMVectorZero();
+			for (int i = -radius; i <= radius; i++)
+			{
+				XMFLOAT4 encoded = ShadowMoments::encode(row[min(max(x + i, 0), size - 1)], settings);
+				total = XMVectorAdd(total, XMLoadFloat4(&encoded));
+			}
+			XMStoreFloat4(&across[(size_t)y * size + x], XMVectorScale(total, weight));
+		}
+	}
+
+	// Then blurs down
+	moments.resize((size_t)size * size);
+	for (int y = 0; y < size; y++)
+	{
+		for (int x = 0; x < size; x++)
+		{
+			XMVECTOR total = XMVectorZero();
+			for (int i = -radius; i <= radius; i++)
+			{
+				total = XMVectorAdd(total, XMLoadFloat4(&across[(size_t)min(max(y + i, 0), size - 1) * size + x]));
+			}
+			XMStoreFloat4(&moments[(size_t)y * size + x], XMVectorScale(total, weight));
+		}
+	}
+}
+
+XMFLOAT4 ShadowQualityBenchmark::sampleMoments(const vector<XMFLOAT4>& moments, int size, float u, float v)
+{
+	// Texel centres sit half a texel in, as on the GPU
+	float x = min(max(u * size - 0.5f, 0.0f), (float)(size - 1));
+	float y = min(max(v * size - 0.5f, 0.0f), (float)(size - 1));
+	int x0 = (int)x;
+	int y0 = (int)y;
+	int x1 = min(x0 + 1, size - 1);
+	int y1 = min(y0 + 1, size - 1);
+	float fx = x - x0;
+	float fy = y - y0;
+
+	XMVECTOR top = XMVectorLerp(XMLoadFloat4(&moments[(size_t)y0 * size + x0]), XMLoadFloat4(&moments[(size_t)y0 * size + x1]), fx);
+	XMVECTOR bottom = XMVectorLerp(XMLoadFloat4(&moments[(size_t)y1 * size + x0]), XMLoadFloat4(&moments[(size_t)y1 * size + x1]), fx);
+	XMFLOAT4 sample;
+	XMStoreFloat4(&sample, XMVectorLerp(top, bottom, fy));
+	return sample;
+}
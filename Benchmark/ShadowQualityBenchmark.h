@@ -0,0 +1,57 @@
+// Compares shadow quality against shadow map resolution for each filter mode, entirely on the CPU so runs are repeatable and independent of the GPU.
+// The occluder mesh is rasterized from the light into shadow maps of each resolution, filtered with the same maths as the lit shaders, and every
+// receiver's visibility is compared with a high resolution reference filtered over the same area of the world
+#pragma once
+
+#include "BenchmarkLog.h"
+#include "ShadowMoments.h"
+#include "SoftwareOcclusionRasterizer.h"
+#include <vector>
+
+using namespace std;
+using namespace DirectX;
+
+// How closely one mode at one resolution matched the reference
+struct ShadowQualityResult
+{
+	ShadowFilterMode mode;
+	int resolution;
+
+	// Mean and largest difference in visibility from the reference, from 0 to 1
+	double meanError;
+	double maxError;
+
+	// Fraction of receivers off by more than a quarter, which show up as visible acne, aliasing or light bleeding
+	double artefactFraction;
+
+	// Memory the shadow map needs at this resolution, including the mips of a moment map
+	unsigned long long bytes;
+};
+
+class ShadowQualityBenchmark
+{
+public:
+	ShadowQualityBenchmark();
+
+	// Tests every mode in settings at every resolution, writing one row per test to filename. The receivers are the points shaded,
+	// and lightViewProjection must map the occluders into the light's clip space with depth from 0 to 1
+	bool run(const char* filename, const vector<XMFLOAT3>& vertices, const vector<unsigned int>& indices, const vector<XMFLOAT3>& receivers, const XMMATRIX& lightViewProjection, const vector<int>& resolutions, const vector<ShadowFilterSettings>& settings, int referenceResolution = 4096);
+
+	const vector<ShadowQualityResult>& getResults() const { return results; }
+
+private:
+	// Single depth compare at the texel under a receiver
+	static float hardVisibility(const SoftwareOcclusionRasterizer& map, float u, float v, float depth, float bias);
+
+	// Fraction of the texels within radius of a receiver that it is in front of, the reference the filtered modes are aiming for
+	static float filteredVisibility(const SoftwareOcclusionRasterizer& map, float u, float v, float depth, float bias, int radius);
+
+	// Encodes a shadow map into moments and box blurs them, as the moment shader does on the GPU
+	static void buildMoments(const SoftwareOcclusionRasterizer& map, const ShadowFilterSettings& settings, vector<XMFLOAT4>& moments);
+
+	// Bilinearly samples the moments at a shadow map coordinate
+	static XMFLOAT4 sampleMoments(const vector<XMFLOAT4>& moments, int size, float u, float v);
+
+	BenchmarkLog log;
+	vector<ShadowQualityResult> results;
+};
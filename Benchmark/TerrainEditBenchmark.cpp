@@ -0,0 +1,123 @@
+#include "TerrainEditBenchmark.h"
+#include "HeightField.h"
+#include "HorizonMap.h"
+#include "TerrainEditor.h"
+#include "TerrainQuery.h"
+#include "Tplane.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+// The terrain the benchmark paints, the same size and height as the application's
+static const float WORLD_SIZE = 100.0f;
+static const float HEIGHT_SCALE = 30.0f;
+static const int OCCLUDER_GRID = 32;
+
+bool TerrainEditBenchmark::run(const char* filename, ID3D11Device* device, ID3D11DeviceContext* deviceContext, const vector<int>& sizes, int editCount, int editsPerFrame, float brushRadius)
+{
+	if (!log.open(filename, { "size", "edits", "ms", "edits_per_second", "brush_ms", "query_ms", "bounds_ms", "horizon_ms", "encode_ms", "upload_ms", "tiles", "upload_kb" }))
+	{
+		return false;
+	}
+	results.clear();
+	editsPerFrame = max(editsPerFrame, 1);
+
+	for (int size : sizes)
+	{
+		// Rolling hills, so every brush has slopes to raise, lower and smooth
+		HeightField heights;
+		heights.resize(size, size);
+		float* data = heights.getData();
+		for (int y = 0; y < size; y++)
+		{
+			float v = (float)y / size;
+			for (int x = 0; x < size; x++)
+			{
+				float u = (float)x / size;
+				data[(size_t)y * size + x] = 0.5f + 0.25f * sinf(u * 12.0f) * cosf(v * 9.0f) + 0.1f * sinf((u + v) * 40.0f);
+			}
+		}
+
+		// Everything an edit refits, each built over the whole heightmap once before the timing starts
+		TerrainQuery query(&heights, WORLD_SIZE, HEIGHT_SCALE);
+		HorizonMap horizon(device, &heights, WORLD_SIZE, HEIGHT_SCALE, max(4, size / 1024));
+		horizon.update(deviceContext);
+		TerrainEditor editor(device, &heights, WORLD_SIZE, HEIGHT_SCALE);
+		TPlane plane(device, deviceContext, 100);
+		plane.computePatchBounds(heights, HEIGHT_SCALE);
+		vector<XMFLOAT3> occluderVertices;
+		vector<unsigned int> occluderIndices;
+		plane.buildOccluderMesh(heights, HEIGHT_SCALE, OCCLUDER_GRID, occluderVertices, occluderIndices);
+		if (!editor.isValid())
+		{
+			continue;
+		}
+
+		TerrainEditResult result;
+		memset(&result, 0, sizeof(result));
+		result.size = size;
+		double tiles = 0.0;
+		double uploadBytes = 0.0;
+		vector<int> refitted;
+		chrono::high_resolution_clock::time_point runStart = chrono::high_resolution_clock::now();
+		for (int edit = 0; edit < editCount; edit++)
+		{
+			// Dabs along a circle round the middle of the terrain, raising, lowering then smoothing a frame's worth at a time
+			float angle = edit * 0.05f;
+			float x = WORLD_SIZE * 0.5f + cosf(angle) * WORLD_SIZE * 0.25f;
+			float z = WORLD_SIZE * 0.5f + sinf(angle) * WORLD_SIZE * 0.25f;
+			TerrainBrush brush = (TerrainBrush)((edit / editsPerFrame) % TERRAIN_BRUSHES);
+			float strength = brush == TERRAIN_BRUSH_SMOOTH ? 0.5f : 0.002f;
+
+			chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+			TerrainEditRegion region;
+			bool changed = editor.applyBrush(brush, x, z, brushRadius, strength, region);
+			chrono::high_resolution_clock::time_point brushEnd = chrono::high_resolution_clock::now();
+			result.brushMilliseconds += chrono::duration<double, milli>(brushEnd - start).count();
+			if (changed)
+			{
+				query.invalidate(region.x0, region.y0, region.x1, region.y1);
+				chrono::high_resolution_clock::time_point queryEnd = chrono::high_resolution_clock::now();
+				result.queryMilliseconds += chrono::duration<double, milli>(queryEnd - brushEnd).count();
+
+				plane.refitPatchBounds(heights, HEIGHT_SCALE, region.x0, region.y0, region.x1, region.y1, refitted);
+				plane.refitOccluderMesh(heights, HEIGHT_SCALE, OCCLUDER_GRID, occluderVertices, region.x0, region.y0, region.x1, region.y1);
+				horizon.invalidate(region.x0, region.y0, region.x1, region.y1);
+				result.boundsMilliseconds += chrono::duration<double, milli>(chrono::high_resolution_clock::now() - queryEnd).count();
+			}
+
+			// The end of a frame, where the horizon map and textures catch up with every edit made during it
+			if ((edit + 1) % editsPerFrame == 0 || edit == editCount - 1)
+			{
+				start = chrono::high_resolution_clock::now();
+				horizon.update(deviceContext);
+				result.horizonMilliseconds += chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+				editor.update(deviceContext);
+				const TerrainEditStats& stats = editor.getStats();
+				result.encodeMilliseconds += stats.encodeMilliseconds;
+				result.uploadMilliseconds += stats.uploadMilliseconds;
+				tiles += stats.tilesUploaded;
+				uploadBytes += (double)stats.bytesUploaded;
+			}
+		}
+		result.milliseconds = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - runStart).count();
+
+		result.edits = editCount;
+		result.editsPerSecond = result.milliseconds > 0.0 ? editCount * 1000.0 / result.milliseconds : 0.0;
+		double perEdit = editCount > 0 ? 1.0 / editCount : 0.0;
+		result.brushMilliseconds *= perEdit;
+		result.queryMilliseconds *= perEdit;
+		result.boundsMilliseconds *= perEdit;
+		result.horizonMilliseconds *= perEdit;
+		result.encodeMilliseconds *= perEdit;
+		result.uploadMilliseconds *= perEdit;
+		result.tilesPerEdit = tiles * perEdit;
+		result.uploadKilobytesPerEdit = uploadBytes / 1024.0 * perEdit;
+		results.push_back(result);
+		log.addRow({ (double)result.size, (double)result.edits, result.milliseconds, result.editsPerSecond, result.brushMilliseconds, result.queryMilliseconds, result.boundsMilliseconds,
+			result.horizonMilliseconds, result.encodeMilliseconds, result.uploadMilliseconds, result.tilesPerEdit, result.uploadKilobytesPerEdit });
+	}
+	log.close();
+	return true;
+}
@@ -0,0 +1,46 @@
+// Measures how many brush edits a second the terrain takes at each heightmap size. Every edit refits the quadtree, patch bounds and occluder
+// grid around it, and every frame of editsPerFrame edits rebuilds the horizon map around them and encodes and uploads the tiles they dirtied,
+// as painting in the application does. The heightmaps are rolling hills from fixed sines, painted along the same stroke each run. The horizon
+// map is kept at most 1024 texels across whatever the heightmap's size, so it costs the same at every size. The larger sizes need a lot of
+// memory, the quadtree alone holding two floats per texel at each of its levels
+#pragma once
+
+#include "BenchmarkLog.h"
+#include "DXF.h"
+#include <vector>
+
+using namespace std;
+
+struct TerrainEditResult
+{
+	int size;
+	int edits;
+	double milliseconds;
+	double editsPerSecond;
+
+	// Average per edit of applying the brush, refitting the quadtree, refitting the patch bounds and occluder grid, rebuilding the horizon
+	// map, encoding the dirty tiles' mips and uploading them
+	double brushMilliseconds;
+	double queryMilliseconds;
+	double boundsMilliseconds;
+	double horizonMilliseconds;
+	double encodeMilliseconds;
+	double uploadMilliseconds;
+
+	// Tiles uploaded and kilobytes of every mip of both textures uploaded, per edit
+	double tilesPerEdit;
+	double uploadKilobytesPerEdit;
+};
+
+class TerrainEditBenchmark
+{
+public:
+	// Runs one row per heightmap size, each a square power of two. The brush radius is in world units, over a terrain 100 units across
+	bool run(const char* filename, ID3D11Device* device, ID3D11DeviceContext* deviceContext, const vector<int>& sizes = { 4096, 16384 }, int editCount = 240, int editsPerFrame = 4, float brushRadius = 2.0f);
+
+	const vector<TerrainEditResult>& getResults() const { return results; }
+
+private:
+	BenchmarkLog log;
+	vector<TerrainEditResult> results;
+};
@@ -0,0 +1,154 @@
+#include "TerrainQueryBenchmark.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+
+TerrainQueryBenchmark::TerrainQueryBenchmark()
+{
+	maxRayDifference = 0.0f;
+	steppedOver = 0;
+}
+
+bool TerrainQueryBenchmark::run(const char* filename, const TerrainQuery& query, int queryCount, int rayCount)
+{
+	if (!log.open(filename, { "test", "count", "ms", "per_second", "hits" }))
+	{
+		return false;
+	}
+	results.clear();
+	maxRayDifference = 0.0f;
+	steppedOver = 0;
+
+	// Query points anywhere over the terrain, and rays from above it looking down at shallow to steep angles
+	float worldSize = query.getWorldSize();
+	float heightScale = query.getHeightScale();
+	mt19937 random(99);
+	uniform_real_distribution<float> position(0.0f, worldSize);
+	uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	vector<float> x(queryCount), z(queryCount), heights(queryCount);
+	for (int i = 0; i < queryCount; i++)
+	{
+		x[i] = position(random);
+		z[i] = position(random);
+	}
+	vector<XMFLOAT3> origins(rayCount), directions(rayCount);
+	for (int i = 0; i < rayCount; i++)
+	{
+		origins[i] = XMFLOAT3(position(random), heightScale * (1.0f + 0.5f * (unit(random) + 1.0f)), position(random));
+		directions[i] = XMFLOAT3(unit(random), -0.05f - 0.5f * (unit(random) + 1.0f), unit(random));
+	}
+
+	// Heights one at a time, then four at a time
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+	for (int i = 0; i < queryCount; i++)
+	{
+		heights[i] = query.getHeight(x[i], z[i]);
+	}
+	addResult("height", queryCount, chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count(), 0);
+
+	start = chrono::high_resolution_clock::now();
+	query.getHeights(x.data(), z.data(), heights.data(), queryCount);
+	addResult("height_batch", queryCount, chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count(), 0);
+
+	// Rays through the quadtree, keeping the hits to check the marched rays against
+	vector<TerrainHit> treeHits(rayCount);
+	vector<char> treeHit(rayCount);
+	int hits = 0;
+	start = chrono::high_resolution_clock::now();
+	for (int i = 0; i < rayCount; i++)
+	{
+		treeHit[i] = query.raycast(origins[i], directions[i], worldSize * 4.0f, treeHits[i]);
+		hits += treeHit[i];
+	}
+	addResult("ray_quadtree", rayCount, chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count(), hits);
+
+	// Marching can step over a ridge the ray only grazes and go on to hit the terrain further away, so hits more than a step apart are
+	// counted separately from the difference between the rest
+	float step = worldSize / 1024.0f;
+	hits = 0;
+	start = chrono::high_resolution_clock::now();
+	for (int i = 0; i < rayCount; i++)
+	{
+		TerrainHit hit;
+		if (marchRay(query, origins[i], directions[i], worldSize * 4.0f, step, hit))
+		{
+			hits++;
+			if (treeHit[i])
+			{
+				float dx = hit.position.x - treeHits[i].position.x;
+				float dy = hit.position.y - treeHits[i].position.y;
+				float dz = hit.position.z - treeHits[i].position.z;
+				float difference = sqrtf(dx * dx + dy * dy + dz * dz);
+				if (difference > step)
+				{
+					steppedOver++;
+				}
+				else
+				{
+					maxRayDifference = max(maxRayDifference, difference);
+				}
+			}
+		}
+	}
+	addResult("ray_march", rayCount, chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count(), hits);
+
+	log.close();
+	return true;
+}
+
+void TerrainQueryBenchmark::addResult(const string& name, int count, double milliseconds, int hits)
+{
+	TerrainQueryResult result;
+	result.name = name;
+	result.count = count;
+	result.milliseconds = milliseconds;
+	result.perSecond = milliseconds > 0.0 ? count / (milliseconds / 1000.0) : 0.0;
+	result.hits = hits;
+	log.addRow({ (double)results.size(), (double)count, milliseconds, result.perSecond, (double)hits });
+	results.push_back(result);
+}
+
+bool TerrainQueryBenchmark::marchRay(const TerrainQuery& query, const XMFLOAT3& origin, const XMFLOAT3& direction, float maxDistance, float step, TerrainHit& hit)
+{
+	float length = sqrtf(direction.x * direction.x + direction.y * direction.y + direction.z * direction.z);
+	if (length <= 0.0f)
+	{
+		return false;
+	}
+	float worldSize = query.getWorldSize();
+	float dt = step / length;
+	bool entered = false;
+	for (float t = 0.0f; t <= maxDistance; t += dt)
+	{
+		float x = origin.x + direction.x * t;
+		float z = origin.z + direction.z * t;
+		if (x < 0.0f || z < 0.0f || x > worldSize || z > worldSize)
+		{
+			// Still approaching the terrain from outside it, or gone past it
+			if (entered)
+			{
+				return false;
+			}
+			continue;
+		}
+		float above = origin.y + direction.y * t - query.getHeight(x, z);
+		if (above <= 0.0f)
+		{
+			// Halves the step that crossed the surface until it's narrow enough
+			float low = max(t - dt, 0.0f);
+			float high = t;
+			for (int i = 0; i < 16; i++)
+			{
+				float mid = (low + high) * 0.5f;
+				float midAbove = origin.y + direction.y * mid - query.getHeight(origin.x + direction.x * mid, origin.z + direction.z * mid);
+				(midAbove > 0.0f ? low : high) = mid;
+			}
+			hit.distance = high;
+			hit.position = XMFLOAT3(origin.x + direction.x * high, origin.y + direction.y * high, origin.z + direction.z * high);
+			return true;
+		}
+		entered = true;
+	}
+	return false;
+}
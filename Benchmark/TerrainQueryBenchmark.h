@@ -0,0 +1,48 @@
+// Measures how many height queries and rays the terrain query answers per second, single and batched heights and quadtree rays, against
+// rays marched across the surface half a texel at a time as a baseline. Runs entirely on the CPU from a fixed seed so runs can be compared
+#pragma once
+
+#include "BenchmarkLog.h"
+#include "TerrainQuery.h"
+#include <string>
+#include <vector>
+
+using namespace std;
+
+struct TerrainQueryResult
+{
+	string name;
+	int count;
+	double milliseconds;
+	double perSecond;
+
+	// Hits out of the queries made, for the ray tests
+	int hits;
+};
+
+class TerrainQueryBenchmark
+{
+public:
+	TerrainQueryBenchmark();
+
+	// Times queryCount heights one at a time and batched, then rayCount rays through the quadtree and marched, writing one row per test
+	bool run(const char* filename, const TerrainQuery& query, int queryCount = 1000000, int rayCount = 100000);
+
+	const vector<TerrainQueryResult>& getResults() const { return results; }
+
+	// Largest difference between a quadtree hit and the marched hit for the same ray, in world units, and how many rays the march
+	// stepped over the quadtree's hit on
+	float getMaxRayDifference() const { return maxRayDifference; }
+	int getSteppedOver() const { return steppedOver; }
+
+private:
+	// Steps along the ray half a texel at a time until it passes below the surface, then bisects the last step
+	static bool marchRay(const TerrainQuery& query, const XMFLOAT3& origin, const XMFLOAT3& direction, float maxDistance, float step, TerrainHit& hit);
+
+	void addResult(const string& name, int count, double milliseconds, int hits);
+
+	BenchmarkLog log;
+	vector<TerrainQueryResult> results;
+	float maxRayDifference;
+	int steppedOver;
+};
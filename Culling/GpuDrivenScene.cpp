@@ -0,0 +1,433 @@
+#include "GpuDrivenScene.h"
+#include "MemoryTracker.h"
+
+GpuDrivenScene::GpuDrivenScene(ID3D11Device* ldevice, int lviewCount)
+{
+	device = ldevice;
+	viewCount = lviewCount;
+	patchCount = 0;
+	planeResolution = 1.0f;
+	lodPosition = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	maxTessFactor = 1.0f;
+	lodNear = 0.0f;
+	lodFar = 1.0f;
+	patchMesh = 0;
+	objectMesh = 0;
+	dirtyFirst = 0;
+	dirtyLast = 0;
+
+	patchCapacity = 0;
+	objectCapacity = 0;
+	recordBuffer = 0;
+	recordSRV = 0;
+	visibleBuffer = 0;
+	visibleSRV = 0;
+	visibleUAV = 0;
+	argumentsBuffer = 0;
+	argumentsUAV = 0;
+
+	// Create the constant buffer the instanced vertex shaders read their list offset from
+	D3D11_BUFFER_DESC instanceBufferDesc;
+	instanceBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+	instanceBufferDesc.ByteWidth = sizeof(InstanceBufferType);
+	instanceBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	instanceBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	instanceBufferDesc.MiscFlags = 0;
+	instanceBufferDesc.StructureByteStride = 0;
+	device->CreateBuffer(&instanceBufferDesc, NULL, &instanceBuffer);
+	MemoryTracker::track(instanceBuffer, MEMORY_GPU_BUFFER, "GPU scene instances");
+
+	// Create the staging copies of the arguments, which never change size
+	D3D11_BUFFER_DESC stagingDesc;
+	stagingDesc.Usage = D3D11_USAGE_STAGING;
+	stagingDesc.ByteWidth = sizeof(DrawArguments) * viewCount * (LOD_COUNT + 1);
+	stagingDesc.BindFlags = 0;
+	stagingDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	stagingDesc.MiscFlags = 0;
+	stagingDesc.StructureByteStride = 0;
+	for (int i = 0; i < STATS_LATENCY; i++)
+	{
+		argumentsStaging[i] = 0;
+		device->CreateBuffer(&stagingDesc, NULL, &argumentsStaging[i]);
+		MemoryTracker::track(argumentsStaging[i], MEMORY_STAGING, "GPU scene arguments readback");
+		stagingWritten[i] = false;
+	}
+	stagingIndex = 0;
+	visibleCounts.assign(viewCount * (LOD_COUNT + 1), 0);
+	argumentTemplate.resize(viewCount * (LOD_COUNT + 1));
+	buildArgumentTemplate();
+}
+
+GpuDrivenScene::~GpuDrivenScene()
+{
+	releaseBuffers();
+
+	// Release the constant buffer and staging copies
+	if (instanceBuffer)
+	{
+		instanceBuffer->Release();
+		instanceBuffer = 0;
+	}
+	for (int i = 0; i < STATS_LATENCY; i++)
+	{
+		if (argumentsStaging[i])
+		{
+			argumentsStaging[i]->Release();
+			argumentsStaging[i] = 0;
+		}
+	}
+}
+
+bool GpuDrivenScene::setPatches(TPlane* mesh, float lplaneResolution)
+{
+	// Every patch is drawn as an offset copy of the first, so they all need the same number of quads
+	for (int patch = 1; patch < mesh->getPatchCount(); patch++)
+	{
+		if (mesh->getPatchIndexCount(patch) != mesh->getPatchIndexCount(0))
+		{
+			return false;
+		}
+	}
+
+	// Patch records always come first, so replacing them moves every object record along
+	vector<GpuDrawRecord> objects(records.begin() + patchCount, records.end());
+	records.clear();
+	for (int patch = 0; patch < mesh->getPatchCount(); patch++)
+	{
+		const BoundingBox& bounds = mesh->getPatchBounds(patch);
+		GpuDrawRecord record;
+		record.center = bounds.Center;
+		record.radius = 0.0f;
+		record.extents = bounds.Extents;
+		record.flags = 0;
+		records.push_back(record);
+	}
+	records.insert(records.end(), objects.begin(), objects.end());
+
+	patchMesh = mesh;
+	patchCount = mesh->getPatchCount();
+	planeResolution = lplaneResolution;
+	buildArgumentTemplate();
+	markDirty(0);
+	markDirty((int)records.size() - 1);
+	return true;
+}
+
+void GpuDrivenScene::updatePatch(int patch)
+{
+	if (!patchMesh || patch < 0 || patch >= patchCount)
+	{
+		return;
+	}
+	const BoundingBox& bounds = patchMesh->getPatchBounds(patch);
+	records[patch].center = bounds.Center;
+	records[patch].extents = bounds.Extents;
+	markDirty(patch);
+}
+
+void GpuDrivenScene::setObjectMesh(LodSphereMesh* mesh)
+{
+	objectMesh = mesh;
+	buildArgumentTemplate();
+}
+
+int GpuDrivenScene::addObject(const XMFLOAT3& position, float radius)
+{
+	records.push_back(GpuDrawRecord());
+	int object = getObjectCount() - 1;
+	setObject(object, position, radius);
+	return object;
+}
+
+void GpuDrivenScene::setObject(int object, const XMFLOAT3& position, float radius)
+{
+	GpuDrawRecord& record = records[patchCount + object];
+	record.center = position;
+	record.radius = radius;
+	record.extents = XMFLOAT3(radius, radius, radius);
+	record.flags = 0;
+	markDirty(patchCount + object);
+}
+
+void GpuDrivenScene::clearObjects()
+{
+	records.resize(patchCount);
+}
+
+void GpuDrivenScene::markDirty(int record)
+{
+	if (dirtyFirst >= dirtyLast)
+	{
+		dirtyFirst = record;
+		dirtyLast = record + 1;
+	}
+	else
+	{
+		dirtyFirst = min(dirtyFirst, record);
+		dirtyLast = max(dirtyLast, record + 1);
+	}
+}
+
+void GpuDrivenScene::buildArgumentTemplate()
+{
+	// Every view draws the same patch and object ranges, only the instance counts differ
+	for (int view = 0; view < viewCount; view++)
+	{
+		DrawArguments* arguments = &argumentTemplate[view * (LOD_COUNT + 1)];
+		memset(arguments, 0, sizeof(DrawArguments) * (LOD_COUNT + 1));
+		if (patchMesh && patchMesh->getPatchCount() > 0)
+		{
+			arguments[0].indexCountPerInstance = patchMesh->getPatchIndexCount(0);
+			arguments[0].startIndexLocation = patchMesh->getPatchIndexStart(0);
+		}
+		for (int lod = 0; objectMesh && lod < LOD_COUNT; lod++)
+		{
+			int meshLod = min(lod, objectMesh->getLodCount() - 1);
+			arguments[lod + 1].indexCountPerInstance = objectMesh->getLodIndexCount(meshLod);
+			arguments[lod + 1].startIndexLocation = objectMesh->getLodIndexStart(meshLod);
+			arguments[lod + 1].baseVertexLocation = objectMesh->getLodBaseVertex(meshLod);
+		}
+	}
+}
+
+void GpuDrivenScene::releaseBuffers()
+{
+	if (recordSRV)
+	{
+		recordSRV->Release();
+		recordSRV = 0;
+	}
+	if (recordBuffer)
+	{
+		recordBuffer->Release();
+		recordBuffer = 0;
+	}
+	if (visibleSRV)
+	{
+		visibleSRV->Release();
+		visibleSRV = 0;
+	}
+	if (visibleUAV)
+	{
+		visibleUAV->Release();
+		visibleUAV = 0;
+	}
+	if (visibleBuffer)
+	{
+		visibleBuffer->Release();
+		visibleBuffer = 0;
+	}
+	if (argumentsUAV)
+	{
+		argumentsUAV->Release();
+		argumentsUAV = 0;
+	}
+	if (argumentsBuffer)
+	{
+		argumentsBuffer->Release();
+		argumentsBuffer = 0;
+	}
+}
+
+void GpuDrivenScene::createBuffers(int newPatchCapacity, int newObjectCapacity)
+{
+	releaseBuffers();
+	patchCapacity = newPatchCapacity;
+	objectCapacity = newObjectCapacity;
+
+	// Records, read by the culling shader and the instanced vertex shaders
+	D3D11_BUFFER_DESC recordDesc;
+	recordDesc.Usage = D3D11_USAGE_DEFAULT;
+	recordDesc.ByteWidth = sizeof(GpuDrawRecord) * (patchCapacity + objectCapacity);
+	recordDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	recordDesc.CPUAccessFlags = 0;
+	recordDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	recordDesc.StructureByteStride = sizeof(GpuDrawRecord);
+	device->CreateBuffer(&recordDesc, NULL, &recordBuffer);
+	MemoryTracker::track(recordBuffer, MEMORY_GPU_BUFFER, "GPU scene draw records");
+	device->CreateShaderResourceView(recordBuffer, NULL, &recordSRV);
+
+	// Visible lists, written by the culling shader and read by the instanced vertex shaders
+	D3D11_BUFFER_DESC visibleDesc;
+	visibleDesc.Usage = D3D11_USAGE_DEFAULT;
+	visibleDesc.ByteWidth = sizeof(UINT) * viewCount * (patchCapacity + LOD_COUNT * objectCapacity);
+	visibleDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS;
+	visibleDesc.CPUAccessFlags = 0;
+	visibleDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	visibleDesc.StructureByteStride = sizeof(UINT);
+	device->CreateBuffer(&visibleDesc, NULL, &visibleBuffer);
+	MemoryTracker::track(visibleBuffer, MEMORY_GPU_BUFFER, "GPU scene visible list");
+	device->CreateShaderResourceView(visibleBuffer, NULL, &visibleSRV);
+	device->CreateUnorderedAccessView(visibleBuffer, NULL, &visibleUAV);
+
+	// Indirect arguments, counted into by the culling shader through a raw view
+	D3D11_BUFFER_DESC argumentsDesc;
+	argumentsDesc.Usage = D3D11_USAGE_DEFAULT;
+	argumentsDesc.ByteWidth = sizeof(DrawArguments) * viewCount * (LOD_COUNT + 1);
+	argumentsDesc.BindFlags = D3D11_BIND_UNORDERED_ACCESS;
+	argumentsDesc.CPUAccessFlags = 0;
+	argumentsDesc.MiscFlags = D3D11_RESOURCE_MISC_DRAWINDIRECT_ARGS | D3D11_RESOURCE_MISC_BUFFER_ALLOW_RAW_VIEWS;
+	argumentsDesc.StructureByteStride = 0;
+	device->CreateBuffer(&argumentsDesc, NULL, &argumentsBuffer);
+	MemoryTracker::track(argumentsBuffer, MEMORY_GPU_BUFFER, "GPU scene draw arguments");
+
+	D3D11_UNORDERED_ACCESS_VIEW_DESC argumentsUAVDesc;
+	argumentsUAVDesc.Format = DXGI_FORMAT_R32_TYPELESS;
+	argumentsUAVDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+	argumentsUAVDesc.Buffer.FirstElement = 0;
+	argumentsUAVDesc.Buffer.NumElements = argumentsDesc.ByteWidth / sizeof(UINT);
+	argumentsUAVDesc.Buffer.Flags = D3D11_BUFFER_UAV_FLAG_RAW;
+	device->CreateUnorderedAccessView(argumentsBuffer, &argumentsUAVDesc, &argumentsUAV);
+
+	// Everything has to be uploaded again into the new record buffer
+	markDirty(0);
+	markDirty(max(0, (int)records.size() - 1));
+}
+
+void GpuDrivenScene::beginFrame(ID3D11DeviceContext* deviceContext)
+{
+	// Grows the buffers to fit, doubling the object capacity so adding objects one at a time doesn't recreate them every frame
+	int objectCount = getObjectCount();
+	if (!recordBuffer || patchCount > patchCapacity || objectCount > objectCapacity)
+	{
+		createBuffers(patchCount, max(max(objectCount, objectCapacity * 2), 1024));
+	}
+
+	// Uploads only the records that changed since the last frame
+	if (dirtyFirst < dirtyLast && !records.empty())
+	{
+		dirtyLast = min(dirtyLast, (int)records.size());
+		D3D11_BOX box;
+		box.left = dirtyFirst * sizeof(GpuDrawRecord);
+		box.right = dirtyLast * sizeof(GpuDrawRecord);
+		box.top = 0;
+		box.bottom = 1;
+		box.front = 0;
+		box.back = 1;
+		deviceContext->UpdateSubresource(recordBuffer, 0, &box, &records[dirtyFirst], 0, 0);
+	}
+	dirtyFirst = 0;
+	dirtyLast = 0;
+
+	// Resets the instance counts, ready for the culling shader to count into
+	deviceContext->UpdateSubresource(argumentsBuffer, 0, NULL, argumentTemplate.data(), 0, 0);
+}
+
+void GpuDrivenScene::invalidateGpuState()
+{
+	dirtyFirst = 0;
+	dirtyLast = (int)records.size();
+	for (int i = 0; i < STATS_LATENCY; i++)
+	{
+		stagingWritten[i] = false;
+	}
+}
+
+UINT GpuDrivenScene::getPatchListOffset(int view) const
+{
+	return view * (patchCapacity + LOD_COUNT * objectCapacity);
+}
+
+UINT GpuDrivenScene::getObjectListOffset(int view) const
+{
+	return getPatchListOffset(view) + patchCapacity;
+}
+
+UINT GpuDrivenScene::getArgumentsOffset(int view) const
+{
+	return view * (LOD_COUNT + 1) * sizeof(DrawArguments);
+}
+
+void GpuDrivenScene::setPatchLod(const XMFLOAT3& position, float lmaxTessFactor, float llodNear, float llodFar)
+{
+	lodPosition = position;
+	maxTessFactor = lmaxTessFactor;
+	lodNear = llodNear;
+	lodFar = llodFar;
+}
+
+void GpuDrivenScene::bindInstances(ID3D11DeviceContext* deviceContext, UINT listOffset)
+{
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+
+	// Set the list offset and patch level of detail and send to the Vertex Shader and Hull Shader
+	deviceContext->Map(instanceBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+	InstanceBufferType* instancePtr = (InstanceBufferType*)mappedResource.pData;
+	instancePtr->listOffset = listOffset;
+	instancePtr->planeResolution = planeResolution;
+	instancePtr->maxTessFactor = maxTessFactor;
+	instancePtr->lodNear = lodNear;
+	instancePtr->lodPosition = lodPosition;
+	instancePtr->lodFar = lodFar;
+	deviceContext->Unmap(instanceBuffer, 0);
+	StateCache::get()->setConstantBuffers(deviceContext, STAGE_VS, 1, 1, &instanceBuffer);
+	StateCache::get()->setConstantBuffers(deviceContext, STAGE_HS, 1, 1, &instanceBuffer);
+
+	// Set the records and visible lists for use in the Vertex Shader
+	StateCache::get()->setShaderResources(deviceContext, STAGE_VS, 0, 1, &recordSRV);
+	StateCache::get()->setShaderResources(deviceContext, STAGE_VS, 1, 1, &visibleSRV);
+}
+
+void GpuDrivenScene::drawPatches(ID3D11DeviceContext* deviceContext, int view)
+{
+	if (patchCount == 0)
+	{
+		return;
+	}
+
+	bindInstances(deviceContext, getPatchListOffset(view));
+	deviceContext->DrawIndexedInstancedIndirect(argumentsBuffer, getArgumentsOffset(view));
+
+	// Unbind the visible lists so the culling shader can write to them again
+	ID3D11ShaderResourceView* nullSRV[2] = { NULL, NULL };
+	StateCache::get()->setShaderResources(deviceContext, STAGE_VS, 0, 2, nullSRV);
+}
+
+void GpuDrivenScene::drawObjects(ID3D11DeviceContext* deviceContext, int view)
+{
+	if (!objectMesh || getObjectCount() == 0)
+	{
+		return;
+	}
+
+	// One indirect draw per level of detail, each reading its own part of the view's visible list
+	for (int lod = 0; lod < LOD_COUNT; lod++)
+	{
+		bindInstances(deviceContext, getObjectListOffset(view) + lod * objectCapacity);
+		deviceContext->DrawIndexedInstancedIndirect(argumentsBuffer, getArgumentsOffset(view) + (lod + 1) * sizeof(DrawArguments));
+	}
+
+	ID3D11ShaderResourceView* nullSRV[2] = { NULL, NULL };
+	StateCache::get()->setShaderResources(deviceContext, STAGE_VS, 0, 2, nullSRV);
+}
+
+void GpuDrivenScene::readStats(ID3D11DeviceContext* deviceContext)
+{
+	// Reads the oldest copy if the GPU has finished with it, without waiting
+	if (stagingWritten[stagingIndex])
+	{
+		D3D11_MAPPED_SUBRESOURCE mappedResource;
+		if (deviceContext->Map(argumentsStaging[stagingIndex], 0, D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &mappedResource) == S_OK)
+		{
+			const DrawArguments* arguments = (const DrawArguments*)mappedResource.pData;
+			for (size_t i = 0; i < visibleCounts.size(); i++)
+			{
+				visibleCounts[i] = arguments[i].instanceCount;
+			}
+			deviceContext->Unmap(argumentsStaging[stagingIndex], 0);
+		}
+	}
+
+	// Queue this frame's arguments for reading back
+	deviceContext->CopyResource(argumentsStaging[stagingIndex], argumentsBuffer);
+	stagingWritten[stagingIndex] = true;
+	stagingIndex = (stagingIndex + 1) % STATS_LATENCY;
+}
+
+unsigned long long GpuDrivenScene::getGpuBytes() const
+{
+	unsigned long long recordBytes = (unsigned long long)sizeof(GpuDrawRecord) * (patchCapacity + objectCapacity);
+	unsigned long long visibleBytes = (unsigned long long)sizeof(UINT) * viewCount * (patchCapacity + LOD_COUNT * objectCapacity);
+	unsigned long long argumentBytes = (unsigned long long)sizeof(DrawArguments) * viewCount * (LOD_COUNT + 1);
+	return recordBytes + visibleBytes + argumentBytes;
+}
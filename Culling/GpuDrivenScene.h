@@ -0,0 +1,152 @@
+// Persistent GPU copy of every terrain patch and object record, plus the per-view visible lists and indirect draw arguments
+// the GPU culling shader fills in. Drawing a view costs the same handful of API calls however many records there are
+#pragma once
+
+#include "DXF.h"
+#include "StateCache.h"
+#include "Tplane.h"
+#include "LodSphereMesh.h"
+#include <vector>
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+using namespace DirectX;
+
+// One patch or object, matching DrawRecord in gpu_records_h.hlsli. Objects are the LOD sphere scaled by radius
+struct GpuDrawRecord
+{
+	XMFLOAT3 center;
+	float radius;
+	XMFLOAT3 extents;
+	UINT flags;
+};
+
+class GpuDrivenScene
+{
+public:
+	// Number of object levels of detail, each with its own visible list and draw arguments
+	static const int LOD_COUNT = 3;
+
+	// Arguments for DrawIndexedInstancedIndirect, in the order the GPU reads them
+	struct DrawArguments
+	{
+		UINT indexCountPerInstance;
+		UINT instanceCount;
+		UINT startIndexLocation;
+		INT baseVertexLocation;
+		UINT startInstanceLocation;
+	};
+
+	// Tells the instanced vertex shaders where the list they're drawing starts, and the patch hull shader how the patches' level of detail
+	// was chosen, so it can work out each edge's factor the same way
+	struct InstanceBufferType
+	{
+		UINT listOffset;
+		float planeResolution;
+		float maxTessFactor;
+		float lodNear;
+		XMFLOAT3 lodPosition;
+		float lodFar;
+	};
+
+	// viewCount is the number of views culled each frame (the camera and each shadow casting light)
+	GpuDrivenScene(ID3D11Device* device, int viewCount);
+	~GpuDrivenScene();
+
+	// Replaces the patch records with the plane's patch bounds. Every patch must be full sized, as they're all drawn as copies of the first
+	bool setPatches(TPlane* mesh, float planeResolution);
+
+	// Copies a patch's bounds from the plane again after they've been refitted, uploading only its record
+	void updatePatch(int patch);
+
+	// Sets the mesh objects are drawn with, whose levels of detail fill the object draw arguments
+	void setObjectMesh(LodSphereMesh* mesh);
+
+	// Adds, moves or removes objects. Only the records that changed are uploaded on the next beginFrame
+	int addObject(const XMFLOAT3& position, float radius);
+	void setObject(int object, const XMFLOAT3& position, float radius);
+	void clearObjects();
+
+	// Sets where the patches' level of detail is measured from and the distances the tessellation factor falls from its maximum to 1 over,
+	// as the culling shader picks each patch's inside factor. The hull shader uses them for the edges, kept for every view until set again
+	void setPatchLod(const XMFLOAT3& position, float maxTessFactor, float lodNear, float lodFar);
+
+	// Makes room for count objects, so adding a large scene's objects doesn't keep growing the record array
+	void reserveObjects(int count) { records.reserve(patchCount + count); }
+
+	int getPatchCount() const { return patchCount; }
+	int getObjectCount() const { return (int)records.size() - patchCount; }
+	int getRecordCount() const { return (int)records.size(); }
+	const GpuDrawRecord& getObject(int object) const { return records[patchCount + object]; }
+	int getViewCount() const { return viewCount; }
+
+	// Grows the buffers if needed, uploads changed records and resets every view's arguments to zero instances
+	void beginFrame(ID3D11DeviceContext* deviceContext);
+
+	// Issues the indirect draws for a view's visible patches or objects. The shaders and mesh must already be bound
+	void drawPatches(ID3D11DeviceContext* deviceContext, int view);
+	void drawObjects(ID3D11DeviceContext* deviceContext, int view);
+
+	// Copies the arguments for reading back, and reads the oldest finished copy into the visible counts
+	void readStats(ID3D11DeviceContext* deviceContext);
+	int getVisiblePatches(int view) const { return visibleCounts[view * (LOD_COUNT + 1)]; }
+	int getVisibleObjects(int view, int lod) const { return visibleCounts[view * (LOD_COUNT + 1) + lod + 1]; }
+
+	// For when something else has written over the buffers, such as a replayed command trace. Every record is uploaded again on the next
+	// beginFrame, and the copies still waiting to be read back are dropped, as they hold whatever was written over them
+	void invalidateGpuState();
+
+	// Buffers and offsets used by the GPU culling shader
+	ID3D11ShaderResourceView* getRecordSRV() { return recordSRV; }
+	ID3D11UnorderedAccessView* getVisibleUAV() { return visibleUAV; }
+	ID3D11UnorderedAccessView* getArgumentsUAV() { return argumentsUAV; }
+	UINT getPatchListOffset(int view) const;
+	UINT getObjectListOffset(int view) const;
+	UINT getArgumentsOffset(int view) const;
+	int getObjectCapacity() const { return objectCapacity; }
+	unsigned long long getGpuBytes() const;
+
+private:
+	void createBuffers(int newPatchCapacity, int newObjectCapacity);
+	void releaseBuffers();
+	void buildArgumentTemplate();
+	void bindInstances(ID3D11DeviceContext* deviceContext, UINT listOffset);
+	void markDirty(int record);
+
+	ID3D11Device* device;
+	int viewCount;
+	int patchCount;
+	float planeResolution;
+	XMFLOAT3 lodPosition;
+	float maxTessFactor;
+	float lodNear;
+	float lodFar;
+	TPlane* patchMesh;
+	LodSphereMesh* objectMesh;
+
+	// CPU copy of the records, and the range that needs uploading
+	vector<GpuDrawRecord> records;
+	int dirtyFirst;
+	int dirtyLast;
+
+	// Records, the visible lists for every view (patches then each object level) and the indirect arguments
+	int patchCapacity;
+	int objectCapacity;
+	ID3D11Buffer* recordBuffer;
+	ID3D11ShaderResourceView* recordSRV;
+	ID3D11Buffer* visibleBuffer;
+	ID3D11ShaderResourceView* visibleSRV;
+	ID3D11UnorderedAccessView* visibleUAV;
+	ID3D11Buffer* argumentsBuffer;
+	ID3D11UnorderedAccessView* argumentsUAV;
+	ID3D11Buffer* instanceBuffer;
+	vector<DrawArguments> argumentTemplate;
+
+	// Staging copies of the arguments, read back a few frames later for the visible counts
+	static const int STATS_LATENCY = 3;
+	ID3D11Buffer* argumentsStaging[STATS_LATENCY];
+	bool stagingWritten[STATS_LATENCY];
+	int stagingIndex;
+	vector<int> visibleCounts;
+};
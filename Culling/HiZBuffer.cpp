@@ -0,0 +1,105 @@
+#include "HiZBuffer.h"
+#include <algorithm>
+#include <cmath>
+
+HiZBuffer::HiZBuffer()
+{
+}
+
+void HiZBuffer::build(const float* depth, int width, int height, int rowPitch)
+{
+	mips.clear();
+	widths.clear();
+	heights.clear();
+	if (width <= 0 || height <= 0)
+	{
+		return;
+	}
+
+	// Copy the top mip, treating cleared (zero) texels as the far plane since nothing was drawn there
+	mips.push_back(vector<float>((size_t)width * height));
+	widths.push_back(width);
+	heights.push_back(height);
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			float value = depth[y * rowPitch + x];
+			mips[0][y * width + x] = value > 0.0f ? value : 1.0f;
+		}
+	}
+
+	// Each following mip keeps the furthest depth of the texels it covers, including the extra row or column of odd sized parents
+	while (widths.back() > 1 || heights.back() > 1)
+	{
+		int parentWidth = widths.back();
+		int parentHeight = heights.back();
+		int mipWidth = max(1, parentWidth / 2);
+		int mipHeight = max(1, parentHeight / 2);
+		vector<float> mip((size_t)mipWidth * mipHeight);
+		const vector<float>& parent = mips.back();
+
+		for (int y = 0; y < mipHeight; y++)
+		{
+			int y1 = (y == mipHeight - 1) ? parentHeight - 1 : y * 2 + 1;
+			for (int x = 0; x < mipWidth; x++)
+			{
+				int x1 = (x == mipWidth - 1) ? parentWidth - 1 : x * 2 + 1;
+				float furthest = 0.0f;
+				for (int parentY = y * 2; parentY <= y1; parentY++)
+				{
+					for (int parentX = x * 2; parentX <= x1; parentX++)
+					{
+						furthest = max(furthest, parent[parentY * parentWidth + parentX]);
+					}
+				}
+				mip[y * mipWidth + x] = furthest;
+			}
+		}
+
+		mips.push_back(move(mip));
+		widths.push_back(mipWidth);
+		heights.push_back(mipHeight);
+	}
+}
+
+bool HiZBuffer::isOccluded(float minU, float minV, float maxU, float maxV, float nearestDepth) const
+{
+	if (mips.empty())
+	{
+		return false;
+	}
+
+	// Clamp the rectangle to the screen
+	minU = min(max(minU, 0.0f), 1.0f);
+	minV = min(max(minV, 0.0f), 1.0f);
+	maxU = min(max(maxU, 0.0f), 1.0f);
+	maxV = min(max(maxV, 0.0f), 1.0f);
+
+	// Pick the mip where the rectangle covers at most two texels in each direction
+	float texelsX = (maxU - minU) * widths[0];
+	float texelsY = (maxV - minV) * heights[0];
+	int mip = (int)ceilf(log2f(max(max(texelsX, texelsY), 1.0f)));
+	mip = min(max(mip, 0), (int)mips.size() - 1);
+
+	int width = widths[mip];
+	int height = heights[mip];
+	int x0 = min((int)(minU * width), width - 1);
+	int x1 = min((int)(maxU * width), width - 1);
+	int y0 = min((int)(minV * height), height - 1);
+	int y1 = min((int)(maxV * height), height - 1);
+
+	// Occluded only if the nearest point of the object is behind every texel it covers
+	const vector<float>& texels = mips[mip];
+	for (int y = y0; y <= y1; y++)
+	{
+		for (int x = x0; x <= x1; x++)
+		{
+			if (nearestDepth <= texels[y * width + x])
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
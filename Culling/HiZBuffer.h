@@ -0,0 +1,29 @@
+// Hierarchical depth buffer kept on the CPU. Each mip stores the furthest depth of the 2x2 texels below it,
+// so a whole screen rectangle can be tested against the depth buffer with a handful of reads
+#pragma once
+
+#include <vector>
+
+using namespace std;
+
+class HiZBuffer
+{
+public:
+	HiZBuffer();
+
+	// Copies a depth image (z / w, furthest being 1) into the top mip and builds the rest of the chain
+	void build(const float* depth, int width, int height, int rowPitch);
+
+	// Returns true if everything inside the rectangle (in 0-1 texture space) is behind the furthest depth stored there
+	bool isOccluded(float minU, float minV, float maxU, float maxV, float nearestDepth) const;
+
+	bool isEmpty() const { return mips.empty(); }
+	int getWidth() const { return widths.empty() ? 0 : widths[0]; }
+	int getHeight() const { return heights.empty() ? 0 : heights[0]; }
+	int getMipCount() const { return (int)mips.size(); }
+
+private:
+	vector<vector<float>> mips;
+	vector<int> widths;
+	vector<int> heights;
+};
@@ -0,0 +1,84 @@
+#include "OcclusionCuller.h"
+#include <algorithm>
+#include <cfloat>
+
+OcclusionCuller::OcclusionCuller()
+{
+	stats.tested = 0;
+	stats.frustumCulled = 0;
+	stats.occluded = 0;
+	stats.visible = 0;
+}
+
+// Projects a box's corners, returning false if any of them are behind the camera
+static bool projectBounds(const XMFLOAT3* corners, const XMMATRIX& viewProjection, XMFLOAT3& ndcMin, XMFLOAT3& ndcMax)
+{
+	XMVECTOR minimum = XMVectorReplicate(FLT_MAX);
+	XMVECTOR maximum = XMVectorReplicate(-FLT_MAX);
+	for (int corner = 0; corner < BoundingBox::CORNER_COUNT; corner++)
+	{
+		XMVECTOR clip = XMVector4Transform(XMVectorSetW(XMLoadFloat3(&corners[corner]), 1.0f), viewProjection);
+		float w = XMVectorGetW(clip);
+		if (w <= 1e-4f)
+		{
+			return false;
+		}
+		XMVECTOR ndc = XMVectorDivide(clip, XMVectorReplicate(w));
+		minimum = XMVectorMin(minimum, ndc);
+		maximum = XMVectorMax(maximum, ndc);
+	}
+	XMStoreFloat3(&ndcMin, minimum);
+	XMStoreFloat3(&ndcMax, maximum);
+	return true;
+}
+
+void OcclusionCuller::cull(const vector<BoundingBox>& bounds, const XMMATRIX& viewProjection, const HiZBuffer& hiZ, const XMMATRIX& hiZViewProjection, vector<int>& visibleList, vector<char>& visibleFlags)
+{
+	stats.tested = (int)bounds.size();
+	stats.frustumCulled = 0;
+	stats.occluded = 0;
+	stats.visible = 0;
+	visibleList.clear();
+	visibleFlags.assign(bounds.size(), 0);
+
+	for (size_t i = 0; i < bounds.size(); i++)
+	{
+		XMFLOAT3 corners[BoundingBox::CORNER_COUNT];
+		bounds[i].GetCorners(corners);
+
+		// Boxes that pass behind the camera can't be projected safely, so they are always drawn
+		bool visible = true;
+		XMFLOAT3 ndcMin, ndcMax;
+		if (projectBounds(corners, viewProjection, ndcMin, ndcMax))
+		{
+			if (ndcMax.x < -1.0f || ndcMin.x > 1.0f || ndcMax.y < -1.0f || ndcMin.y > 1.0f || ndcMin.z > 1.0f)
+			{
+				stats.frustumCulled++;
+				visible = false;
+			}
+		}
+
+		// Project again from the Hi-Z buffer's view, and compare the nearest depth against the furthest depth under the rectangle
+		if (visible && !hiZ.isEmpty() && projectBounds(corners, hiZViewProjection, ndcMin, ndcMax))
+		{
+			if (hiZ.isOccluded(ndcMin.x * 0.5f + 0.5f, 0.5f - ndcMax.y * 0.5f, ndcMax.x * 0.5f + 0.5f, 0.5f - ndcMin.y * 0.5f, ndcMin.z))
+			{
+				stats.occluded++;
+				visible = false;
+			}
+		}
+
+		if (visible)
+		{
+			visibleList.push_back((int)i);
+			visibleFlags[i] = 1;
+			stats.visible++;
+		}
+	}
+}
+
+float OcclusionCuller::getOccludedFraction() const
+{
+	int inFrustum = stats.tested - stats.frustumCulled;
+	return inFrustum > 0 ? (float)stats.occluded / inFrustum : 0.0f;
+}
@@ -0,0 +1,38 @@
+// Tests bounding boxes against the view frustum and a Hi-Z buffer, producing a compacted list of the ones that still need drawing
+#pragma once
+
+#include "HiZBuffer.h"
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include <vector>
+
+using namespace std;
+using namespace DirectX;
+
+// Counters from the most recent cull
+struct OcclusionStats
+{
+	int tested;
+	int frustumCulled;
+	int occluded;
+	int visible;
+};
+
+class OcclusionCuller
+{
+public:
+	OcclusionCuller();
+
+	// Tests every box, writing the indices of the visible ones to visibleList and a flag per box to visibleFlags.
+	// The frustum test uses the current viewProjection, the occlusion test uses the matrix the Hi-Z buffer was rendered with
+	// (which is older when it has been read back from the GPU). An empty Hi-Z buffer only frustum culls
+	void cull(const vector<BoundingBox>& bounds, const XMMATRIX& viewProjection, const HiZBuffer& hiZ, const XMMATRIX& hiZViewProjection, vector<int>& visibleList, vector<char>& visibleFlags);
+
+	const OcclusionStats& getStats() const { return stats; }
+
+	// Fraction of the boxes inside the frustum that were hidden behind other geometry
+	float getOccludedFraction() const;
+
+private:
+	OcclusionStats stats;
+};
@@ -0,0 +1,120 @@
+#include "SoftwareOcclusionRasterizer.h"
+#include <algorithm>
+#include <cmath>
+
+SoftwareOcclusionRasterizer::SoftwareOcclusionRasterizer(int lwidth, int lheight)
+{
+	width = lwidth;
+	height = lheight;
+
+	// Rows are padded to a multiple of four pixels so every SIMD load and store stays inside the row
+	rowPitch = (width + 3) & ~3;
+	trianglesRasterized = 0;
+	depth.resize((size_t)rowPitch * height);
+	clear();
+}
+
+void SoftwareOcclusionRasterizer::clear()
+{
+	fill(depth.begin(), depth.end(), 1.0f);
+	trianglesRasterized = 0;
+}
+
+void SoftwareOcclusionRasterizer::rasterize(const vector<XMFLOAT3>& vertices, const vector<unsigned int>& indices, const XMMATRIX& worldViewProjection)
+{
+	// Transform every vertex once into screen space (x and y in pixels, z as z / w), keeping w to detect the near plane
+	transformed.resize(vertices.size());
+	for (size_t i = 0; i < vertices.size(); i++)
+	{
+		XMVECTOR clip = XMVector4Transform(XMVectorSetW(XMLoadFloat3(&vertices[i]), 1.0f), worldViewProjection);
+		float w = XMVectorGetW(clip);
+		if (w <= 1e-4f)
+		{
+			transformed[i] = XMFLOAT4(0.0f, 0.0f, 0.0f, -1.0f);
+			continue;
+		}
+		XMFLOAT4 ndc;
+		XMStoreFloat4(&ndc, XMVectorDivide(clip, XMVectorReplicate(w)));
+		transformed[i] = XMFLOAT4((ndc.x * 0.5f + 0.5f) * width, (0.5f - ndc.y * 0.5f) * height, ndc.z, w);
+	}
+
+	for (size_t i = 0; i + 2 < indices.size(); i += 3)
+	{
+		const XMFLOAT4& v0 = transformed[indices[i]];
+		const XMFLOAT4& v1 = transformed[indices[i + 1]];
+		const XMFLOAT4& v2 = transformed[indices[i + 2]];
+		if (v0.w < 0.0f || v1.w < 0.0f || v2.w < 0.0f)
+		{
+			continue;
+		}
+		rasterizeTriangle(v0, v1, v2);
+	}
+}
+
+void SoftwareOcclusionRasterizer::rasterizeTriangle(const XMFLOAT4& v0, const XMFLOAT4& v1, const XMFLOAT4& v2)
+{
+	// Twice the signed area, both windings are accepted since occluders are visible from either side
+	float area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+	if (fabsf(area) < 1e-6f)
+	{
+		return;
+	}
+	float sign = area > 0.0f ? 1.0f : -1.0f;
+
+	// Clip the bounding rectangle to the screen
+	int minX = max((int)floorf(min(min(v0.x, v1.x), v2.x)), 0);
+	int maxX = min((int)ceilf(max(max(v0.x, v1.x), v2.x)), width - 1);
+	int minY = max((int)floorf(min(min(v0.y, v1.y), v2.y)), 0);
+	int maxY = min((int)ceilf(max(max(v0.y, v1.y), v2.y)), height - 1);
+	if (minX > maxX || minY > maxY)
+	{
+		return;
+	}
+	minX &= ~3;
+
+	// Edge functions E(x, y) = a * x + b * y + c, positive inside the triangle once the winding sign is applied
+	float a0 = (v1.y - v2.y) * sign, b0 = (v2.x - v1.x) * sign, c0 = (v1.x * v2.y - v2.x * v1.y) * sign;
+	float a1 = (v2.y - v0.y) * sign, b1 = (v0.x - v2.x) * sign, c1 = (v2.x * v0.y - v0.x * v2.y) * sign;
+	float a2 = (v0.y - v1.y) * sign, b2 = (v1.x - v0.x) * sign, c2 = (v0.x * v1.y - v1.x * v0.y) * sign;
+
+	// z / w is linear in screen space, so it can be written as a plane equation from the barycentric weights
+	float inverseArea = 1.0f / (area * sign);
+	float dzdx = (a1 * (v1.z - v0.z) + a2 * (v2.z - v0.z)) * inverseArea;
+	float dzdy = (b1 * (v1.z - v0.z) + b2 * (v2.z - v0.z)) * inverseArea;
+	float z0 = v0.z - dzdx * v0.x - dzdy * v0.y;
+
+	// Four neighbouring pixel centres are evaluated at once
+	XMVECTOR pixelOffsets = XMVectorSet(0.5f, 1.5f, 2.5f, 3.5f);
+	XMVECTOR edgeStepX0 = XMVectorReplicate(a0 * 4.0f);
+	XMVECTOR edgeStepX1 = XMVectorReplicate(a1 * 4.0f);
+	XMVECTOR edgeStepX2 = XMVectorReplicate(a2 * 4.0f);
+	XMVECTOR depthStepX = XMVectorReplicate(dzdx * 4.0f);
+	XMVECTOR zero = XMVectorZero();
+
+	for (int y = minY; y <= maxY; y++)
+	{
+		float pixelY = y + 0.5f;
+		XMVECTOR pixelX = XMVectorAdd(XMVectorReplicate((float)minX), pixelOffsets);
+		XMVECTOR edge0 = XMVectorMultiplyAdd(XMVectorReplicate(a0), pixelX, XMVectorReplicate(b0 * pixelY + c0));
+		XMVECTOR edge1 = XMVectorMultiplyAdd(XMVectorReplicate(a1), pixelX, XMVectorReplicate(b1 * pixelY + c1));
+		XMVECTOR edge2 = XMVectorMultiplyAdd(XMVectorReplicate(a2), pixelX, XMVectorReplicate(b2 * pixelY + c2));
+		XMVECTOR pixelDepth = XMVectorMultiplyAdd(XMVectorReplicate(dzdx), pixelX, XMVectorReplicate(dzdy * pixelY + z0));
+
+		float* row = depth.data() + y * rowPitch;
+		for (int x = minX; x <= maxX; x += 4)
+		{
+			// Inside all three edges, and nearer than what is already stored
+			XMVECTOR inside = XMVectorAndInt(XMVectorAndInt(XMVectorGreaterOrEqual(edge0, zero), XMVectorGreaterOrEqual(edge1, zero)), XMVectorGreaterOrEqual(edge2, zero));
+			XMVECTOR stored = XMLoadFloat4((const XMFLOAT4*)(row + x));
+			XMVECTOR closer = XMVectorAndInt(inside, XMVectorLess(pixelDepth, stored));
+			XMStoreFloat4((XMFLOAT4*)(row + x), XMVectorSelect(stored, pixelDepth, closer));
+
+			edge0 = XMVectorAdd(edge0, edgeStepX0);
+			edge1 = XMVectorAdd(edge1, edgeStepX1);
+			edge2 = XMVectorAdd(edge2, edgeStepX2);
+			pixelDepth = XMVectorAdd(pixelDepth, depthStepX);
+		}
+	}
+
+	trianglesRasterized++;
+}
@@ -0,0 +1,39 @@
+// Rasterizes occluder meshes into a small depth buffer on the CPU, four pixels at a time using DirectXMath's SIMD vectors.
+// Gives the occlusion culler a Hi-Z buffer without the GPU, for headless runs or when the read-back depth is too stale
+#pragma once
+
+#include <DirectXMath.h>
+#include <vector>
+
+using namespace std;
+using namespace DirectX;
+
+class SoftwareOcclusionRasterizer
+{
+public:
+	SoftwareOcclusionRasterizer(int width, int height);
+
+	// Resets every pixel to the far plane
+	void clear();
+
+	// Rasterizes a triangle list, keeping the nearest z / w at each pixel. Triangles crossing the near plane are skipped,
+	// which can only ever make the occluders smaller
+	void rasterize(const vector<XMFLOAT3>& vertices, const vector<unsigned int>& indices, const XMMATRIX& worldViewProjection);
+
+	const float* getDepth() const { return depth.data(); }
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+	int getRowPitch() const { return rowPitch; }
+	int getTrianglesRasterized() const { return trianglesRasterized; }
+	unsigned long long getBytes() const { return depth.capacity() * sizeof(float) + transformed.capacity() * sizeof(XMFLOAT4); }
+
+private:
+	void rasterizeTriangle(const XMFLOAT4& v0, const XMFLOAT4& v1, const XMFLOAT4& v2);
+
+	int width;
+	int height;
+	int rowPitch;
+	int trianglesRasterized;
+	vector<float> depth;
+	vector<XMFLOAT4> transformed;
+};
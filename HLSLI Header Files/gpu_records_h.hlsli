@@ -0,0 +1,26 @@
+// Records shared by the GPU culling shader and the instanced vertex shaders, matching GpuDrawRecord on the CPU
+// Terrain patches come first in the record buffer, followed by the objects
+
+struct DrawRecord
+{
+    float3 center;
+    float radius;
+    float3 extents;
+    uint flags;
+};
+
+// Patch entries in the visible lists carry their tessellation factor in the top 8 bits
+uint PackPatchInstance(uint recordIndex, float tessFactor)
+{
+    return (recordIndex & 0xFFFFFF) | ((uint)clamp(round(tessFactor), 1, 64) << 24);
+}
+
+uint PatchRecordIndex(uint entry)
+{
+    return entry & 0xFFFFFF;
+}
+
+float PatchTessFactor(uint entry)
+{
+    return (float)(entry >> 24);
+}
@@ -1,3 +1,5 @@
+#include "shadow_moments_h.hlsli"
+
 // Calculates directional light depending on the angle between the light's direction and the normal
 float4 calculateDirectionalLighting(float3 lightDirection, float3 normal, float4 diffuse, float4 ambient)
 {
@@ -64,8 +66,19 @@ float4 calculateSpotLighting(float3 lightPosition, float3 lightDirection, float3
     return colour;
 }
 
+// Moves a light's shadow map coordinates into its tile of the shadow atlas, tileRect holding the tile's scale in .xy and offset in .zw
+// Keeps half a texel inside the tile, so filtering never picks up a neighbouring light's depth
+float2 ShadowAtlasCoord(float2 projTex, float4 tileRect, Texture2D shadowAtlas)
+{
+    float2 atlasSize;
+    shadowAtlas.GetDimensions(atlasSize.x, atlasSize.y);
+    float2 halfTexel = 0.5f / atlasSize;
+    return clamp(projTex * tileRect.xy + tileRect.zw, tileRect.zw + halfTexel, tileRect.zw + tileRect.xy - halfTexel);
+}
+
 // Calculates directional lighting, and calculates shadows simultaneously
-float4 shadowCalculation(float3 lightDir, float4 lightDiff, float4 lightAmb, float3 lightNorm, float4 viewPos, Texture2D currentDepthMap, float bias, SamplerState shadowSampler)
+// With a moment filter selected the shadows come from the blurred moment atlas instead, shadowFilter and exponents being the ShadowFilterBuffer's values
+float4 shadowCalculation(float3 lightDir, float4 lightDiff, float4 lightAmb, float3 lightNorm, float4 viewPos, Texture2D currentDepthMap, Texture2D momentMap, float4 tileRect, float bias, SamplerState shadowSampler, SamplerState momentSampler, float4 shadowFilter, float2 exponents)
 {
     float4 tColour = { 0, 0, 0, 1 };
     
@@ -80,8 +93,16 @@ float4 shadowCalculation(float3 lightDir, float4 lightDiff, float4 lightAmb, flo
         return float4(0, 0, 0, 1);
     }
 
+    // Lights the pixel by how much of the filtered region around it is in front of the occluders, as the ortho depth is already linear
+    if (shadowFilter.x != SHADOW_FILTER_HARD)
+    {
+        float4 moments = momentMap.Sample(momentSampler, ShadowAtlasCoord(projTex, tileRect, momentMap));
+        float visibility = ShadowMomentVisibility(moments, viewPos.z / viewPos.w, shadowFilter, exponents);
+        return lerp(tColour, calculateDirectionalLighting(-lightDir, lightNorm, lightDiff, lightAmb), visibility);
+    }
+
     // Sample Shadow Map (get depth of geometry)
-    float currentDepthValue = currentDepthMap.Sample(shadowSampler, projTex).r;
+    float currentDepthValue = currentDepthMap.Sample(shadowSampler, ShadowAtlasCoord(projTex, tileRect, currentDepthMap)).r;
     
     // Calculate the depth from the view position of this light
     float lightDepthValue = viewPos.z / viewPos.w;
@@ -105,7 +126,8 @@ float LinearizeDepth(float depth, float near, float far)
 }
 
 // Calculates spot lighting by creating an intensity based on the cutoff, and applies light colour only to pixels within the cutoff, also calculates shadows
-float4 spotlightShadowCalculation(float3 lightPosition, float3 lightDirection, float3 worldPosition, float4 viewPos, float3 normal, float4 diffuse, float4 ambient, float cutoff, Texture2D currentDepthMap, float bias, SamplerState shadowSampler, float2 uvTex)
+// The moment atlas holds linearized depths for the spot light, so it is compared with the same linearized depth as the hard shadows
+float4 spotlightShadowCalculation(float3 lightPosition, float3 lightDirection, float3 worldPosition, float4 viewPos, float3 normal, float4 diffuse, float4 ambient, float cutoff, Texture2D currentDepthMap, Texture2D momentMap, float4 tileRect, float bias, SamplerState shadowSampler, SamplerState momentSampler, float4 shadowFilter, float2 exponents, float2 uvTex)
 {
     if (viewPos.x == 0 && viewPos.y == 0 && viewPos.z == 0)
     {
@@ -135,8 +157,24 @@ float4 spotlightShadowCalculation(float3 lightPosition, float3 lightDirection, f
         return float4(0, 0, 0, 1);
     }
     
+    // If the intensity is less than or equal to 0, returns empty colour
+    if (intensity <= 0.0f)
+    {
+        return float4(0, 0, 0, 1);
+    }
+    
+    // Lights the pixel by how much of the filtered region around it is in front of the occluders
+    if (shadowFilter.x != SHADOW_FILTER_HARD)
+    {
+        float4 moments = momentMap.Sample(momentSampler, ShadowAtlasCoord(projTex, tileRect, momentMap));
+        float visibility = ShadowMomentVisibility(moments, LinearizeDepth(viewPos.z / viewPos.w, 0.1f, 200.0f) / 200, shadowFilter, exponents);
+        colour = calculateDirectionalLighting(lightVector, normal, diffuse, ambient);
+        colour.xyz *= intensity;
+        return lerp(float4(0, 0, 0, 1), colour, visibility);
+    }
+    
     // Sample Shadow Map (get depth of geometry) using LinearizeDepth to get an appropriate depth value
-    float currentDepthValue = LinearizeDepth(currentDepthMap.Sample(shadowSampler, projTex).x, 0.1f, 200.0f) / 200;
+    float currentDepthValue = LinearizeDepth(currentDepthMap.Sample(shadowSampler, ShadowAtlasCoord(projTex, tileRect, currentDepthMap)).x, 0.1f, 200.0f) / 200;
     
     // Calculates the depth value from the light's view, and linearizes it to return an appropriate value
     float lightDepthValue = viewPos.z / viewPos.w;
@@ -152,11 +190,70 @@ float4 spotlightShadowCalculation(float3 lightPosition, float3 lightDirection, f
         colour.z *= intensity;
     }
     
-    // If the intensity is less than or equal to 0, returns empty colour
-    if (intensity <= 0.0f)
+    return colour;
+}
+
+// Picks the cube face a direction from the point light falls in, from its largest axis, in the order +X, -X, +Y, -Y, +Z, -Z
+int PointShadowFace(float3 direction)
+{
+    float3 size = abs(direction);
+    if (size.x >= size.y && size.x >= size.z)
     {
-        return float4(0, 0, 0, 1);
+        return direction.x >= 0 ? 0 : 1;
     }
+    if (size.y >= size.z)
+    {
+        return direction.y >= 0 ? 2 : 3;
+    }
+    return direction.z >= 0 ? 4 : 5;
+}
+
+// Calculates point lighting as calculatePointLighting does, shadowed by the face of the light's cube shadow map the pixel falls in
+// faceViewProjection and tileRect are that face's, and its depths are linearized the same way as the spot light's
+float4 pointlightShadowCalculation(float3 lightPosition, float3 worldPosition, float3 cameraPosition, float3 normal, float4 diffuse, float4 ambient, float dropoff, float specInt, float specExp, float4x4 faceViewProjection, Texture2D currentDepthMap, Texture2D momentMap, float4 tileRect, float bias, SamplerState shadowSampler, SamplerState momentSampler, float4 shadowFilter, float2 exponents)
+{
+    float4 colour = calculatePointLighting(lightPosition, worldPosition, cameraPosition, normal, diffuse, ambient, dropoff, specInt, specExp);
     
-    return colour;
-}
\ No newline at end of file
+    // Set up the projected tex coords from this face's view, which always contains the pixel
+    float4 viewPos = mul(float4(worldPosition, 1.0f), faceViewProjection);
+    float2 projTex = viewPos.xy / viewPos.w;
+    projTex *= float2(0.5, -0.5);
+    projTex += float2(0.5f, 0.5f);
+    float lightDepthValue = LinearizeDepth(viewPos.z / viewPos.w, 0.1f, 200.0f) / 200;
+    
+    // Lights the pixel by how much of the filtered region around it is in front of the occluders
+    if (shadowFilter.x != SHADOW_FILTER_HARD)
+    {
+        float4 moments = momentMap.Sample(momentSampler, ShadowAtlasCoord(projTex, tileRect, momentMap));
+        return lerp(float4(0, 0, 0, 1), colour, ShadowMomentVisibility(moments, lightDepthValue, shadowFilter, exponents));
+    }
+    
+    // Sample Shadow Map (get depth of geometry) using LinearizeDepth to get an appropriate depth value, and only lights the pixel if it's in front
+    float currentDepthValue = LinearizeDepth(currentDepthMap.Sample(shadowSampler, ShadowAtlasCoord(projTex, tileRect, currentDepthMap)).x, 0.1f, 200.0f) / 200;
+    if (lightDepthValue - bias < currentDepthValue)
+    {
+        return colour;
+    }
+    
+    return float4(0, 0, 0, 1);
+}
+
+// Fraction of a light in direction toLight that clears the terrain's horizon at uv, from a horizon map holding the sine of the horizon's
+// elevation in eight directions around each texel, the first four in slice 0 and the rest in slice 1. Softness blurs the edge of the shadow
+float HorizonVisibility(Texture2DArray horizonMap, SamplerState horizonSampler, float2 uv, float3 toLight, float softness)
+{
+    toLight = normalize(toLight);
+    
+    // Finds the two stored directions either side of the light's, which start along +X and turn towards +Z
+    float slot = frac(atan2(toLight.z, toLight.x) / 6.28318530718f) * 8.0f;
+    int first = (int)floor(slot) % 8;
+    int second = (first + 1) % 8;
+    
+    float4 lower = horizonMap.SampleLevel(horizonSampler, float3(uv, 0), 0);
+    float4 upper = horizonMap.SampleLevel(horizonSampler, float3(uv, 1), 0);
+    float horizons[8] = { lower.x, lower.y, lower.z, lower.w, upper.x, upper.y, upper.z, upper.w };
+    float horizon = lerp(horizons[first], horizons[second], slot - floor(slot));
+    
+    // The light's height in its normalized direction is the sine of its elevation
+    return smoothstep(horizon - softness, horizon + softness, toLight.y);
+}
@@ -0,0 +1,116 @@
+// Moment shadow maps, matching ShadowMoments on the CPU. Each texel stores moments of the depths it covers instead of a single depth,
+// so the map can be blurred and mip mapped, and a receiver's visibility is bounded from the filtered moments
+
+#define SHADOW_FILTER_HARD 0
+#define SHADOW_FILTER_VSM 1
+#define SHADOW_FILTER_EVSM 2
+#define SHADOW_FILTER_MSM 3
+
+// Turns a depth from 0 to 1 into the moments stored for it, exponents being EVSM's positive and negative warps
+float4 EncodeShadowMoments(float depth, float mode, float2 exponents)
+{
+    if (mode == SHADOW_FILTER_VSM)
+    {
+        return float4(depth, depth * depth, 0, 0);
+    }
+    if (mode == SHADOW_FILTER_EVSM)
+    {
+        // Warps the depth (moved to -1 to 1) through a positive and a negative exponential, each stored with its square
+        float warpedDepth = depth * 2.0f - 1.0f;
+        float positive = exp(exponents.x * warpedDepth);
+        float negative = -exp(-exponents.y * warpedDepth);
+        return float4(positive, positive * positive, negative, negative * negative);
+    }
+    if (mode == SHADOW_FILTER_MSM)
+    {
+        float squared = depth * depth;
+        return float4(depth, squared, squared * depth, squared * squared);
+    }
+    return float4(depth, 0, 0, 0);
+}
+
+// In front of the average occluder is fully lit, behind it the variance bounds how much of the filter region can be in front
+float ChebyshevUpperBound(float2 moments, float depth, float minVariance)
+{
+    if (depth <= moments.x)
+    {
+        return 1.0f;
+    }
+    float variance = max(moments.y - moments.x * moments.x, minVariance);
+    float difference = depth - moments.x;
+    return variance / (variance + difference * difference);
+}
+
+// Cuts off the low end of the visibility bound, hiding light bleeding where occluders overlap
+float ReduceLightBleeding(float visibility, float amount)
+{
+    return amount > 0 ? saturate((visibility - amount) / (1.0f - amount)) : visibility;
+}
+
+// Bounds the visibility from four moments, following Peters and Klein, "Moment Shadow Mapping" (2015)
+float Hamburger4Moments(float4 moments, float depth, float momentBias)
+{
+    // Pulls the moments slightly towards those of a uniform distribution, so the Hankel matrix below can always be inverted
+    float4 b = lerp(moments, float4(0.5f, 0.5f, 0.5f, 0.5f), momentBias);
+
+    // Cholesky factorisation of the Hankel matrix, keeping only the entries that aren't trivial
+    float L32D22 = -b.x * b.y + b.z;
+    float D22 = max(-b.x * b.x + b.y, 1e-12f);
+    float squaredDepthVariance = -b.y * b.y + b.w;
+    float D33D22 = squaredDepthVariance * D22 - L32D22 * L32D22;
+    float inverseD22 = 1.0f / D22;
+    float L32 = L32D22 * inverseD22;
+
+    // Solves for the polynomial whose roots, along with the receiver's depth, support the distribution of depths that shadows it the most
+    float3 c = float3(1.0f, depth, depth * depth);
+    c.y -= b.x;
+    c.z -= b.y + L32 * c.y;
+    c.y *= inverseD22;
+    c.z *= D22 / (abs(D33D22) > 1e-20f ? D33D22 : 1e-20f);
+    c.y -= L32 * c.z;
+    c.x -= dot(c.yz, b.xy);
+
+    // Finds the other two support points from the quadratic c.x + c.y * z + c.z * z^2
+    float p = c.y / c.z;
+    float q = c.x / c.z;
+    float root = sqrt(max(p * p * 0.25f - q, 0.0f));
+    float z1 = -p * 0.5f - root;
+    float z2 = -p * 0.5f + root;
+
+    // With no support point in front of the receiver it is fully lit, otherwise sums the weights of those that are
+    if (z1 >= depth)
+    {
+        return 1.0f;
+    }
+    float3 switchValue = (z2 < depth) ? float3(z1, depth, 1.0f) : float3(depth, z1, 0.0f);
+    float quotient = (switchValue.x * z2 - b.x * (switchValue.x + z2) + b.y) / ((z2 - switchValue.y) * (depth - z1));
+    return 1.0f - saturate(switchValue.z + quotient);
+}
+
+// Returns how lit a receiver at depth is from 0 to 1, given the filtered moments around it
+// filter holds the mode, light bleed reduction, moment bias and depth bias, exponents the EVSM warps
+float ShadowMomentVisibility(float4 moments, float depth, float4 filter, float2 exponents)
+{
+    depth -= filter.w;
+
+    if (filter.x == SHADOW_FILTER_VSM)
+    {
+        return ReduceLightBleeding(ChebyshevUpperBound(moments.xy, depth, filter.z), filter.y);
+    }
+    if (filter.x == SHADOW_FILTER_EVSM)
+    {
+        // Each warp gives an upper bound, and the tighter of the two is kept. The minimum variance is scaled by how much each warp stretches depth here
+        float warpedDepth = depth * 2.0f - 1.0f;
+        float positive = exp(exponents.x * warpedDepth);
+        float negative = -exp(-exponents.y * warpedDepth);
+        float positiveVariance = filter.z * (exponents.x * positive) * (exponents.x * positive);
+        float negativeVariance = filter.z * (exponents.y * negative) * (exponents.y * negative);
+        float visibility = min(ChebyshevUpperBound(moments.xy, positive, positiveVariance), ChebyshevUpperBound(moments.zw, negative, negativeVariance));
+        return ReduceLightBleeding(visibility, filter.y);
+    }
+    if (filter.x == SHADOW_FILTER_MSM)
+    {
+        return ReduceLightBleeding(Hamburger4Moments(moments, depth, filter.z), filter.y);
+    }
+    return depth < moments.x ? 1.0f : 0.0f;
+}
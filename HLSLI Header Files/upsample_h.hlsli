@@ -0,0 +1,55 @@
+// Sampling for render targets only partly drawn to at a lower resolution than the screen
+// uvScale is the fraction of the texture holding the image, and every tap is kept inside it so the unrendered texels around it never bleed in
+
+// Keeps a coordinate at least half a texel inside the rendered region
+float2 ClampToRegion(float2 uv, float2 uvScale, float2 texelSize)
+{
+    return clamp(uv, texelSize * 0.5f, uvScale - texelSize * 0.5f);
+}
+
+// Bilinear sample of the rendered region, uv covering the region from 0 to 1
+float4 SampleRegionBilinear(Texture2D tex, SamplerState linearSampler, float2 uv, float2 uvScale)
+{
+    float2 textureSize;
+    tex.GetDimensions(textureSize.x, textureSize.y);
+    return tex.SampleLevel(linearSampler, ClampToRegion(uv * uvScale, uvScale, 1.0f / textureSize), 0);
+}
+
+// Catmull-Rom bicubic sample of the rendered region, which stays sharper than bilinear when upscaling
+// The 4x4 footprint is taken in 9 bilinear taps by merging the two middle weights on each axis into one tap between them
+float4 SampleRegionCatmullRom(Texture2D tex, SamplerState linearSampler, float2 uv, float2 uvScale)
+{
+    float2 textureSize;
+    tex.GetDimensions(textureSize.x, textureSize.y);
+    float2 texelSize = 1.0f / textureSize;
+
+    // Finds the texel centre below and to the left of the sample, and how far past it the sample is
+    float2 samplePosition = uv * uvScale * textureSize;
+    float2 centre1 = floor(samplePosition - 0.5f) + 0.5f;
+    float2 f = samplePosition - centre1;
+
+    // Catmull-Rom weights of the four texels on each axis
+    float2 w0 = f * (-0.5f + f * (1.0f - 0.5f * f));
+    float2 w1 = 1.0f + f * f * (-2.5f + 1.5f * f);
+    float2 w2 = f * (0.5f + f * (2.0f - 1.5f * f));
+    float2 w3 = f * f * (-0.5f + 0.5f * f);
+    float2 w12 = w1 + w2;
+
+    float2 uv0 = ClampToRegion((centre1 - 1.0f) * texelSize, uvScale, texelSize);
+    float2 uv12 = ClampToRegion((centre1 + w2 / w12) * texelSize, uvScale, texelSize);
+    float2 uv3 = ClampToRegion((centre1 + 2.0f) * texelSize, uvScale, texelSize);
+
+    float4 colour = 0.0f;
+    colour += tex.SampleLevel(linearSampler, float2(uv0.x, uv0.y), 0) * w0.x * w0.y;
+    colour += tex.SampleLevel(linearSampler, float2(uv12.x, uv0.y), 0) * w12.x * w0.y;
+    colour += tex.SampleLevel(linearSampler, float2(uv3.x, uv0.y), 0) * w3.x * w0.y;
+    colour += tex.SampleLevel(linearSampler, float2(uv0.x, uv12.y), 0) * w0.x * w12.y;
+    colour += tex.SampleLevel(linearSampler, float2(uv12.x, uv12.y), 0) * w12.x * w12.y;
+    colour += tex.SampleLevel(linearSampler, float2(uv3.x, uv12.y), 0) * w3.x * w12.y;
+    colour += tex.SampleLevel(linearSampler, float2(uv0.x, uv3.y), 0) * w0.x * w3.y;
+    colour += tex.SampleLevel(linearSampler, float2(uv12.x, uv3.y), 0) * w12.x * w3.y;
+    colour += tex.SampleLevel(linearSampler, float2(uv3.x, uv3.y), 0) * w3.x * w3.y;
+
+    // The negative lobes can overshoot, which would show as dark or bright rings around hard edges
+    return max(colour, 0.0f);
+}
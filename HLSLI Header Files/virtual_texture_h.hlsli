@@ -0,0 +1,66 @@
+// Virtual texture sampling, translating a virtual texture coordinate into the physical page cache through the page table
+// The page table stores the cache slot in .xy and the mip actually resident in .z, which may be coarser than the mip requested
+
+// Samples the height at the given mip, falling back to whichever coarser mip is resident
+float SampleVirtualHeight(float2 uv, float mip, Texture2D<uint4> pageTable, Texture2D physicalTexture, SamplerState sampler0, float2 pagesMip0, float pageSize, float border, float2 physicalSize, float maxMip)
+{
+    // Wraps the coordinates, to match the heightmap's sampler
+    uv = frac(uv);
+
+    // Finds the page covering this coordinate at the requested mip, and looks up where it actually lives
+    int requestedMip = (int)clamp(floor(mip), 0, maxMip);
+    float2 pages = max(pagesMip0 / exp2(requestedMip), 1.0f);
+    int2 page = min((int2)(uv * pages), (int2)pages - 1);
+    uint4 entry = pageTable.Load(int3(page, requestedMip));
+
+    // Determines the position within the resident page, then offsets it into that page's slot in the cache (skipping the border)
+    float2 residentPages = max(pagesMip0 / exp2(entry.z), 1.0f);
+    float2 inPage = uv * residentPages - min(floor(uv * residentPages), residentPages - 1);
+    float2 texel = entry.xy * (pageSize + border * 2) + border + inPage * pageSize;
+
+    return physicalTexture.SampleLevel(sampler0, texel / physicalSize, 0).x;
+}
+
+// Determines the mip a pixel needs, based on how quickly the virtual texel coordinate changes across the screen
+float VirtualTextureMip(float2 uv, float virtualSize, float bias)
+{
+    float2 dx = ddx(uv * virtualSize);
+    float2 dy = ddy(uv * virtualSize);
+    float maxDelta = max(dot(dx, dx), dot(dy, dy));
+    return max(0.5f * log2(max(maxDelta, 1e-8f)) + bias, 0);
+}
+
+// Packs the page a pixel needs as mip (4 bits), y (14 bits) and x (14 bits), plus one so a cleared texel means no request
+uint EncodeVirtualPage(float2 uv, float mip, float2 pagesMip0, float maxMip)
+{
+    uv = frac(uv);
+    uint requestedMip = (uint)clamp(floor(mip), 0, maxMip);
+    float2 pages = max(pagesMip0 / exp2(requestedMip), 1.0f);
+    uint2 page = min((uint2)(uv * pages), (uint2)pages - 1);
+    return ((requestedMip << 28) | (page.y << 14) | page.x) + 1;
+}
+
+// Calculates the normal from the virtual heightmap, crossing the tangents to the four neighbouring samples in the same way as CalculateVertexNormal
+float3 CalculateVirtualNormal(float u, float v, float meshSize, float heightMultiplier, float mip, Texture2D<uint4> pageTable, Texture2D physicalTexture, SamplerState sampler0, float2 pagesMip0, float pageSize, float border, float2 physicalSize, float maxMip)
+{
+    float uvInterval = 1 / meshSize;
+    float length = uvInterval * 100;
+
+    // Determines the height of the origin, and the samples to the Left, Right, Up and Down of it
+    float3 origin = float3(0, SampleVirtualHeight(float2(u, v), mip, pageTable, physicalTexture, sampler0, pagesMip0, pageSize, border, physicalSize, maxMip) * heightMultiplier, 0);
+    float eastH = SampleVirtualHeight(float2(u + uvInterval, v), mip, pageTable, physicalTexture, sampler0, pagesMip0, pageSize, border, physicalSize, maxMip) * heightMultiplier;
+    float westH = SampleVirtualHeight(float2(u - uvInterval, v), mip, pageTable, physicalTexture, sampler0, pagesMip0, pageSize, border, physicalSize, maxMip) * heightMultiplier;
+    float northH = SampleVirtualHeight(float2(u, v + uvInterval), mip, pageTable, physicalTexture, sampler0, pagesMip0, pageSize, border, physicalSize, maxMip) * heightMultiplier;
+    float southH = SampleVirtualHeight(float2(u, v - uvInterval), mip, pageTable, physicalTexture, sampler0, pagesMip0, pageSize, border, physicalSize, maxMip) * heightMultiplier;
+
+    // Subtracts the origin from the other samples to generate the tangents
+    float3 eastTangent = float3(length, eastH, 0) - origin;
+    float3 westTangent = float3(-length, westH, 0) - origin;
+    float3 northTangent = float3(0, northH, length) - origin;
+    float3 southTangent = float3(0, southH, -length) - origin;
+
+    // Crosses the four tangents and averages them
+    float3 Result = cross(northTangent, eastTangent) + cross(eastTangent, southTangent) + cross(southTangent, westTangent) + cross(westTangent, northTangent);
+
+    return normalize(Result / 4);
+}
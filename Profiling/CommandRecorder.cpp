@@ -0,0 +1,1049 @@
+#include "CommandRecorder.h"
+#include "MemoryTracker.h"
+#include <algorithm>
+#include <cstring>
+
+CommandRecorder::CommandRecorder(ID3D11DeviceContext* ldeviceContext)
+{
+	deviceContext = ldeviceContext;
+	trace = NULL;
+	outputKnown = false;
+	references = 1;
+	ZeroMemory(&output, sizeof(output));
+}
+
+CommandRecorder::~CommandRecorder()
+{
+	// The context belongs to the renderer, and the trace to whoever handed it over
+	end();
+}
+
+void CommandRecorder::begin(CommandTrace* ltrace)
+{
+	trace = ltrace;
+	trace->clear();
+	written.clear();
+	recordInitialState();
+
+	// Output state is written in full before the first draw, as nothing about it is known yet
+	outputKnown = false;
+}
+
+void CommandRecorder::endFrame()
+{
+	if (trace)
+	{
+		trace->endFrame();
+	}
+}
+
+void CommandRecorder::end()
+{
+	trace = NULL;
+	written.clear();
+}
+
+void CommandRecorder::beginPass(const char* name)
+{
+	if (trace)
+	{
+		trace->beginCommand(COMMAND_BEGIN_PASS);
+		trace->writeString(name);
+	}
+}
+
+HRESULT CommandRecorder::QueryInterface(REFIID riid, void** object)
+{
+	// Anything newer than the base context would be the real one, and calls made through it would be missed
+	if (riid == __uuidof(IUnknown) || riid == __uuidof(ID3D11DeviceChild) || riid == __uuidof(ID3D11DeviceContext))
+	{
+		*object = static_cast<ID3D11DeviceContext*>(this);
+		AddRef();
+		return S_OK;
+	}
+	*object = NULL;
+	return E_NOINTERFACE;
+}
+
+void CommandRecorder::recordShader(CommandStage stage, ID3D11DeviceChild* shader)
+{
+	trace->beginCommand(COMMAND_SET_SHADER);
+	trace->writeUInt(stage);
+	trace->writeObject(shader);
+}
+
+void CommandRecorder::recordList(CommandOp op, CommandStage stage, UINT startSlot, UINT count, ID3D11DeviceChild* const* items)
+{
+	trace->beginCommand(op);
+	trace->writeUInt(stage);
+	trace->writeUInt(startSlot);
+	trace->writeUInt(count);
+	trace->writeObjects(items, count);
+}
+
+void CommandRecorder::recordUnorderedAccessViews(CommandOp op, UINT startSlot, UINT count, ID3D11UnorderedAccessView* const* views, const UINT* initialCounts)
+{
+	trace->beginCommand(op);
+	trace->writeUInt(startSlot);
+	trace->writeUInt(count);
+	trace->writeObjects((ID3D11DeviceChild* const*)views, count);
+	trace->writeUInt(initialCounts ? 1 : 0);
+	for (UINT i = 0; initialCounts && i < count; i++)
+	{
+		trace->writeUInt(initialCounts[i]);
+	}
+}
+
+void CommandRecorder::VSSetConstantBuffers(UINT startSlot, UINT count, ID3D11Buffer* const* buffers)
+{
+	deviceContext->VSSetConstantBuffers(startSlot, count, buffers);
+	if (trace)
+	{
+		recordList(COMMAND_SET_CONSTANT_BUFFERS, COMMAND_STAGE_VERTEX, startSlot, count, (ID3D11DeviceChild* const*)buffers);
+	}
+}
+
+void CommandRecorder::HSSetConstantBuffers(UINT startSlot, UINT count, ID3D11Buffer* const* buffers)
+{
+	deviceContext->HSSetConstantBuffers(startSlot, count, buffers);
+	if (trace)
+	{
+		recordList(COMMAND_SET_CONSTANT_BUFFERS, COMMAND_STAGE_HULL, startSlot, count, (ID3D11DeviceChild* const*)buffers);
+	}
+}
+
+void CommandRecorder::DSSetConstantBuffers(UINT startSlot, UINT count, ID3D11Buffer* const* buffers)
+{
+	deviceContext->DSSetConstantBuffers(startSlot, count, buffers);
+	if (trace)
+	{
+		recordList(COMMAND_SET_CONSTANT_BUFFERS, COMMAND_STAGE_DOMAIN, startSlot, count, (ID3D11DeviceChild* const*)buffers);
+	}
+}
+
+void CommandRecorder::GSSetConstantBuffers(UINT startSlot, UINT count, ID3D11Buffer* const* buffers)
+{
+	deviceContext->GSSetConstantBuffers(startSlot, count, buffers);
+	if (trace)
+	{
+		recordList(COMMAND_SET_CONSTANT_BUFFERS, COMMAND_STAGE_GEOMETRY, startSlot, count, (ID3D11DeviceChild* const*)buffers);
+	}
+}
+
+void CommandRecorder::PSSetConstantBuffers(UINT startSlot, UINT count, ID3D11Buffer* const* buffers)
+{
+	deviceContext->PSSetConstantBuffers(startSlot, count, buffers);
+	if (trace)
+	{
+		recordList(COMMAND_SET_CONSTANT_BUFFERS, COMMAND_STAGE_PIXEL, startSlot, count, (ID3D11DeviceChild* const*)buffers);
+	}
+}
+
+void CommandRecorder::CSSetConstantBuffers(UINT startSlot, UINT count, ID3D11Buffer* const* buffers)
+{
+	deviceContext->CSSetConstantBuffers(startSlot, count, buffers);
+	if (trace)
+	{
+		recordList(COMMAND_SET_CONSTANT_BUFFERS, COMMAND_STAGE_COMPUTE, startSlot, count, (ID3D11DeviceChild* const*)buffers);
+	}
+}
+
+void CommandRecorder::VSSetShaderResources(UINT startSlot, UINT count, ID3D11ShaderResourceView* const* views)
+{
+	deviceContext->VSSetShaderResources(startSlot, count, views);
+	if (trace)
+	{
+		recordList(COMMAND_SET_SHADER_RESOURCES, COMMAND_STAGE_VERTEX, startSlot, count, (ID3D11DeviceChild* const*)views);
+	}
+}
+
+void CommandRecorder::HSSetShaderResources(UINT startSlot, UINT count, ID3D11ShaderResourceView* const* views)
+{
+	deviceContext->HSSetShaderResources(startSlot, count, views);
+	if (trace)
+	{
+		recordList(COMMAND_SET_SHADER_RESOURCES, COMMAND_STAGE_HULL, startSlot, count, (ID3D11DeviceChild* const*)views);
+	}
+}
+
+void CommandRecorder::DSSetShaderResources(UINT startSlot, UINT count, ID3D11ShaderResourceView* const* views)
+{
+	deviceContext->DSSetShaderResources(startSlot, count, views);
+	if (trace)
+	{
+		recordList(COMMAND_SET_SHADER_RESOURCES, COMMAND_STAGE_DOMAIN, startSlot, count, (ID3D11DeviceChild* const*)views);
+	}
+}
+
+void CommandRecorder::GSSetShaderResources(UINT startSlot, UINT count, ID3D11ShaderResourceView* const* views)
+{
+	deviceContext->GSSetShaderResources(startSlot, count, views);
+	if (trace)
+	{
+		recordList(COMMAND_SET_SHADER_RESOURCES, COMMAND_STAGE_GEOMETRY, startSlot, count, (ID3D11DeviceChild* const*)views);
+	}
+}
+
+void CommandRecorder::PSSetShaderResources(UINT startSlot, UINT count, ID3D11ShaderResourceView* const* views)
+{
+	deviceContext->PSSetShaderResources(startSlot, count, views);
+	if (trace)
+	{
+		recordList(COMMAND_SET_SHADER_RESOURCES, COMMAND_STAGE_PIXEL, startSlot, count, (ID3D11DeviceChild* const*)views);
+	}
+}
+
+void CommandRecorder::CSSetShaderResources(UINT startSlot, UINT count, ID3D11ShaderResourceView* const* views)
+{
+	deviceContext->CSSetShaderResources(startSlot, count, views);
+	if (trace)
+	{
+		recordList(COMMAND_SET_SHADER_RESOURCES, COMMAND_STAGE_COMPUTE, startSlot, count, (ID3D11DeviceChild* const*)views);
+	}
+}
+
+void CommandRecorder::VSSetSamplers(UINT startSlot, UINT count, ID3D11SamplerState* const* samplers)
+{
+	deviceContext->VSSetSamplers(startSlot, count, samplers);
+	if (trace)
+	{
+		recordList(COMMAND_SET_SAMPLERS, COMMAND_STAGE_VERTEX, startSlot, count, (ID3D11DeviceChild* const*)samplers);
+	}
+}
+
+void CommandRecorder::HSSetSamplers(UINT startSlot, UINT count, ID3D11SamplerState* const* samplers)
+{
+	deviceContext->HSSetSamplers(startSlot, count, samplers);
+	if (trace)
+	{
+		recordList(COMMAND_SET_SAMPLERS, COMMAND_STAGE_HULL, startSlot, count, (ID3D11DeviceChild* const*)samplers);
+	}
+}
+
+void CommandRecorder::DSSetSamplers(UINT startSlot, UINT count, ID3D11SamplerState* const* samplers)
+{
+	deviceContext->DSSetSamplers(startSlot, count, samplers);
+	if (trace)
+	{
+		recordList(COMMAND_SET_SAMPLERS, COMMAND_STAGE_DOMAIN, startSlot, count, (ID3D11DeviceChild* const*)samplers);
+	}
+}
+
+void CommandRecorder::GSSetSamplers(UINT startSlot, UINT count, ID3D11SamplerState* const* samplers)
+{
+	deviceContext->GSSetSamplers(startSlot, count, samplers);
+	if (trace)
+	{
+		recordList(COMMAND_SET_SAMPLERS, COMMAND_STAGE_GEOMETRY, startSlot, count, (ID3D11DeviceChild* const*)samplers);
+	}
+}
+
+void CommandRecorder::PSSetSamplers(UINT startSlot, UINT count, ID3D11SamplerState* const* samplers)
+{
+	deviceContext->PSSetSamplers(startSlot, count, samplers);
+	if (trace)
+	{
+		recordList(COMMAND_SET_SAMPLERS, COMMAND_STAGE_PIXEL, startSlot, count, (ID3D11DeviceChild* const*)samplers);
+	}
+}
+
+void CommandRecorder::CSSetSamplers(UINT startSlot, UINT count, ID3D11SamplerState* const* samplers)
+{
+	deviceContext->CSSetSamplers(startSlot, count, samplers);
+	if (trace)
+	{
+		recordList(COMMAND_SET_SAMPLERS, COMMAND_STAGE_COMPUTE, startSlot, count, (ID3D11DeviceChild* const*)samplers);
+	}
+}
+
+// Class instances are never used by the shaders here, so only the shader itself is recorded
+void CommandRecorder::VSSetShader(ID3D11VertexShader* shader, ID3D11ClassInstance* const* classInstances, UINT classInstanceCount)
+{
+	deviceContext->VSSetShader(shader, classInstances, classInstanceCount);
+	if (trace)
+	{
+		recordShader(COMMAND_STAGE_VERTEX, shader);
+	}
+}
+
+void CommandRecorder::HSSetShader(ID3D11HullShader* shader, ID3D11ClassInstance* const* classInstances, UINT classInstanceCount)
+{
+	deviceContext->HSSetShader(shader, classInstances, classInstanceCount);
+	if (trace)
+	{
+		recordShader(COMMAND_STAGE_HULL, shader);
+	}
+}
+
+void CommandRecorder::DSSetShader(ID3D11DomainShader* shader, ID3D11ClassInstance* const* classInstances, UINT classInstanceCount)
+{
+	deviceContext->DSSetShader(shader, classInstances, classInstanceCount);
+	if (trace)
+	{
+		recordShader(COMMAND_STAGE_DOMAIN, shader);
+	}
+}
+
+void CommandRecorder::GSSetShader(ID3D11GeometryShader* shader, ID3D11ClassInstance* const* classInstances, UINT classInstanceCount)
+{
+	deviceContext->GSSetShader(shader, classInstances, classInstanceCount);
+	if (trace)
+	{
+		recordShader(COMMAND_STAGE_GEOMETRY, shader);
+	}
+}
+
+void CommandRecorder::PSSetShader(ID3D11PixelShader* shader, ID3D11ClassInstance* const* classInstances, UINT classInstanceCount)
+{
+	deviceContext->PSSetShader(shader, classInstances, classInstanceCount);
+	if (trace)
+	{
+		recordShader(COMMAND_STAGE_PIXEL, shader);
+	}
+}
+
+void CommandRecorder::CSSetShader(ID3D11ComputeShader* shader, ID3D11ClassInstance* const* classInstances, UINT classInstanceCount)
+{
+	deviceContext->CSSetShader(shader, classInstances, classInstanceCount);
+	if (trace)
+	{
+		recordShader(COMMAND_STAGE_COMPUTE, shader);
+	}
+}
+
+void CommandRecorder::CSSetUnorderedAccessViews(UINT startSlot, UINT count, ID3D11UnorderedAccessView* const* views, const UINT* initialCounts)
+{
+	deviceContext->CSSetUnorderedAccessViews(startSlot, count, views, initialCounts);
+	if (trace)
+	{
+		recordUnorderedAccessViews(COMMAND_SET_UNORDERED_ACCESS_VIEWS, startSlot, count, views, initialCounts);
+	}
+}
+
+void CommandRecorder::IASetInputLayout(ID3D11InputLayout* inputLayout)
+{
+	deviceContext->IASetInputLayout(inputLayout);
+	if (trace)
+	{
+		trace->beginCommand(COMMAND_SET_INPUT_LAYOUT);
+		trace->writeObject(inputLayout);
+	}
+}
+
+void CommandRecorder::IASetVertexBuffers(UINT startSlot, UINT count, ID3D11Buffer* const* buffers, const UINT* strides, const UINT* offsets)
+{
+	deviceContext->IASetVertexBuffers(startSlot, count, buffers, strides, offsets);
+	if (trace)
+	{
+		trace->beginCommand(COMMAND_SET_VERTEX_BUFFERS);
+		trace->writeUInt(startSlot);
+		trace->writeUInt(count);
+		for (UINT i = 0; i < count; i++)
+		{
+			trace->writeObject(buffers ? buffers[i] : NULL);
+			trace->writeUInt(strides ? strides[i] : 0);
+			trace->writeUInt(offsets ? offsets[i] : 0);
+		}
+	}
+}
+
+void CommandRecorder::IASetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, UINT offset)
+{
+	deviceContext->IASetIndexBuffer(buffer, format, offset);
+	if (trace)
+	{
+		trace->beginCommand(COMMAND_SET_INDEX_BUFFER);
+		trace->writeObject(buffer);
+		trace->writeUInt(format);
+		trace->writeUInt(offset);
+	}
+}
+
+void CommandRecorder::IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology)
+{
+	deviceContext->IASetPrimitiveTopology(topology);
+	if (trace)
+	{
+		trace->beginCommand(COMMAND_SET_TOPOLOGY);
+		trace->writeUInt(topology);
+	}
+}
+
+void CommandRecorder::OMSetRenderTargetsAndUnorderedAccessViews(UINT targetCount, ID3D11RenderTargetView* const* targets, ID3D11DepthStencilView* depthStencil,
+	UINT uavStartSlot, UINT uavCount, ID3D11UnorderedAccessView* const* uavs, const UINT* initialCounts)
+{
+	deviceContext->OMSetRenderTargetsAndUnorderedAccessViews(targetCount, targets, depthStencil, uavStartSlot, uavCount, uavs, initialCounts);
+	if (!trace)
+	{
+		return;
+	}
+
+	// Setting the targets alone unbinds the views, so the targets are written first and the views after, as they were set
+	if (targetCount != D3D11_KEEP_RENDER_TARGETS_AND_DEPTH_STENCIL)
+	{
+		recordOutputState();
+	}
+	if (uavCount != D3D11_KEEP_UNORDERED_ACCESS_VIEWS)
+	{
+		recordUnorderedAccessViews(COMMAND_SET_OUTPUT_UNORDERED_ACCESS_VIEWS, uavStartSlot, uavCount, uavs, initialCounts);
+	}
+}
+
+HRESULT CommandRecorder::Map(ID3D11Resource* resource, UINT subresource, D3D11_MAP mapType, UINT mapFlags, D3D11_MAPPED_SUBRESOURCE* mapped)
+{
+	HRESULT result = deviceContext->Map(resource, subresource, mapType, mapFlags, mapped);
+
+	// Reads back are the application's business and aren't recorded. Anything written goes into a shadow copy instead, as memory mapped
+	// for writing is usually write combined, too slow to read back what was written from, and holds nothing worth reading after a discard
+	if (!trace || result != S_OK || !mapped || mapType == D3D11_MAP_READ)
+	{
+		return result;
+	}
+
+	UINT rowBytes, rows, depth;
+	CommandTrace::getSubresourceSize(resource, subresource, NULL, rowBytes, rows, depth);
+	PendingMap pending;
+	pending.resource = resource;
+	pending.subresource = subresource;
+	pending.mapType = mapType;
+	pending.mapped = *mapped;
+	pending.shadow.assign(max(max((size_t)rows * mapped->RowPitch, (size_t)depth * mapped->DepthPitch), (size_t)rowBytes), 0);
+
+	// A read-write map is of a resource the CPU can read, so starts from what's there. Anything else starts from what was last written
+	// through the recorder, which is all a map that doesn't discard can count on being there
+	auto last = written.find(make_pair(resource, subresource));
+	for (UINT slice = 0; slice < depth; slice++)
+	{
+		for (UINT row = 0; row < rows; row++)
+		{
+			size_t offset = (size_t)slice * mapped->DepthPitch + (size_t)row * mapped->RowPitch;
+			size_t packedOffset = ((size_t)slice * rows + row) * rowBytes;
+			if (mapType == D3D11_MAP_READ_WRITE)
+			{
+				memcpy(&pending.shadow[offset], (const uint8_t*)mapped->pData + offset, rowBytes);
+			}
+			else if (mapType != D3D11_MAP_WRITE_DISCARD && last != written.end() && packedOffset + rowBytes <= last->second.size())
+			{
+				memcpy(&pending.shadow[offset], &last->second[packedOffset], rowBytes);
+			}
+		}
+	}
+	mapped->pData = pending.shadow.data();
+	pendingMaps.push_back(move(pending));
+	return result;
+}
+
+void CommandRecorder::Unmap(ID3D11Resource* resource, UINT subresource)
+{
+	// Maps are copied through even once recording has stopped, as the application only ever had the shadow copy to write to
+	for (size_t i = 0; i < pendingMaps.size(); i++)
+	{
+		if (pendingMaps[i].resource != resource || pendingMaps[i].subresource != subresource)
+		{
+			continue;
+		}
+		const PendingMap& pending = pendingMaps[i];
+		UINT rowBytes, rows, depth;
+		CommandTrace::getSubresourceSize(resource, subresource, NULL, rowBytes, rows, depth);
+		size_t totalRows = (size_t)rows * depth;
+
+		// Rows are packed tightly, leaving out whatever padding the driver pitched them with
+		packed.resize(totalRows * rowBytes);
+		for (size_t row = 0; row < totalRows; row++)
+		{
+			size_t offset = (row / rows) * pending.mapped.DepthPitch + (row % rows) * pending.mapped.RowPitch;
+			memcpy(&packed[row * rowBytes], &pending.shadow[offset], rowBytes);
+		}
+
+		// After a discard everything the application relies on was written. Otherwise only the bytes that differ from what was there
+		// before count as written, in whole rows for a texture as the driver may pitch them differently on replay
+		vector<uint8_t>& last = written[make_pair(resource, subresource)];
+		size_t first = 0;
+		size_t end = packed.size();
+		if (pending.mapType != D3D11_MAP_WRITE_DISCARD)
+		{
+			if (last.size() != packed.size())
+			{
+				last.assign(packed.size(), 0);
+			}
+			while (first < end && packed[first] == last[first])
+			{
+				first++;
+			}
+			while (end > first && packed[end - 1] == last[end - 1])
+			{
+				end--;
+			}
+			if (totalRows > 1 && end > first)
+			{
+				first = first / rowBytes * rowBytes;
+				end = (end + rowBytes - 1) / rowBytes * rowBytes;
+			}
+		}
+
+		// Only what was written goes through to the real mapping, as the GPU may still be reading the rest of a no-overwrite map
+		if (totalRows <= 1)
+		{
+			memcpy((uint8_t*)pending.mapped.pData + first, &packed[first], end - first);
+		}
+		else
+		{
+			for (size_t row = first / max(rowBytes, 1u); row < end / max(rowBytes, 1u); row++)
+			{
+				size_t offset = (row / rows) * pending.mapped.DepthPitch + (row % rows) * pending.mapped.RowPitch;
+				memcpy((uint8_t*)pending.mapped.pData + offset, &packed[row * rowBytes], rowBytes);
+			}
+		}
+
+		if (trace && end > first)
+		{
+			trace->beginCommand(COMMAND_UPDATE_MAPPED);
+			trace->writeObject(resource);
+			trace->writeUInt(subresource);
+			trace->writeUInt(pending.mapType);
+			trace->writeUInt(first);
+			trace->writeData(&packed[first], end - first);
+		}
+		last = packed;
+		pendingMaps.erase(pendingMaps.begin() + i);
+		break;
+	}
+
+	deviceContext->Unmap(resource, subresource);
+}
+
+void CommandRecorder::UpdateSubresource(ID3D11Resource* resource, UINT subresource, const D3D11_BOX* box, const void* data, UINT rowPitch, UINT depthPitch)
+{
+	deviceContext->UpdateSubresource(resource, subresource, box, data, rowPitch, depthPitch);
+	if (!trace)
+	{
+		return;
+	}
+
+	UINT rowBytes, rows, depth;
+	CommandTrace::getSubresourceSize(resource, subresource, box, rowBytes, rows, depth);
+	size_t length = 0;
+	if (rows > 0 && depth > 0)
+	{
+		length = (size_t)(depth - 1) * depthPitch + (size_t)(rows - 1) * rowPitch + rowBytes;
+	}
+
+	trace->beginCommand(COMMAND_UPDATE_SUBRESOURCE);
+	trace->writeObject(resource);
+	trace->writeUInt(subresource);
+	trace->writeUInt(box ? 1 : 0);
+	if (box)
+	{
+		trace->writeUInt(box->left);
+		trace->writeUInt(box->top);
+		trace->writeUInt(box->front);
+		trace->writeUInt(box->right);
+		trace->writeUInt(box->bottom);
+		trace->writeUInt(box->back);
+	}
+	trace->writeUInt(rowPitch);
+	trace->writeUInt(depthPitch);
+	trace->writeData(data, length);
+}
+
+void CommandRecorder::CopyResource(ID3D11Resource* destination, ID3D11Resource* source)
+{
+	deviceContext->CopyResource(destination, source);
+	if (trace)
+	{
+		trace->beginCommand(COMMAND_COPY_RESOURCE);
+		trace->writeObject(destination);
+		trace->writeObject(source);
+	}
+}
+
+void CommandRecorder::CopySubresourceRegion(ID3D11Resource* destination, UINT destinationSubresource, UINT x, UINT y, UINT z, ID3D11Resource* source, UINT sourceSubresource, const D3D11_BOX* box)
+{
+	deviceContext->CopySubresourceRegion(destination, destinationSubresource, x, y, z, source, sourceSubresource, box);
+	if (trace)
+	{
+		trace->beginCommand(COMMAND_COPY_SUBRESOURCE_REGION);
+		trace->writeObject(destination);
+		trace->writeUInt(destinationSubresource);
+		trace->writeUInt(x);
+		trace->writeUInt(y);
+		trace->writeUInt(z);
+		trace->writeObject(source);
+		trace->writeUInt(sourceSubresource);
+		trace->writeUInt(box ? 1 : 0);
+		if (box)
+		{
+			trace->writeUInt(box->left);
+			trace->writeUInt(box->top);
+			trace->writeUInt(box->front);
+			trace->writeUInt(box->right);
+			trace->writeUInt(box->bottom);
+			trace->writeUInt(box->back);
+		}
+	}
+}
+
+void CommandRecorder::CopyStructureCount(ID3D11Buffer* destination, UINT offset, ID3D11UnorderedAccessView* source)
+{
+	deviceContext->CopyStructureCount(destination, offset, source);
+	if (trace)
+	{
+		trace->beginCommand(COMMAND_COPY_STRUCTURE_COUNT);
+		trace->writeObject(destination);
+		trace->writeUInt(offset);
+		trace->writeObject(source);
+	}
+}
+
+void CommandRecorder::ResolveSubresource(ID3D11Resource* destination, UINT destinationSubresource, ID3D11Resource* source, UINT sourceSubresource, DXGI_FORMAT format)
+{
+	deviceContext->ResolveSubresource(destination, destinationSubresource, source, sourceSubresource, format);
+	if (trace)
+	{
+		trace->beginCommand(COMMAND_RESOLVE_SUBRESOURCE);
+		trace->writeObject(destination);
+		trace->writeUInt(destinationSubresource);
+		trace->writeObject(source);
+		trace->writeUInt(sourceSubresource);
+		trace->writeUInt(format);
+	}
+}
+
+void CommandRecorder::ClearRenderTargetView(ID3D11RenderTargetView* view, const FLOAT colour[4])
+{
+	deviceContext->ClearRenderTargetView(view, colour);
+	if (trace)
+	{
+		trace->beginCommand(COMMAND_CLEAR_RENDER_TARGET);
+		trace->writeObject(view);
+		for (int i = 0; i < 4; i++)
+		{
+			trace->writeFloat(colour[i]);
+		}
+	}
+}
+
+void CommandRecorder::ClearDepthStencilView(ID3D11DepthStencilView* view, UINT flags, FLOAT depth, UINT8 stencil)
+{
+	deviceContext->ClearDepthStencilView(view, flags, depth, stencil);
+	if (trace)
+	{
+		trace->beginCommand(COMMAND_CLEAR_DEPTH_STENCIL);
+		trace->writeObject(view);
+		trace->writeUInt(flags);
+		trace->writeFloat(depth);
+		trace->writeUInt(stencil);
+	}
+}
+
+void CommandRecorder::ClearUnorderedAccessViewFloat(ID3D11UnorderedAccessView* view, const FLOAT values[4])
+{
+	deviceContext->ClearUnorderedAccessViewFloat(view, values);
+	if (trace)
+	{
+		trace->beginCommand(COMMAND_CLEAR_UNORDERED_ACCESS_FLOAT);
+		trace->writeObject(view);
+		for (int i = 0; i < 4; i++)
+		{
+			trace->writeFloat(values[i]);
+		}
+	}
+}
+
+void CommandRecorder::ClearUnorderedAccessViewUint(ID3D11UnorderedAccessView* view, const UINT values[4])
+{
+	deviceContext->ClearUnorderedAccessViewUint(view, values);
+	if (trace)
+	{
+		trace->beginCommand(COMMAND_CLEAR_UNORDERED_ACCESS_UINT);
+		trace->writeObject(view);
+		for (int i = 0; i < 4; i++)
+		{
+			trace->writeUInt(values[i]);
+		}
+	}
+}
+
+void CommandRecorder::GenerateMips(ID3D11ShaderResourceView* view)
+{
+	deviceContext->GenerateMips(view);
+	if (trace)
+	{
+		trace->beginCommand(COMMAND_GENERATE_MIPS);
+		trace->writeObject(view);
+	}
+}
+
+void CommandRecorder::SetResourceMinLOD(ID3D11Resource* resource, FLOAT minLod)
+{
+	deviceContext->SetResourceMinLOD(resource, minLod);
+	if (trace)
+	{
+		trace->beginCommand(COMMAND_SET_RESOURCE_MIN_LOD);
+		trace->writeObject(resource);
+		trace->writeFloat(minLod);
+	}
+}
+
+void CommandRecorder::Draw(UINT vertexCount, UINT startVertex)
+{
+	deviceContext->Draw(vertexCount, startVertex);
+	if (trace)
+	{
+		recordOutputState();
+		trace->beginCommand(COMMAND_DRAW);
+		trace->writeUInt(vertexCount);
+		trace->writeUInt(startVertex);
+	}
+}
+
+void CommandRecorder::DrawIndexed(UINT indexCount, UINT startIndex, INT baseVertex)
+{
+	deviceContext->DrawIndexed(indexCount, startIndex, baseVertex);
+	if (trace)
+	{
+		recordOutputState();
+		trace->beginCommand(COMMAND_DRAW_INDEXED);
+		trace->writeUInt(indexCount);
+		trace->writeUInt(startIndex);
+		trace->writeInt(baseVertex);
+	}
+}
+
+void CommandRecorder::DrawInstanced(UINT vertexCount, UINT instanceCount, UINT startVertex, UINT startInstance)
+{
+	deviceContext->DrawInstanced(vertexCount, instanceCount, startVertex, startInstance);
+	if (trace)
+	{
+		recordOutputState();
+		trace->beginCommand(COMMAND_DRAW_INSTANCED);
+		trace->writeUInt(vertexCount);
+		trace->writeUInt(instanceCount);
+		trace->writeUInt(startVertex);
+		trace->writeUInt(startInstance);
+	}
+}
+
+void CommandRecorder::DrawIndexedInstanced(UINT indexCount, UINT instanceCount, UINT startIndex, INT baseVertex, UINT startInstance)
+{
+	deviceContext->DrawIndexedInstanced(indexCount, instanceCount, startIndex, baseVertex, startInstance);
+	if (trace)
+	{
+		recordOutputState();
+		trace->beginCommand(COMMAND_DRAW_INDEXED_INSTANCED);
+		trace->writeUInt(indexCount);
+		trace->writeUInt(instanceCount);
+		trace->writeUInt(startIndex);
+		trace->writeInt(baseVertex);
+		trace->writeUInt(startInstance);
+	}
+}
+
+void CommandRecorder::DrawInstancedIndirect(ID3D11Buffer* arguments, UINT offset)
+{
+	deviceContext->DrawInstancedIndirect(arguments, offset);
+	if (trace)
+	{
+		recordOutputState();
+		trace->beginCommand(COMMAND_DRAW_INSTANCED_INDIRECT);
+		trace->writeObject(arguments);
+		trace->writeUInt(offset);
+	}
+}
+
+void CommandRecorder::DrawIndexedInstancedIndirect(ID3D11Buffer* arguments, UINT offset)
+{
+	deviceContext->DrawIndexedInstancedIndirect(arguments, offset);
+	if (trace)
+	{
+		recordOutputState();
+		trace->beginCommand(COMMAND_DRAW_INDEXED_INSTANCED_INDIRECT);
+		trace->writeObject(arguments);
+		trace->writeUInt(offset);
+	}
+}
+
+void CommandRecorder::Dispatch(UINT x, UINT y, UINT z)
+{
+	deviceContext->Dispatch(x, y, z);
+	if (trace)
+	{
+		trace->beginCommand(COMMAND_DISPATCH);
+		trace->writeUInt(x);
+		trace->writeUInt(y);
+		trace->writeUInt(z);
+	}
+}
+
+void CommandRecorder::DispatchIndirect(ID3D11Buffer* arguments, UINT offset)
+{
+	deviceContext->DispatchIndirect(arguments, offset);
+	if (trace)
+	{
+		trace->beginCommand(COMMAND_DISPATCH_INDIRECT);
+		trace->writeObject(arguments);
+		trace->writeUInt(offset);
+	}
+}
+
+void CommandRecorder::recordOutputState()
+{
+	OutputState current;
+	ZeroMemory(&current, sizeof(current));
+
+	// Objects read back come with a reference each, which the trace takes its own of before they're let go
+	ID3D11RenderTargetView* targets[D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT];
+	ID3D11DepthStencilView* depthStencil = NULL;
+	deviceContext->OMGetRenderTargets(D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT, targets, &depthStencil);
+	for (UINT i = 0; i < D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT; i++)
+	{
+		current.targets[i] = trace->getObjectId(targets[i]);
+		if (targets[i])
+		{
+			current.targetCount = i + 1;
+			targets[i]->Release();
+		}
+	}
+	current.depthStencil = trace->getObjectId(depthStencil);
+	if (depthStencil)
+	{
+		depthStencil->Release();
+	}
+
+	// Asking with no array gives how many are bound
+	deviceContext->RSGetViewports(&current.viewportCount, NULL);
+	current.viewportCount = min(current.viewportCount, (UINT)D3D11_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE);
+	deviceContext->RSGetViewports(&current.viewportCount, current.viewports);
+	deviceContext->RSGetScissorRects(&current.scissorCount, NULL);
+	current.scissorCount = min(current.scissorCount, (UINT)D3D11_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE);
+	deviceContext->RSGetScissorRects(&current.scissorCount, current.scissors);
+
+	ID3D11BlendState* blendState = NULL;
+	deviceContext->OMGetBlendState(&blendState, current.blendFactor, &current.sampleMask);
+	current.blendState = trace->getObjectId(blendState);
+	if (blendState)
+	{
+		blendState->Release();
+	}
+	ID3D11DepthStencilState* depthStencilState = NULL;
+	deviceContext->OMGetDepthStencilState(&depthStencilState, &current.stencilRef);
+	current.depthStencilState = trace->getObjectId(depthStencilState);
+	if (depthStencilState)
+	{
+		depthStencilState->Release();
+	}
+	ID3D11RasterizerState* rasterizerState = NULL;
+	deviceContext->RSGetState(&rasterizerState);
+	current.rasterizerState = trace->getObjectId(rasterizerState);
+	if (rasterizerState)
+	{
+		rasterizerState->Release();
+	}
+
+	// Only what changed since the last draw is written
+	if (!outputKnown || current.targetCount != output.targetCount || current.depthStencil != output.depthStencil || memcmp(current.targets, output.targets, sizeof(current.targets)) != 0)
+	{
+		trace->beginCommand(COMMAND_SET_TARGETS);
+		trace->writeUInt(current.targetCount);
+		for (UINT i = 0; i < current.targetCount; i++)
+		{
+			trace->writeUInt(current.targets[i]);
+		}
+		trace->writeUInt(current.depthStencil);
+	}
+	if (!outputKnown || current.viewportCount != output.viewportCount || memcmp(current.viewports, output.viewports, sizeof(D3D11_VIEWPORT) * current.viewportCount) != 0)
+	{
+		trace->beginCommand(COMMAND_SET_VIEWPORTS);
+		trace->writeUInt(current.viewportCount);
+		for (UINT i = 0; i < current.viewportCount; i++)
+		{
+			trace->writeFloat(current.viewports[i].TopLeftX);
+			trace->writeFloat(current.viewports[i].TopLeftY);
+			trace->writeFloat(current.viewports[i].Width);
+			trace->writeFloat(current.viewports[i].Height);
+			trace->writeFloat(current.viewports[i].MinDepth);
+			trace->writeFloat(current.viewports[i].MaxDepth);
+		}
+	}
+	if (!outputKnown || current.scissorCount != output.scissorCount || memcmp(current.scissors, output.scissors, sizeof(D3D11_RECT) * current.scissorCount) != 0)
+	{
+		trace->beginCommand(COMMAND_SET_SCISSORS);
+		trace->writeUInt(current.scissorCount);
+		for (UINT i = 0; i < current.scissorCount; i++)
+		{
+			trace->writeInt(current.scissors[i].left);
+			trace->writeInt(current.scissors[i].top);
+			trace->writeInt(current.scissors[i].right);
+			trace->writeInt(current.scissors[i].bottom);
+		}
+	}
+	if (!outputKnown || current.blendState != output.blendState || current.sampleMask != output.sampleMask || memcmp(current.blendFactor, output.blendFactor, sizeof(current.blendFactor)) != 0)
+	{
+		trace->beginCommand(COMMAND_SET_BLEND_STATE);
+		trace->writeUInt(current.blendState);
+		for (int i = 0; i < 4; i++)
+		{
+			trace->writeFloat(current.blendFactor[i]);
+		}
+		trace->writeUInt(current.sampleMask);
+	}
+	if (!outputKnown || current.depthStencilState != output.depthStencilState || current.stencilRef != output.stencilRef)
+	{
+		trace->beginCommand(COMMAND_SET_DEPTH_STENCIL_STATE);
+		trace->writeUInt(current.depthStencilState);
+		trace->writeUInt(current.stencilRef);
+	}
+	if (!outputKnown || current.rasterizerState != output.rasterizerState)
+	{
+		trace->beginCommand(COMMAND_SET_RASTERIZER_STATE);
+		trace->writeUInt(current.rasterizerState);
+	}
+
+	output = current;
+	outputKnown = true;
+}
+
+void CommandRecorder::recordInitialState()
+{
+	ID3D11DeviceChild* shader;
+	ID3D11Buffer* buffers[D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT];
+	ID3D11ShaderResourceView* views[D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT];
+	ID3D11SamplerState* samplers[D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT];
+	const UINT bufferCount = D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT;
+	const UINT viewCount = D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT;
+	const UINT samplerCount = D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT;
+
+	// Every slot is written, empty or not, so a replay starting from whatever the last one left behind sees exactly what was recorded
+	for (int stage = 0; stage < COMMAND_STAGES; stage++)
+	{
+		shader = NULL;
+		switch (stage)
+		{
+		case COMMAND_STAGE_VERTEX:
+			deviceContext->VSGetShader((ID3D11VertexShader**)&shader, NULL, NULL);
+			deviceContext->VSGetConstantBuffers(0, bufferCount, buffers);
+			deviceContext->VSGetShaderResources(0, viewCount, views);
+			deviceContext->VSGetSamplers(0, samplerCount, samplers);
+			break;
+		case COMMAND_STAGE_HULL:
+			deviceContext->HSGetShader((ID3D11HullShader**)&shader, NULL, NULL);
+			deviceContext->HSGetConstantBuffers(0, bufferCount, buffers);
+			deviceContext->HSGetShaderResources(0, viewCount, views);
+			deviceContext->HSGetSamplers(0, samplerCount, samplers);
+			break;
+		case COMMAND_STAGE_DOMAIN:
+			deviceContext->DSGetShader((ID3D11DomainShader**)&shader, NULL, NULL);
+			deviceContext->DSGetConstantBuffers(0, bufferCount, buffers);
+			deviceContext->DSGetShaderResources(0, viewCount, views);
+			deviceContext->DSGetSamplers(0, samplerCount, samplers);
+			break;
+		case COMMAND_STAGE_GEOMETRY:
+			deviceContext->GSGetShader((ID3D11GeometryShader**)&shader, NULL, NULL);
+			deviceContext->GSGetConstantBuffers(0, bufferCount, buffers);
+			deviceContext->GSGetShaderResources(0, viewCount, views);
+			deviceContext->GSGetSamplers(0, samplerCount, samplers);
+			break;
+		case COMMAND_STAGE_PIXEL:
+			deviceContext->PSGetShader((ID3D11PixelShader**)&shader, NULL, NULL);
+			deviceContext->PSGetConstantBuffers(0, bufferCount, buffers);
+			deviceContext->PSGetShaderResources(0, viewCount, views);
+			deviceContext->PSGetSamplers(0, samplerCount, samplers);
+			break;
+		default:
+			deviceContext->CSGetShader((ID3D11ComputeShader**)&shader, NULL, NULL);
+			deviceContext->CSGetConstantBuffers(0, bufferCount, buffers);
+			deviceContext->CSGetShaderResources(0, viewCount, views);
+			deviceContext->CSGetSamplers(0, samplerCount, samplers);
+			break;
+		}
+
+		recordShader((CommandStage)stage, shader);
+		recordList(COMMAND_SET_CONSTANT_BUFFERS, (CommandStage)stage, 0, bufferCount, (ID3D11DeviceChild* const*)buffers);
+		recordList(COMMAND_SET_SHADER_RESOURCES, (CommandStage)stage, 0, viewCount, (ID3D11DeviceChild* const*)views);
+		recordList(COMMAND_SET_SAMPLERS, (CommandStage)stage, 0, samplerCount, (ID3D11DeviceChild* const*)samplers);
+
+		if (shader)
+		{
+			shader->Release();
+		}
+		for (UINT i = 0; i < bufferCount; i++)
+		{
+			if (buffers[i])
+			{
+				buffers[i]->Release();
+			}
+		}
+		for (UINT i = 0; i < viewCount; i++)
+		{
+			if (views[i])
+			{
+				views[i]->Release();
+			}
+		}
+		for (UINT i = 0; i < samplerCount; i++)
+		{
+			if (samplers[i])
+			{
+				samplers[i]->Release();
+			}
+		}
+	}
+
+	// Compute's writable views, as many as the lowest feature level the application runs on has
+	ID3D11UnorderedAccessView* uavs[D3D11_PS_CS_UAV_REGISTER_COUNT];
+	deviceContext->CSGetUnorderedAccessViews(0, D3D11_PS_CS_UAV_REGISTER_COUNT, uavs);
+	recordUnorderedAccessViews(COMMAND_SET_UNORDERED_ACCESS_VIEWS, 0, D3D11_PS_CS_UAV_REGISTER_COUNT, uavs, NULL);
+	for (UINT i = 0; i < D3D11_PS_CS_UAV_REGISTER_COUNT; i++)
+	{
+		if (uavs[i])
+		{
+			uavs[i]->Release();
+		}
+	}
+
+	// The input assembler
+	ID3D11InputLayout* inputLayout = NULL;
+	deviceContext->IAGetInputLayout(&inputLayout);
+	trace->beginCommand(COMMAND_SET_INPUT_LAYOUT);
+	trace->writeObject(inputLayout);
+	if (inputLayout)
+	{
+		inputLayout->Release();
+	}
+
+	ID3D11Buffer* vertexBuffers[D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT];
+	UINT strides[D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT];
+	UINT offsets[D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT];
+	deviceContext->IAGetVertexBuffers(0, D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT, vertexBuffers, strides, offsets);
+	trace->beginCommand(COMMAND_SET_VERTEX_BUFFERS);
+	trace->writeUInt(0);
+	trace->writeUInt(D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT);
+	for (UINT i = 0; i < D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT; i++)
+	{
+		trace->writeObject(vertexBuffers[i]);
+		trace->writeUInt(strides[i]);
+		trace->writeUInt(offsets[i]);
+		if (vertexBuffers[i])
+		{
+			vertexBuffers[i]->Release();
+		}
+	}
+
+	ID3D11Buffer* indexBuffer = NULL;
+	DXGI_FORMAT indexFormat = DXGI_FORMAT_UNKNOWN;
+	UINT indexOffset = 0;
+	deviceContext->IAGetIndexBuffer(&indexBuffer, &indexFormat, &indexOffset);
+	trace->beginCommand(COMMAND_SET_INDEX_BUFFER);
+	trace->writeObject(indexBuffer);
+	trace->writeUInt(indexFormat);
+	trace->writeUInt(indexOffset);
+	if (indexBuffer)
+	{
+		indexBuffer->Release();
+	}
+
+	D3D11_PRIMITIVE_TOPOLOGY topology = D3D11_PRIMITIVE_TOPOLOGY_UNDEFINED;
+	deviceContext->IAGetPrimitiveTopology(&topology);
+	trace->beginCommand(COMMAND_SET_TOPOLOGY);
+	trace->writeUInt(topology);
+}
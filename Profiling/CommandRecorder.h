@@ -0,0 +1,213 @@
+// Stands in for the immediate context while a trace is taken, passing every call straight through and writing the ones that render into
+// the trace. The shaders and meshes only ever see the context they are handed, so recording is just a matter of handing them this one.
+// What the framework binds on its own context, the back buffer, viewport and its depth and blend states, is picked up by comparing the
+// real context's output state against what was last recorded before each draw. Queries and reads back to the CPU are application logic,
+// so are passed through without being recorded, as are stream output, predication and command lists, which nothing here uses
+#pragma once
+
+#include "DXF.h"
+#include "CommandTrace.h"
+#include <map>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+class CommandRecorder : public ID3D11DeviceContext
+{
+public:
+	CommandRecorder(ID3D11DeviceContext* deviceContext);
+	~CommandRecorder();
+
+	// Starts recording into the trace with the pipeline state as it is now, so the trace replays the same from any state. Frames are
+	// marked as they end, and recording stops at end
+	void begin(CommandTrace* trace);
+	void endFrame();
+	void end();
+
+	// Marks where one of the application's passes begins
+	void beginPass(const char* name);
+	bool isRecording() const { return trace != NULL; }
+
+	// The application owns the recorder, so references others take are counted but never free it
+	HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** object);
+	ULONG STDMETHODCALLTYPE AddRef() { return InterlockedIncrement(&references); }
+	ULONG STDMETHODCALLTYPE Release() { return InterlockedDecrement(&references); }
+
+	void STDMETHODCALLTYPE GetDevice(ID3D11Device** device) { deviceContext->GetDevice(device); }
+	HRESULT STDMETHODCALLTYPE GetPrivateData(REFGUID guid, UINT* dataSize, void* data) { return deviceContext->GetPrivateData(guid, dataSize, data); }
+	HRESULT STDMETHODCALLTYPE SetPrivateData(REFGUID guid, UINT dataSize, const void* data) { return deviceContext->SetPrivateData(guid, dataSize, data); }
+	HRESULT STDMETHODCALLTYPE SetPrivateDataInterface(REFGUID guid, const IUnknown* data) { return deviceContext->SetPrivateDataInterface(guid, data); }
+
+	// Recorded
+	void STDMETHODCALLTYPE VSSetConstantBuffers(UINT startSlot, UINT count, ID3D11Buffer* const* buffers);
+	void STDMETHODCALLTYPE HSSetConstantBuffers(UINT startSlot, UINT count, ID3D11Buffer* const* buffers);
+	void STDMETHODCALLTYPE DSSetConstantBuffers(UINT startSlot, UINT count, ID3D11Buffer* const* buffers);
+	void STDMETHODCALLTYPE GSSetConstantBuffers(UINT startSlot, UINT count, ID3D11Buffer* const* buffers);
+	void STDMETHODCALLTYPE PSSetConstantBuffers(UINT startSlot, UINT count, ID3D11Buffer* const* buffers);
+	void STDMETHODCALLTYPE CSSetConstantBuffers(UINT startSlot, UINT count, ID3D11Buffer* const* buffers);
+	void STDMETHODCALLTYPE VSSetShaderResources(UINT startSlot, UINT count, ID3D11ShaderResourceView* const* views);
+	void STDMETHODCALLTYPE HSSetShaderResources(UINT startSlot, UINT count, ID3D11ShaderResourceView* const* views);
+	void STDMETHODCALLTYPE DSSetShaderResources(UINT startSlot, UINT count, ID3D11ShaderResourceView* const* views);
+	void STDMETHODCALLTYPE GSSetShaderResources(UINT startSlot, UINT count, ID3D11ShaderResourceView* const* views);
+	void STDMETHODCALLTYPE PSSetShaderResources(UINT startSlot, UINT count, ID3D11ShaderResourceView* const* views);
+	void STDMETHODCALLTYPE CSSetShaderResources(UINT startSlot, UINT count, ID3D11ShaderResourceView* const* views);
+	void STDMETHODCALLTYPE VSSetSamplers(UINT startSlot, UINT count, ID3D11SamplerState* const* samplers);
+	void STDMETHODCALLTYPE HSSetSamplers(UINT startSlot, UINT count, ID3D11SamplerState* const* samplers);
+	void STDMETHODCALLTYPE DSSetSamplers(UINT startSlot, UINT count, ID3D11SamplerState* const* samplers);
+	void STDMETHODCALLTYPE GSSetSamplers(UINT startSlot, UINT count, ID3D11SamplerState* const* samplers);
+	void STDMETHODCALLTYPE PSSetSamplers(UINT startSlot, UINT count, ID3D11SamplerState* const* samplers);
+	void STDMETHODCALLTYPE CSSetSamplers(UINT startSlot, UINT count, ID3D11SamplerState* const* samplers);
+	void STDMETHODCALLTYPE VSSetShader(ID3D11VertexShader* shader, ID3D11ClassInstance* const* classInstances, UINT classInstanceCount);
+	void STDMETHODCALLTYPE HSSetShader(ID3D11HullShader* shader, ID3D11ClassInstance* const* classInstances, UINT classInstanceCount);
+	void STDMETHODCALLTYPE DSSetShader(ID3D11DomainShader* shader, ID3D11ClassInstance* const* classInstances, UINT classInstanceCount);
+	void STDMETHODCALLTYPE GSSetShader(ID3D11GeometryShader* shader, ID3D11ClassInstance* const* classInstances, UINT classInstanceCount);
+	void STDMETHODCALLTYPE PSSetShader(ID3D11PixelShader* shader, ID3D11ClassInstance* const* classInstances, UINT classInstanceCount);
+	void STDMETHODCALLTYPE CSSetShader(ID3D11ComputeShader* shader, ID3D11ClassInstance* const* classInstances, UINT classInstanceCount);
+	void STDMETHODCALLTYPE CSSetUnorderedAccessViews(UINT startSlot, UINT count, ID3D11UnorderedAccessView* const* views, const UINT* initialCounts);
+	void STDMETHODCALLTYPE IASetInputLayout(ID3D11InputLayout* inputLayout);
+	void STDMETHODCALLTYPE IASetVertexBuffers(UINT startSlot, UINT count, ID3D11Buffer* const* buffers, const UINT* strides, const UINT* offsets);
+	void STDMETHODCALLTYPE IASetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, UINT offset);
+	void STDMETHODCALLTYPE IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology);
+	void STDMETHODCALLTYPE OMSetRenderTargetsAndUnorderedAccessViews(UINT targetCount, ID3D11RenderTargetView* const* targets, ID3D11DepthStencilView* depthStencil,
+		UINT uavStartSlot, UINT uavCount, ID3D11UnorderedAccessView* const* uavs, const UINT* initialCounts);
+	HRESULT STDMETHODCALLTYPE Map(ID3D11Resource* resource, UINT subresource, D3D11_MAP mapType, UINT mapFlags, D3D11_MAPPED_SUBRESOURCE* mapped);
+	void STDMETHODCALLTYPE Unmap(ID3D11Resource* resource, UINT subresource);
+	void STDMETHODCALLTYPE UpdateSubresource(ID3D11Resource* resource, UINT subresource, const D3D11_BOX* box, const void* data, UINT rowPitch, UINT depthPitch);
+	void STDMETHODCALLTYPE CopyResource(ID3D11Resource* destination, ID3D11Resource* source);
+	void STDMETHODCALLTYPE CopySubresourceRegion(ID3D11Resource* destination, UINT destinationSubresource, UINT x, UINT y, UINT z, ID3D11Resource* source, UINT sourceSubresource, const D3D11_BOX* box);
+	void STDMETHODCALLTYPE CopyStructureCount(ID3D11Buffer* destination, UINT offset, ID3D11UnorderedAccessView* source);
+	void STDMETHODCALLTYPE ResolveSubresource(ID3D11Resource* destination, UINT destinationSubresource, ID3D11Resource* source, UINT sourceSubresource, DXGI_FORMAT format);
+	void STDMETHODCALLTYPE ClearRenderTargetView(ID3D11RenderTargetView* view, const FLOAT colour[4]);
+	void STDMETHODCALLTYPE ClearDepthStencilView(ID3D11DepthStencilView* view, UINT flags, FLOAT depth, UINT8 stencil);
+	void STDMETHODCALLTYPE ClearUnorderedAccessViewFloat(ID3D11UnorderedAccessView* view, const FLOAT values[4]);
+	void STDMETHODCALLTYPE ClearUnorderedAccessViewUint(ID3D11UnorderedAccessView* view, const UINT values[4]);
+	void STDMETHODCALLTYPE GenerateMips(ID3D11ShaderResourceView* view);
+	void STDMETHODCALLTYPE SetResourceMinLOD(ID3D11Resource* resource, FLOAT minLod);
+	void STDMETHODCALLTYPE Draw(UINT vertexCount, UINT startVertex);
+	void STDMETHODCALLTYPE DrawIndexed(UINT indexCount, UINT startIndex, INT baseVertex);
+	void STDMETHODCALLTYPE DrawInstanced(UINT vertexCount, UINT instanceCount, UINT startVertex, UINT startInstance);
+	void STDMETHODCALLTYPE DrawIndexedInstanced(UINT indexCount, UINT instanceCount, UINT startIndex, INT baseVertex, UINT startInstance);
+	void STDMETHODCALLTYPE DrawInstancedIndirect(ID3D11Buffer* arguments, UINT offset);
+	void STDMETHODCALLTYPE DrawIndexedInstancedIndirect(ID3D11Buffer* arguments, UINT offset);
+	void STDMETHODCALLTYPE Dispatch(UINT x, UINT y, UINT z);
+	void STDMETHODCALLTYPE DispatchIndirect(ID3D11Buffer* arguments, UINT offset);
+
+	// Output state is read back from the real context at each draw, so setting it is only passed through
+	void STDMETHODCALLTYPE OMSetRenderTargets(UINT count, ID3D11RenderTargetView* const* targets, ID3D11DepthStencilView* depthStencil) { deviceContext->OMSetRenderTargets(count, targets, depthStencil); }
+	void STDMETHODCALLTYPE OMSetBlendState(ID3D11BlendState* state, const FLOAT factor[4], UINT sampleMask) { deviceContext->OMSetBlendState(state, factor, sampleMask); }
+	void STDMETHODCALLTYPE OMSetDepthStencilState(ID3D11DepthStencilState* state, UINT stencilRef) { deviceContext->OMSetDepthStencilState(state, stencilRef); }
+	void STDMETHODCALLTYPE RSSetState(ID3D11RasterizerState* state) { deviceContext->RSSetState(state); }
+	void STDMETHODCALLTYPE RSSetViewports(UINT count, const D3D11_VIEWPORT* viewports) { deviceContext->RSSetViewports(count, viewports); }
+	void STDMETHODCALLTYPE RSSetScissorRects(UINT count, const D3D11_RECT* rects) { deviceContext->RSSetScissorRects(count, rects); }
+
+	// Passed through unrecorded
+	void STDMETHODCALLTYPE Begin(ID3D11Asynchronous* async) { deviceContext->Begin(async); }
+	void STDMETHODCALLTYPE End(ID3D11Asynchronous* async) { deviceContext->End(async); }
+	HRESULT STDMETHODCALLTYPE GetData(ID3D11Asynchronous* async, void* data, UINT dataSize, UINT flags) { return deviceContext->GetData(async, data, dataSize, flags); }
+	void STDMETHODCALLTYPE SetPredication(ID3D11Predicate* predicate, BOOL value) { deviceContext->SetPredication(predicate, value); }
+	void STDMETHODCALLTYPE SOSetTargets(UINT count, ID3D11Buffer* const* targets, const UINT* offsets) { deviceContext->SOSetTargets(count, targets, offsets); }
+	void STDMETHODCALLTYPE DrawAuto() { deviceContext->DrawAuto(); }
+	FLOAT STDMETHODCALLTYPE GetResourceMinLOD(ID3D11Resource* resource) { return deviceContext->GetResourceMinLOD(resource); }
+	void STDMETHODCALLTYPE ExecuteCommandList(ID3D11CommandList* commandList, BOOL restoreState) { deviceContext->ExecuteCommandList(commandList, restoreState); }
+	void STDMETHODCALLTYPE ClearState() { deviceContext->ClearState(); }
+	void STDMETHODCALLTYPE Flush() { deviceContext->Flush(); }
+	D3D11_DEVICE_CONTEXT_TYPE STDMETHODCALLTYPE GetType() { return deviceContext->GetType(); }
+	UINT STDMETHODCALLTYPE GetContextFlags() { return deviceContext->GetContextFlags(); }
+	HRESULT STDMETHODCALLTYPE FinishCommandList(BOOL restoreState, ID3D11CommandList** commandList) { return deviceContext->FinishCommandList(restoreState, commandList); }
+
+	void STDMETHODCALLTYPE VSGetConstantBuffers(UINT startSlot, UINT count, ID3D11Buffer** buffers) { deviceContext->VSGetConstantBuffers(startSlot, count, buffers); }
+	void STDMETHODCALLTYPE HSGetConstantBuffers(UINT startSlot, UINT count, ID3D11Buffer** buffers) { deviceContext->HSGetConstantBuffers(startSlot, count, buffers); }
+	void STDMETHODCALLTYPE DSGetConstantBuffers(UINT startSlot, UINT count, ID3D11Buffer** buffers) { deviceContext->DSGetConstantBuffers(startSlot, count, buffers); }
+	void STDMETHODCALLTYPE GSGetConstantBuffers(UINT startSlot, UINT count, ID3D11Buffer** buffers) { deviceContext->GSGetConstantBuffers(startSlot, count, buffers); }
+	void STDMETHODCALLTYPE PSGetConstantBuffers(UINT startSlot, UINT count, ID3D11Buffer** buffers) { deviceContext->PSGetConstantBuffers(startSlot, count, buffers); }
+	void STDMETHODCALLTYPE CSGetConstantBuffers(UINT startSlot, UINT count, ID3D11Buffer** buffers) { deviceContext->CSGetConstantBuffers(startSlot, count, buffers); }
+	void STDMETHODCALLTYPE VSGetShaderResources(UINT startSlot, UINT count, ID3D11ShaderResourceView** views) { deviceContext->VSGetShaderResources(startSlot, count, views); }
+	void STDMETHODCALLTYPE HSGetShaderResources(UINT startSlot, UINT count, ID3D11ShaderResourceView** views) { deviceContext->HSGetShaderResources(startSlot, count, views); }
+	void STDMETHODCALLTYPE DSGetShaderResources(UINT startSlot, UINT count, ID3D11ShaderResourceView** views) { deviceContext->DSGetShaderResources(startSlot, count, views); }
+	void STDMETHODCALLTYPE GSGetShaderResources(UINT startSlot, UINT count, ID3D11ShaderResourceView** views) { deviceContext->GSGetShaderResources(startSlot, count, views); }
+	void STDMETHODCALLTYPE PSGetShaderResources(UINT startSlot, UINT count, ID3D11ShaderResourceView** views) { deviceContext->PSGetShaderResources(startSlot, count, views); }
+	void STDMETHODCALLTYPE CSGetShaderResources(UINT startSlot, UINT count, ID3D11ShaderResourceView** views) { deviceContext->CSGetShaderResources(startSlot, count, views); }
+	void STDMETHODCALLTYPE VSGetSamplers(UINT startSlot, UINT count, ID3D11SamplerState** samplers) { deviceContext->VSGetSamplers(startSlot, count, samplers); }
+	void STDMETHODCALLTYPE HSGetSamplers(UINT startSlot, UINT count, ID3D11SamplerState** samplers) { deviceContext->HSGetSamplers(startSlot, count, samplers); }
+	void STDMETHODCALLTYPE DSGetSamplers(UINT startSlot, UINT count, ID3D11SamplerState** samplers) { deviceContext->DSGetSamplers(startSlot, count, samplers); }
+	void STDMETHODCALLTYPE GSGetSamplers(UINT startSlot, UINT count, ID3D11SamplerState** samplers) { deviceContext->GSGetSamplers(startSlot, count, samplers); }
+	void STDMETHODCALLTYPE PSGetSamplers(UINT startSlot, UINT count, ID3D11SamplerState** samplers) { deviceContext->PSGetSamplers(startSlot, count, samplers); }
+	void STDMETHODCALLTYPE CSGetSamplers(UINT startSlot, UINT count, ID3D11SamplerState** samplers) { deviceContext->CSGetSamplers(startSlot, count, samplers); }
+	void STDMETHODCALLTYPE VSGetShader(ID3D11VertexShader** shader, ID3D11ClassInstance** classInstances, UINT* classInstanceCount) { deviceContext->VSGetShader(shader, classInstances, classInstanceCount); }
+	void STDMETHODCALLTYPE HSGetShader(ID3D11HullShader** shader, ID3D11ClassInstance** classInstances, UINT* classInstanceCount) { deviceContext->HSGetShader(shader, classInstances, classInstanceCount); }
+	void STDMETHODCALLTYPE DSGetShader(ID3D11DomainShader** shader, ID3D11ClassInstance** classInstances, UINT* classInstanceCount) { deviceContext->DSGetShader(shader, classInstances, classInstanceCount); }
+	void STDMETHODCALLTYPE GSGetShader(ID3D11GeometryShader** shader, ID3D11ClassInstance** classInstances, UINT* classInstanceCount) { deviceContext->GSGetShader(shader, classInstances, classInstanceCount); }
+	void STDMETHODCALLTYPE PSGetShader(ID3D11PixelShader** shader, ID3D11ClassInstance** classInstances, UINT* classInstanceCount) { deviceContext->PSGetShader(shader, classInstances, classInstanceCount); }
+	void STDMETHODCALLTYPE CSGetShader(ID3D11ComputeShader** shader, ID3D11ClassInstance** classInstances, UINT* classInstanceCount) { deviceContext->CSGetShader(shader, classInstances, classInstanceCount); }
+	void STDMETHODCALLTYPE CSGetUnorderedAccessViews(UINT startSlot, UINT count, ID3D11UnorderedAccessView** views) { deviceContext->CSGetUnorderedAccessViews(startSlot, count, views); }
+	void STDMETHODCALLTYPE IAGetInputLayout(ID3D11InputLayout** inputLayout) { deviceContext->IAGetInputLayout(inputLayout); }
+	void STDMETHODCALLTYPE IAGetVertexBuffers(UINT startSlot, UINT count, ID3D11Buffer** buffers, UINT* strides, UINT* offsets) { deviceContext->IAGetVertexBuffers(startSlot, count, buffers, strides, offsets); }
+	void STDMETHODCALLTYPE IAGetIndexBuffer(ID3D11Buffer** buffer, DXGI_FORMAT* format, UINT* offset) { deviceContext->IAGetIndexBuffer(buffer, format, offset); }
+	void STDMETHODCALLTYPE IAGetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY* topology) { deviceContext->IAGetPrimitiveTopology(topology); }
+	void STDMETHODCALLTYPE GetPredication(ID3D11Predicate** predicate, BOOL* value) { deviceContext->GetPredication(predicate, value); }
+	void STDMETHODCALLTYPE OMGetRenderTargets(UINT count, ID3D11RenderTargetView** targets, ID3D11DepthStencilView** depthStencil) { deviceContext->OMGetRenderTargets(count, targets, depthStencil); }
+	void STDMETHODCALLTYPE OMGetRenderTargetsAndUnorderedAccessViews(UINT targetCount, ID3D11RenderTargetView** targets, ID3D11DepthStencilView** depthStencil, UINT uavStartSlot, UINT uavCount, ID3D11UnorderedAccessView** uavs)
+	{
+		deviceContext->OMGetRenderTargetsAndUnorderedAccessViews(targetCount, targets, depthStencil, uavStartSlot, uavCount, uavs);
+	}
+	void STDMETHODCALLTYPE OMGetBlendState(ID3D11BlendState** state, FLOAT factor[4], UINT* sampleMask) { deviceContext->OMGetBlendState(state, factor, sampleMask); }
+	void STDMETHODCALLTYPE OMGetDepthStencilState(ID3D11DepthStencilState** state, UINT* stencilRef) { deviceContext->OMGetDepthStencilState(state, stencilRef); }
+	void STDMETHODCALLTYPE SOGetTargets(UINT count, ID3D11Buffer** targets) { deviceContext->SOGetTargets(count, targets); }
+	void STDMETHODCALLTYPE RSGetState(ID3D11RasterizerState** state) { deviceContext->RSGetState(state); }
+	void STDMETHODCALLTYPE RSGetViewports(UINT* count, D3D11_VIEWPORT* viewports) { deviceContext->RSGetViewports(count, viewports); }
+	void STDMETHODCALLTYPE RSGetScissorRects(UINT* count, D3D11_RECT* rects) { deviceContext->RSGetScissorRects(count, rects); }
+
+private:
+	// The output state last written to the trace, as object ids
+	struct OutputState
+	{
+		uint32_t targets[D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT];
+		UINT targetCount;
+		uint32_t depthStencil;
+		D3D11_VIEWPORT viewports[D3D11_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE];
+		UINT viewportCount;
+		D3D11_RECT scissors[D3D11_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE];
+		UINT scissorCount;
+		uint32_t blendState;
+		FLOAT blendFactor[4];
+		UINT sampleMask;
+		uint32_t depthStencilState;
+		UINT stencilRef;
+		uint32_t rasterizerState;
+	};
+
+	// A resource mapped for writing. The application writes into the shadow copy, pitched as the real mapping is, which is copied through
+	// and recorded when it's unmapped
+	struct PendingMap
+	{
+		ID3D11Resource* resource;
+		UINT subresource;
+		D3D11_MAP mapType;
+		D3D11_MAPPED_SUBRESOURCE mapped;
+		vector<uint8_t> shadow;
+	};
+
+	void recordShader(CommandStage stage, ID3D11DeviceChild* shader);
+	void recordList(CommandOp op, CommandStage stage, UINT startSlot, UINT count, ID3D11DeviceChild* const* items);
+	void recordUnorderedAccessViews(CommandOp op, UINT startSlot, UINT count, ID3D11UnorderedAccessView* const* views, const UINT* initialCounts);
+
+	// Writes the real context's output state wherever it differs from what was last written
+	void recordOutputState();
+
+	// Writes every binding of every stage and the input assembler as they stand
+	void recordInitialState();
+
+	ID3D11DeviceContext* deviceContext;
+	CommandTrace* trace;
+	OutputState output;
+	bool outputKnown;
+	vector<PendingMap> pendingMaps;
+
+	// What was last written to each mapped subresource during the recording, rows packed tightly, to find what the next write changed
+	map<pair<ID3D11Resource*, UINT>, vector<uint8_t>> written;
+
+	// Rows of a mapped texture with the driver's padding taken out, kept between uploads
+	vector<uint8_t> packed;
+	volatile LONG references;
+};
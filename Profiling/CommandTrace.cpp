@@ -0,0 +1,986 @@
+#include "CommandTrace.h"
+#include "MemoryTracker.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <thread>
+
+// Most bindings the API takes in one call, so a replayed call's list fits on the stack
+static const UINT MAX_BINDINGS = D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT;
+
+CommandTrace::CommandTrace()
+{
+	ZeroMemory(&stats, sizeof(stats));
+	commandStart = 0;
+}
+
+CommandTrace::~CommandTrace()
+{
+	clear();
+}
+
+void CommandTrace::clear()
+{
+	for (ID3D11DeviceChild* object : objects)
+	{
+		object->Release();
+	}
+	objects.clear();
+	objectIds.clear();
+	bytes.clear();
+	ZeroMemory(&stats, sizeof(stats));
+	commandStart = 0;
+}
+
+void CommandTrace::beginCommand(CommandOp op)
+{
+	// The last command's size is only known once the next one starts, so it's counted then
+	stats.commandBytes += bytes.size() - commandStart;
+	commandStart = bytes.size();
+	bytes.push_back((uint8_t)op);
+
+	stats.commands++;
+	stats.opCounts[op]++;
+	if (op >= COMMAND_DRAW && op <= COMMAND_DRAW_INDEXED_INSTANCED_INDIRECT)
+	{
+		stats.draws++;
+	}
+	else if (op == COMMAND_DISPATCH || op == COMMAND_DISPATCH_INDIRECT)
+	{
+		stats.dispatches++;
+	}
+	else if (op >= COMMAND_SET_SHADER && op <= COMMAND_SET_RASTERIZER_STATE)
+	{
+		stats.bindings++;
+	}
+	else if (op == COMMAND_UPDATE_MAPPED || op == COMMAND_UPDATE_SUBRESOURCE)
+	{
+		stats.uploads++;
+	}
+}
+
+void CommandTrace::endFrame()
+{
+	beginCommand(COMMAND_FRAME_END);
+	stats.frames++;
+
+	// The frame marker is a whole command, so is counted straight away to keep the byte counts adding up between frames
+	stats.commandBytes += bytes.size() - commandStart;
+	commandStart = bytes.size();
+}
+
+void CommandTrace::writeUInt(uint64_t value)
+{
+	// Seven bits a byte, the top bit set on every byte but the last. Counts, slots and ids mostly fit in one
+	while (value >= 0x80)
+	{
+		bytes.push_back((uint8_t)(value | 0x80));
+		value >>= 7;
+	}
+	bytes.push_back((uint8_t)value);
+}
+
+void CommandTrace::writeInt(int64_t value)
+{
+	// Zigzag encoded, so small negative base vertices stay small
+	writeUInt(((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+}
+
+void CommandTrace::writeFloat(float value)
+{
+	uint8_t raw[sizeof(float)];
+	memcpy(raw, &value, sizeof(float));
+	bytes.insert(bytes.end(), raw, raw + sizeof(float));
+}
+
+void CommandTrace::writeData(const void* data, size_t size)
+{
+	writeUInt(size);
+	const uint8_t* source = (const uint8_t*)data;
+	bytes.insert(bytes.end(), source, source + size);
+
+	// Taken off again when the command is counted, so the data is only counted here
+	stats.dataBytes += size;
+	commandStart += size;
+}
+
+void CommandTrace::writeString(const char* text)
+{
+	// Laid out like data, but counted as part of the command
+	size_t length = strlen(text);
+	writeUInt(length);
+	bytes.insert(bytes.end(), text, text + length);
+}
+
+void CommandTrace::writeObject(ID3D11DeviceChild* object)
+{
+	writeUInt(getObjectId(object));
+}
+
+void CommandTrace::writeObjects(ID3D11DeviceChild* const* items, UINT count)
+{
+	for (UINT i = 0; i < count; i++)
+	{
+		writeObject(items ? items[i] : NULL);
+	}
+}
+
+uint32_t CommandTrace::getObjectId(ID3D11DeviceChild* object)
+{
+	if (!object)
+	{
+		return 0;
+	}
+
+	auto found = objectIds.find(object);
+	if (found != objectIds.end())
+	{
+		return found->second;
+	}
+	object->AddRef();
+	objects.push_back(object);
+	uint32_t id = (uint32_t)objects.size();
+	objectIds[object] = id;
+	stats.objects = (int)objects.size();
+	return id;
+}
+
+uint64_t CommandTrace::Reader::readUInt()
+{
+	// Ten bytes hold any 64 bit value, so a longer run can only be a corrupt stream
+	uint64_t value = 0;
+	for (int shift = 0; !failed && shift < 64; shift += 7)
+	{
+		if (position >= size)
+		{
+			break;
+		}
+		uint8_t byte = data[position++];
+		value |= (uint64_t)(byte & 0x7F) << shift;
+		if (!(byte & 0x80))
+		{
+			return value;
+		}
+	}
+	failed = true;
+	return 0;
+}
+
+UINT CommandTrace::Reader::readCount(UINT limit)
+{
+	// More items than the call that wrote them could take means the stream is corrupt
+	uint64_t count = readUInt();
+	if (count > limit)
+	{
+		failed = true;
+		return 0;
+	}
+	return (UINT)count;
+}
+
+int64_t CommandTrace::Reader::readInt()
+{
+	uint64_t value = readUInt();
+	return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+float CommandTrace::Reader::readFloat()
+{
+	float value = 0.0f;
+	if (failed || size - position < sizeof(float))
+	{
+		failed = true;
+		return value;
+	}
+	memcpy(&value, data + position, sizeof(float));
+	position += sizeof(float);
+	return value;
+}
+
+const uint8_t* CommandTrace::Reader::readData(size_t& length)
+{
+	uint64_t recorded = readUInt();
+	if (failed || recorded > size - position)
+	{
+		failed = true;
+		length = 0;
+		return NULL;
+	}
+	length = (size_t)recorded;
+	const uint8_t* start = data + position;
+	position += length;
+	return start;
+}
+
+template <typename T> T* CommandTrace::readObject(Reader& reader) const
+{
+	// Id 0 is no object, anything past the table can't have been written
+	uint64_t id = reader.readUInt();
+	if (id > objects.size())
+	{
+		reader.failed = true;
+		return NULL;
+	}
+	return id > 0 ? static_cast<T*>(objects[(size_t)id - 1]) : NULL;
+}
+
+template <typename T> void CommandTrace::readObjects(Reader& reader, UINT slot, UINT slots, T** items, UINT& count) const
+{
+	// The list has to fit in the stage's slots from where it starts
+	count = reader.readCount(slot < slots ? min(slots - slot, MAX_BINDINGS) : 0);
+	for (UINT i = 0; i < count; i++)
+	{
+		items[i] = readObject<T>(reader);
+	}
+}
+
+bool CommandTrace::replay(ID3D11DeviceContext* deviceContext, int iterations, CommandReplayStats& replayStats) const
+{
+	ZeroMemory(&replayStats, sizeof(replayStats));
+	if (bytes.empty() || iterations < 1)
+	{
+		return false;
+	}
+
+	// An event query after the last command says when the GPU has caught up, so the total covers its work as well as the submission
+	ID3D11Device* device = NULL;
+	deviceContext->GetDevice(&device);
+	D3D11_QUERY_DESC queryDesc;
+	queryDesc.Query = D3D11_QUERY_EVENT;
+	queryDesc.MiscFlags = 0;
+	ID3D11Query* finished = NULL;
+	device->CreateQuery(&queryDesc, &finished);
+	device->Release();
+
+	// Stops at the first command that doesn't read back whole, as nothing after it can be trusted
+	bool complete = true;
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+	for (int iteration = 0; complete && iteration < iterations; iteration++)
+	{
+		Reader reader = { bytes.data(), 0, bytes.size(), false };
+		while (reader.position < reader.size)
+		{
+			CommandOp op = (CommandOp)reader.data[reader.position++];
+			if (op >= COMMAND_OPS)
+			{
+				complete = false;
+				break;
+			}
+			execute(deviceContext, reader, op);
+			if (reader.failed)
+			{
+				complete = false;
+				break;
+			}
+			replayStats.commands++;
+			if (op >= COMMAND_DRAW && op <= COMMAND_DRAW_INDEXED_INSTANCED_INDIRECT)
+			{
+				replayStats.draws++;
+			}
+			else if (op == COMMAND_FRAME_END)
+			{
+				replayStats.frames++;
+			}
+		}
+	}
+	replayStats.submitMilliseconds = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+
+	if (finished)
+	{
+		// Flushed once so the GPU has everything, then polled without flushing again, giving the thread up between polls
+		deviceContext->End(finished);
+		deviceContext->Flush();
+		BOOL done = FALSE;
+		while (deviceContext->GetData(finished, &done, sizeof(done), D3D11_ASYNC_GETDATA_DONOTFLUSH) == S_FALSE)
+		{
+			this_thread::yield();
+		}
+		finished->Release();
+	}
+	if (!complete)
+	{
+		ZeroMemory(&replayStats, sizeof(replayStats));
+		return false;
+	}
+	replayStats.totalMilliseconds = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+
+	replayStats.iterations = iterations;
+	double seconds = max(replayStats.totalMilliseconds, 0.001) / 1000.0;
+	replayStats.framesPerSecond = replayStats.frames / seconds;
+	replayStats.commandsPerSecond = replayStats.commands / seconds;
+	replayStats.megabytesPerSecond = (double)bytes.size() * iterations / (1024.0 * 1024.0) / seconds;
+	return true;
+}
+
+void CommandTrace::execute(ID3D11DeviceContext* deviceContext, Reader& reader, CommandOp op) const
+{
+	ID3D11DeviceChild* items[MAX_BINDINGS];
+	UINT counts[MAX_BINDINGS];
+	UINT count = 0;
+
+	switch (op)
+	{
+	case COMMAND_FRAME_END:
+		break;
+
+	case COMMAND_BEGIN_PASS:
+	{
+		// Pass names only mark where each pass starts, for reading the trace
+		size_t length;
+		reader.readData(length);
+		break;
+	}
+
+	case COMMAND_SET_SHADER:
+	{
+		CommandStage stage = (CommandStage)reader.readUInt();
+		ID3D11DeviceChild* shader = readObject<ID3D11DeviceChild>(reader);
+		switch (stage)
+		{
+		case COMMAND_STAGE_VERTEX: deviceContext->VSSetShader(static_cast<ID3D11VertexShader*>(shader), NULL, 0); break;
+		case COMMAND_STAGE_HULL: deviceContext->HSSetShader(static_cast<ID3D11HullShader*>(shader), NULL, 0); break;
+		case COMMAND_STAGE_DOMAIN: deviceContext->DSSetShader(static_cast<ID3D11DomainShader*>(shader), NULL, 0); break;
+		case COMMAND_STAGE_GEOMETRY: deviceContext->GSSetShader(static_cast<ID3D11GeometryShader*>(shader), NULL, 0); break;
+		case COMMAND_STAGE_PIXEL: deviceContext->PSSetShader(static_cast<ID3D11PixelShader*>(shader), NULL, 0); break;
+		case COMMAND_STAGE_COMPUTE: deviceContext->CSSetShader(static_cast<ID3D11ComputeShader*>(shader), NULL, 0); break;
+		default: break;
+		}
+		break;
+	}
+
+	case COMMAND_SET_CONSTANT_BUFFERS:
+	{
+		CommandStage stage = (CommandStage)reader.readUInt();
+		UINT slot = (UINT)reader.readUInt();
+		ID3D11Buffer** buffers = (ID3D11Buffer**)items;
+		readObjects(reader, slot, D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT, buffers, count);
+		switch (stage)
+		{
+		case COMMAND_STAGE_VERTEX: deviceContext->VSSetConstantBuffers(slot, count, buffers); break;
+		case COMMAND_STAGE_HULL: deviceContext->HSSetConstantBuffers(slot, count, buffers); break;
+		case COMMAND_STAGE_DOMAIN: deviceContext->DSSetConstantBuffers(slot, count, buffers); break;
+		case COMMAND_STAGE_GEOMETRY: deviceContext->GSSetConstantBuffers(slot, count, buffers); break;
+		case COMMAND_STAGE_PIXEL: deviceContext->PSSetConstantBuffers(slot, count, buffers); break;
+		case COMMAND_STAGE_COMPUTE: deviceContext->CSSetConstantBuffers(slot, count, buffers); break;
+		default: break;
+		}
+		break;
+	}
+
+	case COMMAND_SET_SHADER_RESOURCES:
+	{
+		CommandStage stage = (CommandStage)reader.readUInt();
+		UINT slot = (UINT)reader.readUInt();
+		ID3D11ShaderResourceView** views = (ID3D11ShaderResourceView**)items;
+		readObjects(reader, slot, D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT, views, count);
+		switch (stage)
+		{
+		case COMMAND_STAGE_VERTEX: deviceContext->VSSetShaderResources(slot, count, views); break;
+		case COMMAND_STAGE_HULL: deviceContext->HSSetShaderResources(slot, count, views); break;
+		case COMMAND_STAGE_DOMAIN: deviceContext->DSSetShaderResources(slot, count, views); break;
+		case COMMAND_STAGE_GEOMETRY: deviceContext->GSSetShaderResources(slot, count, views); break;
+		case COMMAND_STAGE_PIXEL: deviceContext->PSSetShaderResources(slot, count, views); break;
+		case COMMAND_STAGE_COMPUTE: deviceContext->CSSetShaderResources(slot, count, views); break;
+		default: break;
+		}
+		break;
+	}
+
+	case COMMAND_SET_SAMPLERS:
+	{
+		CommandStage stage = (CommandStage)reader.readUInt();
+		UINT slot = (UINT)reader.readUInt();
+		ID3D11SamplerState** samplers = (ID3D11SamplerState**)items;
+		readObjects(reader, slot, D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT, samplers, count);
+		switch (stage)
+		{
+		case COMMAND_STAGE_VERTEX: deviceContext->VSSetSamplers(slot, count, samplers); break;
+		case COMMAND_STAGE_HULL: deviceContext->HSSetSamplers(slot, count, samplers); break;
+		case COMMAND_STAGE_DOMAIN: deviceContext->DSSetSamplers(slot, count, samplers); break;
+		case COMMAND_STAGE_GEOMETRY: deviceContext->GSSetSamplers(slot, count, samplers); break;
+		case COMMAND_STAGE_PIXEL: deviceContext->PSSetSamplers(slot, count, samplers); break;
+		case COMMAND_STAGE_COMPUTE: deviceContext->CSSetSamplers(slot, count, samplers); break;
+		default: break;
+		}
+		break;
+	}
+
+	case COMMAND_SET_UNORDERED_ACCESS_VIEWS:
+	case COMMAND_SET_OUTPUT_UNORDERED_ACCESS_VIEWS:
+	{
+		UINT slot = (UINT)reader.readUInt();
+		ID3D11UnorderedAccessView** views = (ID3D11UnorderedAccessView**)items;
+		readObjects(reader, slot, D3D11_PS_CS_UAV_REGISTER_COUNT, views, count);
+		bool hasCounts = reader.readUInt() != 0;
+		for (UINT i = 0; hasCounts && i < count; i++)
+		{
+			counts[i] = (UINT)reader.readUInt();
+		}
+		if (op == COMMAND_SET_UNORDERED_ACCESS_VIEWS)
+		{
+			deviceContext->CSSetUnorderedAccessViews(slot, count, views, hasCounts ? counts : NULL);
+		}
+		else
+		{
+			deviceContext->OMSetRenderTargetsAndUnorderedAccessViews(D3D11_KEEP_RENDER_TARGETS_AND_DEPTH_STENCIL, NULL, NULL, slot, count, views, hasCounts ? counts : NULL);
+		}
+		break;
+	}
+
+	case COMMAND_SET_INPUT_LAYOUT:
+		deviceContext->IASetInputLayout(readObject<ID3D11InputLayout>(reader));
+		break;
+
+	case COMMAND_SET_VERTEX_BUFFERS:
+	{
+		UINT slot = (UINT)reader.readUInt();
+		count = reader.readCount(slot < D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT ? D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT - slot : 0);
+		ID3D11Buffer* buffers[D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT];
+		UINT strides[D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT];
+		UINT offsets[D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT];
+		for (UINT i = 0; i < count; i++)
+		{
+			buffers[i] = readObject<ID3D11Buffer>(reader);
+			strides[i] = (UINT)reader.readUInt();
+			offsets[i] = (UINT)reader.readUInt();
+		}
+		deviceContext->IASetVertexBuffers(slot, count, buffers, strides, offsets);
+		break;
+	}
+
+	case COMMAND_SET_INDEX_BUFFER:
+	{
+		ID3D11Buffer* buffer = readObject<ID3D11Buffer>(reader);
+		DXGI_FORMAT format = (DXGI_FORMAT)reader.readUInt();
+		UINT offset = (UINT)reader.readUInt();
+		deviceContext->IASetIndexBuffer(buffer, format, offset);
+		break;
+	}
+
+	case COMMAND_SET_TOPOLOGY:
+		deviceContext->IASetPrimitiveTopology((D3D11_PRIMITIVE_TOPOLOGY)reader.readUInt());
+		break;
+
+	case COMMAND_SET_TARGETS:
+	{
+		ID3D11RenderTargetView** views = (ID3D11RenderTargetView**)items;
+		readObjects(reader, 0, D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT, views, count);
+		ID3D11DepthStencilView* depthStencil = readObject<ID3D11DepthStencilView>(reader);
+		deviceContext->OMSetRenderTargets(count, views, depthStencil);
+		break;
+	}
+
+	case COMMAND_SET_VIEWPORTS:
+	{
+		D3D11_VIEWPORT viewports[D3D11_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE];
+		count = reader.readCount(D3D11_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE);
+		for (UINT i = 0; i < count; i++)
+		{
+			viewports[i].TopLeftX = reader.readFloat();
+			viewports[i].TopLeftY = reader.readFloat();
+			viewports[i].Width = reader.readFloat();
+			viewports[i].Height = reader.readFloat();
+			viewports[i].MinDepth = reader.readFloat();
+			viewports[i].MaxDepth = reader.readFloat();
+		}
+		deviceContext->RSSetViewports(count, viewports);
+		break;
+	}
+
+	case COMMAND_SET_SCISSORS:
+	{
+		D3D11_RECT rects[D3D11_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE];
+		count = reader.readCount(D3D11_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE);
+		for (UINT i = 0; i < count; i++)
+		{
+			rects[i].left = (LONG)reader.readInt();
+			rects[i].top = (LONG)reader.readInt();
+			rects[i].right = (LONG)reader.readInt();
+			rects[i].bottom = (LONG)reader.readInt();
+		}
+		deviceContext->RSSetScissorRects(count, rects);
+		break;
+	}
+
+	case COMMAND_SET_BLEND_STATE:
+	{
+		ID3D11BlendState* state = readObject<ID3D11BlendState>(reader);
+		float factor[4];
+		for (int i = 0; i < 4; i++)
+		{
+			factor[i] = reader.readFloat();
+		}
+		UINT mask = (UINT)reader.readUInt();
+		deviceContext->OMSetBlendState(state, factor, mask);
+		break;
+	}
+
+	case COMMAND_SET_DEPTH_STENCIL_STATE:
+	{
+		ID3D11DepthStencilState* state = readObject<ID3D11DepthStencilState>(reader);
+		deviceContext->OMSetDepthStencilState(state, (UINT)reader.readUInt());
+		break;
+	}
+
+	case COMMAND_SET_RASTERIZER_STATE:
+		deviceContext->RSSetState(readObject<ID3D11RasterizerState>(reader));
+		break;
+
+	case COMMAND_UPDATE_MAPPED:
+	{
+		ID3D11Resource* resource = readObject<ID3D11Resource>(reader);
+		UINT subresource = (UINT)reader.readUInt();
+		D3D11_MAP mapType = (D3D11_MAP)reader.readUInt();
+		size_t offset = (size_t)reader.readUInt();
+		size_t length;
+		const uint8_t* data = reader.readData(length);
+		if (!resource)
+		{
+			break;
+		}
+
+		// The written bytes are an offset into the subresource with its rows packed tightly, whole rows for a texture
+		UINT rowBytes, rows, depth;
+		getSubresourceSize(resource, subresource, NULL, rowBytes, rows, depth);
+		size_t totalRows = (size_t)rows * depth;
+		if (length == 0 || offset + length > totalRows * rowBytes || (totalRows > 1 && (offset % rowBytes != 0 || length % rowBytes != 0)))
+		{
+			reader.failed = true;
+			break;
+		}
+
+		// Mapped as the application mapped it, so a no-overwrite write leaves the rest of the resource alone here too
+		D3D11_MAPPED_SUBRESOURCE mapped;
+		if (deviceContext->Map(resource, subresource, mapType, 0, &mapped) == S_OK)
+		{
+			if (totalRows <= 1)
+			{
+				memcpy((uint8_t*)mapped.pData + offset, data, length);
+			}
+			else
+			{
+				// The driver may pitch the rows differently this time, so they are copied one at a time
+				for (size_t row = offset / rowBytes; row < (offset + length) / rowBytes; row++)
+				{
+					memcpy((uint8_t*)mapped.pData + (row / rows) * mapped.DepthPitch + (row % rows) * mapped.RowPitch, data + row * rowBytes - offset, rowBytes);
+				}
+			}
+			deviceContext->Unmap(resource, subresource);
+		}
+		break;
+	}
+
+	case COMMAND_UPDATE_SUBRESOURCE:
+	{
+		ID3D11Resource* resource = readObject<ID3D11Resource>(reader);
+		UINT subresource = (UINT)reader.readUInt();
+		bool hasBox = reader.readUInt() != 0;
+		D3D11_BOX box;
+		if (hasBox)
+		{
+			box.left = (UINT)reader.readUInt();
+			box.top = (UINT)reader.readUInt();
+			box.front = (UINT)reader.readUInt();
+			box.right = (UINT)reader.readUInt();
+			box.bottom = (UINT)reader.readUInt();
+			box.back = (UINT)reader.readUInt();
+		}
+		UINT rowPitch = (UINT)reader.readUInt();
+		UINT depthPitch = (UINT)reader.readUInt();
+		size_t length;
+		const uint8_t* data = reader.readData(length);
+		if (!resource || reader.failed)
+		{
+			break;
+		}
+
+		// The update reads as far as the last row of the last slice, which the recorded data has to reach
+		UINT rowBytes, rows, depth;
+		getSubresourceSize(resource, subresource, hasBox ? &box : NULL, rowBytes, rows, depth);
+		if (rows == 0 || depth == 0 || rowBytes == 0)
+		{
+			break;
+		}
+		if ((uint64_t)(depth - 1) * depthPitch + (uint64_t)(rows - 1) * rowPitch + rowBytes > length)
+		{
+			reader.failed = true;
+			break;
+		}
+		deviceContext->UpdateSubresource(resource, subresource, hasBox ? &box : NULL, data, rowPitch, depthPitch);
+		break;
+	}
+
+	case COMMAND_COPY_RESOURCE:
+	{
+		ID3D11Resource* destination = readObject<ID3D11Resource>(reader);
+		ID3D11Resource* source = readObject<ID3D11Resource>(reader);
+		if (destination && source)
+		{
+			deviceContext->CopyResource(destination, source);
+		}
+		break;
+	}
+
+	case COMMAND_COPY_SUBRESOURCE_REGION:
+	{
+		ID3D11Resource* destination = readObject<ID3D11Resource>(reader);
+		UINT destinationSubresource = (UINT)reader.readUInt();
+		UINT x = (UINT)reader.readUInt();
+		UINT y = (UINT)reader.readUInt();
+		UINT z = (UINT)reader.readUInt();
+		ID3D11Resource* source = readObject<ID3D11Resource>(reader);
+		UINT sourceSubresource = (UINT)reader.readUInt();
+		bool hasBox = reader.readUInt() != 0;
+		D3D11_BOX box;
+		if (hasBox)
+		{
+			box.left = (UINT)reader.readUInt();
+			box.top = (UINT)reader.readUInt();
+			box.front = (UINT)reader.readUInt();
+			box.right = (UINT)reader.readUInt();
+			box.bottom = (UINT)reader.readUInt();
+			box.back = (UINT)reader.readUInt();
+		}
+		if (destination && source)
+		{
+			deviceContext->CopySubresourceRegion(destination, destinationSubresource, x, y, z, source, sourceSubresource, hasBox ? &box : NULL);
+		}
+		break;
+	}
+
+	case COMMAND_COPY_STRUCTURE_COUNT:
+	{
+		ID3D11Buffer* destination = readObject<ID3D11Buffer>(reader);
+		UINT offset = (UINT)reader.readUInt();
+		ID3D11UnorderedAccessView* source = readObject<ID3D11UnorderedAccessView>(reader);
+		if (destination && source)
+		{
+			deviceContext->CopyStructureCount(destination, offset, source);
+		}
+		break;
+	}
+
+	case COMMAND_RESOLVE_SUBRESOURCE:
+	{
+		ID3D11Resource* destination = readObject<ID3D11Resource>(reader);
+		UINT destinationSubresource = (UINT)reader.readUInt();
+		ID3D11Resource* source = readObject<ID3D11Resource>(reader);
+		UINT sourceSubresource = (UINT)reader.readUInt();
+		DXGI_FORMAT format = (DXGI_FORMAT)reader.readUInt();
+		if (destination && source)
+		{
+			deviceContext->ResolveSubresource(destination, destinationSubresource, source, sourceSubresource, format);
+		}
+		break;
+	}
+
+	case COMMAND_CLEAR_RENDER_TARGET:
+	{
+		ID3D11RenderTargetView* view = readObject<ID3D11RenderTargetView>(reader);
+		float colour[4];
+		for (int i = 0; i < 4; i++)
+		{
+			colour[i] = reader.readFloat();
+		}
+		if (view)
+		{
+			deviceContext->ClearRenderTargetView(view, colour);
+		}
+		break;
+	}
+
+	case COMMAND_CLEAR_DEPTH_STENCIL:
+	{
+		ID3D11DepthStencilView* view = readObject<ID3D11DepthStencilView>(reader);
+		UINT flags = (UINT)reader.readUInt();
+		float depthValue = reader.readFloat();
+		UINT8 stencil = (UINT8)reader.readUInt();
+		if (view)
+		{
+			deviceContext->ClearDepthStencilView(view, flags, depthValue, stencil);
+		}
+		break;
+	}
+
+	case COMMAND_CLEAR_UNORDERED_ACCESS_FLOAT:
+	{
+		ID3D11UnorderedAccessView* view = readObject<ID3D11UnorderedAccessView>(reader);
+		float values[4];
+		for (int i = 0; i < 4; i++)
+		{
+			values[i] = reader.readFloat();
+		}
+		if (view)
+		{
+			deviceContext->ClearUnorderedAccessViewFloat(view, values);
+		}
+		break;
+	}
+
+	case COMMAND_CLEAR_UNORDERED_ACCESS_UINT:
+	{
+		ID3D11UnorderedAccessView* view = readObject<ID3D11UnorderedAccessView>(reader);
+		UINT values[4];
+		for (int i = 0; i < 4; i++)
+		{
+			values[i] = (UINT)reader.readUInt();
+		}
+		if (view)
+		{
+			deviceContext->ClearUnorderedAccessViewUint(view, values);
+		}
+		break;
+	}
+
+	case COMMAND_GENERATE_MIPS:
+	{
+		ID3D11ShaderResourceView* view = readObject<ID3D11ShaderResourceView>(reader);
+		if (view)
+		{
+			deviceContext->GenerateMips(view);
+		}
+		break;
+	}
+
+	case COMMAND_SET_RESOURCE_MIN_LOD:
+	{
+		ID3D11Resource* resource = readObject<ID3D11Resource>(reader);
+		float minLod = reader.readFloat();
+		if (resource)
+		{
+			deviceContext->SetResourceMinLOD(resource, minLod);
+		}
+		break;
+	}
+
+	case COMMAND_DRAW:
+	{
+		UINT vertexCount = (UINT)reader.readUInt();
+		UINT startVertex = (UINT)reader.readUInt();
+		deviceContext->Draw(vertexCount, startVertex);
+		break;
+	}
+
+	case COMMAND_DRAW_INDEXED:
+	{
+		UINT indexCount = (UINT)reader.readUInt();
+		UINT startIndex = (UINT)reader.readUInt();
+		INT baseVertex = (INT)reader.readInt();
+		deviceContext->DrawIndexed(indexCount, startIndex, baseVertex);
+		break;
+	}
+
+	case COMMAND_DRAW_INSTANCED:
+	{
+		UINT vertexCount = (UINT)reader.readUInt();
+		UINT instanceCount = (UINT)reader.readUInt();
+		UINT startVertex = (UINT)reader.readUInt();
+		UINT startInstance = (UINT)reader.readUInt();
+		deviceContext->DrawInstanced(vertexCount, instanceCount, startVertex, startInstance);
+		break;
+	}
+
+	case COMMAND_DRAW_INDEXED_INSTANCED:
+	{
+		UINT indexCount = (UINT)reader.readUInt();
+		UINT instanceCount = (UINT)reader.readUInt();
+		UINT startIndex = (UINT)reader.readUInt();
+		INT baseVertex = (INT)reader.readInt();
+		UINT startInstance = (UINT)reader.readUInt();
+		deviceContext->DrawIndexedInstanced(indexCount, instanceCount, startIndex, baseVertex, startInstance);
+		break;
+	}
+
+	case COMMAND_DRAW_INSTANCED_INDIRECT:
+	case COMMAND_DRAW_INDEXED_INSTANCED_INDIRECT:
+	case COMMAND_DISPATCH_INDIRECT:
+	{
+		ID3D11Buffer* arguments = readObject<ID3D11Buffer>(reader);
+		UINT offset = (UINT)reader.readUInt();
+		if (!arguments)
+		{
+			break;
+		}
+		if (op == COMMAND_DRAW_INSTANCED_INDIRECT)
+		{
+			deviceContext->DrawInstancedIndirect(arguments, offset);
+		}
+		else if (op == COMMAND_DRAW_INDEXED_INSTANCED_INDIRECT)
+		{
+			deviceContext->DrawIndexedInstancedIndirect(arguments, offset);
+		}
+		else
+		{
+			deviceContext->DispatchIndirect(arguments, offset);
+		}
+		break;
+	}
+
+	case COMMAND_DISPATCH:
+	{
+		UINT x = (UINT)reader.readUInt();
+		UINT y = (UINT)reader.readUInt();
+		UINT z = (UINT)reader.readUInt();
+		deviceContext->Dispatch(x, y, z);
+		break;
+	}
+
+	default:
+		break;
+	}
+}
+
+bool CommandTrace::save(const char* filename) const
+{
+	ofstream file(filename, ios::binary);
+	if (!file)
+	{
+		return false;
+	}
+
+	// Magic, version, frame, object and command counts, then a byte per object saying what it was, then the stream itself
+	const char magic[4] = { 'C', 'T', 'R', 'C' };
+	uint32_t header[4] = { 2, (uint32_t)stats.frames, (uint32_t)objects.size(), (uint32_t)min(stats.commands, (unsigned long long)UINT32_MAX) };
+	uint64_t streamBytes = bytes.size();
+	file.write(magic, sizeof(magic));
+	file.write((const char*)header, sizeof(header));
+	file.write((const char*)&streamBytes, sizeof(streamBytes));
+
+	vector<uint8_t> kinds(objects.size(), 0);
+	for (size_t i = 0; i < objects.size(); i++)
+	{
+		// Just enough to tell the object apart: resources by their dimension, everything else as 0
+		ID3D11Resource* resource = NULL;
+		if (objects[i]->QueryInterface(__uuidof(ID3D11Resource), (void**)&resource) == S_OK)
+		{
+			D3D11_RESOURCE_DIMENSION dimension;
+			resource->GetType(&dimension);
+			kinds[i] = (uint8_t)dimension;
+			resource->Release();
+		}
+	}
+	file.write((const char*)kinds.data(), kinds.size());
+	file.write((const char*)bytes.data(), bytes.size());
+	return file.good();
+}
+
+const char* CommandTrace::getOpName(CommandOp op)
+{
+	switch (op)
+	{
+	case COMMAND_FRAME_END: return "Frame End";
+	case COMMAND_BEGIN_PASS: return "Begin Pass";
+	case COMMAND_SET_SHADER: return "Set Shader";
+	case COMMAND_SET_CONSTANT_BUFFERS: return "Set Constant Buffers";
+	case COMMAND_SET_SHADER_RESOURCES: return "Set Shader Resources";
+	case COMMAND_SET_SAMPLERS: return "Set Samplers";
+	case COMMAND_SET_UNORDERED_ACCESS_VIEWS: return "Set UAVs";
+	case COMMAND_SET_OUTPUT_UNORDERED_ACCESS_VIEWS: return "Set Output UAVs";
+	case COMMAND_SET_INPUT_LAYOUT: return "Set Input Layout";
+	case COMMAND_SET_VERTEX_BUFFERS: return "Set Vertex Buffers";
+	case COMMAND_SET_INDEX_BUFFER: return "Set Index Buffer";
+	case COMMAND_SET_TOPOLOGY: return "Set Topology";
+	case COMMAND_SET_TARGETS: return "Set Targets";
+	case COMMAND_SET_VIEWPORTS: return "Set Viewports";
+	case COMMAND_SET_SCISSORS: return "Set Scissors";
+	case COMMAND_SET_BLEND_STATE: return "Set Blend State";
+	case COMMAND_SET_DEPTH_STENCIL_STATE: return "Set Depth Stencil State";
+	case COMMAND_SET_RASTERIZER_STATE: return "Set Rasterizer State";
+	case COMMAND_UPDATE_MAPPED: return "Update Mapped";
+	case COMMAND_UPDATE_SUBRESOURCE: return "Update Subresource";
+	case COMMAND_COPY_RESOURCE: return "Copy Resource";
+	case COMMAND_COPY_SUBRESOURCE_REGION: return "Copy Region";
+	case COMMAND_COPY_STRUCTURE_COUNT: return "Copy Structure Count";
+	case COMMAND_RESOLVE_SUBRESOURCE: return "Resolve";
+	case COMMAND_CLEAR_RENDER_TARGET: return "Clear Render Target";
+	case COMMAND_CLEAR_DEPTH_STENCIL: return "Clear Depth Stencil";
+	case COMMAND_CLEAR_UNORDERED_ACCESS_FLOAT: return "Clear UAV Float";
+	case COMMAND_CLEAR_UNORDERED_ACCESS_UINT: return "Clear UAV Uint";
+	case COMMAND_GENERATE_MIPS: return "Generate Mips";
+	case COMMAND_SET_RESOURCE_MIN_LOD: return "Set Min LOD";
+	case COMMAND_DRAW: return "Draw";
+	case COMMAND_DRAW_INDEXED: return "Draw Indexed";
+	case COMMAND_DRAW_INSTANCED: return "Draw Instanced";
+	case COMMAND_DRAW_INDEXED_INSTANCED: return "Draw Indexed Instanced";
+	case COMMAND_DRAW_INSTANCED_INDIRECT: return "Draw Instanced Indirect";
+	case COMMAND_DRAW_INDEXED_INSTANCED_INDIRECT: return "Draw Indexed Instanced Indirect";
+	case COMMAND_DISPATCH: return "Dispatch";
+	case COMMAND_DISPATCH_INDIRECT: return "Dispatch Indirect";
+	default: return "Unknown";
+	}
+}
+
+void CommandTrace::getSubresourceSize(ID3D11Resource* resource, UINT subresource, const D3D11_BOX* box, UINT& rowBytes, UINT& rows, UINT& depth)
+{
+	rowBytes = 0;
+	rows = 1;
+	depth = 1;
+	UINT width = 1;
+	UINT height = 1;
+	DXGI_FORMAT format = DXGI_FORMAT_UNKNOWN;
+
+	D3D11_RESOURCE_DIMENSION dimension;
+	resource->GetType(&dimension);
+	switch (dimension)
+	{
+	case D3D11_RESOURCE_DIMENSION_BUFFER:
+	{
+		D3D11_BUFFER_DESC desc;
+		static_cast<ID3D11Buffer*>(resource)->GetDesc(&desc);
+		rowBytes = box ? (box->right > box->left ? box->right - box->left : 0) : desc.ByteWidth;
+		return;
+	}
+	case D3D11_RESOURCE_DIMENSION_TEXTURE1D:
+	{
+		D3D11_TEXTURE1D_DESC desc;
+		static_cast<ID3D11Texture1D*>(resource)->GetDesc(&desc);
+		width = max(desc.Width >> (subresource % max(desc.MipLevels, 1u)), 1u);
+		format = desc.Format;
+		break;
+	}
+	case D3D11_RESOURCE_DIMENSION_TEXTURE2D:
+	{
+		D3D11_TEXTURE2D_DESC desc;
+		static_cast<ID3D11Texture2D*>(resource)->GetDesc(&desc);
+		UINT mip = subresource % max(desc.MipLevels, 1u);
+		width = max(desc.Width >> mip, 1u);
+		height = max(desc.Height >> mip, 1u);
+		format = desc.Format;
+		break;
+	}
+	case D3D11_RESOURCE_DIMENSION_TEXTURE3D:
+	{
+		D3D11_TEXTURE3D_DESC desc;
+		static_cast<ID3D11Texture3D*>(resource)->GetDesc(&desc);
+		UINT mip = subresource % max(desc.MipLevels, 1u);
+		width = max(desc.Width >> mip, 1u);
+		height = max(desc.Height >> mip, 1u);
+		depth = max(desc.Depth >> mip, 1u);
+		format = desc.Format;
+		break;
+	}
+	default:
+		return;
+	}
+
+	if (box)
+	{
+		width = box->right > box->left ? box->right - box->left : 0;
+		height = box->bottom > box->top ? box->bottom - box->top : 0;
+		depth = box->back > box->front ? box->back - box->front : 0;
+	}
+
+	// Block compressed rows are a row of 4x4 blocks
+	UINT bits = MemoryTracker::getFormatBits(format);
+	if (MemoryTracker::isBlockCompressed(format))
+	{
+		rowBytes = (width + 3) / 4 * bits * 2;
+		rows = (height + 3) / 4;
+	}
+	else
+	{
+		rowBytes = (width * bits + 7) / 8;
+		rows = height;
+	}
+}
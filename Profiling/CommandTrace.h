@@ -0,0 +1,163 @@
+// A recorded stream of rendering commands: the passes' pipeline bindings, the data uploaded into buffers and textures, and every draw,
+// dispatch, copy and clear, with none of the application logic that decided them. Commands are a one byte op followed by their fields
+// as variable length integers, and pipeline objects are referred to by small ids into a table the trace holds a reference to each of, so
+// the trace keeps everything it draws with alive and can be replayed at full speed against the same device as many times as wanted.
+// Written to disk the table only records what kind of object each id was, as the objects themselves belong to the session
+#pragma once
+
+#include "DXF.h"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+enum CommandOp
+{
+	COMMAND_FRAME_END,
+	COMMAND_BEGIN_PASS,
+	COMMAND_SET_SHADER,
+	COMMAND_SET_CONSTANT_BUFFERS,
+	COMMAND_SET_SHADER_RESOURCES,
+	COMMAND_SET_SAMPLERS,
+	COMMAND_SET_UNORDERED_ACCESS_VIEWS,
+	COMMAND_SET_OUTPUT_UNORDERED_ACCESS_VIEWS,
+	COMMAND_SET_INPUT_LAYOUT,
+	COMMAND_SET_VERTEX_BUFFERS,
+	COMMAND_SET_INDEX_BUFFER,
+	COMMAND_SET_TOPOLOGY,
+	COMMAND_SET_TARGETS,
+	COMMAND_SET_VIEWPORTS,
+	COMMAND_SET_SCISSORS,
+	COMMAND_SET_BLEND_STATE,
+	COMMAND_SET_DEPTH_STENCIL_STATE,
+	COMMAND_SET_RASTERIZER_STATE,
+	COMMAND_UPDATE_MAPPED,
+	COMMAND_UPDATE_SUBRESOURCE,
+	COMMAND_COPY_RESOURCE,
+	COMMAND_COPY_SUBRESOURCE_REGION,
+	COMMAND_COPY_STRUCTURE_COUNT,
+	COMMAND_RESOLVE_SUBRESOURCE,
+	COMMAND_CLEAR_RENDER_TARGET,
+	COMMAND_CLEAR_DEPTH_STENCIL,
+	COMMAND_CLEAR_UNORDERED_ACCESS_FLOAT,
+	COMMAND_CLEAR_UNORDERED_ACCESS_UINT,
+	COMMAND_GENERATE_MIPS,
+	COMMAND_SET_RESOURCE_MIN_LOD,
+	COMMAND_DRAW,
+	COMMAND_DRAW_INDEXED,
+	COMMAND_DRAW_INSTANCED,
+	COMMAND_DRAW_INDEXED_INSTANCED,
+	COMMAND_DRAW_INSTANCED_INDIRECT,
+	COMMAND_DRAW_INDEXED_INSTANCED_INDIRECT,
+	COMMAND_DISPATCH,
+	COMMAND_DISPATCH_INDIRECT,
+	COMMAND_OPS
+};
+
+// The programmable stages, in place of the separate call each stage has for every binding
+enum CommandStage
+{
+	COMMAND_STAGE_VERTEX,
+	COMMAND_STAGE_HULL,
+	COMMAND_STAGE_DOMAIN,
+	COMMAND_STAGE_GEOMETRY,
+	COMMAND_STAGE_PIXEL,
+	COMMAND_STAGE_COMPUTE,
+	COMMAND_STAGES
+};
+
+struct CommandTraceStats
+{
+	int frames;
+	unsigned long long commands;
+	unsigned long long draws;
+	unsigned long long dispatches;
+	unsigned long long bindings;
+	unsigned long long uploads;
+	int objects;
+
+	// Bytes of the commands themselves, and of the buffer and texture data they upload
+	unsigned long long commandBytes;
+	unsigned long long dataBytes;
+	unsigned long long opCounts[COMMAND_OPS];
+};
+
+struct CommandReplayStats
+{
+	int iterations;
+	int frames;
+	unsigned long long commands;
+	unsigned long long draws;
+
+	// CPU time issuing the commands, and the time until the GPU had finished them too
+	double submitMilliseconds;
+	double totalMilliseconds;
+	double framesPerSecond;
+	double commandsPerSecond;
+	double megabytesPerSecond;
+};
+
+class CommandTrace
+{
+public:
+	CommandTrace();
+	~CommandTrace();
+
+	// Drops every command and the references to every object
+	void clear();
+
+	// Replays the trace iterations times on the device context, as fast as it will take them, then waits for the GPU to finish
+	bool replay(ID3D11DeviceContext* deviceContext, int iterations, CommandReplayStats& stats) const;
+
+	// Writes the trace as a header, the kind of each object and the command stream
+	bool save(const char* filename) const;
+
+	bool isEmpty() const { return stats.commands == 0; }
+	const CommandTraceStats& getStats() const { return stats; }
+	unsigned long long getBytes() const { return bytes.size(); }
+	static const char* getOpName(CommandOp op);
+
+	// Rows and slices of a subresource, or of the box in it, counting block compressed rows in blocks, and the bytes of one row
+	static void getSubresourceSize(ID3D11Resource* resource, UINT subresource, const D3D11_BOX* box, UINT& rowBytes, UINT& rows, UINT& depth);
+
+	// Writing, for the recorder. Ids are 0 for no object, and an object's first id holds a reference to it
+	void beginCommand(CommandOp op);
+	void endFrame();
+	void writeUInt(uint64_t value);
+	void writeInt(int64_t value);
+	void writeFloat(float value);
+	void writeData(const void* data, size_t size);
+	void writeString(const char* text);
+	void writeObject(ID3D11DeviceChild* object);
+	void writeObjects(ID3D11DeviceChild* const* objects, UINT count);
+	uint32_t getObjectId(ID3D11DeviceChild* object);
+
+private:
+	// Reads fields back in the order they were written, from a position in the stream. Reading past the end, or anything that can't have
+	// been written, marks the stream as failed and reads zeros from then on
+	struct Reader
+	{
+		const uint8_t* data;
+		size_t position;
+		size_t size;
+		bool failed;
+
+		uint64_t readUInt();
+		UINT readCount(UINT limit);
+		int64_t readInt();
+		float readFloat();
+		const uint8_t* readData(size_t& length);
+	};
+
+	template <typename T> T* readObject(Reader& reader) const;
+	template <typename T> void readObjects(Reader& reader, UINT slot, UINT slots, T** items, UINT& count) const;
+	void execute(ID3D11DeviceContext* deviceContext, Reader& reader, CommandOp op) const;
+
+	vector<uint8_t> bytes;
+	vector<ID3D11DeviceChild*> objects;
+	unordered_map<ID3D11DeviceChild*, uint32_t> objectIds;
+	CommandTraceStats stats;
+	size_t commandStart;
+};
@@ -0,0 +1,748 @@
+#include "FrameCapture.h"
+#include "MemoryTracker.h"
+#include <DirectXPackedVector.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+using namespace DirectX::PackedVector;
+
+// Precedes every frame in a raw sequence file, followed by width x height x channels floats
+struct RawFrameHeader
+{
+	unsigned long long frame;
+	int width;
+	int height;
+	int channels;
+	int padding;
+};
+
+FrameCapture::FrameCapture(const string& lprefix, int lqueueSize)
+{
+	prefix = lprefix;
+	queueSize = max(lqueueSize, 1);
+	frameIndex = 0;
+	frameMilliseconds = 0.0;
+	encoderBusy = false;
+	stopEncoder = false;
+	memset(&stats, 0, sizeof(stats));
+
+	encoder = thread(&FrameCapture::encoderThread, this);
+}
+
+FrameCapture::~FrameCapture()
+{
+	// The encoder writes out everything already queued before it stops. Copies still in the staging rings are lost unless flushed first
+	if (encoder.joinable())
+	{
+		{
+			lock_guard<mutex> lock(encoderMutex);
+			stopEncoder = true;
+		}
+		encoderCondition.notify_all();
+		spaceCondition.notify_all();
+		encoder.join();
+	}
+
+	for (Stream& stream : streams)
+	{
+		releaseStaging(stream);
+	}
+}
+
+int FrameCapture::addStream(const string& name)
+{
+	Stream stream;
+	stream.name = name;
+	for (int slot = 0; slot < CAPTURE_LATENCY; slot++)
+	{
+		stream.staging[slot] = 0;
+		stream.pending[slot] = false;
+		stream.frame[slot] = 0;
+		stream.width[slot] = 0;
+		stream.height[slot] = 0;
+	}
+	stream.stagingWidth = 0;
+	stream.stagingHeight = 0;
+	stream.format = DXGI_FORMAT_UNKNOWN;
+	stream.index = 0;
+	streams.push_back(stream);
+	return (int)streams.size() - 1;
+}
+
+void FrameCapture::capture(ID3D11DeviceContext* deviceContext, int stream, ID3D11ShaderResourceView* source, int width, int height)
+{
+	if (stream < 0 || stream >= (int)streams.size() || !source)
+	{
+		return;
+	}
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+	Stream& captured = streams[stream];
+
+	ID3D11Resource* resource = 0;
+	source->GetResource(&resource);
+	ID3D11Texture2D* texture = 0;
+	resource->QueryInterface(__uuidof(ID3D11Texture2D), (void**)&texture);
+	resource->Release();
+	if (!texture)
+	{
+		return;
+	}
+
+	// Multisampled textures would need resolving first, and none of the captured targets are
+	D3D11_TEXTURE2D_DESC desc;
+	texture->GetDesc(&desc);
+	D3D11_SHADER_RESOURCE_VIEW_DESC viewDesc;
+	source->GetDesc(&viewDesc);
+	if (desc.SampleDesc.Count > 1 || getBytesPerTexel(viewDesc.Format) == 0)
+	{
+		texture->Release();
+		return;
+	}
+	if (!captured.staging[0] || captured.stagingWidth != desc.Width || captured.stagingHeight != desc.Height || captured.format != viewDesc.Format)
+	{
+		createStaging(captured, texture, desc, viewDesc.Format);
+	}
+
+	// The slot about to be reused still holds a copy when update hasn't been able to read it back yet. Blocking waits for it, dropping
+	// skips this frame's copy instead so the GPU is never waited on
+	int slot = captured.index;
+	if (captured.pending[slot] && !readSlot(deviceContext, stream, slot, policy == CAPTURE_BLOCK))
+	{
+		lock_guard<mutex> lock(encoderMutex);
+		stats.dropped++;
+	}
+	else
+	{
+		D3D11_BOX box;
+		box.left = 0;
+		box.top = 0;
+		box.front = 0;
+		box.right = (UINT)min(max(width, 1), (int)desc.Width);
+		box.bottom = (UINT)min(max(height, 1), (int)desc.Height);
+		box.back = 1;
+		deviceContext->CopySubresourceRegion(captured.staging[slot], 0, 0, 0, 0, texture, 0, &box);
+		captured.pending[slot] = true;
+		captured.frame[slot] = frameIndex;
+		captured.width[slot] = (int)box.right;
+		captured.height[slot] = (int)box.bottom;
+		captured.index = (slot + 1) % CAPTURE_LATENCY;
+
+		lock_guard<mutex> lock(encoderMutex);
+		stats.captured++;
+	}
+	texture->Release();
+
+	frameMilliseconds += chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+}
+
+void FrameCapture::captureCpu(int stream, const void* data, int width, int height, int rowPitch, DXGI_FORMAT format)
+{
+	int texelBytes = getBytesPerTexel(format);
+	if (stream < 0 || stream >= (int)streams.size() || !data || width <= 0 || height <= 0 || texelBytes == 0)
+	{
+		return;
+	}
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+
+	if (reserveQueueSlot())
+	{
+		CapturedFrame frame;
+		frame.stream = stream;
+		frame.name = streams[stream].name;
+		frame.frame = frameIndex;
+		frame.width = width;
+		frame.height = height;
+		frame.format = format;
+		frame.fileFormat = fileFormat;
+
+		size_t rowBytes = (size_t)width * texelBytes;
+		frame.pixels = takeBuffer(rowBytes * height);
+		for (int y = 0; y < height; y++)
+		{
+			memcpy(&frame.pixels[y * rowBytes], (const unsigned char*)data + (size_t)y * rowPitch, rowBytes);
+		}
+		enqueue(frame);
+
+		lock_guard<mutex> lock(encoderMutex);
+		stats.captured++;
+	}
+
+	frameMilliseconds += chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+}
+
+void FrameCapture::update(ID3D11DeviceContext* deviceContext)
+{
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+
+	// Reads each ring oldest first, stopping at the first copy that is too new or that the GPU hasn't finished, so frames stay in order
+	int inFlight = 0;
+	for (int stream = 0; stream < (int)streams.size(); stream++)
+	{
+		Stream& captured = streams[stream];
+		for (int i = 0; i < CAPTURE_LATENCY; i++)
+		{
+			int slot = (captured.index + i) % CAPTURE_LATENCY;
+			if (!captured.pending[slot])
+			{
+				continue;
+			}
+			if (frameIndex - captured.frame[slot] < CAPTURE_LATENCY - 1 || !readSlot(deviceContext, stream, slot, false))
+			{
+				break;
+			}
+		}
+		for (int slot = 0; slot < CAPTURE_LATENCY; slot++)
+		{
+			inFlight += captured.pending[slot];
+		}
+	}
+
+	frameMilliseconds += chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+	{
+		lock_guard<mutex> lock(encoderMutex);
+		stats.frameMilliseconds = frameMilliseconds;
+		stats.peakFrameMilliseconds = max(stats.peakFrameMilliseconds, frameMilliseconds);
+		stats.inFlight = inFlight;
+	}
+	frameMilliseconds = 0.0;
+	frameIndex++;
+}
+
+void FrameCapture::flush(ID3D11DeviceContext* deviceContext)
+{
+	for (int stream = 0; stream < (int)streams.size(); stream++)
+	{
+		Stream& captured = streams[stream];
+		for (int i = 0; i < CAPTURE_LATENCY; i++)
+		{
+			int slot = (captured.index + i) % CAPTURE_LATENCY;
+			if (captured.pending[slot])
+			{
+				readSlot(deviceContext, stream, slot, true);
+			}
+		}
+	}
+
+	unique_lock<mutex> lock(encoderMutex);
+	spaceCondition.wait(lock, [this] { return queue.empty() && !encoderBusy; });
+	stats.inFlight = 0;
+}
+
+FrameCaptureStats FrameCapture::getStats() const
+{
+	lock_guard<mutex> lock(encoderMutex);
+	return stats;
+}
+
+const char* FrameCapture::getName(CaptureFileFormat format)
+{
+	switch (format)
+	{
+	case CAPTURE_PNG:
+		return "PNG";
+	case CAPTURE_EXR:
+		return "EXR";
+	case CAPTURE_RAW:
+		return "Raw Sequence";
+	default:
+		return "Unknown";
+	}
+}
+
+int FrameCapture::getBytesPerTexel(DXGI_FORMAT format)
+{
+	switch (format)
+	{
+	case DXGI_FORMAT_R32G32B32A32_FLOAT:
+		return 16;
+	case DXGI_FORMAT_R16G16B16A16_FLOAT:
+		return 8;
+	case DXGI_FORMAT_R8G8B8A8_UNORM:
+	case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+	case DXGI_FORMAT_B8G8R8A8_UNORM:
+	case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+	case DXGI_FORMAT_R32_FLOAT:
+		return 4;
+	case DXGI_FORMAT_R16_FLOAT:
+	case DXGI_FORMAT_R16_UNORM:
+		return 2;
+	default:
+		return 0;
+	}
+}
+
+void FrameCapture::createStaging(Stream& stream, ID3D11Texture2D* source, const D3D11_TEXTURE2D_DESC& sourceDesc, DXGI_FORMAT viewFormat)
+{
+	// Copies still in the old ring can't be read back once it is released
+	int lost = 0;
+	for (int slot = 0; slot < CAPTURE_LATENCY; slot++)
+	{
+		lost += stream.pending[slot];
+	}
+	if (lost > 0)
+	{
+		lock_guard<mutex> lock(encoderMutex);
+		stats.dropped += lost;
+	}
+	releaseStaging(stream);
+
+	ID3D11Device* device = 0;
+	source->GetDevice(&device);
+	D3D11_TEXTURE2D_DESC stagingDesc = sourceDesc;
+	stagingDesc.MipLevels = 1;
+	stagingDesc.ArraySize = 1;
+	stagingDesc.Usage = D3D11_USAGE_STAGING;
+	stagingDesc.BindFlags = 0;
+	stagingDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	stagingDesc.MiscFlags = 0;
+	for (int slot = 0; slot < CAPTURE_LATENCY; slot++)
+	{
+		stream.staging[slot] = 0;
+		device->CreateTexture2D(&stagingDesc, NULL, &stream.staging[slot]);
+		MemoryTracker::track(stream.staging[slot], MEMORY_STAGING, "Frame capture readback");
+		stream.pending[slot] = false;
+	}
+	device->Release();
+
+	stream.stagingWidth = sourceDesc.Width;
+	stream.stagingHeight = sourceDesc.Height;
+	stream.format = viewFormat;
+	stream.index = 0;
+}
+
+void FrameCapture::releaseStaging(Stream& stream)
+{
+	for (int slot = 0; slot < CAPTURE_LATENCY; slot++)
+	{
+		if (stream.staging[slot])
+		{
+			stream.staging[slot]->Release();
+			stream.staging[slot] = 0;
+		}
+		stream.pending[slot] = false;
+	}
+}
+
+bool FrameCapture::readSlot(ID3D11DeviceContext* deviceContext, int stream, int slot, bool wait)
+{
+	Stream& captured = streams[stream];
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	if (deviceContext->Map(captured.staging[slot], 0, D3D11_MAP_READ, wait ? 0 : D3D11_MAP_FLAG_DO_NOT_WAIT, &mappedResource) != S_OK)
+	{
+		return false;
+	}
+
+	// The copy is finished with either way, so the slot is free even if the encoder has no room for it
+	if (reserveQueueSlot())
+	{
+		CapturedFrame frame;
+		frame.stream = stream;
+		frame.name = captured.name;
+		frame.frame = captured.frame[slot];
+		frame.width = captured.width[slot];
+		frame.height = captured.height[slot];
+		frame.format = captured.format;
+		frame.fileFormat = fileFormat;
+
+		size_t rowBytes = (size_t)frame.width * getBytesPerTexel(frame.format);
+		frame.pixels = takeBuffer(rowBytes * frame.height);
+		for (int y = 0; y < frame.height; y++)
+		{
+			memcpy(&frame.pixels[y * rowBytes], (const unsigned char*)mappedResource.pData + (size_t)y * mappedResource.RowPitch, rowBytes);
+		}
+		deviceContext->Unmap(captured.staging[slot], 0);
+		enqueue(frame);
+	}
+	else
+	{
+		deviceContext->Unmap(captured.staging[slot], 0);
+	}
+	captured.pending[slot] = false;
+	return true;
+}
+
+vector<unsigned char> FrameCapture::takeBuffer(size_t bytes)
+{
+	vector<unsigned char> buffer;
+	{
+		lock_guard<mutex> lock(encoderMutex);
+		if (!freeBuffers.empty())
+		{
+			buffer = move(freeBuffers.back());
+			freeBuffers.pop_back();
+		}
+	}
+	buffer.resize(bytes);
+	return buffer;
+}
+
+bool FrameCapture::reserveQueueSlot()
+{
+	unique_lock<mutex> lock(encoderMutex);
+	if ((int)queue.size() < queueSize)
+	{
+		return true;
+	}
+	if (policy == CAPTURE_DROP)
+	{
+		stats.dropped++;
+		return false;
+	}
+	spaceCondition.wait(lock, [this] { return (int)queue.size() < queueSize || stopEncoder; });
+	return true;
+}
+
+void FrameCapture::enqueue(CapturedFrame& frame)
+{
+	{
+		lock_guard<mutex> lock(encoderMutex);
+		queue.push_back(move(frame));
+		stats.queued = (int)queue.size();
+	}
+	encoderCondition.notify_one();
+}
+
+void FrameCapture::encoderThread()
+{
+	// Converts and writes frames in the order they were queued, handing their buffers back to be reused
+	while (true)
+	{
+		CapturedFrame frame;
+		{
+			unique_lock<mutex> lock(encoderMutex);
+			encoderCondition.wait(lock, [this] { return stopEncoder || !queue.empty(); });
+			if (queue.empty())
+			{
+				return;
+			}
+			frame = move(queue.front());
+			queue.pop_front();
+			stats.queued = (int)queue.size();
+			encoderBusy = true;
+		}
+		spaceCondition.notify_all();
+
+		chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+		unsigned long long bytes = 0;
+		bool written = encode(frame, bytes);
+		double milliseconds = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+
+		{
+			lock_guard<mutex> lock(encoderMutex);
+			encoderBusy = false;
+			stats.encodeMilliseconds = milliseconds;
+			stats.written += written;
+			stats.failed += !written;
+			stats.bytesWritten += bytes;
+			if ((int)freeBuffers.size() < queueSize)
+			{
+				freeBuffers.push_back(move(frame.pixels));
+			}
+		}
+		spaceCondition.notify_all();
+	}
+}
+
+bool FrameCapture::encode(const CapturedFrame& frame, unsigned long long& bytes)
+{
+	vector<float> values;
+	int channels = convert(frame, values);
+	if (channels == 0)
+	{
+		return false;
+	}
+
+	char number[32];
+	sprintf_s(number, "_%06llu", frame.frame);
+	string filename = prefix + frame.name + number;
+	switch (frame.fileFormat)
+	{
+	case CAPTURE_PNG:
+		return writePng(filename + ".png", frame.width, frame.height, channels, values, bytes);
+	case CAPTURE_EXR:
+		return writeExr(filename + ".exr", frame.width, frame.height, channels, values, bytes);
+	case CAPTURE_RAW:
+		return writeRaw(frame, channels, values, bytes);
+	default:
+		return false;
+	}
+}
+
+int FrameCapture::convert(const CapturedFrame& frame, vector<float>& values)
+{
+	size_t texels = (size_t)frame.width * frame.height;
+	const unsigned char* pixels = frame.pixels.data();
+	switch (frame.format)
+	{
+	case DXGI_FORMAT_R32G32B32A32_FLOAT:
+		values.resize(texels * 4);
+		memcpy(values.data(), pixels, texels * 16);
+		return 4;
+	case DXGI_FORMAT_R16G16B16A16_FLOAT:
+		values.resize(texels * 4);
+		for (size_t i = 0; i < texels * 4; i++)
+		{
+			values[i] = XMConvertHalfToFloat(((const HALF*)pixels)[i]);
+		}
+		return 4;
+	case DXGI_FORMAT_R8G8B8A8_UNORM:
+	case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+	case DXGI_FORMAT_B8G8R8A8_UNORM:
+	case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+	{
+		// BGRA is swapped round to RGBA, so every writer sees the channels in the same order
+		bool bgra = frame.format == DXGI_FORMAT_B8G8R8A8_UNORM || frame.format == DXGI_FORMAT_B8G8R8A8_UNORM_SRGB;
+		values.resize(texels * 4);
+		for (size_t i = 0; i < texels; i++)
+		{
+			const unsigned char* texel = pixels + i * 4;
+			values[i * 4 + 0] = texel[bgra ? 2 : 0] / 255.0f;
+			values[i * 4 + 1] = texel[1] / 255.0f;
+			values[i * 4 + 2] = texel[bgra ? 0 : 2] / 255.0f;
+			values[i * 4 + 3] = texel[3] / 255.0f;
+		}
+		return 4;
+	}
+	case DXGI_FORMAT_R32_FLOAT:
+		values.resize(texels);
+		memcpy(values.data(), pixels, texels * 4);
+		return 1;
+	case DXGI_FORMAT_R16_FLOAT:
+		values.resize(texels);
+		for (size_t i = 0; i < texels; i++)
+		{
+			values[i] = XMConvertHalfToFloat(((const HALF*)pixels)[i]);
+		}
+		return 1;
+	case DXGI_FORMAT_R16_UNORM:
+		values.resize(texels);
+		for (size_t i = 0; i < texels; i++)
+		{
+			values[i] = ((const unsigned short*)pixels)[i] / 65535.0f;
+		}
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+// PNG chunks and the zlib stream inside them are checked with CRC-32 and Adler-32
+static unsigned int pngCrc(const unsigned char* data, size_t length, unsigned int crc = 0)
+{
+	static unsigned int table[256];
+	static bool tableBuilt = false;
+	if (!tableBuilt)
+	{
+		for (unsigned int n = 0; n < 256; n++)
+		{
+			unsigned int c = n;
+			for (int k = 0; k < 8; k++)
+			{
+				c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			}
+			table[n] = c;
+		}
+		tableBuilt = true;
+	}
+	crc = ~crc;
+	for (size_t i = 0; i < length; i++)
+	{
+		crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+static void appendBigEndian(vector<unsigned char>& output, unsigned int value)
+{
+	output.push_back((unsigned char)(value >> 24));
+	output.push_back((unsigned char)(value >> 16));
+	output.push_back((unsigned char)(value >> 8));
+	output.push_back((unsigned char)value);
+}
+
+static void appendPngChunk(vector<unsigned char>& output, const char* type, const vector<unsigned char>& data)
+{
+	appendBigEndian(output, (unsigned int)data.size());
+	size_t start = output.size();
+	output.insert(output.end(), type, type + 4);
+	output.insert(output.end(), data.begin(), data.end());
+	appendBigEndian(output, pngCrc(&output[start], output.size() - start));
+}
+
+bool FrameCapture::writePng(const string& filename, int width, int height, int channels, const vector<float>& values, unsigned long long& bytes)
+{
+	// Colour is written as 8 bit RGB, clamped as the back buffer would, and single channel frames such as depth as 16 bit grey.
+	// Every row starts with a zero byte, meaning it is stored unfiltered
+	int sampleBytes = channels == 1 ? 2 : 1;
+	int outputChannels = channels == 1 ? 1 : 3;
+	size_t rowBytes = 1 + (size_t)width * outputChannels * sampleBytes;
+	vector<unsigned char> scanlines(rowBytes * height);
+	for (int y = 0; y < height; y++)
+	{
+		unsigned char* row = &scanlines[y * rowBytes];
+		*row++ = 0;
+		for (int x = 0; x < width; x++)
+		{
+			const float* texel = &values[((size_t)y * width + x) * channels];
+			if (channels == 1)
+			{
+				unsigned int grey = (unsigned int)(min(max(texel[0], 0.0f), 1.0f) * 65535.0f + 0.5f);
+				*row++ = (unsigned char)(grey >> 8);
+				*row++ = (unsigned char)grey;
+			}
+			else
+			{
+				for (int c = 0; c < 3; c++)
+				{
+					*row++ = (unsigned char)(min(max(texel[c], 0.0f), 1.0f) * 255.0f + 0.5f);
+				}
+			}
+		}
+	}
+
+	// The zlib stream uses stored blocks rather than compressing, trading file size for keeping the encoder well ahead of the frame rate
+	vector<unsigned char> compressed;
+	compressed.reserve(scanlines.size() + scanlines.size() / 65535 * 5 + 16);
+	compressed.push_back(0x78);
+	compressed.push_back(0x01);
+	size_t offset = 0;
+	do
+	{
+		size_t blockLength = min(scanlines.size() - offset, (size_t)65535);
+		bool last = offset + blockLength == scanlines.size();
+		compressed.push_back(last ? 1 : 0);
+		compressed.push_back((unsigned char)blockLength);
+		compressed.push_back((unsigned char)(blockLength >> 8));
+		compressed.push_back((unsigned char)~blockLength);
+		compressed.push_back((unsigned char)(~blockLength >> 8));
+		compressed.insert(compressed.end(), scanlines.begin() + offset, scanlines.begin() + offset + blockLength);
+		offset += blockLength;
+	} while (offset < scanlines.size());
+	unsigned int a = 1;
+	unsigned int b = 0;
+	for (unsigned char value : scanlines)
+	{
+		a = (a + value) % 65521;
+		b = (b + a) % 65521;
+	}
+	appendBigEndian(compressed, (b << 16) | a);
+
+	vector<unsigned char> header;
+	appendBigEndian(header, (unsigned int)width);
+	appendBigEndian(header, (unsigned int)height);
+	header.push_back((unsigned char)(sampleBytes * 8));
+	header.push_back(channels == 1 ? 0 : 2);
+	header.push_back(0);
+	header.push_back(0);
+	header.push_back(0);
+
+	static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	vector<unsigned char> output(signature, signature + 8);
+	appendPngChunk(output, "IHDR", header);
+	appendPngChunk(output, "IDAT", compressed);
+	appendPngChunk(output, "IEND", vector<unsigned char>());
+
+	ofstream file(filename, ios::binary | ios::trunc);
+	file.write((const char*)output.data(), output.size());
+	bytes = output.size();
+	return file.good();
+}
+
+static void appendExrAttribute(vector<unsigned char>& output, const char* name, const char* type, const void* value, int size)
+{
+	output.insert(output.end(), name, name + strlen(name) + 1);
+	output.insert(output.end(), type, type + strlen(type) + 1);
+	output.insert(output.end(), (const unsigned char*)&size, (const unsigned char*)&size + 4);
+	output.insert(output.end(), (const unsigned char*)value, (const unsigned char*)value + size);
+}
+
+bool FrameCapture::writeExr(const string& filename, int width, int height, int channels, const vector<float>& values, unsigned long long& bytes)
+{
+	// An uncompressed scanline file of 32 bit float channels, which keeps the scene's full range where the PNG has to clamp it.
+	// Channels are stored in alphabetical order, so colour is A, B, G, R, and single channel frames are Y so viewers show them as grey
+	static const char* colourNames[4] = { "A", "B", "G", "R" };
+	static const int colourSources[4] = { 3, 2, 1, 0 };
+	int nameCount = channels == 1 ? 1 : 4;
+
+	vector<unsigned char> channelList;
+	for (int c = 0; c < nameCount; c++)
+	{
+		const char* name = channels == 1 ? "Y" : colourNames[c];
+		int channelInfo[4] = { 2, 0, 1, 1 };
+		channelList.insert(channelList.end(), name, name + strlen(name) + 1);
+		channelList.insert(channelList.end(), (const unsigned char*)channelInfo, (const unsigned char*)channelInfo + sizeof(channelInfo));
+	}
+	channelList.push_back(0);
+
+	int window[4] = { 0, 0, width - 1, height - 1 };
+	unsigned char zero = 0;
+	float one = 1.0f;
+	float centre[2] = { 0.0f, 0.0f };
+	vector<unsigned char> output = { 0x76, 0x2F, 0x31, 0x01, 2, 0, 0, 0 };
+	appendExrAttribute(output, "channels", "chlist", channelList.data(), (int)channelList.size());
+	appendExrAttribute(output, "compression", "compression", &zero, 1);
+	appendExrAttribute(output, "dataWindow", "box2i", window, sizeof(window));
+	appendExrAttribute(output, "displayWindow", "box2i", window, sizeof(window));
+	appendExrAttribute(output, "lineOrder", "lineOrder", &zero, 1);
+	appendExrAttribute(output, "pixelAspectRatio", "float", &one, 4);
+	appendExrAttribute(output, "screenWindowCenter", "v2f", centre, sizeof(centre));
+	appendExrAttribute(output, "screenWindowWidth", "float", &one, 4);
+	output.push_back(0);
+
+	// Every scanline is its own chunk, found through a table of offsets from the start of the file
+	int lineBytes = width * nameCount * 4;
+	unsigned long long chunkStart = output.size() + (unsigned long long)height * 8;
+	for (int y = 0; y < height; y++)
+	{
+		unsigned long long lineOffset = chunkStart + (unsigned long long)y * (8 + lineBytes);
+		output.insert(output.end(), (const unsigned char*)&lineOffset, (const unsigned char*)&lineOffset + 8);
+	}
+	output.reserve(output.size() + (size_t)height * (8 + lineBytes));
+	vector<float> line((size_t)width * nameCount);
+	for (int y = 0; y < height; y++)
+	{
+		for (int c = 0; c < nameCount; c++)
+		{
+			int source = channels == 1 ? 0 : colourSources[c];
+			for (int x = 0; x < width; x++)
+			{
+				line[(size_t)c * width + x] = values[((size_t)y * width + x) * channels + source];
+			}
+		}
+		output.insert(output.end(), (const unsigned char*)&y, (const unsigned char*)&y + 4);
+		output.insert(output.end(), (const unsigned char*)&lineBytes, (const unsigned char*)&lineBytes + 4);
+		output.insert(output.end(), (const unsigned char*)line.data(), (const unsigned char*)line.data() + lineBytes);
+	}
+
+	ofstream file(filename, ios::binary | ios::trunc);
+	file.write((const char*)output.data(), output.size());
+	bytes = output.size();
+	return file.good();
+}
+
+bool FrameCapture::writeRaw(const CapturedFrame& frame, int channels, const vector<float>& values, unsigned long long& bytes)
+{
+	if ((int)rawFiles.size() <= frame.stream)
+	{
+		rawFiles.resize(frame.stream + 1);
+	}
+	if (!rawFiles[frame.stream])
+	{
+		rawFiles[frame.stream].reset(new ofstream(prefix + frame.name + ".raw", ios::binary | ios::trunc));
+	}
+	ofstream& file = *rawFiles[frame.stream];
+
+	RawFrameHeader header;
+	header.frame = frame.frame;
+	header.width = frame.width;
+	header.height = frame.height;
+	header.channels = channels;
+	header.padding = 0;
+	file.write((const char*)&header, sizeof(header));
+	file.write((const char*)values.data(), values.size() * sizeof(float));
+	file.flush();
+	bytes = sizeof(header) + values.size() * sizeof(float);
+	return file.good();
+}
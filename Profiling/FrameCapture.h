@@ -0,0 +1,163 @@
+// Records rendered frames to disk for offline analysis without stalling the pipeline. Each capture copies a texture into a ring of staging
+// textures which is only mapped once the copy is a few frames old, and the pixels are handed to an encoder thread that converts them and
+// writes PNG, EXR or a raw sequence. Frames that already live on the CPU, such as the software occlusion depth, skip the ring and go straight
+// to the encoder, so headless runs can be captured too
+#pragma once
+
+#include "DXF.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace DirectX;
+
+enum CaptureFileFormat
+{
+	CAPTURE_PNG,
+	CAPTURE_EXR,
+	CAPTURE_RAW,
+	CAPTURE_FILE_FORMAT_COUNT
+};
+
+// What happens to a frame when the encoder queue is full, or the staging ring still holds copies the GPU hasn't finished
+enum CapturePolicy
+{
+	CAPTURE_DROP,
+	CAPTURE_BLOCK
+};
+
+struct FrameCaptureStats
+{
+	// CPU time the render thread spent issuing copies and reading back finished ones this frame, and the most it has spent in one frame
+	double frameMilliseconds;
+	double peakFrameMilliseconds;
+
+	// Time the encoder thread took converting and writing the last frame
+	double encodeMilliseconds;
+
+	// Copies still in the staging rings, and frames waiting for the encoder
+	int inFlight;
+	int queued;
+
+	int captured;
+	int written;
+	int dropped;
+
+	// Frames the encoder couldn't convert or write
+	int failed;
+	unsigned long long bytesWritten;
+};
+
+class FrameCapture
+{
+public:
+	// Copies are read back this many frames after they are issued
+	static const int CAPTURE_LATENCY = 3;
+
+	// Frames are written to prefix, the stream's name and the frame number. At most queueSize frames wait for the encoder at once
+	FrameCapture(const string& prefix, int queueSize = 8);
+	~FrameCapture();
+
+	// Registers a stream of frames, returning the id to capture it with
+	int addStream(const string& name);
+
+	// Copies the top left width x height texels of the texture behind source into the stream's staging ring
+	void capture(ID3D11DeviceContext* deviceContext, int stream, ID3D11ShaderResourceView* source, int width, int height);
+
+	// Queues a frame that is already on the CPU, rowPitch being in bytes
+	void captureCpu(int stream, const void* data, int width, int height, int rowPitch, DXGI_FORMAT format);
+
+	// Called once a frame after the captures, reading back every copy that has had time to finish
+	void update(ID3D11DeviceContext* deviceContext);
+
+	// Waits for every copy in flight and every queued frame to be written, for the end of a recording
+	void flush(ID3D11DeviceContext* deviceContext);
+
+	FrameCaptureStats getStats() const;
+	static const char* getName(CaptureFileFormat format);
+
+	// Size of a texel in the formats frames can be converted from, or 0 for any other format, which is skipped
+	static int getBytesPerTexel(DXGI_FORMAT format);
+
+	CaptureFileFormat fileFormat = CAPTURE_PNG;
+	CapturePolicy policy = CAPTURE_DROP;
+
+private:
+	// Pixels read back from a staging texture or handed over from the CPU, rows packed tightly
+	struct CapturedFrame
+	{
+		int stream;
+		string name;
+		unsigned long long frame;
+		int width;
+		int height;
+		DXGI_FORMAT format;
+		CaptureFileFormat fileFormat;
+		vector<unsigned char> pixels;
+	};
+
+	// A stream's staging ring, recreated whenever the texture it captures changes size or format
+	struct Stream
+	{
+		string name;
+		ID3D11Texture2D* staging[CAPTURE_LATENCY];
+		UINT stagingWidth;
+		UINT stagingHeight;
+
+		// Format the texels are read as, which is the view's where the texture itself is typeless
+		DXGI_FORMAT format;
+		bool pending[CAPTURE_LATENCY];
+		unsigned long long frame[CAPTURE_LATENCY];
+		int width[CAPTURE_LATENCY];
+		int height[CAPTURE_LATENCY];
+		int index;
+	};
+
+	void createStaging(Stream& stream, ID3D11Texture2D* source, const D3D11_TEXTURE2D_DESC& sourceDesc, DXGI_FORMAT viewFormat);
+	void releaseStaging(Stream& stream);
+
+	// Maps one slot of the ring into a frame for the encoder, waiting for the GPU only if wait is set. False if the copy hasn't finished
+	bool readSlot(ID3D11DeviceContext* deviceContext, int stream, int slot, bool wait);
+
+	// Takes a pixel buffer from the ones the encoder has finished with, so recording doesn't allocate every frame
+	vector<unsigned char> takeBuffer(size_t bytes);
+
+	// Makes room in the encoder queue as the policy says, returning false if the frame should be dropped
+	bool reserveQueueSlot();
+	void enqueue(CapturedFrame& frame);
+
+	void encoderThread();
+	bool encode(const CapturedFrame& frame, unsigned long long& bytes);
+
+	// Turns a frame's texels into floats, one or four channels
+	static int convert(const CapturedFrame& frame, vector<float>& values);
+	static bool writePng(const string& filename, int width, int height, int channels, const vector<float>& values, unsigned long long& bytes);
+	static bool writeExr(const string& filename, int width, int height, int channels, const vector<float>& values, unsigned long long& bytes);
+	bool writeRaw(const CapturedFrame& frame, int channels, const vector<float>& values, unsigned long long& bytes);
+
+	string prefix;
+	int queueSize;
+	unsigned long long frameIndex;
+	vector<Stream> streams;
+	double frameMilliseconds;
+
+	// Encoder thread and everything shared with it
+	thread encoder;
+	mutable mutex encoderMutex;
+	condition_variable encoderCondition;
+	condition_variable spaceCondition;
+	deque<CapturedFrame> queue;
+	vector<vector<unsigned char>> freeBuffers;
+	bool encoderBusy;
+	bool stopEncoder;
+	FrameCaptureStats stats;
+
+	// Raw sequences append every frame of a stream to one file, opened by the encoder the first time the stream is written
+	vector<unique_ptr<ofstream>> rawFiles;
+};
@@ -0,0 +1,191 @@
+#include "GpuProfiler.h"
+
+GpuProfiler::GpuProfiler(ID3D11Device* device, int lmaxPasses)
+{
+	maxPasses = lmaxPasses;
+	frameIndex = 0;
+	frameTime = 0.0f;
+
+	D3D11_QUERY_DESC disjointDesc;
+	disjointDesc.Query = D3D11_QUERY_TIMESTAMP_DISJOINT;
+	disjointDesc.MiscFlags = 0;
+	D3D11_QUERY_DESC timestampDesc;
+	timestampDesc.Query = D3D11_QUERY_TIMESTAMP;
+	timestampDesc.MiscFlags = 0;
+
+	// Every frame in flight gets its own set of queries, so a frame's results can be read while later frames are recorded
+	for (int frame = 0; frame < FRAME_LATENCY; frame++)
+	{
+		device->CreateQuery(&disjointDesc, &frames[frame].disjoint);
+		device->CreateQuery(&timestampDesc, &frames[frame].frameBegin);
+		device->CreateQuery(&timestampDesc, &frames[frame].frameEnd);
+		frames[frame].passBegin.resize(maxPasses);
+		frames[frame].passEnd.resize(maxPasses);
+		frames[frame].passIssued.assign(maxPasses, false);
+		for (int pass = 0; pass < maxPasses; pass++)
+		{
+			device->CreateQuery(&timestampDesc, &frames[frame].passBegin[pass]);
+			device->CreateQuery(&timestampDesc, &frames[frame].passEnd[pass]);
+		}
+		frames[frame].issued = false;
+	}
+}
+
+GpuProfiler::~GpuProfiler()
+{
+	// Release every query
+	for (int frame = 0; frame < FRAME_LATENCY; frame++)
+	{
+		if (frames[frame].disjoint)
+		{
+			frames[frame].disjoint->Release();
+			frames[frame].disjoint = 0;
+		}
+		if (frames[frame].frameBegin)
+		{
+			frames[frame].frameBegin->Release();
+			frames[frame].frameBegin = 0;
+		}
+		if (frames[frame].frameEnd)
+		{
+			frames[frame].frameEnd->Release();
+			frames[frame].frameEnd = 0;
+		}
+		for (int pass = 0; pass < maxPasses; pass++)
+		{
+			if (frames[frame].passBegin[pass])
+			{
+				frames[frame].passBegin[pass]->Release();
+				frames[frame].passBegin[pass] = 0;
+			}
+			if (frames[frame].passEnd[pass])
+			{
+				frames[frame].passEnd[pass]->Release();
+				frames[frame].passEnd[pass] = 0;
+			}
+		}
+	}
+}
+
+int GpuProfiler::findPass(const char* name) const
+{
+	for (size_t pass = 0; pass < passNames.size(); pass++)
+	{
+		if (passNames[pass] == name)
+		{
+			return (int)pass;
+		}
+	}
+	return -1;
+}
+
+void GpuProfiler::beginFrame(ID3D11DeviceContext* deviceContext)
+{
+	// The slot about to be reused holds the oldest frame, which has had the most time to finish
+	FrameQueries& frame = frames[frameIndex];
+	if (frame.issued)
+	{
+		readFrame(deviceContext, frameIndex);
+	}
+
+	frame.passIssued.assign(maxPasses, false);
+	deviceContext->Begin(frame.disjoint);
+	deviceContext->End(frame.frameBegin);
+}
+
+void GpuProfiler::endFrame(ID3D11DeviceContext* deviceContext)
+{
+	FrameQueries& frame = frames[frameIndex];
+	deviceContext->End(frame.frameEnd);
+	deviceContext->End(frame.disjoint);
+	frame.issued = true;
+	frameIndex = (frameIndex + 1) % FRAME_LATENCY;
+}
+
+void GpuProfiler::beginPass(ID3D11DeviceContext* deviceContext, const char* name)
+{
+	int pass = findPass(name);
+	if (pass < 0)
+	{
+		if ((int)passNames.size() >= maxPasses)
+		{
+			return;
+		}
+		passNames.push_back(name);
+		passTimes.push_back(0.0f);
+		pass = (int)passNames.size() - 1;
+	}
+	deviceContext->End(frames[frameIndex].passBegin[pass]);
+}
+
+void GpuProfiler::endPass(ID3D11DeviceContext* deviceContext, const char* name)
+{
+	int pass = findPass(name);
+	if (pass < 0)
+	{
+		return;
+	}
+	deviceContext->End(frames[frameIndex].passEnd[pass]);
+	frames[frameIndex].passIssued[pass] = true;
+}
+
+void GpuProfiler::readFrame(ID3D11DeviceContext* deviceContext, int frameSlot)
+{
+	FrameQueries& frame = frames[frameSlot];
+
+	// If the GPU isn't done yet, skip this frame's results rather than waiting for them
+	D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjoint;
+	if (deviceContext->GetData(frame.disjoint, &disjoint, sizeof(disjoint), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)
+	{
+		return;
+	}
+	frame.issued = false;
+
+	// Timestamps are meaningless if the clock changed frequency part way through the frame
+	if (disjoint.Disjoint)
+	{
+		return;
+	}
+
+	UINT64 begin, end;
+	if (deviceContext->GetData(frame.frameBegin, &begin, sizeof(UINT64), D3D11_ASYNC_GETDATA_DONOTFLUSH) == S_OK &&
+		deviceContext->GetData(frame.frameEnd, &end, sizeof(UINT64), D3D11_ASYNC_GETDATA_DONOTFLUSH) == S_OK)
+	{
+		float milliseconds = (float)((double)(end - begin) / disjoint.Frequency * 1000.0);
+		frameTime += (milliseconds - frameTime) * smoothing;
+	}
+
+	for (size_t pass = 0; pass < passNames.size(); pass++)
+	{
+		if (!frame.passIssued[pass])
+		{
+			continue;
+		}
+		if (deviceContext->GetData(frame.passBegin[pass], &begin, sizeof(UINT64), D3D11_ASYNC_GETDATA_DONOTFLUSH) == S_OK &&
+			deviceContext->GetData(frame.passEnd[pass], &end, sizeof(UINT64), D3D11_ASYNC_GETDATA_DONOTFLUSH) == S_OK)
+		{
+			float milliseconds = (float)((double)(end - begin) / disjoint.Frequency * 1000.0);
+			passTimes[pass] += (milliseconds - passTimes[pass]) * smoothing;
+		}
+	}
+}
+
+float GpuProfiler::getPassTime(const char* name) const
+{
+	int pass = findPass(name);
+	return pass < 0 ? 0.0f : passTimes[pass];
+}
+
+void GpuProfiler::setCounter(const char* name, double value)
+{
+	for (size_t counter = 0; counter < counterNames.size(); counter++)
+	{
+		if (counterNames[counter] == name)
+		{
+			counterValues[counter] = value;
+			return;
+		}
+	}
+	counterNames.push_back(name);
+	counterValues.push_back(value);
+}
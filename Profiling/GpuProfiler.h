@@ -0,0 +1,68 @@
+// Times named passes on the GPU with timestamp queries. Results are read back a few frames later without stalling,
+// and smoothed so they can drive controllers as well as be displayed. Also holds named counters from the CPU side of the frame
+#pragma once
+
+#include "DXF.h"
+#include <string>
+#include <vector>
+
+using namespace std;
+
+class GpuProfiler
+{
+public:
+	GpuProfiler(ID3D11Device* device, int maxPasses = 16);
+	~GpuProfiler();
+
+	// Brackets everything submitted for a frame. beginFrame also reads back the oldest frame the GPU has finished with
+	void beginFrame(ID3D11DeviceContext* deviceContext);
+	void endFrame(ID3D11DeviceContext* deviceContext);
+
+	// Brackets a named pass. A name is given a slot the first time it's seen, up to maxPasses
+	void beginPass(ID3D11DeviceContext* deviceContext, const char* name);
+	void endPass(ID3D11DeviceContext* deviceContext, const char* name);
+
+	// Smoothed times in milliseconds, zero until a frame containing the pass has been read back
+	float getPassTime(const char* name) const;
+	float getFrameTime() const { return frameTime; }
+	int getPassCount() const { return (int)passNames.size(); }
+	const string& getPassName(int pass) const { return passNames[pass]; }
+	float getPassTime(int pass) const { return passTimes[pass]; }
+
+	// Values counted on the CPU each frame, such as the constant ring's usage, kept by name to show alongside the pass times
+	void setCounter(const char* name, double value);
+	int getCounterCount() const { return (int)counterNames.size(); }
+	const string& getCounterName(int counter) const { return counterNames[counter]; }
+	double getCounterValue(int counter) const { return counterValues[counter]; }
+
+	// How quickly the smoothed times follow the measurements, 1 being no smoothing
+	float smoothing = 0.1f;
+
+private:
+	int findPass(const char* name) const;
+	void readFrame(ID3D11DeviceContext* deviceContext, int frame);
+
+	// Queries for one frame in flight
+	struct FrameQueries
+	{
+		ID3D11Query* disjoint;
+		ID3D11Query* frameBegin;
+		ID3D11Query* frameEnd;
+		vector<ID3D11Query*> passBegin;
+		vector<ID3D11Query*> passEnd;
+		vector<bool> passIssued;
+		bool issued;
+	};
+
+	static const int FRAME_LATENCY = 4;
+	FrameQueries frames[FRAME_LATENCY];
+	int frameIndex;
+	int maxPasses;
+
+	vector<string> passNames;
+	vector<float> passTimes;
+	float frameTime;
+
+	vector<string> counterNames;
+	vector<double> counterValues;
+};
@@ -0,0 +1,651 @@
+#include "MemoryTracker.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+MemoryTracker* MemoryTracker::instance = 0;
+
+// Identifies the tracker's private data on each resource. Made up for this purpose, so it can't collide with the debug layer's names
+static const GUID MEMORY_TRACKER_GUID = { 0x6b1e4d2a, 0x93c7, 0x4f05, { 0xa8, 0x1d, 0x2e, 0x57, 0xc4, 0x90, 0x3b, 0x6f } };
+
+// Attached to a tracked resource, which holds the only reference to it. The resource lets go of its private data when it's destroyed,
+// which is when the allocation is forgotten
+class MemorySentinel : public IUnknown
+{
+public:
+	MemorySentinel(uint64_t lid)
+	{
+		id = lid;
+		references = 1;
+	}
+
+	HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** object)
+	{
+		if (!object)
+		{
+			return E_POINTER;
+		}
+		if (riid == __uuidof(IUnknown))
+		{
+			*object = static_cast<IUnknown*>(this);
+			AddRef();
+			return S_OK;
+		}
+		*object = 0;
+		return E_NOINTERFACE;
+	}
+
+	ULONG STDMETHODCALLTYPE AddRef()
+	{
+		return InterlockedIncrement(&references);
+	}
+
+	ULONG STDMETHODCALLTYPE Release()
+	{
+		ULONG count = InterlockedDecrement(&references);
+		if (count == 0)
+		{
+			// The tracker goes before the last few resources at shutdown, which then have nobody to tell
+			if (MemoryTracker::instance)
+			{
+				MemoryTracker::instance->forget(id);
+			}
+			delete this;
+		}
+		return count;
+	}
+
+private:
+	uint64_t id;
+	volatile LONG references;
+};
+
+void MemoryTracker::create()
+{
+	if (!instance)
+	{
+		instance = new MemoryTracker();
+	}
+}
+
+void MemoryTracker::destroy()
+{
+	if (instance)
+	{
+		delete instance;
+		instance = 0;
+	}
+}
+
+MemoryTracker::MemoryTracker()
+{
+	epoch = chrono::steady_clock::now();
+	nextId = 1;
+	frame = 0;
+	ZeroMemory(categories, sizeof(categories));
+	gpuBytes = 0;
+	hostBytes = 0;
+	peakGpuBytes = 0;
+	peakHostBytes = 0;
+	gpuBudget = 0;
+	overGpuBudget = false;
+	changes = 0;
+	lastChanges = 0;
+	quietFrames = 0;
+	steady = false;
+	steadyGpuBytes = 0;
+	steadyHostBytes = 0;
+	steadyFrame = 0;
+	resizedBytes = 0;
+	steadyResizedBytes = 0;
+}
+
+double MemoryTracker::now() const
+{
+	return chrono::duration<double>(chrono::steady_clock::now() - epoch).count();
+}
+
+void MemoryTracker::track(ID3D11Resource* resource, MemoryCategory category, const char* name)
+{
+	if (!instance || !resource)
+	{
+		return;
+	}
+
+	uint64_t id = instance->add(name, category, getResourceBytes(resource));
+
+	// Attached outside the lock, since replacing a sentinel already on the resource releases it, which forgets its allocation
+	MemorySentinel* sentinel = new MemorySentinel(id);
+	if (FAILED(resource->SetPrivateDataInterface(MEMORY_TRACKER_GUID, sentinel)))
+	{
+		instance->forget(id);
+	}
+	sentinel->Release();
+}
+
+void MemoryTracker::track(ID3D11View* view, MemoryCategory category, const char* name)
+{
+	if (!instance || !view)
+	{
+		return;
+	}
+
+	ID3D11Resource* resource = 0;
+	view->GetResource(&resource);
+	if (resource)
+	{
+		track(resource, category, name);
+		resource->Release();
+	}
+}
+
+void MemoryTracker::trackBoundTargets(ID3D11DeviceContext* deviceContext, MemoryCategory category, const char* name)
+{
+	if (!instance)
+	{
+		return;
+	}
+
+	ID3D11RenderTargetView* renderTarget = 0;
+	ID3D11DepthStencilView* depthStencil = 0;
+	deviceContext->OMGetRenderTargets(1, &renderTarget, &depthStencil);
+	if (renderTarget)
+	{
+		track(renderTarget, category, name);
+		renderTarget->Release();
+	}
+	if (depthStencil)
+	{
+		string depthName = string(name) + " depth";
+		track(depthStencil, MEMORY_DEPTH, depthName.c_str());
+		depthStencil->Release();
+	}
+}
+
+void MemoryTracker::setHostBytes(const char* name, unsigned long long bytes)
+{
+	if (!instance)
+	{
+		return;
+	}
+
+	uint64_t id = 0;
+	{
+		lock_guard<mutex> guard(instance->lock);
+		auto found = instance->hostAllocations.find(name);
+		if (found != instance->hostAllocations.end())
+		{
+			id = found->second;
+		}
+	}
+
+	if (id && bytes)
+	{
+		instance->resize(id, bytes);
+	}
+	else if (id)
+	{
+		instance->forget(id);
+	}
+	else if (bytes)
+	{
+		instance->add(name, MEMORY_HOST, bytes);
+	}
+}
+
+uint64_t MemoryTracker::add(const char* name, MemoryCategory category, unsigned long long bytes)
+{
+	lock_guard<mutex> guard(lock);
+
+	MemoryAllocation allocation;
+	allocation.name = name ? name : "";
+	allocation.category = category;
+	allocation.bytes = bytes;
+	allocation.createdFrame = frame;
+	allocation.createdSeconds = now();
+
+	uint64_t id = nextId++;
+	if (category == MEMORY_HOST)
+	{
+		hostAllocations[allocation.name] = id;
+	}
+	allocations[id] = allocation;
+
+	MemoryCategoryStats& stats = categories[category];
+	stats.bytes += bytes;
+	stats.peakBytes = max(stats.peakBytes, stats.bytes);
+	stats.count++;
+	stats.created++;
+	if (category == MEMORY_HOST)
+	{
+		hostBytes += bytes;
+		peakHostBytes = max(peakHostBytes, hostBytes);
+	}
+	else
+	{
+		gpuBytes += bytes;
+		peakGpuBytes = max(peakGpuBytes, gpuBytes);
+	}
+	changes++;
+	return id;
+}
+
+void MemoryTracker::resize(uint64_t id, unsigned long long bytes)
+{
+	lock_guard<mutex> guard(lock);
+
+	auto found = allocations.find(id);
+	if (found == allocations.end() || found->second.bytes == bytes)
+	{
+		return;
+	}
+
+	// Only host allocations are resized, so it's only the host total that moves. A container growing or shrinking is the same allocation
+	// still in use, so it's counted in bytes rather than as a change
+	MemoryCategoryStats& stats = categories[found->second.category];
+	unsigned long long moved = bytes > found->second.bytes ? bytes - found->second.bytes : found->second.bytes - bytes;
+	stats.bytes = stats.bytes - found->second.bytes + bytes;
+	stats.peakBytes = max(stats.peakBytes, stats.bytes);
+	stats.resizedBytes += moved;
+	hostBytes = hostBytes - found->second.bytes + bytes;
+	peakHostBytes = max(peakHostBytes, hostBytes);
+	resizedBytes += moved;
+	found->second.bytes = bytes;
+}
+
+void MemoryTracker::forget(uint64_t id)
+{
+	lock_guard<mutex> guard(lock);
+
+	auto found = allocations.find(id);
+	if (found == allocations.end())
+	{
+		return;
+	}
+
+	const MemoryAllocation& allocation = found->second;
+	MemoryCategoryStats& stats = categories[allocation.category];
+	stats.bytes -= allocation.bytes;
+	stats.count--;
+
+	// Running average, so nothing about the released allocations needs keeping
+	double lifetime = now() - allocation.createdSeconds;
+	stats.released++;
+	stats.averageLifetimeSeconds += (lifetime - stats.averageLifetimeSeconds) / (double)stats.released;
+
+	if (allocation.category == MEMORY_HOST)
+	{
+		hostBytes -= allocation.bytes;
+		hostAllocations.erase(allocation.name);
+	}
+	else
+	{
+		gpuBytes -= allocation.bytes;
+	}
+	allocations.erase(found);
+	changes++;
+}
+
+void MemoryTracker::setBudget(MemoryCategory category, unsigned long long bytes, MemoryBudgetCallback callback)
+{
+	lock_guard<mutex> guard(lock);
+	categories[category].budget = bytes;
+	categories[category].overBudget = false;
+	callbacks[category] = callback;
+}
+
+void MemoryTracker::setGpuBudget(unsigned long long bytes, MemoryBudgetCallback callback)
+{
+	lock_guard<mutex> guard(lock);
+	gpuBudget = bytes;
+	overGpuBudget = false;
+	gpuCallback = callback;
+}
+
+bool MemoryTracker::update()
+{
+	// Callbacks are gathered under the lock and run after it's dropped, since downgrading releases and creates resources of its own
+	vector<pair<MemoryBudgetCallback, MemoryBudgetEvent>> exceeded;
+	bool settled = false;
+	{
+		lock_guard<mutex> guard(lock);
+		frame++;
+
+		for (int i = 0; i < MEMORY_CATEGORIES; i++)
+		{
+			MemoryCategoryStats& stats = categories[i];
+			bool over = stats.budget > 0 && stats.bytes > stats.budget;
+			if (over && !stats.overBudget && callbacks[i])
+			{
+				MemoryBudgetEvent event = { (MemoryCategory)i, stats.bytes, stats.budget };
+				exceeded.push_back(make_pair(callbacks[i], event));
+			}
+			stats.overBudget = over;
+		}
+
+		bool over = gpuBudget > 0 && gpuBytes > gpuBudget;
+		if (over && !overGpuBudget && gpuCallback)
+		{
+			MemoryBudgetEvent event = { MEMORY_CATEGORIES, gpuBytes, gpuBudget };
+			exceeded.push_back(make_pair(gpuCallback, event));
+		}
+		overGpuBudget = over;
+
+		// Anything allocated or released restarts the count, and a settled figure holds until usage settles again somewhere else
+		if (changes != lastChanges)
+		{
+			lastChanges = changes;
+			quietFrames = 0;
+			resizedBytes = 0;
+		}
+		else if (++quietFrames == STEADY_FRAMES)
+		{
+			steady = true;
+			steadyGpuBytes = gpuBytes;
+			steadyHostBytes = hostBytes;
+			steadyFrame = frame - STEADY_FRAMES;
+			steadyResizedBytes = resizedBytes;
+			settled = true;
+		}
+	}
+
+	for (auto& callback : exceeded)
+	{
+		callback.first(callback.second);
+	}
+	return settled;
+}
+
+MemoryCategoryStats MemoryTracker::getCategoryStats(MemoryCategory category)
+{
+	lock_guard<mutex> guard(lock);
+	return categories[category];
+}
+
+vector<MemoryAllocation> MemoryTracker::getAllocations()
+{
+	vector<MemoryAllocation> list;
+	{
+		lock_guard<mutex> guard(lock);
+		list.reserve(allocations.size());
+		for (auto& allocation : allocations)
+		{
+			list.push_back(allocation.second);
+		}
+	}
+
+	sort(list.begin(), list.end(), [](const MemoryAllocation& a, const MemoryAllocation& b)
+	{
+		return a.bytes != b.bytes ? a.bytes > b.bytes : a.name < b.name;
+	});
+	return list;
+}
+
+unsigned long long MemoryTracker::getGpuBytes()
+{
+	lock_guard<mutex> guard(lock);
+	return gpuBytes;
+}
+
+unsigned long long MemoryTracker::getHostBytes()
+{
+	lock_guard<mutex> guard(lock);
+	return hostBytes;
+}
+
+unsigned long long MemoryTracker::getPeakGpuBytes()
+{
+	lock_guard<mutex> guard(lock);
+	return peakGpuBytes;
+}
+
+unsigned long long MemoryTracker::getPeakHostBytes()
+{
+	lock_guard<mutex> guard(lock);
+	return peakHostBytes;
+}
+
+// Escapes the few characters a resource name could hold that JSON won't take in a string
+static string escapeJson(const string& text)
+{
+	string escaped;
+	for (char c : text)
+	{
+		if (c == '"' || c == '\\')
+		{
+			escaped += '\\';
+			escaped += c;
+		}
+		else if ((unsigned char)c < 0x20)
+		{
+			escaped += ' ';
+		}
+		else
+		{
+			escaped += c;
+		}
+	}
+	return escaped;
+}
+
+bool MemoryTracker::writeSnapshot(const char* filename)
+{
+	vector<MemoryAllocation> list = getAllocations();
+
+	ofstream file(filename);
+	if (!file)
+	{
+		return false;
+	}
+
+	char line[512];
+	lock_guard<mutex> guard(lock);
+	double seconds = now();
+
+	file << "{\n";
+	snprintf(line, sizeof(line), "\t\"frame\": %llu,\n\t\"seconds\": %.3f,\n", frame, seconds);
+	file << line;
+	snprintf(line, sizeof(line), "\t\"gpuBytes\": %llu,\n\t\"hostBytes\": %llu,\n\t\"peakGpuBytes\": %llu,\n\t\"peakHostBytes\": %llu,\n\t\"gpuBudget\": %llu,\n",
+		gpuBytes, hostBytes, peakGpuBytes, peakHostBytes, gpuBudget);
+	file << line;
+	snprintf(line, sizeof(line), "\t\"steady\": %s,\n\t\"steadyFrame\": %llu,\n\t\"steadyGpuBytes\": %llu,\n\t\"steadyHostBytes\": %llu,\n\t\"steadyResizedBytes\": %llu,\n",
+		steady ? "true" : "false", steadyFrame, steadyGpuBytes, steadyHostBytes, steadyResizedBytes);
+	file << line;
+
+	file << "\t\"categories\": [\n";
+	for (int i = 0; i < MEMORY_CATEGORIES; i++)
+	{
+		const MemoryCategoryStats& stats = categories[i];
+		snprintf(line, sizeof(line), "\t\t{ \"name\": \"%s\", \"bytes\": %llu, \"peakBytes\": %llu, \"count\": %d, \"created\": %llu, \"released\": %llu, \"averageLifetimeSeconds\": %.3f, \"resizedBytes\": %llu, \"budget\": %llu, \"overBudget\": %s }%s\n",
+			getCategoryName((MemoryCategory)i), stats.bytes, stats.peakBytes, stats.count, stats.created, stats.released, stats.averageLifetimeSeconds,
+			stats.resizedBytes, stats.budget, stats.overBudget ? "true" : "false", i + 1 < MEMORY_CATEGORIES ? "," : "");
+		file << line;
+	}
+	file << "\t],\n";
+
+	file << "\t\"allocations\": [\n";
+	for (size_t i = 0; i < list.size(); i++)
+	{
+		const MemoryAllocation& allocation = list[i];
+		snprintf(line, sizeof(line), "\t\t{ \"name\": \"%s\", \"category\": \"%s\", \"bytes\": %llu, \"createdFrame\": %llu, \"ageSeconds\": %.3f }%s\n",
+			escapeJson(allocation.name).c_str(), getCategoryName(allocation.category), allocation.bytes, allocation.createdFrame,
+			seconds - allocation.createdSeconds, i + 1 < list.size() ? "," : "");
+		file << line;
+	}
+	file << "\t]\n}\n";
+	return file.good();
+}
+
+unsigned long long MemoryTracker::getResourceBytes(ID3D11Resource* resource)
+{
+	D3D11_RESOURCE_DIMENSION dimension;
+	resource->GetType(&dimension);
+
+	UINT width = 1, height = 1, depth = 1, mips = 1, layers = 1, samples = 1;
+	DXGI_FORMAT format = DXGI_FORMAT_UNKNOWN;
+	switch (dimension)
+	{
+	case D3D11_RESOURCE_DIMENSION_BUFFER:
+	{
+		D3D11_BUFFER_DESC desc;
+		((ID3D11Buffer*)resource)->GetDesc(&desc);
+		return desc.ByteWidth;
+	}
+	case D3D11_RESOURCE_DIMENSION_TEXTURE1D:
+	{
+		D3D11_TEXTURE1D_DESC desc;
+		((ID3D11Texture1D*)resource)->GetDesc(&desc);
+		width = desc.Width;
+		mips = desc.MipLevels;
+		layers = desc.ArraySize;
+		format = desc.Format;
+		break;
+	}
+	case D3D11_RESOURCE_DIMENSION_TEXTURE2D:
+	{
+		D3D11_TEXTURE2D_DESC desc;
+		((ID3D11Texture2D*)resource)->GetDesc(&desc);
+		width = desc.Width;
+		height = desc.Height;
+		mips = desc.MipLevels;
+		layers = desc.ArraySize;
+		samples = desc.SampleDesc.Count;
+		format = desc.Format;
+		break;
+	}
+	case D3D11_RESOURCE_DIMENSION_TEXTURE3D:
+	{
+		D3D11_TEXTURE3D_DESC desc;
+		((ID3D11Texture3D*)resource)->GetDesc(&desc);
+		width = desc.Width;
+		height = desc.Height;
+		depth = desc.Depth;
+		mips = desc.MipLevels;
+		format = desc.Format;
+		break;
+	}
+	default:
+		return 0;
+	}
+
+	// Descriptions read back from a created resource always hold the real mip count, never the 0 asked for to get a full chain
+	bool blocks = isBlockCompressed(format);
+	unsigned long long bits = getFormatBits(format);
+	unsigned long long bytes = 0;
+	for (UINT mip = 0; mip < max(mips, 1u); mip++)
+	{
+		unsigned long long w = max(width >> mip, 1u);
+		unsigned long long h = max(height >> mip, 1u);
+		unsigned long long d = max(depth >> mip, 1u);
+		if (blocks)
+		{
+			// Block compressed mips are stored in whole 4x4 blocks however small they get
+			w = (w + 3) / 4 * 4;
+			h = (h + 3) / 4 * 4;
+		}
+		bytes += (w * h * d * bits + 7) / 8;
+	}
+	return bytes * layers * samples;
+}
+
+bool MemoryTracker::isBlockCompressed(DXGI_FORMAT format)
+{
+	return (format >= DXGI_FORMAT_BC1_TYPELESS && format <= DXGI_FORMAT_BC5_SNORM) || (format >= DXGI_FORMAT_BC6H_TYPELESS && format <= DXGI_FORMAT_BC7_UNORM_SRGB);
+}
+
+unsigned int MemoryTracker::getFormatBits(DXGI_FORMAT format)
+{
+	switch (format)
+	{
+	case DXGI_FORMAT_R32G32B32A32_TYPELESS:
+	case DXGI_FORMAT_R32G32B32A32_FLOAT:
+	case DXGI_FORMAT_R32G32B32A32_UINT:
+	case DXGI_FORMAT_R32G32B32A32_SINT:
+		return 128;
+	case DXGI_FORMAT_R32G32B32_TYPELESS:
+	case DXGI_FORMAT_R32G32B32_FLOAT:
+	case DXGI_FORMAT_R32G32B32_UINT:
+	case DXGI_FORMAT_R32G32B32_SINT:
+		return 96;
+	case DXGI_FORMAT_R16G16B16A16_TYPELESS:
+	case DXGI_FORMAT_R16G16B16A16_FLOAT:
+	case DXGI_FORMAT_R16G16B16A16_UNORM:
+	case DXGI_FORMAT_R16G16B16A16_UINT:
+	case DXGI_FORMAT_R16G16B16A16_SNORM:
+	case DXGI_FORMAT_R16G16B16A16_SINT:
+	case DXGI_FORMAT_R32G32_TYPELESS:
+	case DXGI_FORMAT_R32G32_FLOAT:
+	case DXGI_FORMAT_R32G32_UINT:
+	case DXGI_FORMAT_R32G32_SINT:
+	case DXGI_FORMAT_R32G8X24_TYPELESS:
+	case DXGI_FORMAT_D32_FLOAT_S8X24_UINT:
+	case DXGI_FORMAT_R32_FLOAT_X8X24_TYPELESS:
+	case DXGI_FORMAT_X32_TYPELESS_G8X24_UINT:
+		return 64;
+	case DXGI_FORMAT_R8G8_TYPELESS:
+	case DXGI_FORMAT_R8G8_UNORM:
+	case DXGI_FORMAT_R8G8_UINT:
+	case DXGI_FORMAT_R8G8_SNORM:
+	case DXGI_FORMAT_R8G8_SINT:
+	case DXGI_FORMAT_R16_TYPELESS:
+	case DXGI_FORMAT_R16_FLOAT:
+	case DXGI_FORMAT_D16_UNORM:
+	case DXGI_FORMAT_R16_UNORM:
+	case DXGI_FORMAT_R16_UINT:
+	case DXGI_FORMAT_R16_SNORM:
+	case DXGI_FORMAT_R16_SINT:
+		return 16;
+	case DXGI_FORMAT_R8_TYPELESS:
+	case DXGI_FORMAT_R8_UNORM:
+	case DXGI_FORMAT_R8_UINT:
+	case DXGI_FORMAT_R8_SNORM:
+	case DXGI_FORMAT_R8_SINT:
+	case DXGI_FORMAT_A8_UNORM:
+	// 16 bytes to a 4x4 block
+	case DXGI_FORMAT_BC2_TYPELESS:
+	case DXGI_FORMAT_BC2_UNORM:
+	case DXGI_FORMAT_BC2_UNORM_SRGB:
+	case DXGI_FORMAT_BC3_TYPELESS:
+	case DXGI_FORMAT_BC3_UNORM:
+	case DXGI_FORMAT_BC3_UNORM_SRGB:
+	case DXGI_FORMAT_BC5_TYPELESS:
+	case DXGI_FORMAT_BC5_UNORM:
+	case DXGI_FORMAT_BC5_SNORM:
+	case DXGI_FORMAT_BC6H_TYPELESS:
+	case DXGI_FORMAT_BC6H_UF16:
+	case DXGI_FORMAT_BC6H_SF16:
+	case DXGI_FORMAT_BC7_TYPELESS:
+	case DXGI_FORMAT_BC7_UNORM:
+	case DXGI_FORMAT_BC7_UNORM_SRGB:
+		return 8;
+	// 8 bytes to a 4x4 block
+	case DXGI_FORMAT_BC1_TYPELESS:
+	case DXGI_FORMAT_BC1_UNORM:
+	case DXGI_FORMAT_BC1_UNORM_SRGB:
+	case DXGI_FORMAT_BC4_TYPELESS:
+	case DXGI_FORMAT_BC4_UNORM:
+	case DXGI_FORMAT_BC4_SNORM:
+		return 4;
+	default:
+		// Every other format the scene creates packs into 32 bits
+		return 32;
+	}
+}
+
+const char* MemoryTracker::getCategoryName(MemoryCategory category)
+{
+	switch (category)
+	{
+	case MEMORY_RENDER_TARGET: return "Render Targets";
+	case MEMORY_DEPTH: return "Depth";
+	case MEMORY_SHADOW: return "Shadows";
+	case MEMORY_TEXTURE: return "Textures";
+	case MEMORY_STREAMING: return "Streaming";
+	case MEMORY_GEOMETRY: return "Geometry";
+	case MEMORY_CONSTANTS: return "Constants";
+	case MEMORY_GPU_BUFFER: return "GPU Buffers";
+	case MEMORY_STAGING: return "Staging";
+	case MEMORY_HOST: return "Host";
+	default: return "Unknown";
+	}
+}
@@ -0,0 +1,168 @@
+// Accounts for every GPU resource and the larger host allocations by category. Resources are registered once when they're created, sized
+// from their descriptions, and a small object is attached to each as private data which D3D releases when the resource is destroyed,
+// so the tracker hears about every release without the code releasing it knowing. Each category can be given a budget, whose callback
+// runs the first frame the category goes over it so the application can downgrade whatever fills it. The whole picture can be written
+// out as JSON, including the peak reached and the steady state usage settles at once nothing has been allocated or released for a while
+#pragma once
+
+#include "DXF.h"
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+enum MemoryCategory
+{
+	MEMORY_RENDER_TARGET,
+	MEMORY_DEPTH,
+	MEMORY_SHADOW,
+	MEMORY_TEXTURE,
+	MEMORY_STREAMING,
+	MEMORY_GEOMETRY,
+	MEMORY_CONSTANTS,
+	MEMORY_GPU_BUFFER,
+	MEMORY_STAGING,
+	MEMORY_HOST,
+	MEMORY_CATEGORIES
+};
+
+struct MemoryAllocation
+{
+	string name;
+	MemoryCategory category;
+	unsigned long long bytes;
+
+	// When it was registered, as a frame number and seconds since the tracker was created
+	unsigned long long createdFrame;
+	double createdSeconds;
+};
+
+struct MemoryCategoryStats
+{
+	unsigned long long bytes;
+	unsigned long long peakBytes;
+	int count;
+
+	// Everything ever registered and released in the category, and how long the released ones lived on average
+	unsigned long long created;
+	unsigned long long released;
+	double averageLifetimeSeconds;
+
+	// Bytes the category's allocations have grown and shrunk by in place, as host containers change size. Resizing isn't allocating,
+	// so it doesn't hold off the steady state
+	unsigned long long resizedBytes;
+
+	// The category's budget, 0 for none, and whether it's over it
+	unsigned long long budget;
+	bool overBudget;
+};
+
+// Passed to a budget's callback. The category is MEMORY_CATEGORIES for the budget on all GPU memory together
+struct MemoryBudgetEvent
+{
+	MemoryCategory category;
+	unsigned long long bytes;
+	unsigned long long budget;
+};
+
+typedef function<void(const MemoryBudgetEvent&)> MemoryBudgetCallback;
+
+class MemoryTracker
+{
+public:
+	static void create();
+	static void destroy();
+	static MemoryTracker* get() { return instance; }
+
+	// Registers a resource, or the resource behind a view. Registering one again replaces its category and name. Does nothing before the
+	// tracker is created, so resources made by the benchmarks and tools outside the application cost nothing
+	static void track(ID3D11Resource* resource, MemoryCategory category, const char* name);
+	static void track(ID3D11View* view, MemoryCategory category, const char* name);
+
+	// Registers the render target and depth buffer currently bound, for targets whose textures can't otherwise be reached. The depth
+	// buffer always goes under MEMORY_DEPTH
+	static void trackBoundTargets(ID3D11DeviceContext* deviceContext, MemoryCategory category, const char* name);
+
+	// Sets how much host memory something holds, replacing the figure last given under the same name. Zero stops tracking it
+	static void setHostBytes(const char* name, unsigned long long bytes);
+
+	// Sets a category's budget and what to do when it's exceeded. A budget of 0 removes it
+	void setBudget(MemoryCategory category, unsigned long long bytes, MemoryBudgetCallback callback = nullptr);
+	void setGpuBudget(unsigned long long bytes, MemoryBudgetCallback callback = nullptr);
+
+	// Once a frame: runs the callbacks of budgets newly exceeded, and notes whether usage has settled. Returns true on the frame it does
+	bool update();
+
+	// Writes the categories, budgets, peak and steady state and every live allocation, largest first
+	bool writeSnapshot(const char* filename);
+
+	MemoryCategoryStats getCategoryStats(MemoryCategory category);
+	vector<MemoryAllocation> getAllocations();
+	unsigned long long getGpuBytes();
+	unsigned long long getHostBytes();
+	unsigned long long getPeakGpuBytes();
+	unsigned long long getPeakHostBytes();
+	unsigned long long getGpuBudget() const { return gpuBudget; }
+	unsigned long long getFrame() const { return frame; }
+
+	// Usage once nothing has been allocated or released for STEADY_FRAMES frames, and the frame that quiet stretch began. Host allocations
+	// changing size don't count, but the bytes they moved by during the quiet stretch are kept beside it
+	bool isSteady() const { return steady; }
+	unsigned long long getSteadyGpuBytes() const { return steadyGpuBytes; }
+	unsigned long long getSteadyHostBytes() const { return steadyHostBytes; }
+	unsigned long long getSteadyFrame() const { return steadyFrame; }
+	unsigned long long getSteadyResizedBytes() const { return steadyResizedBytes; }
+	static const int STEADY_FRAMES = 120;
+
+	static unsigned long long getResourceBytes(ID3D11Resource* resource);
+	static const char* getCategoryName(MemoryCategory category);
+
+	// Bits per texel, averaged over a block for the block compressed formats, which are stored in whole 4x4 blocks
+	static unsigned int getFormatBits(DXGI_FORMAT format);
+	static bool isBlockCompressed(DXGI_FORMAT format);
+
+private:
+	friend class MemorySentinel;
+
+	MemoryTracker();
+
+	// Adds an allocation, returning its id. Host allocations are the only ones whose size changes
+	uint64_t add(const char* name, MemoryCategory category, unsigned long long bytes);
+	void resize(uint64_t id, unsigned long long bytes);
+	void forget(uint64_t id);
+	double now() const;
+
+	static MemoryTracker* instance;
+
+	mutex lock;
+	chrono::steady_clock::time_point epoch;
+	unordered_map<uint64_t, MemoryAllocation> allocations;
+	unordered_map<string, uint64_t> hostAllocations;
+	uint64_t nextId;
+	unsigned long long frame;
+	MemoryCategoryStats categories[MEMORY_CATEGORIES];
+	MemoryBudgetCallback callbacks[MEMORY_CATEGORIES];
+	unsigned long long gpuBytes;
+	unsigned long long hostBytes;
+	unsigned long long peakGpuBytes;
+	unsigned long long peakHostBytes;
+	unsigned long long gpuBudget;
+	bool overGpuBudget;
+	MemoryBudgetCallback gpuCallback;
+
+	// Bumped on every allocation and release, so update can tell whether anything changed since the last frame. Resizes only add to
+	// resizedBytes, which is counted from the start of the current quiet stretch
+	unsigned long long changes;
+	unsigned long long lastChanges;
+	int quietFrames;
+	bool steady;
+	unsigned long long steadyGpuBytes;
+	unsigned long long steadyHostBytes;
+	unsigned long long steadyFrame;
+	unsigned long long resizedBytes;
+	unsigned long long steadyResizedBytes;
+};
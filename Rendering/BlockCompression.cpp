@@ -0,0 +1,555 @@
+#include "BlockCompression.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+int BlockCompression::lastThreadCount = 1;
+
+// Mode 6's sixteen interpolation weights, out of 64
+static const int BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// Reads and writes a block's fields least significant bit first, as BC7 lays them out
+struct BlockBits
+{
+	uint8_t* data;
+	int position;
+
+	void write(unsigned int value, int count)
+	{
+		for (int bit = 0; bit < count; bit++, position++)
+		{
+			data[position >> 3] |= ((value >> bit) & 1) << (position & 7);
+		}
+	}
+};
+
+static unsigned int readBits(const uint8_t* data, int& position, int count)
+{
+	unsigned int value = 0;
+	for (int bit = 0; bit < count; bit++, position++)
+	{
+		value |= ((data[position >> 3] >> (position & 7)) & 1u) << bit;
+	}
+	return value;
+}
+
+// Fills a BC4 block's eight levels in index order. When red0 is larger the six between them are interpolated, otherwise four are and the
+// last two are 0 and 1
+static void bc4Palette(int red0, int red1, float palette[8])
+{
+	palette[0] = red0 / 255.0f;
+	palette[1] = red1 / 255.0f;
+	if (red0 > red1)
+	{
+		for (int i = 2; i < 8; i++)
+		{
+			palette[i] = ((8 - i) * red0 + (i - 1) * red1) / (7.0f * 255.0f);
+		}
+	}
+	else
+	{
+		for (int i = 2; i < 6; i++)
+		{
+			palette[i] = ((6 - i) * red0 + (i - 1) * red1) / (5.0f * 255.0f);
+		}
+		palette[6] = 0.0f;
+		palette[7] = 1.0f;
+	}
+}
+
+float BlockCompression::fitBC4(const float texels[16], int red0, int red1, uint8_t indices[16])
+{
+	float palette[8];
+	bc4Palette(red0, red1, palette);
+
+	// Four texels at a time, keeping the nearest level and its index in each lane
+	float error = 0.0f;
+	for (int group = 0; group < 4; group++)
+	{
+		XMVECTOR values = XMLoadFloat4((const XMFLOAT4*)&texels[group * 4]);
+		XMVECTOR best = XMVectorReplicate(FLT_MAX);
+		XMVECTOR bestIndex = XMVectorZero();
+		for (int i = 0; i < 8; i++)
+		{
+			XMVECTOR difference = XMVectorSubtract(values, XMVectorReplicate(palette[i]));
+			XMVECTOR distance = XMVectorMultiply(difference, difference);
+			XMVECTOR closer = XMVectorLess(distance, best);
+			best = XMVectorSelect(best, distance, closer);
+			bestIndex = XMVectorSelect(bestIndex, XMVectorReplicate((float)i), closer);
+		}
+		XMFLOAT4 groupIndices;
+		XMStoreFloat4(&groupIndices, bestIndex);
+		indices[group * 4 + 0] = (uint8_t)groupIndices.x;
+		indices[group * 4 + 1] = (uint8_t)groupIndices.y;
+		indices[group * 4 + 2] = (uint8_t)groupIndices.z;
+		indices[group * 4 + 3] = (uint8_t)groupIndices.w;
+		error += XMVectorGetX(XMVectorSum(best));
+	}
+	return error;
+}
+
+void BlockCompression::encodeBC4Block(const float texels[16], uint8_t* block)
+{
+	float low = texels[0];
+	float high = texels[0];
+	for (int i = 1; i < 16; i++)
+	{
+		low = min(low, texels[i]);
+		high = max(high, texels[i]);
+	}
+	int red0 = (int)(min(max(high, 0.0f), 1.0f) * 255.0f + 0.5f);
+	int red1 = (int)(min(max(low, 0.0f), 1.0f) * 255.0f + 0.5f);
+
+	// Eight levels need red0 above red1. A flat block keeps them equal, every texel taking red0
+	uint8_t indices[16];
+	uint8_t bestIndices[16];
+	int bestRed0 = red0;
+	int bestRed1 = red1;
+	if (red0 == red1)
+	{
+		memset(bestIndices, 0, sizeof(bestIndices));
+	}
+	else
+	{
+		// The rounded extremes are rarely the best endpoints, so nudges of a step either way are tried too
+		float bestError = FLT_MAX;
+		for (int step0 = -1; step0 <= 1; step0++)
+		{
+			for (int step1 = -1; step1 <= 1; step1++)
+			{
+				int candidate0 = min(max(red0 + step0, 0), 255);
+				int candidate1 = min(max(red1 + step1, 0), 255);
+				if (candidate0 <= candidate1)
+				{
+					continue;
+				}
+				float error = fitBC4(texels, candidate0, candidate1, indices);
+				if (error < bestError)
+				{
+					bestError = error;
+					bestRed0 = candidate0;
+					bestRed1 = candidate1;
+					memcpy(bestIndices, indices, sizeof(indices));
+				}
+			}
+		}
+	}
+
+	block[0] = (uint8_t)bestRed0;
+	block[1] = (uint8_t)bestRed1;
+	uint64_t packed = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		packed |= (uint64_t)bestIndices[i] << (i * 3);
+	}
+	for (int i = 0; i < 6; i++)
+	{
+		block[2 + i] = (uint8_t)(packed >> (i * 8));
+	}
+}
+
+void BlockCompression::encodeBC5Block(const float texels[32], uint8_t* block)
+{
+	float red[16];
+	float green[16];
+	for (int i = 0; i < 16; i++)
+	{
+		red[i] = texels[i * 2];
+		green[i] = texels[i * 2 + 1];
+	}
+	encodeBC4Block(red, block);
+	encodeBC4Block(green, block + 8);
+}
+
+float BlockCompression::fitBC7(const XMVECTOR texels[16], const int endpoints[2][4], uint8_t indices[16])
+{
+	// Builds the line's colours exactly as the hardware interpolates them
+	XMVECTOR palette[16];
+	for (int i = 0; i < 16; i++)
+	{
+		int weight = BC7_WEIGHTS[i];
+		palette[i] = XMVectorSet(
+			(float)(((64 - weight) * endpoints[0][0] + weight * endpoints[1][0] + 32) >> 6),
+			(float)(((64 - weight) * endpoints[0][1] + weight * endpoints[1][1] + 32) >> 6),
+			(float)(((64 - weight) * endpoints[0][2] + weight * endpoints[1][2] + 32) >> 6),
+			(float)(((64 - weight) * endpoints[0][3] + weight * endpoints[1][3] + 32) >> 6));
+	}
+
+	float error = 0.0f;
+	for (int texel = 0; texel < 16; texel++)
+	{
+		float best = FLT_MAX;
+		for (int i = 0; i < 16; i++)
+		{
+			float distance = XMVectorGetX(XMVector4LengthSq(XMVectorSubtract(texels[texel], palette[i])));
+			if (distance < best)
+			{
+				best = distance;
+				indices[texel] = (uint8_t)i;
+			}
+		}
+		error += best;
+	}
+	return error;
+}
+
+float BlockCompression::quantizeBC7(const XMVECTOR texels[16], XMVECTOR end0, XMVECTOR end1, int endpoints[2][4], uint8_t indices[16])
+{
+	XMFLOAT4 ends[2];
+	XMStoreFloat4(&ends[0], XMVectorClamp(end0, XMVectorZero(), XMVectorReplicate(255.0f)));
+	XMStoreFloat4(&ends[1], XMVectorClamp(end1, XMVectorZero(), XMVectorReplicate(255.0f)));
+
+	float bestError = FLT_MAX;
+	int candidate[2][4];
+	uint8_t candidateIndices[16];
+	for (int bits = 0; bits < 4; bits++)
+	{
+		for (int end = 0; end < 2; end++)
+		{
+			int low = (bits >> end) & 1;
+			const float* channels = &ends[end].x;
+			for (int c = 0; c < 4; c++)
+			{
+				int high = min(max((int)floorf((channels[c] - low) * 0.5f + 0.5f), 0), 127);
+				candidate[end][c] = (high << 1) | low;
+			}
+		}
+		float error = fitBC7(texels, candidate, candidateIndices);
+		if (error < bestError)
+		{
+			bestError = error;
+			memcpy(endpoints, candidate, sizeof(candidate));
+			memcpy(indices, candidateIndices, sizeof(candidateIndices));
+		}
+	}
+	return bestError;
+}
+
+void BlockCompression::encodeBC7Block(const XMFLOAT4 texels[16], uint8_t* block)
+{
+	XMVECTOR values[16];
+	XMVECTOR mean = XMVectorZero();
+	XMVECTOR low = XMVectorReplicate(FLT_MAX);
+	XMVECTOR high = XMVectorReplicate(-FLT_MAX);
+	for (int i = 0; i < 16; i++)
+	{
+		values[i] = XMVectorScale(XMVectorSaturate(XMLoadFloat4(&texels[i])), 255.0f);
+		mean = XMVectorAdd(mean, values[i]);
+		low = XMVectorMin(low, values[i]);
+		high = XMVectorMax(high, values[i]);
+	}
+	mean = XMVectorScale(mean, 1.0f / 16.0f);
+
+	// The colours' principal axis, found by power iteration on their covariance starting from the bounding box's diagonal
+	XMFLOAT4 rows[4] = {};
+	for (int i = 0; i < 16; i++)
+	{
+		XMFLOAT4 centred;
+		XMStoreFloat4(&centred, XMVectorSubtract(values[i], mean));
+		const float* c = &centred.x;
+		for (int row = 0; row < 4; row++)
+		{
+			XMStoreFloat4(&rows[row], XMVectorAdd(XMLoadFloat4(&rows[row]), XMVectorScale(XMLoadFloat4(&centred), c[row])));
+		}
+	}
+	XMMATRIX covariance(XMLoadFloat4(&rows[0]), XMLoadFloat4(&rows[1]), XMLoadFloat4(&rows[2]), XMLoadFloat4(&rows[3]));
+	XMVECTOR axis = XMVectorSubtract(high, low);
+	for (int iteration = 0; iteration < 8; iteration++)
+	{
+		XMVECTOR next = XMVector4Transform(axis, covariance);
+		float length = XMVectorGetX(XMVector4Length(next));
+		if (length < 1e-6f)
+		{
+			break;
+		}
+		axis = XMVectorScale(next, 1.0f / length);
+	}
+	float axisLength = XMVectorGetX(XMVector4Length(axis));
+	axis = axisLength > 1e-6f ? XMVectorScale(axis, 1.0f / axisLength) : XMVectorZero();
+
+	// The texels' extent along the axis gives the first endpoints
+	float minProjection = 0.0f;
+	float maxProjection = 0.0f;
+	for (int i = 0; i < 16; i++)
+	{
+		float projection = XMVectorGetX(XMVector4Dot(XMVectorSubtract(values[i], mean), axis));
+		minProjection = min(minProjection, projection);
+		maxProjection = max(maxProjection, projection);
+	}
+	int endpoints[2][4];
+	uint8_t indices[16];
+	float error = quantizeBC7(values, XMVectorAdd(mean, XMVectorScale(axis, minProjection)), XMVectorAdd(mean, XMVectorScale(axis, maxProjection)), endpoints, indices);
+
+	// Then one least squares refit of the endpoints to the indices chosen, kept if it lowers the error
+	float aa = 0.0f;
+	float ab = 0.0f;
+	float bb = 0.0f;
+	XMVECTOR ax = XMVectorZero();
+	XMVECTOR bx = XMVectorZero();
+	for (int i = 0; i < 16; i++)
+	{
+		float weight = BC7_WEIGHTS[indices[i]] / 64.0f;
+		aa += (1.0f - weight) * (1.0f - weight);
+		ab += (1.0f - weight) * weight;
+		bb += weight * weight;
+		ax = XMVectorAdd(ax, XMVectorScale(values[i], 1.0f - weight));
+		bx = XMVectorAdd(bx, XMVectorScale(values[i], weight));
+	}
+	float determinant = aa * bb - ab * ab;
+	if (fabsf(determinant) > 1e-6f)
+	{
+		XMVECTOR refit0 = XMVectorScale(XMVectorSubtract(XMVectorScale(ax, bb), XMVectorScale(bx, ab)), 1.0f / determinant);
+		XMVECTOR refit1 = XMVectorScale(XMVectorSubtract(XMVectorScale(bx, aa), XMVectorScale(ax, ab)), 1.0f / determinant);
+		int refitEndpoints[2][4];
+		uint8_t refitIndices[16];
+		if (quantizeBC7(values, refit0, refit1, refitEndpoints, refitIndices) < error)
+		{
+			memcpy(endpoints, refitEndpoints, sizeof(endpoints));
+			memcpy(indices, refitIndices, sizeof(indices));
+		}
+	}
+
+	// The first texel's index is stored without its top bit, so the line is flipped when that bit would be set
+	if (indices[0] >= 8)
+	{
+		for (int c = 0; c < 4; c++)
+		{
+			swap(endpoints[0][c], endpoints[1][c]);
+		}
+		for (int i = 0; i < 16; i++)
+		{
+			indices[i] = 15 - indices[i];
+		}
+	}
+
+	memset(block, 0, 16);
+	BlockBits bits = { block, 0 };
+	bits.write(1 << 6, 7);
+	for (int c = 0; c < 4; c++)
+	{
+		bits.write(endpoints[0][c] >> 1, 7);
+		bits.write(endpoints[1][c] >> 1, 7);
+	}
+	bits.write(endpoints[0][0] & 1, 1);
+	bits.write(endpoints[1][0] & 1, 1);
+	bits.write(indices[0], 3);
+	for (int i = 1; i < 16; i++)
+	{
+		bits.write(indices[i], 4);
+	}
+}
+
+// Colour half of BC1 to BC3 blocks. BC2 and BC3 always use four colours, BC1 drops to three and transparent black when the first endpoint
+// isn't the larger
+static void decodeColourBlock(const uint8_t* block, XMFLOAT4 texels[16], bool threeColourMode)
+{
+	unsigned int colour0 = block[0] | (block[1] << 8);
+	unsigned int colour1 = block[2] | (block[3] << 8);
+	XMVECTOR palette[4];
+	palette[0] = XMVectorSet(((colour0 >> 11) & 31) / 31.0f, ((colour0 >> 5) & 63) / 63.0f, (colour0 & 31) / 31.0f, 1.0f);
+	palette[1] = XMVectorSet(((colour1 >> 11) & 31) / 31.0f, ((colour1 >> 5) & 63) / 63.0f, (colour1 & 31) / 31.0f, 1.0f);
+	if (colour0 > colour1 || !threeColourMode)
+	{
+		palette[2] = XMVectorLerp(palette[0], palette[1], 1.0f / 3.0f);
+		palette[3] = XMVectorLerp(palette[0], palette[1], 2.0f / 3.0f);
+	}
+	else
+	{
+		palette[2] = XMVectorLerp(palette[0], palette[1], 0.5f);
+		palette[3] = XMVectorZero();
+	}
+	for (int i = 0; i < 16; i++)
+	{
+		XMStoreFloat4(&texels[i], palette[(block[4 + i / 4] >> ((i % 4) * 2)) & 3]);
+	}
+}
+
+static void decodeBC4Channel(const uint8_t* block, XMFLOAT4 texels[16], int channel)
+{
+	float palette[8];
+	bc4Palette(block[0], block[1], palette);
+	uint64_t packed = 0;
+	for (int i = 0; i < 6; i++)
+	{
+		packed |= (uint64_t)block[2 + i] << (i * 8);
+	}
+	for (int i = 0; i < 16; i++)
+	{
+		(&texels[i].x)[channel] = palette[(packed >> (i * 3)) & 7];
+	}
+}
+
+void BlockCompression::decodeBlock(BlockFormat format, const uint8_t* block, XMFLOAT4 texels[16])
+{
+	switch (format)
+	{
+	case BLOCK_BC1:
+		decodeColourBlock(block, texels, true);
+		break;
+	case BLOCK_BC2:
+		decodeColourBlock(block + 8, texels, false);
+		for (int i = 0; i < 16; i++)
+		{
+			texels[i].w = ((block[i / 2] >> ((i % 2) * 4)) & 15) / 15.0f;
+		}
+		break;
+	case BLOCK_BC3:
+		decodeColourBlock(block + 8, texels, false);
+		decodeBC4Channel(block, texels, 3);
+		break;
+	case BLOCK_BC4:
+		for (int i = 0; i < 16; i++)
+		{
+			texels[i] = XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f);
+		}
+		decodeBC4Channel(block, texels, 0);
+		break;
+	case BLOCK_BC5:
+		for (int i = 0; i < 16; i++)
+		{
+			texels[i] = XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f);
+		}
+		decodeBC4Channel(block, texels, 0);
+		decodeBC4Channel(block + 8, texels, 1);
+		break;
+	case BLOCK_BC7:
+	{
+		int position = 0;
+		if (readBits(block, position, 7) != (1 << 6))
+		{
+			memset(texels, 0, sizeof(XMFLOAT4) * 16);
+			break;
+		}
+		int endpoints[2][4];
+		for (int c = 0; c < 4; c++)
+		{
+			endpoints[0][c] = readBits(block, position, 7) << 1;
+			endpoints[1][c] = readBits(block, position, 7) << 1;
+		}
+		int low0 = readBits(block, position, 1);
+		int low1 = readBits(block, position, 1);
+		for (int c = 0; c < 4; c++)
+		{
+			endpoints[0][c] |= low0;
+			endpoints[1][c] |= low1;
+		}
+		for (int i = 0; i < 16; i++)
+		{
+			int weight = BC7_WEIGHTS[readBits(block, position, i == 0 ? 3 : 4)];
+			float* channels = &texels[i].x;
+			for (int c = 0; c < 4; c++)
+			{
+				channels[c] = (((64 - weight) * endpoints[0][c] + weight * endpoints[1][c] + 32) >> 6) / 255.0f;
+			}
+		}
+		break;
+	}
+	}
+}
+
+void BlockCompression::encodeImage(BlockFormat format, const float* texels, int width, int height, vector<uint8_t>& blocks, int threadCount)
+{
+	int blocksX = getBlocksAcross(width);
+	int blocksY = getBlocksAcross(height);
+	int channels = getChannels(format);
+	int blockBytes = getBlockBytes(format);
+	blocks.assign((size_t)blocksX * blocksY * blockBytes, 0);
+
+	// Each thread encodes a band of block rows into its own part of the output, so nothing is shared but the source
+	auto encodeRows = [=, &blocks](int firstRow, int lastRow)
+	{
+		float block[64];
+		for (int blockY = firstRow; blockY <= lastRow; blockY++)
+		{
+			for (int blockX = 0; blockX < blocksX; blockX++)
+			{
+				for (int i = 0; i < 16; i++)
+				{
+					int x = min(blockX * 4 + i % 4, width - 1);
+					int y = min(blockY * 4 + i / 4, height - 1);
+					memcpy(&block[i * channels], &texels[((size_t)y * width + x) * channels], channels * sizeof(float));
+				}
+				uint8_t* output = &blocks[((size_t)blockY * blocksX + blockX) * blockBytes];
+				switch (format)
+				{
+				case BLOCK_BC4:
+					encodeBC4Block(block, output);
+					break;
+				case BLOCK_BC5:
+					encodeBC5Block(block, output);
+					break;
+				case BLOCK_BC7:
+					encodeBC7Block((const XMFLOAT4*)block, output);
+					break;
+				default:
+					break;
+				}
+			}
+		}
+	};
+
+	int threads = threadCount > 0 ? threadCount : max((int)thread::hardware_concurrency(), 1);
+	threads = min(threads, blocksY);
+	lastThreadCount = threads;
+	if (threads <= 1)
+	{
+		encodeRows(0, blocksY - 1);
+		return;
+	}
+	vector<thread> workers;
+	for (int worker = 0; worker < threads; worker++)
+	{
+		workers.push_back(thread(encodeRows, blocksY * worker / threads, blocksY * (worker + 1) / threads - 1));
+	}
+	for (thread& worker : workers)
+	{
+		worker.join();
+	}
+}
+
+void BlockCompression::decodeImage(BlockFormat format, const uint8_t* blocks, int width, int height, vector<float>& texels)
+{
+	int blocksX = getBlocksAcross(width);
+	int blocksY = getBlocksAcross(height);
+	int channels = getChannels(format);
+	int blockBytes = getBlockBytes(format);
+	texels.resize((size_t)width * height * channels);
+
+	XMFLOAT4 decoded[16];
+	for (int blockY = 0; blockY < blocksY; blockY++)
+	{
+		for (int blockX = 0; blockX < blocksX; blockX++)
+		{
+			decodeBlock(format, &blocks[((size_t)blockY * blocksX + blockX) * blockBytes], decoded);
+			for (int i = 0; i < 16; i++)
+			{
+				int x = blockX * 4 + i % 4;
+				int y = blockY * 4 + i / 4;
+				if (x < width && y < height)
+				{
+					memcpy(&texels[((size_t)y * width + x) * channels], &decoded[i], channels * sizeof(float));
+				}
+			}
+		}
+	}
+}
+
+int BlockCompression::getChannels(BlockFormat format)
+{
+	switch (format)
+	{
+	case BLOCK_BC4:
+		return 1;
+	case BLOCK_BC5:
+		return 2;
+	default:
+		return 4;
+	}
+}
+
+int BlockCompression::getBlockBytes(BlockFormat format)
+{
+	return format == BLOCK_BC1 || format == BLOCK_BC4 ? 8 : 16;
+}
@@ -0,0 +1,60 @@
+// CPU encoders and decoders for the block compressed formats the texture cooker writes. BC4 holds one channel as two 8 bit endpoints with
+// six levels between them per 4x4 block, and BC5 is two BC4 blocks side by side. BC7 is only encoded in mode 6, a single RGBA line per block
+// with sixteen levels, which suits the smooth gradients of the scene's textures and keeps the endpoint search small. Blocks are independent,
+// so images are split into rows of blocks across threads, and every index search compares four texels or four channels at once
+#pragma once
+
+#include <DirectXMath.h>
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+using namespace DirectX;
+
+enum BlockFormat
+{
+	BLOCK_BC1,
+	BLOCK_BC2,
+	BLOCK_BC3,
+	BLOCK_BC4,
+	BLOCK_BC5,
+	BLOCK_BC7
+};
+
+class BlockCompression
+{
+public:
+	// Encodes one 4x4 block of texels, given row by row with values from 0 to 1. BC5 takes the two channels interleaved
+	static void encodeBC4Block(const float texels[16], uint8_t* block);
+	static void encodeBC5Block(const float texels[32], uint8_t* block);
+	static void encodeBC7Block(const XMFLOAT4 texels[16], uint8_t* block);
+
+	// Decodes one block into four channels per texel. BC7 blocks in modes other than 6 decode to zero, as they are never written here
+	static void decodeBlock(BlockFormat format, const uint8_t* block, XMFLOAT4 texels[16]);
+
+	// Encodes a width x height image with getChannels(format) floats per texel, blocks written row by row. Blocks hanging over the edge
+	// repeat the last row and column. Uses every core when threadCount is 0
+	static void encodeImage(BlockFormat format, const float* texels, int width, int height, vector<uint8_t>& blocks, int threadCount = 0);
+
+	// Decodes blocks back into getChannels(format) floats per texel
+	static void decodeImage(BlockFormat format, const uint8_t* blocks, int width, int height, vector<float>& texels);
+
+	static int getChannels(BlockFormat format);
+	static int getBlockBytes(BlockFormat format);
+	static int getBlocksAcross(int texels) { return (texels + 3) / 4; }
+
+	// Threads encodeImage used last, for reporting throughput
+	static int getLastThreadCount() { return lastThreadCount; }
+
+private:
+	// Picks the nearest of a BC4 block's eight levels for every texel between endpoints red0 and red1, returning the squared error
+	static float fitBC4(const float texels[16], int red0, int red1, uint8_t indices[16]);
+
+	// Picks the nearest of a mode 6 line's sixteen colours for every texel, returning the squared error in 0-255 units
+	static float fitBC7(const XMVECTOR texels[16], const int endpoints[2][4], uint8_t indices[16]);
+
+	// Rounds two endpoints to mode 6's seven bits and a shared low bit each, trying all four low bit pairs and keeping the best fit
+	static float quantizeBC7(const XMVECTOR texels[16], XMVECTOR end0, XMVECTOR end1, int endpoints[2][4], uint8_t indices[16]);
+
+	static int lastThreadCount;
+};
@@ -0,0 +1,144 @@
+#include "BokehDepthOfField.h"
+#include <algorithm>
+#include <cmath>
+
+float BokehDepthOfField::circleOfConfusion(const BokehSettings& settings, float viewZ)
+{
+	float blur = (viewZ - settings.focusDistance) / max(settings.focusRange, 0.001f);
+	return min(max(blur, -1.0f), 1.0f) * min(settings.maxRadius, (float)MAX_RADIUS);
+}
+
+void BokehDepthOfField::classifyTiles(const vector<XMFLOAT4>& half, int width, int height, const BokehSettings& settings, vector<BokehTile>& tiles, int& nearTiles)
+{
+	int tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+	int tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+	tiles.clear();
+	nearTiles = 0;
+
+	// The largest blur of any kind in each tile, and the largest in front of the focus
+	vector<float> tileFar((size_t)tilesX * tilesY, 0.0f);
+	vector<float> tileNear((size_t)tilesX * tilesY, 0.0f);
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			float coc = half[(size_t)y * width + x].w;
+			size_t tile = (size_t)(y / TILE_SIZE) * tilesX + x / TILE_SIZE;
+			tileFar[tile] = max(tileFar[tile], fabsf(coc));
+			tileNear[tile] = max(tileNear[tile], -coc);
+		}
+	}
+
+	// Near blur spills over the edges of what's in front, so it reaches into the tiles around it, as many as the largest blur can cross
+	for (int ty = 0; ty < tilesY; ty++)
+	{
+		for (int tx = 0; tx < tilesX; tx++)
+		{
+			float nearReach = 0.0f;
+			for (int dy = -NEAR_REACH_TILES; dy <= NEAR_REACH_TILES; dy++)
+			{
+				for (int dx = -NEAR_REACH_TILES; dx <= NEAR_REACH_TILES; dx++)
+				{
+					int nx = min(max(tx + dx, 0), tilesX - 1);
+					int ny = min(max(ty + dy, 0), tilesY - 1);
+					nearReach = max(nearReach, tileNear[(size_t)ny * tilesX + nx]);
+				}
+			}
+
+			float radius = max(tileFar[(size_t)ty * tilesX + tx], nearReach);
+			if (radius < settings.inFocusThreshold)
+			{
+				continue;
+			}
+
+			BokehTile tile;
+			tile.coords = (UINT)tx | ((UINT)ty << 16);
+			tile.tileClass = nearReach >= settings.inFocusThreshold ? BOKEH_TILE_NEAR : BOKEH_TILE_FAR;
+			tile.radius = radius;
+			tile.padding = 0.0f;
+			tiles.push_back(tile);
+			if (tile.tileClass == BOKEH_TILE_NEAR)
+			{
+				nearTiles++;
+			}
+		}
+	}
+}
+
+XMFLOAT4 BokehDepthOfField::gather(const vector<XMFLOAT4>& half, int width, int height, int x, int y, const BokehTile& tile, const BokehSettings& settings)
+{
+	const XMFLOAT4& centre = half[(size_t)y * width + x];
+	float centreCoC = centre.w;
+
+	// The centre texel always counts, more so the more blurred it is
+	float centreWeight = min(max(fabsf(centreCoC) + 0.5f, 0.0f), 1.0f);
+	XMVECTOR sum = XMVectorScale(XMLoadFloat4(&centre), centreWeight);
+	float total = centreWeight;
+	float nearWeight = centreCoC < 0.0f ? centreWeight : 0.0f;
+
+	// Rings one texel apart, with six more samples on each ring than the last, out to the largest blur that reaches this tile
+	int rings = (int)ceilf(min(tile.radius, min(settings.maxRadius, (float)MAX_RADIUS)));
+	for (int ring = 1; ring <= rings; ring++)
+	{
+		int count = ring * 6;
+		for (int i = 0; i < count; i++)
+		{
+			float angle = XM_2PI * i / count;
+			int sx = min(max((int)floorf(x + 0.5f + cosf(angle) * ring), 0), width - 1);
+			int sy = min(max((int)floorf(y + 0.5f + sinf(angle) * ring), 0), height - 1);
+			const XMFLOAT4& sample = half[(size_t)sy * width + sx];
+
+			// A sample spreads as far as its own blur, except that something behind the centre can't blur over it further than the centre is blurred
+			float reach = fabsf(sample.w);
+			if (sample.w > centreCoC)
+			{
+				reach = min(reach, fabsf(centreCoC));
+			}
+			float weight = min(max(reach - ring + 0.5f, 0.0f), 1.0f);
+			if (weight <= 0.0f)
+			{
+				continue;
+			}
+			sum = XMVectorMultiplyAdd(XMLoadFloat4(&sample), XMVectorReplicate(weight), sum);
+			total += weight;
+			if (sample.w < 0.0f)
+			{
+				nearWeight += weight;
+			}
+		}
+	}
+
+	// Blends in as the centre's own blur grows, or as near blur covers it
+	XMFLOAT4 result;
+	XMStoreFloat4(&result, XMVectorScale(sum, 1.0f / total));
+	result.w = min(max(fabsf(centreCoC) * 0.5f, 0.0f), 1.0f);
+	if (tile.tileClass == BOKEH_TILE_NEAR)
+	{
+		result.w = max(result.w, nearWeight / total);
+	}
+	return result;
+}
+
+void BokehDepthOfField::reference(const vector<XMFLOAT4>& half, int width, int height, const BokehSettings& settings, vector<XMFLOAT4>& output, vector<BokehTile>& tiles)
+{
+	output.resize((size_t)width * height);
+	for (size_t texel = 0; texel < output.size(); texel++)
+	{
+		output[texel] = XMFLOAT4(half[texel].x, half[texel].y, half[texel].z, 0.0f);
+	}
+
+	int nearTiles = 0;
+	classifyTiles(half, width, height, settings, tiles, nearTiles);
+	for (const BokehTile& tile : tiles)
+	{
+		int tileX = (int)(tile.coords & 0xffff) * TILE_SIZE;
+		int tileY = (int)(tile.coords >> 16) * TILE_SIZE;
+		for (int y = tileY; y < min(tileY + TILE_SIZE, height); y++)
+		{
+			for (int x = tileX; x < min(tileX + TILE_SIZE, width); x++)
+			{
+				output[(size_t)y * width + x] = gather(half, width, height, x, y, tile, settings);
+			}
+		}
+	}
+}
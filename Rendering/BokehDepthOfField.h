@@ -0,0 +1,80 @@
+// Depth of field settings, and a CPU reference of the bokeh compute shader's tile classification and gather. The scene is halved, each texel
+// given a signed circle of confusion (negative in front of the focus, positive behind it), and the half resolution image split into tiles.
+// Tiles whose blur, and the near blur of every tile within reach, stays under a threshold are in focus and skipped; every other tile gathers a disc of
+// texels around each of its own, sized to the largest blur that could reach it. The reference uses DirectXMath's SIMD vectors for the colour
+// sums, and follows the shader's sample pattern exactly so the two can be compared texel by texel
+#pragma once
+
+#include "DXF.h"
+#include <vector>
+
+using namespace std;
+using namespace DirectX;
+
+enum BokehTileClass
+{
+	BOKEH_TILE_IN_FOCUS,
+	BOKEH_TILE_FAR,
+	BOKEH_TILE_NEAR,
+	BOKEH_TILE_CLASS_COUNT
+};
+
+struct BokehSettings
+{
+	// View depth that is perfectly sharp when focusing manually, and how far either side of the focus the blur takes to reach its full radius
+	float focusDistance = 20.0f;
+	float focusRange = 30.0f;
+
+	// Largest blur radius, in half resolution texels
+	float maxRadius = 8.0f;
+
+	// Tiles whose blur stays under this radius are left sharp
+	float inFocusThreshold = 0.5f;
+};
+
+// One listed tile, matching BokehTile in the bokeh compute shader
+struct BokehTile
+{
+	UINT coords;
+	UINT tileClass;
+	float radius;
+	float padding;
+};
+
+// How closely the GPU's gather matched the reference over the same half resolution input
+struct BokehComparison
+{
+	int width;
+	int height;
+	int gpuTiles;
+	int cpuTiles;
+
+	// Mean and largest difference in any channel, colour and blend weight alike
+	double meanError;
+	double maxError;
+};
+
+class BokehDepthOfField
+{
+public:
+	// Half resolution texels along each side of a tile, one thread group's worth
+	static const int TILE_SIZE = 8;
+
+	// Furthest a gather reaches, in half resolution texels
+	static const int MAX_RADIUS = 16;
+
+	// Tiles away near blur can spill, the most MAX_RADIUS texels can cross
+	static const int NEAR_REACH_TILES = (MAX_RADIUS + TILE_SIZE - 1) / TILE_SIZE;
+
+	// Signed blur radius, in half resolution texels, of a surface at view depth viewZ
+	static float circleOfConfusion(const BokehSettings& settings, float viewZ);
+
+	// Finds the tiles of a half resolution image (colour in xyz, circle of confusion in w) that need blurring. nearTiles counts those near blur reaches
+	static void classifyTiles(const vector<XMFLOAT4>& half, int width, int height, const BokehSettings& settings, vector<BokehTile>& tiles, int& nearTiles);
+
+	// Gathers the disc around one texel of a listed tile, returning the blurred colour and how much of it to blend over the sharp scene
+	static XMFLOAT4 gather(const vector<XMFLOAT4>& half, int width, int height, int x, int y, const BokehTile& tile, const BokehSettings& settings);
+
+	// Runs the whole reference, leaving the texels of in focus tiles as their own colour with nothing to blend
+	static void reference(const vector<XMFLOAT4>& half, int width, int height, const BokehSettings& settings, vector<XMFLOAT4>& output, vector<BokehTile>& tiles);
+};
@@ -0,0 +1,190 @@
+#include "CameraDepthTarget.h"
+#include "MemoryTracker.h"
+#include <DirectXPackedVector.h>
+#include <algorithm>
+#include <cmath>
+
+CameraDepthTarget::CameraDepthTarget(ID3D11Device* device, int width, int height, float lnearPlane, float lfarPlane, DepthStorageFormat lformat)
+{
+	format = lformat;
+	nearPlane = lnearPlane;
+	farPlane = lfarPlane;
+	depthTexture = 0;
+	depthRTV = 0;
+	depthSRV = 0;
+	depthStencilBuffer = 0;
+	depthStencilView = 0;
+	depthStorageBuffer = 0;
+
+	// The colour texture the depth is stored in, in the chosen format
+	D3D11_TEXTURE2D_DESC textureDesc;
+	ZeroMemory(&textureDesc, sizeof(textureDesc));
+	textureDesc.Width = width;
+	textureDesc.Height = height;
+	textureDesc.MipLevels = 1;
+	textureDesc.ArraySize = 1;
+	textureDesc.Format = getDXGIFormat(format);
+	textureDesc.SampleDesc.Count = 1;
+	textureDesc.Usage = D3D11_USAGE_DEFAULT;
+	textureDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+	device->CreateTexture2D(&textureDesc, NULL, &depthTexture);
+	MemoryTracker::track(depthTexture, MEMORY_RENDER_TARGET, "Camera depth");
+	device->CreateRenderTargetView(depthTexture, NULL, &depthRTV);
+	device->CreateShaderResourceView(depthTexture, NULL, &depthSRV);
+
+	// Its own depth buffer, so nearer surfaces still win the depth test whatever the texture holds
+	D3D11_TEXTURE2D_DESC depthBufferDesc = textureDesc;
+	depthBufferDesc.Format = DXGI_FORMAT_D32_FLOAT;
+	depthBufferDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL;
+	device->CreateTexture2D(&depthBufferDesc, NULL, &depthStencilBuffer);
+	MemoryTracker::track(depthStencilBuffer, MEMORY_DEPTH, "Camera depth buffer");
+	device->CreateDepthStencilView(depthStencilBuffer, NULL, &depthStencilView);
+
+	D3D11_BUFFER_DESC bufferDesc;
+	bufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+	bufferDesc.ByteWidth = sizeof(DepthStorageBufferType);
+	bufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	bufferDesc.MiscFlags = 0;
+	bufferDesc.StructureByteStride = 0;
+	device->CreateBuffer(&bufferDesc, NULL, &depthStorageBuffer);
+	MemoryTracker::track(depthStorageBuffer, MEMORY_CONSTANTS, "Camera depth constants");
+}
+
+CameraDepthTarget::~CameraDepthTarget()
+{
+	// Release the texture, its depth buffer, their views and the storage buffer
+	if (depthSRV)
+	{
+		depthSRV->Release();
+		depthSRV = 0;
+	}
+	if (depthRTV)
+	{
+		depthRTV->Release();
+		depthRTV = 0;
+	}
+	if (depthTexture)
+	{
+		depthTexture->Release();
+		depthTexture = 0;
+	}
+	if (depthStencilView)
+	{
+		depthStencilView->Release();
+		depthStencilView = 0;
+	}
+	if (depthStencilBuffer)
+	{
+		depthStencilBuffer->Release();
+		depthStencilBuffer = 0;
+	}
+	if (depthStorageBuffer)
+	{
+		depthStorageBuffer->Release();
+		depthStorageBuffer = 0;
+	}
+}
+
+void CameraDepthTarget::setRenderTarget(ID3D11DeviceContext* deviceContext)
+{
+	deviceContext->OMSetRenderTargets(1, &depthRTV, depthStencilView);
+	setShaderParameters(deviceContext, BUFFER_SLOT);
+}
+
+void CameraDepthTarget::clearRenderTarget(ID3D11DeviceContext* deviceContext)
+{
+	float colour[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	deviceContext->ClearRenderTargetView(depthRTV, colour);
+	deviceContext->ClearDepthStencilView(depthStencilView, D3D11_CLEAR_DEPTH, 1.0f, 0);
+}
+
+void CameraDepthTarget::setShaderParameters(ID3D11DeviceContext* deviceContext, int slot)
+{
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	deviceContext->Map(depthStorageBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+	DepthStorageBufferType* storagePtr = (DepthStorageBufferType*)mappedResource.pData;
+	storagePtr->nearPlane = nearPlane;
+	storagePtr->farPlane = farPlane;
+	storagePtr->linearDepth = isLinear() ? 1.0f : 0.0f;
+	storagePtr->padding = 0.0f;
+	deviceContext->Unmap(depthStorageBuffer, 0);
+	StateCache::get()->setConstantBuffers(deviceContext, STAGE_PS, slot, 1, &depthStorageBuffer);
+}
+
+DXGI_FORMAT CameraDepthTarget::getDXGIFormat(DepthStorageFormat format)
+{
+	switch (format)
+	{
+	case DEPTH_STORAGE_LINEAR_R16_UNORM: return DXGI_FORMAT_R16_UNORM;
+	case DEPTH_STORAGE_LINEAR_R16_FLOAT: return DXGI_FORMAT_R16_FLOAT;
+	default: return DXGI_FORMAT_R32_FLOAT;
+	}
+}
+
+int CameraDepthTarget::getBytesPerTexel(DepthStorageFormat format)
+{
+	return format == DEPTH_STORAGE_LINEAR_R16_UNORM || format == DEPTH_STORAGE_LINEAR_R16_FLOAT ? 2 : 4;
+}
+
+const char* CameraDepthTarget::getName(DepthStorageFormat format)
+{
+	switch (format)
+	{
+	case DEPTH_STORAGE_HYPERBOLIC_R32: return "Hyperbolic R32F";
+	case DEPTH_STORAGE_LINEAR_R16_UNORM: return "Linear R16 UNORM";
+	case DEPTH_STORAGE_LINEAR_R16_FLOAT: return "Linear R16F";
+	case DEPTH_STORAGE_LINEAR_R32_FLOAT: return "Linear R32F";
+	default: return "Unknown";
+	}
+}
+
+float CameraDepthTarget::roundTrip(DepthStorageFormat format, float viewZ, float nearPlane, float farPlane)
+{
+	float range = farPlane - nearPlane;
+	if (format == DEPTH_STORAGE_HYPERBOLIC_R32)
+	{
+		// z / w as the projection gives it, then undone exactly rather than with the approximation the shaders used
+		float stored = farPlane / range * (1.0f - nearPlane / viewZ);
+		return nearPlane * farPlane / (farPlane - stored * range);
+	}
+
+	float stored = min(max((viewZ - nearPlane) / range, 0.0f), 1.0f);
+	if (format == DEPTH_STORAGE_LINEAR_R16_UNORM)
+	{
+		stored = floorf(stored * 65535.0f + 0.5f) / 65535.0f;
+	}
+	else if (format == DEPTH_STORAGE_LINEAR_R16_FLOAT)
+	{
+		stored = PackedVector::XMConvertHalfToFloat(PackedVector::XMConvertFloatToHalf(stored));
+	}
+	return nearPlane + stored * range;
+}
+
+vector<DepthStorageReport> CameraDepthTarget::buildReport(int width, int height, float nearPlane, float farPlane, int readsPerFrame, int samples)
+{
+	vector<DepthStorageReport> report;
+	for (int format = 0; format < DEPTH_STORAGE_FORMAT_COUNT; format++)
+	{
+		DepthStorageReport row;
+		row.format = (DepthStorageFormat)format;
+		row.meanError = 0.0;
+		row.maxError = 0.0;
+		row.maxNearError = 0.0;
+		row.bytesPerFrame = (unsigned long long)width * height * getBytesPerTexel(row.format) * (1 + readsPerFrame);
+
+		for (int sample = 0; sample < samples; sample++)
+		{
+			float viewZ = nearPlane + (farPlane - nearPlane) * (sample + 0.5f) / samples;
+			double error = fabs((double)roundTrip(row.format, viewZ, nearPlane, farPlane) - viewZ);
+			row.meanError += error / samples;
+			row.maxError = max(row.maxError, error);
+			if (sample < samples / 10)
+			{
+				row.maxNearError = max(row.maxNearError, error);
+			}
+		}
+		report.push_back(row);
+	}
+	return report;
+}
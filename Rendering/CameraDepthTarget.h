@@ -0,0 +1,91 @@
+// The camera's depth texture, read by the Hi-Z build and depth of field. Stores the distance along the view direction, linearly scaled between
+// the near and far planes, in a choice of compact formats, rather than the hyperbolic z / w the shaders used to have to linearize on every read.
+// The hyperbolic 32 bit float layout is still available for comparison, and a report gives the precision and bandwidth of each choice
+#pragma once
+
+#include "DXF.h"
+#include "StateCache.h"
+#include <vector>
+
+using namespace std;
+using namespace DirectX;
+
+enum DepthStorageFormat
+{
+	DEPTH_STORAGE_HYPERBOLIC_R32,
+	DEPTH_STORAGE_LINEAR_R16_UNORM,
+	DEPTH_STORAGE_LINEAR_R16_FLOAT,
+	DEPTH_STORAGE_LINEAR_R32_FLOAT,
+	DEPTH_STORAGE_FORMAT_COUNT
+};
+
+// How accurately one format gives back the view depth it was written with, and what it costs to move each frame
+struct DepthStorageReport
+{
+	DepthStorageFormat format;
+
+	// Mean and largest difference between the view depth written and the one read back, in world units, over the whole depth range
+	double meanError;
+	double maxError;
+
+	// Largest difference within the nearest tenth of the range, where depth of field and occlusion culling look hardest
+	double maxNearError;
+
+	// Bytes written by the depth pass and read by the Hi-Z build and depth of field each frame
+	unsigned long long bytesPerFrame;
+};
+
+class CameraDepthTarget
+{
+public:
+	// Matches DepthStorageBuffer in the depth pixel shaders and the depth of field shader
+	struct DepthStorageBufferType
+	{
+		float nearPlane;
+		float farPlane;
+		float linearDepth;
+		float padding;
+	};
+
+	// Register the depth storage buffer is bound to in the depth pixel shaders
+	static const int BUFFER_SLOT = 0;
+
+	CameraDepthTarget(ID3D11Device* device, int width, int height, float nearPlane, float farPlane, DepthStorageFormat format);
+	~CameraDepthTarget();
+
+	// Binds the texture and its depth buffer, and the storage buffer for the depth pixel shaders, which keep writing z / w whenever
+	// no colour target of this kind is bound. The texture is cleared to zero, meaning nothing was drawn there
+	void setRenderTarget(ID3D11DeviceContext* deviceContext);
+	void clearRenderTarget(ID3D11DeviceContext* deviceContext);
+
+	// Binds the storage buffer to a pixel shader register, for shaders reading the texture back
+	void setShaderParameters(ID3D11DeviceContext* deviceContext, int slot);
+
+	ID3D11ShaderResourceView* getShaderResourceView() { return depthSRV; }
+	DepthStorageFormat getFormat() const { return format; }
+	bool isLinear() const { return format != DEPTH_STORAGE_HYPERBOLIC_R32; }
+	float getNearPlane() const { return nearPlane; }
+	float getFarPlane() const { return farPlane; }
+
+	static DXGI_FORMAT getDXGIFormat(DepthStorageFormat format);
+	static int getBytesPerTexel(DepthStorageFormat format);
+	static const char* getName(DepthStorageFormat format);
+
+	// Writes view depth viewZ as format would store it, then reads it back as the shaders would, in world units
+	static float roundTrip(DepthStorageFormat format, float viewZ, float nearPlane, float farPlane);
+
+	// Measures every format over samples view depths spread evenly from near to far, for a target of width x height read readsPerFrame times
+	static vector<DepthStorageReport> buildReport(int width, int height, float nearPlane, float farPlane, int readsPerFrame = 2, int samples = 4096);
+
+private:
+	DepthStorageFormat format;
+	float nearPlane;
+	float farPlane;
+
+	ID3D11Texture2D* depthTexture;
+	ID3D11RenderTargetView* depthRTV;
+	ID3D11ShaderResourceView* depthSRV;
+	ID3D11Texture2D* depthStencilBuffer;
+	ID3D11DepthStencilView* depthStencilView;
+	ID3D11Buffer* depthStorageBuffer;
+};
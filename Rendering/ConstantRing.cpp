@@ -0,0 +1,264 @@
+#include "ConstantRing.h"
+#include "MemoryTracker.h"
+#include <cstring>
+
+ConstantRing::ConstantRing(ID3D11Device* device, ID3D11DeviceContext* deviceContext, UINT size)
+{
+	buffer = 0;
+	deviceContext1 = 0;
+	capacity = (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+	mapped = false;
+	head = 0;
+	used = 0;
+	frameUsed = 0;
+	oldestFrame = 0;
+	framesInFlight = 0;
+	frameAllocations = 0;
+	frameFallbacks = 0;
+	ZeroMemory(&stats, sizeof(stats));
+	for (int i = 0; i < FRAMES_IN_FLIGHT; i++)
+	{
+		frames[i].query = 0;
+		frames[i].size = 0;
+	}
+
+	// Binding at an offset, and mapping a constant buffer without discarding it, both need the 11.1 runtime and driver support
+	D3D11_FEATURE_DATA_D3D11_OPTIONS options;
+	ZeroMemory(&options, sizeof(options));
+	device->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options));
+	if (!options.ConstantBufferOffsetting || !options.MapNoOverwriteOnDynamicConstantBuffer)
+	{
+		return;
+	}
+	if (deviceContext->QueryInterface(__uuidof(ID3D11DeviceContext1), (void**)&deviceContext1) != S_OK)
+	{
+		deviceContext1 = 0;
+		return;
+	}
+
+	// A constant buffer can be at most 4096 constants when bound, but as a whole can be as large as any other buffer
+	D3D11_BUFFER_DESC bufferDesc;
+	bufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+	bufferDesc.ByteWidth = capacity;
+	bufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	bufferDesc.MiscFlags = 0;
+	bufferDesc.StructureByteStride = 0;
+	if (device->CreateBuffer(&bufferDesc, NULL, &buffer) != S_OK)
+	{
+		buffer = 0;
+		return;
+	}
+	MemoryTracker::track(buffer, MEMORY_CONSTANTS, "Constant ring");
+
+	// One event query per frame in flight, fencing the part of the ring that frame wrote
+	D3D11_QUERY_DESC queryDesc;
+	queryDesc.Query = D3D11_QUERY_EVENT;
+	queryDesc.MiscFlags = 0;
+	for (int i = 0; i < FRAMES_IN_FLIGHT; i++)
+	{
+		device->CreateQuery(&queryDesc, &frames[i].query);
+	}
+}
+
+ConstantRing::~ConstantRing()
+{
+	// Release the fences
+	for (int i = 0; i < FRAMES_IN_FLIGHT; i++)
+	{
+		if (frames[i].query)
+		{
+			frames[i].query->Release();
+			frames[i].query = 0;
+		}
+	}
+
+	// Release the ring and the 11.1 context
+	if (buffer)
+	{
+		buffer->Release();
+		buffer = 0;
+	}
+	if (deviceContext1)
+	{
+		deviceContext1->Release();
+		deviceContext1 = 0;
+	}
+}
+
+void ConstantRing::beginFrame(ID3D11DeviceContext* deviceContext)
+{
+	// Frees the space of every frame the GPU has finished with, oldest first, without waiting on any
+	while (framesInFlight > 0 && deviceContext->GetData(frames[oldestFrame].query, NULL, 0, D3D11_ASYNC_GETDATA_DONOTFLUSH) == S_OK)
+	{
+		retireFrame(false);
+	}
+	frameUsed = 0;
+	frameAllocations = 0;
+	frameFallbacks = 0;
+}
+
+void ConstantRing::endFrame(ID3D11DeviceContext* deviceContext)
+{
+	stats.frameBytes = frameUsed;
+	stats.peakFrameBytes = max(stats.peakFrameBytes, stats.frameBytes);
+	stats.frameAllocations = frameAllocations;
+	stats.frameFallbacks = frameFallbacks;
+	if (!buffer)
+	{
+		return;
+	}
+
+	// Every fence is in use, so the oldest frame has to finish before its query can fence this one
+	if (framesInFlight == FRAMES_IN_FLIGHT)
+	{
+		retireFrame(true);
+	}
+
+	FrameFence& frame = frames[(oldestFrame + framesInFlight) % FRAMES_IN_FLIGHT];
+	frame.size = frameUsed;
+	deviceContext->End(frame.query);
+	framesInFlight++;
+	frameUsed = 0;
+}
+
+void ConstantRing::retireFrame(bool wait)
+{
+	FrameFence& frame = frames[oldestFrame];
+	if (wait && deviceContext1->GetData(frame.query, NULL, 0, 0) != S_OK)
+	{
+		stats.stalls++;
+		while (deviceContext1->GetData(frame.query, NULL, 0, 0) != S_OK)
+		{
+		}
+	}
+	used -= frame.size;
+	frame.size = 0;
+	oldestFrame = (oldestFrame + 1) % FRAMES_IN_FLIGHT;
+	framesInFlight--;
+}
+
+bool ConstantRing::allocate(UINT size, UINT& offset)
+{
+	// An allocation never straddles the end, so whatever is left there is skipped and held by this frame until it's retired
+	UINT aligned = (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+	UINT skipped = head + aligned > capacity ? capacity - head : 0;
+	UINT needed = skipped + aligned;
+	if (needed > capacity)
+	{
+		return false;
+	}
+
+	// Waits for the oldest frames until there is room, and gives up if the space is all this frame's own
+	while (used + needed > capacity)
+	{
+		if (framesInFlight == 0)
+		{
+			return false;
+		}
+		retireFrame(true);
+	}
+
+	if (skipped > 0)
+	{
+		head = 0;
+		stats.wraps++;
+	}
+	offset = head;
+	head = (head + aligned) % capacity;
+	used += needed;
+	frameUsed += needed;
+	return true;
+}
+
+bool ConstantRing::upload(ID3D11DeviceContext* deviceContext, UINT stages, UINT slot, const void* data, UINT size)
+{
+	UINT offset;
+	if (!buffer || !allocate(size, offset))
+	{
+		return false;
+	}
+
+	// The first map of a dynamic buffer has to discard it, after which the fences make sure nothing in flight is written over
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	if (deviceContext->Map(buffer, 0, mapped ? D3D11_MAP_WRITE_NO_OVERWRITE : D3D11_MAP_WRITE_DISCARD, 0, &mappedResource) != S_OK)
+	{
+		return false;
+	}
+	memcpy((BYTE*)mappedResource.pData + offset, data, size);
+	deviceContext->Unmap(buffer, 0);
+	mapped = true;
+
+	// Offsets and counts are in 16 byte constants, counts rounded up to a multiple of 16 of them
+	UINT firstConstant = offset / 16;
+	UINT constantCount = (size + ALIGNMENT - 1) / ALIGNMENT * (ALIGNMENT / 16);
+	if (stages & RING_STAGE_VS)
+	{
+		deviceContext1->VSSetConstantBuffers1(slot, 1, &buffer, &firstConstant, &constantCount);
+	}
+	if (stages & RING_STAGE_HS)
+	{
+		deviceContext1->HSSetConstantBuffers1(slot, 1, &buffer, &firstConstant, &constantCount);
+	}
+	if (stages & RING_STAGE_DS)
+	{
+		deviceContext1->DSSetConstantBuffers1(slot, 1, &buffer, &firstConstant, &constantCount);
+	}
+	if (stages & RING_STAGE_GS)
+	{
+		deviceContext1->GSSetConstantBuffers1(slot, 1, &buffer, &firstConstant, &constantCount);
+	}
+	if (stages & RING_STAGE_PS)
+	{
+		deviceContext1->PSSetConstantBuffers1(slot, 1, &buffer, &firstConstant, &constantCount);
+	}
+	if (stages & RING_STAGE_CS)
+	{
+		deviceContext1->CSSetConstantBuffers1(slot, 1, &buffer, &firstConstant, &constantCount);
+	}
+
+	// Bound at an offset behind the filter's back, so it has to forget what it thought was in the slot
+	for (int stage = STAGE_VS; stage < STAGE_COUNT; stage++)
+	{
+		if (stages & (1 << stage))
+		{
+			StateCache::get()->forgetConstantBuffer((ShaderStage)stage, slot);
+		}
+	}
+	frameAllocations++;
+	return true;
+}
+
+void ConstantRing::setConstants(ConstantRing* ring, ID3D11DeviceContext* deviceContext, UINT stages, UINT slot, const void* data, UINT size, ID3D11Buffer* fallback)
+{
+	if (ring && ring->upload(deviceContext, stages, slot, data, size))
+	{
+		return;
+	}
+	if (ring)
+	{
+		ring->frameFallbacks++;
+	}
+
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	deviceContext->Map(fallback, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+	memcpy(mappedResource.pData, data, size);
+	deviceContext->Unmap(fallback, 0);
+	bindFallback(deviceContext, stages, slot, fallback);
+}
+
+void ConstantRing::bindFallback(ID3D11DeviceContext* deviceContext, UINT stages, UINT slot, ID3D11Buffer* fallback)
+{
+	// The graphics stages' own buffers are bound through the state cache's filter, so a shader drawing again with the same buffer skips the bind
+	for (int stage = STAGE_VS; stage < STAGE_COUNT; stage++)
+	{
+		if (stages & (1 << stage))
+		{
+			StateCache::get()->setConstantBuffers(deviceContext, (ShaderStage)stage, slot, 1, &fallback);
+		}
+	}
+	if (stages & RING_STAGE_CS)
+	{
+		deviceContext->CSSetConstantBuffers(slot, 1, &fallback);
+	}
+}
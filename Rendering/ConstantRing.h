@@ -0,0 +1,94 @@
+// One large dynamic constant buffer shared by every shader's per draw constants, sub-allocated front to back with WRITE_NO_OVERWRITE and bound
+// at an offset, in place of each shader mapping its own small buffers with WRITE_DISCARD for every draw and the driver renaming them each time.
+// Frames in flight are fenced with event queries, so space is only reused once the GPU has finished the frame that wrote it. Needs the
+// Direct3D 11.1 constant buffer offsetting; without it every upload falls back to the shader's own buffer, mapped as before
+#pragma once
+
+#include "DXF.h"
+#include "StateCache.h"
+#include <d3d11_1.h>
+
+using namespace std;
+using namespace DirectX;
+
+// Shader stages an upload is bound to, combined as a mask, the graphics stages in the order of ShaderStage
+enum ConstantRingStage
+{
+	RING_STAGE_VS = 1 << 0,
+	RING_STAGE_HS = 1 << 1,
+	RING_STAGE_DS = 1 << 2,
+	RING_STAGE_GS = 1 << 3,
+	RING_STAGE_PS = 1 << 4,
+	RING_STAGE_CS = 1 << 5
+};
+
+struct ConstantRingStats
+{
+	// Bytes handed out last frame, including what was skipped at the end of the ring when wrapping, and the most in any frame so far
+	unsigned long long frameBytes;
+	unsigned long long peakFrameBytes;
+
+	// Uploads last frame, and how many went to the shaders' own buffers because the ring was unsupported or full
+	int frameAllocations;
+	int frameFallbacks;
+
+	// Totals since the ring was made: times the head went back to the start, and times the CPU had to wait for the GPU to free space
+	int wraps;
+	int stalls;
+};
+
+class ConstantRing
+{
+public:
+	ConstantRing(ID3D11Device* device, ID3D11DeviceContext* deviceContext, UINT capacity = 4 * 1024 * 1024);
+	~ConstantRing();
+
+	// Brackets a frame's uploads. beginFrame frees the space of every frame the GPU has finished, endFrame fences this one
+	void beginFrame(ID3D11DeviceContext* deviceContext);
+	void endFrame(ID3D11DeviceContext* deviceContext);
+
+	// Copies size bytes of constants into the ring and binds them to slot of every stage in the mask. Uses fallback instead, mapped with
+	// WRITE_DISCARD, when ring is null, unsupported or can't make room. Lets shaders work the same whether or not they were given a ring
+	static void setConstants(ConstantRing* ring, ID3D11DeviceContext* deviceContext, UINT stages, UINT slot, const void* data, UINT size, ID3D11Buffer* fallback);
+
+	bool isSupported() const { return buffer != 0; }
+	UINT getCapacity() const { return capacity; }
+	const ConstantRingStats& getStats() const { return stats; }
+
+private:
+	// Reserves aligned space, waiting on the oldest frames in flight if needed. Returns false if this frame alone has filled the ring
+	bool allocate(UINT size, UINT& offset);
+	bool upload(ID3D11DeviceContext* deviceContext, UINT stages, UINT slot, const void* data, UINT size);
+	void retireFrame(bool wait);
+
+	static void bindFallback(ID3D11DeviceContext* deviceContext, UINT stages, UINT slot, ID3D11Buffer* fallback);
+
+private:
+	// Offsets are bound in whole constants and must be a multiple of 16 of them
+	static const UINT ALIGNMENT = 256;
+	static const int FRAMES_IN_FLIGHT = 4;
+
+	ID3D11Buffer* buffer;
+	ID3D11DeviceContext1* deviceContext1;
+	UINT capacity;
+	bool mapped;
+
+	// Where the next upload goes, and how much of the ring is held by this frame and the frames in flight
+	UINT head;
+	UINT used;
+	UINT frameUsed;
+
+	// Frames the GPU may still be reading, oldest first, with how much of the ring each holds
+	struct FrameFence
+	{
+		ID3D11Query* query;
+		UINT size;
+	};
+	FrameFence frames[FRAMES_IN_FLIGHT];
+	int oldestFrame;
+	int framesInFlight;
+
+	ConstantRingStats stats;
+	int frameAllocations;
+	int frameFallbacks;
+};
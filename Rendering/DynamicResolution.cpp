@@ -0,0 +1,128 @@
+#include "DynamicResolution.h"
+
+DynamicResolution::DynamicResolution(int lfullWidth, int lfullHeight)
+{
+	fullWidth = lfullWidth;
+	fullHeight = lfullHeight;
+	decision = RESOLUTION_HOLD;
+	reason = "Waiting for timings";
+	predictedScale = 1.0f;
+	cooldown = 0;
+	frame = 0;
+	lastTargetMilliseconds = targetMilliseconds;
+	applyScale(maxScale);
+}
+
+DynamicResolution::~DynamicResolution()
+{
+	trace.close();
+}
+
+void DynamicResolution::applyScale(float newScale)
+{
+	scale = min(max(newScale, minScale), maxScale);
+
+	// Snaps the size to a multiple of 8 pixels, which keeps the compute passes' thread groups full and stops single pixel changes every frame
+	width = min(fullWidth, max(8, ((int)(fullWidth * scale) + 4) / 8 * 8));
+	height = min(fullHeight, max(8, ((int)(fullHeight * scale) + 4) / 8 * 8));
+}
+
+void DynamicResolution::setScale(float newScale)
+{
+	applyScale(newScale);
+	predictedScale = scale;
+}
+
+void DynamicResolution::update(float scaledMilliseconds, float fixedMilliseconds)
+{
+	frame++;
+	float totalMilliseconds = scaledMilliseconds + fixedMilliseconds;
+	decision = RESOLUTION_HOLD;
+
+	// A new target invalidates the wait, so the controller responds to it straight away
+	if (targetMilliseconds != lastTargetMilliseconds)
+	{
+		cooldown = 0;
+		lastTargetMilliseconds = targetMilliseconds;
+	}
+	if (cooldown > 0)
+	{
+		cooldown--;
+	}
+
+	if (!enabled)
+	{
+		reason = "Disabled";
+	}
+	else if (scaledMilliseconds <= 0.0f)
+	{
+		reason = "Waiting for timings";
+	}
+	else
+	{
+		// The scaled passes cost roughly in proportion to the pixel count, which is the square of the scale, so the scale that just fits
+		// is the current one times the square root of how much of the budget the scaled passes can have over how much they take now
+		float budget = max(targetMilliseconds - fixedMilliseconds, targetMilliseconds * 0.1f);
+		predictedScale = min(max(scale * sqrtf(budget / scaledMilliseconds), minScale), maxScale);
+
+		if (totalMilliseconds > targetMilliseconds)
+		{
+			if (scale <= minScale)
+			{
+				reason = "Over budget at minimum scale";
+			}
+			else
+			{
+				// Drops as far as the prediction says in one go, so a spike is dealt with before it causes more than a few long frames
+				applyScale(max(predictedScale, scale - maxStepDown));
+				decision = RESOLUTION_DOWN;
+				reason = "Over budget";
+				cooldown = cooldownFrames;
+			}
+		}
+		else if (totalMilliseconds < targetMilliseconds * headroom)
+		{
+			// Creeps back up towards the headroom rather than the budget itself, so it settles instead of oscillating around the target
+			float headroomBudget = max(targetMilliseconds * headroom - fixedMilliseconds, targetMilliseconds * 0.1f);
+			float upScale = min(scale * sqrtf(headroomBudget / scaledMilliseconds), maxScale);
+			if (scale >= maxScale)
+			{
+				reason = "Under budget at maximum scale";
+			}
+			else if (cooldown > 0)
+			{
+				reason = "Under budget, waiting for timings to settle";
+			}
+			else if (upScale > scale)
+			{
+				applyScale(min(upScale, scale + maxStepUp));
+				decision = RESOLUTION_UP;
+				reason = "Under budget";
+				cooldown = cooldownFrames;
+			}
+			else
+			{
+				reason = "Within headroom";
+			}
+		}
+		else
+		{
+			reason = "Within budget";
+		}
+	}
+
+	if (trace.isOpen())
+	{
+		trace.addRow({ (double)frame, scaledMilliseconds, fixedMilliseconds, totalMilliseconds, targetMilliseconds, scale, (double)width, (double)height, (double)decision });
+	}
+}
+
+bool DynamicResolution::startTrace(const char* filename)
+{
+	return trace.open(filename, { "frame", "scaled_ms", "fixed_ms", "gpu_ms", "target_ms", "scale", "width", "height", "decision" });
+}
+
+void DynamicResolution::stopTrace()
+{
+	trace.close();
+}
@@ -0,0 +1,83 @@
+// Picks the resolution the scene is rendered at each frame, so the GPU frame time stays within a budget. The render targets stay at
+// full size and only a sub-rectangle of them is drawn to, which the final pass then upsamples to the screen
+#pragma once
+
+#include "BenchmarkLog.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+// What the controller did on its last update, matching the value written to the trace
+enum ResolutionDecision
+{
+	RESOLUTION_DOWN = -1,
+	RESOLUTION_HOLD = 0,
+	RESOLUTION_UP = 1
+};
+
+class DynamicResolution
+{
+public:
+	DynamicResolution(int fullWidth, int fullHeight);
+	~DynamicResolution();
+
+	// Takes the GPU time of the passes that scale with resolution and of everything else, and moves the scale towards the budget
+	void update(float scaledMilliseconds, float fixedMilliseconds);
+
+	// Sets the scale directly, used when the controller is switched off
+	void setScale(float scale);
+
+	// Writes every update to a CSV file, so the controller's behaviour can be plotted against the frame times it saw
+	bool startTrace(const char* filename);
+	void stopTrace();
+	bool isTracing() const { return trace.isOpen(); }
+
+	float getScale() const { return scale; }
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+	int getFullWidth() const { return fullWidth; }
+	int getFullHeight() const { return fullHeight; }
+
+	// Fraction of the render targets that holds the image, in each direction
+	float getUVScaleX() const { return (float)width / fullWidth; }
+	float getUVScaleY() const { return (float)height / fullHeight; }
+
+	ResolutionDecision getDecision() const { return decision; }
+	const char* getReason() const { return reason; }
+	float getPredictedScale() const { return predictedScale; }
+
+	// Frame time to aim for, and the range the scale may move in
+	bool enabled = true;
+	float targetMilliseconds = 16.0f;
+	float minScale = 0.5f;
+	float maxScale = 1.0f;
+
+	// Only scales up once the frame is this fraction of the budget, and aims for that fraction rather than the budget itself
+	float headroom = 0.85f;
+
+	// Largest change in scale per update in each direction, scaling down being allowed to react faster than scaling up
+	float maxStepDown = 0.1f;
+	float maxStepUp = 0.02f;
+
+	// Updates to wait after a change before scaling up again, as the timings lag the change by a few frames
+	int cooldownFrames = 15;
+
+private:
+	void applyScale(float newScale);
+
+	int fullWidth;
+	int fullHeight;
+	float scale;
+	int width;
+	int height;
+
+	ResolutionDecision decision;
+	const char* reason;
+	float predictedScale;
+	int cooldown;
+	int frame;
+
+	BenchmarkLog trace;
+	float lastTargetMilliseconds;
+};
@@ -0,0 +1,301 @@
+#include "GeometryRegistry.h"
+#include "MemoryTracker.h"
+#include <chrono>
+#include <cstring>
+
+GeometryRegistry::GeometryRegistry()
+{
+	requestCount = 0;
+	optimized = false;
+	buildMilliseconds = 0.0;
+	bufferBytes = 0;
+	sourceBytes = 0;
+	vertexBuffer = 0;
+	indexBuffer = 0;
+}
+
+GeometryRegistry::~GeometryRegistry()
+{
+	// Delete every mesh, then release the registry's own references to the shared buffers
+	for (Entry& entry : entries)
+	{
+		delete entry.mesh;
+		entry.mesh = 0;
+	}
+	if (vertexBuffer)
+	{
+		vertexBuffer->Release();
+		vertexBuffer = 0;
+	}
+	if (indexBuffer)
+	{
+		indexBuffer->Release();
+		indexBuffer = 0;
+	}
+}
+
+RegisteredMesh* GeometryRegistry::add(const string& name, const vector<RegisteredMesh::Vertex>& vertices, const vector<unsigned long>& indices)
+{
+	requestCount++;
+
+	// The hash only narrows the search, a match still has to be the same byte for byte
+	uint64_t hash = hashBytes(vertices.data(), vertices.size() * sizeof(RegisteredMesh::Vertex));
+	hash = hashBytes(indices.data(), indices.size() * sizeof(unsigned long), hash);
+	auto range = entryIndex.equal_range(hash);
+	for (auto found = range.first; found != range.second; ++found)
+	{
+		Entry& entry = entries[found->second];
+		if (entry.vertices.size() == vertices.size() && entry.indices.size() == indices.size() &&
+			memcmp(entry.vertices.data(), vertices.data(), vertices.size() * sizeof(RegisteredMesh::Vertex)) == 0 &&
+			memcmp(entry.indices.data(), indices.data(), indices.size() * sizeof(unsigned long)) == 0)
+		{
+			entry.requests++;
+			return entry.mesh;
+		}
+	}
+
+	Entry entry;
+	entry.name = name;
+	entry.vertices = vertices;
+	entry.indices = indices;
+	entry.mesh = new RegisteredMesh();
+	entry.requests = 1;
+	entryIndex.insert(make_pair(hash, entries.size()));
+	entries.push_back(entry);
+	return entry.mesh;
+}
+
+RegisteredMesh* GeometryRegistry::addCube(int resolution)
+{
+	vector<RegisteredMesh::Vertex> vertices;
+	vector<unsigned long> indices;
+	buildCube(resolution, false, vertices, indices);
+	return add("Cube " + to_string(resolution), vertices, indices);
+}
+
+RegisteredMesh* GeometryRegistry::addSphere(int resolution)
+{
+	vector<RegisteredMesh::Vertex> vertices;
+	vector<unsigned long> indices;
+	buildCube(resolution, true, vertices, indices);
+	return add("Sphere " + to_string(resolution), vertices, indices);
+}
+
+bool GeometryRegistry::build(ID3D11Device* device, bool optimize)
+{
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+	if (vertexBuffer)
+	{
+		vertexBuffer->Release();
+		vertexBuffer = 0;
+	}
+	if (indexBuffer)
+	{
+		indexBuffer->Release();
+		indexBuffer = 0;
+	}
+	reports.clear();
+	optimized = optimize;
+	bufferBytes = 0;
+	sourceBytes = 0;
+	if (entries.empty())
+	{
+		return false;
+	}
+
+	// Each mesh is optimized on its own, from the copy it was registered as, then appended to the shared arrays
+	vector<RegisteredMesh::Vertex> sharedVertices;
+	vector<unsigned long> sharedIndices;
+	for (const Entry& entry : entries)
+	{
+		vector<RegisteredMesh::Vertex> vertices = entry.vertices;
+		vector<unsigned long> indices = entry.indices;
+		GeometryReport report;
+		report.name = entry.name;
+		report.requests = entry.requests;
+		report.sourceVertices = (int)vertices.size();
+		report.triangles = (int)indices.size() / 3;
+		report.before = MeshOptimizer::simulateCache(indices, (int)vertices.size());
+		report.overdrawSorted = false;
+		if (optimize)
+		{
+			weldVertices(vertices, indices);
+			MeshOptimizer::optimizeVertexCache(indices, (int)vertices.size());
+			vector<XMFLOAT3> positions(vertices.size());
+			for (size_t vertex = 0; vertex < vertices.size(); vertex++)
+			{
+				positions[vertex] = vertices[vertex].position;
+			}
+			report.overdrawSorted = MeshOptimizer::optimizeOverdraw(indices, positions);
+
+			// Lays the vertices out in the order the triangles now fetch them
+			vector<unsigned long> remap;
+			MeshOptimizer::optimizeVertexFetch(indices, (int)vertices.size(), remap);
+			vector<RegisteredMesh::Vertex> reordered(vertices.size());
+			for (size_t vertex = 0; vertex < vertices.size(); vertex++)
+			{
+				reordered[remap[vertex]] = vertices[vertex];
+			}
+			vertices.swap(reordered);
+		}
+		report.vertices = (int)vertices.size();
+		report.after = MeshOptimizer::simulateCache(indices, (int)vertices.size());
+		report.baseVertex = (int)sharedVertices.size();
+		report.startIndex = (int)sharedIndices.size();
+		sharedVertices.insert(sharedVertices.end(), vertices.begin(), vertices.end());
+		sharedIndices.insert(sharedIndices.end(), indices.begin(), indices.end());
+		sourceBytes += (unsigned long long)entry.requests * (entry.vertices.size() * sizeof(RegisteredMesh::Vertex) + entry.indices.size() * sizeof(unsigned long));
+		reports.push_back(report);
+	}
+
+	// Set up the description of the shared static vertex buffer.
+	D3D11_BUFFER_DESC vertexBufferDesc, indexBufferDesc;
+	D3D11_SUBRESOURCE_DATA vertexData, indexData;
+	vertexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
+	vertexBufferDesc.ByteWidth = sizeof(RegisteredMesh::Vertex) * (UINT)sharedVertices.size();
+	vertexBufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	vertexBufferDesc.CPUAccessFlags = 0;
+	vertexBufferDesc.MiscFlags = 0;
+	vertexBufferDesc.StructureByteStride = 0;
+	vertexData.pSysMem = sharedVertices.data();
+	vertexData.SysMemPitch = 0;
+	vertexData.SysMemSlicePitch = 0;
+	if (FAILED(device->CreateBuffer(&vertexBufferDesc, &vertexData, &vertexBuffer)))
+	{
+		return false;
+	}
+	MemoryTracker::track(vertexBuffer, MEMORY_GEOMETRY, "Shared vertices");
+
+	// Set up the description of the shared static index buffer.
+	indexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
+	indexBufferDesc.ByteWidth = sizeof(unsigned long) * (UINT)sharedIndices.size();
+	indexBufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
+	indexBufferDesc.CPUAccessFlags = 0;
+	indexBufferDesc.MiscFlags = 0;
+	indexBufferDesc.StructureByteStride = 0;
+	indexData.pSysMem = sharedIndices.data();
+	indexData.SysMemPitch = 0;
+	indexData.SysMemSlicePitch = 0;
+	if (FAILED(device->CreateBuffer(&indexBufferDesc, &indexData, &indexBuffer)))
+	{
+		return false;
+	}
+	MemoryTracker::track(indexBuffer, MEMORY_GEOMETRY, "Shared indices");
+	bufferBytes = vertexBufferDesc.ByteWidth + (unsigned long long)indexBufferDesc.ByteWidth;
+
+	for (size_t i = 0; i < entries.size(); i++)
+	{
+		const GeometryReport& report = reports[i];
+		entries[i].mesh->setRange(vertexBuffer, indexBuffer, report.baseVertex, report.vertices, report.startIndex, report.triangles * 3);
+	}
+	buildMilliseconds = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+	return true;
+}
+
+void GeometryRegistry::bind(ID3D11DeviceContext* deviceContext)
+{
+	unsigned int stride = sizeof(RegisteredMesh::Vertex);
+	unsigned int offset = 0;
+	deviceContext->IASetVertexBuffers(0, 1, &vertexBuffer, &stride, &offset);
+	deviceContext->IASetIndexBuffer(indexBuffer, DXGI_FORMAT_R32_UINT, 0);
+	deviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+}
+
+uint64_t GeometryRegistry::hashBytes(const void* data, size_t size, uint64_t hash)
+{
+	// 64 bit FNV-1a, carried on from the hash given so several arrays can be hashed as one
+	const uint8_t* bytes = (const uint8_t*)data;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+void GeometryRegistry::buildCube(int resolution, bool spherical, vector<RegisteredMesh::Vertex>& vertices, vector<unsigned long>& indices)
+{
+	// Each face's outward normal and the two axes across it, ordered so the triangles wind clockwise seen from outside
+	static const XMFLOAT3 faces[6][3] =
+	{
+		{ XMFLOAT3(1, 0, 0), XMFLOAT3(0, 0, -1), XMFLOAT3(0, 1, 0) },
+		{ XMFLOAT3(-1, 0, 0), XMFLOAT3(0, 0, 1), XMFLOAT3(0, 1, 0) },
+		{ XMFLOAT3(0, 1, 0), XMFLOAT3(1, 0, 0), XMFLOAT3(0, 0, -1) },
+		{ XMFLOAT3(0, -1, 0), XMFLOAT3(1, 0, 0), XMFLOAT3(0, 0, 1) },
+		{ XMFLOAT3(0, 0, 1), XMFLOAT3(1, 0, 0), XMFLOAT3(0, 1, 0) },
+		{ XMFLOAT3(0, 0, -1), XMFLOAT3(-1, 0, 0), XMFLOAT3(0, 1, 0) }
+	};
+	resolution = max(resolution, 1);
+	for (int face = 0; face < 6; face++)
+	{
+		XMVECTOR normal = XMLoadFloat3(&faces[face][0]);
+		XMVECTOR across = XMLoadFloat3(&faces[face][1]);
+		XMVECTOR up = XMLoadFloat3(&faces[face][2]);
+
+		// Corner (i, j) of the face's grid, which every quad touching it works out identically so welding can find them
+		auto corner = [&](int i, int j)
+		{
+			float u = (float)i / resolution;
+			float v = (float)j / resolution;
+			XMVECTOR position = XMVectorAdd(normal, XMVectorAdd(XMVectorScale(across, u * 2.0f - 1.0f), XMVectorScale(up, v * 2.0f - 1.0f)));
+			RegisteredMesh::Vertex vertex;
+			if (spherical)
+			{
+				position = XMVector3Normalize(position);
+				XMStoreFloat3(&vertex.normal, position);
+			}
+			else
+			{
+				XMStoreFloat3(&vertex.normal, normal);
+			}
+			XMStoreFloat3(&vertex.position, position);
+			vertex.texture = XMFLOAT2(u, 1.0f - v);
+			return vertex;
+		};
+
+		for (int j = 0; j < resolution; j++)
+		{
+			for (int i = 0; i < resolution; i++)
+			{
+				RegisteredMesh::Vertex quad[6] = { corner(i, j), corner(i + 1, j), corner(i, j + 1), corner(i + 1, j), corner(i + 1, j + 1), corner(i, j + 1) };
+				for (int k = 0; k < 6; k++)
+				{
+					indices.push_back((unsigned long)vertices.size());
+					vertices.push_back(quad[k]);
+				}
+			}
+		}
+	}
+}
+
+void GeometryRegistry::weldVertices(vector<RegisteredMesh::Vertex>& vertices, vector<unsigned long>& indices)
+{
+	vector<RegisteredMesh::Vertex> welded;
+	vector<unsigned long> remap(vertices.size());
+	unordered_multimap<uint64_t, unsigned long> seen;
+	for (size_t vertex = 0; vertex < vertices.size(); vertex++)
+	{
+		uint64_t hash = hashBytes(&vertices[vertex], sizeof(RegisteredMesh::Vertex));
+		unsigned long index = (unsigned long)welded.size();
+		auto range = seen.equal_range(hash);
+		for (auto found = range.first; found != range.second; ++found)
+		{
+			if (memcmp(&welded[found->second], &vertices[vertex], sizeof(RegisteredMesh::Vertex)) == 0)
+			{
+				index = found->second;
+				break;
+			}
+		}
+		if (index == welded.size())
+		{
+			seen.insert(make_pair(hash, index));
+			welded.push_back(vertices[vertex]);
+		}
+		remap[vertex] = index;
+	}
+	for (unsigned long& index : indices)
+	{
+		index = remap[index];
+	}
+	vertices.swap(welded);
+}
@@ -0,0 +1,102 @@
+// Owns the scene's static meshes, packed into one shared vertex buffer and one shared index buffer. Meshes are registered as plain
+// triangle lists and looked up by a hash of their contents, so asking for the same mesh twice hands back the one already registered
+// instead of building a second set of buffers. Building welds each mesh's repeated vertices and reorders its triangles for the
+// post-transform cache and for overdraw, measuring the cache's miss ratio before and after
+#pragma once
+
+#include "DXF.h"
+#include "MeshOptimizer.h"
+#include "RegisteredMesh.h"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+using namespace DirectX;
+
+// One distinct mesh in the shared buffers, and what building it did
+struct GeometryReport
+{
+	string name;
+
+	// Times the mesh was asked for, all of which share the one copy
+	int requests;
+
+	// Vertices as registered and after welding, and its triangles
+	int sourceVertices;
+	int vertices;
+	int triangles;
+
+	// The post-transform cache as the mesh was registered and as built, and whether sorting for overdraw kept its order
+	VertexCacheStats before;
+	VertexCacheStats after;
+	bool overdrawSorted;
+
+	// Where the mesh landed in the shared buffers
+	int startIndex;
+	int baseVertex;
+};
+
+class GeometryRegistry
+{
+public:
+	GeometryRegistry();
+	~GeometryRegistry();
+
+	// Registers a triangle list under a name, returning the mesh already registered with exactly the same vertices and indices if there
+	// is one. Meshes have no buffers until the registry is built
+	RegisteredMesh* add(const string& name, const vector<RegisteredMesh::Vertex>& vertices, const vector<unsigned long>& indices);
+
+	// Registers a cube, or a sphere made by pushing a cube's vertices out to the unit sphere, each face a resolution x resolution grid
+	// of quads. Built as the framework's CubeMesh and SphereMesh are, each quad its own six vertices
+	RegisteredMesh* addCube(int resolution);
+	RegisteredMesh* addSphere(int resolution);
+
+	// Packs every registered mesh into the shared buffers, welding and reordering them first when optimize is set, and points each mesh at
+	// its range. Can be called again to rebuild them either way
+	bool build(ID3D11Device* device, bool optimize = true);
+
+	// Binds both shared buffers whole, for drawing several meshes with their start indices and base vertices without rebinding
+	void bind(ID3D11DeviceContext* deviceContext);
+
+	const vector<GeometryReport>& getReports() const { return reports; }
+	int getRequestCount() const { return requestCount; }
+	int getMeshCount() const { return (int)entries.size(); }
+	bool isOptimized() const { return optimized; }
+	double getBuildMilliseconds() const { return buildMilliseconds; }
+
+	// Bytes of the shared buffers, and of the separate buffers every request would have had without sharing or welding
+	unsigned long long getBufferBytes() const { return bufferBytes; }
+	unsigned long long getSourceBytes() const { return sourceBytes; }
+
+private:
+	struct Entry
+	{
+		string name;
+		vector<RegisteredMesh::Vertex> vertices;
+		vector<unsigned long> indices;
+		RegisteredMesh* mesh;
+		int requests;
+	};
+
+	static uint64_t hashBytes(const void* data, size_t size, uint64_t hash = 14695981039346656037ULL);
+
+	// Appends the cube's six faces, each vertex pushed out to the unit sphere when spherical is set
+	static void buildCube(int resolution, bool spherical, vector<RegisteredMesh::Vertex>& vertices, vector<unsigned long>& indices);
+
+	// Merges vertices whose every byte matches, renumbering the indices to suit
+	static void weldVertices(vector<RegisteredMesh::Vertex>& vertices, vector<unsigned long>& indices);
+
+	vector<Entry> entries;
+	unordered_multimap<uint64_t, size_t> entryIndex;
+	vector<GeometryReport> reports;
+	int requestCount;
+	bool optimized;
+	double buildMilliseconds;
+	unsigned long long bufferBytes;
+	unsigned long long sourceBytes;
+
+	ID3D11Buffer* vertexBuffer;
+	ID3D11Buffer* indexBuffer;
+};
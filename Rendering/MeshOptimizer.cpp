@@ -0,0 +1,306 @@
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <cmath>
+
+// Forsyth's tuning: an LRU cache of 32 vertices is scored, the last triangle's three vertices score a fixed amount so the next triangle
+// doesn't just hug the previous one, older entries decay towards nothing, and vertices with few triangles left are boosted to finish them off
+static const int SCORE_CACHE_SIZE = 32;
+static const float CACHE_DECAY_POWER = 1.5f;
+static const float LAST_TRIANGLE_SCORE = 0.75f;
+static const float VALENCE_BOOST_SCALE = 2.0f;
+static const float VALENCE_BOOST_POWER = 0.5f;
+
+VertexCacheStats MeshOptimizer::simulateCache(const vector<unsigned long>& indices, int vertexCount, int cacheSize)
+{
+	VertexCacheStats stats;
+	stats.triangles = (int)indices.size() / 3;
+	stats.vertices = vertexCount;
+	stats.misses = 0;
+
+	// A vertex is still cached while fewer than cacheSize others have been pushed since it was, so only when each was pushed is kept
+	vector<int> pushedAt(vertexCount, -cacheSize - 1);
+	for (unsigned long index : indices)
+	{
+		if (stats.misses - pushedAt[index] > cacheSize)
+		{
+			pushedAt[index] = stats.misses;
+			stats.misses++;
+		}
+	}
+	stats.acmr = stats.triangles > 0 ? (float)stats.misses / stats.triangles : 0.0f;
+	stats.atvr = vertexCount > 0 ? (float)stats.misses / vertexCount : 0.0f;
+	return stats;
+}
+
+float MeshOptimizer::scoreVertex(int cachePosition, int remainingTriangles)
+{
+	// Vertices with nothing left to draw never pull a triangle in
+	if (remainingTriangles == 0)
+	{
+		return -1.0f;
+	}
+	float score = 0.0f;
+	if (cachePosition >= 0)
+	{
+		if (cachePosition < 3)
+		{
+			score = LAST_TRIANGLE_SCORE;
+		}
+		else
+		{
+			score = powf(1.0f - (float)(cachePosition - 3) / (SCORE_CACHE_SIZE - 3), CACHE_DECAY_POWER);
+		}
+	}
+	return score + VALENCE_BOOST_SCALE * powf((float)remainingTriangles, -VALENCE_BOOST_POWER);
+}
+
+void MeshOptimizer::optimizeVertexCache(vector<unsigned long>& indices, int vertexCount)
+{
+	int triangleCount = (int)indices.size() / 3;
+	if (triangleCount == 0)
+	{
+		return;
+	}
+
+	// Each vertex's triangles, packed one vertex after another. The first remaining[v] of a vertex's are the ones not yet drawn
+	vector<int> remaining(vertexCount, 0);
+	for (unsigned long index : indices)
+	{
+		remaining[index]++;
+	}
+	vector<int> offsets(vertexCount + 1, 0);
+	for (int vertex = 0; vertex < vertexCount; vertex++)
+	{
+		offsets[vertex + 1] = offsets[vertex] + remaining[vertex];
+	}
+	vector<int> adjacency(indices.size());
+	vector<int> filled(vertexCount, 0);
+	for (int triangle = 0; triangle < triangleCount; triangle++)
+	{
+		for (int corner = 0; corner < 3; corner++)
+		{
+			unsigned long vertex = indices[triangle * 3 + corner];
+			adjacency[offsets[vertex] + filled[vertex]++] = triangle;
+		}
+	}
+
+	vector<int> cachePosition(vertexCount, -1);
+	vector<float> vertexScores(vertexCount);
+	for (int vertex = 0; vertex < vertexCount; vertex++)
+	{
+		vertexScores[vertex] = scoreVertex(-1, remaining[vertex]);
+	}
+	vector<float> triangleScores(triangleCount);
+	for (int triangle = 0; triangle < triangleCount; triangle++)
+	{
+		triangleScores[triangle] = vertexScores[indices[triangle * 3]] + vertexScores[indices[triangle * 3 + 1]] + vertexScores[indices[triangle * 3 + 2]];
+	}
+
+	vector<char> emitted(triangleCount, 0);
+	vector<unsigned long> output;
+	output.reserve(indices.size());
+	int cache[SCORE_CACHE_SIZE + 3];
+	int cacheCount = 0;
+	int next = (int)(max_element(triangleScores.begin(), triangleScores.end()) - triangleScores.begin());
+	int scanStart = 0;
+	while ((int)output.size() < triangleCount * 3)
+	{
+		// When nothing in the cache has triangles left, starts again from the first triangle not yet drawn
+		if (next < 0)
+		{
+			while (emitted[scanStart])
+			{
+				scanStart++;
+			}
+			next = scanStart;
+		}
+
+		// Draws the triangle and takes it off its vertices' lists
+		emitted[next] = 1;
+		unsigned long corners[3] = { indices[next * 3], indices[next * 3 + 1], indices[next * 3 + 2] };
+		for (int corner = 0; corner < 3; corner++)
+		{
+			unsigned long vertex = corners[corner];
+			output.push_back(vertex);
+			int* triangles = &adjacency[offsets[vertex]];
+			for (int i = 0; i < remaining[vertex]; i++)
+			{
+				if (triangles[i] == next)
+				{
+					swap(triangles[i], triangles[remaining[vertex] - 1]);
+					remaining[vertex]--;
+					break;
+				}
+			}
+		}
+
+		// Moves its vertices to the front of the cache, pushing the rest back
+		int newCache[SCORE_CACHE_SIZE + 3];
+		int newCount = 0;
+		for (int corner = 0; corner < 3; corner++)
+		{
+			if (find(newCache, newCache + newCount, (int)corners[corner]) == newCache + newCount)
+			{
+				newCache[newCount++] = (int)corners[corner];
+			}
+		}
+		for (int i = 0; i < cacheCount; i++)
+		{
+			if (find(newCache, newCache + newCount, cache[i]) == newCache + newCount)
+			{
+				newCache[newCount++] = cache[i];
+			}
+		}
+
+		// Rescores every vertex that was in either cache, those pushed off the end scoring as uncached
+		for (int i = 0; i < newCount; i++)
+		{
+			int vertex = newCache[i];
+			cachePosition[vertex] = i < SCORE_CACHE_SIZE ? i : -1;
+			vertexScores[vertex] = scoreVertex(cachePosition[vertex], remaining[vertex]);
+		}
+
+		// Rescores their triangles, the best of which is drawn next
+		next = -1;
+		float bestScore = -1.0f;
+		for (int i = 0; i < newCount; i++)
+		{
+			int vertex = newCache[i];
+			const int* triangles = &adjacency[offsets[vertex]];
+			for (int j = 0; j < remaining[vertex]; j++)
+			{
+				int triangle = triangles[j];
+				float score = vertexScores[indices[triangle * 3]] + vertexScores[indices[triangle * 3 + 1]] + vertexScores[indices[triangle * 3 + 2]];
+				triangleScores[triangle] = score;
+				if (score > bestScore)
+				{
+					bestScore = score;
+					next = triangle;
+				}
+			}
+		}
+
+		cacheCount = min(newCount, SCORE_CACHE_SIZE);
+		copy(newCache, newCache + cacheCount, cache);
+	}
+	indices.swap(output);
+}
+
+bool MeshOptimizer::optimizeOverdraw(vector<unsigned long>& indices, const vector<XMFLOAT3>& positions, float threshold)
+{
+	int triangleCount = (int)indices.size() / 3;
+	if (triangleCount < 2)
+	{
+		return false;
+	}
+	int vertexCount = (int)positions.size();
+	float cacheAcmr = simulateCache(indices, vertexCount).acmr;
+
+	// Cuts the order into clusters wherever a triangle misses all three vertices, which is where the cache optimizer started somewhere new
+	vector<int> clusterStarts;
+	vector<int> pushedAt(vertexCount, -SIMULATED_CACHE_SIZE - 1);
+	int misses = 0;
+	for (int triangle = 0; triangle < triangleCount; triangle++)
+	{
+		int triangleMisses = 0;
+		for (int corner = 0; corner < 3; corner++)
+		{
+			unsigned long vertex = indices[triangle * 3 + corner];
+			if (misses - pushedAt[vertex] > SIMULATED_CACHE_SIZE)
+			{
+				pushedAt[vertex] = misses;
+				misses++;
+				triangleMisses++;
+			}
+		}
+		if (triangle == 0 || triangleMisses == 3)
+		{
+			clusterStarts.push_back(triangle);
+		}
+	}
+	int clusterCount = (int)clusterStarts.size();
+	clusterStarts.push_back(triangleCount);
+	if (clusterCount < 2)
+	{
+		return false;
+	}
+
+	// Each cluster's area weighted centre and facing, and the mesh's centre
+	vector<XMFLOAT3> clusterCentres(clusterCount);
+	vector<XMFLOAT3> clusterNormals(clusterCount);
+	XMVECTOR meshCentre = XMVectorZero();
+	float meshArea = 0.0f;
+	for (int cluster = 0; cluster < clusterCount; cluster++)
+	{
+		XMVECTOR centre = XMVectorZero();
+		XMVECTOR normal = XMVectorZero();
+		float area = 0.0f;
+		for (int triangle = clusterStarts[cluster]; triangle < clusterStarts[cluster + 1]; triangle++)
+		{
+			XMVECTOR a = XMLoadFloat3(&positions[indices[triangle * 3]]);
+			XMVECTOR b = XMLoadFloat3(&positions[indices[triangle * 3 + 1]]);
+			XMVECTOR c = XMLoadFloat3(&positions[indices[triangle * 3 + 2]]);
+			XMVECTOR cross = XMVector3Cross(XMVectorSubtract(b, a), XMVectorSubtract(c, a));
+			float triangleArea = XMVectorGetX(XMVector3Length(cross)) * 0.5f;
+			centre = XMVectorAdd(centre, XMVectorScale(XMVectorAdd(XMVectorAdd(a, b), c), triangleArea / 3.0f));
+			normal = XMVectorAdd(normal, cross);
+			area += triangleArea;
+		}
+		meshCentre = XMVectorAdd(meshCentre, centre);
+		meshArea += area;
+		XMStoreFloat3(&clusterCentres[cluster], area > 0.0f ? XMVectorScale(centre, 1.0f / area) : centre);
+		XMStoreFloat3(&clusterNormals[cluster], XMVector3Normalize(normal));
+	}
+	if (meshArea > 0.0f)
+	{
+		meshCentre = XMVectorScale(meshCentre, 1.0f / meshArea);
+	}
+
+	// Clusters further out along their facing occlude more of the mesh, so are drawn first
+	vector<float> sortKeys(clusterCount);
+	vector<int> order(clusterCount);
+	for (int cluster = 0; cluster < clusterCount; cluster++)
+	{
+		XMVECTOR offset = XMVectorSubtract(XMLoadFloat3(&clusterCentres[cluster]), meshCentre);
+		sortKeys[cluster] = XMVectorGetX(XMVector3Dot(offset, XMLoadFloat3(&clusterNormals[cluster])));
+		order[cluster] = cluster;
+	}
+	stable_sort(order.begin(), order.end(), [&sortKeys](int a, int b) { return sortKeys[a] > sortKeys[b]; });
+
+	vector<unsigned long> sorted;
+	sorted.reserve(indices.size());
+	for (int cluster : order)
+	{
+		sorted.insert(sorted.end(), indices.begin() + clusterStarts[cluster] * 3, indices.begin() + clusterStarts[cluster + 1] * 3);
+	}
+
+	// Cutting the clusters apart costs a few misses where they now meet, which is only worth it up to the threshold
+	if (simulateCache(sorted, vertexCount).acmr > cacheAcmr * threshold)
+	{
+		return false;
+	}
+	indices.swap(sorted);
+	return true;
+}
+
+void MeshOptimizer::optimizeVertexFetch(vector<unsigned long>& indices, int vertexCount, vector<unsigned long>& remap)
+{
+	const unsigned long unassigned = ~0ul;
+	remap.assign(vertexCount, unassigned);
+	unsigned long next = 0;
+	for (unsigned long& index : indices)
+	{
+		if (remap[index] == unassigned)
+		{
+			remap[index] = next++;
+		}
+		index = remap[index];
+	}
+	for (int vertex = 0; vertex < vertexCount; vertex++)
+	{
+		if (remap[vertex] == unassigned)
+		{
+			remap[vertex] = next++;
+		}
+	}
+}
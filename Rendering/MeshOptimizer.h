@@ -0,0 +1,46 @@
+// Reorders triangle lists for the GPU. The vertex cache pass is Forsyth's linear speed optimizer, greedily emitting the triangle whose
+// vertices score highest for being recently used and for having few triangles left. The overdraw pass cuts that order where the cache
+// starts over and sorts the pieces so the most outward facing are drawn first, hiding the rest behind them, then keeps the sorted order
+// only if it stays within a few percent of the cache pass. The fetch pass renumbers vertices in the order they're first used
+#pragma once
+
+#include <DirectXMath.h>
+#include <vector>
+
+using namespace std;
+using namespace DirectX;
+
+struct VertexCacheStats
+{
+	int triangles;
+	int vertices;
+	int misses;
+
+	// Average cache miss ratio, vertices transformed per triangle, and average transform to vertex ratio, vertices transformed per vertex
+	float acmr;
+	float atvr;
+};
+
+class MeshOptimizer
+{
+public:
+	// Entries of the post-transform cache the simulator models by default, a FIFO as on most hardware
+	static const int SIMULATED_CACHE_SIZE = 16;
+
+	// Runs a triangle list through a FIFO post-transform cache of cacheSize vertices, counting each vertex that had to be transformed
+	static VertexCacheStats simulateCache(const vector<unsigned long>& indices, int vertexCount, int cacheSize = SIMULATED_CACHE_SIZE);
+
+	// Reorders triangles so their vertices are reused while still in the cache
+	static void optimizeVertexCache(vector<unsigned long>& indices, int vertexCount);
+
+	// Sorts runs of triangles front to back from outside the mesh, keeping the order only if the ACMR grows by less than threshold times
+	// Returns whether the sorted order was kept
+	static bool optimizeOverdraw(vector<unsigned long>& indices, const vector<XMFLOAT3>& positions, float threshold = 1.05f);
+
+	// Fills remap with each vertex's new index, numbering them in the order the triangles first use them, and renumbers the indices to
+	// match. Vertices no triangle uses are numbered after the rest
+	static void optimizeVertexFetch(vector<unsigned long>& indices, int vertexCount, vector<unsigned long>& remap);
+
+private:
+	static float scoreVertex(int cachePosition, int remainingTriangles);
+};
@@ -0,0 +1,112 @@
+#include "PointShadowMap.h"
+#include "MemoryTracker.h"
+
+PointShadowMap::PointShadowMap(ID3D11Device* device, float lnearPlane, float lfarPlane)
+{
+	nearPlane = lnearPlane;
+	farPlane = lfarPlane;
+	position = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	range = farPlane;
+
+	D3D11_BUFFER_DESC bufferDesc;
+	bufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+	bufferDesc.ByteWidth = sizeof(PointShadowBufferType);
+	bufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	bufferDesc.MiscFlags = 0;
+	bufferDesc.StructureByteStride = 0;
+	device->CreateBuffer(&bufferDesc, NULL, &pointShadowBuffer);
+	MemoryTracker::track(pointShadowBuffer, MEMORY_CONSTANTS, "Point shadow constants");
+
+	// Square faces with a 90 degree field of view meet exactly at their edges
+	XMStoreFloat4x4(&projection, XMMatrixPerspectiveFovLH(XM_PIDIV2, 1.0f, nearPlane, farPlane));
+	setLight(position, range);
+}
+
+PointShadowMap::~PointShadowMap()
+{
+	if (pointShadowBuffer)
+	{
+		pointShadowBuffer->Release();
+		pointShadowBuffer = 0;
+	}
+}
+
+void PointShadowMap::setLight(const XMFLOAT3& lposition, float lrange)
+{
+	position = lposition;
+	range = min(max(lrange, nearPlane * 2.0f), farPlane);
+
+	// Looking straight up or down, the faces use the Z axis as up instead, as a cube map does
+	const XMFLOAT3 directions[FACE_COUNT] = { XMFLOAT3(1, 0, 0), XMFLOAT3(-1, 0, 0), XMFLOAT3(0, 1, 0), XMFLOAT3(0, -1, 0), XMFLOAT3(0, 0, 1), XMFLOAT3(0, 0, -1) };
+	const XMFLOAT3 ups[FACE_COUNT] = { XMFLOAT3(0, 1, 0), XMFLOAT3(0, 1, 0), XMFLOAT3(0, 0, -1), XMFLOAT3(0, 0, 1), XMFLOAT3(0, 1, 0), XMFLOAT3(0, 1, 0) };
+	for (int face = 0; face < FACE_COUNT; face++)
+	{
+		XMStoreFloat4x4(&faceViews[face], XMMatrixLookToLH(XMLoadFloat3(&position), XMLoadFloat3(&directions[face]), XMLoadFloat3(&ups[face])));
+	}
+
+	activeFaces.resize(FACE_COUNT);
+	for (int face = 0; face < FACE_COUNT; face++)
+	{
+		activeFaces[face] = face;
+	}
+}
+
+void PointShadowMap::cullFaces(const vector<BoundingBox>& casters)
+{
+	// Each face's frustum only reaches out as far as the light does
+	BoundingFrustum frusta[FACE_COUNT];
+	BoundingFrustum local(XMMatrixPerspectiveFovLH(XM_PIDIV2, 1.0f, nearPlane, range));
+	for (int face = 0; face < FACE_COUNT; face++)
+	{
+		local.Transform(frusta[face], XMMatrixInverse(NULL, getFaceView(face)));
+	}
+
+	// Casters outside the light's range are skipped before testing them against the faces, and testing stops once every face is needed
+	BoundingSphere reach(position, range);
+	bool needed[FACE_COUNT] = { false, false, false, false, false, false };
+	int neededCount = 0;
+	for (const BoundingBox& caster : casters)
+	{
+		if (!reach.Intersects(caster))
+		{
+			continue;
+		}
+		for (int face = 0; face < FACE_COUNT; face++)
+		{
+			if (!needed[face] && frusta[face].Intersects(caster))
+			{
+				needed[face] = true;
+				neededCount++;
+			}
+		}
+		if (neededCount == FACE_COUNT)
+		{
+			break;
+		}
+	}
+
+	activeFaces.clear();
+	for (int face = 0; face < FACE_COUNT; face++)
+	{
+		if (needed[face])
+		{
+			activeFaces.push_back(face);
+		}
+	}
+}
+
+void PointShadowMap::setShaderParameters(ID3D11DeviceContext* deviceContext, bool enabled)
+{
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	deviceContext->Map(pointShadowBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+	PointShadowBufferType* pointPtr = (PointShadowBufferType*)mappedResource.pData;
+	for (int face = 0; face < FACE_COUNT; face++)
+	{
+		pointPtr->faceViewProjection[face] = XMMatrixTranspose(getFaceViewProjection(face));
+	}
+	pointPtr->enabled = enabled ? 1.0f : 0.0f;
+	pointPtr->padding = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	deviceContext->Unmap(pointShadowBuffer, 0);
+	StateCache::get()->setConstantBuffers(deviceContext, STAGE_PS, BUFFER_SLOT, 1, &pointShadowBuffer);
+}
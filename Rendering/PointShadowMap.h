@@ -0,0 +1,60 @@
+// The six faces of an omnidirectional shadow map around a point light. Each face is a 90 degree frustum with its own tile in the shadow atlas,
+// so the whole cube can be drawn in one instanced submission with a viewport per face. Faces no shadow caster reaches are culled on the CPU
+#pragma once
+
+#include "DXF.h"
+#include "StateCache.h"
+#include <vector>
+
+using namespace std;
+using namespace DirectX;
+
+class PointShadowMap
+{
+public:
+	// Faces in the order +X, -X, +Y, -Y, +Z, -Z, matching PointShadowFace in light_h.hlsli
+	static const int FACE_COUNT = 6;
+
+	// Every face's view projection for the lit pixel shaders, matching PointShadowBuffer in the lit pixel shaders
+	struct PointShadowBufferType
+	{
+		XMMATRIX faceViewProjection[FACE_COUNT];
+		float enabled;
+		XMFLOAT3 padding;
+	};
+
+	// Register the point shadow constant buffer is bound to in the pixel shaders that sample shadows
+	static const int BUFFER_SLOT = 5;
+
+	// The depth range matches the spot light's, so both are linearized the same way in the lit shaders
+	PointShadowMap(ID3D11Device* device, float nearPlane = 0.1f, float farPlane = 200.0f);
+	~PointShadowMap();
+
+	// Builds every face's matrices around the light. Nothing further away than range is lit, so culling stops there
+	void setLight(const XMFLOAT3& position, float range);
+
+	// Keeps only the faces whose frustum touches at least one of the casters' bounds
+	void cullFaces(const vector<BoundingBox>& casters);
+
+	// Faces left after culling, in face order
+	const vector<int>& getActiveFaces() const { return activeFaces; }
+
+	XMMATRIX getFaceView(int face) const { return XMLoadFloat4x4(&faceViews[face]); }
+	XMMATRIX getProjection() const { return XMLoadFloat4x4(&projection); }
+	XMMATRIX getFaceViewProjection(int face) const { return getFaceView(face) * getProjection(); }
+
+	// Binds every face's matrix for the lit pixel shaders, which leave the point light unshadowed when not enabled. Stays bound for the rest of the frame
+	void setShaderParameters(ID3D11DeviceContext* deviceContext, bool enabled);
+
+private:
+	ID3D11Buffer* pointShadowBuffer;
+
+	float nearPlane;
+	float farPlane;
+	XMFLOAT3 position;
+	float range;
+
+	XMFLOAT4X4 faceViews[FACE_COUNT];
+	XMFLOAT4X4 projection;
+	vector<int> activeFaces;
+};
@@ -0,0 +1,77 @@
+#include "PostStack.h"
+
+const char* PostStack::getName(PostEffect effect)
+{
+	switch (effect)
+	{
+	case POST_EFFECT_BLUR: return "Blur";
+	case POST_EFFECT_DEPTH_OF_FIELD: return "Depth Of Field";
+	case POST_EFFECT_BOKEH: return "Bokeh Composite";
+	case POST_EFFECT_TONEMAP: return "Tonemap";
+	case POST_EFFECT_COLOUR_GRADE: return "Colour Grade";
+	default: return "Unknown";
+	}
+}
+
+bool PostStack::needsNeighbours(const vector<PostEffect>& effects)
+{
+	for (PostEffect effect : effects)
+	{
+		if (effect == POST_EFFECT_BLUR)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+PostBandwidthEstimate PostStack::estimateBandwidth(const vector<PostEffect>& effects, int renderWidth, int renderHeight, int outputWidth, int outputHeight, int sceneBytes, int depthBytes, int resultBytes)
+{
+	unsigned long long region = (unsigned long long)renderWidth * renderHeight;
+	unsigned long long quarterRegion = (unsigned long long)((renderWidth + 1) / 2) * ((renderHeight + 1) / 2);
+	unsigned long long output = (unsigned long long)outputWidth * outputHeight;
+	bool bokeh = false;
+	for (PostEffect effect : effects)
+	{
+		bokeh = bokeh || effect == POST_EFFECT_BOKEH;
+	}
+
+	PostBandwidthEstimate estimate;
+
+	// The final pass always reads the scene and the camera depth, and writes the back buffer
+	estimate.twoPassBytes = region * (sceneBytes + depthBytes) + output * 4;
+	estimate.twoPassReads = 2;
+	estimate.twoPassWrites = 1;
+	if (bokeh)
+	{
+		// The bokeh result is read at half resolution in place of the blur texture
+		estimate.twoPassBytes += quarterRegion * resultBytes;
+		estimate.twoPassReads++;
+	}
+	else
+	{
+		// The blur pass clears the whole blur texture, reads the scene and writes the blur, which the final pass reads again
+		estimate.twoPassBytes += output * sceneBytes + region * sceneBytes * 3;
+		estimate.twoPassReads += 2;
+		estimate.twoPassWrites += 2;
+	}
+
+	// The stack reads the scene once, and the depth or bokeh result only when an effect needs them, then the final pass just upsamples its result
+	estimate.fusedBytes = region * sceneBytes + region * resultBytes * 2 + output * 4;
+	estimate.fusedReads = 2;
+	estimate.fusedWrites = 2;
+	for (PostEffect effect : effects)
+	{
+		if (effect == POST_EFFECT_DEPTH_OF_FIELD)
+		{
+			estimate.fusedBytes += region * depthBytes;
+			estimate.fusedReads++;
+		}
+		else if (effect == POST_EFFECT_BOKEH)
+		{
+			estimate.fusedBytes += quarterRegion * resultBytes;
+			estimate.fusedReads++;
+		}
+	}
+	return estimate;
+}
@@ -0,0 +1,75 @@
+// The post processing stack, described as an ordered list of effects the post stack compute shader runs in one tile based dispatch, in place of
+// the blur pass writing a whole blurred copy of the screen for the final pass to read back. Each effect works on the colour left by the ones
+// before it, and the blur only makes its result available to the depth of field after it, so the two can be listed in that order or not at all.
+// The bandwidth estimate counts the full screen traffic of the stack against the blur and final passes it replaces
+#pragma once
+
+#include "DXF.h"
+#include <vector>
+
+using namespace std;
+using namespace DirectX;
+
+enum PostEffect
+{
+	// Blurs the scene from the tile held in groupshared memory, for a depth of field listed after it
+	POST_EFFECT_BLUR,
+
+	// Lerps towards the blur by how far each pixel is from the focus, as the depth of field pixel shader does
+	POST_EFFECT_DEPTH_OF_FIELD,
+
+	// Blends the bokeh shader's half resolution result over the scene
+	POST_EFFECT_BOKEH,
+
+	// Scales by the exposure and maps through a filmic curve
+	POST_EFFECT_TONEMAP,
+
+	// Adjusts saturation around the luminance and contrast around mid grey
+	POST_EFFECT_COLOUR_GRADE,
+
+	POST_EFFECT_COUNT
+};
+
+struct PostStackSettings
+{
+	// Depth of field lerp weighting, and how far from the focus (as a fraction of 75 units) a pixel is fully blurred
+	float dofWeight = 1.0f;
+	float dofCutoff = 0.15f;
+
+	// Texels either side of the centre the blur reaches, up to the apron the tile is loaded with
+	float blurRadius = 4.0f;
+
+	float exposure = 1.0f;
+	float saturation = 1.0f;
+	float contrast = 1.0f;
+};
+
+// Full screen bytes moved each frame by the blur and final passes, against the post stack and the final pass reading its result
+struct PostBandwidthEstimate
+{
+	unsigned long long twoPassBytes;
+	unsigned long long fusedBytes;
+
+	// Full screen reads and writes, counting the final pass's output to the back buffer on both sides
+	int twoPassReads;
+	int twoPassWrites;
+	int fusedReads;
+	int fusedWrites;
+};
+
+class PostStack
+{
+public:
+	// Most effects one stack can list, and the widest blur the tile's apron allows for
+	static const int MAX_EFFECTS = 8;
+	static const int MAX_BLUR_RADIUS = 4;
+
+	static const char* getName(PostEffect effect);
+
+	// Whether any effect in the list reads neighbouring texels, so the tile needs loading with an apron around it
+	static bool needsNeighbours(const vector<PostEffect>& effects);
+
+	// Estimates the traffic of a renderWidth x renderHeight region shown on an outputWidth x outputHeight back buffer, assuming every texel
+	// is fetched from memory once and neighbouring taps hit the cache. The scene and blur are sceneBytes a texel, the stack's result resultBytes
+	static PostBandwidthEstimate estimateBandwidth(const vector<PostEffect>& effects, int renderWidth, int renderHeight, int outputWidth, int outputHeight, int sceneBytes, int depthBytes, int resultBytes);
+};
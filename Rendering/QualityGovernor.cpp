@@ -0,0 +1,101 @@
+#include "QualityGovernor.h"
+
+QualityGovernor::QualityGovernor()
+{
+	policy = 0;
+	frame = 0;
+	changeCount = 0;
+	reset();
+}
+
+QualityGovernor::~QualityGovernor()
+{
+	log.close();
+}
+
+void QualityGovernor::setPolicy(QualityPolicy* lpolicy)
+{
+	policy = lpolicy;
+}
+
+void QualityGovernor::reset()
+{
+	settings.tessellationLevel = 0;
+	settings.shadowTier = 0;
+	settings.blurRadius = QUALITY_MAX_BLUR_RADIUS;
+	framesOver = 0;
+	framesUnder = 0;
+	cooldown = 0;
+	raiseDelay = raiseFrames;
+	framesSinceRaise = INT_MAX / 2;
+	lastChange = 0;
+}
+
+void QualityGovernor::update(const QualityTimings& timings)
+{
+	frame++;
+	lastChange = 0;
+	framesSinceRaise++;
+
+	if (enabled && policy && timings.frameMilliseconds > 0.0f)
+	{
+		// Counts how long the frame has been outside the band, any frame inside it starting the count again
+		framesOver = timings.frameMilliseconds > targetMilliseconds * (1.0f + overBand) ? framesOver + 1 : 0;
+		framesUnder = timings.frameMilliseconds < targetMilliseconds * (1.0f - underBand) ? framesUnder + 1 : 0;
+
+		if (cooldown > 0)
+		{
+			cooldown--;
+		}
+		else if (framesOver >= lowerFrames)
+		{
+			// A raise that put the frame straight back over budget means that level doesn't fit, so wait twice as long before trying it again
+			if (framesSinceRaise < raiseDelay)
+			{
+				raiseDelay = min(raiseDelay * 2, raiseFrames * 16);
+			}
+			if (policy->lower(settings, timings))
+			{
+				lastChange = -1;
+			}
+		}
+		else if (framesUnder >= raiseDelay)
+		{
+			if (policy->raise(settings, timings))
+			{
+				lastChange = 1;
+				framesSinceRaise = 0;
+			}
+		}
+
+		if (lastChange != 0)
+		{
+			changeCount++;
+			framesOver = 0;
+			framesUnder = 0;
+			cooldown = cooldownFrames;
+		}
+
+		// Sustained time within budget with no failed raise lets the wait shrink back to normal
+		if (framesSinceRaise > raiseDelay * 4 && raiseDelay > raiseFrames)
+		{
+			raiseDelay = max(raiseDelay / 2, raiseFrames);
+			framesSinceRaise = raiseDelay;
+		}
+	}
+
+	if (log.isOpen())
+	{
+		log.addRow({ (double)frame, timings.frameMilliseconds, targetMilliseconds, getTessellationBias(), (double)settings.shadowTier, (double)settings.blurRadius, (double)lastChange });
+	}
+}
+
+bool QualityGovernor::startLog(const char* filename)
+{
+	return log.open(filename, { "frame", "gpu_ms", "target_ms", "tessellation_bias", "shadow_tier", "blur_radius", "change" });
+}
+
+void QualityGovernor::stopLog()
+{
+	log.close();
+}
@@ -0,0 +1,69 @@
+// Adjusts the tessellation factor, shadow map resolution and blur radius to keep the GPU frame time near a target.
+// Changes only happen after the frame has been out of budget for several frames in a row, and a quality increase that
+// immediately pushes the frame back over budget makes the governor wait longer before trying again, so it doesn't oscillate
+#pragma once
+
+#include "QualityPolicy.h"
+#include "BenchmarkLog.h"
+#include <algorithm>
+#include <climits>
+
+using namespace std;
+
+class QualityGovernor
+{
+public:
+	QualityGovernor();
+	~QualityGovernor();
+
+	// Sets the rules for choosing which setting to change. The policy is not owned, and must outlive the governor
+	void setPolicy(QualityPolicy* policy);
+	QualityPolicy* getPolicy() { return policy; }
+
+	// Feeds in a frame's timings, lowering or raising one setting if the frame has been out of budget for long enough
+	void update(const QualityTimings& timings);
+
+	// Puts every setting back to full quality
+	void reset();
+
+	// Writes the chosen settings for every frame to a CSV file
+	bool startLog(const char* filename);
+	void stopLog();
+	bool isLogging() const { return log.isOpen(); }
+
+	const QualitySettings& getSettings() const { return settings; }
+	float getTessellationBias() const { return QualityPolicy::getTessellationBias(settings.tessellationLevel); }
+	int getShadowResolution(int fullResolution) const { return QualityPolicy::getShadowResolution(settings.shadowTier, fullResolution); }
+
+	// -1 if the last update lowered a setting, 1 if it raised one, otherwise 0
+	int getLastChange() const { return lastChange; }
+	int getChangeCount() const { return changeCount; }
+	int getRaiseDelay() const { return raiseDelay; }
+
+	bool enabled = false;
+	float targetMilliseconds = 16.0f;
+
+	// Hysteresis band. The frame must be this fraction over the target to lower quality, and this fraction under to raise it
+	float overBand = 0.05f;
+	float underBand = 0.2f;
+
+	// Consecutive frames out of the band before acting, and frames to ignore after any change while the timings catch up
+	int lowerFrames = 5;
+	int raiseFrames = 60;
+	int cooldownFrames = 20;
+
+private:
+	QualityPolicy* policy;
+	QualitySettings settings;
+
+	int framesOver;
+	int framesUnder;
+	int cooldown;
+	int raiseDelay;
+	int framesSinceRaise;
+	int lastChange;
+	int changeCount;
+	int frame;
+
+	BenchmarkLog log;
+};
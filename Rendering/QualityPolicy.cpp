@@ -0,0 +1,180 @@
+#include "QualityPolicy.h"
+
+// Tessellation factor multiplier at each level
+static const float tessellationBiases[QUALITY_TESSELLATION_LEVELS] = { 1.0f, 0.75f, 0.5f, 0.35f, 0.25f };
+
+float QualityPolicy::getTessellationBias(int level)
+{
+	if (level < 0)
+	{
+		level = 0;
+	}
+	if (level >= QUALITY_TESSELLATION_LEVELS)
+	{
+		level = QUALITY_TESSELLATION_LEVELS - 1;
+	}
+	return tessellationBiases[level];
+}
+
+int QualityPolicy::getShadowResolution(int tier, int fullResolution)
+{
+	return fullResolution >> tier;
+}
+
+float CostWeightedPolicy::tessellationSaving(const QualitySettings& settings, const QualityTimings& timings) const
+{
+	if (settings.tessellationLevel >= QUALITY_TESSELLATION_LEVELS - 1)
+	{
+		return 0.0f;
+	}
+
+	// Triangle count goes with the square of the tessellation factor
+	float bias = getTessellationBias(settings.tessellationLevel);
+	float nextBias = getTessellationBias(settings.tessellationLevel + 1);
+	return timings.tessellationMilliseconds * (1.0f - (nextBias * nextBias) / (bias * bias));
+}
+
+float CostWeightedPolicy::shadowSaving(const QualitySettings& settings, const QualityTimings& timings) const
+{
+	if (settings.shadowTier >= QUALITY_SHADOW_TIERS - 1)
+	{
+		return 0.0f;
+	}
+
+	// Halving the resolution quarters the texels written, but the shadow passes also pay for their geometry, so only half is counted
+	return timings.shadowMilliseconds * 0.5f;
+}
+
+float CostWeightedPolicy::blurSaving(const QualitySettings& settings, const QualityTimings& timings) const
+{
+	if (settings.blurRadius <= QUALITY_MIN_BLUR_RADIUS)
+	{
+		return 0.0f;
+	}
+
+	// The blur takes four samples for every texel of radius, plus the centre
+	float samples = settings.blurRadius * 4.0f + 1.0f;
+	return timings.blurMilliseconds * 4.0f / samples;
+}
+
+bool CostWeightedPolicy::lower(QualitySettings& settings, const QualityTimings& timings)
+{
+	float tessellation = tessellationSaving(settings, timings);
+	float shadow = shadowSaving(settings, timings);
+	float blur = blurSaving(settings, timings);
+
+	if (tessellation <= 0.0f && shadow <= 0.0f && blur <= 0.0f)
+	{
+		return false;
+	}
+	if (tessellation >= shadow && tessellation >= blur)
+	{
+		settings.tessellationLevel++;
+	}
+	else if (shadow >= blur)
+	{
+		settings.shadowTier++;
+	}
+	else
+	{
+		settings.blurRadius--;
+	}
+	return true;
+}
+
+bool CostWeightedPolicy::raise(QualitySettings& settings, const QualityTimings& timings)
+{
+	// Works out what each setting would cost to raise, scaling the saving of lowering it again from the raised level back to the current timings
+	QualitySettings raised;
+	float bestCost = -1.0f;
+	int best = -1;
+
+	raised = settings;
+	raised.tessellationLevel--;
+	if (raised.tessellationLevel >= 0)
+	{
+		float bias = getTessellationBias(settings.tessellationLevel);
+		float cost = tessellationSaving(raised, timings) * (getTessellationBias(raised.tessellationLevel) * getTessellationBias(raised.tessellationLevel)) / (bias * bias);
+		bestCost = cost;
+		best = 0;
+	}
+
+	raised = settings;
+	raised.shadowTier--;
+	if (raised.shadowTier >= 0)
+	{
+		// Doubling the resolution quadruples the texels written, so the whole of the current shadow time is a cautious estimate of the cost
+		float cost = timings.shadowMilliseconds;
+		if (best < 0 || cost < bestCost)
+		{
+			bestCost = cost;
+			best = 1;
+		}
+	}
+
+	raised = settings;
+	raised.blurRadius++;
+	if (raised.blurRadius <= QUALITY_MAX_BLUR_RADIUS)
+	{
+		float cost = blurSaving(raised, timings) * (raised.blurRadius * 4.0f + 1.0f) / (settings.blurRadius * 4.0f + 1.0f);
+		if (best < 0 || cost < bestCost)
+		{
+			bestCost = cost;
+			best = 2;
+		}
+	}
+
+	switch (best)
+	{
+	case 0:
+		settings.tessellationLevel--;
+		return true;
+	case 1:
+		settings.shadowTier--;
+		return true;
+	case 2:
+		settings.blurRadius++;
+		return true;
+	}
+	return false;
+}
+
+bool FixedOrderPolicy::lower(QualitySettings& settings, const QualityTimings& timings)
+{
+	if (settings.blurRadius > QUALITY_MIN_BLUR_RADIUS)
+	{
+		settings.blurRadius--;
+		return true;
+	}
+	if (settings.tessellationLevel < QUALITY_TESSELLATION_LEVELS - 1)
+	{
+		settings.tessellationLevel++;
+		return true;
+	}
+	if (settings.shadowTier < QUALITY_SHADOW_TIERS - 1)
+	{
+		settings.shadowTier++;
+		return true;
+	}
+	return false;
+}
+
+bool FixedOrderPolicy::raise(QualitySettings& settings, const QualityTimings& timings)
+{
+	if (settings.shadowTier > 0)
+	{
+		settings.shadowTier--;
+		return true;
+	}
+	if (settings.tessellationLevel > 0)
+	{
+		settings.tessellationLevel--;
+		return true;
+	}
+	if (settings.blurRadius < QUALITY_MAX_BLUR_RADIUS)
+	{
+		settings.blurRadius++;
+		return true;
+	}
+	return false;
+}
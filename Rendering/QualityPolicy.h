@@ -0,0 +1,76 @@
+// Rules deciding which quality setting to trade away when the frame is over budget, and which to restore when there's time to spare.
+// The governor only decides when to change, a policy decides what, so different trade-offs can be plugged in without touching the governor
+#pragma once
+
+// Quality settings the governor controls, each as a level so changes are discrete and easy to log
+struct QualitySettings
+{
+	// 0 is the tessellation factor as set, each level after multiplies it down further
+	int tessellationLevel;
+
+	// 0 is the full size shadow maps, each tier halves their resolution
+	int shadowTier;
+
+	// Texels sampled either side of each pixel in the blur
+	int blurRadius;
+};
+
+// Measured GPU times the policy bases its choice on, in milliseconds
+struct QualityTimings
+{
+	float frameMilliseconds;
+	float targetMilliseconds;
+
+	// The camera depth and screen passes, whose cost follows the tessellation factor, the shadow passes, and the blur pass. No pass is in two
+	float tessellationMilliseconds;
+	float shadowMilliseconds;
+	float blurMilliseconds;
+};
+
+// Limits of each setting
+static const int QUALITY_TESSELLATION_LEVELS = 5;
+static const int QUALITY_SHADOW_TIERS = 4;
+static const int QUALITY_MIN_BLUR_RADIUS = 1;
+static const int QUALITY_MAX_BLUR_RADIUS = 4;
+
+class QualityPolicy
+{
+public:
+	virtual ~QualityPolicy() {}
+
+	virtual const char* getName() const = 0;
+
+	// Makes the settings one step cheaper. Returns false if there's nothing left to lower
+	virtual bool lower(QualitySettings& settings, const QualityTimings& timings) = 0;
+
+	// Makes the settings one step better. Returns false if everything is already at full quality
+	virtual bool raise(QualitySettings& settings, const QualityTimings& timings) = 0;
+
+	// Multiplier applied to the tessellation factor at a level, and the shadow map resolution at a tier
+	static float getTessellationBias(int level);
+	static int getShadowResolution(int tier, int fullResolution);
+};
+
+// Lowers whichever setting is predicted to save the most time this frame, and raises whichever is predicted to cost the least
+class CostWeightedPolicy : public QualityPolicy
+{
+public:
+	const char* getName() const { return "Cost Weighted"; }
+	bool lower(QualitySettings& settings, const QualityTimings& timings);
+	bool raise(QualitySettings& settings, const QualityTimings& timings);
+
+private:
+	// Predicted change in milliseconds from moving each setting one step down, or zero if it can't move
+	float tessellationSaving(const QualitySettings& settings, const QualityTimings& timings) const;
+	float shadowSaving(const QualitySettings& settings, const QualityTimings& timings) const;
+	float blurSaving(const QualitySettings& settings, const QualityTimings& timings) const;
+};
+
+// Always gives up the blur first, then tessellation, then shadow resolution, and restores them in reverse
+class FixedOrderPolicy : public QualityPolicy
+{
+public:
+	const char* getName() const { return "Fixed Order"; }
+	bool lower(QualitySettings& settings, const QualityTimings& timings);
+	bool raise(QualitySettings& settings, const QualityTimings& timings);
+};
@@ -0,0 +1,225 @@
+#include "RenderQueue.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+RenderQueue::RenderQueue(int threads)
+{
+	threadCount = threads > 0 ? threads : max((int)thread::hardware_concurrency(), 1);
+	workerPackets.resize(threadCount);
+	memset(&stats, 0, sizeof(stats));
+	buildMilliseconds = 0.0;
+
+	stopping = false;
+	job = NULL;
+	jobCount = 0;
+	jobRanges = 0;
+	generation = 0;
+	rangesLeft = 0;
+
+	// The calling thread builds the first range of every build, so it needs one worker fewer than there are threads
+	for (int worker = 1; worker < threadCount; worker++)
+	{
+		workers.push_back(thread(&RenderQueue::runWorker, this, worker));
+	}
+}
+
+RenderQueue::~RenderQueue()
+{
+	{
+		lock_guard<mutex> guard(lock);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (thread& worker : workers)
+	{
+		worker.join();
+	}
+}
+
+unsigned long long RenderQueue::makeKey(unsigned int pass, unsigned int shader, unsigned int material, unsigned int mesh, float depth)
+{
+	// Nearer draws get smaller keys, so they come first within the rest of the key
+	float clamped = min(max(depth, 0.0f), 1.0f);
+	unsigned long long depthBits = (unsigned long long)(clamped * (float)((1 << DEPTH_BITS) - 1));
+
+	unsigned long long key = min(pass, (1u << PASS_BITS) - 1);
+	key = (key << SHADER_BITS) | min(shader, (1u << SHADER_BITS) - 1);
+	key = (key << MATERIAL_BITS) | min(material, (1u << MATERIAL_BITS) - 1);
+	key = (key << MESH_BITS) | min(mesh, (1u << MESH_BITS) - 1);
+	key = (key << DEPTH_BITS) | depthBits;
+	return key;
+}
+
+void RenderQueue::clear()
+{
+	packets.clear();
+	for (vector<DrawPacket>& list : workerPackets)
+	{
+		list.clear();
+	}
+	buildMilliseconds = 0.0;
+}
+
+void RenderQueue::submit(unsigned long long key, unsigned int item)
+{
+	DrawPacket packet;
+	packet.key = key;
+	packet.item = item;
+	packet.padding = 0;
+	packets.push_back(packet);
+}
+
+void RenderQueue::build(int count, const function<void(int first, int last, vector<DrawPacket>& packets)>& builder)
+{
+	if (count <= 0)
+	{
+		return;
+	}
+	chrono::high_resolution_clock::time_point buildStart = chrono::high_resolution_clock::now();
+
+	// Splits the range between the threads, each appending to its own list so none of them has to lock
+	int ranges = min(threadCount, max(count / MIN_PACKETS_PER_WORKER, 1));
+	if (ranges == 1)
+	{
+		builder(0, count - 1, workerPackets[0]);
+	}
+	else
+	{
+		// Wakes the workers for the other ranges, builds the first here, then waits for the rest
+		{
+			lock_guard<mutex> guard(lock);
+			job = &builder;
+			jobCount = count;
+			jobRanges = ranges;
+			rangesLeft = ranges - 1;
+			generation++;
+		}
+		wake.notify_all();
+		builder(0, count / ranges - 1, workerPackets[0]);
+
+		unique_lock<mutex> guard(lock);
+		finished.wait(guard, [this] { return rangesLeft == 0; });
+		job = NULL;
+	}
+	buildMilliseconds += chrono::duration<double, milli>(chrono::high_resolution_clock::now() - buildStart).count();
+}
+
+void RenderQueue::runWorker(int worker)
+{
+	unsigned int seen = 0;
+	unique_lock<mutex> guard(lock);
+	while (true)
+	{
+		wake.wait(guard, [this, seen] { return stopping || generation != seen; });
+		if (stopping)
+		{
+			return;
+		}
+		seen = generation;
+
+		// Builds with fewer ranges than there are threads leave the last workers asleep
+		if (worker >= jobRanges)
+		{
+			continue;
+		}
+		const function<void(int first, int last, vector<DrawPacket>& packets)>& builder = *job;
+		int first = jobCount * worker / jobRanges;
+		int last = jobCount * (worker + 1) / jobRanges - 1;
+
+		guard.unlock();
+		builder(first, last, workerPackets[worker]);
+		guard.lock();
+
+		rangesLeft--;
+		if (rangesLeft == 0)
+		{
+			finished.notify_one();
+		}
+	}
+}
+
+void RenderQueue::sort()
+{
+	chrono::high_resolution_clock::time_point sortStart = chrono::high_resolution_clock::now();
+
+	// Joins the workers' lists onto the packets submitted directly
+	for (vector<DrawPacket>& list : workerPackets)
+	{
+		packets.insert(packets.end(), list.begin(), list.end());
+		list.clear();
+	}
+	radixSort(packets, scratch);
+	stats.sortMilliseconds = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - sortStart).count();
+	stats.buildMilliseconds = buildMilliseconds;
+
+	// Counts what an executor would have to change walking the packets in order, the first packet changing everything
+	stats.packets = (int)packets.size();
+	stats.passChanges = 0;
+	stats.shaderChanges = 0;
+	stats.materialChanges = 0;
+	stats.meshChanges = 0;
+	for (size_t i = 0; i < packets.size(); i++)
+	{
+		unsigned long long key = packets[i].key;
+		unsigned long long previous = i > 0 ? packets[i - 1].key : ~key;
+		stats.passChanges += getPass(key) != getPass(previous);
+		stats.shaderChanges += getShader(key) != getShader(previous);
+		stats.materialChanges += getMaterial(key) != getMaterial(previous);
+		stats.meshChanges += getMesh(key) != getMesh(previous);
+	}
+}
+
+void RenderQueue::radixSort(vector<DrawPacket>& packets, vector<DrawPacket>& scratch)
+{
+	size_t count = packets.size();
+	if (count < 2)
+	{
+		return;
+	}
+	scratch.resize(count);
+
+	// Counts every byte of every key in one read, so bytes all the keys share can be skipped without another
+	static const int BYTES = 8;
+	vector<size_t> histograms(BYTES * 256, 0);
+	for (size_t i = 0; i < count; i++)
+	{
+		unsigned long long key = packets[i].key;
+		for (int byte = 0; byte < BYTES; byte++)
+		{
+			histograms[byte * 256 + ((key >> (byte * 8)) & 0xFF)]++;
+		}
+	}
+
+	DrawPacket* source = packets.data();
+	DrawPacket* destination = scratch.data();
+	for (int byte = 0; byte < BYTES; byte++)
+	{
+		size_t* histogram = &histograms[byte * 256];
+		if (histogram[(source[0].key >> (byte * 8)) & 0xFF] == count)
+		{
+			continue;
+		}
+
+		// Turns the counts into where each value's run starts, then scatters keeping the order of equal bytes
+		size_t offset = 0;
+		for (int value = 0; value < 256; value++)
+		{
+			size_t valueCount = histogram[value];
+			histogram[value] = offset;
+			offset += valueCount;
+		}
+		for (size_t i = 0; i < count; i++)
+		{
+			destination[histogram[(source[i].key >> (byte * 8)) & 0xFF]++] = source[i];
+		}
+		swap(source, destination);
+	}
+
+	// An odd number of scatters leaves the result in the scratch buffer
+	if (source != packets.data())
+	{
+		packets.swap(scratch);
+	}
+}
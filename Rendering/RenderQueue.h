@@ -0,0 +1,109 @@
+// Collects a pass's draws as packets with 64 bit sort keys, radix sorts them and hands them back in an order that changes the pipeline as
+// little as possible: every draw of a pass together, then of a shader, then of a material and mesh, nearest first within those so early depth
+// rejection gets the most out of them. Building can be split across worker threads, started once with the queue and woken for each build,
+// each filling its own list, which are joined before sorting.
+// What a packet draws is left to whoever executes the queue, from the ids in its key and the item index it carries
+#pragma once
+
+#include <vector>
+#include <functional>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+using namespace std;
+
+// A draw, small enough that sorting moves little memory. The item indexes whatever the submitter keeps per draw, such as an object record
+struct DrawPacket
+{
+	unsigned long long key;
+	unsigned int item;
+	unsigned int padding;
+};
+
+// Changes an executor would make walking the sorted packets, counted as each field of the key changes from the packet before
+struct RenderQueueStats
+{
+	int packets;
+	int passChanges;
+	int shaderChanges;
+	int materialChanges;
+	int meshChanges;
+
+	// Times for the last frame's build and sort, and the submit time given back by the executor
+	double buildMilliseconds;
+	double sortMilliseconds;
+	double submitMilliseconds;
+};
+
+class RenderQueue
+{
+public:
+	// Bits of each key field, highest first. Depth is the most significant bits of the distance scaled to the far plane
+	static const int PASS_BITS = 4;
+	static const int SHADER_BITS = 8;
+	static const int MATERIAL_BITS = 16;
+	static const int MESH_BITS = 12;
+	static const int DEPTH_BITS = 24;
+
+	// Packets below this per worker are built on the calling thread, as waking a worker costs more than they take
+	static const int MIN_PACKETS_PER_WORKER = 4096;
+
+	// Starts threadCount - 1 workers, the calling thread being the last. Zero uses one thread per hardware thread
+	RenderQueue(int threadCount = 0);
+	~RenderQueue();
+
+	// Packs the fields into a key, clamping depth to [0, 1] and each id to its bits. Decoding gives back the ids
+	static unsigned long long makeKey(unsigned int pass, unsigned int shader, unsigned int material, unsigned int mesh, float depth);
+	static unsigned int getPass(unsigned long long key) { return (unsigned int)(key >> (64 - PASS_BITS)); }
+	static unsigned int getShader(unsigned long long key) { return (unsigned int)(key >> (MATERIAL_BITS + MESH_BITS + DEPTH_BITS)) & ((1 << SHADER_BITS) - 1); }
+	static unsigned int getMaterial(unsigned long long key) { return (unsigned int)(key >> (MESH_BITS + DEPTH_BITS)) & ((1 << MATERIAL_BITS) - 1); }
+	static unsigned int getMesh(unsigned long long key) { return (unsigned int)(key >> DEPTH_BITS) & ((1 << MESH_BITS) - 1); }
+
+	// Empties the queue for a new frame, keeping its memory
+	void clear();
+
+	// Adds one packet from the calling thread
+	void submit(unsigned long long key, unsigned int item);
+
+	// Calls builder over [0, count) split into ranges, on the worker threads and the calling thread when there are enough to be worth it,
+	// each range appending its packets to a list of its own. Returns once every range is built. The builder must only read shared data
+	void build(int count, const function<void(int first, int last, vector<DrawPacket>& packets)>& builder);
+
+	// Joins the lists, radix sorts the packets by key and counts the changes between them
+	void sort();
+
+	const vector<DrawPacket>& getPackets() const { return packets; }
+	int getThreadCount() const { return threadCount; }
+
+	// The executor reports how long it took to submit the sorted packets, so the queue's stats hold the whole cost
+	void setSubmitTime(double milliseconds) { stats.submitMilliseconds = milliseconds; }
+	const RenderQueueStats& getStats() const { return stats; }
+
+	// Sorts keyed packets least significant byte first, skipping bytes every key shares, using scratch as the second buffer
+	static void radixSort(vector<DrawPacket>& packets, vector<DrawPacket>& scratch);
+
+private:
+	// Waits for builds, building this worker's range of each one that has enough ranges to include it, until the queue is destroyed
+	void runWorker(int worker);
+
+	int threadCount;
+	vector<DrawPacket> packets;
+	vector<DrawPacket> scratch;
+	vector<vector<DrawPacket>> workerPackets;
+	RenderQueueStats stats;
+	double buildMilliseconds;
+
+	// The build being run, handed to the workers under the lock. Each new build bumps the generation, and rangesLeft counts the workers'
+	// ranges still building
+	vector<thread> workers;
+	mutex lock;
+	condition_variable wake;
+	condition_variable finished;
+	bool stopping;
+	const function<void(int first, int last, vector<DrawPacket>& packets)>* job;
+	int jobCount;
+	int jobRanges;
+	unsigned int generation;
+	int rangesLeft;
+};
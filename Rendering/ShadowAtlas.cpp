@@ -0,0 +1,347 @@
+#include "ShadowAtlas.h"
+#include "MemoryTracker.h"
+
+ShadowAtlas::ShadowAtlas(ID3D11Device* device, HWND hwnd, int latlasSize, int llightCount, int lminTileSize)
+{
+	atlasSize = latlasSize;
+	lightCount = min(llightCount, MAX_TILES);
+	minTileSize = lminTileSize;
+	maxTileSize = atlasSize / 2;
+	tilesRendered = 0;
+	repackCount = 0;
+
+	// Typeless, so it can be written as depth and read as a float texture
+	D3D11_TEXTURE2D_DESC textureDesc;
+	ZeroMemory(&textureDesc, sizeof(textureDesc));
+	textureDesc.Width = atlasSize;
+	textureDesc.Height = atlasSize;
+	textureDesc.MipLevels = 1;
+	textureDesc.ArraySize = 1;
+	textureDesc.Format = DXGI_FORMAT_R32_TYPELESS;
+	textureDesc.SampleDesc.Count = 1;
+	textureDesc.Usage = D3D11_USAGE_DEFAULT;
+	textureDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE;
+	device->CreateTexture2D(&textureDesc, NULL, &atlasTexture);
+	MemoryTracker::track(atlasTexture, MEMORY_SHADOW, "Shadow atlas");
+
+	D3D11_DEPTH_STENCIL_VIEW_DESC dsvDesc;
+	ZeroMemory(&dsvDesc, sizeof(dsvDesc));
+	dsvDesc.Format = DXGI_FORMAT_D32_FLOAT;
+	dsvDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
+	device->CreateDepthStencilView(atlasTexture, &dsvDesc, &atlasDSV);
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
+	ZeroMemory(&srvDesc, sizeof(srvDesc));
+	srvDesc.Format = DXGI_FORMAT_R32_FLOAT;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+	srvDesc.Texture2D.MipLevels = 1;
+	device->CreateShaderResourceView(atlasTexture, &srvDesc, &atlasSRV);
+
+	D3D11_BUFFER_DESC bufferDesc;
+	bufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+	bufferDesc.ByteWidth = sizeof(ShadowAtlasBufferType);
+	bufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	bufferDesc.MiscFlags = 0;
+	bufferDesc.StructureByteStride = 0;
+	device->CreateBuffer(&bufferDesc, NULL, &atlasBuffer);
+	MemoryTracker::track(atlasBuffer, MEMORY_CONSTANTS, "Shadow atlas constants");
+
+	clearShader = new ShadowTileClearShader(device, hwnd);
+
+	// Every light starts with the largest tile it could have, until its importance has been measured
+	ShadowAtlasTile tile = { -1, -1, 0 };
+	tiles.assign(lightCount, tile);
+	importance.assign(lightCount, 1.0f);
+	pendingSize.assign(lightCount, maxTileSize);
+	pendingFrames.assign(lightCount, 0);
+	dirty.assign(lightCount, true);
+	XMFLOAT4X4 identity;
+	XMStoreFloat4x4(&identity, XMMatrixIdentity());
+	viewProjections.assign(lightCount, identity);
+	repack(vector<int>(lightCount, maxTileSize));
+}
+
+ShadowAtlas::~ShadowAtlas()
+{
+	// Release the atlas and its views
+	if (atlasSRV)
+	{
+		atlasSRV->Release();
+		atlasSRV = 0;
+	}
+	if (atlasDSV)
+	{
+		atlasDSV->Release();
+		atlasDSV = 0;
+	}
+	if (atlasTexture)
+	{
+		atlasTexture->Release();
+		atlasTexture = 0;
+	}
+	if (atlasBuffer)
+	{
+		atlasBuffer->Release();
+		atlasBuffer = 0;
+	}
+	if (clearShader)
+	{
+		delete clearShader;
+		clearShader = 0;
+	}
+}
+
+void ShadowAtlas::setImportance(int light, float limportance)
+{
+	importance[light] = min(max(limportance, 0.0f), 1.0f);
+}
+
+void ShadowAtlas::setLightViewProjection(int light, const XMMATRIX& viewProjection)
+{
+	XMFLOAT4X4 matrix;
+	XMStoreFloat4x4(&matrix, viewProjection);
+	for (int i = 0; i < 16; i++)
+	{
+		if (fabsf(((float*)&matrix)[i] - ((float*)&viewProjections[light])[i]) > 1e-6f)
+		{
+			viewProjections[light] = matrix;
+			dirty[light] = true;
+			return;
+		}
+	}
+}
+
+void ShadowAtlas::invalidate(int light)
+{
+	dirty[light] = true;
+}
+
+void ShadowAtlas::invalidateAll()
+{
+	dirty.assign(lightCount, true);
+}
+
+void ShadowAtlas::setMaxTileSize(int size)
+{
+	maxTileSize = min(max(size, minTileSize), atlasSize);
+}
+
+int ShadowAtlas::sizeForImportance(float lightImportance) const
+{
+	// A tile's area follows the light's screen coverage, so its side follows the square root, rounded down to a power of two
+	float wanted = maxTileSize * sqrtf(lightImportance);
+	int size = minTileSize;
+	while (size * 2 <= wanted && size * 2 <= maxTileSize)
+	{
+		size *= 2;
+	}
+	return size;
+}
+
+void ShadowAtlas::update()
+{
+	vector<int> sizes(lightCount);
+	bool resized = false;
+	for (int light = 0; light < lightCount; light++)
+	{
+		int wanted = sizeForImportance(importance[light]);
+		sizes[light] = tiles[light].size;
+
+		// A tile over the size limit shrinks straight away, otherwise the light has to keep asking for the new size for a while
+		if (wanted == tiles[light].size)
+		{
+			pendingFrames[light] = 0;
+			continue;
+		}
+		if (wanted != pendingSize[light])
+		{
+			pendingSize[light] = wanted;
+			pendingFrames[light] = 0;
+		}
+		pendingFrames[light]++;
+		if (pendingFrames[light] >= resizeFrames || tiles[light].size > maxTileSize)
+		{
+			sizes[light] = wanted;
+			pendingFrames[light] = 0;
+			resized = true;
+		}
+	}
+
+	if (resized)
+	{
+		repack(sizes);
+	}
+	tilesRendered = 0;
+}
+
+void ShadowAtlas::repack(vector<int> sizes)
+{
+	// If the tiles ask for more than the atlas holds, the least important light that can still shrink gives up half its size until they fit
+	unsigned long long area = 0;
+	for (int size : sizes)
+	{
+		area += (unsigned long long)size * size;
+	}
+	while (area > (unsigned long long)atlasSize * atlasSize)
+	{
+		int shrink = -1;
+		for (int light = 0; light < lightCount; light++)
+		{
+			if (sizes[light] > minTileSize && (shrink < 0 || importance[light] < importance[shrink]))
+			{
+				shrink = light;
+			}
+		}
+		if (shrink < 0)
+		{
+			break;
+		}
+		area -= (unsigned long long)sizes[shrink] * sizes[shrink] * 3 / 4;
+		sizes[shrink] /= 2;
+	}
+
+	// Places the tiles largest first along a Morton curve, which is the order a quadtree hands out its nodes. With power of two sizes
+	// in decreasing order, every tile lands on a position aligned to its own size and none ever overlap
+	vector<int> order(lightCount);
+	for (int light = 0; light < lightCount; light++)
+	{
+		order[light] = light;
+	}
+	stable_sort(order.begin(), order.end(), [&sizes](int a, int b) { return sizes[a] > sizes[b]; });
+
+	unsigned long long offset = 0;
+	for (int light : order)
+	{
+		// Decodes the position from the number of minimum sized cells already used, x from the even bits and y from the odd ones
+		unsigned long long cell = offset / ((unsigned long long)minTileSize * minTileSize);
+		int x = 0;
+		int y = 0;
+		for (int bit = 0; bit < 16; bit++)
+		{
+			x |= (int)((cell >> (bit * 2)) & 1) << bit;
+			y |= (int)((cell >> (bit * 2 + 1)) & 1) << bit;
+		}
+
+		// Tiles that kept their place and size keep their contents
+		ShadowAtlasTile placed = { x * minTileSize, y * minTileSize, sizes[light] };
+		if (placed.x != tiles[light].x || placed.y != tiles[light].y || placed.size != tiles[light].size)
+		{
+			dirty[light] = true;
+		}
+		tiles[light] = placed;
+		offset += (unsigned long long)placed.size * placed.size;
+	}
+	repackCount++;
+}
+
+D3D11_VIEWPORT ShadowAtlas::getTileViewport(int light) const
+{
+	const ShadowAtlasTile& tile = tiles[light];
+	D3D11_VIEWPORT viewport;
+	viewport.TopLeftX = (float)tile.x;
+	viewport.TopLeftY = (float)tile.y;
+	viewport.Width = (float)tile.size;
+	viewport.Height = (float)tile.size;
+	viewport.MinDepth = 0.0f;
+	viewport.MaxDepth = 1.0f;
+	return viewport;
+}
+
+void ShadowAtlas::beginTile(ID3D11DeviceContext* deviceContext, int light)
+{
+	// Writes depth only, into this light's tile
+	ID3D11RenderTargetView* nullRTV = NULL;
+	deviceContext->OMSetRenderTargets(1, &nullRTV, atlasDSV);
+	setTileViewport(deviceContext, light);
+
+	clearShader->clear(deviceContext);
+	tilesRendered++;
+}
+
+void ShadowAtlas::beginTiles(ID3D11DeviceContext* deviceContext, int firstLight, int count)
+{
+	// Clears each tile through its own viewport, as the clear has no geometry shader to pick one
+	D3D11_VIEWPORT viewports[MAX_TILES];
+	for (int i = 0; i < count; i++)
+	{
+		beginTile(deviceContext, firstLight + i);
+		viewports[i] = getTileViewport(firstLight + i);
+	}
+	deviceContext->RSSetViewports(count, viewports);
+}
+
+void ShadowAtlas::endTiles(int firstLight, int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		endTile(firstLight + i);
+	}
+}
+
+void ShadowAtlas::setTileViewport(ID3D11DeviceContext* deviceContext, int light)
+{
+	D3D11_VIEWPORT viewport = getTileViewport(light);
+	deviceContext->RSSetViewports(1, &viewport);
+}
+
+void ShadowAtlas::endTile(int light)
+{
+	dirty[light] = false;
+}
+
+XMFLOAT4 ShadowAtlas::getTileRect(int light) const
+{
+	const ShadowAtlasTile& tile = tiles[light];
+	return XMFLOAT4((float)tile.size / atlasSize, (float)tile.size / atlasSize, (float)tile.x / atlasSize, (float)tile.y / atlasSize);
+}
+
+void ShadowAtlas::setShaderParameters(ID3D11DeviceContext* deviceContext)
+{
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	deviceContext->Map(atlasBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+	ShadowAtlasBufferType* atlasPtr = (ShadowAtlasBufferType*)mappedResource.pData;
+	for (int light = 0; light < MAX_TILES; light++)
+	{
+		atlasPtr->tileRect[light] = light < lightCount ? getTileRect(light) : XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f);
+	}
+	deviceContext->Unmap(atlasBuffer, 0);
+	StateCache::get()->setConstantBuffers(deviceContext, STAGE_PS, BUFFER_SLOT, 1, &atlasBuffer);
+}
+
+float ShadowAtlas::getOccupancy() const
+{
+	unsigned long long area = 0;
+	for (const ShadowAtlasTile& tile : tiles)
+	{
+		area += (unsigned long long)tile.size * tile.size;
+	}
+	return (float)((double)area / ((double)atlasSize * atlasSize));
+}
+
+float ShadowAtlas::screenCoverage(const BoundingSphere& bounds, const XMMATRIX& view, const XMMATRIX& projection)
+{
+	// Nothing the camera can't see needs detailed shadows
+	BoundingSphere viewBounds;
+	bounds.Transform(viewBounds, view);
+	BoundingFrustum frustum(projection);
+	if (frustum.Contains(viewBounds) == DISJOINT)
+	{
+		return 0.0f;
+	}
+
+	// With the camera inside the sphere it fills the screen
+	float distance = XMVectorGetX(XMVector3Length(XMLoadFloat3(&viewBounds.Center)));
+	if (distance <= viewBounds.Radius)
+	{
+		return 1.0f;
+	}
+
+	// Projects the sphere's radius into each screen axis, and compares the ellipse it makes with the screen's area of four
+	XMFLOAT4X4 proj;
+	XMStoreFloat4x4(&proj, projection);
+	float tangentDistance = sqrtf(distance * distance - viewBounds.Radius * viewBounds.Radius);
+	float radiusX = viewBounds.Radius * proj._11 / tangentDistance;
+	float radiusY = viewBounds.Radius * proj._22 / tangentDistance;
+	return min(XM_PI * radiusX * radiusY / 4.0f, 1.0f);
+}
@@ -0,0 +1,124 @@
+// One depth texture shared by every shadow casting light. Each light gets a square tile sized by how much of the screen its shadows
+// can affect, tiles are packed in quadtree order whenever a size changes, and a tile is only redrawn when its light or the scene has moved
+#pragma once
+
+#include "DXF.h"
+#include "StateCache.h"
+#include "ShadowTileClearShader.h"
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace DirectX;
+
+// Where a light's tile lives in the atlas, in texels
+struct ShadowAtlasTile
+{
+	int x;
+	int y;
+	int size;
+};
+
+class ShadowAtlas
+{
+public:
+	// Most tiles the pixel shaders can look up
+	static const int MAX_TILES = 8;
+
+	// Per tile scale and offset from shadow map coordinates into the atlas, matching ShadowAtlasBuffer in light_h.hlsli
+	struct ShadowAtlasBufferType
+	{
+		XMFLOAT4 tileRect[MAX_TILES];
+	};
+
+	// Register the atlas constant buffer is bound to in the pixel shaders that sample shadows
+	static const int BUFFER_SLOT = 3;
+
+	// Each light (or shadow map face) gets its own tile, up to MAX_TILES
+	ShadowAtlas(ID3D11Device* device, HWND hwnd, int atlasSize, int lightCount, int minTileSize = 256);
+	~ShadowAtlas();
+
+	// Sets how much of the screen a light's shadows can affect, from 0 to 1, which decides the size of its tile
+	void setImportance(int light, float importance);
+
+	// Sets the matrix a light will render its shadows with this frame. Any change marks its tile for redrawing
+	void setLightViewProjection(int light, const XMMATRIX& viewProjection);
+
+	// Marks a light's tile, or every tile, for redrawing because something casting shadows has changed
+	void invalidate(int light);
+	void invalidateAll();
+
+	// Limits the largest tile any light can have, used to trade shadow resolution for time
+	void setMaxTileSize(int size);
+
+	// Resizes tiles whose requested size has settled on a new value, repacking the atlas and marking moved tiles for redrawing
+	void update();
+
+	// Whether a light's tile needs drawing this frame
+	bool needsRender(int light) const { return dirty[light]; }
+
+	// Binds the atlas with the light's tile as the viewport and clears the tile. endTile marks it as up to date
+	void beginTile(ID3D11DeviceContext* deviceContext, int light);
+	void endTile(int light);
+
+	// Binds the atlas with count consecutive tiles as viewports 0 to count - 1 and clears them all, for a geometry shader to pick
+	// between with SV_ViewportArrayIndex. endTiles marks them all as up to date
+	void beginTiles(ID3D11DeviceContext* deviceContext, int firstLight, int count);
+	void endTiles(int firstLight, int count);
+
+	// Makes a single light's tile the only viewport, without clearing it
+	void setTileViewport(ID3D11DeviceContext* deviceContext, int light);
+
+	// Binds every light's tile rectangle for the pixel shaders. Stays bound for the rest of the frame
+	void setShaderParameters(ID3D11DeviceContext* deviceContext);
+
+	ID3D11ShaderResourceView* getShaderResourceView() { return atlasSRV; }
+	const ShadowAtlasTile& getTile(int light) const { return tiles[light]; }
+	XMFLOAT4 getTileRect(int light) const;
+	int getAtlasSize() const { return atlasSize; }
+	int getMaxTileSize() const { return maxTileSize; }
+	int getLightCount() const { return lightCount; }
+
+	// Fraction of the atlas covered by tiles, and memory against giving every light its own atlas sized map
+	float getOccupancy() const;
+	unsigned long long getAtlasBytes() const { return (unsigned long long)atlasSize * atlasSize * 4; }
+	unsigned long long getSeparateMapBytes() const { return getAtlasBytes() * lightCount; }
+	int getTilesRendered() const { return tilesRendered; }
+	int getRepackCount() const { return repackCount; }
+
+	// Estimates the fraction of the screen a sphere covers, zero if it is outside the view
+	static float screenCoverage(const BoundingSphere& bounds, const XMMATRIX& view, const XMMATRIX& projection);
+
+	// Frames a light must ask for a new tile size before it is given it, so sizes don't flicker back and forth
+	int resizeFrames = 10;
+
+private:
+	int sizeForImportance(float importance) const;
+	D3D11_VIEWPORT getTileViewport(int light) const;
+
+	// Places every tile at its given size, marking any that moved or changed size for redrawing
+	void repack(vector<int> sizes);
+
+	int atlasSize;
+	int lightCount;
+	int minTileSize;
+	int maxTileSize;
+
+	ID3D11Texture2D* atlasTexture;
+	ID3D11DepthStencilView* atlasDSV;
+	ID3D11ShaderResourceView* atlasSRV;
+	ID3D11Buffer* atlasBuffer;
+	ShadowTileClearShader* clearShader;
+
+	// Tiles as currently placed in the atlas
+	vector<ShadowAtlasTile> tiles;
+	vector<float> importance;
+	vector<int> pendingSize;
+	vector<int> pendingFrames;
+	vector<bool> dirty;
+	vector<XMFLOAT4X4> viewProjections;
+
+	int tilesRendered;
+	int repackCount;
+};
@@ -0,0 +1,185 @@
+#include "ShadowMoments.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+ShadowFilterSettings ShadowMoments::getDefaultSettings(ShadowFilterMode mode)
+{
+	ShadowFilterSettings settings;
+	settings.mode = mode;
+	settings.blurRadius = mode == SHADOW_FILTER_HARD ? 0 : 2;
+	settings.lightBleedReduction = 0.0f;
+	settings.positiveExponent = 40.0f;
+	settings.negativeExponent = 5.0f;
+	settings.momentBias = 0.0f;
+	settings.depthBias = 0.0f;
+
+	switch (mode)
+	{
+	case SHADOW_FILTER_HARD:
+		// Matches the bias the lit shaders have always used
+		settings.depthBias = 0.005f;
+		break;
+	case SHADOW_FILTER_VSM:
+		// Plain variance maps bleed badly where shadows overlap, so most need cutting off
+		settings.lightBleedReduction = 0.3f;
+		settings.momentBias = 0.00001f;
+		break;
+	case SHADOW_FILTER_EVSM:
+		settings.lightBleedReduction = 0.1f;
+		settings.momentBias = 0.0001f;
+		break;
+	case SHADOW_FILTER_MSM:
+		// The bound is tight enough that a receiver right at the occluder's depth shadows itself without a small offset
+		settings.momentBias = 0.00003f;
+		settings.depthBias = 0.001f;
+		break;
+	}
+	return settings;
+}
+
+const char* ShadowMoments::getName(ShadowFilterMode mode)
+{
+	switch (mode)
+	{
+	case SHADOW_FILTER_VSM:
+		return "VSM";
+	case SHADOW_FILTER_EVSM:
+		return "EVSM";
+	case SHADOW_FILTER_MSM:
+		return "MSM";
+	default:
+		return "Hard";
+	}
+}
+
+int ShadowMoments::getBytesPerTexel(ShadowFilterMode mode)
+{
+	// A 32 bit depth, or four 32 bit moments (VSM only uses two, but shares the format so modes can be swapped without reallocating)
+	return mode == SHADOW_FILTER_HARD ? 4 : 16;
+}
+
+XMFLOAT4 ShadowMoments::encode(float depth, const ShadowFilterSettings& settings)
+{
+	switch (settings.mode)
+	{
+	case SHADOW_FILTER_VSM:
+		return XMFLOAT4(depth, depth * depth, 0.0f, 0.0f);
+	case SHADOW_FILTER_EVSM:
+	{
+		// Warps the depth (moved to -1 to 1) through a positive and a negative exponential, each stored with its square
+		float warpedDepth = depth * 2.0f - 1.0f;
+		float positive = expf(settings.positiveExponent * warpedDepth);
+		float negative = -expf(-settings.negativeExponent * warpedDepth);
+		return XMFLOAT4(positive, positive * positive, negative, negative * negative);
+	}
+	case SHADOW_FILTER_MSM:
+	{
+		float squared = depth * depth;
+		return XMFLOAT4(depth, squared, squared * depth, squared * squared);
+	}
+	default:
+		return XMFLOAT4(depth, 0.0f, 0.0f, 0.0f);
+	}
+}
+
+float ShadowMoments::visibility(const XMFLOAT4& moments, float depth, const ShadowFilterSettings& settings)
+{
+	depth -= settings.depthBias;
+
+	switch (settings.mode)
+	{
+	case SHADOW_FILTER_VSM:
+		return reduceLightBleeding(chebyshevUpperBound(moments.x, moments.y, depth, settings.momentBias), settings.lightBleedReduction);
+	case SHADOW_FILTER_EVSM:
+	{
+		// Each warp gives an upper bound on the visibility, and the tighter of the two is kept. The minimum variance is scaled by how much
+		// each warp stretches depth at this point, so it means roughly the same thing in both
+		float warpedDepth = depth * 2.0f - 1.0f;
+		float positive = expf(settings.positiveExponent * warpedDepth);
+		float negative = -expf(-settings.negativeExponent * warpedDepth);
+		float positiveVariance = settings.momentBias * (settings.positiveExponent * positive) * (settings.positiveExponent * positive);
+		float negativeVariance = settings.momentBias * (settings.negativeExponent * negative) * (settings.negativeExponent * negative);
+		float positiveBound = chebyshevUpperBound(moments.x, moments.y, positive, positiveVariance);
+		float negativeBound = chebyshevUpperBound(moments.z, moments.w, negative, negativeVariance);
+		return reduceLightBleeding(min(positiveBound, negativeBound), settings.lightBleedReduction);
+	}
+	case SHADOW_FILTER_MSM:
+		return reduceLightBleeding(hamburger4Moments(moments, depth, settings.momentBias), settings.lightBleedReduction);
+	default:
+		return depth < moments.x ? 1.0f : 0.0f;
+	}
+}
+
+float ShadowMoments::chebyshevUpperBound(float mean, float meanSquared, float depth, float minVariance)
+{
+	// In front of the average occluder is fully lit, behind it the variance bounds how much of the filter region can be in front
+	if (depth <= mean)
+	{
+		return 1.0f;
+	}
+	float variance = max(meanSquared - mean * mean, minVariance);
+	float difference = depth - mean;
+	return variance / (variance + difference * difference);
+}
+
+float ShadowMoments::reduceLightBleeding(float visibility, float amount)
+{
+	if (amount <= 0.0f)
+	{
+		return visibility;
+	}
+	return min(max((visibility - amount) / (1.0f - amount), 0.0f), 1.0f);
+}
+
+float ShadowMoments::hamburger4Moments(const XMFLOAT4& moments, float depth, float momentBias)
+{
+	// Pulls the moments slightly towards those of a uniform distribution, so the Hankel matrix below can always be inverted
+	// Follows Peters and Klein, "Moment Shadow Mapping" (2015)
+	float b[4] = { moments.x, moments.y, moments.z, moments.w };
+	for (int i = 0; i < 4; i++)
+	{
+		b[i] = b[i] * (1.0f - momentBias) + 0.5f * momentBias;
+	}
+
+	// Cholesky factorisation of the Hankel matrix, keeping only the entries that aren't trivial
+	float L32D22 = -b[0] * b[1] + b[2];
+	float D22 = max(-b[0] * b[0] + b[1], 1e-12f);
+	float squaredDepthVariance = -b[1] * b[1] + b[3];
+	float D33D22 = squaredDepthVariance * D22 - L32D22 * L32D22;
+	float inverseD22 = 1.0f / D22;
+	float L32 = L32D22 * inverseD22;
+
+	// Solves for the polynomial whose roots, along with the receiver's depth, support the distribution of depths that shadows it the most
+	float c[3] = { 1.0f, depth, depth * depth };
+	c[1] -= b[0];
+	c[2] -= b[1] + L32 * c[1];
+	c[1] *= inverseD22;
+	c[2] *= D22 / (fabsf(D33D22) > 1e-20f ? D33D22 : 1e-20f);
+	c[1] -= L32 * c[2];
+	c[0] -= c[1] * b[0] + c[2] * b[1];
+
+	// Finds the other two support points from the quadratic c[0] + c[1] * z + c[2] * z^2
+	float p = c[1] / c[2];
+	float q = c[0] / c[2];
+	float root = sqrtf(max(p * p * 0.25f - q, 0.0f));
+	float z1 = -p * 0.5f - root;
+	float z2 = -p * 0.5f + root;
+
+	// With no support point in front of the receiver it is fully lit, otherwise sums the weights of those that are
+	if (z1 >= depth)
+	{
+		return 1.0f;
+	}
+	float switchValue[3] = { depth, z1, 0.0f };
+	if (z2 < depth)
+	{
+		switchValue[0] = z1;
+		switchValue[1] = depth;
+		switchValue[2] = 1.0f;
+	}
+	float quotient = (switchValue[0] * z2 - b[0] * (switchValue[0] + z2) + b[1]) / ((z2 - switchValue[1]) * (depth - z1));
+	float shadow = switchValue[2] + quotient;
+	return 1.0f - min(max(shadow, 0.0f), 1.0f);
+}
@@ -0,0 +1,61 @@
+// Moment shadow maps. Instead of a single depth, each texel stores moments of the depths it covers, which can be blurred and mip mapped like
+// any other texture. A receiver's visibility is then bounded from the filtered moments, giving soft shadows that don't alias even from small maps.
+// These are the CPU versions of shadow_moments_h.hlsli, used as the reference path when comparing filter modes and resolutions
+#pragma once
+
+#include <DirectXMath.h>
+
+using namespace DirectX;
+
+// How the shadow maps are filtered. Hard compares a single depth, the others store moments
+enum ShadowFilterMode
+{
+	SHADOW_FILTER_HARD = 0,
+	SHADOW_FILTER_VSM = 1,
+	SHADOW_FILTER_EVSM = 2,
+	SHADOW_FILTER_MSM = 3
+};
+static const int SHADOW_FILTER_MODES = 4;
+
+struct ShadowFilterSettings
+{
+	ShadowFilterMode mode;
+
+	// Texels either side of each texel in the separable box blur applied to the moments
+	int blurRadius;
+
+	// Cuts off the low end of the visibility bound, hiding light bleeding where occluders overlap at the cost of some softness
+	float lightBleedReduction;
+
+	// Exponents of the positive and negative warps used by EVSM, 42 and 5 being about the most 32 bit floats can hold
+	float positiveExponent;
+	float negativeExponent;
+
+	// Minimum variance (VSM and EVSM) or the amount the moments are pulled towards a safe value (MSM), keeping the maths stable
+	float momentBias;
+
+	// Offset subtracted from the receiver's depth before it's tested against the moments
+	float depthBias;
+};
+
+class ShadowMoments
+{
+public:
+	// Settings the scene was tuned with for each mode
+	static ShadowFilterSettings getDefaultSettings(ShadowFilterMode mode);
+	static const char* getName(ShadowFilterMode mode);
+
+	// Bytes each texel of a shadow map takes in the given mode, moment maps also carry a full mip chain on top of this
+	static int getBytesPerTexel(ShadowFilterMode mode);
+
+	// Turns a depth from 0 to 1 into the moments stored for it
+	static XMFLOAT4 encode(float depth, const ShadowFilterSettings& settings);
+
+	// Returns how lit a receiver at depth is from 0 to 1, given the filtered moments around it
+	static float visibility(const XMFLOAT4& moments, float depth, const ShadowFilterSettings& settings);
+
+private:
+	static float chebyshevUpperBound(float mean, float meanSquared, float depth, float minVariance);
+	static float reduceLightBleeding(float visibility, float amount);
+	static float hamburger4Moments(const XMFLOAT4& moments, float depth, float momentBias);
+};
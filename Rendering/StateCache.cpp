@@ -0,0 +1,356 @@
+#include "StateCache.h"
+#include <cstring>
+
+StateCache* StateCache::instance = 0;
+
+// Records a bind over the tracked slots, returning whether any of them changes. Untracked slots always count as a change
+template <typename T, UINT N> static bool trackBind(T* (&bound)[N], bool (&known)[N], UINT slot, UINT count, T* const* items)
+{
+	bool changed = false;
+	for (UINT i = 0; i < count; i++)
+	{
+		UINT tracked = slot + i;
+		if (tracked >= N)
+		{
+			changed = true;
+		}
+		else if (!known[tracked] || bound[tracked] != items[i])
+		{
+			bound[tracked] = items[i];
+			known[tracked] = true;
+			changed = true;
+		}
+	}
+	return changed;
+}
+
+void StateCache::create(ID3D11Device* device)
+{
+	if (!instance)
+	{
+		instance = new StateCache(device);
+	}
+}
+
+void StateCache::destroy()
+{
+	if (instance)
+	{
+		delete instance;
+		instance = 0;
+	}
+}
+
+StateCache::StateCache(ID3D11Device* d)
+{
+	device = d;
+	ZeroMemory(&stats, sizeof(stats));
+	issuedCalls = 0;
+	elidedCalls = 0;
+	invalidate();
+
+	depthTestStates[0] = getDepthStencilState(depthTest(false));
+	depthTestStates[1] = getDepthStencilState(depthTest(true));
+}
+
+StateCache::~StateCache()
+{
+	// Release the references held for setDepthTest, then every state the tables hold
+	for (int i = 0; i < 2; i++)
+	{
+		if (depthTestStates[i])
+		{
+			depthTestStates[i]->Release();
+			depthTestStates[i] = 0;
+		}
+	}
+	releaseTable(samplers);
+	releaseTable(blends);
+	releaseTable(depthStencils);
+	releaseTable(rasterizers);
+}
+
+UINT64 StateCache::hashBytes(const void* data, size_t size)
+{
+	// 64 bit FNV-1a
+	const BYTE* bytes = (const BYTE*)data;
+	UINT64 hash = 14695981039346656037ULL;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+D3D11_BLEND_DESC StateCache::normalize(const D3D11_BLEND_DESC& desc)
+{
+	D3D11_BLEND_DESC normalized;
+	ZeroMemory(&normalized, sizeof(normalized));
+	normalized.AlphaToCoverageEnable = desc.AlphaToCoverageEnable;
+	normalized.IndependentBlendEnable = desc.IndependentBlendEnable;
+	for (int i = 0; i < 8; i++)
+	{
+		normalized.RenderTarget[i].BlendEnable = desc.RenderTarget[i].BlendEnable;
+		normalized.RenderTarget[i].SrcBlend = desc.RenderTarget[i].SrcBlend;
+		normalized.RenderTarget[i].DestBlend = desc.RenderTarget[i].DestBlend;
+		normalized.RenderTarget[i].BlendOp = desc.RenderTarget[i].BlendOp;
+		normalized.RenderTarget[i].SrcBlendAlpha = desc.RenderTarget[i].SrcBlendAlpha;
+		normalized.RenderTarget[i].DestBlendAlpha = desc.RenderTarget[i].DestBlendAlpha;
+		normalized.RenderTarget[i].BlendOpAlpha = desc.RenderTarget[i].BlendOpAlpha;
+		normalized.RenderTarget[i].RenderTargetWriteMask = desc.RenderTarget[i].RenderTargetWriteMask;
+	}
+	return normalized;
+}
+
+D3D11_DEPTH_STENCIL_DESC StateCache::normalize(const D3D11_DEPTH_STENCIL_DESC& desc)
+{
+	D3D11_DEPTH_STENCIL_DESC normalized;
+	ZeroMemory(&normalized, sizeof(normalized));
+	normalized.DepthEnable = desc.DepthEnable;
+	normalized.DepthWriteMask = desc.DepthWriteMask;
+	normalized.DepthFunc = desc.DepthFunc;
+	normalized.StencilEnable = desc.StencilEnable;
+	normalized.StencilReadMask = desc.StencilReadMask;
+	normalized.StencilWriteMask = desc.StencilWriteMask;
+	normalized.FrontFace = desc.FrontFace;
+	normalized.BackFace = desc.BackFace;
+	return normalized;
+}
+
+template <typename Desc, typename State> State* StateCache::find(StateTable<Desc, State>& table, const Desc& desc, UINT64& hash)
+{
+	hash = hashBytes(&desc, sizeof(Desc));
+	auto range = table.index.equal_range(hash);
+	for (auto entry = range.first; entry != range.second; ++entry)
+	{
+		if (memcmp(&table.descs[entry->second], &desc, sizeof(Desc)) == 0)
+		{
+			State* state = table.states[entry->second];
+			state->AddRef();
+			stats.cacheHits++;
+			return state;
+		}
+	}
+	return NULL;
+}
+
+template <typename Desc, typename State> void StateCache::add(StateTable<Desc, State>& table, const Desc& desc, UINT64 hash, State* state)
+{
+	// The table keeps a reference of its own, as well as the one handed to the caller
+	state->AddRef();
+	table.index.insert(make_pair(hash, table.descs.size()));
+	table.descs.push_back(desc);
+	table.states.push_back(state);
+	stats.statesCreated++;
+}
+
+template <typename Desc, typename State> void StateCache::releaseTable(StateTable<Desc, State>& table)
+{
+	for (State* state : table.states)
+	{
+		state->Release();
+	}
+	table.states.clear();
+	table.descs.clear();
+	table.index.clear();
+}
+
+ID3D11SamplerState* StateCache::getSamplerState(const D3D11_SAMPLER_DESC& desc)
+{
+	UINT64 hash;
+	ID3D11SamplerState* state = find(samplers, desc, hash);
+	if (!state && device->CreateSamplerState(&desc, &state) == S_OK)
+	{
+		add(samplers, desc, hash, state);
+	}
+	return state;
+}
+
+ID3D11BlendState* StateCache::getBlendState(const D3D11_BLEND_DESC& desc)
+{
+	UINT64 hash;
+	D3D11_BLEND_DESC normalized = normalize(desc);
+	ID3D11BlendState* state = find(blends, normalized, hash);
+	if (!state && device->CreateBlendState(&normalized, &state) == S_OK)
+	{
+		add(blends, normalized, hash, state);
+	}
+	return state;
+}
+
+ID3D11DepthStencilState* StateCache::getDepthStencilState(const D3D11_DEPTH_STENCIL_DESC& desc)
+{
+	UINT64 hash;
+	D3D11_DEPTH_STENCIL_DESC normalized = normalize(desc);
+	ID3D11DepthStencilState* state = find(depthStencils, normalized, hash);
+	if (!state && device->CreateDepthStencilState(&normalized, &state) == S_OK)
+	{
+		add(depthStencils, normalized, hash, state);
+	}
+	return state;
+}
+
+ID3D11RasterizerState* StateCache::getRasterizerState(const D3D11_RASTERIZER_DESC& desc)
+{
+	UINT64 hash;
+	ID3D11RasterizerState* state = find(rasterizers, desc, hash);
+	if (!state && device->CreateRasterizerState(&desc, &state) == S_OK)
+	{
+		add(rasterizers, desc, hash, state);
+	}
+	return state;
+}
+
+D3D11_SAMPLER_DESC StateCache::anisotropicWrap()
+{
+	D3D11_SAMPLER_DESC samplerDesc;
+	ZeroMemory(&samplerDesc, sizeof(samplerDesc));
+	samplerDesc.Filter = D3D11_FILTER_ANISOTROPIC;
+	samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_WRAP;
+	samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_WRAP;
+	samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_WRAP;
+	samplerDesc.MipLODBias = 0.0f;
+	samplerDesc.MaxAnisotropy = 1;
+	samplerDesc.ComparisonFunc = D3D11_COMPARISON_ALWAYS;
+	samplerDesc.MinLOD = 0;
+	samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
+	return samplerDesc;
+}
+
+D3D11_SAMPLER_DESC StateCache::linearClamp()
+{
+	D3D11_SAMPLER_DESC samplerDesc;
+	ZeroMemory(&samplerDesc, sizeof(samplerDesc));
+	samplerDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+	samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
+	samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
+	samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+	samplerDesc.MipLODBias = 0.0f;
+	samplerDesc.MaxAnisotropy = 1;
+	samplerDesc.ComparisonFunc = D3D11_COMPARISON_ALWAYS;
+	samplerDesc.MinLOD = 0;
+	samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
+	return samplerDesc;
+}
+
+D3D11_DEPTH_STENCIL_DESC StateCache::depthTest(bool enabled)
+{
+	D3D11_DEPTH_STENCIL_DESC depthDesc;
+	ZeroMemory(&depthDesc, sizeof(depthDesc));
+	depthDesc.DepthEnable = enabled;
+	depthDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ALL;
+	depthDesc.DepthFunc = D3D11_COMPARISON_LESS;
+	depthDesc.StencilEnable = FALSE;
+	depthDesc.StencilReadMask = D3D11_DEFAULT_STENCIL_READ_MASK;
+	depthDesc.StencilWriteMask = D3D11_DEFAULT_STENCIL_WRITE_MASK;
+	depthDesc.FrontFace.StencilFailOp = D3D11_STENCIL_OP_KEEP;
+	depthDesc.FrontFace.StencilDepthFailOp = D3D11_STENCIL_OP_KEEP;
+	depthDesc.FrontFace.StencilPassOp = D3D11_STENCIL_OP_KEEP;
+	depthDesc.FrontFace.StencilFunc = D3D11_COMPARISON_ALWAYS;
+	depthDesc.BackFace = depthDesc.FrontFace;
+	return depthDesc;
+}
+
+void StateCache::setShaderResources(ID3D11DeviceContext* deviceContext, ShaderStage stage, UINT slot, UINT count, ID3D11ShaderResourceView* const* views)
+{
+	if (!trackBind(boundResources[stage], knownResources[stage], slot, count, views))
+	{
+		elidedCalls++;
+		return;
+	}
+	issuedCalls++;
+	switch (stage)
+	{
+	case STAGE_VS: deviceContext->VSSetShaderResources(slot, count, views); break;
+	case STAGE_HS: deviceContext->HSSetShaderResources(slot, count, views); break;
+	case STAGE_DS: deviceContext->DSSetShaderResources(slot, count, views); break;
+	case STAGE_GS: deviceContext->GSSetShaderResources(slot, count, views); break;
+	case STAGE_PS: deviceContext->PSSetShaderResources(slot, count, views); break;
+	default: break;
+	}
+}
+
+void StateCache::setSamplers(ID3D11DeviceContext* deviceContext, ShaderStage stage, UINT slot, UINT count, ID3D11SamplerState* const* states)
+{
+	if (!trackBind(boundSamplers[stage], knownSamplers[stage], slot, count, states))
+	{
+		elidedCalls++;
+		return;
+	}
+	issuedCalls++;
+	switch (stage)
+	{
+	case STAGE_VS: deviceContext->VSSetSamplers(slot, count, states); break;
+	case STAGE_HS: deviceContext->HSSetSamplers(slot, count, states); break;
+	case STAGE_DS: deviceContext->DSSetSamplers(slot, count, states); break;
+	case STAGE_GS: deviceContext->GSSetSamplers(slot, count, states); break;
+	case STAGE_PS: deviceContext->PSSetSamplers(slot, count, states); break;
+	default: break;
+	}
+}
+
+void StateCache::setConstantBuffers(ID3D11DeviceContext* deviceContext, ShaderStage stage, UINT slot, UINT count, ID3D11Buffer* const* buffers)
+{
+	// A buffer mapped since it was bound needs no rebinding, the runtime follows its contents
+	if (!trackBind(boundBuffers[stage], knownBuffers[stage], slot, count, buffers))
+	{
+		elidedCalls++;
+		return;
+	}
+	issuedCalls++;
+	switch (stage)
+	{
+	case STAGE_VS: deviceContext->VSSetConstantBuffers(slot, count, buffers); break;
+	case STAGE_HS: deviceContext->HSSetConstantBuffers(slot, count, buffers); break;
+	case STAGE_DS: deviceContext->DSSetConstantBuffers(slot, count, buffers); break;
+	case STAGE_GS: deviceContext->GSSetConstantBuffers(slot, count, buffers); break;
+	case STAGE_PS: deviceContext->PSSetConstantBuffers(slot, count, buffers); break;
+	default: break;
+	}
+}
+
+void StateCache::setDepthStencilState(ID3D11DeviceContext* deviceContext, ID3D11DepthStencilState* state, UINT stencilRef)
+{
+	if (knownDepthStencil && boundDepthStencil == state && boundStencilRef == stencilRef)
+	{
+		elidedCalls++;
+		return;
+	}
+	issuedCalls++;
+	boundDepthStencil = state;
+	boundStencilRef = stencilRef;
+	knownDepthStencil = true;
+	deviceContext->OMSetDepthStencilState(state, stencilRef);
+}
+
+void StateCache::setDepthTest(ID3D11DeviceContext* deviceContext, bool enabled)
+{
+	setDepthStencilState(deviceContext, depthTestStates[enabled ? 1 : 0]);
+}
+
+void StateCache::forgetConstantBuffer(ShaderStage stage, UINT slot)
+{
+	if (slot < TRACKED_BUFFERS)
+	{
+		knownBuffers[stage][slot] = false;
+	}
+}
+
+void StateCache::invalidate()
+{
+	ZeroMemory(knownResources, sizeof(knownResources));
+	ZeroMemory(knownSamplers, sizeof(knownSamplers));
+	ZeroMemory(knownBuffers, sizeof(knownBuffers));
+	knownDepthStencil = false;
+	boundDepthStencil = 0;
+	boundStencilRef = 0;
+}
+
+void StateCache::endFrame()
+{
+	stats.frameIssuedCalls = issuedCalls;
+	stats.frameElidedCalls = elidedCalls;
+	issuedCalls = 0;
+	elidedCalls = 0;
+}
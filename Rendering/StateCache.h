@@ -0,0 +1,124 @@
+// Shares sampler, blend, depth stencil and rasterizer states between every shader, looked up by a hash of their description so each different
+// description is only ever created once, and filters out binds of shader resources, samplers and constant buffers that are already bound.
+// The filter only knows about binds made through it, so it forgets everything at the start of each pass, where render targets and unordered
+// access views change and the runtime may unbind resources on its own. Compute binds are left alone, as compute passes rebind everything anyway
+#pragma once
+
+#include "DXF.h"
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+using namespace DirectX;
+
+// Graphics stages whose binds are filtered
+enum ShaderStage
+{
+	STAGE_VS,
+	STAGE_HS,
+	STAGE_DS,
+	STAGE_GS,
+	STAGE_PS,
+	STAGE_COUNT
+};
+
+struct StateCacheStats
+{
+	// Different states created, and lookups answered by one that already existed
+	int statesCreated;
+	int cacheHits;
+
+	// Bind calls last frame that reached the device context, and those dropped as already bound
+	int frameIssuedCalls;
+	int frameElidedCalls;
+};
+
+class StateCache
+{
+public:
+	// The one cache, made before any shader and destroyed after them all
+	static void create(ID3D11Device* device);
+	static void destroy();
+	static StateCache* get() { return instance; }
+
+	// Returns the shared state for a description, with a reference added for the caller to release as if it had created it
+	ID3D11SamplerState* getSamplerState(const D3D11_SAMPLER_DESC& desc);
+	ID3D11BlendState* getBlendState(const D3D11_BLEND_DESC& desc);
+	ID3D11DepthStencilState* getDepthStencilState(const D3D11_DEPTH_STENCIL_DESC& desc);
+	ID3D11RasterizerState* getRasterizerState(const D3D11_RASTERIZER_DESC& desc);
+
+	// Descriptions most of the shaders share
+	static D3D11_SAMPLER_DESC anisotropicWrap();
+	static D3D11_SAMPLER_DESC linearClamp();
+	static D3D11_DEPTH_STENCIL_DESC depthTest(bool enabled);
+
+	// Filtered binds, passed on only if some slot in the range would change. Slots past those tracked are always passed on
+	void setShaderResources(ID3D11DeviceContext* deviceContext, ShaderStage stage, UINT slot, UINT count, ID3D11ShaderResourceView* const* views);
+	void setSamplers(ID3D11DeviceContext* deviceContext, ShaderStage stage, UINT slot, UINT count, ID3D11SamplerState* const* samplers);
+	void setConstantBuffers(ID3D11DeviceContext* deviceContext, ShaderStage stage, UINT slot, UINT count, ID3D11Buffer* const* buffers);
+	void setDepthStencilState(ID3D11DeviceContext* deviceContext, ID3D11DepthStencilState* state, UINT stencilRef = 0);
+
+	// Turns depth testing on or off through the two shared states, in place of the renderer's setZBuffer
+	void setDepthTest(ID3D11DeviceContext* deviceContext, bool enabled);
+
+	// Marks a constant buffer slot as unknown, after it has been bound some other way, such as at an offset
+	void forgetConstantBuffer(ShaderStage stage, UINT slot);
+
+	// Forgets every bind, so the next of each is passed on. Called wherever something outside the filter may have changed them
+	void invalidate();
+
+	// Closes the frame's bind counts
+	void endFrame();
+
+	const StateCacheStats& getStats() const { return stats; }
+
+private:
+	StateCache(ID3D11Device* device);
+	~StateCache();
+
+	// Each table keeps the descriptions it has seen with their states, indexed by a hash of the description's bytes
+	template <typename Desc, typename State> struct StateTable
+	{
+		vector<Desc> descs;
+		vector<State*> states;
+		unordered_multimap<UINT64, size_t> index;
+	};
+	template <typename Desc, typename State> State* find(StateTable<Desc, State>& table, const Desc& desc, UINT64& hash);
+	template <typename Desc, typename State> void add(StateTable<Desc, State>& table, const Desc& desc, UINT64 hash, State* state);
+	template <typename Desc, typename State> void releaseTable(StateTable<Desc, State>& table);
+
+	static UINT64 hashBytes(const void* data, size_t size);
+
+	// Copies a description field by field into a zeroed one, so padding never makes equal descriptions hash differently
+	static D3D11_BLEND_DESC normalize(const D3D11_BLEND_DESC& desc);
+	static D3D11_DEPTH_STENCIL_DESC normalize(const D3D11_DEPTH_STENCIL_DESC& desc);
+
+private:
+	static StateCache* instance;
+
+	static const UINT TRACKED_RESOURCES = 16;
+	static const UINT TRACKED_SAMPLERS = D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT;
+	static const UINT TRACKED_BUFFERS = D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT;
+
+	ID3D11Device* device;
+	StateTable<D3D11_SAMPLER_DESC, ID3D11SamplerState> samplers;
+	StateTable<D3D11_BLEND_DESC, ID3D11BlendState> blends;
+	StateTable<D3D11_DEPTH_STENCIL_DESC, ID3D11DepthStencilState> depthStencils;
+	StateTable<D3D11_RASTERIZER_DESC, ID3D11RasterizerState> rasterizers;
+	ID3D11DepthStencilState* depthTestStates[2];
+
+	// What the filter last bound to each slot of each stage, and whether it knows at all
+	ID3D11ShaderResourceView* boundResources[STAGE_COUNT][TRACKED_RESOURCES];
+	ID3D11SamplerState* boundSamplers[STAGE_COUNT][TRACKED_SAMPLERS];
+	ID3D11Buffer* boundBuffers[STAGE_COUNT][TRACKED_BUFFERS];
+	bool knownResources[STAGE_COUNT][TRACKED_RESOURCES];
+	bool knownSamplers[STAGE_COUNT][TRACKED_SAMPLERS];
+	bool knownBuffers[STAGE_COUNT][TRACKED_BUFFERS];
+	ID3D11DepthStencilState* boundDepthStencil;
+	UINT boundStencilRef;
+	bool knownDepthStencil;
+
+	StateCacheStats stats;
+	int issuedCalls;
+	int elidedCalls;
+};
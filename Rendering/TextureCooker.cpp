@@ -0,0 +1,597 @@
+#include "TextureCooker.h"
+#include "HeightField.h"
+#include "MemoryTracker.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+static const uint32_t COOKED_TEXTURE_VERSION = 1;
+
+// Block format a DXGI format's data is laid out in, false for formats stored texel by texel
+static bool getBlockFormat(DXGI_FORMAT format, BlockFormat& blockFormat)
+{
+	switch (format)
+	{
+	case DXGI_FORMAT_BC1_UNORM:
+	case DXGI_FORMAT_BC1_UNORM_SRGB:
+		blockFormat = BLOCK_BC1;
+		return true;
+	case DXGI_FORMAT_BC2_UNORM:
+	case DXGI_FORMAT_BC2_UNORM_SRGB:
+		blockFormat = BLOCK_BC2;
+		return true;
+	case DXGI_FORMAT_BC3_UNORM:
+	case DXGI_FORMAT_BC3_UNORM_SRGB:
+		blockFormat = BLOCK_BC3;
+		return true;
+	case DXGI_FORMAT_BC4_UNORM:
+		blockFormat = BLOCK_BC4;
+		return true;
+	case DXGI_FORMAT_BC5_UNORM:
+		blockFormat = BLOCK_BC5;
+		return true;
+	case DXGI_FORMAT_BC7_UNORM:
+	case DXGI_FORMAT_BC7_UNORM_SRGB:
+		blockFormat = BLOCK_BC7;
+		return true;
+	default:
+		return false;
+	}
+}
+
+// The SRGB curve the GPU decodes 8 bit colour through, and its inverse
+static float srgbToLinear(float value)
+{
+	return value <= 0.04045f ? value / 12.92f : powf((value + 0.055f) / 1.055f, 2.4f);
+}
+
+static float linearToSrgb(float value)
+{
+	return value <= 0.0031308f ? value * 12.92f : 1.055f * powf(value, 1.0f / 2.4f) - 0.055f;
+}
+
+bool TextureCooker::cookHeightMap(const HeightField& heights, const wchar_t* filename, DXGI_FORMAT format, unsigned long long sourceBytes, CookReport& report)
+{
+	if (heights.getWidth() == 0 || (format != DXGI_FORMAT_R16_UNORM && format != DXGI_FORMAT_BC4_UNORM))
+	{
+		return false;
+	}
+
+	MipChain chain;
+	chain.channels = 1;
+	chain.widths.push_back(heights.getWidth());
+	chain.heights.push_back(heights.getHeight());
+	chain.mips.push_back(vector<float>(heights.getData(), heights.getData() + (size_t)heights.getWidth() * heights.getHeight()));
+	buildMips(chain, false, false);
+
+	report.name = "Height Map";
+	report.sourceBytes = sourceBytes;
+	return write(filename, format, chain, report);
+}
+
+bool TextureCooker::cookNormalMap(const HeightField& heights, float worldSize, float heightScale, const wchar_t* filename, CookReport& report)
+{
+	int width = heights.getWidth();
+	int height = heights.getHeight();
+	if (width == 0)
+	{
+		return false;
+	}
+
+	// The same four tangents and crosses as CalculatePixelNormal, one texel apart. Its origin works out as zero in HLSL, so it is zero here too
+	MipChain chain;
+	chain.channels = 2;
+	chain.widths.push_back(width);
+	chain.heights.push_back(height);
+	chain.mips.push_back(vector<float>((size_t)width * height * 2));
+	float spacing = worldSize / width;
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			XMVECTOR east = XMVectorSet(spacing, heights.getTexel(x + 1, y) * heightScale, 0.0f, 0.0f);
+			XMVECTOR west = XMVectorSet(-spacing, heights.getTexel(x + width - 1, y) * heightScale, 0.0f, 0.0f);
+			XMVECTOR north = XMVectorSet(0.0f, heights.getTexel(x, y + 1) * heightScale, spacing, 0.0f);
+			XMVECTOR south = XMVectorSet(0.0f, heights.getTexel(x, y + height - 1) * heightScale, -spacing, 0.0f);
+			XMVECTOR normal = XMVectorAdd(XMVectorAdd(XMVector3Cross(north, east), XMVector3Cross(east, south)), XMVectorAdd(XMVector3Cross(south, west), XMVector3Cross(west, north)));
+			XMFLOAT3 unit;
+			XMStoreFloat3(&unit, XMVector3Normalize(normal));
+			chain.mips[0][((size_t)y * width + x) * 2 + 0] = unit.x * 0.5f + 0.5f;
+			chain.mips[0][((size_t)y * width + x) * 2 + 1] = unit.z * 0.5f + 0.5f;
+		}
+	}
+	buildMips(chain, true, false);
+
+	// Nothing is replaced as such, the shader reads the heightmap five times for each normal instead
+	report.name = "Normal Map";
+	report.sourceBytes = 0;
+	return write(filename, DXGI_FORMAT_BC5_UNORM, chain, report);
+}
+
+bool TextureCooker::cookColour(ID3D11Device* device, ID3D11DeviceContext* deviceContext, ID3D11ShaderResourceView* source, const wchar_t* filename, CookReport& report)
+{
+	if (!source)
+	{
+		return false;
+	}
+
+	ID3D11Resource* resource = 0;
+	ID3D11Texture2D* sourceTexture = 0;
+	source->GetResource(&resource);
+	if (FAILED(resource->QueryInterface(__uuidof(ID3D11Texture2D), (void**)&sourceTexture)))
+	{
+		resource->Release();
+		return false;
+	}
+	resource->Release();
+
+	// A CPU readable copy of the top mip
+	D3D11_TEXTURE2D_DESC textureDesc;
+	sourceTexture->GetDesc(&textureDesc);
+	D3D11_TEXTURE2D_DESC stagingDesc = textureDesc;
+	stagingDesc.MipLevels = 1;
+	stagingDesc.ArraySize = 1;
+	stagingDesc.Usage = D3D11_USAGE_STAGING;
+	stagingDesc.BindFlags = 0;
+	stagingDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	stagingDesc.MiscFlags = 0;
+	ID3D11Texture2D* stagingTexture = 0;
+	if (FAILED(device->CreateTexture2D(&stagingDesc, NULL, &stagingTexture)))
+	{
+		sourceTexture->Release();
+		return false;
+	}
+	MemoryTracker::track(stagingTexture, MEMORY_STAGING, "Texture cooker readback");
+	deviceContext->CopySubresourceRegion(stagingTexture, 0, 0, 0, 0, sourceTexture, 0, NULL);
+	sourceTexture->Release();
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	if (FAILED(deviceContext->Map(stagingTexture, 0, D3D11_MAP_READ, 0, &mappedResource)))
+	{
+		stagingTexture->Release();
+		return false;
+	}
+
+	// Converts each supported format to RGBA floats, decoding sources that are already block compressed
+	int width = textureDesc.Width;
+	int height = textureDesc.Height;
+	MipChain chain;
+	chain.channels = 4;
+	chain.widths.push_back(width);
+	chain.heights.push_back(height);
+	chain.mips.push_back(vector<float>((size_t)width * height * 4));
+	float* texels = chain.mips[0].data();
+	bool supported = true;
+	BlockFormat sourceBlocks;
+	if (getBlockFormat(textureDesc.Format, sourceBlocks))
+	{
+		XMFLOAT4 decoded[16];
+		for (int blockY = 0; blockY < BlockCompression::getBlocksAcross(height); blockY++)
+		{
+			const uint8_t* row = (const uint8_t*)mappedResource.pData + blockY * mappedResource.RowPitch;
+			for (int blockX = 0; blockX < BlockCompression::getBlocksAcross(width); blockX++)
+			{
+				BlockCompression::decodeBlock(sourceBlocks, row + blockX * BlockCompression::getBlockBytes(sourceBlocks), decoded);
+				for (int i = 0; i < 16; i++)
+				{
+					int x = blockX * 4 + i % 4;
+					int y = blockY * 4 + i / 4;
+					if (x < width && y < height)
+					{
+						memcpy(&texels[((size_t)y * width + x) * 4], &decoded[i], sizeof(XMFLOAT4));
+					}
+				}
+			}
+		}
+	}
+	else
+	{
+		for (int y = 0; y < height && supported; y++)
+		{
+			const unsigned char* row = (const unsigned char*)mappedResource.pData + y * mappedResource.RowPitch;
+			for (int x = 0; x < width; x++)
+			{
+				float* texel = &texels[((size_t)y * width + x) * 4];
+				switch (textureDesc.Format)
+				{
+				case DXGI_FORMAT_R8G8B8A8_UNORM:
+				case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+					for (int c = 0; c < 4; c++)
+					{
+						texel[c] = row[x * 4 + c] / 255.0f;
+					}
+					break;
+				case DXGI_FORMAT_B8G8R8A8_UNORM:
+				case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+				case DXGI_FORMAT_B8G8R8X8_UNORM:
+					texel[0] = row[x * 4 + 2] / 255.0f;
+					texel[1] = row[x * 4 + 1] / 255.0f;
+					texel[2] = row[x * 4 + 0] / 255.0f;
+					texel[3] = textureDesc.Format == DXGI_FORMAT_B8G8R8X8_UNORM ? 1.0f : row[x * 4 + 3] / 255.0f;
+					break;
+				case DXGI_FORMAT_R16G16B16A16_UNORM:
+					for (int c = 0; c < 4; c++)
+					{
+						texel[c] = ((const unsigned short*)row)[x * 4 + c] / 65535.0f;
+					}
+					break;
+				case DXGI_FORMAT_R32G32B32A32_FLOAT:
+					memcpy(texel, &((const float*)row)[x * 4], sizeof(float) * 4);
+					break;
+				default:
+					supported = false;
+					break;
+				}
+			}
+		}
+	}
+	deviceContext->Unmap(stagingTexture, 0);
+	stagingTexture->Release();
+	if (!supported)
+	{
+		return false;
+	}
+	bool srgb = textureDesc.Format == DXGI_FORMAT_R8G8B8A8_UNORM_SRGB || textureDesc.Format == DXGI_FORMAT_B8G8R8A8_UNORM_SRGB || textureDesc.Format == DXGI_FORMAT_BC1_UNORM_SRGB || textureDesc.Format == DXGI_FORMAT_BC2_UNORM_SRGB || textureDesc.Format == DXGI_FORMAT_BC3_UNORM_SRGB;
+	buildMips(chain, false, srgb);
+
+	report.name = "Colour";
+	report.sourceBytes = getTextureBytes(source);
+	return write(filename, srgb ? DXGI_FORMAT_BC7_UNORM_SRGB : DXGI_FORMAT_BC7_UNORM, chain, report);
+}
+
+void TextureCooker::buildMips(MipChain& chain, bool normals, bool srgb)
+{
+	int channels = chain.channels;
+	while (chain.widths.back() > 1 || chain.heights.back() > 1)
+	{
+		int parentWidth = chain.widths.back();
+		int parentHeight = chain.heights.back();
+		int mipWidth = max(1, parentWidth / 2);
+		int mipHeight = max(1, parentHeight / 2);
+		const vector<float>& parent = chain.mips.back();
+		vector<float> mip((size_t)mipWidth * mipHeight * channels);
+		for (int y = 0; y < mipHeight; y++)
+		{
+			for (int x = 0; x < mipWidth; x++)
+			{
+				int x0 = min(x * 2, parentWidth - 1);
+				int x1 = min(x * 2 + 1, parentWidth - 1);
+				int y0 = min(y * 2, parentHeight - 1);
+				int y1 = min(y * 2 + 1, parentHeight - 1);
+				float* texel = &mip[((size_t)y * mipWidth + x) * channels];
+
+				// Light adds up linearly, so SRGB colour is decoded before it is averaged and encoded again after, or each mip comes out darker. Alpha is stored linear already
+				for (int c = 0; c < channels; c++)
+				{
+					float samples[4] = { parent[((size_t)y0 * parentWidth + x0) * channels + c], parent[((size_t)y0 * parentWidth + x1) * channels + c], parent[((size_t)y1 * parentWidth + x0) * channels + c], parent[((size_t)y1 * parentWidth + x1) * channels + c] };
+					if (srgb && c < 3)
+					{
+						texel[c] = linearToSrgb((srgbToLinear(samples[0]) + srgbToLinear(samples[1]) + srgbToLinear(samples[2]) + srgbToLinear(samples[3])) * 0.25f);
+					}
+					else
+					{
+						texel[c] = (samples[0] + samples[1] + samples[2] + samples[3]) * 0.25f;
+					}
+				}
+
+				// Averaged normals come out shorter than unit length the more they disagree, so the four are summed as vectors and normalized
+				if (normals)
+				{
+					XMVECTOR sum = XMVectorZero();
+					int corners[4][2] = { { x0, y0 }, { x1, y0 }, { x0, y1 }, { x1, y1 } };
+					for (int corner = 0; corner < 4; corner++)
+					{
+						const float* source = &parent[((size_t)corners[corner][1] * parentWidth + corners[corner][0]) * 2];
+						float normalX = source[0] * 2.0f - 1.0f;
+						float normalZ = source[1] * 2.0f - 1.0f;
+						sum = XMVectorAdd(sum, XMVectorSet(normalX, sqrtf(max(1.0f - normalX * normalX - normalZ * normalZ, 0.0f)), normalZ, 0.0f));
+					}
+					XMFLOAT3 unit;
+					XMStoreFloat3(&unit, XMVector3Normalize(sum));
+					texel[0] = unit.x * 0.5f + 0.5f;
+					texel[1] = unit.z * 0.5f + 0.5f;
+				}
+			}
+		}
+		chain.widths.push_back(mipWidth);
+		chain.heights.push_back(mipHeight);
+		chain.mips.push_back(move(mip));
+	}
+}
+
+void TextureCooker::decodeMip(DXGI_FORMAT format, const vector<uint8_t>& data, int width, int height, vector<float>& texels)
+{
+	BlockFormat blockFormat;
+	if (getBlockFormat(format, blockFormat))
+	{
+		BlockCompression::decodeImage(blockFormat, data.data(), width, height, texels);
+		return;
+	}
+
+	// Everything else the cooker writes is R16_UNORM
+	texels.resize((size_t)width * height);
+	for (size_t i = 0; i < texels.size(); i++)
+	{
+		texels[i] = ((const uint16_t*)data.data())[i] / 65535.0f;
+	}
+}
+
+bool TextureCooker::write(const wchar_t* filename, DXGI_FORMAT format, const MipChain& chain, CookReport& report)
+{
+	// Block compressed textures must start at a whole number of blocks
+	BlockFormat blockFormat;
+	bool blocks = getBlockFormat(format, blockFormat);
+	if (blocks && (chain.widths[0] % 4 != 0 || chain.heights[0] % 4 != 0))
+	{
+		return false;
+	}
+
+	int mipCount = (int)chain.mips.size();
+	vector<vector<uint8_t>> mipData(mipCount);
+	vector<CookedMipEntry> entries(mipCount);
+	unsigned long long texels = 0;
+	report.threads = 1;
+	chrono::high_resolution_clock::time_point encodeStart = chrono::high_resolution_clock::now();
+	for (int mip = 0; mip < mipCount; mip++)
+	{
+		int width = chain.widths[mip];
+		int height = chain.heights[mip];
+		texels += (unsigned long long)width * height;
+		if (blocks)
+		{
+			BlockCompression::encodeImage(blockFormat, chain.mips[mip].data(), width, height, mipData[mip]);
+			entries[mip].rowPitch = BlockCompression::getBlocksAcross(width) * BlockCompression::getBlockBytes(blockFormat);
+			report.threads = max(report.threads, BlockCompression::getLastThreadCount());
+		}
+		else
+		{
+			mipData[mip].resize((size_t)width * height * sizeof(uint16_t));
+			uint16_t* output = (uint16_t*)mipData[mip].data();
+			for (size_t i = 0; i < (size_t)width * height; i++)
+			{
+				output[i] = (uint16_t)(min(max(chain.mips[mip][i], 0.0f), 1.0f) * 65535.0f + 0.5f);
+			}
+			entries[mip].rowPitch = width * sizeof(uint16_t);
+		}
+		entries[mip].bytes = (uint32_t)mipData[mip].size();
+	}
+	report.encodeMilliseconds = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - encodeStart).count();
+	report.megatexelsPerSecond = report.encodeMilliseconds > 0.0 ? texels / (report.encodeMilliseconds * 1000.0) : 0.0;
+
+	// Decodes every mip as it will be read back and measures it against what it was cooked from, so a bad block anywhere in the chain shows
+	vector<float> decoded;
+	report.mipMaxError = 0.0;
+	report.worstMipPsnr = MAX_PSNR;
+	report.worstMip = 0;
+	for (int mip = 0; mip < mipCount; mip++)
+	{
+		decodeMip(format, mipData[mip], chain.widths[mip], chain.heights[mip], decoded);
+		const vector<float>& original = chain.mips[mip];
+		double squaredError = 0.0;
+		double maxError = 0.0;
+		for (size_t i = 0; i < original.size(); i++)
+		{
+			double difference = decoded[i] - min(max(original[i], 0.0f), 1.0f);
+			squaredError += difference * difference;
+			maxError = max(maxError, fabs(difference));
+		}
+		double meanSquaredError = squaredError / max(original.size(), (size_t)1);
+		double psnr = meanSquaredError > 0.0 ? min(10.0 * log10(1.0 / meanSquaredError), MAX_PSNR) : MAX_PSNR;
+		if (mip == 0)
+		{
+			report.rmsError = sqrt(meanSquaredError);
+			report.maxError = maxError;
+			report.psnr = psnr;
+		}
+		report.mipMaxError = max(report.mipMaxError, maxError);
+		if (psnr < report.worstMipPsnr)
+		{
+			report.worstMipPsnr = psnr;
+			report.worstMip = mip;
+		}
+	}
+
+	CookedTextureHeader header;
+	memcpy(header.magic, "CTEX", 4);
+	header.version = COOKED_TEXTURE_VERSION;
+	header.format = format;
+	header.width = chain.widths[0];
+	header.height = chain.heights[0];
+	header.mipCount = mipCount;
+	uint64_t offset = sizeof(header) + sizeof(CookedMipEntry) * mipCount;
+	for (int mip = 0; mip < mipCount; mip++)
+	{
+		entries[mip].offset = offset;
+		offset += entries[mip].bytes;
+	}
+
+	ofstream output(filename, ios::binary | ios::trunc);
+	if (!output.is_open())
+	{
+		return false;
+	}
+	output.write((const char*)&header, sizeof(header));
+	output.write((const char*)entries.data(), sizeof(CookedMipEntry) * mipCount);
+	for (int mip = 0; mip < mipCount; mip++)
+	{
+		output.write((const char*)mipData[mip].data(), mipData[mip].size());
+	}
+
+	report.format = format;
+	report.width = chain.widths[0];
+	report.height = chain.heights[0];
+	report.mipCount = mipCount;
+	report.cookedBytes = offset - sizeof(header) - sizeof(CookedMipEntry) * mipCount;
+	return output.good();
+}
+
+ID3D11ShaderResourceView* TextureCooker::load(ID3D11Device* device, const wchar_t* filename)
+{
+	ifstream file(filename, ios::binary);
+	if (!file.is_open())
+	{
+		return NULL;
+	}
+
+	// Validate the header before trusting any of the sizes in it
+	CookedTextureHeader header;
+	file.read((char*)&header, sizeof(header));
+	if (!file.good() || memcmp(header.magic, "CTEX", 4) != 0 || header.version != COOKED_TEXTURE_VERSION || header.mipCount == 0 || header.mipCount > 16)
+	{
+		return NULL;
+	}
+	vector<CookedMipEntry> entries(header.mipCount);
+	file.read((char*)entries.data(), sizeof(CookedMipEntry) * header.mipCount);
+
+	// Every mip is read into memory in the layout the texture takes, then handed over in one call
+	vector<vector<uint8_t>> mipData(header.mipCount);
+	vector<D3D11_SUBRESOURCE_DATA> initialData(header.mipCount);
+	for (uint32_t mip = 0; mip < header.mipCount; mip++)
+	{
+		mipData[mip].resize(entries[mip].bytes);
+		file.seekg(entries[mip].offset);
+		file.read((char*)mipData[mip].data(), entries[mip].bytes);
+		initialData[mip].pSysMem = mipData[mip].data();
+		initialData[mip].SysMemPitch = entries[mip].rowPitch;
+		initialData[mip].SysMemSlicePitch = entries[mip].bytes;
+	}
+	if (!file.good())
+	{
+		return NULL;
+	}
+
+	D3D11_TEXTURE2D_DESC textureDesc;
+	textureDesc.Width = header.width;
+	textureDesc.Height = header.height;
+	textureDesc.MipLevels = header.mipCount;
+	textureDesc.ArraySize = 1;
+	textureDesc.Format = (DXGI_FORMAT)header.format;
+	textureDesc.SampleDesc.Count = 1;
+	textureDesc.SampleDesc.Quality = 0;
+	textureDesc.Usage = D3D11_USAGE_IMMUTABLE;
+	textureDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	textureDesc.CPUAccessFlags = 0;
+	textureDesc.MiscFlags = 0;
+	ID3D11Texture2D* texture = 0;
+	if (FAILED(device->CreateTexture2D(&textureDesc, initialData.data(), &texture)))
+	{
+		return NULL;
+	}
+	MemoryTracker::track(texture, MEMORY_TEXTURE, "Cooked texture");
+	ID3D11ShaderResourceView* view = 0;
+	device->CreateShaderResourceView(texture, NULL, &view);
+	texture->Release();
+	return view;
+}
+
+unsigned long long TextureCooker::getTextureBytes(ID3D11ShaderResourceView* texture)
+{
+	if (!texture)
+	{
+		return 0;
+	}
+	ID3D11Resource* resource = 0;
+	ID3D11Texture2D* texture2D = 0;
+	texture->GetResource(&resource);
+	HRESULT result = resource->QueryInterface(__uuidof(ID3D11Texture2D), (void**)&texture2D);
+	resource->Release();
+	if (FAILED(result))
+	{
+		return 0;
+	}
+	D3D11_TEXTURE2D_DESC desc;
+	texture2D->GetDesc(&desc);
+	texture2D->Release();
+
+	// Block compressed mips round up to whole blocks
+	BlockFormat blockFormat;
+	bool blocks = getBlockFormat(desc.Format, blockFormat);
+	float bytesPerTexel = getBytesPerTexel(desc.Format);
+	unsigned long long bytes = 0;
+	for (UINT mip = 0; mip < desc.MipLevels; mip++)
+	{
+		UINT width = max(desc.Width >> mip, 1u);
+		UINT height = max(desc.Height >> mip, 1u);
+		if (blocks)
+		{
+			bytes += (unsigned long long)BlockCompression::getBlocksAcross(width) * BlockCompression::getBlocksAcross(height) * BlockCompression::getBlockBytes(blockFormat);
+		}
+		else
+		{
+			bytes += (unsigned long long)(width * height * bytesPerTexel);
+		}
+	}
+	return bytes * desc.ArraySize;
+}
+
+float TextureCooker::getBytesPerTexel(DXGI_FORMAT format)
+{
+	switch (format)
+	{
+	case DXGI_FORMAT_R32G32B32A32_FLOAT:
+		return 16.0f;
+	case DXGI_FORMAT_R16G16B16A16_UNORM:
+	case DXGI_FORMAT_R16G16B16A16_FLOAT:
+		return 8.0f;
+	case DXGI_FORMAT_R8G8B8A8_UNORM:
+	case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+	case DXGI_FORMAT_B8G8R8A8_UNORM:
+	case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+	case DXGI_FORMAT_B8G8R8X8_UNORM:
+	case DXGI_FORMAT_R32_FLOAT:
+		return 4.0f;
+	case DXGI_FORMAT_R16_UNORM:
+		return 2.0f;
+	case DXGI_FORMAT_R8_UNORM:
+	case DXGI_FORMAT_BC2_UNORM:
+	case DXGI_FORMAT_BC2_UNORM_SRGB:
+	case DXGI_FORMAT_BC3_UNORM:
+	case DXGI_FORMAT_BC3_UNORM_SRGB:
+	case DXGI_FORMAT_BC5_UNORM:
+	case DXGI_FORMAT_BC7_UNORM:
+	case DXGI_FORMAT_BC7_UNORM_SRGB:
+		return 1.0f;
+	case DXGI_FORMAT_BC1_UNORM:
+	case DXGI_FORMAT_BC1_UNORM_SRGB:
+	case DXGI_FORMAT_BC4_UNORM:
+		return 0.5f;
+	default:
+		return 4.0f;
+	}
+}
+
+const char* TextureCooker::getFormatName(DXGI_FORMAT format)
+{
+	switch (format)
+	{
+	case DXGI_FORMAT_R32G32B32A32_FLOAT:
+		return "RGBA32F";
+	case DXGI_FORMAT_R16G16B16A16_UNORM:
+		return "RGBA16";
+	case DXGI_FORMAT_R8G8B8A8_UNORM:
+	case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+		return "RGBA8";
+	case DXGI_FORMAT_B8G8R8A8_UNORM:
+	case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+	case DXGI_FORMAT_B8G8R8X8_UNORM:
+		return "BGRA8";
+	case DXGI_FORMAT_R16_UNORM:
+		return "R16";
+	case DXGI_FORMAT_BC1_UNORM:
+	case DXGI_FORMAT_BC1_UNORM_SRGB:
+		return "BC1";
+	case DXGI_FORMAT_BC3_UNORM:
+	case DXGI_FORMAT_BC3_UNORM_SRGB:
+		return "BC3";
+	case DXGI_FORMAT_BC4_UNORM:
+		return "BC4";
+	case DXGI_FORMAT_BC5_UNORM:
+		return "BC5";
+	case DXGI_FORMAT_BC7_UNORM:
+	case DXGI_FORMAT_BC7_UNORM_SRGB:
+		return "BC7";
+	default:
+		return "Other";
+	}
+}
@@ -0,0 +1,107 @@
+// Cooks the scene's textures offline into the formats the shaders actually need, and loads the results straight into immutable textures.
+// The heightmap is loaded as RGBA although GetHeight only reads red, so it becomes single channel 16 bit, or BC4 where its error is small
+// enough. The terrain's per pixel normals are baked from the heights into BC5, and colour textures are encoded to BC7. A cooked file is a
+// header, a table of mips and each mip's texels or blocks laid out as the texture takes them, so loading is one read and one create
+#pragma once
+
+#include "DXF.h"
+#include "BlockCompression.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace DirectX;
+
+class HeightField;
+
+// File header, followed by one CookedMipEntry per mip and then the mips' data
+struct CookedTextureHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t format;
+	uint32_t width;
+	uint32_t height;
+	uint32_t mipCount;
+};
+
+struct CookedMipEntry
+{
+	uint64_t offset;
+	uint32_t rowPitch;
+	uint32_t bytes;
+};
+
+// What one cook produced, against the texture it replaces
+struct CookReport
+{
+	string name;
+	DXGI_FORMAT format;
+	int width;
+	int height;
+	int mipCount;
+
+	// Every mip of the texture as loaded before cooking, and as cooked
+	unsigned long long sourceBytes;
+	unsigned long long cookedBytes;
+
+	// Time spent converting or block encoding every mip, not counting building the mips or writing the file
+	double encodeMilliseconds;
+	double megatexelsPerSecond;
+	int threads;
+
+	// Difference between the top mip as the GPU will decode it and what it was cooked from, in the texture's 0 to 1 units, and as a peak
+	// signal to noise ratio in decibels, capped at MAX_PSNR for a lossless cook
+	double rmsError;
+	double maxError;
+	double psnr;
+
+	// Every mip is decoded and measured the same way. The largest error of any mip, and the mip with the lowest PSNR
+	double mipMaxError;
+	double worstMipPsnr;
+	int worstMip;
+};
+
+static const double MAX_PSNR = 100.0;
+
+class TextureCooker
+{
+public:
+	// Cooks the height field as R16_UNORM or BC4_UNORM, with a box filtered mip chain
+	static bool cookHeightMap(const HeightField& heights, const wchar_t* filename, DXGI_FORMAT format, unsigned long long sourceBytes, CookReport& report);
+
+	// Bakes the normals CalculatePixelNormal works out from the heights into BC5, X in red and Z in green, for a terrain worldSize units across
+	static bool cookNormalMap(const HeightField& heights, float worldSize, float heightScale, const wchar_t* filename, CookReport& report);
+
+	// Reads back the top mip of a loaded colour texture and encodes it as BC7, keeping sRGB textures sRGB
+	static bool cookColour(ID3D11Device* device, ID3D11DeviceContext* deviceContext, ID3D11ShaderResourceView* source, const wchar_t* filename, CookReport& report);
+
+	// Loads a cooked file into an immutable texture, returning its view, or NULL if the file is missing or isn't a cooked texture
+	static ID3D11ShaderResourceView* load(ID3D11Device* device, const wchar_t* filename);
+
+	// Bytes every mip of a texture takes in video memory, and what one texel costs to read at the top mip
+	static unsigned long long getTextureBytes(ID3D11ShaderResourceView* texture);
+	static float getBytesPerTexel(DXGI_FORMAT format);
+	static const char* getFormatName(DXGI_FORMAT format);
+
+private:
+	// A box filtered mip chain of channels floats per texel, the top mip given
+	struct MipChain
+	{
+		int channels;
+		vector<int> widths;
+		vector<int> heights;
+		vector<vector<float>> mips;
+	};
+
+	// Filters every mip down to 1 x 1. Normal maps' two channels are a unit vector's X and Z, so their averages are renormalized,
+	// and SRGB colour is averaged in linear space
+	static void buildMips(MipChain& chain, bool normals, bool srgb);
+
+	// Decodes one converted or encoded mip back to floats, the way the GPU will read it
+	static void decodeMip(DXGI_FORMAT format, const vector<uint8_t>& data, int width, int height, vector<float>& texels);
+
+	// Converts or encodes every mip to format and writes the file, filling in the report's sizes, timings and the error of each mip decoded
+	static bool write(const wchar_t* filename, DXGI_FORMAT format, const MipChain& chain, CookReport& report);
+};
@@ -0,0 +1,161 @@
+#include "SceneFile.h"
+#include <cstring>
+#include <fstream>
+
+static const uint32_t SCENE_FILE_VERSION = 1;
+
+// Section offsets are rounded up to this, so every record is read from a naturally aligned address
+static const uint64_t SCENE_SECTION_ALIGNMENT = 8;
+
+static uint64_t alignSection(uint64_t offset)
+{
+	return (offset + SCENE_SECTION_ALIGNMENT - 1) & ~(SCENE_SECTION_ALIGNMENT - 1);
+}
+
+SceneFile::SceneFile()
+{
+	file = INVALID_HANDLE_VALUE;
+	mapping = NULL;
+	view = 0;
+	bytes = 0;
+}
+
+SceneFile::~SceneFile()
+{
+	close();
+}
+
+bool SceneFile::write(const wchar_t* filename, const SceneData& scene)
+{
+	SceneHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "SCNB", 4);
+	header.version = SCENE_FILE_VERSION;
+	header.lightCount = (uint32_t)scene.lights.size();
+	header.instanceCount = (uint32_t)scene.instances.size();
+	header.settingsOffset = alignSection(sizeof(SceneHeader));
+	header.lightOffset = alignSection(header.settingsOffset + sizeof(SceneSettings));
+	header.instanceOffset = alignSection(header.lightOffset + sizeof(SceneLight) * scene.lights.size());
+	header.fileBytes = header.instanceOffset + sizeof(SceneInstance) * scene.instances.size();
+
+	ofstream output(filename, ios::binary | ios::trunc);
+	if (!output.is_open())
+	{
+		return false;
+	}
+
+	// Pads up to each section's offset with zeros
+	const char zeros[SCENE_SECTION_ALIGNMENT] = {};
+	output.write((const char*)&header, sizeof(header));
+	output.write(zeros, header.settingsOffset - sizeof(header));
+	output.write((const char*)&scene.settings, sizeof(SceneSettings));
+	output.write(zeros, header.lightOffset - header.settingsOffset - sizeof(SceneSettings));
+	output.write((const char*)scene.lights.data(), sizeof(SceneLight) * scene.lights.size());
+	output.write(zeros, header.instanceOffset - header.lightOffset - sizeof(SceneLight) * scene.lights.size());
+	output.write((const char*)scene.instances.data(), sizeof(SceneInstance) * scene.instances.size());
+	return output.good();
+}
+
+bool SceneFile::open(const wchar_t* filename)
+{
+	close();
+	file = CreateFileW(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart < (LONGLONG)sizeof(SceneHeader))
+	{
+		close();
+		return false;
+	}
+	bytes = size.QuadPart;
+
+	// The whole file is mapped as one view, the OS paging it in as the arrays are first touched
+	mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping)
+	{
+		view = (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	}
+	if (!view || !validate())
+	{
+		close();
+		return false;
+	}
+	return true;
+}
+
+void SceneFile::close()
+{
+	if (view)
+	{
+		UnmapViewOfFile(view);
+		view = 0;
+	}
+	if (mapping)
+	{
+		CloseHandle(mapping);
+		mapping = NULL;
+	}
+	if (file != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(file);
+		file = INVALID_HANDLE_VALUE;
+	}
+	bytes = 0;
+}
+
+bool SceneFile::validate() const
+{
+	const SceneHeader& header = getHeader();
+	if (memcmp(header.magic, "SCNB", 4) != 0 || header.version != SCENE_FILE_VERSION || header.fileBytes != bytes)
+	{
+		return false;
+	}
+
+	// Each section must start aligned, after the header, and end inside the file. Sizes are checked against what's left so they can't overflow
+	uint64_t offsets[3] = { header.settingsOffset, header.lightOffset, header.instanceOffset };
+	uint64_t sizes[3] = { sizeof(SceneSettings), sizeof(SceneLight), sizeof(SceneInstance) };
+	uint64_t counts[3] = { 1, header.lightCount, header.instanceCount };
+	for (int section = 0; section < 3; section++)
+	{
+		if (offsets[section] % SCENE_SECTION_ALIGNMENT != 0 || offsets[section] < sizeof(SceneHeader) || offsets[section] > bytes)
+		{
+			return false;
+		}
+		if (counts[section] > (bytes - offsets[section]) / sizes[section])
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+const char* SceneFile::getLightTypeName(SceneLightType type)
+{
+	switch (type)
+	{
+	case SCENE_LIGHT_DIRECTIONAL:
+		return "directional";
+	case SCENE_LIGHT_POINT:
+		return "point";
+	case SCENE_LIGHT_SPOT:
+		return "spot";
+	default:
+		return "unknown";
+	}
+}
+
+const char* SceneFile::getMeshName(SceneMesh mesh)
+{
+	switch (mesh)
+	{
+	case SCENE_MESH_CUBE:
+		return "cube";
+	case SCENE_MESH_SPHERE:
+		return "sphere";
+	default:
+		return "unknown";
+	}
+}
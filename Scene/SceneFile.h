@@ -0,0 +1,120 @@
+// Binary scene format holding the lights, mesh instances and render settings the application starts with. Every section is a flat array
+// of fixed size records with no pointers or strings, at offsets the header gives, so a file is memory mapped and read in place without
+// parsing or copying. SceneJson converts the text form of a scene into this one
+#pragma once
+
+#include "DXF.h"
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+using namespace DirectX;
+
+enum SceneLightType
+{
+	SCENE_LIGHT_DIRECTIONAL,
+	SCENE_LIGHT_POINT,
+	SCENE_LIGHT_SPOT,
+	SCENE_LIGHT_TYPE_COUNT
+};
+
+// Meshes an instance can be drawn with. Spheres are the GPU driven scene's objects, scaled by their radius
+enum SceneMesh
+{
+	SCENE_MESH_CUBE,
+	SCENE_MESH_SPHERE,
+	SCENE_MESH_COUNT
+};
+
+// File header, followed by the settings, lights and instances. Offsets are from the start of the file and sections are 8 byte aligned
+struct SceneHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t lightCount;
+	uint32_t instanceCount;
+	uint64_t settingsOffset;
+	uint64_t lightOffset;
+	uint64_t instanceOffset;
+	uint64_t fileBytes;
+};
+
+struct SceneSettings
+{
+	int32_t tessFactor;
+	uint32_t pixelNormals;
+	float specIntensity;
+	float specExponent;
+	uint32_t depthOfField;
+	float dofWeighting;
+	float dofCutoff;
+	float dofPercentage;
+	uint32_t horizonShadows;
+	uint32_t pointShadows;
+};
+
+// Directional lights only use the direction, and point lights only the position and dropoff
+struct SceneLight
+{
+	uint32_t type;
+	uint32_t active;
+	XMFLOAT4 ambient;
+	XMFLOAT4 diffuse;
+	XMFLOAT3 position;
+	float dropoff;
+	XMFLOAT3 direction;
+	float cutoff;
+};
+
+// Nothing in the scene is rotated, so an instance's transform is a position and uniform scale
+struct SceneInstance
+{
+	XMFLOAT3 position;
+	float scale;
+	uint32_t mesh;
+	uint32_t padding;
+};
+
+// A scene held in memory, as built by the application or read from text, for writing out
+struct SceneData
+{
+	SceneSettings settings;
+	vector<SceneLight> lights;
+	vector<SceneInstance> instances;
+};
+
+class SceneFile
+{
+public:
+	SceneFile();
+	~SceneFile();
+
+	// Writes a scene out in the binary format
+	static bool write(const wchar_t* filename, const SceneData& scene);
+
+	// Maps a file read only and checks every section lies within it. Nothing is read until the arrays are used
+	bool open(const wchar_t* filename);
+	void close();
+	bool isOpen() const { return view != 0; }
+
+	// Point straight into the mapped file, valid until it is closed
+	const SceneHeader& getHeader() const { return *(const SceneHeader*)view; }
+	const SceneSettings& getSettings() const { return *(const SceneSettings*)(view + getHeader().settingsOffset); }
+	const SceneLight* getLights() const { return (const SceneLight*)(view + getHeader().lightOffset); }
+	const SceneInstance* getInstances() const { return (const SceneInstance*)(view + getHeader().instanceOffset); }
+	int getLightCount() const { return getHeader().lightCount; }
+	int getInstanceCount() const { return getHeader().instanceCount; }
+	unsigned long long getBytes() const { return bytes; }
+
+	static const char* getLightTypeName(SceneLightType type);
+	static const char* getMeshName(SceneMesh mesh);
+
+private:
+	// Checks the header and that each section's records fit inside the file at an aligned offset
+	bool validate() const;
+
+	HANDLE file;
+	HANDLE mapping;
+	const uint8_t* view;
+	unsigned long long bytes;
+};
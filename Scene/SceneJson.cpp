@@ -0,0 +1,493 @@
+#include "SceneJson.h"
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+// Reads JSON a value at a time from a null terminated string. Every call returns false on malformed text and sets failed, and the
+// object and array loops also return false once they reach the closing bracket
+class JsonReader
+{
+public:
+	JsonReader(const char* text) : position(text), failed(false) {}
+
+	bool beginObject() { return expect('{'); }
+	bool beginArray() { return expect('['); }
+
+	// Moves to the next member of an object, reading its key and the colon after it
+	bool nextMember(string& key)
+	{
+		if (!nextItem('}'))
+		{
+			return false;
+		}
+		return readString(key) && expect(':');
+	}
+
+	// Moves to the next element of an array
+	bool nextElement() { return nextItem(']'); }
+
+	bool readString(string& value)
+	{
+		if (!expect('"'))
+		{
+			return false;
+		}
+		value.clear();
+		while (*position != '"')
+		{
+			if (*position == 0)
+			{
+				return fail();
+			}
+
+			// Only the simple escapes are kept, \u escapes are replaced as none of the scene's strings need them
+			if (*position == '\\')
+			{
+				position++;
+				switch (*position)
+				{
+				case 'n':
+					value += '\n';
+					break;
+				case 't':
+					value += '\t';
+					break;
+				case 'u':
+					for (int digit = 0; digit < 4 && position[1] != 0; digit++)
+					{
+						position++;
+					}
+					value += '?';
+					break;
+				case 0:
+					return fail();
+				default:
+					value += *position;
+					break;
+				}
+				position++;
+				continue;
+			}
+			value += *position++;
+		}
+		position++;
+		return true;
+	}
+
+	bool readNumber(double& value)
+	{
+		skipWhitespace();
+		char* end;
+		value = strtod(position, &end);
+		if (end == position)
+		{
+			return fail();
+		}
+		position = end;
+		return true;
+	}
+
+	bool readFloat(float& value)
+	{
+		double number;
+		if (!readNumber(number))
+		{
+			return false;
+		}
+		value = (float)number;
+		return true;
+	}
+
+	bool readBool(bool& value)
+	{
+		skipWhitespace();
+		if (strncmp(position, "true", 4) == 0)
+		{
+			value = true;
+			position += 4;
+			return true;
+		}
+		if (strncmp(position, "false", 5) == 0)
+		{
+			value = false;
+			position += 5;
+			return true;
+		}
+		return fail();
+	}
+
+	// Reads an array of exactly count numbers
+	bool readFloats(float* values, int count)
+	{
+		if (!beginArray())
+		{
+			return false;
+		}
+		int read = 0;
+		while (nextElement())
+		{
+			if (read == count || !readFloat(values[read]))
+			{
+				return fail();
+			}
+			read++;
+		}
+		return !failed && read == count ? true : fail();
+	}
+
+	// Steps over a value of any type, for keys the loader doesn't use
+	bool skipValue()
+	{
+		skipWhitespace();
+		string text;
+		double number;
+		bool boolean;
+		switch (*position)
+		{
+		case '"':
+			return readString(text);
+		case '{':
+			beginObject();
+			while (nextMember(text))
+			{
+				if (!skipValue())
+				{
+					return false;
+				}
+			}
+			return !failed;
+		case '[':
+			beginArray();
+			while (nextElement())
+			{
+				if (!skipValue())
+				{
+					return false;
+				}
+			}
+			return !failed;
+		case 't':
+		case 'f':
+			return readBool(boolean);
+		case 'n':
+			if (strncmp(position, "null", 4) == 0)
+			{
+				position += 4;
+				return true;
+			}
+			return fail();
+		default:
+			return readNumber(number);
+		}
+	}
+
+	bool hasFailed() const { return failed; }
+
+private:
+	void skipWhitespace()
+	{
+		while (*position == ' ' || *position == '\t' || *position == '\n' || *position == '\r')
+		{
+			position++;
+		}
+	}
+
+	bool expect(char character)
+	{
+		skipWhitespace();
+		if (*position != character)
+		{
+			return fail();
+		}
+		position++;
+		return true;
+	}
+
+	// Consumes the closing bracket, returning false, or the comma before the next item
+	bool nextItem(char closing)
+	{
+		skipWhitespace();
+		if (*position == closing)
+		{
+			position++;
+			return false;
+		}
+		if (*position == ',')
+		{
+			position++;
+		}
+		skipWhitespace();
+		return *position != 0 ? true : fail();
+	}
+
+	bool fail()
+	{
+		failed = true;
+		return false;
+	}
+
+	const char* position;
+	bool failed;
+};
+
+// How a record's member is written in the text, and where it sits in the record
+enum JsonFieldType
+{
+	FIELD_INT,
+	FIELD_BOOL,
+	FIELD_FLOAT,
+	FIELD_FLOAT3,
+	FIELD_FLOAT4,
+	FIELD_LIGHT_TYPE,
+	FIELD_MESH
+};
+
+struct JsonField
+{
+	const char* name;
+	size_t offset;
+	JsonFieldType type;
+};
+
+static const JsonField settingsFields[] =
+{
+	{ "tessFactor", offsetof(SceneSettings, tessFactor), FIELD_INT },
+	{ "pixelNormals", offsetof(SceneSettings, pixelNormals), FIELD_BOOL },
+	{ "specIntensity", offsetof(SceneSettings, specIntensity), FIELD_FLOAT },
+	{ "specExponent", offsetof(SceneSettings, specExponent), FIELD_FLOAT },
+	{ "depthOfField", offsetof(SceneSettings, depthOfField), FIELD_BOOL },
+	{ "dofWeighting", offsetof(SceneSettings, dofWeighting), FIELD_FLOAT },
+	{ "dofCutoff", offsetof(SceneSettings, dofCutoff), FIELD_FLOAT },
+	{ "dofPercentage", offsetof(SceneSettings, dofPercentage), FIELD_FLOAT },
+	{ "horizonShadows", offsetof(SceneSettings, horizonShadows), FIELD_BOOL },
+	{ "pointShadows", offsetof(SceneSettings, pointShadows), FIELD_BOOL }
+};
+
+static const JsonField lightFields[] =
+{
+	{ "type", offsetof(SceneLight, type), FIELD_LIGHT_TYPE },
+	{ "active", offsetof(SceneLight, active), FIELD_BOOL },
+	{ "ambient", offsetof(SceneLight, ambient), FIELD_FLOAT4 },
+	{ "diffuse", offsetof(SceneLight, diffuse), FIELD_FLOAT4 },
+	{ "position", offsetof(SceneLight, position), FIELD_FLOAT3 },
+	{ "dropoff", offsetof(SceneLight, dropoff), FIELD_FLOAT },
+	{ "direction", offsetof(SceneLight, direction), FIELD_FLOAT3 },
+	{ "cutoff", offsetof(SceneLight, cutoff), FIELD_FLOAT }
+};
+
+static const JsonField instanceFields[] =
+{
+	{ "mesh", offsetof(SceneInstance, mesh), FIELD_MESH },
+	{ "position", offsetof(SceneInstance, position), FIELD_FLOAT3 },
+	{ "scale", offsetof(SceneInstance, scale), FIELD_FLOAT }
+};
+
+// Reads an object into a record, member by member. Names of light types and meshes that aren't known become the type's count
+static bool readRecord(JsonReader& reader, const JsonField* fields, int fieldCount, void* record)
+{
+	string key;
+	string name;
+	double number = 0.0;
+	bool flag = false;
+	if (!reader.beginObject())
+	{
+		return false;
+	}
+	while (reader.nextMember(key))
+	{
+		const JsonField* field = 0;
+		for (int i = 0; i < fieldCount && !field; i++)
+		{
+			if (key == fields[i].name)
+			{
+				field = &fields[i];
+			}
+		}
+		if (!field)
+		{
+			if (!reader.skipValue())
+			{
+				return false;
+			}
+			continue;
+		}
+
+		uint8_t* member = (uint8_t*)record + field->offset;
+		bool read = false;
+		switch (field->type)
+		{
+		case FIELD_INT:
+			read = reader.readNumber(number);
+			*(int32_t*)member = (int32_t)number;
+			break;
+		case FIELD_BOOL:
+			read = reader.readBool(flag);
+			*(uint32_t*)member = flag ? 1 : 0;
+			break;
+		case FIELD_FLOAT:
+			read = reader.readFloat(*(float*)member);
+			break;
+		case FIELD_FLOAT3:
+			read = reader.readFloats((float*)member, 3);
+			break;
+		case FIELD_FLOAT4:
+			read = reader.readFloats((float*)member, 4);
+			break;
+		case FIELD_LIGHT_TYPE:
+			read = reader.readString(name);
+			*(uint32_t*)member = SCENE_LIGHT_TYPE_COUNT;
+			for (int type = 0; type < SCENE_LIGHT_TYPE_COUNT; type++)
+			{
+				if (name == SceneFile::getLightTypeName((SceneLightType)type))
+				{
+					*(uint32_t*)member = type;
+				}
+			}
+			break;
+		case FIELD_MESH:
+			read = reader.readString(name);
+			*(uint32_t*)member = SCENE_MESH_COUNT;
+			for (int mesh = 0; mesh < SCENE_MESH_COUNT; mesh++)
+			{
+				if (name == SceneFile::getMeshName((SceneMesh)mesh))
+				{
+					*(uint32_t*)member = mesh;
+				}
+			}
+			break;
+		}
+		if (!read)
+		{
+			return false;
+		}
+	}
+	return !reader.hasFailed();
+}
+
+bool SceneJson::load(const wchar_t* filename, SceneData& scene)
+{
+	ifstream file(filename, ios::binary);
+	if (!file.is_open())
+	{
+		return false;
+	}
+	stringstream contents;
+	contents << file.rdbuf();
+	string text = contents.str();
+
+	// Anything not given keeps these values
+	memset(&scene.settings, 0, sizeof(scene.settings));
+	scene.settings.tessFactor = 10;
+	scene.lights.clear();
+	scene.instances.clear();
+
+	JsonReader reader(text.c_str());
+	string key;
+	if (!reader.beginObject())
+	{
+		return false;
+	}
+	while (reader.nextMember(key))
+	{
+		bool read = true;
+		if (key == "version")
+		{
+			double version;
+			read = reader.readNumber(version) && version == 1.0;
+		}
+		else if (key == "settings")
+		{
+			read = readRecord(reader, settingsFields, sizeof(settingsFields) / sizeof(JsonField), &scene.settings);
+		}
+		else if (key == "lights" && reader.beginArray())
+		{
+			while (read && reader.nextElement())
+			{
+				SceneLight light;
+				memset(&light, 0, sizeof(light));
+				light.active = 1;
+				read = readRecord(reader, lightFields, sizeof(lightFields) / sizeof(JsonField), &light);
+				if (read && light.type < SCENE_LIGHT_TYPE_COUNT)
+				{
+					scene.lights.push_back(light);
+				}
+			}
+		}
+		else if (key == "instances" && reader.beginArray())
+		{
+			while (read && reader.nextElement())
+			{
+				SceneInstance instance;
+				memset(&instance, 0, sizeof(instance));
+				instance.scale = 1.0f;
+				read = readRecord(reader, instanceFields, sizeof(instanceFields) / sizeof(JsonField), &instance);
+				if (read && instance.mesh < SCENE_MESH_COUNT)
+				{
+					scene.instances.push_back(instance);
+				}
+			}
+		}
+		else
+		{
+			read = reader.skipValue();
+		}
+		if (!read || reader.hasFailed())
+		{
+			return false;
+		}
+	}
+	return !reader.hasFailed();
+}
+
+bool SceneJson::save(const wchar_t* filename, const SceneData& scene)
+{
+	ofstream output(filename, ios::trunc);
+	if (!output.is_open())
+	{
+		return false;
+	}
+
+	// Floats are written with nine significant digits, enough to read back the exact same value
+	char line[512];
+	const SceneSettings& settings = scene.settings;
+	output << "{\n\t\"version\": 1,\n";
+	snprintf(line, sizeof(line), "\t\"settings\": { \"tessFactor\": %d, \"pixelNormals\": %s, \"specIntensity\": %.9g, \"specExponent\": %.9g, \"depthOfField\": %s, \"dofWeighting\": %.9g, \"dofCutoff\": %.9g, \"dofPercentage\": %.9g, \"horizonShadows\": %s, \"pointShadows\": %s },\n",
+		settings.tessFactor, settings.pixelNormals ? "true" : "false", settings.specIntensity, settings.specExponent, settings.depthOfField ? "true" : "false", settings.dofWeighting, settings.dofCutoff, settings.dofPercentage,
+		settings.horizonShadows ? "true" : "false", settings.pointShadows ? "true" : "false");
+	output << line;
+
+	output << "\t\"lights\": [\n";
+	for (size_t i = 0; i < scene.lights.size(); i++)
+	{
+		const SceneLight& light = scene.lights[i];
+		snprintf(line, sizeof(line), "\t\t{ \"type\": \"%s\", \"active\": %s, \"ambient\": [%.9g, %.9g, %.9g, %.9g], \"diffuse\": [%.9g, %.9g, %.9g, %.9g], \"position\": [%.9g, %.9g, %.9g], \"direction\": [%.9g, %.9g, %.9g], \"dropoff\": %.9g, \"cutoff\": %.9g }%s\n",
+			SceneFile::getLightTypeName((SceneLightType)light.type), light.active ? "true" : "false", light.ambient.x, light.ambient.y, light.ambient.z, light.ambient.w, light.diffuse.x, light.diffuse.y, light.diffuse.z, light.diffuse.w,
+			light.position.x, light.position.y, light.position.z, light.direction.x, light.direction.y, light.direction.z, light.dropoff, light.cutoff, i + 1 < scene.lights.size() ? "," : "");
+		output << line;
+	}
+	output << "\t],\n";
+
+	output << "\t\"instances\": [\n";
+	for (size_t i = 0; i < scene.instances.size(); i++)
+	{
+		const SceneInstance& instance = scene.instances[i];
+		snprintf(line, sizeof(line), "\t\t{ \"mesh\": \"%s\", \"position\": [%.9g, %.9g, %.9g], \"scale\": %.9g }%s\n", SceneFile::getMeshName((SceneMesh)instance.mesh),
+			instance.position.x, instance.position.y, instance.position.z, instance.scale, i + 1 < scene.instances.size() ? "," : "");
+		output << line;
+	}
+	output << "\t]\n}\n";
+	return output.good();
+}
+
+bool SceneJson::convert(const wchar_t* jsonFilename, const wchar_t* binaryFilename)
+{
+	SceneData scene;
+	if (!load(jsonFilename, scene))
+	{
+		return false;
+	}
+	return SceneFile::write(binaryFilename, scene);
+}
@@ -0,0 +1,21 @@
+// Text form of a scene, as JSON that can be edited by hand, and the converter from it to the binary SceneFile. Reading it parses every
+// value into a SceneData the way a general scene loader would, which the load benchmark measures the binary format against
+#pragma once
+
+#include "SceneFile.h"
+#include <string>
+
+using namespace std;
+
+class SceneJson
+{
+public:
+	// Parses a scene, skipping keys it doesn't know. Lights and instances of an unknown type or mesh are left out
+	static bool load(const wchar_t* filename, SceneData& scene);
+
+	// Writes a scene with one light or instance per line
+	static bool save(const wchar_t* filename, const SceneData& scene);
+
+	// Loads a text scene and writes it out as a binary one
+	static bool convert(const wchar_t* jsonFilename, const wchar_t* binaryFilename);
+};
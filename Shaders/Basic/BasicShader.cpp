@@ -1,8 +1,9 @@
 #include "BasicShader.h"
+#include "MemoryTracker.h"
 
-BasicShader::BasicShader(ID3D11Device* device, HWND hwnd) : BaseShader(device, hwnd)
+BasicShader::BasicShader(ID3D11Device* device, HWND hwnd, bool gpuDriven) : BaseShader(device, hwnd)
 {
-	initShader(L"basic_vs.cso", L"basic_ps.cso");
+	initShader(gpuDriven ? L"gpu_instance_vs.cso" : L"basic_vs.cso", L"basic_ps.cso");
 }
 
 BasicShader::~BasicShader()
@@ -42,7 +43,6 @@ BasicShader::~BasicShader()
 void BasicShader::initShader(const wchar_t* vsFilename, const wchar_t* psFilename)
 {
 	D3D11_BUFFER_DESC matrixBufferDesc;
-	D3D11_SAMPLER_DESC samplerDesc;
 	D3D11_BUFFER_DESC lightBufferDesc;
 	D3D11_BUFFER_DESC timeBufferDesc;
 
@@ -58,18 +58,10 @@ void BasicShader::initShader(const wchar_t* vsFilename, const wchar_t* psFilenam
 	matrixBufferDesc.MiscFlags = 0;
 	matrixBufferDesc.StructureByteStride = 0;
 	renderer->CreateBuffer(&matrixBufferDesc, NULL, &matrixBuffer);
+	MemoryTracker::track(matrixBuffer, MEMORY_CONSTANTS, "Basic matrices");
 
-	// Create a texture sampler state description.
-	samplerDesc.Filter = D3D11_FILTER_ANISOTROPIC;
-	samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_WRAP;
-	samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_WRAP;
-	samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_WRAP;
-	samplerDesc.MipLODBias = 0.0f;
-	samplerDesc.MaxAnisotropy = 1;
-	samplerDesc.ComparisonFunc = D3D11_COMPARISON_ALWAYS;
-	samplerDesc.MinLOD = 0;
-	samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
-	renderer->CreateSamplerState(&samplerDesc, &sampleState);
+	// The shared anisotropic, wrapping texture sampler
+	sampleState = StateCache::get()->getSamplerState(StateCache::anisotropicWrap());
 
 	// Create a buffer to store light information
 	lightBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
@@ -79,32 +71,24 @@ void BasicShader::initShader(const wchar_t* vsFilename, const wchar_t* psFilenam
 	lightBufferDesc.MiscFlags = 0;
 	lightBufferDesc.StructureByteStride = 0;
 	renderer->CreateBuffer(&lightBufferDesc, NULL, &lightBuffer);
+	MemoryTracker::track(lightBuffer, MEMORY_CONSTANTS, "Basic lights");
 }
 
-void BasicShader::setShaderParameters(ID3D11DeviceContext* deviceContext, const XMMATRIX& world, const XMMATRIX& view, const XMMATRIX& projection, ID3D11ShaderResourceView* meshTexture, ID3D11ShaderResourceView* shadowMap1, ID3D11ShaderResourceView* shadowMap2, Light* lights[], bool active[], float dropoff2, bool bumpMapping, float specInt, float specExp, Camera* cam, float cutOffAngle)
+void BasicShader::setShaderParameters(ID3D11DeviceContext* deviceContext, const XMMATRIX& world, const XMMATRIX& view, const XMMATRIX& projection, ID3D11ShaderResourceView* meshTexture, ID3D11ShaderResourceView* shadowAtlas, ID3D11ShaderResourceView* momentAtlas, Light* lights[], bool active[], float dropoff2, bool bumpMapping, float specInt, float specExp, Camera* cam, float cutOffAngle)
 {
-	HRESULT result;
-	D3D11_MAPPED_SUBRESOURCE mappedResource;
-	MatrixBufferType* dataPtr;
-
-	XMMATRIX tworld, tview, tproj;
-
-	// Transpose the matrices to prepare them for the shader.
-	tworld = XMMatrixTranspose(world);
-	tview = XMMatrixTranspose(view);
-	tproj = XMMatrixTranspose(projection);
-	result = deviceContext->Map(matrixBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
-	dataPtr = (MatrixBufferType*)mappedResource.pData;
-	dataPtr->world = tworld;
-	dataPtr->view = tview;
-	dataPtr->projection = tproj;
-	deviceContext->Unmap(matrixBuffer, 0);
-	deviceContext->VSSetConstantBuffers(0, 1, &matrixBuffer);
+	setFrameParameters(deviceContext, view, projection, shadowAtlas, momentAtlas, lights, active, dropoff2, bumpMapping, specInt, specExp, cam, cutOffAngle);
+	setObjectParameters(deviceContext, world, meshTexture);
+}
+
+void BasicShader::setFrameParameters(ID3D11DeviceContext* deviceContext, const XMMATRIX& view, const XMMATRIX& projection, ID3D11ShaderResourceView* shadowAtlas, ID3D11ShaderResourceView* momentAtlas, Light* lights[], bool active[], float dropoff2, bool bumpMapping, float specInt, float specExp, Camera* cam, float cutOffAngle)
+{
+	// Keeps the transposed view and projection for each object's matrix buffer
+	XMStoreFloat4x4(&viewMatrix, XMMatrixTranspose(view));
+	XMStoreFloat4x4(&projectionMatrix, XMMatrixTranspose(projection));
 
 	// Set light data and send buffer to the Pixel Shader
-	LightBufferType* lightPtr;
-	deviceContext->Map(lightBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
-	lightPtr = (LightBufferType*)mappedResource.pData;
+	LightBufferType lightData;
+	LightBufferType* lightPtr = &lightData;
 
 	// Set Directional Light attributes
 	lightPtr->ambient1 = lights[0]->getAmbientColour();
@@ -131,12 +115,33 @@ void BasicShader::setShaderParameters(ID3D11DeviceContext* deviceContext, const
 	lightPtr->active3 = active[2];
 	lightPtr->direction3 = lights[2]->getDirection();
 	lightPtr->cutoff = cutOffAngle;
-	deviceContext->Unmap(lightBuffer, 0);
-	deviceContext->PSSetConstantBuffers(0, 1, &lightBuffer);
-
-	// Set sampler and textures for use in the Pixel Shader
-	deviceContext->PSSetSamplers(0, 1, &sampleState);
-	deviceContext->PSSetShaderResources(0, 1, &meshTexture);
-	deviceContext->PSSetShaderResources(1, 1, &shadowMap1);
-	deviceContext->PSSetShaderResources(2, 1, &shadowMap2);
-}
\ No newline at end of file
+	ConstantRing::setConstants(constantRing, deviceContext, RING_STAGE_PS, 0, &lightData, sizeof(lightData), lightBuffer);
+
+	// Set sampler and shadow textures for use in the Pixel Shader
+	StateCache::get()->setSamplers(deviceContext, STAGE_PS, 0, 1, &sampleState);
+	StateCache::get()->setShaderResources(deviceContext, STAGE_PS, 1, 1, &shadowAtlas);
+	StateCache::get()->setShaderResources(deviceContext, STAGE_PS, 2, 1, &momentAtlas);
+}
+
+void BasicShader::setObjectParameters(ID3D11DeviceContext* deviceContext, const XMMATRIX& world, ID3D11ShaderResourceView* meshTexture)
+{
+	// Transpose the world matrix to prepare it for the shader, alongside the view and projection set for the frame
+	MatrixBufferType matrices;
+	matrices.world = XMMatrixTranspose(world);
+	matrices.view = XMLoadFloat4x4(&viewMatrix);
+	matrices.projection = XMLoadFloat4x4(&projectionMatrix);
+	ConstantRing::setConstants(constantRing, deviceContext, RING_STAGE_VS, 0, &matrices, sizeof(matrices), matrixBuffer);
+
+	StateCache::get()->setShaderResources(deviceContext, STAGE_PS, 0, 1, &meshTexture);
+}
+
+void BasicShader::bindStages(ID3D11DeviceContext* deviceContext)
+{
+	// Only the vertex and pixel shaders are loaded, so the stages in between are cleared of whatever the last shader left there
+	deviceContext->IASetInputLayout(layout);
+	deviceContext->VSSetShader(vertexShader, NULL, 0);
+	deviceContext->HSSetShader(NULL, NULL, 0);
+	deviceContext->DSSetShader(NULL, NULL, 0);
+	deviceContext->GSSetShader(NULL, NULL, 0);
+	deviceContext->PSSetShader(pixelShader, NULL, 0);
+}
@@ -1,6 +1,7 @@
 // Simple shader that calculates lighting and shadows only, does not Tessellate or manipulate the vertices in any way
 #pragma once
 #include "DXF.h"
+#include "ConstantRing.h"
 
 using namespace std;
 using namespace DirectX;
@@ -8,10 +9,21 @@ using namespace DirectX;
 class BasicShader : public BaseShader
 {
 public:
-	BasicShader(ID3D11Device* device, HWND hwnd);
+	// When gpuDriven is set, objects are instanced from the GpuDrivenScene's visible lists instead of using the world matrix
+	BasicShader(ID3D11Device* device, HWND hwnd, bool gpuDriven = false);
 	~BasicShader();
 
-	void setShaderParameters(ID3D11DeviceContext* deviceContext, const XMMATRIX& world, const XMMATRIX& view, const XMMATRIX& projection, ID3D11ShaderResourceView* meshTexture, ID3D11ShaderResourceView* shadowMap1, ID3D11ShaderResourceView* shadowMap2, Light* lights[], bool active[], float dropoff2, bool bumpMapping, float specInt, float specExp, Camera* cam, float cutOffAngle);
+	// Uploads the per draw constants through the frame's constant ring while one is set, and through this shader's own buffers otherwise
+	void setConstantRing(ConstantRing* ring) { constantRing = ring; }
+
+	// Sets everything for one draw. Drawing many objects in a row can set the lights and shadows once with setFrameParameters,
+	// then only each object's world matrix and texture with setObjectParameters
+	void setShaderParameters(ID3D11DeviceContext* deviceContext, const XMMATRIX& world, const XMMATRIX& view, const XMMATRIX& projection, ID3D11ShaderResourceView* meshTexture, ID3D11ShaderResourceView* shadowAtlas, ID3D11ShaderResourceView* momentAtlas, Light* lights[], bool active[], float dropoff2, bool bumpMapping, float specInt, float specExp, Camera* cam, float cutOffAngle);
+	void setFrameParameters(ID3D11DeviceContext* deviceContext, const XMMATRIX& view, const XMMATRIX& projection, ID3D11ShaderResourceView* shadowAtlas, ID3D11ShaderResourceView* momentAtlas, Light* lights[], bool active[], float dropoff2, bool bumpMapping, float specInt, float specExp, Camera* cam, float cutOffAngle);
+	void setObjectParameters(ID3D11DeviceContext* deviceContext, const XMMATRIX& world, ID3D11ShaderResourceView* meshTexture);
+
+	// Binds the input layout and shader stages without drawing anything, for callers that issue their own draws
+	void bindStages(ID3D11DeviceContext* deviceContext);
 
 private:
 
@@ -22,6 +34,11 @@ private:
 	ID3D11Buffer* matrixBuffer;
 	ID3D11SamplerState* sampleState;
 	ID3D11Buffer* lightBuffer;
+	ConstantRing* constantRing = 0;
+
+	// Transposed view and projection from the last setFrameParameters
+	XMFLOAT4X4 viewMatrix;
+	XMFLOAT4X4 projectionMatrix;
 
 	// Stores light values to calculate lighting
 	struct LightBufferType
@@ -4,10 +4,13 @@
 #include "light_h.hlsli"
 
 Texture2D meshTexture : register(t0);
-Texture2D shadowMap1 : register(t1);
-Texture2D shadowMap2 : register(t2);
+Texture2D shadowAtlas : register(t1);
+Texture2D momentAtlas : register(t2);
+Texture2DArray horizonMap : register(t5);
 
 SamplerState sampler0 : register(s0);
+SamplerState momentSampler : register(s1);
+SamplerState horizonSampler : register(s2);
 
 // Stores data on all three types of lights
 cbuffer LightBuffer : register(b0)
@@ -37,6 +40,37 @@ cbuffer LightBuffer : register(b0)
     
 };
 
+// Where each light's tile sits in the shadow atlas, the directional light's first, the spot light's second, then the point light's six faces
+cbuffer ShadowAtlasBuffer : register(b3)
+{
+    float4 shadowTileRects[8];
+};
+
+// How the shadows are filtered, holding the mode, light bleed reduction, moment bias and depth bias, then EVSM's exponents
+cbuffer ShadowFilterBuffer : register(b4)
+{
+    float4 shadowFilter;
+    float2 evsmExponents;
+    float2 padding4;
+};
+
+// Every face of the point light's cube shadow map, whose tiles follow the spot light's in the shadow atlas, and whether the point light casts shadows
+cbuffer PointShadowBuffer : register(b5)
+{
+    matrix pointFaceViewProjection[6];
+    float pointShadows;
+    float3 padding5;
+};
+
+// Whether the terrain shadows itself through the horizon map, how soft the edge is and how many world units the map covers
+cbuffer HorizonBuffer : register(b6)
+{
+    float horizonEnabled;
+    float horizonSoftness;
+    float horizonWorldSize;
+    float padding6;
+};
+
 struct InputType
 {
     float4 position : SV_POSITION;
@@ -59,13 +93,22 @@ float4 main(InputType input) : SV_TARGET
     textureColour = meshTexture.Sample(sampler0, input.tex);
     
     // Calculates shadows for the Directional Light, and also calculates regular directional lighting value
-    lightColour[0] = shadowCalculation(lightDirection1, diffuseColour1, ambientColour1, input.normal, input.lightViewPos1, shadowMap1, 0.005f, sampler0);
+    lightColour[0] = shadowCalculation(lightDirection1, diffuseColour1, ambientColour1, input.normal, input.lightViewPos1, shadowAtlas, momentAtlas, shadowTileRects[0], 0.005f, sampler0, momentSampler, shadowFilter, evsmExponents);
     
     // Calculates lighting value for the point light, as well as applying specular and attenuation values to affect those attributes
-    lightColour[1] = calculatePointLighting(lightPosition2, input.worldPosition, camPos, input.normal, diffuseColour2, ambientColour2, dropoff2, specIntensity, specExponent);
+    // When the point light casts shadows, they come from the face of its cube shadow map this pixel falls in
+    if (pointShadows)
+    {
+        int face = PointShadowFace(input.worldPosition - lightPosition2);
+        lightColour[1] = pointlightShadowCalculation(lightPosition2, input.worldPosition, camPos, input.normal, diffuseColour2, ambientColour2, dropoff2, specIntensity, specExponent, pointFaceViewProjection[face], shadowAtlas, momentAtlas, shadowTileRects[2 + face], 0.005f, sampler0, momentSampler, shadowFilter, evsmExponents);
+    }
+    else
+    {
+        lightColour[1] = calculatePointLighting(lightPosition2, input.worldPosition, camPos, input.normal, diffuseColour2, ambientColour2, dropoff2, specIntensity, specExponent);
+    }
     
     // Calcualtes shadows for the Spot Light, and also calculates lighting value
-    lightColour[2] = spotlightShadowCalculation(lightPosition3, -lightDirection3, input.worldPosition, input.lightViewPos2, input.normal, diffuseColour3, ambientColour3, cutoff, shadowMap2, 0.005f, sampler0, input.tex);
+    lightColour[2] = spotlightShadowCalculation(lightPosition3, -lightDirection3, input.worldPosition, input.lightViewPos2, input.normal, diffuseColour3, ambientColour3, cutoff, shadowAtlas, momentAtlas, shadowTileRects[1], 0.005f, sampler0, momentSampler, shadowFilter, evsmExponents, input.tex);
     
      // Spot light checks allow for other lights to function, so the cutoff feature doesn't apply to every light in the scene
     if (lightDirection3.x == 0 && lightDirection3.y == 0 && lightDirection3.z == 0)
@@ -77,6 +120,15 @@ float4 main(InputType input) : SV_TARGET
         lightColour[2] = float4(0, 0, 0, 1);
     }
 	
+    // The terrain shadows the Directional and Spot Light through the horizon map instead of the shadow maps while it is enabled
+    // Objects take the horizon of the ground beneath them, the Spot Light is treated as if it were further away than any ridge towards it
+    if (horizonEnabled)
+    {
+        float2 horizonUV = input.worldPosition.xz / horizonWorldSize;
+        lightColour[0].xyz *= HorizonVisibility(horizonMap, horizonSampler, horizonUV, -lightDirection1, horizonSoftness);
+        lightColour[2].xyz *= HorizonVisibility(horizonMap, horizonSampler, horizonUV, lightPosition3 - input.worldPosition, horizonSoftness);
+    }
+	
     // Checks if any of the lights are active, and if so, adds the colour to total colour variable
     for (int i = 0; i < 3; i++)
     {
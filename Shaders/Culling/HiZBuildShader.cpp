@@ -0,0 +1,224 @@
+#include "HiZBuildShader.h"
+#include "MemoryTracker.h"
+
+
+HiZBuildShader::HiZBuildShader(ID3D11Device* device, HWND hwnd, int width, int height) : BaseShader(device, hwnd)
+{
+	sourceWidth = width;
+	sourceHeight = height;
+	built = false;
+	XMStoreFloat4x4(&builtViewProjection, XMMatrixIdentity());
+	initShader(L"hiz_build_cs.cso", NULL);
+}
+
+
+HiZBuildShader::~HiZBuildShader()
+{
+	// Release the per level views
+	for (size_t i = 0; i < mipSRV.size(); i++)
+	{
+		mipSRV[i]->Release();
+		mipUAV[i]->Release();
+	}
+	mipSRV.clear();
+	mipUAV.clear();
+
+	// Release the pyramid and its read-back copies
+	if (pyramidSRV)
+	{
+		pyramidSRV->Release();
+		pyramidSRV = 0;
+	}
+	if (pyramid)
+	{
+		pyramid->Release();
+		pyramid = 0;
+	}
+	for (int i = 0; i < READBACK_LATENCY; i++)
+	{
+		if (staging[i])
+		{
+			staging[i]->Release();
+			staging[i] = 0;
+		}
+	}
+
+	// Release the size buffer
+	if (hiZBuffer)
+	{
+		hiZBuffer->Release();
+		hiZBuffer = 0;
+	}
+
+	//Release base shader components
+	BaseShader::~BaseShader();
+}
+
+void HiZBuildShader::initShader(const wchar_t* cfile, const wchar_t* blank)
+{
+	// Load (+ compile) shader file
+	loadComputeShader(cfile);
+
+	// Setup the description of the size buffer.
+	D3D11_BUFFER_DESC hiZBufferDesc;
+	hiZBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+	hiZBufferDesc.ByteWidth = sizeof(HiZBufferType);
+	hiZBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	hiZBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	hiZBufferDesc.MiscFlags = 0;
+	hiZBufferDesc.StructureByteStride = 0;
+	renderer->CreateBuffer(&hiZBufferDesc, NULL, &hiZBuffer);
+	MemoryTracker::track(hiZBuffer, MEMORY_CONSTANTS, "Hi-Z constants");
+
+	// The top level of the pyramid is half the size of the depth texture, and each level halves again down to a single texel
+	int width = max(1, sourceWidth / 2);
+	int height = max(1, sourceHeight / 2);
+	readbackMip = -1;
+	while (true)
+	{
+		mipWidth.push_back(width);
+		mipHeight.push_back(height);
+		if (readbackMip < 0 && width <= 128)
+		{
+			readbackMip = (int)mipWidth.size() - 1;
+		}
+		if (width == 1 && height == 1)
+		{
+			break;
+		}
+		width = max(1, width / 2);
+		height = max(1, height / 2);
+	}
+
+	D3D11_TEXTURE2D_DESC pyramidDesc;
+	ZeroMemory(&pyramidDesc, sizeof(pyramidDesc));
+	pyramidDesc.Width = mipWidth[0];
+	pyramidDesc.Height = mipHeight[0];
+	pyramidDesc.MipLevels = (UINT)mipWidth.size();
+	pyramidDesc.ArraySize = 1;
+	pyramidDesc.Format = DXGI_FORMAT_R32_FLOAT;
+	pyramidDesc.SampleDesc.Count = 1;
+	pyramidDesc.Usage = D3D11_USAGE_DEFAULT;
+	pyramidDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS;
+	renderer->CreateTexture2D(&pyramidDesc, NULL, &pyramid);
+	MemoryTracker::track(pyramid, MEMORY_RENDER_TARGET, "Hi-Z pyramid");
+	renderer->CreateShaderResourceView(pyramid, NULL, &pyramidSRV);
+
+	// Each level needs its own views, as it is written by one dispatch and read by the next
+	for (UINT mip = 0; mip < pyramidDesc.MipLevels; mip++)
+	{
+		D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
+		ZeroMemory(&srvDesc, sizeof(srvDesc));
+		srvDesc.Format = DXGI_FORMAT_R32_FLOAT;
+		srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+		srvDesc.Texture2D.MostDetailedMip = mip;
+		srvDesc.Texture2D.MipLevels = 1;
+		ID3D11ShaderResourceView* srv = 0;
+		renderer->CreateShaderResourceView(pyramid, &srvDesc, &srv);
+		mipSRV.push_back(srv);
+
+		D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc;
+		ZeroMemory(&uavDesc, sizeof(uavDesc));
+		uavDesc.Format = DXGI_FORMAT_R32_FLOAT;
+		uavDesc.ViewDimension = D3D11_UAV_DIMENSION_TEXTURE2D;
+		uavDesc.Texture2D.MipSlice = mip;
+		ID3D11UnorderedAccessView* uav = 0;
+		renderer->CreateUnorderedAccessView(pyramid, &uavDesc, &uav);
+		mipUAV.push_back(uav);
+	}
+
+	// Staging copies of the read-back level
+	D3D11_TEXTURE2D_DESC stagingDesc = pyramidDesc;
+	stagingDesc.Width = mipWidth[readbackMip];
+	stagingDesc.Height = mipHeight[readbackMip];
+	stagingDesc.MipLevels = 1;
+	stagingDesc.Usage = D3D11_USAGE_STAGING;
+	stagingDesc.BindFlags = 0;
+	stagingDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	for (int i = 0; i < READBACK_LATENCY; i++)
+	{
+		staging[i] = 0;
+		renderer->CreateTexture2D(&stagingDesc, NULL, &staging[i]);
+		MemoryTracker::track(staging[i], MEMORY_STAGING, "Hi-Z readback");
+		stagingWritten[i] = false;
+	}
+	stagingIndex = 0;
+}
+
+
+void HiZBuildShader::build(ID3D11DeviceContext* deviceContext, ID3D11ShaderResourceView* depthTexture, const XMMATRIX& viewProjection, int renderWidth, int renderHeight, float nearPlane, float farPlane)
+{
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	ID3D11ShaderResourceView* nullSRV = NULL;
+	ID3D11UnorderedAccessView* nullUAV = NULL;
+
+	for (size_t mip = 0; mip < mipWidth.size(); mip++)
+	{
+		// The first level reads the rendered region of the camera depth texture, every other level reads the whole of the one above it
+		ID3D11ShaderResourceView* source = mip == 0 ? depthTexture : mipSRV[mip - 1];
+		UINT width = mip == 0 ? (renderWidth > 0 ? min(renderWidth, sourceWidth) : sourceWidth) : mipWidth[mip - 1];
+		UINT height = mip == 0 ? (renderHeight > 0 ? min(renderHeight, sourceHeight) : sourceHeight) : mipHeight[mip - 1];
+
+		// Set the level sizes, and how to read the camera depth texture, and send to the Compute Shader
+		deviceContext->Map(hiZBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+		HiZBufferType* sizePtr = (HiZBufferType*)mappedResource.pData;
+		sizePtr->sourceSize[0] = width;
+		sizePtr->sourceSize[1] = height;
+		sizePtr->destinationSize[0] = mipWidth[mip];
+		sizePtr->destinationSize[1] = mipHeight[mip];
+		sizePtr->depthRange[0] = nearPlane;
+		sizePtr->depthRange[1] = farPlane;
+		sizePtr->linearSource = mip == 0 && farPlane > 0.0f ? 1.0f : 0.0f;
+		sizePtr->padding = 0.0f;
+		deviceContext->Unmap(hiZBuffer, 0);
+		deviceContext->CSSetConstantBuffers(0, 1, &hiZBuffer);
+
+		deviceContext->CSSetShaderResources(0, 1, &source);
+		deviceContext->CSSetUnorderedAccessViews(0, 1, &mipUAV[mip], 0);
+		compute(deviceContext, (mipWidth[mip] + 7) / 8, (mipHeight[mip] + 7) / 8, 1);
+
+		// Unbind so this level can be read by the next dispatch
+		deviceContext->CSSetShaderResources(0, 1, &nullSRV);
+		deviceContext->CSSetUnorderedAccessViews(0, 1, &nullUAV, 0);
+	}
+	deviceContext->CSSetShader(NULL, NULL, 0);
+
+	// Queue the read-back level for copying to the CPU, remembering which view it was rendered from
+	deviceContext->CopySubresourceRegion(staging[stagingIndex], 0, 0, 0, 0, pyramid, readbackMip, NULL);
+	XMStoreFloat4x4(&stagingViewProjection[stagingIndex], viewProjection);
+	stagingWritten[stagingIndex] = true;
+	stagingIndex = (stagingIndex + 1) % READBACK_LATENCY;
+
+	XMStoreFloat4x4(&builtViewProjection, viewProjection);
+	built = true;
+}
+
+bool HiZBuildShader::readback(ID3D11DeviceContext* deviceContext, HiZBuffer& hiZ, XMMATRIX& viewProjection)
+{
+	// The oldest copy is the one about to be overwritten, and has had the most time to finish on the GPU
+	if (!stagingWritten[stagingIndex])
+	{
+		return false;
+	}
+
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	if (deviceContext->Map(staging[stagingIndex], 0, D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &mappedResource) != S_OK)
+	{
+		return false;
+	}
+	hiZ.build((const float*)mappedResource.pData, mipWidth[readbackMip], mipHeight[readbackMip], mappedResource.RowPitch / sizeof(float));
+	deviceContext->Unmap(staging[stagingIndex], 0);
+
+	viewProjection = XMLoadFloat4x4(&stagingViewProjection[stagingIndex]);
+	stagingWritten[stagingIndex] = false;
+	return true;
+}
+
+void HiZBuildShader::invalidateGpuState()
+{
+	for (int i = 0; i < READBACK_LATENCY; i++)
+	{
+		stagingWritten[i] = false;
+	}
+	built = false;
+}
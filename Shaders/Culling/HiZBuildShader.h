@@ -0,0 +1,78 @@
+// Builds a Hi-Z pyramid from the camera depth texture on the GPU, then reads a small level of it back a few frames later without stalling
+#pragma once
+
+#include "DXF.h"
+#include "HiZBuffer.h"
+#include <vector>
+
+using namespace std;
+using namespace DirectX;
+
+class HiZBuildShader : public BaseShader
+{
+private:
+
+	// Stores the size of the region of the level being read and the size of the level being written, and the near and far planes
+	// of a linear depth source
+	struct HiZBufferType
+	{
+		UINT sourceSize[2];
+		UINT destinationSize[2];
+		float depthRange[2];
+		float linearSource;
+		float padding;
+	};
+
+public:
+
+	HiZBuildShader(ID3D11Device* device, HWND hwnd, int width, int height);
+	~HiZBuildShader();
+
+	// Downsamples the depth texture into every level of the pyramid, and queues the read-back level for copying to the CPU
+	// When the depth was only rendered to the top left renderWidth x renderHeight of the texture, that region is stretched over the whole pyramid
+	// A far plane above zero means the texture holds linear depth between nearPlane and farPlane, which the first level turns back into z / w
+	void build(ID3D11DeviceContext* deviceContext, ID3D11ShaderResourceView* depthTexture, const XMMATRIX& viewProjection, int renderWidth = 0, int renderHeight = 0, float nearPlane = 0.0f, float farPlane = 0.0f);
+
+	// Copies the oldest finished read-back into the Hi-Z buffer, along with the matrix it was rendered with. Returns false if none are ready yet
+	bool readback(ID3D11DeviceContext* deviceContext, HiZBuffer& hiZ, XMMATRIX& viewProjection);
+
+	// For when something else has written over the pyramid and its read-backs, such as a replayed command trace. Drops the read-backs still
+	// waiting, and the pyramid counts as unbuilt until the next build
+	void invalidateGpuState();
+
+	ID3D11ShaderResourceView* getShaderResourceView() { return pyramidSRV; }
+
+	// Size of the top level and number of levels, and the view the pyramid was last built from, for testing against it on the GPU
+	int getWidth() const { return mipWidth[0]; }
+	int getHeight() const { return mipHeight[0]; }
+	int getMipCount() const { return (int)mipWidth.size(); }
+	bool hasBuilt() const { return built; }
+	XMMATRIX getBuiltViewProjection() const { return XMLoadFloat4x4(&builtViewProjection); }
+
+private:
+	void initShader(const wchar_t* cfile, const wchar_t* blank);
+
+private:
+	static const int READBACK_LATENCY = 3;
+
+	ID3D11Buffer* hiZBuffer;
+	ID3D11Texture2D* pyramid;
+	ID3D11ShaderResourceView* pyramidSRV;
+	vector<ID3D11ShaderResourceView*> mipSRV;
+	vector<ID3D11UnorderedAccessView*> mipUAV;
+	vector<int> mipWidth;
+	vector<int> mipHeight;
+	int sourceWidth;
+	int sourceHeight;
+
+	// The first level no larger than 128 texels across is copied back, the CPU builds the coarser levels itself
+	int readbackMip;
+	ID3D11Texture2D* staging[READBACK_LATENCY];
+	XMFLOAT4X4 stagingViewProjection[READBACK_LATENCY];
+	bool stagingWritten[READBACK_LATENCY];
+	int stagingIndex;
+	vector<float> readbackDepth;
+
+	bool built;
+	XMFLOAT4X4 builtViewProjection;
+};
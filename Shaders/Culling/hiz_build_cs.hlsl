@@ -0,0 +1,48 @@
+// Hi-Z Build Compute Shader
+// Downsamples a depth image into the next level of the Hi-Z pyramid, keeping the furthest depth of the texels each output covers
+
+Texture2D<float4> sourceDepth : register(t0);
+RWTexture2D<float> destination : register(u0);
+
+// Stores the size of the region of the level being read and the size of the level being written, and the near and far planes of a linear depth source
+cbuffer HiZBuffer : register(b0)
+{
+    uint2 sourceSize;
+    uint2 destinationSize;
+    float2 depthRange;
+    float linearSource;
+    float padding;
+};
+
+[numthreads(8, 8, 1)]
+void main(uint3 dispatchThreadID : SV_DispatchThreadID)
+{
+    if (dispatchThreadID.x >= destinationSize.x || dispatchThreadID.y >= destinationSize.y)
+    {
+        return;
+    }
+    
+    // Covers every source texel that overlaps this output, which is a 2x2 block when halving an even sized level, takes in the leftover texel
+    // of an odd sized one, and shrinks towards a single texel when a reduced resolution region is stretched over the pyramid, so no depth is ever skipped
+    uint2 first = dispatchThreadID.xy * sourceSize / destinationSize;
+    uint2 last = max(first, ((dispatchThreadID.xy + 1) * sourceSize + destinationSize - 1) / destinationSize - 1);
+    
+    float furthest = 0.0f;
+    for (uint y = first.y; y <= last.y; y++)
+    {
+        for (uint x = first.x; x <= last.x; x++)
+        {
+            // The camera depth texture is cleared to zero, which means nothing was drawn there so it counts as the far plane
+            float depth = sourceDepth.Load(int3(min(uint2(x, y), sourceSize - 1), 0)).x;
+            if (depth > 0.0f && linearSource)
+            {
+                // Turns linear camera depth back into z / w, so the pyramid is compared against projected bounds as before
+                float viewZ = depthRange.x + depth * (depthRange.y - depthRange.x);
+                depth = depthRange.y / (depthRange.y - depthRange.x) * (1.0f - depthRange.x / viewZ);
+            }
+            furthest = max(furthest, depth > 0.0f ? depth : 1.0f);
+        }
+    }
+    
+    destination[dispatchThreadID.xy] = furthest;
+}
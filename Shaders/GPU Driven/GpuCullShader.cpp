@@ -0,0 +1,109 @@
+#include "GpuCullShader.h"
+#include "MemoryTracker.h"
+
+
+GpuCullShader::GpuCullShader(ID3D11Device* device, HWND hwnd) : BaseShader(device, hwnd)
+{
+	initShader(L"gpu_cull_cs.cso", NULL);
+}
+
+
+GpuCullShader::~GpuCullShader()
+{
+	// Release the cull constant buffer
+	if (cullBuffer)
+	{
+		cullBuffer->Release();
+		cullBuffer = 0;
+	}
+
+	//Release base shader components
+	BaseShader::~BaseShader();
+}
+
+void GpuCullShader::initShader(const wchar_t* cfile, const wchar_t* blank)
+{
+	// Load (+ compile) shader file
+	loadComputeShader(cfile);
+
+	// Setup the description of the cull constant buffer.
+	D3D11_BUFFER_DESC cullBufferDesc;
+	cullBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+	cullBufferDesc.ByteWidth = sizeof(CullBufferType);
+	cullBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	cullBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	cullBufferDesc.MiscFlags = 0;
+	cullBufferDesc.StructureByteStride = 0;
+	renderer->CreateBuffer(&cullBufferDesc, NULL, &cullBuffer);
+	MemoryTracker::track(cullBuffer, MEMORY_CONSTANTS, "GPU cull constants");
+}
+
+void GpuCullShader::cull(ID3D11DeviceContext* deviceContext, GpuDrivenScene* scene, int view, const XMMATRIX& viewProjection, const XMFLOAT3& lodPosition, int maxTessFactor, const XMFLOAT4& lodDistances, HiZBuildShader* hiZ, const XMMATRIX& hiZViewProjection)
+{
+	if (scene->getRecordCount() == 0)
+	{
+		return;
+	}
+
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	deviceContext->Map(cullBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+	CullBufferType* cullPtr = (CullBufferType*)mappedResource.pData;
+
+	// Transpose the matrices to prepare them for the shader.
+	cullPtr->viewProjection = XMMatrixTranspose(viewProjection);
+	cullPtr->hiZViewProjection = XMMatrixTranspose(hiZViewProjection);
+
+	// Extract the six frustum planes from the columns of the view projection matrix (left, right, bottom, top, near, far)
+	XMMATRIX columns = XMMatrixTranspose(viewProjection);
+	XMVECTOR planes[6] =
+	{
+		XMVectorAdd(columns.r[3], columns.r[0]),
+		XMVectorSubtract(columns.r[3], columns.r[0]),
+		XMVectorAdd(columns.r[3], columns.r[1]),
+		XMVectorSubtract(columns.r[3], columns.r[1]),
+		columns.r[2],
+		XMVectorSubtract(columns.r[3], columns.r[2])
+	};
+	for (int i = 0; i < 6; i++)
+	{
+		XMStoreFloat4(&cullPtr->frustumPlanes[i], XMPlaneNormalize(planes[i]));
+	}
+
+	// Set where this view's lists and arguments live
+	cullPtr->lodPosition = lodPosition;
+	cullPtr->recordCount = scene->getRecordCount();
+	cullPtr->patchCount = scene->getPatchCount();
+	cullPtr->patchListOffset = scene->getPatchListOffset(view);
+	cullPtr->objectListOffset = scene->getObjectListOffset(view);
+	cullPtr->argumentsOffset = scene->getArgumentsOffset(view);
+	cullPtr->objectCapacity = scene->getObjectCapacity();
+	cullPtr->maxTessFactor = (float)maxTessFactor;
+	cullPtr->lodDistances = lodDistances;
+
+	// The hull shader picks the patches' edge factors from the same settings, so neighbours agree on the edges they share
+	scene->setPatchLod(lodPosition, (float)maxTessFactor, lodDistances.z, lodDistances.w);
+
+	// The Hi-Z pyramid only describes the camera's view, so other views pass none
+	cullPtr->useHiZ = hiZ ? 1.0f : 0.0f;
+	cullPtr->hiZMipCount = hiZ ? (float)hiZ->getMipCount() : 0.0f;
+	cullPtr->hiZSize = hiZ ? XMFLOAT2((float)hiZ->getWidth(), (float)hiZ->getHeight()) : XMFLOAT2(0.0f, 0.0f);
+	cullPtr->padding = XMFLOAT2(0.0f, 0.0f);
+	deviceContext->Unmap(cullBuffer, 0);
+	deviceContext->CSSetConstantBuffers(0, 1, &cullBuffer);
+
+	// Set the records, the pyramid, and the lists and arguments to append to
+	ID3D11ShaderResourceView* shaderResources[2] = { scene->getRecordSRV(), hiZ ? hiZ->getShaderResourceView() : NULL };
+	ID3D11UnorderedAccessView* unorderedAccess[2] = { scene->getVisibleUAV(), scene->getArgumentsUAV() };
+	deviceContext->CSSetShaderResources(0, 2, shaderResources);
+	deviceContext->CSSetUnorderedAccessViews(0, 2, unorderedAccess, 0);
+
+	// One thread per record
+	compute(deviceContext, (scene->getRecordCount() + 63) / 64, 1, 1);
+
+	// Unbind so the lists and arguments can be drawn from
+	ID3D11ShaderResourceView* nullSRV[2] = { NULL, NULL };
+	ID3D11UnorderedAccessView* nullUAV[2] = { NULL, NULL };
+	deviceContext->CSSetShaderResources(0, 2, nullSRV);
+	deviceContext->CSSetUnorderedAccessViews(0, 2, nullUAV, 0);
+	deviceContext->CSSetShader(NULL, NULL, 0);
+}
@@ -0,0 +1,50 @@
+// Culls the GpuDrivenScene's records for one view on the GPU, choosing each one's level of detail and filling that view's indirect draw arguments
+#pragma once
+
+#include "DXF.h"
+#include "GpuDrivenScene.h"
+#include "HiZBuildShader.h"
+
+using namespace std;
+using namespace DirectX;
+
+class GpuCullShader : public BaseShader
+{
+private:
+
+	// Stores the view being culled, where its lists and arguments live, and the level of detail settings
+	struct CullBufferType
+	{
+		XMMATRIX viewProjection;
+		XMMATRIX hiZViewProjection;
+		XMFLOAT4 frustumPlanes[6];
+		XMFLOAT3 lodPosition;
+		UINT recordCount;
+		UINT patchCount;
+		UINT patchListOffset;
+		UINT objectListOffset;
+		UINT argumentsOffset;
+		UINT objectCapacity;
+		float maxTessFactor;
+		float useHiZ;
+		float hiZMipCount;
+		XMFLOAT4 lodDistances;
+		XMFLOAT2 hiZSize;
+		XMFLOAT2 padding;
+	};
+
+public:
+
+	GpuCullShader(ID3D11Device* device, HWND hwnd);
+	~GpuCullShader();
+
+	// Culls every record against the view, and against the Hi-Z pyramid too if one is given. lodDistances holds the two object
+	// level switches (in multiples of the object's radius) followed by the distances patches start and finish dropping tessellation
+	void cull(ID3D11DeviceContext* deviceContext, GpuDrivenScene* scene, int view, const XMMATRIX& viewProjection, const XMFLOAT3& lodPosition, int maxTessFactor, const XMFLOAT4& lodDistances, HiZBuildShader* hiZ, const XMMATRIX& hiZViewProjection);
+
+private:
+	void initShader(const wchar_t* cfile, const wchar_t* blank);
+
+private:
+	ID3D11Buffer* cullBuffer;
+};
@@ -0,0 +1,124 @@
+// GPU Culling Compute Shader
+// Tests every patch and object record against one view's frustum (and the Hi-Z pyramid for the camera), picks a level of detail,
+// and appends the visible ones to that view's instance lists, counting them straight into the indirect draw arguments
+#include "gpu_records_h.hlsli"
+
+StructuredBuffer<DrawRecord> records : register(t0);
+Texture2D<float> hiZ : register(t1);
+RWStructuredBuffer<uint> visibleInstances : register(u0);
+RWByteAddressBuffer drawArguments : register(u1);
+
+// Stores the view being culled, where its lists and arguments live, and the level of detail settings
+cbuffer CullBuffer : register(b0)
+{
+    matrix viewProjection;
+    matrix hiZViewProjection;
+    float4 frustumPlanes[6];
+    float3 lodPosition;
+    uint recordCount;
+    uint patchCount;
+    uint patchListOffset;
+    uint objectListOffset;
+    uint argumentsOffset;
+    uint objectCapacity;
+    float maxTessFactor;
+    float useHiZ;
+    float hiZMipCount;
+    float4 lodDistances;
+    float2 hiZSize;
+    float2 padding;
+};
+
+// Size in bytes of one set of DrawIndexedInstancedIndirect arguments
+static const uint ARGUMENTS_STRIDE = 20;
+
+// Returns true if the box is entirely behind any of the frustum's planes
+bool OutsideFrustum(float3 center, float3 extents)
+{
+    for (int i = 0; i < 6; i++)
+    {
+        float distance = dot(frustumPlanes[i].xyz, center) + frustumPlanes[i].w;
+        float radius = dot(extents, abs(frustumPlanes[i].xyz));
+        if (distance + radius < 0.0f)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Returns true if the box's nearest depth is behind the furthest depth of the Hi-Z texels covering it
+bool Occluded(float3 center, float3 extents)
+{
+    float3 ndcMin = float3(1e30f, 1e30f, 1e30f);
+    float3 ndcMax = float3(-1e30f, -1e30f, -1e30f);
+    [unroll]
+    for (uint corner = 0; corner < 8; corner++)
+    {
+        float3 direction = float3((corner & 1) ? 1.0f : -1.0f, (corner & 2) ? 1.0f : -1.0f, (corner & 4) ? 1.0f : -1.0f);
+        float4 clip = mul(float4(center + extents * direction, 1.0f), hiZViewProjection);
+
+        // Boxes crossing the camera plane can't be projected safely, so they are always drawn
+        if (clip.w <= 1e-4f)
+        {
+            return false;
+        }
+        float3 ndc = clip.xyz / clip.w;
+        ndcMin = min(ndcMin, ndc);
+        ndcMax = max(ndcMax, ndc);
+    }
+
+    // Picks the level where the rectangle covers no more than two texels along each side, and takes the furthest of those texels
+    float2 uvMin = saturate(float2(ndcMin.x * 0.5f + 0.5f, 0.5f - ndcMax.y * 0.5f));
+    float2 uvMax = saturate(float2(ndcMax.x * 0.5f + 0.5f, 0.5f - ndcMin.y * 0.5f));
+    float2 size = (uvMax - uvMin) * hiZSize;
+    uint mip = (uint)clamp(ceil(log2(max(max(size.x, size.y), 1.0f))), 0.0f, hiZMipCount - 1.0f);
+    uint2 mipSize = max((uint2)hiZSize >> mip, 1);
+    int2 texelMin = (int2)min((uint2)(uvMin * mipSize), mipSize - 1);
+    int2 texelMax = (int2)min((uint2)(uvMax * mipSize), mipSize - 1);
+
+    float furthest = max(max(hiZ.Load(int3(texelMin, mip)), hiZ.Load(int3(texelMax.x, texelMin.y, mip))),
+                         max(hiZ.Load(int3(texelMin.x, texelMax.y, mip)), hiZ.Load(int3(texelMax, mip))));
+    return ndcMin.z > furthest;
+}
+
+[numthreads(64, 1, 1)]
+void main(uint3 dispatchThreadID : SV_DispatchThreadID)
+{
+    uint index = dispatchThreadID.x;
+    if (index >= recordCount)
+    {
+        return;
+    }
+
+    DrawRecord record = records[index];
+    if (OutsideFrustum(record.center, record.extents))
+    {
+        return;
+    }
+    if (useHiZ > 0.0f && Occluded(record.center, record.extents))
+    {
+        return;
+    }
+
+    // Level of detail is always chosen from the camera, so shadows match what is drawn on screen
+    float distance = length(record.center - lodPosition);
+    uint slot;
+    if (index < patchCount)
+    {
+        // Patches tessellate less the further they are between the near and far distances. This is only the inside factor, as the hull
+        // shader works out each edge's factor from the edge itself so that neighbouring patches agree
+        float blend = saturate((distance - lodDistances.z) / max(lodDistances.w - lodDistances.z, 1e-3f));
+        float tessFactor = lerp(maxTessFactor, 1.0f, blend);
+        drawArguments.InterlockedAdd(argumentsOffset + 4, 1, slot);
+        visibleInstances[patchListOffset + slot] = PackPatchInstance(index, tessFactor);
+    }
+    else
+    {
+        // Objects drop a level each time their distance, measured in multiples of their radius, passes the next threshold
+        float relativeDistance = distance / max(record.radius, 1e-3f);
+        uint lod = relativeDistance < lodDistances.x ? 0 : (relativeDistance < lodDistances.y ? 1 : 2);
+        drawArguments.InterlockedAdd(argumentsOffset + (lod + 1) * ARGUMENTS_STRIDE + 4, 1, slot);
+        visibleInstances[objectListOffset + lod * objectCapacity + slot] = index;
+    }
+}
@@ -0,0 +1,62 @@
+// GPU Driven Instance Vertex Shader
+// Same as the basic vertex shader, except each instance's position and scale come from its record in the visible list
+
+#include "gpu_records_h.hlsli"
+
+StructuredBuffer<DrawRecord> records : register(t0);
+StructuredBuffer<uint> visibleInstances : register(t1);
+
+// Stores matrix data, the world matrix is unused as each record places its own instance
+cbuffer MatrixBuffer : register(b0)
+{
+    matrix worldMatrix;
+    matrix viewMatrix;
+    matrix projectionMatrix;
+};
+
+// Stores where this view and level of detail's visible objects start. The rest is the patch hull shader's
+cbuffer InstanceBuffer : register(b1)
+{
+    uint listOffset;
+    float planeResolution;
+    float maxTessFactor;
+    float lodNear;
+    float3 lodPosition;
+    float lodFar;
+};
+
+struct InputType
+{
+    float4 position : POSITION;
+    float2 tex : TEXCOORD0;
+    float3 normal : NORMAL;
+};
+
+struct OutputType
+{
+    float4 position : SV_POSITION;
+    float2 tex : TEXCOORD0;
+    float3 normal : NORMAL;
+    float3 worldPosition : TEXCOORD1;
+};
+
+OutputType main(InputType input, uint instanceID : SV_InstanceID)
+{
+    OutputType output;
+
+    // Scales the unit mesh by the record's radius and moves it to the record's centre
+    DrawRecord record = records[visibleInstances[listOffset + instanceID]];
+    output.worldPosition = input.position.xyz * record.radius + record.center;
+
+    // Calculate the position of the vertex against the view and projection matrices
+    output.position = mul(float4(output.worldPosition, 1.0f), viewMatrix);
+    output.position = mul(output.position, projectionMatrix);
+
+    // Store the texture coordinates for the pixel shader.
+    output.tex = input.tex;
+
+    // The scale is uniform, so the normal is unchanged
+    output.normal = normalize(input.normal);
+
+    return output;
+}
@@ -0,0 +1,85 @@
+// GPU Driven Patch Hull Shader
+// Same as the tessellation quad hull shader, except the tessellation factors come from the patch's level of detail rather than a constant.
+// The inside factor is the one the culling shader chose for the whole patch, but each edge's factor is worked out from the edge's own
+// midpoint, so two patches at different levels of detail split the edge they share the same way and the displaced terrain doesn't crack
+
+// Stores the level of detail settings the culling shader chose the patch's factor with
+cbuffer InstanceBuffer : register(b1)
+{
+    uint listOffset;
+    float planeResolution;
+    float maxTessFactor;
+    float lodNear;
+    float3 lodPosition;
+    float lodFar;
+};
+
+struct InputType
+{
+    float3 position : POSITION;
+    float2 tex : TEXCOORD0;
+    float3 normal : NORMAL;
+    float tessFactor : TEXCOORD1;
+};
+
+struct ConstantOutputType
+{
+    float edges[4] : SV_TessFactor;
+    float inside[2] : SV_InsideTessFactor;
+};
+
+struct OutputType
+{
+    float3 position : POSITION;
+    float2 tex : TEXCOORD0;
+    float3 normal : NORMAL;
+};
+
+// Tessellates less the further the edge's midpoint is between the near and far distances, as the culling shader does for the patch.
+// Both patches sharing the edge pass the same two corners, though each offsets them from its own origin, so the midpoint is snapped to a
+// quarter unit to keep any rounding in that from giving the two patches different factors
+float EdgeTessFactor(float3 corner0, float3 corner1)
+{
+    float3 midpoint = round((corner0 + corner1) * 2.0f) * 0.25f;
+    float blend = saturate((length(midpoint - lodPosition) - lodNear) / max(lodFar - lodNear, 1e-3f));
+    return clamp(round(lerp(maxTessFactor, 1.0f, blend)), 1.0f, 64.0f);
+}
+
+ConstantOutputType PatchConstantFunction(InputPatch<InputType, 4> inputPatch, uint patchId : SV_PrimitiveID)
+{
+    ConstantOutputType output;
+
+    // Every control point of a patch carries the same factor
+    float tessFactor = inputPatch[0].tessFactor;
+
+    // Set the tessellation factors for the four edges of the quad, in the order the domain shader lays the corners out: u = 0 runs from
+    // corner 0 to 1, v = 0 from 0 to 3, u = 1 from 3 to 2 and v = 1 from 1 to 2
+    output.edges[0] = EdgeTessFactor(inputPatch[0].position, inputPatch[1].position);
+    output.edges[1] = EdgeTessFactor(inputPatch[0].position, inputPatch[3].position);
+    output.edges[2] = EdgeTessFactor(inputPatch[3].position, inputPatch[2].position);
+    output.edges[3] = EdgeTessFactor(inputPatch[1].position, inputPatch[2].position);
+
+    // Set the tessellation factor for tessallating inside the quad
+    output.inside[0] = tessFactor;
+    output.inside[1] = tessFactor;
+
+    return output;
+}
+
+[domain("quad")]
+[partitioning("integer")]
+[outputtopology("triangle_ccw")]
+[outputcontrolpoints(4)]
+[patchconstantfunc("PatchConstantFunction")]
+[maxtessfactor(64.0f)]
+OutputType main(InputPatch<InputType, 4> patch, uint pointId : SV_OutputControlPointID, uint patchId : SV_PrimitiveID)
+{
+    OutputType output;
+
+    // Passes the control point through unchanged
+    output.tex = patch[pointId].tex;
+    output.normal = patch[pointId].normal;
+    output.position = patch[pointId].position;
+
+    return output;
+}
@@ -0,0 +1,51 @@
+// GPU Driven Patch Vertex Shader
+// Places a copy of the first terrain patch at each visible patch's position, and passes on the tessellation factor the culling shader chose for it
+#include "gpu_records_h.hlsli"
+
+StructuredBuffer<DrawRecord> records : register(t0);
+StructuredBuffer<uint> visibleInstances : register(t1);
+
+// Stores where this view's visible patches start, and the plane's resolution for offsetting the texture coordinates. The level of detail
+// settings are read by the hull shader
+cbuffer InstanceBuffer : register(b1)
+{
+    uint listOffset;
+    float planeResolution;
+    float maxTessFactor;
+    float lodNear;
+    float3 lodPosition;
+    float lodFar;
+};
+
+struct InputType
+{
+    float3 position : POSITION;
+    float2 tex : TEXCOORD0;
+    float3 normal : NORMAL;
+};
+
+struct OutputType
+{
+    float3 position : POSITION;
+    float2 tex : TEXCOORD0;
+    float3 normal : NORMAL;
+    float tessFactor : TEXCOORD1;
+};
+
+OutputType main(InputType input, uint instanceID : SV_InstanceID)
+{
+    OutputType output;
+
+    // Finds the patch this instance draws, whose corner is the bottom of its bounding box
+    uint entry = visibleInstances[listOffset + instanceID];
+    DrawRecord record = records[PatchRecordIndex(entry)];
+    float2 origin = round(record.center.xz - record.extents.xz);
+
+    // Moves the control point to the patch, offsetting the texture coordinates to match
+    output.position = input.position + float3(origin.x, 0.0f, origin.y);
+    output.tex = input.tex + origin / planeResolution;
+    output.normal = input.normal;
+    output.tessFactor = PatchTessFactor(entry);
+
+    return output;
+}
@@ -0,0 +1,105 @@
+// Sphere mesh with levels of detail, built as latitude/longitude spheres of decreasing slice counts
+#include "LodSphereMesh.h"
+#include "MemoryTracker.h"
+
+LodSphereMesh::LodSphereMesh(ID3D11Device* device, ID3D11DeviceContext* deviceContext, int lslices, int llodCount)
+{
+	slices = lslices;
+	lodLevels = llodCount;
+	initBuffers(device);
+}
+
+// Release resources.
+LodSphereMesh::~LodSphereMesh()
+{
+	// Run parent deconstructor
+	BaseMesh::~BaseMesh();
+}
+
+void LodSphereMesh::initBuffers(ID3D11Device* device)
+{
+	vector<VertexType> vertices;
+	vector<unsigned long> indices;
+	D3D11_BUFFER_DESC vertexBufferDesc, indexBufferDesc;
+	D3D11_SUBRESOURCE_DATA vertexData, indexData;
+
+	lodIndexStart.clear();
+	lodIndexCount.clear();
+	lodBaseVertex.clear();
+
+	for (int lod = 0; lod < lodLevels; lod++)
+	{
+		// Each level halves the slices, down to a minimum of four
+		int lodSlices = max(4, slices >> lod);
+		int stacks = max(2, lodSlices / 2);
+
+		lodBaseVertex.push_back((int)vertices.size());
+		lodIndexStart.push_back((int)indices.size());
+
+		// Rings of vertices from the top of the sphere to the bottom, duplicating the seam so the texture wraps cleanly
+		for (int stack = 0; stack <= stacks; stack++)
+		{
+			float phi = XM_PI * stack / stacks;
+			for (int slice = 0; slice <= lodSlices; slice++)
+			{
+				float theta = XM_2PI * slice / lodSlices;
+				VertexType vertex;
+				vertex.normal = XMFLOAT3(sinf(phi) * cosf(theta), cosf(phi), sinf(phi) * sinf(theta));
+				vertex.position = vertex.normal;
+				vertex.texture = XMFLOAT2((float)slice / lodSlices, (float)stack / stacks);
+				vertices.push_back(vertex);
+			}
+		}
+
+		// Two triangles between each pair of rings, relative to this level's base vertex
+		for (int stack = 0; stack < stacks; stack++)
+		{
+			for (int slice = 0; slice < lodSlices; slice++)
+			{
+				unsigned long topLeft = stack * (lodSlices + 1) + slice;
+				unsigned long bottomLeft = topLeft + lodSlices + 1;
+				indices.push_back(topLeft);
+				indices.push_back(topLeft + 1);
+				indices.push_back(bottomLeft);
+				indices.push_back(topLeft + 1);
+				indices.push_back(bottomLeft + 1);
+				indices.push_back(bottomLeft);
+			}
+		}
+
+		lodIndexCount.push_back((int)indices.size() - lodIndexStart.back());
+	}
+
+	vertexCount = (int)vertices.size();
+	indexCount = lodIndexCount[0];
+
+	// Set up the description of the static vertex buffer.
+	vertexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
+	vertexBufferDesc.ByteWidth = sizeof(VertexType) * vertexCount;
+	vertexBufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	vertexBufferDesc.CPUAccessFlags = 0;
+	vertexBufferDesc.MiscFlags = 0;
+	vertexBufferDesc.StructureByteStride = 0;
+	// Give the subresource structure a pointer to the vertex data.
+	vertexData.pSysMem = vertices.data();
+	vertexData.SysMemPitch = 0;
+	vertexData.SysMemSlicePitch = 0;
+	// Now create the vertex buffer.
+	device->CreateBuffer(&vertexBufferDesc, &vertexData, &vertexBuffer);
+	MemoryTracker::track(vertexBuffer, MEMORY_GEOMETRY, "LOD sphere vertices");
+
+	// Set up the description of the static index buffer.
+	indexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
+	indexBufferDesc.ByteWidth = sizeof(unsigned long) * (UINT)indices.size();
+	indexBufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
+	indexBufferDesc.CPUAccessFlags = 0;
+	indexBufferDesc.MiscFlags = 0;
+	indexBufferDesc.StructureByteStride = 0;
+	// Give the subresource structure a pointer to the index data.
+	indexData.pSysMem = indices.data();
+	indexData.SysMemPitch = 0;
+	indexData.SysMemSlicePitch = 0;
+	// Create the index buffer.
+	device->CreateBuffer(&indexBufferDesc, &indexData, &indexBuffer);
+	MemoryTracker::track(indexBuffer, MEMORY_GEOMETRY, "LOD sphere indices");
+}
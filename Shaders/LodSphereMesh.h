@@ -0,0 +1,38 @@
+// Sphere mesh holding several levels of detail in one vertex and index buffer, so any level can be drawn without rebinding
+#pragma once
+
+#include "BaseMesh.h"
+#include <vector>
+
+using namespace std;
+using namespace DirectX;
+
+class LodSphereMesh : public BaseMesh
+{
+
+public:
+	/** \brief Initialises and builds a unit sphere at each level of detail
+	*
+	* @param device is the renderer device
+	* @param device context is the renderer device context
+	* @param slices is the number of slices around the most detailed level, each following level halves it
+	* @param lodCount is the number of levels of detail
+	*/
+	LodSphereMesh(ID3D11Device* device, ID3D11DeviceContext* deviceContext, int slices = 24, int lodCount = 3);
+	~LodSphereMesh();
+
+	// Index range and base vertex of each level, as used by DrawIndexed and the indirect draw arguments
+	int getLodCount() const { return (int)lodIndexStart.size(); }
+	int getLodIndexStart(int lod) const { return lodIndexStart[lod]; }
+	int getLodIndexCount(int lod) const { return lodIndexCount[lod]; }
+	int getLodBaseVertex(int lod) const { return lodBaseVertex[lod]; }
+
+protected:
+	void initBuffers(ID3D11Device* device);
+	int slices;
+	int lodLevels;
+
+	vector<int> lodIndexStart;
+	vector<int> lodIndexCount;
+	vector<int> lodBaseVertex;
+};
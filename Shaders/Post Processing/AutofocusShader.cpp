@@ -0,0 +1,215 @@
+#include "AutofocusShader.h"
+#include "MemoryTracker.h"
+
+
+AutofocusShader::AutofocusShader(ID3D11Device* device, HWND hwnd, float initialFocus) : BaseShader(device, hwnd)
+{
+	manual = false;
+	stateLost = false;
+	focusDistance = initialFocus;
+	targetDistance = initialFocus;
+	initShader(L"autofocus_cs.cso", NULL);
+}
+
+
+AutofocusShader::~AutofocusShader()
+{
+	// Release the read-back copies of the focus
+	for (int i = 0; i < READBACK_LATENCY; i++)
+	{
+		if (staging[i])
+		{
+			staging[i]->Release();
+			staging[i] = 0;
+		}
+	}
+
+	// Release the focus state and its view
+	if (stateUAV)
+	{
+		stateUAV->Release();
+		stateUAV = 0;
+	}
+	if (stateBuffer)
+	{
+		stateBuffer->Release();
+		stateBuffer = 0;
+	}
+
+	// Release the constant buffers
+	if (focusBuffer)
+	{
+		focusBuffer->Release();
+		focusBuffer = 0;
+	}
+	if (autofocusBuffer)
+	{
+		autofocusBuffer->Release();
+		autofocusBuffer = 0;
+	}
+
+	//Release base shader components
+	BaseShader::~BaseShader();
+}
+
+void AutofocusShader::initShader(const wchar_t* cfile, const wchar_t* blank)
+{
+	// Load (+ compile) shader file
+	loadComputeShader(cfile);
+
+	// Setup the description of the autofocus buffer, sent to the Compute Shader
+	D3D11_BUFFER_DESC bufferDesc;
+	bufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+	bufferDesc.ByteWidth = sizeof(AutofocusBufferType);
+	bufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	bufferDesc.MiscFlags = 0;
+	bufferDesc.StructureByteStride = 0;
+	renderer->CreateBuffer(&bufferDesc, NULL, &autofocusBuffer);
+	MemoryTracker::track(autofocusBuffer, MEMORY_CONSTANTS, "Autofocus constants");
+
+	// The state starts at the initial focus, as does the constant buffer, which is only ever copied or updated into
+	FocusBufferType initial;
+	initial.focusDistance = focusDistance;
+	initial.targetDistance = targetDistance;
+	initial.valid = 1.0f;
+	initial.padding = 0.0f;
+	D3D11_SUBRESOURCE_DATA initialData;
+	initialData.pSysMem = &initial;
+	initialData.SysMemPitch = 0;
+	initialData.SysMemSlicePitch = 0;
+
+	bufferDesc.Usage = D3D11_USAGE_DEFAULT;
+	bufferDesc.ByteWidth = sizeof(FocusBufferType);
+	bufferDesc.CPUAccessFlags = 0;
+	renderer->CreateBuffer(&bufferDesc, &initialData, &focusBuffer);
+	MemoryTracker::track(focusBuffer, MEMORY_GPU_BUFFER, "Autofocus focus");
+
+	// Written through a raw view, as typed views of four floats can't be read back in a compute shader
+	bufferDesc.BindFlags = D3D11_BIND_UNORDERED_ACCESS;
+	bufferDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_ALLOW_RAW_VIEWS;
+	renderer->CreateBuffer(&bufferDesc, &initialData, &stateBuffer);
+	MemoryTracker::track(stateBuffer, MEMORY_GPU_BUFFER, "Autofocus state");
+
+	D3D11_UNORDERED_ACCESS_VIEW_DESC stateUAVDesc;
+	stateUAVDesc.Format = DXGI_FORMAT_R32_TYPELESS;
+	stateUAVDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+	stateUAVDesc.Buffer.FirstElement = 0;
+	stateUAVDesc.Buffer.NumElements = sizeof(FocusBufferType) / sizeof(float);
+	stateUAVDesc.Buffer.Flags = D3D11_BUFFER_UAV_FLAG_RAW;
+	renderer->CreateUnorderedAccessView(stateBuffer, &stateUAVDesc, &stateUAV);
+
+	// Staging copies of the state, so the focus can be shown without stalling
+	bufferDesc.Usage = D3D11_USAGE_STAGING;
+	bufferDesc.BindFlags = 0;
+	bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	bufferDesc.MiscFlags = 0;
+	for (int i = 0; i < READBACK_LATENCY; i++)
+	{
+		staging[i] = 0;
+		renderer->CreateBuffer(&bufferDesc, NULL, &staging[i]);
+		MemoryTracker::track(staging[i], MEMORY_STAGING, "Autofocus readback");
+		stagingWritten[i] = false;
+	}
+	stagingIndex = 0;
+}
+
+void AutofocusShader::update(ID3D11DeviceContext* deviceContext, ID3D11ShaderResourceView* depth, int renderWidth, int renderHeight, float nearPlane, float farPlane, bool linearDepth, float deltaTime)
+{
+	if (manual)
+	{
+		return;
+	}
+
+	// The state on the GPU can't be trusted once written over, so the easing carries on from the focus last read back
+	if (stateLost)
+	{
+		FocusBufferType state;
+		state.focusDistance = focusDistance;
+		state.targetDistance = targetDistance;
+		state.valid = 1.0f;
+		state.padding = 0.0f;
+		deviceContext->UpdateSubresource(stateBuffer, 0, NULL, &state, 0, 0);
+		stateLost = false;
+	}
+
+	// Set the region, easing and depth storage and send to the Compute Shader
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	deviceContext->Map(autofocusBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+	AutofocusBufferType* autofocusPtr = (AutofocusBufferType*)mappedResource.pData;
+	autofocusPtr->renderSize[0] = max(renderWidth, 1);
+	autofocusPtr->renderSize[1] = max(renderHeight, 1);
+	autofocusPtr->regionSize = min(max(regionSize, 0.01f), 1.0f);
+	autofocusPtr->smoothing = max(smoothing, 0.0f);
+	autofocusPtr->nearPlane = nearPlane;
+	autofocusPtr->farPlane = farPlane;
+	autofocusPtr->linearDepth = linearDepth ? 1.0f : 0.0f;
+	autofocusPtr->deltaTime = deltaTime;
+	deviceContext->Unmap(autofocusBuffer, 0);
+	deviceContext->CSSetConstantBuffers(0, 1, &autofocusBuffer);
+
+	// One group reduces the whole region
+	ID3D11ShaderResourceView* nullSRV = NULL;
+	ID3D11UnorderedAccessView* nullUAV = NULL;
+	deviceContext->CSSetShaderResources(0, 1, &depth);
+	deviceContext->CSSetUnorderedAccessViews(0, 1, &stateUAV, 0);
+	compute(deviceContext, 1, 1, 1);
+	deviceContext->CSSetShaderResources(0, 1, &nullSRV);
+	deviceContext->CSSetUnorderedAccessViews(0, 1, &nullUAV, 0);
+	deviceContext->CSSetShader(NULL, NULL, 0);
+
+	publish(deviceContext);
+}
+
+void AutofocusShader::setManualFocus(ID3D11DeviceContext* deviceContext, float distance)
+{
+	manual = true;
+	FocusBufferType state;
+	state.focusDistance = distance;
+	state.targetDistance = distance;
+	state.valid = 1.0f;
+	state.padding = 0.0f;
+	deviceContext->UpdateSubresource(stateBuffer, 0, NULL, &state, 0, 0);
+	publish(deviceContext);
+}
+
+void AutofocusShader::invalidateGpuState()
+{
+	// A manual focus is set again every frame it's held, so only the eased state needs restoring
+	stateLost = true;
+	for (int i = 0; i < READBACK_LATENCY; i++)
+	{
+		stagingWritten[i] = false;
+	}
+}
+
+void AutofocusShader::publish(ID3D11DeviceContext* deviceContext)
+{
+	// Copies the state into the constant buffer the depth of field passes read, and queues it for reading back
+	deviceContext->CopyResource(focusBuffer, stateBuffer);
+
+	if (stagingWritten[stagingIndex])
+	{
+		D3D11_MAPPED_SUBRESOURCE mappedResource;
+		if (deviceContext->Map(staging[stagingIndex], 0, D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &mappedResource) == S_OK)
+		{
+			const FocusBufferType* state = (const FocusBufferType*)mappedResource.pData;
+			focusDistance = state->focusDistance;
+			targetDistance = state->targetDistance;
+			deviceContext->Unmap(staging[stagingIndex], 0);
+		}
+	}
+	deviceContext->CopyResource(staging[stagingIndex], stateBuffer);
+	stagingWritten[stagingIndex] = true;
+	stagingIndex = (stagingIndex + 1) % READBACK_LATENCY;
+}
+
+void AutofocusShader::setShaderParameters(ID3D11DeviceContext* deviceContext, int slot)
+{
+	StateCache::get()->setConstantBuffers(deviceContext, STAGE_PS, slot, 1, &focusBuffer);
+}
+
+void AutofocusShader::setComputeParameters(ID3D11DeviceContext* deviceContext, int slot)
+{
+	deviceContext->CSSetConstantBuffers(slot, 1, &focusBuffer);
+}
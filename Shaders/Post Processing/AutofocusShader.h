@@ -0,0 +1,89 @@
+// Autofocus Shader picks the depth of field's focus distance on the GPU once a frame, from a weighted region of the camera depth around the
+// centre of the screen, and eases towards it over time. The focus lands in a small constant buffer the depth of field passes read directly.
+// A manual focus can be set instead, for scripted benchmark shots that need the same focus every run
+#pragma once
+
+#include "DXF.h"
+#include "StateCache.h"
+
+using namespace std;
+using namespace DirectX;
+
+class AutofocusShader : public BaseShader
+{
+private:
+
+	// Stores the region rendered to, the size of the region sampled, how quickly the focus follows and how the camera depth is stored
+	struct AutofocusBufferType
+	{
+		UINT renderSize[2];
+		float regionSize;
+		float smoothing;
+		float nearPlane;
+		float farPlane;
+		float linearDepth;
+		float deltaTime;
+	};
+
+public:
+
+	// Matches FocusBuffer in the depth of field shaders: the eased focus, the focus it's heading for, whether it's set, and padding
+	struct FocusBufferType
+	{
+		float focusDistance;
+		float targetDistance;
+		float valid;
+		float padding;
+	};
+
+	AutofocusShader(ID3D11Device* device, HWND hwnd, float initialFocus);
+	~AutofocusShader();
+
+	// Finds this frame's focus from the top left renderWidth x renderHeight of the camera depth, stored between nearPlane and farPlane.
+	// Does nothing while a manual focus is set
+	void update(ID3D11DeviceContext* deviceContext, ID3D11ShaderResourceView* depth, int renderWidth, int renderHeight, float nearPlane, float farPlane, bool linearDepth, float deltaTime);
+
+	// Fixes the focus at a view distance, immediately and with no easing, until released. Autofocus then eases on from there
+	void setManualFocus(ID3D11DeviceContext* deviceContext, float distance);
+	void releaseManualFocus() { manual = false; }
+	bool isManual() const { return manual; }
+
+	// For when something else has written over the focus state, such as a replayed command trace. The next update starts easing again from
+	// the last focus read back, and the copies still waiting to be read back are dropped
+	void invalidateGpuState();
+
+	// Binds the focus constant buffer to a pixel or compute shader register
+	void setShaderParameters(ID3D11DeviceContext* deviceContext, int slot);
+	void setComputeParameters(ID3D11DeviceContext* deviceContext, int slot);
+
+	// The focus from a few frames ago, read back without stalling, for display
+	float getFocusDistance() const { return focusDistance; }
+	float getTargetDistance() const { return targetDistance; }
+
+	// Fraction of the screen's width and height sampled around the centre, and how quickly the focus closes the gap to its target, per second
+	float regionSize = 0.2f;
+	float smoothing = 4.0f;
+
+private:
+	void initShader(const wchar_t* cfile, const wchar_t* blank);
+	void publish(ID3D11DeviceContext* deviceContext);
+
+private:
+	static const int READBACK_LATENCY = 3;
+
+	ID3D11Buffer* autofocusBuffer;
+	ID3D11Buffer* focusBuffer;
+
+	// The eased focus, kept between frames on the GPU
+	ID3D11Buffer* stateBuffer;
+	ID3D11UnorderedAccessView* stateUAV;
+
+	ID3D11Buffer* staging[READBACK_LATENCY];
+	bool stagingWritten[READBACK_LATENCY];
+	int stagingIndex;
+
+	bool manual;
+	bool stateLost;
+	float focusDistance;
+	float targetDistance;
+};
@@ -0,0 +1,387 @@
+#include "BokehDofShader.h"
+#include "MemoryTracker.h"
+#include <DirectXPackedVector.h>
+#include <algorithm>
+#include <cmath>
+
+
+BokehDofShader::BokehDofShader(ID3D11Device* device, HWND hwnd, int width, int height) : BaseShader(device, hwnd)
+{
+	halfWidth = max(1, (width + 1) / 2);
+	halfHeight = max(1, (height + 1) / 2);
+	tilesX = (halfWidth + BokehDepthOfField::TILE_SIZE - 1) / BokehDepthOfField::TILE_SIZE;
+	tilesY = (halfHeight + BokehDepthOfField::TILE_SIZE - 1) / BokehDepthOfField::TILE_SIZE;
+	tileCount = 0;
+	blurredTiles = 0;
+	nearTiles = 0;
+	ZeroMemory(&constants, sizeof(constants));
+	initShader(L"bokeh_dof_cs.cso", NULL);
+}
+
+
+BokehDofShader::~BokehDofShader()
+{
+	// Release the read-back copies of the arguments
+	for (int i = 0; i < READBACK_LATENCY; i++)
+	{
+		if (argumentsStaging[i])
+		{
+			argumentsStaging[i]->Release();
+			argumentsStaging[i] = 0;
+		}
+	}
+
+	// Release the tile list and arguments, and their views
+	if (argumentsUAV)
+	{
+		argumentsUAV->Release();
+		argumentsUAV = 0;
+	}
+	if (argumentsBuffer)
+	{
+		argumentsBuffer->Release();
+		argumentsBuffer = 0;
+	}
+	if (tileListUAV)
+	{
+		tileListUAV->Release();
+		tileListUAV = 0;
+	}
+	if (tileListSRV)
+	{
+		tileListSRV->Release();
+		tileListSRV = 0;
+	}
+	if (tileListBuffer)
+	{
+		tileListBuffer->Release();
+		tileListBuffer = 0;
+	}
+
+	// Release the half resolution, result and tile textures, and their views
+	ID3D11Texture2D** textures[3] = { &halfTexture, &bokehTexture, &tileTexture };
+	ID3D11ShaderResourceView** srvs[3] = { &halfSRV, &bokehSRV, &tileSRV };
+	ID3D11UnorderedAccessView** uavs[3] = { &halfUAV, &bokehUAV, &tileUAV };
+	for (int i = 0; i < 3; i++)
+	{
+		if (*uavs[i])
+		{
+			(*uavs[i])->Release();
+			*uavs[i] = 0;
+		}
+		if (*srvs[i])
+		{
+			(*srvs[i])->Release();
+			*srvs[i] = 0;
+		}
+		if (*textures[i])
+		{
+			(*textures[i])->Release();
+			*textures[i] = 0;
+		}
+	}
+
+	// Release the constant buffer
+	if (bokehBuffer)
+	{
+		bokehBuffer->Release();
+		bokehBuffer = 0;
+	}
+
+	//Release base shader components
+	BaseShader::~BaseShader();
+}
+
+void BokehDofShader::initShader(const wchar_t* cfile, const wchar_t* blank)
+{
+	// Load (+ compile) shader file
+	loadComputeShader(cfile);
+
+	// Setup the description of the bokeh buffer, sent to the Compute Shader
+	D3D11_BUFFER_DESC bufferDesc;
+	bufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+	bufferDesc.ByteWidth = sizeof(BokehBufferType);
+	bufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	bufferDesc.MiscFlags = 0;
+	bufferDesc.StructureByteStride = 0;
+	renderer->CreateBuffer(&bufferDesc, NULL, &bokehBuffer);
+	MemoryTracker::track(bokehBuffer, MEMORY_CONSTANTS, "Bokeh constants");
+
+	// The half resolution scene with its circle of confusion, and the blurred result, both read and written by the passes
+	D3D11_TEXTURE2D_DESC textureDesc;
+	ZeroMemory(&textureDesc, sizeof(textureDesc));
+	textureDesc.Width = halfWidth;
+	textureDesc.Height = halfHeight;
+	textureDesc.MipLevels = 1;
+	textureDesc.ArraySize = 1;
+	textureDesc.Format = DXGI_FORMAT_R16G16B16A16_FLOAT;
+	textureDesc.SampleDesc.Count = 1;
+	textureDesc.Usage = D3D11_USAGE_DEFAULT;
+	textureDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS;
+	renderer->CreateTexture2D(&textureDesc, NULL, &halfTexture);
+	MemoryTracker::track(halfTexture, MEMORY_RENDER_TARGET, "Bokeh half resolution");
+	renderer->CreateShaderResourceView(halfTexture, NULL, &halfSRV);
+	renderer->CreateUnorderedAccessView(halfTexture, NULL, &halfUAV);
+	renderer->CreateTexture2D(&textureDesc, NULL, &bokehTexture);
+	MemoryTracker::track(bokehTexture, MEMORY_RENDER_TARGET, "Bokeh sprites");
+	renderer->CreateShaderResourceView(bokehTexture, NULL, &bokehSRV);
+	renderer->CreateUnorderedAccessView(bokehTexture, NULL, &bokehUAV);
+
+	// One texel per tile, holding its largest blur and its largest blur in front of the focus
+	textureDesc.Width = tilesX;
+	textureDesc.Height = tilesY;
+	textureDesc.Format = DXGI_FORMAT_R16G16_FLOAT;
+	renderer->CreateTexture2D(&textureDesc, NULL, &tileTexture);
+	MemoryTracker::track(tileTexture, MEMORY_RENDER_TARGET, "Bokeh tiles");
+	renderer->CreateShaderResourceView(tileTexture, NULL, &tileSRV);
+	renderer->CreateUnorderedAccessView(tileTexture, NULL, &tileUAV);
+
+	// Room for every tile to be listed
+	D3D11_BUFFER_DESC listDesc;
+	listDesc.Usage = D3D11_USAGE_DEFAULT;
+	listDesc.ByteWidth = sizeof(BokehTile) * tilesX * tilesY;
+	listDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS;
+	listDesc.CPUAccessFlags = 0;
+	listDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	listDesc.StructureByteStride = sizeof(BokehTile);
+	renderer->CreateBuffer(&listDesc, NULL, &tileListBuffer);
+	MemoryTracker::track(tileListBuffer, MEMORY_GPU_BUFFER, "Bokeh tile list");
+	renderer->CreateShaderResourceView(tileListBuffer, NULL, &tileListSRV);
+	renderer->CreateUnorderedAccessView(tileListBuffer, NULL, &tileListUAV);
+
+	// The gather's group counts, counted into by the classification through a raw view, followed by the near tile count
+	D3D11_BUFFER_DESC argumentsDesc;
+	argumentsDesc.Usage = D3D11_USAGE_DEFAULT;
+	argumentsDesc.ByteWidth = sizeof(UINT) * 4;
+	argumentsDesc.BindFlags = D3D11_BIND_UNORDERED_ACCESS;
+	argumentsDesc.CPUAccessFlags = 0;
+	argumentsDesc.MiscFlags = D3D11_RESOURCE_MISC_DRAWINDIRECT_ARGS | D3D11_RESOURCE_MISC_BUFFER_ALLOW_RAW_VIEWS;
+	argumentsDesc.StructureByteStride = 0;
+	renderer->CreateBuffer(&argumentsDesc, NULL, &argumentsBuffer);
+	MemoryTracker::track(argumentsBuffer, MEMORY_GPU_BUFFER, "Bokeh draw arguments");
+
+	D3D11_UNORDERED_ACCESS_VIEW_DESC argumentsUAVDesc;
+	argumentsUAVDesc.Format = DXGI_FORMAT_R32_TYPELESS;
+	argumentsUAVDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+	argumentsUAVDesc.Buffer.FirstElement = 0;
+	argumentsUAVDesc.Buffer.NumElements = 4;
+	argumentsUAVDesc.Buffer.Flags = D3D11_BUFFER_UAV_FLAG_RAW;
+	renderer->CreateUnorderedAccessView(argumentsBuffer, &argumentsUAVDesc, &argumentsUAV);
+
+	// Staging copies of the arguments, so the tile counts can be read back without stalling
+	D3D11_BUFFER_DESC stagingDesc = argumentsDesc;
+	stagingDesc.Usage = D3D11_USAGE_STAGING;
+	stagingDesc.BindFlags = 0;
+	stagingDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	stagingDesc.MiscFlags = 0;
+	for (int i = 0; i < READBACK_LATENCY; i++)
+	{
+		argumentsStaging[i] = 0;
+		renderer->CreateBuffer(&stagingDesc, NULL, &argumentsStaging[i]);
+		MemoryTracker::track(argumentsStaging[i], MEMORY_STAGING, "Bokeh arguments readback");
+		stagingTileCount[i] = 0;
+		stagingWritten[i] = false;
+	}
+	stagingIndex = 0;
+}
+
+void BokehDofShader::runPass(ID3D11DeviceContext* deviceContext, UINT pass)
+{
+	// Set the pass and send to the Compute Shader
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	constants.passIndex = pass;
+	deviceContext->Map(bokehBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+	*(BokehBufferType*)mappedResource.pData = constants;
+	deviceContext->Unmap(bokehBuffer, 0);
+	deviceContext->CSSetConstantBuffers(0, 1, &bokehBuffer);
+}
+
+void BokehDofShader::apply(ID3D11DeviceContext* deviceContext, ID3D11ShaderResourceView* scene, ID3D11ShaderResourceView* depth, int renderWidth, int renderHeight, const BokehSettings& settings, float nearPlane, float farPlane, bool linearDepth)
+{
+	ID3D11ShaderResourceView* nullSRV[5] = { NULL, NULL, NULL, NULL, NULL };
+	ID3D11UnorderedAccessView* nullUAV[5] = { NULL, NULL, NULL, NULL, NULL };
+
+	// Only the half of the region rendered to is worked on, in tiles of eight texels
+	UINT regionWidth = min(max((renderWidth + 1) / 2, 1), halfWidth);
+	UINT regionHeight = min(max((renderHeight + 1) / 2, 1), halfHeight);
+	UINT regionTilesX = (regionWidth + BokehDepthOfField::TILE_SIZE - 1) / BokehDepthOfField::TILE_SIZE;
+	UINT regionTilesY = (regionHeight + BokehDepthOfField::TILE_SIZE - 1) / BokehDepthOfField::TILE_SIZE;
+	constants.renderSize[0] = min(renderWidth, halfWidth * 2);
+	constants.renderSize[1] = min(renderHeight, halfHeight * 2);
+	constants.halfSize[0] = regionWidth;
+	constants.halfSize[1] = regionHeight;
+	constants.tileCount[0] = regionTilesX;
+	constants.tileCount[1] = regionTilesY;
+	constants.maxRadius = min(settings.maxRadius, (float)BokehDepthOfField::MAX_RADIUS);
+	constants.focusRange = settings.focusRange;
+	constants.inFocusThreshold = settings.inFocusThreshold;
+	constants.nearPlane = nearPlane;
+	constants.farPlane = farPlane;
+	constants.linearDepth = linearDepth ? 1.0f : 0.0f;
+	constants.padding = XMFLOAT3(0.0f, 0.0f, 0.0f);
+
+	// Resets the gather to no groups of one by one, ready for the classification to count into
+	UINT resetArguments[4] = { 0, 1, 1, 0 };
+	deviceContext->UpdateSubresource(argumentsBuffer, 0, NULL, resetArguments, 0, 0);
+
+	// Halves the scene and finds each tile's largest blur
+	runPass(deviceContext, 0);
+	ID3D11ShaderResourceView* prepareSRV[2] = { scene, depth };
+	ID3D11UnorderedAccessView* prepareUAV[3] = { halfUAV, bokehUAV, tileUAV };
+	deviceContext->CSSetShaderResources(0, 2, prepareSRV);
+	deviceContext->CSSetUnorderedAccessViews(0, 3, prepareUAV, 0);
+	compute(deviceContext, regionTilesX, regionTilesY, 1);
+	deviceContext->CSSetShaderResources(0, 5, nullSRV);
+	deviceContext->CSSetUnorderedAccessViews(0, 5, nullUAV, 0);
+
+	// Lists the tiles needing blur
+	runPass(deviceContext, 1);
+	ID3D11UnorderedAccessView* classifyUAV[2] = { tileListUAV, argumentsUAV };
+	deviceContext->CSSetShaderResources(3, 1, &tileSRV);
+	deviceContext->CSSetUnorderedAccessViews(3, 2, classifyUAV, 0);
+	compute(deviceContext, (regionTilesX + 7) / 8, (regionTilesY + 7) / 8, 1);
+	deviceContext->CSSetShaderResources(0, 5, nullSRV);
+	deviceContext->CSSetUnorderedAccessViews(0, 5, nullUAV, 0);
+
+	// Gathers every listed tile, one group each. An empty dispatch binds the shader, then the group count comes from the classification
+	runPass(deviceContext, 2);
+	deviceContext->CSSetShaderResources(2, 1, &halfSRV);
+	deviceContext->CSSetShaderResources(4, 1, &tileListSRV);
+	deviceContext->CSSetUnorderedAccessViews(1, 1, &bokehUAV, 0);
+	compute(deviceContext, 0, 0, 0);
+	deviceContext->DispatchIndirect(argumentsBuffer, 0);
+	deviceContext->CSSetShaderResources(0, 5, nullSRV);
+	deviceContext->CSSetUnorderedAccessViews(0, 5, nullUAV, 0);
+	deviceContext->CSSetShader(NULL, NULL, 0);
+
+	// Queues the counts for reading back, after taking the oldest ones if they've arrived
+	readCounts(deviceContext);
+	deviceContext->CopyResource(argumentsStaging[stagingIndex], argumentsBuffer);
+	stagingTileCount[stagingIndex] = regionTilesX * regionTilesY;
+	stagingWritten[stagingIndex] = true;
+	stagingIndex = (stagingIndex + 1) % READBACK_LATENCY;
+}
+
+void BokehDofShader::readCounts(ID3D11DeviceContext* deviceContext)
+{
+	// The oldest copy is the one about to be overwritten, and has had the most time to finish on the GPU
+	if (!stagingWritten[stagingIndex])
+	{
+		return;
+	}
+
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	if (deviceContext->Map(argumentsStaging[stagingIndex], 0, D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &mappedResource) != S_OK)
+	{
+		return;
+	}
+	const UINT* counts = (const UINT*)mappedResource.pData;
+	blurredTiles = (int)counts[0];
+	nearTiles = (int)counts[3];
+	tileCount = stagingTileCount[stagingIndex];
+	deviceContext->Unmap(argumentsStaging[stagingIndex], 0);
+}
+
+void BokehDofShader::invalidateGpuState()
+{
+	for (int i = 0; i < READBACK_LATENCY; i++)
+	{
+		stagingWritten[i] = false;
+	}
+}
+
+bool BokehDofShader::compareWithReference(ID3D11DeviceContext* deviceContext, const BokehSettings& settings, BokehComparison& comparison)
+{
+	int width = (int)constants.halfSize[0];
+	int height = (int)constants.halfSize[1];
+	if (width == 0 || height == 0)
+	{
+		return false;
+	}
+
+	// Copies the half resolution input and the result into textures the CPU can read, waiting for them
+	ID3D11Device* device = NULL;
+	deviceContext->GetDevice(&device);
+	D3D11_TEXTURE2D_DESC stagingDesc;
+	halfTexture->GetDesc(&stagingDesc);
+	stagingDesc.Usage = D3D11_USAGE_STAGING;
+	stagingDesc.BindFlags = 0;
+	stagingDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	ID3D11Texture2D* staging[2] = { NULL, NULL };
+	ID3D11Texture2D* sources[2] = { halfTexture, bokehTexture };
+	vector<XMFLOAT4> images[2];
+	bool read = true;
+	for (int i = 0; i < 2; i++)
+	{
+		if (device->CreateTexture2D(&stagingDesc, NULL, &staging[i]) != S_OK)
+		{
+			read = false;
+			break;
+		}
+		MemoryTracker::track(staging[i], MEMORY_STAGING, "Bokeh debug readback");
+		deviceContext->CopyResource(staging[i], sources[i]);
+
+		D3D11_MAPPED_SUBRESOURCE mappedResource;
+		if (deviceContext->Map(staging[i], 0, D3D11_MAP_READ, 0, &mappedResource) != S_OK)
+		{
+			read = false;
+			break;
+		}
+		images[i].resize((size_t)width * height);
+		for (int y = 0; y < height; y++)
+		{
+			const PackedVector::XMHALF4* row = (const PackedVector::XMHALF4*)((const BYTE*)mappedResource.pData + (size_t)y * mappedResource.RowPitch);
+			for (int x = 0; x < width; x++)
+			{
+				XMStoreFloat4(&images[i][(size_t)y * width + x], PackedVector::XMLoadHalf4(&row[x]));
+			}
+		}
+		deviceContext->Unmap(staging[i], 0);
+	}
+
+	// The listed tile count is the first argument of the gather
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	comparison.gpuTiles = -1;
+	int previous = (stagingIndex + READBACK_LATENCY - 1) % READBACK_LATENCY;
+	if (read && deviceContext->Map(argumentsStaging[previous], 0, D3D11_MAP_READ, 0, &mappedResource) == S_OK)
+	{
+		comparison.gpuTiles = (int)((const UINT*)mappedResource.pData)[0];
+		deviceContext->Unmap(argumentsStaging[previous], 0);
+	}
+	for (int i = 0; i < 2; i++)
+	{
+		if (staging[i])
+		{
+			staging[i]->Release();
+		}
+	}
+	device->Release();
+	if (!read)
+	{
+		return false;
+	}
+
+	// Runs the reference on the GPU's own half resolution input, so only the classification and gather are compared
+	BokehSettings clamped = settings;
+	clamped.maxRadius = constants.maxRadius;
+	vector<XMFLOAT4> expected;
+	vector<BokehTile> tiles;
+	BokehDepthOfField::reference(images[0], width, height, clamped, expected, tiles);
+
+	comparison.width = width;
+	comparison.height = height;
+	comparison.cpuTiles = (int)tiles.size();
+	comparison.meanError = 0.0;
+	comparison.maxError = 0.0;
+	for (size_t texel = 0; texel < expected.size(); texel++)
+	{
+		XMVECTOR difference = XMVectorAbs(XMVectorSubtract(XMLoadFloat4(&expected[texel]), XMLoadFloat4(&images[1][texel])));
+		XMFLOAT4 error;
+		XMStoreFloat4(&error, difference);
+		double largest = max(max(error.x, error.y), max(error.z, error.w));
+		comparison.meanError += largest / expected.size();
+		comparison.maxError = max(comparison.maxError, largest);
+	}
+	return true;
+}
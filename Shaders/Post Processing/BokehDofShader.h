@@ -0,0 +1,100 @@
+// Bokeh Depth of Field Shader blurs the out of focus parts of the scene at half resolution in compute, in place of blurring the whole screen.
+// Tiles are classified on the GPU and only the ones needing blur are gathered, through an indirect dispatch sized by the classification,
+// and the result is blended over the sharp scene by the depth of field pixel shader
+#pragma once
+
+#include "DXF.h"
+#include "BokehDepthOfField.h"
+
+using namespace std;
+using namespace DirectX;
+
+class BokehDofShader : public BaseShader
+{
+private:
+
+	// Stores the region rendered to, the half resolution and tile sizes, the pass being run, how the blur grows and how the camera depth is stored
+	struct BokehBufferType
+	{
+		UINT renderSize[2];
+		UINT halfSize[2];
+		UINT tileCount[2];
+		UINT passIndex;
+		float maxRadius;
+		float focusRange;
+		float inFocusThreshold;
+		float nearPlane;
+		float farPlane;
+		float linearDepth;
+		XMFLOAT3 padding;
+	};
+
+public:
+
+	static const int FOCUS_SLOT = 1;
+
+	// Sized for a scene of width x height, of which any top left region can be rendered to
+	BokehDofShader(ID3D11Device* device, HWND hwnd, int width, int height);
+	~BokehDofShader();
+
+	// Blurs the top left renderWidth x renderHeight of the scene, reading the camera depth as stored between nearPlane and farPlane
+	// The focus distance is read from the autofocus shader's focus buffer, which must be bound to compute register FOCUS_SLOT first
+	void apply(ID3D11DeviceContext* deviceContext, ID3D11ShaderResourceView* scene, ID3D11ShaderResourceView* depth, int renderWidth, int renderHeight, const BokehSettings& settings, float nearPlane, float farPlane, bool linearDepth);
+
+	// Reads back the half resolution input and result of the last apply, stalling until they are ready, and compares the result with the CPU reference
+	bool compareWithReference(ID3D11DeviceContext* deviceContext, const BokehSettings& settings, BokehComparison& comparison);
+
+	// For when something else has written over the read-back copies of the tile counts, such as a replayed command trace, which drops them
+	void invalidateGpuState();
+
+	// Half resolution colour with the blend weight in alpha, and the fraction of it the last region covers
+	ID3D11ShaderResourceView* getShaderResourceView() { return bokehSRV; }
+	XMFLOAT2 getUVScale() const { return XMFLOAT2((float)constants.halfSize[0] / halfWidth, (float)constants.halfSize[1] / halfHeight); }
+
+	// Tiles covering the last region, and how many of them were blurred and reached by near blur, read back a few frames late
+	int getTileCount() const { return tileCount; }
+	int getBlurredTiles() const { return blurredTiles; }
+	int getNearTiles() const { return nearTiles; }
+	float getOutOfFocusFraction() const { return tileCount > 0 ? (float)blurredTiles / tileCount : 0.0f; }
+
+private:
+	void initShader(const wchar_t* cfile, const wchar_t* blank);
+	void runPass(ID3D11DeviceContext* deviceContext, UINT pass);
+	void readCounts(ID3D11DeviceContext* deviceContext);
+
+private:
+	static const int READBACK_LATENCY = 3;
+
+	ID3D11Buffer* bokehBuffer;
+	BokehBufferType constants;
+
+	int halfWidth;
+	int halfHeight;
+	int tilesX;
+	int tilesY;
+	int tileCount;
+	int blurredTiles;
+	int nearTiles;
+
+	// Half resolution colour and circle of confusion, the blurred result, and each tile's largest far and near blur
+	ID3D11Texture2D* halfTexture;
+	ID3D11ShaderResourceView* halfSRV;
+	ID3D11UnorderedAccessView* halfUAV;
+	ID3D11Texture2D* bokehTexture;
+	ID3D11ShaderResourceView* bokehSRV;
+	ID3D11UnorderedAccessView* bokehUAV;
+	ID3D11Texture2D* tileTexture;
+	ID3D11ShaderResourceView* tileSRV;
+	ID3D11UnorderedAccessView* tileUAV;
+
+	// Listed tiles and the gather's dispatch arguments, followed by the near tile count
+	ID3D11Buffer* tileListBuffer;
+	ID3D11ShaderResourceView* tileListSRV;
+	ID3D11UnorderedAccessView* tileListUAV;
+	ID3D11Buffer* argumentsBuffer;
+	ID3D11UnorderedAccessView* argumentsUAV;
+	ID3D11Buffer* argumentsStaging[READBACK_LATENCY];
+	int stagingTileCount[READBACK_LATENCY];
+	bool stagingWritten[READBACK_LATENCY];
+	int stagingIndex;
+};
@@ -1,5 +1,6 @@
 // Horizontal blur shader
 #include "CombinedBlurShader.h"
+#include "MemoryTracker.h"
 
 
 CombinedBlurShader::CombinedBlurShader(ID3D11Device* device, HWND hwnd) : BaseShader(device, hwnd)
@@ -43,7 +44,6 @@ CombinedBlurShader::~CombinedBlurShader()
 void CombinedBlurShader::initShader(const wchar_t* vsFilename, const wchar_t* psFilename)
 {
 	D3D11_BUFFER_DESC matrixBufferDesc;
-	D3D11_SAMPLER_DESC samplerDesc;
 	D3D11_BUFFER_DESC screenSizeBufferDesc;
 
 	// Load (+ compile) shader files
@@ -58,22 +58,10 @@ void CombinedBlurShader::initShader(const wchar_t* vsFilename, const wchar_t* ps
 	matrixBufferDesc.MiscFlags = 0;
 	matrixBufferDesc.StructureByteStride = 0;
 	renderer->CreateBuffer(&matrixBufferDesc, NULL, &matrixBuffer);
+	MemoryTracker::track(matrixBuffer, MEMORY_CONSTANTS, "Blur matrices");
 
-	// Create a texture sampler state description.
-	samplerDesc.Filter = D3D11_FILTER_ANISOTROPIC;
-	samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_WRAP;
-	samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_WRAP;
-	samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_WRAP;
-	samplerDesc.MipLODBias = 0.0f;
-	samplerDesc.MaxAnisotropy = 1;
-	samplerDesc.ComparisonFunc = D3D11_COMPARISON_ALWAYS;
-	samplerDesc.BorderColor[0] = 0;
-	samplerDesc.BorderColor[1] = 0;
-	samplerDesc.BorderColor[2] = 0;
-	samplerDesc.BorderColor[3] = 0;
-	samplerDesc.MinLOD = 0;
-	samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
-	renderer->CreateSamplerState(&samplerDesc, &sampleState);
+	// Texture sampler state, looked up rather than created
+	sampleState = StateCache::get()->getSamplerState(StateCache::anisotropicWrap());
 
 	// Setup the description of the screen size.
 	screenSizeBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
@@ -83,11 +71,12 @@ void CombinedBlurShader::initShader(const wchar_t* vsFilename, const wchar_t* ps
 	screenSizeBufferDesc.MiscFlags = 0;
 	screenSizeBufferDesc.StructureByteStride = 0;
 	renderer->CreateBuffer(&screenSizeBufferDesc, NULL, &screenSizeBuffer);
+	MemoryTracker::track(screenSizeBuffer, MEMORY_CONSTANTS, "Blur screen size");
 
 }
 
 
-void CombinedBlurShader::setShaderParameters(ID3D11DeviceContext* deviceContext, const XMMATRIX& worldMatrix, const XMMATRIX& viewMatrix, const XMMATRIX& projectionMatrix, ID3D11ShaderResourceView* texture, float width, float height)
+void CombinedBlurShader::setShaderParameters(ID3D11DeviceContext* deviceContext, const XMMATRIX& worldMatrix, const XMMATRIX& viewMatrix, const XMMATRIX& projectionMatrix, ID3D11ShaderResourceView* texture, float width, float height, XMFLOAT2 uvScale, int blurRadius)
 {
 	D3D11_MAPPED_SUBRESOURCE mappedResource;
 	MatrixBufferType* dataPtr;
@@ -105,7 +94,7 @@ void CombinedBlurShader::setShaderParameters(ID3D11DeviceContext* deviceContext,
 	dataPtr->view = tview;
 	dataPtr->projection = tproj;
 	deviceContext->Unmap(matrixBuffer, 0);
-	deviceContext->VSSetConstantBuffers(0, 1, &matrixBuffer);
+	StateCache::get()->setConstantBuffers(deviceContext, STAGE_VS, 0, 1, &matrixBuffer);
 
 	// Set screen size and send buffer to pixel shader
 	ScreenSizeBufferType* widthPtr;
@@ -113,11 +102,13 @@ void CombinedBlurShader::setShaderParameters(ID3D11DeviceContext* deviceContext,
 	widthPtr = (ScreenSizeBufferType*)mappedResource.pData;
 	widthPtr->screenWidth = width;
 	widthPtr->screenHeight = height;
-	widthPtr->padding = XMFLOAT2(1.f, 1.f);
+	widthPtr->uvScale = uvScale;
+	widthPtr->blurRadius = (float)blurRadius;
+	widthPtr->padding = XMFLOAT3(0.0f, 0.0f, 0.0f);
 	deviceContext->Unmap(screenSizeBuffer, 0);
-	deviceContext->PSSetConstantBuffers(0, 1, &screenSizeBuffer);
+	StateCache::get()->setConstantBuffers(deviceContext, STAGE_PS, 0, 1, &screenSizeBuffer);
 
 	// Set texture and shader resources in the pixel shader.
-	deviceContext->PSSetShaderResources(0, 1, &texture);
-	deviceContext->PSSetSamplers(0, 1, &sampleState);
+	StateCache::get()->setShaderResources(deviceContext, STAGE_PS, 0, 1, &texture);
+	StateCache::get()->setSamplers(deviceContext, STAGE_PS, 0, 1, &sampleState);
 }
\ No newline at end of file
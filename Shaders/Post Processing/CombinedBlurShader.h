@@ -2,6 +2,7 @@
 #pragma once
 
 #include "DXF.h"
+#include "StateCache.h"
 
 using namespace std;
 using namespace DirectX;
@@ -10,12 +11,14 @@ class CombinedBlurShader : public BaseShader
 {
 private:
 
-	// Stores the screen's height and width
+	// Stores the screen's height and width, the fraction of the texture the scene was rendered to and the blur radius
 	struct ScreenSizeBufferType
 	{
 		float screenWidth;
 		float screenHeight;
-		XMFLOAT2 padding;
+		XMFLOAT2 uvScale;
+		float blurRadius;
+		XMFLOAT3 padding;
 	};
 
 public:
@@ -23,7 +26,9 @@ public:
 	CombinedBlurShader(ID3D11Device* device, HWND hwnd);
 	~CombinedBlurShader();
 
-	void setShaderParameters(ID3D11DeviceContext* deviceContext, const XMMATRIX& world, const XMMATRIX& view, const XMMATRIX& projection, ID3D11ShaderResourceView* texture, float width, float height);
+	// uvScale is the fraction of the texture holding the image when rendering at a reduced resolution, the blur texture's viewport being set to match
+	// blurRadius is how many texels either side are sampled, from 1 to 4
+	void setShaderParameters(ID3D11DeviceContext* deviceContext, const XMMATRIX& world, const XMMATRIX& view, const XMMATRIX& projection, ID3D11ShaderResourceView* texture, float width, float height, XMFLOAT2 uvScale = XMFLOAT2(1.0f, 1.0f), int blurRadius = 4);
 
 private:
 	void initShader(const wchar_t* vs, const wchar_t* ps);
@@ -1,4 +1,5 @@
 #include "DepthOfFieldShader.h"
+#include "MemoryTracker.h"
 
 DepthOfFieldShader::DepthOfFieldShader(ID3D11Device* device, HWND hwnd) : BaseShader(device, hwnd)
 {
@@ -34,6 +35,11 @@ DepthOfFieldShader::~DepthOfFieldShader()
 		activeBuffer->Release();
 		activeBuffer = 0;
 	}
+	if (bokehBuffer)
+	{
+		bokehBuffer->Release();
+		bokehBuffer = 0;
+	}
 
 	//Release base shader components
 	BaseShader::~BaseShader();
@@ -42,7 +48,6 @@ DepthOfFieldShader::~DepthOfFieldShader()
 void DepthOfFieldShader::initShader(const wchar_t* vsFilename, const wchar_t* psFilename)
 {
 	D3D11_BUFFER_DESC matrixBufferDesc;
-	D3D11_SAMPLER_DESC samplerDesc;
 	D3D11_BUFFER_DESC activeBufferDesc;
 
 	// Load (+ compile) shader files
@@ -57,18 +62,10 @@ void DepthOfFieldShader::initShader(const wchar_t* vsFilename, const wchar_t* ps
 	matrixBufferDesc.MiscFlags = 0;
 	matrixBufferDesc.StructureByteStride = 0;
 	renderer->CreateBuffer(&matrixBufferDesc, NULL, &matrixBuffer);
+	MemoryTracker::track(matrixBuffer, MEMORY_CONSTANTS, "Depth of field matrices");
 
-	// Create a texture sampler state description.
-	samplerDesc.Filter = D3D11_FILTER_ANISOTROPIC;
-	samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_WRAP;
-	samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_WRAP;
-	samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_WRAP;
-	samplerDesc.MipLODBias = 0.0f;
-	samplerDesc.MaxAnisotropy = 1;
-	samplerDesc.ComparisonFunc = D3D11_COMPARISON_ALWAYS;
-	samplerDesc.MinLOD = 0;
-	samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
-	renderer->CreateSamplerState(&samplerDesc, &sampleState);
+	// Texture sampler, the cache's shared anisotropic wrap
+	sampleState = StateCache::get()->getSamplerState(StateCache::anisotropicWrap());
 
 	// Setup active buffer for use in pixel shader
 	activeBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
@@ -78,9 +75,15 @@ void DepthOfFieldShader::initShader(const wchar_t* vsFilename, const wchar_t* ps
 	activeBufferDesc.MiscFlags = 0;
 	activeBufferDesc.StructureByteStride = 0;
 	renderer->CreateBuffer(&activeBufferDesc, NULL, &activeBuffer);
+	MemoryTracker::track(activeBuffer, MEMORY_CONSTANTS, "Depth of field constants");
+
+	// Setup bokeh buffer for use in pixel shader
+	activeBufferDesc.ByteWidth = sizeof(BokehCompositeBufferType);
+	renderer->CreateBuffer(&activeBufferDesc, NULL, &bokehBuffer);
+	MemoryTracker::track(bokehBuffer, MEMORY_CONSTANTS, "Depth of field bokeh");
 }
 
-void DepthOfFieldShader::setShaderParameters(ID3D11DeviceContext* deviceContext, const XMMATRIX& worldMatrix, const XMMATRIX& viewMatrix, const XMMATRIX& projectionMatrix, ID3D11ShaderResourceView* normalTexture, ID3D11ShaderResourceView* blurTexture, ID3D11ShaderResourceView* depthTexture, float weighting, float cutOff, float lerpPercent, bool activeDOF)
+void DepthOfFieldShader::setShaderParameters(ID3D11DeviceContext* deviceContext, const XMMATRIX& worldMatrix, const XMMATRIX& viewMatrix, const XMMATRIX& projectionMatrix, ID3D11ShaderResourceView* normalTexture, ID3D11ShaderResourceView* blurTexture, ID3D11ShaderResourceView* depthTexture, float weighting, float cutOff, float lerpPercent, bool activeDOF, XMFLOAT2 uvScale, bool bicubicUpsample)
 {
 	HRESULT result;
 	D3D11_MAPPED_SUBRESOURCE mappedResource;
@@ -100,7 +103,7 @@ void DepthOfFieldShader::setShaderParameters(ID3D11DeviceContext* deviceContext,
 	dataPtr->view = tview;
 	dataPtr->projection = tproj;
 	deviceContext->Unmap(matrixBuffer, 0);
-	deviceContext->VSSetConstantBuffers(0, 1, &matrixBuffer);
+	StateCache::get()->setConstantBuffers(deviceContext, STAGE_VS, 0, 1, &matrixBuffer);
 
 	// Set active buffer and send to the Pixel Shader
 	ActiveBufferType* activePtr;
@@ -110,16 +113,36 @@ void DepthOfFieldShader::setShaderParameters(ID3D11DeviceContext* deviceContext,
 	activePtr->cutoff = cutOff;
 	activePtr->weight = weighting;
 	activePtr->active = activeDOF;
+	activePtr->uvScale = uvScale;
+	activePtr->bicubic = bicubicUpsample;
+	activePtr->padding = 0.0f;
 	deviceContext->Unmap(activeBuffer, 0);
-	deviceContext->PSSetConstantBuffers(0, 1, &activeBuffer);
+	StateCache::get()->setConstantBuffers(deviceContext, STAGE_PS, 0, 1, &activeBuffer);
 
 	// Set Textures and the sampler in the Pixel Shader.
-	deviceContext->PSSetShaderResources(0, 1, &normalTexture);
-	deviceContext->PSSetShaderResources(1, 1, &blurTexture);
-	deviceContext->PSSetShaderResources(2, 1, &depthTexture);
-	deviceContext->PSSetSamplers(0, 1, &sampleState);
+	StateCache::get()->setShaderResources(deviceContext, STAGE_PS, 0, 1, &normalTexture);
+	StateCache::get()->setShaderResources(deviceContext, STAGE_PS, 1, 1, &blurTexture);
+	StateCache::get()->setShaderResources(deviceContext, STAGE_PS, 2, 1, &depthTexture);
+	StateCache::get()->setSamplers(deviceContext, STAGE_PS, 0, 1, &sampleState);
 
 	// Set texture and sampler in the Vertex Shader
-	deviceContext->VSSetShaderResources(0, 1, &normalTexture);
-	deviceContext->VSSetSamplers(0, 1, &sampleState);
+	StateCache::get()->setShaderResources(deviceContext, STAGE_VS, 0, 1, &normalTexture);
+	StateCache::get()->setSamplers(deviceContext, STAGE_VS, 0, 1, &sampleState);
+}
+
+void DepthOfFieldShader::setBokeh(ID3D11DeviceContext* deviceContext, ID3D11ShaderResourceView* bokehTexture, XMFLOAT2 bokehUVScale, bool enabled)
+{
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+
+	// Set bokeh buffer and send to the Pixel Shader
+	deviceContext->Map(bokehBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+	BokehCompositeBufferType* bokehPtr = (BokehCompositeBufferType*)mappedResource.pData;
+	bokehPtr->bokehUVScale = bokehUVScale;
+	bokehPtr->bokeh = enabled ? 1.0f : 0.0f;
+	bokehPtr->padding = 0.0f;
+	deviceContext->Unmap(bokehBuffer, 0);
+	StateCache::get()->setConstantBuffers(deviceContext, STAGE_PS, 2, 1, &bokehBuffer);
+
+	// Set the bokeh result in the Pixel Shader
+	StateCache::get()->setShaderResources(deviceContext, STAGE_PS, 3, 1, &bokehTexture);
 }
\ No newline at end of file
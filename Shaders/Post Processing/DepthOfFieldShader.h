@@ -1,6 +1,7 @@
-// Blurs the screen based on how far away a pixel's depth is from the centre pixel
+// Blurs the screen based on how far away a pixel's depth is from the focus
 #pragma once
 #include "DXF.h"
+#include "StateCache.h"
 
 using namespace std;
 using namespace DirectX;
@@ -11,7 +12,14 @@ public:
 	DepthOfFieldShader(ID3D11Device* device, HWND hwnd);
 	~DepthOfFieldShader();
 
-	void setShaderParameters(ID3D11DeviceContext* deviceContext, const XMMATRIX& world, const XMMATRIX& view, const XMMATRIX& projection, ID3D11ShaderResourceView* normalTexture, ID3D11ShaderResourceView* blurTexture, ID3D11ShaderResourceView* depthTexture, float weighting, float cutOff, float lerpPercent, bool activeDOF);
+	// uvScale is the fraction of the textures the scene was rendered to, which is upsampled to the screen with a bicubic filter unless bilinear is asked for
+	void setShaderParameters(ID3D11DeviceContext* deviceContext, const XMMATRIX& world, const XMMATRIX& view, const XMMATRIX& projection, ID3D11ShaderResourceView* normalTexture, ID3D11ShaderResourceView* blurTexture, ID3D11ShaderResourceView* depthTexture, float weighting, float cutOff, float lerpPercent, bool activeDOF, XMFLOAT2 uvScale = XMFLOAT2(1.0f, 1.0f), bool bicubicUpsample = true);
+
+	// The focus comes from the autofocus shader's focus buffer, which must be bound to pixel register FOCUS_SLOT before rendering
+	static const int FOCUS_SLOT = 3;
+
+	// When enabled, blends the bokeh shader's half resolution result over the scene instead of lerping towards the blur texture
+	void setBokeh(ID3D11DeviceContext* deviceContext, ID3D11ShaderResourceView* bokehTexture, XMFLOAT2 bokehUVScale, bool enabled);
 
 private:
 
@@ -22,6 +30,17 @@ private:
 		float cutoff;
 		float weight;
 		float active;
+		XMFLOAT2 uvScale;
+		float bicubic;
+		float padding;
+	};
+
+	// Stores whether the bokeh result is blended in, and the fraction of its texture that was written
+	struct BokehCompositeBufferType
+	{
+		XMFLOAT2 bokehUVScale;
+		float bokeh;
+		float padding;
 	};
 
 	// Initialization function
@@ -31,5 +50,6 @@ private:
 	ID3D11Buffer* matrixBuffer;
 	ID3D11SamplerState* sampleState;
 	ID3D11Buffer* activeBuffer;
+	ID3D11Buffer* bokehBuffer;
 };
 #pragma once
@@ -0,0 +1,128 @@
+#include "PostStackShader.h"
+#include "MemoryTracker.h"
+
+
+PostStackShader::PostStackShader(ID3D11Device* device, HWND hwnd, int w, int h) : BaseShader(device, hwnd)
+{
+	width = max(w, 1);
+	height = max(h, 1);
+	initShader(L"post_stack_cs.cso", NULL);
+}
+
+
+PostStackShader::~PostStackShader()
+{
+	// Release the result texture and its views
+	if (postUAV)
+	{
+		postUAV->Release();
+		postUAV = 0;
+	}
+	if (postSRV)
+	{
+		postSRV->Release();
+		postSRV = 0;
+	}
+	if (postTexture)
+	{
+		postTexture->Release();
+		postTexture = 0;
+	}
+
+	// Release the sampler state
+	if (sampleState)
+	{
+		sampleState->Release();
+		sampleState = 0;
+	}
+
+	// Release the constant buffer
+	if (postStackBuffer)
+	{
+		postStackBuffer->Release();
+		postStackBuffer = 0;
+	}
+
+	//Release base shader components
+	BaseShader::~BaseShader();
+}
+
+void PostStackShader::initShader(const wchar_t* cfile, const wchar_t* blank)
+{
+	// Load (+ compile) shader file
+	loadComputeShader(cfile);
+
+	// Setup the description of the post stack buffer, sent to the Compute Shader
+	D3D11_BUFFER_DESC bufferDesc;
+	bufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+	bufferDesc.ByteWidth = sizeof(PostStackBufferType);
+	bufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	bufferDesc.MiscFlags = 0;
+	bufferDesc.StructureByteStride = 0;
+	renderer->CreateBuffer(&bufferDesc, NULL, &postStackBuffer);
+	MemoryTracker::track(postStackBuffer, MEMORY_CONSTANTS, "Post stack constants");
+
+	// Bilinear, clamped sampler for upsampling the half resolution bokeh result
+	sampleState = StateCache::get()->getSamplerState(StateCache::linearClamp());
+
+	// The result, written by the stack and read by the final pass
+	D3D11_TEXTURE2D_DESC textureDesc;
+	ZeroMemory(&textureDesc, sizeof(textureDesc));
+	textureDesc.Width = width;
+	textureDesc.Height = height;
+	textureDesc.MipLevels = 1;
+	textureDesc.ArraySize = 1;
+	textureDesc.Format = DXGI_FORMAT_R16G16B16A16_FLOAT;
+	textureDesc.SampleDesc.Count = 1;
+	textureDesc.Usage = D3D11_USAGE_DEFAULT;
+	textureDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS;
+	renderer->CreateTexture2D(&textureDesc, NULL, &postTexture);
+	MemoryTracker::track(postTexture, MEMORY_RENDER_TARGET, "Post stack output");
+	renderer->CreateShaderResourceView(postTexture, NULL, &postSRV);
+	renderer->CreateUnorderedAccessView(postTexture, NULL, &postUAV);
+}
+
+void PostStackShader::apply(ID3D11DeviceContext* deviceContext, const vector<PostEffect>& effects, const PostStackSettings& settings, ID3D11ShaderResourceView* scene, ID3D11ShaderResourceView* depth, ID3D11ShaderResourceView* bokeh, XMFLOAT2 bokehUVScale, int renderWidth, int renderHeight, float nearPlane, float farPlane, bool linearDepth)
+{
+	UINT regionWidth = min(max(renderWidth, 1), width);
+	UINT regionHeight = min(max(renderHeight, 1), height);
+
+	// Set the effect list and settings and send to the Compute Shader. Only a blur needs the tile's neighbours loaded
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	deviceContext->Map(postStackBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+	PostStackBufferType* postPtr = (PostStackBufferType*)mappedResource.pData;
+	postPtr->renderSize[0] = regionWidth;
+	postPtr->renderSize[1] = regionHeight;
+	postPtr->effectCount = (UINT)min((int)effects.size(), PostStack::MAX_EFFECTS);
+	postPtr->apron = PostStack::needsNeighbours(effects) ? PostStack::MAX_BLUR_RADIUS : 0;
+	for (int i = 0; i < PostStack::MAX_EFFECTS; i++)
+	{
+		postPtr->effects[i] = i < (int)postPtr->effectCount ? (UINT)effects[i] : 0;
+	}
+	postPtr->blurRadius = min(settings.blurRadius, (float)PostStack::MAX_BLUR_RADIUS);
+	postPtr->dofWeight = settings.dofWeight;
+	postPtr->dofCutoff = settings.dofCutoff;
+	postPtr->exposure = settings.exposure;
+	postPtr->saturation = settings.saturation;
+	postPtr->contrast = settings.contrast;
+	postPtr->bokehUVScale = bokehUVScale;
+	postPtr->nearPlane = nearPlane;
+	postPtr->farPlane = farPlane;
+	postPtr->linearDepth = linearDepth ? 1.0f : 0.0f;
+	postPtr->padding = 0.0f;
+	deviceContext->Unmap(postStackBuffer, 0);
+	deviceContext->CSSetConstantBuffers(0, 1, &postStackBuffer);
+
+	// One group per tile of the region
+	ID3D11ShaderResourceView* srvs[3] = { scene, depth, bokeh };
+	ID3D11ShaderResourceView* nullSRV[3] = { NULL, NULL, NULL };
+	ID3D11UnorderedAccessView* nullUAV = NULL;
+	deviceContext->CSSetShaderResources(0, 3, srvs);
+	deviceContext->CSSetSamplers(0, 1, &sampleState);
+	deviceContext->CSSetUnorderedAccessViews(0, 1, &postUAV, 0);
+	compute(deviceContext, (regionWidth + TILE_SIZE - 1) / TILE_SIZE, (regionHeight + TILE_SIZE - 1) / TILE_SIZE, 1);
+	deviceContext->CSSetShaderResources(0, 3, nullSRV);
+	deviceContext->CSSetUnorderedAccessViews(0, 1, &nullUAV, 0);
+	deviceContext->CSSetShader(NULL, NULL, 0);
+}
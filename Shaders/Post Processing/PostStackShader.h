@@ -0,0 +1,70 @@
+// Post Stack Shader runs a list of post processing effects over the rendered region of the scene in one compute dispatch, keeping the tile
+// being worked on in groupshared memory so the blur never has to be written out and read back. The result is left at the scene's resolution,
+// for the final pass to upsample to the screen as it is
+#pragma once
+
+#include "DXF.h"
+#include "StateCache.h"
+#include "PostStack.h"
+
+using namespace std;
+using namespace DirectX;
+
+class PostStackShader : public BaseShader
+{
+private:
+
+	// Stores the region rendered to, the texels loaded around each tile, the effects to run in order, and each effect's settings
+	struct PostStackBufferType
+	{
+		UINT renderSize[2];
+		UINT effectCount;
+		UINT apron;
+		UINT effects[PostStack::MAX_EFFECTS];
+		float blurRadius;
+		float dofWeight;
+		float dofCutoff;
+		float exposure;
+		float saturation;
+		float contrast;
+		XMFLOAT2 bokehUVScale;
+		float nearPlane;
+		float farPlane;
+		float linearDepth;
+		float padding;
+	};
+
+public:
+
+	static const int FOCUS_SLOT = 1;
+
+	// Sized for a scene of width x height, of which any top left region can be rendered to
+	PostStackShader(ID3D11Device* device, HWND hwnd, int width, int height);
+	~PostStackShader();
+
+	// Runs effects in order over the top left renderWidth x renderHeight of the scene. The camera depth is only read for the depth of field,
+	// and the bokeh result only for its composite. The focus is read from the autofocus shader's buffer, bound to compute register FOCUS_SLOT
+	void apply(ID3D11DeviceContext* deviceContext, const vector<PostEffect>& effects, const PostStackSettings& settings, ID3D11ShaderResourceView* scene, ID3D11ShaderResourceView* depth, ID3D11ShaderResourceView* bokeh, XMFLOAT2 bokehUVScale, int renderWidth, int renderHeight, float nearPlane, float farPlane, bool linearDepth);
+
+	// The stack's result, covering the same top left region of the texture as the scene did
+	ID3D11ShaderResourceView* getShaderResourceView() { return postSRV; }
+
+	// Bytes a texel of the result takes
+	static const int RESULT_BYTES = 8;
+
+private:
+	void initShader(const wchar_t* cfile, const wchar_t* blank);
+
+private:
+	static const int TILE_SIZE = 16;
+
+	int width;
+	int height;
+
+	ID3D11Buffer* postStackBuffer;
+	ID3D11SamplerState* sampleState;
+
+	ID3D11Texture2D* postTexture;
+	ID3D11ShaderResourceView* postSRV;
+	ID3D11UnorderedAccessView* postUAV;
+};
@@ -0,0 +1,70 @@
+// Autofocus Compute Shader
+// A single group reduces a grid of samples over the centre of the camera depth to one weighted focus distance, the samples weighted less the
+// further they are from the centre, then eases the focus it kept from the last frame towards it. The result is copied into the constant buffer
+// the depth of field passes read, so the focus never has to come back to the CPU
+
+Texture2D<float> depthTexture : register(t0);
+RWByteAddressBuffer focusState : register(u0);
+
+// Stores the region rendered to, the size of the region sampled, how quickly the focus follows and how the camera depth is stored
+cbuffer AutofocusBuffer : register(b0)
+{
+    uint2 renderSize;
+    float regionSize;
+    float smoothing;
+    float nearPlane;
+    float farPlane;
+    float linearDepth;
+    float deltaTime;
+};
+
+static const uint GRID_SIZE = 16;
+
+groupshared float weightedDepth[GRID_SIZE * GRID_SIZE];
+groupshared float weights[GRID_SIZE * GRID_SIZE];
+
+// Distance along the view direction, with nothing drawn counting as the far plane
+float ViewDepth(float storedDepth)
+{
+    if (storedDepth <= 0.0f)
+    {
+        return farPlane;
+    }
+    if (linearDepth)
+    {
+        return nearPlane + storedDepth * (farPlane - nearPlane);
+    }
+    return nearPlane * farPlane / (farPlane - storedDepth * (farPlane - nearPlane));
+}
+
+[numthreads(16, 16, 1)]
+void main(uint3 groupThreadID : SV_GroupThreadID, uint groupIndex : SV_GroupIndex)
+{
+    // Each thread takes one point of a grid spread over the centre region, weighted by a gaussian falling to about a tenth at its edge
+    float2 offset = (float2(groupThreadID.xy) + 0.5f) / GRID_SIZE * 2.0f - 1.0f;
+    float2 uv = 0.5f + offset * regionSize * 0.5f;
+    int2 texel = (int2)min(uint2(uv * renderSize), renderSize - 1);
+    float weight = exp(-dot(offset, offset) * 2.3f);
+    weightedDepth[groupIndex] = ViewDepth(depthTexture.Load(int3(texel, 0))) * weight;
+    weights[groupIndex] = weight;
+    GroupMemoryBarrierWithGroupSync();
+
+    for (uint stride = GRID_SIZE * GRID_SIZE / 2; stride > 0; stride >>= 1)
+    {
+        if (groupIndex < stride)
+        {
+            weightedDepth[groupIndex] += weightedDepth[groupIndex + stride];
+            weights[groupIndex] += weights[groupIndex + stride];
+        }
+        GroupMemoryBarrierWithGroupSync();
+    }
+
+    if (groupIndex == 0)
+    {
+        // The state holds the eased focus, the focus it's heading for, and whether it has been set, starting straight at the target if not
+        float target = weightedDepth[0] / weights[0];
+        float4 state = asfloat(focusState.Load4(0));
+        float focus = state.z > 0.0f ? lerp(state.x, target, saturate(1.0f - exp(-smoothing * deltaTime))) : target;
+        focusState.Store4(0, asuint(float4(focus, target, 1.0f, 0.0f)));
+    }
+}
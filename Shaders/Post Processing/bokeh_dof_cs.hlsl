@@ -0,0 +1,230 @@
+// Bokeh Depth of Field Compute Shader
+// Runs as three passes over a half resolution copy of the scene, picked by passIndex. The first halves the scene, gives each texel a signed circle
+// of confusion and finds each tile's largest. The second lists the tiles needing blur, counting them into the arguments of the third, which gathers
+// a disc around every texel of each listed tile. In focus tiles are never gathered, so the cost follows how much of the screen is out of focus
+// The gather mirrors BokehDepthOfField::gather on the CPU, which it is checked against
+
+// Matches BokehTile in BokehDepthOfField.h
+struct BokehTile
+{
+    uint coords;
+    uint tileClass;
+    float radius;
+    float padding;
+};
+
+Texture2D<float4> sceneTexture : register(t0);
+Texture2D<float> depthTexture : register(t1);
+Texture2D<float4> halfTexture : register(t2);
+Texture2D<float2> tileTexture : register(t3);
+StructuredBuffer<BokehTile> listedTiles : register(t4);
+
+RWTexture2D<float4> halfOutput : register(u0);
+RWTexture2D<float4> bokehOutput : register(u1);
+RWTexture2D<float2> tileOutput : register(u2);
+RWStructuredBuffer<BokehTile> tileList : register(u3);
+RWByteAddressBuffer tileArguments : register(u4);
+
+// Stores the region rendered to, the half resolution and tile sizes, the pass being run, how the blur grows and how the camera depth is stored
+cbuffer BokehBuffer : register(b0)
+{
+    uint2 renderSize;
+    uint2 halfSize;
+    uint2 tileCount;
+    uint passIndex;
+    float maxRadius;
+    float focusRange;
+    float inFocusThreshold;
+    float nearPlane;
+    float farPlane;
+    float linearDepth;
+    float3 padding;
+};
+
+// The focus the autofocus settled on this frame, or the manual focus
+cbuffer FocusBuffer : register(b1)
+{
+    float focusDistance;
+    float targetDistance;
+    float focusValid;
+    float focusPadding;
+};
+
+static const uint TILE_SIZE = 8;
+
+// Matches BokehDepthOfField::MAX_RADIUS, and the tiles away near blur that large can spill
+static const int MAX_RADIUS = 16;
+static const int NEAR_REACH_TILES = (MAX_RADIUS + (int)TILE_SIZE - 1) / (int)TILE_SIZE;
+static const uint TILE_NEAR = 2;
+static const uint TILE_FAR = 1;
+
+groupshared float tileFar[TILE_SIZE * TILE_SIZE];
+groupshared float tileNear[TILE_SIZE * TILE_SIZE];
+
+// Distance along the view direction, with nothing drawn counting as the far plane
+float ViewDepth(float storedDepth)
+{
+    if (storedDepth <= 0.0f)
+    {
+        return farPlane;
+    }
+    if (linearDepth)
+    {
+        return nearPlane + storedDepth * (farPlane - nearPlane);
+    }
+    return nearPlane * farPlane / (farPlane - storedDepth * (farPlane - nearPlane));
+}
+
+float CircleOfConfusion(float viewZ)
+{
+    return clamp((viewZ - focusDistance) / max(focusRange, 0.001f), -1.0f, 1.0f) * maxRadius;
+}
+
+// Averages each 2x2 block of the scene, taking the nearest depth so thin foreground edges keep their blur, then reduces the tile's largest blurs
+void Prepare(uint2 texel, uint groupIndex, uint2 tile)
+{
+    bool inside = all(texel < halfSize);
+    float coc = 0.0f;
+    if (inside)
+    {
+        float3 colour = float3(0.0f, 0.0f, 0.0f);
+        float nearest = farPlane;
+        for (uint y = 0; y < 2; y++)
+        {
+            for (uint x = 0; x < 2; x++)
+            {
+                int3 source = int3(min(texel * 2 + uint2(x, y), renderSize - 1), 0);
+                colour += sceneTexture.Load(source).rgb;
+                nearest = min(nearest, ViewDepth(depthTexture.Load(source)));
+            }
+        }
+        colour *= 0.25f;
+        coc = CircleOfConfusion(nearest);
+        halfOutput[texel] = float4(colour, coc);
+
+        // Nothing to blend until a gather says otherwise, so in focus tiles need no more work
+        bokehOutput[texel] = float4(colour, 0.0f);
+    }
+
+    tileFar[groupIndex] = abs(coc);
+    tileNear[groupIndex] = max(-coc, 0.0f);
+    GroupMemoryBarrierWithGroupSync();
+    for (uint stride = TILE_SIZE * TILE_SIZE / 2; stride > 0; stride >>= 1)
+    {
+        if (groupIndex < stride)
+        {
+            tileFar[groupIndex] = max(tileFar[groupIndex], tileFar[groupIndex + stride]);
+            tileNear[groupIndex] = max(tileNear[groupIndex], tileNear[groupIndex + stride]);
+        }
+        GroupMemoryBarrierWithGroupSync();
+    }
+    if (groupIndex == 0)
+    {
+        tileOutput[tile] = float2(tileFar[0], tileNear[0]);
+    }
+}
+
+// Lists a tile if its own blur, or near blur spilling in from any tile close enough for it to reach, is large enough to see
+void Classify(uint2 tile)
+{
+    if (any(tile >= tileCount))
+    {
+        return;
+    }
+
+    float nearReach = 0.0f;
+    for (int y = -NEAR_REACH_TILES; y <= NEAR_REACH_TILES; y++)
+    {
+        for (int x = -NEAR_REACH_TILES; x <= NEAR_REACH_TILES; x++)
+        {
+            int2 neighbour = clamp((int2)tile + int2(x, y), int2(0, 0), (int2)tileCount - 1);
+            nearReach = max(nearReach, tileTexture.Load(int3(neighbour, 0)).y);
+        }
+    }
+
+    float radius = max(tileTexture.Load(int3(tile, 0)).x, nearReach);
+    if (radius < inFocusThreshold)
+    {
+        return;
+    }
+
+    // The first argument is the group count of the gather, the fourth counts the near tiles for the statistics
+    BokehTile listed;
+    listed.coords = tile.x | (tile.y << 16);
+    listed.tileClass = nearReach >= inFocusThreshold ? TILE_NEAR : TILE_FAR;
+    listed.radius = radius;
+    listed.padding = 0.0f;
+    uint index;
+    tileArguments.InterlockedAdd(0, 1, index);
+    tileList[index] = listed;
+    if (listed.tileClass == TILE_NEAR)
+    {
+        uint nearIndex;
+        tileArguments.InterlockedAdd(12, 1, nearIndex);
+    }
+}
+
+// Gathers rings of samples one texel apart, each sample reaching as far as its own blur, out to the largest blur that reaches the tile
+void Gather(uint listIndex, uint2 threadInTile)
+{
+    BokehTile listed = listedTiles[listIndex];
+    uint2 texel = uint2(listed.coords & 0xffff, listed.coords >> 16) * TILE_SIZE + threadInTile;
+    if (any(texel >= halfSize))
+    {
+        return;
+    }
+
+    float4 centre = halfTexture.Load(int3(texel, 0));
+    float centreWeight = saturate(abs(centre.w) + 0.5f);
+    float3 sum = centre.rgb * centreWeight;
+    float total = centreWeight;
+    float nearWeight = centre.w < 0.0f ? centreWeight : 0.0f;
+
+    int rings = (int)ceil(min(listed.radius, maxRadius));
+    for (int ring = 1; ring <= rings; ring++)
+    {
+        int count = ring * 6;
+        for (int i = 0; i < count; i++)
+        {
+            float angle = 6.28318531f * i / count;
+            int2 position = clamp((int2)floor(float2(texel) + 0.5f + float2(cos(angle), sin(angle)) * ring), int2(0, 0), (int2)halfSize - 1);
+            float4 sample = halfTexture.Load(int3(position, 0));
+
+            // Something behind the centre can't blur over it further than the centre itself is blurred
+            float reach = abs(sample.w);
+            if (sample.w > centre.w)
+            {
+                reach = min(reach, abs(centre.w));
+            }
+            float weight = saturate(reach - ring + 0.5f);
+            sum += sample.rgb * weight;
+            total += weight;
+            nearWeight += sample.w < 0.0f ? weight : 0.0f;
+        }
+    }
+
+    // Blends in as the centre's own blur grows, or as near blur covers it
+    float blend = saturate(abs(centre.w) * 0.5f);
+    if (listed.tileClass == TILE_NEAR)
+    {
+        blend = max(blend, nearWeight / total);
+    }
+    bokehOutput[texel] = float4(sum / total, blend);
+}
+
+[numthreads(8, 8, 1)]
+void main(uint3 dispatchThreadID : SV_DispatchThreadID, uint3 groupThreadID : SV_GroupThreadID, uint3 groupID : SV_GroupID, uint groupIndex : SV_GroupIndex)
+{
+    if (passIndex == 0)
+    {
+        Prepare(dispatchThreadID.xy, groupIndex, groupID.xy);
+    }
+    else if (passIndex == 1)
+    {
+        Classify(dispatchThreadID.xy);
+    }
+    else
+    {
+        Gather(groupID.x, groupThreadID.xy);
+    }
+}
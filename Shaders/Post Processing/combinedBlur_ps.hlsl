@@ -1,15 +1,18 @@
 // Combined Blur pixel shader
 // Calculates a basic gaussian blur, weighting the further away pixels less than the more central ones. Only blurs in the X and Y axis, for easier division
+#include "upsample_h.hlsli"
 
 Texture2D shaderTexture : register(t0);
 SamplerState SampleType : register(s0);
 
-// Stores the screen's size 
+// Stores the screen's size, the fraction of the screen texture the scene was rendered to, and how many texels either side are blurred
 cbuffer ScreenSizeBuffer : register(b0)
 {
     float screenWidth;
     float screenHeight;
-    float2 padding;
+    float2 uvScale;
+    float blurRadius;
+    float3 padding;
 };
 
 struct InputType
@@ -20,16 +23,11 @@ struct InputType
 
 float4 main(InputType input) : SV_TARGET
 {
-    float weight0, weight1, weight2, weight3, weight4;
     float4 colour;
     
-    // Create the weights that each neighbor pixel will contribute to the blur. Overall, only 17 pixels affect the blur, 
+    // Create the weights that each neighbor pixel will contribute to the blur. At the full radius only 17 pixels affect the blur, 
     // but those pixels are enough to generate a decent gaussian blur.
-    weight0 = 0.30;
-    weight1 = 0.25 / 4;
-    weight2 = 0.20 / 4;
-    weight3 = 0.15 / 4;
-    weight4 = 0.10 / 4;
+    float weights[5] = { 0.30, 0.25 / 4, 0.20 / 4, 0.15 / 4, 0.10 / 4 };
 
 	// Initialize the colour to black.
     colour = float4(0.0f, 0.0f, 0.0f, 0.0f);
@@ -37,28 +35,29 @@ float4 main(InputType input) : SV_TARGET
     // Initializes the tex coord size, depending on the screen height and width
     float HtexelSize = 1.0f / screenWidth;
     float VtexelSize = 1.0f / screenHeight;
+    float2 texelSize = float2(HtexelSize, VtexelSize);
     
-    // Samples the pixels going along the X (U) axis, taking all 8 of them plus the original texture colour
-    colour += shaderTexture.Sample(SampleType, input.tex + float2(HtexelSize * -4.0f, 0.0f)) * weight4;
-    colour += shaderTexture.Sample(SampleType, input.tex + float2(HtexelSize * -3.0f, 0.0f)) * weight3;
-    colour += shaderTexture.Sample(SampleType, input.tex + float2(HtexelSize * -2.0f, 0.0f)) * weight2;
-    colour += shaderTexture.Sample(SampleType, input.tex + float2(HtexelSize * -1.0f, 0.0f)) * weight1;
-    colour += shaderTexture.Sample(SampleType, input.tex) * weight0;
-    colour += shaderTexture.Sample(SampleType, input.tex + float2(HtexelSize * 1.0f, 0.0f)) * weight1;
-    colour += shaderTexture.Sample(SampleType, input.tex + float2(HtexelSize * 2.0f, 0.0f)) * weight2;
-    colour += shaderTexture.Sample(SampleType, input.tex + float2(HtexelSize * 3.0f, 0.0f)) * weight3;
-    colour += shaderTexture.Sample(SampleType, input.tex + float2(HtexelSize * 4.0f, 0.0f)) * weight4;
+    // Maps the blur texture's viewport onto the region of the screen texture that was rendered to
+    float2 tex = input.tex * uvScale;
     
-    // Samples the pixels going along the Y (V) axis, taking all 8 of them
-    colour += shaderTexture.Sample(SampleType, input.tex + float2(0.0f, VtexelSize * -4.0f)) * weight4;
-    colour += shaderTexture.Sample(SampleType, input.tex + float2(0.0f, VtexelSize * -3.0f)) * weight3;
-    colour += shaderTexture.Sample(SampleType, input.tex + float2(0.0f, VtexelSize * -2.0f)) * weight2;
-    colour += shaderTexture.Sample(SampleType, input.tex + float2(0.0f, VtexelSize * -1.0f)) * weight1;
-    colour += shaderTexture.Sample(SampleType, input.tex + float2(0.0f, VtexelSize * 1.0f)) * weight1;
-    colour += shaderTexture.Sample(SampleType, input.tex + float2(0.0f, VtexelSize * 2.0f)) * weight2;
-    colour += shaderTexture.Sample(SampleType, input.tex + float2(0.0f, VtexelSize * 3.0f)) * weight3;
-    colour += shaderTexture.Sample(SampleType, input.tex + float2(0.0f, VtexelSize * 4.0f)) * weight4;
+    // Samples the original texture colour, then the pixels either side along the X (U) and Y (V) axis out to the blur radius
+    colour += shaderTexture.Sample(SampleType, ClampToRegion(tex, uvScale, texelSize)) * weights[0];
+    float totalWeight = weights[0];
+    [unroll]
+    for (int i = 1; i <= 4; i++)
+    {
+        if (i <= blurRadius)
+        {
+            colour += shaderTexture.Sample(SampleType, ClampToRegion(tex + float2(HtexelSize * -i, 0.0f), uvScale, texelSize)) * weights[i];
+            colour += shaderTexture.Sample(SampleType, ClampToRegion(tex + float2(HtexelSize * i, 0.0f), uvScale, texelSize)) * weights[i];
+            colour += shaderTexture.Sample(SampleType, ClampToRegion(tex + float2(0.0f, VtexelSize * -i), uvScale, texelSize)) * weights[i];
+            colour += shaderTexture.Sample(SampleType, ClampToRegion(tex + float2(0.0f, VtexelSize * i), uvScale, texelSize)) * weights[i];
+            totalWeight += weights[i] * 4;
+        }
+    }
     
+    // A smaller radius leaves out the outer weights, so divides by what was actually sampled to keep the brightness the same
+    colour /= totalWeight;
 
 	// Set the alpha channel to one.
     colour.a = 1.0f;
@@ -1,12 +1,16 @@
 // Depth of Field Pixel Shader
 // Samples the depth map from the Camera's perspective, then changes the values to more usable ones, and lerps between the blurred and normal texture depending on the difference in
-// depth from the centre pixel to the current one. Also can apply a cutoff for more interesting results
+// depth from the focus to the current pixel. Also can apply a cutoff for more interesting results
+// The focus is found once a frame by the autofocus shader, rather than every pixel sampling the centre of the screen
+// The scene may have been rendered to only part of the textures, in which case this is also where it's upsampled to the screen
 #include "light_h.hlsli"
+#include "upsample_h.hlsli"
 
 // Texture and sampler registers
 Texture2D normalTexture : register(t0);
 Texture2D blurTexture : register(t1);
 Texture2D depthTexture : register(t2);
+Texture2D bokehTexture : register(t3);
 
 SamplerState Sampler0 : register(s0);
 
@@ -23,24 +27,88 @@ cbuffer ActiveBuffer : register(b0)
     float cutoff;
     float weight;
     float active;
+    float2 uvScale;
+    float bicubic;
+    float padding;
 };
 
+// How the camera depth texture was stored, linear between the near and far planes or as z / w
+cbuffer DepthStorageBuffer : register(b1)
+{
+    float nearPlane;
+    float farPlane;
+    float linearDepth;
+    float padding1;
+};
+
+// Whether the half resolution bokeh result is blended in, in place of the blur texture, and the fraction of it that was written
+cbuffer BokehCompositeBuffer : register(b2)
+{
+    float2 bokehUVScale;
+    float bokeh;
+    float padding2;
+};
+
+// The focus the autofocus settled on this frame, or the manual focus
+cbuffer FocusBuffer : register(b3)
+{
+    float focusDistance;
+    float targetDistance;
+    float focusValid;
+    float focusPadding;
+};
+
+// Distance along the view direction, read straight from linear depth and only linearized when stored as z / w
+float ViewDepth(float storedDepth)
+{
+    if (linearDepth)
+    {
+        return nearPlane + storedDepth * (farPlane - nearPlane);
+    }
+    return LinearizeDepth(storedDepth, nearPlane, farPlane);
+}
+
 float4 main(InputType input) : SV_TARGET
 {
-    // Samples the scene and blur texture, as well as sampling the depth (and generating a more appropriate value) from both the centre of the screen and the current pixel
-    // Would normally divide by the Far variable (200.0f), however decided to divide by 75 to get more distinct values
-    float4 textureColour = normalTexture.Sample(Sampler0, input.tex);
-    float4 blurColour = blurTexture.Sample(Sampler0, input.tex);
-    float depth = LinearizeDepth(depthTexture.Sample(Sampler0, input.tex).x, 0.1f, 200.0f) / 75;
-    float centreDepth = LinearizeDepth(depthTexture.Sample(Sampler0, float2(0.5f, 0.5f)).x, 0.1f, 200.0f) / 75;
+    // Samples the scene with the chosen upsampling filter. The blur and depth are only sampled when the blend below needs them, so the post
+    // stack's result, which has had its depth of field applied already, is only read once
+    float4 textureColour;
+    if (bicubic)
+    {
+        textureColour = SampleRegionCatmullRom(normalTexture, Sampler0, input.tex, uvScale);
+    }
+    else
+    {
+        textureColour = SampleRegionBilinear(normalTexture, Sampler0, input.tex, uvScale);
+    }
     
     // Only runs if depth of field is allowed, otherwise returns just the normal texture colour
-    if (active)
+    if (active && bokeh)
+    {
+        // The compute shader has already blurred what needs it, and says how much of it to show
+        float4 bokehColour = SampleRegionBilinear(bokehTexture, Sampler0, input.tex, bokehUVScale);
+        return float4(lerp(textureColour.rgb, bokehColour.rgb, bokehColour.a), textureColour.a);
+    }
+    else if (active)
     {
+        // Samples the blur texture, as well as sampling the depth (and generating a more appropriate value) of the current pixel to compare with the focus
+        // Would normally divide by the Far variable (200.0f), however decided to divide by 75 to get more distinct values
+        // Depth is only ever sampled bilinearly so edges don't ring
+        float4 blurColour;
+        if (bicubic)
+        {
+            blurColour = SampleRegionCatmullRom(blurTexture, Sampler0, input.tex, uvScale);
+        }
+        else
+        {
+            blurColour = SampleRegionBilinear(blurTexture, Sampler0, input.tex, uvScale);
+        }
+        float depth = ViewDepth(SampleRegionBilinear(depthTexture, Sampler0, input.tex, uvScale).x) / 75;
+        float centreDepth = focusDistance / 75;
         float4 finalColour = { 0, 0, 0, 1 };
         float lerpValue;
         
-        // Finds the absolute value (between 0 and 1) from the distance in depth values between the centre pixel and the current one
+        // Finds the absolute value (between 0 and 1) from the distance in depth values between the focus and the current pixel
         lerpValue = abs(centreDepth - depth);
         
         // If the value is above the cutoff, blurs entirely. Allows for a more noticeable Depth of Field view
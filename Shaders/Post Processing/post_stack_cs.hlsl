@@ -0,0 +1,170 @@
+// Post Stack Compute Shader
+// Runs the whole post processing stack in one dispatch, each group loading a 16x16 tile of the scene (with an apron around it for the blur)
+// into groupshared memory once, then applying the listed effects in order without writing anything in between. Replaces the blur pass and the
+// depth of field blend of the final pass, which had to write a blurred copy of the whole screen and read it back again
+// The blur and depth of field mirror combinedBlur_ps and depth_of_field_ps, so the two paths can be compared
+#include "upsample_h.hlsli"
+
+Texture2D<float4> sceneTexture : register(t0);
+Texture2D<float> depthTexture : register(t1);
+Texture2D<float4> bokehTexture : register(t2);
+SamplerState linearSampler : register(s0);
+
+RWTexture2D<float4> postOutput : register(u0);
+
+// Stores the region rendered to, the texels loaded around each tile, the effects to run in order, and each effect's settings
+cbuffer PostStackBuffer : register(b0)
+{
+    uint2 renderSize;
+    uint effectCount;
+    uint apron;
+    uint4 effects[2];
+    float blurRadius;
+    float dofWeight;
+    float dofCutoff;
+    float exposure;
+    float saturation;
+    float contrast;
+    float2 bokehUVScale;
+    float nearPlane;
+    float farPlane;
+    float linearDepth;
+    float padding;
+};
+
+// The focus the autofocus settled on this frame, or the manual focus
+cbuffer FocusBuffer : register(b1)
+{
+    float focusDistance;
+    float targetDistance;
+    float focusValid;
+    float focusPadding;
+};
+
+// Matches PostEffect in PostStack.h
+static const uint EFFECT_BLUR = 0;
+static const uint EFFECT_DEPTH_OF_FIELD = 1;
+static const uint EFFECT_BOKEH = 2;
+static const uint EFFECT_TONEMAP = 3;
+static const uint EFFECT_COLOUR_GRADE = 4;
+
+static const uint TILE_SIZE = 16;
+static const uint MAX_APRON = 4;
+static const uint MAX_SIDE = TILE_SIZE + MAX_APRON * 2;
+
+groupshared float3 tileColour[MAX_SIDE * MAX_SIDE];
+
+// Distance along the view direction, read straight from linear depth and only linearized when stored as z / w
+float ViewDepth(float storedDepth)
+{
+    if (linearDepth)
+    {
+        return nearPlane + storedDepth * (farPlane - nearPlane);
+    }
+    return nearPlane * farPlane / (farPlane - storedDepth * (farPlane - nearPlane));
+}
+
+// The same cross shaped gaussian as the combined blur, taken from the tile instead of the texture
+float3 Blur(uint2 local, uint side)
+{
+    float weights[5] = { 0.30, 0.25 / 4, 0.20 / 4, 0.15 / 4, 0.10 / 4 };
+    uint centre = local.y * side + local.x;
+    float3 colour = tileColour[centre] * weights[0];
+    float totalWeight = weights[0];
+    [unroll]
+    for (uint i = 1; i <= MAX_APRON; i++)
+    {
+        if (i <= apron && i <= blurRadius)
+        {
+            colour += tileColour[centre - i] * weights[i];
+            colour += tileColour[centre + i] * weights[i];
+            colour += tileColour[centre - i * side] * weights[i];
+            colour += tileColour[centre + i * side] * weights[i];
+            totalWeight += weights[i] * 4;
+        }
+    }
+    return colour / totalWeight;
+}
+
+// Lerps towards the blur by the distance from the focus, blurring entirely past the cutoff
+float3 DepthOfField(float3 colour, float3 blurred, uint2 texel)
+{
+    float depth = ViewDepth(depthTexture.Load(int3(texel, 0))) / 75;
+    float lerpValue = abs(focusDistance / 75 - depth);
+    if (lerpValue > dofCutoff)
+    {
+        return blurred;
+    }
+    return lerp(colour, blurred, lerpValue * dofWeight);
+}
+
+// The bokeh result says how much of its blurred colour to show over the scene
+float3 Bokeh(float3 colour, uint2 texel)
+{
+    float4 bokehColour = SampleRegionBilinear(bokehTexture, linearSampler, (float2(texel) + 0.5f) / float2(renderSize), bokehUVScale);
+    return lerp(colour, bokehColour.rgb, bokehColour.a);
+}
+
+// Narkowicz's fit of the ACES filmic curve
+float3 Tonemap(float3 colour)
+{
+    float3 x = colour * exposure;
+    return saturate(x * (2.51f * x + 0.03f) / (x * (2.43f * x + 0.59f) + 0.14f));
+}
+
+float3 ColourGrade(float3 colour)
+{
+    float luminance = dot(colour, float3(0.2126f, 0.7152f, 0.0722f));
+    colour = lerp(luminance.xxx, colour, saturation);
+    return max((colour - 0.5f) * contrast + 0.5f, 0.0f);
+}
+
+[numthreads(16, 16, 1)]
+void main(uint3 dispatchThreadID : SV_DispatchThreadID, uint3 groupThreadID : SV_GroupThreadID, uint3 groupID : SV_GroupID, uint groupIndex : SV_GroupIndex)
+{
+    // Loads the tile and its apron, clamped to the rendered region so nothing outside it bleeds in
+    uint side = TILE_SIZE + apron * 2;
+    int2 origin = int2(groupID.xy * TILE_SIZE) - (int)apron;
+    for (uint i = groupIndex; i < side * side; i += TILE_SIZE * TILE_SIZE)
+    {
+        int2 source = clamp(origin + int2(i % side, i / side), int2(0, 0), (int2)renderSize - 1);
+        tileColour[i] = sceneTexture.Load(int3(source, 0)).rgb;
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    uint2 texel = dispatchThreadID.xy;
+    if (any(texel >= renderSize))
+    {
+        return;
+    }
+
+    // Each effect works on the colour so far, with the blur held aside for the depth of field to lerp towards
+    uint2 local = groupThreadID.xy + apron;
+    float3 colour = tileColour[local.y * side + local.x];
+    float3 blurred = colour;
+    for (uint e = 0; e < effectCount; e++)
+    {
+        uint effect = effects[e / 4][e % 4];
+        if (effect == EFFECT_BLUR)
+        {
+            blurred = Blur(local, side);
+        }
+        else if (effect == EFFECT_DEPTH_OF_FIELD)
+        {
+            colour = DepthOfField(colour, blurred, texel);
+        }
+        else if (effect == EFFECT_BOKEH)
+        {
+            colour = Bokeh(colour, texel);
+        }
+        else if (effect == EFFECT_TONEMAP)
+        {
+            colour = Tonemap(colour);
+        }
+        else if (effect == EFFECT_COLOUR_GRADE)
+        {
+            colour = ColourGrade(colour);
+        }
+    }
+    postOutput[texel] = float4(colour, 1.0f);
+}
@@ -0,0 +1,60 @@
+// Mesh drawn from a range of the geometry registry's shared vertex and index buffers
+#include "RegisteredMesh.h"
+
+RegisteredMesh::RegisteredMesh()
+{
+	vertexBuffer = 0;
+	indexBuffer = 0;
+	vertexCount = 0;
+	indexCount = 0;
+	startIndex = 0;
+	baseVertex = 0;
+}
+
+// Release resources.
+RegisteredMesh::~RegisteredMesh()
+{
+	// The parent deconstructor drops this mesh's references to the shared buffers. It isn't called here as well, since running it twice
+	// would release buffers other meshes still draw from
+}
+
+void RegisteredMesh::initBuffers(ID3D11Device* device)
+{
+}
+
+void RegisteredMesh::setRange(ID3D11Buffer* sharedVertices, ID3D11Buffer* sharedIndices, int lbaseVertex, int lvertexCount, int lstartIndex, int lindexCount)
+{
+	// Takes the new buffers' references before dropping the old ones, in case they are the same
+	if (sharedVertices)
+	{
+		sharedVertices->AddRef();
+	}
+	if (sharedIndices)
+	{
+		sharedIndices->AddRef();
+	}
+	if (vertexBuffer)
+	{
+		vertexBuffer->Release();
+	}
+	if (indexBuffer)
+	{
+		indexBuffer->Release();
+	}
+	vertexBuffer = sharedVertices;
+	indexBuffer = sharedIndices;
+	baseVertex = lbaseVertex;
+	vertexCount = lvertexCount;
+	startIndex = lstartIndex;
+	indexCount = lindexCount;
+}
+
+void RegisteredMesh::sendData(ID3D11DeviceContext* deviceContext, D3D_PRIMITIVE_TOPOLOGY top)
+{
+	// Offsetting the bindings to the mesh's range stands in for the start index and base vertex, which the shaders' render calls leave at 0
+	unsigned int stride = sizeof(VertexType);
+	unsigned int offset = baseVertex * stride;
+	deviceContext->IASetVertexBuffers(0, 1, &vertexBuffer, &stride, &offset);
+	deviceContext->IASetIndexBuffer(indexBuffer, DXGI_FORMAT_R32_UINT, startIndex * sizeof(unsigned long));
+	deviceContext->IASetPrimitiveTopology(top);
+}
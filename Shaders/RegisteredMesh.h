@@ -0,0 +1,35 @@
+// A mesh whose vertices and indices are a range of the geometry registry's shared buffers. Sending its data binds those buffers offset to
+// its range, so it draws from index 0 and vertex 0 like any other mesh, or the registry's buffers can be bound once for several meshes
+// and each drawn with its start index and base vertex
+#pragma once
+
+#include "BaseMesh.h"
+
+using namespace DirectX;
+
+class RegisteredMesh : public BaseMesh
+{
+	friend class GeometryRegistry;
+
+public:
+	// The same layout as every other mesh's vertices, for building geometry to register
+	typedef VertexType Vertex;
+
+	RegisteredMesh();
+	~RegisteredMesh();
+
+	void sendData(ID3D11DeviceContext* deviceContext, D3D_PRIMITIVE_TOPOLOGY top = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+	int getStartIndex() const { return startIndex; }
+	int getBaseVertex() const { return baseVertex; }
+
+protected:
+	// The registry creates the buffers, so there is nothing to build here
+	void initBuffers(ID3D11Device* device);
+
+	// Points the mesh at its range of the registry's buffers, holding a reference to each
+	void setRange(ID3D11Buffer* sharedVertices, ID3D11Buffer* sharedIndices, int lbaseVertex, int lvertexCount, int lstartIndex, int lindexCount);
+
+	int startIndex;
+	int baseVertex;
+};
@@ -0,0 +1,199 @@
+#include "CubeShadowShader.h"
+#include "MemoryTracker.h"
+
+
+CubeShadowShader::CubeShadowShader(ID3D11Device* device, HWND hwnd, bool ltessellated) : BaseShader(device, hwnd)
+{
+	tessellated = ltessellated;
+	faceCount = 0;
+	if (tessellated)
+	{
+		initShader(L"cube_shadow_tess_vs.cso", L"cube_shadow_hs.cso", L"cube_shadow_ds.cso", L"cube_shadow_gs.cso", L"depth_ps.cso");
+	}
+	else
+	{
+		initShader(L"cube_shadow_vs.cso", L"depth_ps.cso");
+		loadGeometryShader(L"cube_shadow_gs.cso");
+	}
+}
+
+
+CubeShadowShader::~CubeShadowShader()
+{
+	if (sampleState)
+	{
+		sampleState->Release();
+		sampleState = 0;
+	}
+	if (worldBuffer)
+	{
+		worldBuffer->Release();
+		worldBuffer = 0;
+	}
+	if (cubeShadowBuffer)
+	{
+		cubeShadowBuffer->Release();
+		cubeShadowBuffer = 0;
+	}
+	if (tessBuffer)
+	{
+		tessBuffer->Release();
+		tessBuffer = 0;
+	}
+	if (virtualTextureBuffer)
+	{
+		virtualTextureBuffer->Release();
+		virtualTextureBuffer = 0;
+	}
+	if (layout)
+	{
+		layout->Release();
+		layout = 0;
+	}
+
+	//Release base shader components
+	BaseShader::~BaseShader();
+}
+
+void CubeShadowShader::initShader(const wchar_t* vsFilename, const wchar_t* psFilename)
+{
+	D3D11_BUFFER_DESC bufferDesc;
+
+	// Load (+ compile) shader files
+	loadVertexShader(vsFilename);
+	loadPixelShader(psFilename);
+
+	// Setup the description of the world buffer, sent to the Vertex or Domain Shader
+	bufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+	bufferDesc.ByteWidth = sizeof(WorldBufferType);
+	bufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	bufferDesc.MiscFlags = 0;
+	bufferDesc.StructureByteStride = 0;
+	renderer->CreateBuffer(&bufferDesc, NULL, &worldBuffer);
+	MemoryTracker::track(worldBuffer, MEMORY_CONSTANTS, "Cube shadow world");
+
+	// Setup the description of the face buffer, sent to the Vertex and Geometry Shaders
+	bufferDesc.ByteWidth = sizeof(CubeShadowBufferType);
+	renderer->CreateBuffer(&bufferDesc, NULL, &cubeShadowBuffer);
+	MemoryTracker::track(cubeShadowBuffer, MEMORY_CONSTANTS, "Cube shadow faces");
+
+	// Setup the descriptions of the tessellation and virtual texture buffers, only used by the tessellated terrain
+	bufferDesc.ByteWidth = sizeof(TessBufferType);
+	renderer->CreateBuffer(&bufferDesc, NULL, &tessBuffer);
+	MemoryTracker::track(tessBuffer, MEMORY_CONSTANTS, "Cube shadow tessellation");
+	bufferDesc.ByteWidth = sizeof(VirtualTexture::VirtualTextureBufferType);
+	renderer->CreateBuffer(&bufferDesc, NULL, &virtualTextureBuffer);
+	MemoryTracker::track(virtualTextureBuffer, MEMORY_CONSTANTS, "Cube shadow virtual texture");
+
+	// Texture sampler state, shared
+	sampleState = StateCache::get()->getSamplerState(StateCache::anisotropicWrap());
+}
+
+void CubeShadowShader::initShader(const wchar_t* vsFilename, const wchar_t* hsFilename, const wchar_t* dsFilename, const wchar_t* gsFilename, const wchar_t* psFilename)
+{
+	// InitShader must be overwritten and it will load both vertex and pixel shaders + setup buffers
+	initShader(vsFilename, psFilename);
+
+	// Load other required shaders.
+	loadHullShader(hsFilename);
+	loadDomainShader(dsFilename);
+	loadGeometryShader(gsFilename);
+}
+
+void CubeShadowShader::setFaces(ID3D11DeviceContext* deviceContext, const PointShadowMap& pointShadow)
+{
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	const vector<int>& faces = pointShadow.getActiveFaces();
+	faceCount = (int)faces.size();
+
+	// Set every face's matrix, and the face each instance draws to, then send to the Vertex and Geometry Shaders
+	deviceContext->Map(cubeShadowBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+	CubeShadowBufferType* facePtr = (CubeShadowBufferType*)mappedResource.pData;
+	for (int face = 0; face < PointShadowMap::FACE_COUNT; face++)
+	{
+		facePtr->faceViewProjection[face] = XMMatrixTranspose(pointShadow.getFaceViewProjection(face));
+		facePtr->faceList[face][0] = face < faceCount ? faces[face] : 0;
+		facePtr->faceList[face][1] = 0;
+		facePtr->faceList[face][2] = 0;
+		facePtr->faceList[face][3] = 0;
+	}
+	deviceContext->Unmap(cubeShadowBuffer, 0);
+	StateCache::get()->setConstantBuffers(deviceContext, STAGE_VS, 1, 1, &cubeShadowBuffer);
+	StateCache::get()->setConstantBuffers(deviceContext, STAGE_GS, 0, 1, &cubeShadowBuffer);
+}
+
+void CubeShadowShader::setWorldMatrix(ID3D11DeviceContext* deviceContext, const XMMATRIX& worldMatrix)
+{
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+
+	// Set the world matrix and send to the Domain Shader for the terrain, or the Vertex Shader for meshes
+	deviceContext->Map(worldBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+	WorldBufferType* worldPtr = (WorldBufferType*)mappedResource.pData;
+	worldPtr->world = XMMatrixTranspose(worldMatrix);
+	deviceContext->Unmap(worldBuffer, 0);
+	if (tessellated)
+	{
+		StateCache::get()->setConstantBuffers(deviceContext, STAGE_DS, 0, 1, &worldBuffer);
+	}
+	else
+	{
+		StateCache::get()->setConstantBuffers(deviceContext, STAGE_VS, 0, 1, &worldBuffer);
+	}
+}
+
+void CubeShadowShader::setHeightMap(ID3D11DeviceContext* deviceContext, ID3D11ShaderResourceView* heightMap, int tessFactor)
+{
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+
+	// Set the tessellation factors and send to the Hull and Domain Shaders
+	deviceContext->Map(tessBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+	TessBufferType* tessPtr = (TessBufferType*)mappedResource.pData;
+	tessPtr->insideFactor = tessFactor;
+	tessPtr->outsideFactor = tessFactor;
+	tessPtr->padding = XMFLOAT2(0.0f, 0.0f);
+	deviceContext->Unmap(tessBuffer, 0);
+	StateCache::get()->setConstantBuffers(deviceContext, STAGE_DS, 1, 1, &tessBuffer);
+	StateCache::get()->setConstantBuffers(deviceContext, STAGE_HS, 0, 1, &tessBuffer);
+
+	// Send samplers and textures to Domain Shader
+	StateCache::get()->setSamplers(deviceContext, STAGE_DS, 0, 1, &sampleState);
+	StateCache::get()->setShaderResources(deviceContext, STAGE_DS, 0, 1, &heightMap);
+}
+
+void CubeShadowShader::setVirtualTexture(ID3D11DeviceContext* deviceContext, VirtualTexture* virtualTexture, int tessFactor, bool enabled)
+{
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+
+	// Set the virtual texture layout and send to Domain Shader
+	deviceContext->Map(virtualTextureBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+	virtualTexture->getShaderParameters(*(VirtualTexture::VirtualTextureBufferType*)mappedResource.pData, tessFactor, enabled);
+	deviceContext->Unmap(virtualTextureBuffer, 0);
+	StateCache::get()->setConstantBuffers(deviceContext, STAGE_DS, 2, 1, &virtualTextureBuffer);
+
+	// Set the page table and physical page cache for use in the Domain Shader
+	ID3D11ShaderResourceView* pageTable = virtualTexture->getPageTableSRV();
+	ID3D11ShaderResourceView* physicalTexture = virtualTexture->getPhysicalSRV();
+	StateCache::get()->setShaderResources(deviceContext, STAGE_DS, 1, 1, &pageTable);
+	StateCache::get()->setShaderResources(deviceContext, STAGE_DS, 2, 1, &physicalTexture);
+}
+
+void CubeShadowShader::renderFaces(ID3D11DeviceContext* deviceContext, int indexCount)
+{
+	if (faceCount == 0)
+	{
+		return;
+	}
+
+	// Binds the shader stages, with the hull and domain shaders only for the tessellated terrain, then draws one instance per face
+	deviceContext->IASetInputLayout(layout);
+	deviceContext->VSSetShader(vertexShader, NULL, 0);
+	deviceContext->HSSetShader(tessellated ? hullShader : NULL, NULL, 0);
+	deviceContext->DSSetShader(tessellated ? domainShader : NULL, NULL, 0);
+	deviceContext->GSSetShader(geometryShader, NULL, 0);
+	deviceContext->PSSetShader(pixelShader, NULL, 0);
+	deviceContext->DrawIndexedInstanced(indexCount, faceCount, 0, 0, 0);
+
+	// Later passes don't use a geometry shader, and shaders that don't load one may not unbind it
+	deviceContext->GSSetShader(NULL, NULL, 0);
+}
@@ -0,0 +1,73 @@
+// Cube Shadow Shader draws depth into every face of a point light's shadow map in one submission. Each draw is instanced once per face
+// that survived culling, and a geometry shader projects the instance's triangles into its face and picks that face's viewport in the atlas
+#pragma once
+
+#include "DXF.h"
+#include "StateCache.h"
+#include "VirtualTexture.h"
+#include "PointShadowMap.h"
+
+using namespace std;
+using namespace DirectX;
+
+class CubeShadowShader : public BaseShader
+{
+private:
+
+	// Stores the mesh's world matrix, the faces' own matrices being applied in the geometry shader
+	struct WorldBufferType
+	{
+		XMMATRIX world;
+	};
+
+	// Stores each face's view projection and, per instance, the face it draws to. Padded to a full register per face
+	struct CubeShadowBufferType
+	{
+		XMMATRIX faceViewProjection[PointShadowMap::FACE_COUNT];
+		UINT faceList[PointShadowMap::FACE_COUNT][4];
+	};
+
+	// Stores the inside and outside factor, which determines how the quad is sliced
+	struct TessBufferType
+	{
+		float insideFactor;
+		float outsideFactor;
+		XMFLOAT2 padding;
+	};
+
+public:
+
+	// When tessellated, draws the terrain plane's patches displaced by the heightmap, as the depth tessellation shader does
+	CubeShadowShader(ID3D11Device* device, HWND hwnd, bool tessellated = false);
+	~CubeShadowShader();
+
+	// Sets the faces every draw is instanced across, from the point shadow map's active faces
+	void setFaces(ID3D11DeviceContext* deviceContext, const PointShadowMap& pointShadow);
+
+	void setWorldMatrix(ID3D11DeviceContext* deviceContext, const XMMATRIX& world);
+
+	// Binds the heightmap and tessellation factor for the tessellated terrain
+	void setHeightMap(ID3D11DeviceContext* deviceContext, ID3D11ShaderResourceView* heightMap, int tessFactor);
+
+	// Binds the streamed heightmap, which the shaders sample instead of the heightmap texture while enabled
+	void setVirtualTexture(ID3D11DeviceContext* deviceContext, VirtualTexture* virtualTexture, int tessFactor, bool enabled);
+
+	// Draws the mesh once into every active face with a single instanced draw, in place of render
+	void renderFaces(ID3D11DeviceContext* deviceContext, int indexCount);
+
+	int getFaceCount() const { return faceCount; }
+
+private:
+	void initShader(const wchar_t* vsFilename, const wchar_t* psFilename);
+	void initShader(const wchar_t* vsFilename, const wchar_t* hsFilename, const wchar_t* dsFilename, const wchar_t* gsFilename, const wchar_t* psFilename);
+
+private:
+	ID3D11Buffer* worldBuffer;
+	ID3D11Buffer* cubeShadowBuffer;
+	ID3D11Buffer* tessBuffer;
+	ID3D11Buffer* virtualTextureBuffer;
+	ID3D11SamplerState* sampleState;
+
+	bool tessellated;
+	int faceCount;
+};
@@ -1,9 +1,10 @@
 // depth shader.cpp
 #include "depthshader.h"
+#include "MemoryTracker.h"
 
-DepthShader::DepthShader(ID3D11Device* device, HWND hwnd) : BaseShader(device, hwnd)
+DepthShader::DepthShader(ID3D11Device* device, HWND hwnd, bool gpuDriven) : BaseShader(device, hwnd)
 {
-	initShader(L"depth_vs.cso", L"depth_ps.cso");
+	initShader(gpuDriven ? L"gpu_instance_depth_vs.cso" : L"depth_vs.cso", L"depth_ps.cso");
 }
 
 DepthShader::~DepthShader()
@@ -42,25 +43,32 @@ void DepthShader::initShader(const wchar_t* vsFilename, const wchar_t* psFilenam
 	matrixBufferDesc.MiscFlags = 0;
 	matrixBufferDesc.StructureByteStride = 0;
 	renderer->CreateBuffer(&matrixBufferDesc, NULL, &matrixBuffer);
+	MemoryTracker::track(matrixBuffer, MEMORY_CONSTANTS, "Depth matrices");
 
 }
 
 void DepthShader::setShaderParameters(ID3D11DeviceContext* deviceContext, const XMMATRIX& worldMatrix, const XMMATRIX& viewMatrix, const XMMATRIX& projectionMatrix)
 {
-	D3D11_MAPPED_SUBRESOURCE mappedResource;
-	MatrixBufferType* dataPtr;
-
 	// Transpose the matrices to prepare them for the shader.
 	XMMATRIX tworld = XMMatrixTranspose(worldMatrix);
 	XMMATRIX tview = XMMatrixTranspose(viewMatrix);
 	XMMATRIX tproj = XMMatrixTranspose(projectionMatrix);
 
 	// Set matrix buffer and send to vertex shader
-	deviceContext->Map(matrixBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
-	dataPtr = (MatrixBufferType*)mappedResource.pData;
-	dataPtr->world = tworld;
-	dataPtr->view = tview;
-	dataPtr->projection = tproj;
-	deviceContext->Unmap(matrixBuffer, 0);
-	deviceContext->VSSetConstantBuffers(0, 1, &matrixBuffer);
+	MatrixBufferType matrices;
+	matrices.world = tworld;
+	matrices.view = tview;
+	matrices.projection = tproj;
+	ConstantRing::setConstants(constantRing, deviceContext, RING_STAGE_VS, 0, &matrices, sizeof(matrices), matrixBuffer);
+}
+
+void DepthShader::bindStages(ID3D11DeviceContext* deviceContext)
+{
+	// Only the vertex and pixel shaders are loaded, so the stages in between are cleared of whatever the last shader left there
+	deviceContext->IASetInputLayout(layout);
+	deviceContext->VSSetShader(vertexShader, NULL, 0);
+	deviceContext->HSSetShader(NULL, NULL, 0);
+	deviceContext->DSSetShader(NULL, NULL, 0);
+	deviceContext->GSSetShader(NULL, NULL, 0);
+	deviceContext->PSSetShader(pixelShader, NULL, 0);
 }
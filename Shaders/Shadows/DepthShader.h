@@ -2,6 +2,7 @@
 #pragma once
 
 #include "DXF.h"
+#include "ConstantRing.h"
 
 using namespace std;
 using namespace DirectX;
@@ -11,15 +12,23 @@ class DepthShader : public BaseShader
 
 public:
 
-	DepthShader(ID3D11Device* device, HWND hwnd);
+	// When gpuDriven is set, objects are instanced from the GpuDrivenScene's visible lists instead of using the world matrix
+	DepthShader(ID3D11Device* device, HWND hwnd, bool gpuDriven = false);
 	~DepthShader();
 
 	void setShaderParameters(ID3D11DeviceContext* deviceContext, const XMMATRIX& world, const XMMATRIX& view, const XMMATRIX& projection);
 
+	// Sends the matrices through the frame's constant ring instead of the matrix buffer, when given one
+	void setConstantRing(ConstantRing* ring) { constantRing = ring; }
+
+	// Binds the input layout and shader stages without drawing anything, for callers that issue their own draws
+	void bindStages(ID3D11DeviceContext* deviceContext);
+
 private:
 	void initShader(const wchar_t* vs, const wchar_t* ps);
 
 private:
 	ID3D11Buffer* matrixBuffer;
+	ConstantRing* constantRing = 0;
 };
 
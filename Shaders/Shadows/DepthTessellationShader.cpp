@@ -1,9 +1,10 @@
 #include "DepthTessellationShader.h"
+#include "MemoryTracker.h"
 
 
-DepthTessellationShader::DepthTessellationShader(ID3D11Device* device, HWND hwnd) : BaseShader(device, hwnd)
+DepthTessellationShader::DepthTessellationShader(ID3D11Device* device, HWND hwnd, bool gpuDriven) : BaseShader(device, hwnd)
 {
-	initShader(L"tessellation_quad_vs.cso", L"tessellation_quad_hs.cso", L"depth_tess_ds.cso", L"depth_tess_ps.cso");
+	initShader(gpuDriven ? L"gpu_patch_vs.cso" : L"tessellation_quad_vs.cso", gpuDriven ? L"gpu_patch_hs.cso" : L"tessellation_quad_hs.cso", L"depth_tess_ds.cso", L"depth_tess_ps.cso");
 }
 
 
@@ -24,6 +25,11 @@ DepthTessellationShader::~DepthTessellationShader()
 		tessBuffer->Release();
 		tessBuffer = 0;
 	}
+	if (virtualTextureBuffer)
+	{
+		virtualTextureBuffer->Release();
+		virtualTextureBuffer = 0;
+	}
 	if (layout)
 	{
 		layout->Release();
@@ -60,21 +66,24 @@ void DepthTessellationShader::initShader(const wchar_t* vsFilename, const wchar_
 	tessBufferDesc.MiscFlags = 0;
 	tessBufferDesc.StructureByteStride = 0;
 
-	// Setup texture sampler state description.
-	D3D11_SAMPLER_DESC samplerDesc;
-	samplerDesc.Filter = D3D11_FILTER_ANISOTROPIC;
-	samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_WRAP;
-	samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_WRAP;
-	samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_WRAP;
-	samplerDesc.MipLODBias = 0.0f;
-	samplerDesc.MaxAnisotropy = 1;
-	samplerDesc.ComparisonFunc = D3D11_COMPARISON_ALWAYS;
-	samplerDesc.MinLOD = 0;
-	samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
-	renderer->CreateSamplerState(&samplerDesc, &sampleState);
+	// Setup virtual texture buffer description.
+	D3D11_BUFFER_DESC virtualTextureBufferDesc;
+	virtualTextureBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+	virtualTextureBufferDesc.ByteWidth = sizeof(VirtualTexture::VirtualTextureBufferType);
+	virtualTextureBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	virtualTextureBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	virtualTextureBufferDesc.MiscFlags = 0;
+	virtualTextureBufferDesc.StructureByteStride = 0;
+
+	// Sampler for the displacement map, shared with the tessellation shader
+	sampleState = StateCache::get()->getSamplerState(StateCache::anisotropicWrap());
 
 	renderer->CreateBuffer(&tessBufferDesc, NULL, &tessBuffer);
+	MemoryTracker::track(tessBuffer, MEMORY_CONSTANTS, "Depth tessellation");
 	renderer->CreateBuffer(&matrixBufferDesc, NULL, &matrixBuffer);
+	MemoryTracker::track(matrixBuffer, MEMORY_CONSTANTS, "Depth tessellation matrices");
+	renderer->CreateBuffer(&virtualTextureBufferDesc, NULL, &virtualTextureBuffer);
+	MemoryTracker::track(virtualTextureBuffer, MEMORY_CONSTANTS, "Depth tessellation virtual texture");
 }
 
 void DepthTessellationShader::initShader(const wchar_t* vsFilename, const wchar_t* hsFilename, const wchar_t* dsFilename, const wchar_t* psFilename)
@@ -90,36 +99,61 @@ void DepthTessellationShader::initShader(const wchar_t* vsFilename, const wchar_
 
 void DepthTessellationShader::setShaderParameters(ID3D11DeviceContext* deviceContext, const XMMATRIX& worldMatrix, const XMMATRIX& viewMatrix, const XMMATRIX& projectionMatrix, ID3D11ShaderResourceView* heightMap, int tessFactor)
 {
-	HRESULT result;
-	D3D11_MAPPED_SUBRESOURCE mappedResource;
-
 	// Transpose the matrices to prepare them for the shader.
 	XMMATRIX tworld = XMMatrixTranspose(worldMatrix);
 	XMMATRIX tview = XMMatrixTranspose(viewMatrix);
 	XMMATRIX tproj = XMMatrixTranspose(projectionMatrix);
 
 	// Set matrix data and send buffer to Domain shader
-	result = deviceContext->Map(matrixBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
-	MatrixBufferType* dataPtr = (MatrixBufferType*)mappedResource.pData;
-	dataPtr->world = tworld;
-	dataPtr->view = tview;
-	dataPtr->projection = tproj;
-	deviceContext->Unmap(matrixBuffer, 0);
-	deviceContext->DSSetConstantBuffers(0, 1, &matrixBuffer);
-
-	// Set matrix data and send buffer to Hull and Domain Shader
-	TessBufferType* tessPtr;
-	deviceContext->Map(tessBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
-	tessPtr = (TessBufferType*)mappedResource.pData;
-	tessPtr->insideFactor = tessFactor;
-	tessPtr->outsideFactor = tessFactor;
-	tessPtr->padding = XMFLOAT2(0.0f, 0.0f);
-	deviceContext->Unmap(tessBuffer, 0);
-	deviceContext->DSSetConstantBuffers(1, 1, &tessBuffer);
-	deviceContext->HSSetConstantBuffers(0, 1, &tessBuffer);
+	MatrixBufferType matrices;
+	matrices.world = tworld;
+	matrices.view = tview;
+	matrices.projection = tproj;
+	ConstantRing::setConstants(constantRing, deviceContext, RING_STAGE_DS, 0, &matrices, sizeof(matrices), matrixBuffer);
+
+	// Set matrix data and send buffer to Hull and Domain Shader, which read it from different registers
+	TessBufferType tessData;
+	tessData.insideFactor = tessFactor;
+	tessData.outsideFactor = tessFactor;
+	tessData.padding = XMFLOAT2(0.0f, 0.0f);
+	ConstantRing::setConstants(constantRing, deviceContext, RING_STAGE_DS, 1, &tessData, sizeof(tessData), tessBuffer);
+	ConstantRing::setConstants(constantRing, deviceContext, RING_STAGE_HS, 0, &tessData, sizeof(tessData), tessBuffer);
 
 	// Send samplers and textures to Domain Shader
-	deviceContext->DSSetSamplers(0, 1, &sampleState);
-	deviceContext->DSSetShaderResources(0, 1, &heightMap);
+	StateCache::get()->setSamplers(deviceContext, STAGE_DS, 0, 1, &sampleState);
+	StateCache::get()->setShaderResources(deviceContext, STAGE_DS, 0, 1, &heightMap);
+}
+
+void DepthTessellationShader::setVirtualTexture(ID3D11DeviceContext* deviceContext, VirtualTexture* virtualTexture, int tessFactor, bool enabled)
+{
+	// Set the virtual texture layout and send to Domain Shader
+	VirtualTexture::VirtualTextureBufferType layout;
+	virtualTexture->getShaderParameters(layout, tessFactor, enabled);
+	ConstantRing::setConstants(constantRing, deviceContext, RING_STAGE_DS, 2, &layout, sizeof(layout), virtualTextureBuffer);
+
+	// Set the page table and physical page cache for use in the Domain Shader
+	ID3D11ShaderResourceView* pageTable = virtualTexture->getPageTableSRV();
+	ID3D11ShaderResourceView* physicalTexture = virtualTexture->getPhysicalSRV();
+	StateCache::get()->setShaderResources(deviceContext, STAGE_DS, 1, 1, &pageTable);
+	StateCache::get()->setShaderResources(deviceContext, STAGE_DS, 2, 1, &physicalTexture);
 }
 
+void DepthTessellationShader::bindStages(ID3D11DeviceContext* deviceContext)
+{
+	deviceContext->IASetInputLayout(layout);
+	deviceContext->VSSetShader(vertexShader, NULL, 0);
+	deviceContext->HSSetShader(hullShader, NULL, 0);
+	deviceContext->DSSetShader(domainShader, NULL, 0);
+	deviceContext->GSSetShader(NULL, NULL, 0);
+	deviceContext->PSSetShader(pixelShader, NULL, 0);
+}
+
+void DepthTessellationShader::renderPatches(ID3D11DeviceContext* deviceContext, TPlane* mesh, const vector<int>& patches)
+{
+	// Draws each visible patch's range of the index buffer
+	bindStages(deviceContext);
+	for (int patch : patches)
+	{
+		deviceContext->DrawIndexed(mesh->getPatchIndexCount(patch), mesh->getPatchIndexStart(patch), 0);
+	}
+}
@@ -2,6 +2,9 @@
 #pragma once
 
 #include "DXF.h"
+#include "VirtualTexture.h"
+#include "Tplane.h"
+#include "ConstantRing.h"
 
 using namespace std;
 using namespace DirectX;
@@ -12,11 +15,24 @@ class DepthTessellationShader : public BaseShader
 
 public:
 
-	DepthTessellationShader(ID3D11Device* device, HWND hwnd);
+	// When gpuDriven is set, the patches are instanced from the GpuDrivenScene's visible lists with a tessellation factor per patch
+	DepthTessellationShader(ID3D11Device* device, HWND hwnd, bool gpuDriven = false);
 	~DepthTessellationShader();
 
 	void setShaderParameters(ID3D11DeviceContext* deviceContext, const XMMATRIX& world, const XMMATRIX& view, const XMMATRIX& projection, ID3D11ShaderResourceView* heightMap, int tessFactor);
 
+	// Shares the frame's constant ring for the matrices, factors and virtual texture layout, when given one
+	void setConstantRing(ConstantRing* ring) { constantRing = ring; }
+
+	// Binds the streamed heightmap, which the shaders sample instead of the heightmap texture while enabled
+	void setVirtualTexture(ID3D11DeviceContext* deviceContext, VirtualTexture* virtualTexture, int tessFactor, bool enabled);
+
+	// Binds the input layout and the vertex, hull, domain and pixel shaders without drawing anything, for callers that issue their own draws
+	void bindStages(ID3D11DeviceContext* deviceContext);
+
+	// Draws only the listed patches of the plane, in place of render, so culled patches are never tessellated
+	void renderPatches(ID3D11DeviceContext* deviceContext, TPlane* mesh, const vector<int>& patches);
+
 private:
 	void initShader(const wchar_t* vsFilename, const wchar_t* psFilename);
 	void initShader(const wchar_t* vsFilename, const wchar_t* hsFilename, const wchar_t* dsFilename, const wchar_t* psFilename);
@@ -24,7 +40,9 @@ private:
 private:
 	ID3D11Buffer* matrixBuffer;
 	ID3D11Buffer* tessBuffer;
+	ID3D11Buffer* virtualTextureBuffer;
 	ID3D11SamplerState* sampleState;
+	ConstantRing* constantRing = 0;
 
 	// Stores the inside and outside factor, which determines how the quad is sliced
 	struct TessBufferType
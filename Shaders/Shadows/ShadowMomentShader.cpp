@@ -0,0 +1,233 @@
+#include "ShadowMomentShader.h"
+#include "MemoryTracker.h"
+
+
+ShadowMomentShader::ShadowMomentShader(ID3D11Device* device, HWND hwnd) : BaseShader(device, hwnd)
+{
+	atlasSize = 0;
+	mipsDirty = false;
+	momentTexture = 0;
+	momentSRV = 0;
+	momentUAV = 0;
+	scratchTexture = 0;
+	scratchSRV = 0;
+	scratchUAV = 0;
+	initShader(L"shadow_moments_cs.cso", NULL);
+}
+
+
+ShadowMomentShader::~ShadowMomentShader()
+{
+	releaseTextures();
+
+	// Release the sampler state
+	if (momentSampler)
+	{
+		momentSampler->Release();
+		momentSampler = 0;
+	}
+
+	// Release the constant buffers
+	if (momentBuffer)
+	{
+		momentBuffer->Release();
+		momentBuffer = 0;
+	}
+	if (filterBuffer)
+	{
+		filterBuffer->Release();
+		filterBuffer = 0;
+	}
+
+	//Release base shader components
+	BaseShader::~BaseShader();
+}
+
+void ShadowMomentShader::initShader(const wchar_t* cfile, const wchar_t* blank)
+{
+	D3D11_BUFFER_DESC bufferDesc;
+
+	// Load (+ compile) shader file
+	loadComputeShader(cfile);
+
+	// Setup the description of the tile buffer, sent to the Compute Shader
+	bufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+	bufferDesc.ByteWidth = sizeof(ShadowMomentBufferType);
+	bufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	bufferDesc.MiscFlags = 0;
+	bufferDesc.StructureByteStride = 0;
+	renderer->CreateBuffer(&bufferDesc, NULL, &momentBuffer);
+	MemoryTracker::track(momentBuffer, MEMORY_CONSTANTS, "Shadow moment constants");
+
+	// Setup the description of the filter buffer, sent to the lit Pixel Shaders
+	bufferDesc.ByteWidth = sizeof(ShadowFilterBufferType);
+	renderer->CreateBuffer(&bufferDesc, NULL, &filterBuffer);
+	MemoryTracker::track(filterBuffer, MEMORY_CONSTANTS, "Shadow moment filter");
+
+	// Trilinear and clamped, so the blurred moments are filtered across texels and mips but never wrap around the atlas
+	momentSampler = StateCache::get()->getSamplerState(StateCache::linearClamp());
+}
+
+void ShadowMomentShader::releaseTextures()
+{
+	// Release the moment atlas, the scratch texture and their views
+	if (momentUAV)
+	{
+		momentUAV->Release();
+		momentUAV = 0;
+	}
+	if (momentSRV)
+	{
+		momentSRV->Release();
+		momentSRV = 0;
+	}
+	if (momentTexture)
+	{
+		momentTexture->Release();
+		momentTexture = 0;
+	}
+	if (scratchUAV)
+	{
+		scratchUAV->Release();
+		scratchUAV = 0;
+	}
+	if (scratchSRV)
+	{
+		scratchSRV->Release();
+		scratchSRV = 0;
+	}
+	if (scratchTexture)
+	{
+		scratchTexture->Release();
+		scratchTexture = 0;
+	}
+	atlasSize = 0;
+}
+
+void ShadowMomentShader::resize(int latlasSize)
+{
+	if (latlasSize == atlasSize)
+	{
+		return;
+	}
+	releaseTextures();
+	if (latlasSize <= 0)
+	{
+		return;
+	}
+	atlasSize = latlasSize;
+
+	// Four 32 bit moments with a full mip chain. Needs to be a render target for GenerateMips, and writable for the blur
+	D3D11_TEXTURE2D_DESC textureDesc;
+	ZeroMemory(&textureDesc, sizeof(textureDesc));
+	textureDesc.Width = atlasSize;
+	textureDesc.Height = atlasSize;
+	textureDesc.MipLevels = 0;
+	textureDesc.ArraySize = 1;
+	textureDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+	textureDesc.SampleDesc.Count = 1;
+	textureDesc.Usage = D3D11_USAGE_DEFAULT;
+	textureDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS | D3D11_BIND_RENDER_TARGET;
+	textureDesc.MiscFlags = D3D11_RESOURCE_MISC_GENERATE_MIPS;
+	renderer->CreateTexture2D(&textureDesc, NULL, &momentTexture);
+	MemoryTracker::track(momentTexture, MEMORY_SHADOW, "Shadow moments");
+	renderer->CreateShaderResourceView(momentTexture, NULL, &momentSRV);
+
+	// The blur only ever writes the top mip
+	D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc;
+	ZeroMemory(&uavDesc, sizeof(uavDesc));
+	uavDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+	uavDesc.ViewDimension = D3D11_UAV_DIMENSION_TEXTURE2D;
+	uavDesc.Texture2D.MipSlice = 0;
+	renderer->CreateUnorderedAccessView(momentTexture, &uavDesc, &momentUAV);
+
+	// The scratch texture matches the top mip, so tiles sit at the same place in both
+	textureDesc.MipLevels = 1;
+	textureDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS;
+	textureDesc.MiscFlags = 0;
+	renderer->CreateTexture2D(&textureDesc, NULL, &scratchTexture);
+	MemoryTracker::track(scratchTexture, MEMORY_SHADOW, "Shadow moment blur scratch");
+	renderer->CreateShaderResourceView(scratchTexture, NULL, &scratchSRV);
+	renderer->CreateUnorderedAccessView(scratchTexture, &uavDesc, &scratchUAV);
+
+	mipsDirty = false;
+}
+
+void ShadowMomentShader::filterTile(ID3D11DeviceContext* deviceContext, ID3D11ShaderResourceView* depthAtlas, const ShadowAtlasTile& tile, const ShadowFilterSettings& settings, bool perspective)
+{
+	if (!momentTexture || tile.size <= 0)
+	{
+		return;
+	}
+
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	ID3D11ShaderResourceView* nullSRV[2] = { NULL, NULL };
+	ID3D11UnorderedAccessView* nullUAV = NULL;
+
+	// The first pass encodes the depths and blurs them across into the scratch texture, the second blurs down into the moment atlas
+	for (int pass = 0; pass < 2; pass++)
+	{
+		deviceContext->Map(momentBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+		ShadowMomentBufferType* momentPtr = (ShadowMomentBufferType*)mappedResource.pData;
+		momentPtr->tileOrigin[0] = tile.x;
+		momentPtr->tileOrigin[1] = tile.y;
+		momentPtr->tileSize = tile.size;
+		momentPtr->blurRadius = max(settings.blurRadius, 0);
+		momentPtr->filterMode = (float)settings.mode;
+		momentPtr->perspectiveDepth = perspective ? 1.0f : 0.0f;
+		momentPtr->exponents = XMFLOAT2(settings.positiveExponent, settings.negativeExponent);
+		momentPtr->verticalPass = (float)pass;
+		momentPtr->padding = XMFLOAT3(0.0f, 0.0f, 0.0f);
+		deviceContext->Unmap(momentBuffer, 0);
+		deviceContext->CSSetConstantBuffers(0, 1, &momentBuffer);
+
+		ID3D11ShaderResourceView* sources[2] = { depthAtlas, pass == 0 ? NULL : scratchSRV };
+		deviceContext->CSSetShaderResources(0, 2, sources);
+		deviceContext->CSSetUnorderedAccessViews(0, 1, pass == 0 ? &scratchUAV : &momentUAV, 0);
+		compute(deviceContext, (tile.size + 7) / 8, (tile.size + 7) / 8, 1);
+
+		// Unbind so the scratch texture can be read by the next pass
+		deviceContext->CSSetShaderResources(0, 2, nullSRV);
+		deviceContext->CSSetUnorderedAccessViews(0, 1, &nullUAV, 0);
+	}
+	deviceContext->CSSetShader(NULL, NULL, 0);
+	mipsDirty = true;
+}
+
+void ShadowMomentShader::generateMips(ID3D11DeviceContext* deviceContext)
+{
+	if (!mipsDirty)
+	{
+		return;
+	}
+	deviceContext->GenerateMips(momentSRV);
+	mipsDirty = false;
+}
+
+void ShadowMomentShader::setShaderParameters(ID3D11DeviceContext* deviceContext, const ShadowFilterSettings& settings)
+{
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+
+	// Without a moment atlas only the hard filter can be used
+	ShadowFilterMode mode = momentTexture ? settings.mode : SHADOW_FILTER_HARD;
+
+	deviceContext->Map(filterBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+	ShadowFilterBufferType* filterPtr = (ShadowFilterBufferType*)mappedResource.pData;
+	filterPtr->filterMode = (float)mode;
+	filterPtr->lightBleedReduction = settings.lightBleedReduction;
+	filterPtr->momentBias = settings.momentBias;
+	filterPtr->depthBias = settings.depthBias;
+	filterPtr->exponents = XMFLOAT2(settings.positiveExponent, settings.negativeExponent);
+	filterPtr->padding = XMFLOAT2(0.0f, 0.0f);
+	deviceContext->Unmap(filterBuffer, 0);
+	StateCache::get()->setConstantBuffers(deviceContext, STAGE_PS, BUFFER_SLOT, 1, &filterBuffer);
+	StateCache::get()->setSamplers(deviceContext, STAGE_PS, SAMPLER_SLOT, 1, &momentSampler);
+}
+
+unsigned long long ShadowMomentShader::getBytes() const
+{
+	// A full mip chain adds about a third to the top mip
+	unsigned long long topMip = (unsigned long long)atlasSize * atlasSize * ShadowMoments::getBytesPerTexel(SHADOW_FILTER_MSM);
+	return topMip + topMip / 3 + topMip;
+}
@@ -0,0 +1,88 @@
+// Builds a moment atlas from the shadow atlas for the moment filtered shadow modes. Each redrawn tile is turned into moments and box blurred
+// on the GPU, then the whole atlas is mip mapped, so the lit shaders can filter their shadows like any other texture. Tiles are aligned to their
+// own size, so every mip of a tile stays inside it until the tile is a single texel
+#pragma once
+
+#include "DXF.h"
+#include "StateCache.h"
+#include "ShadowAtlas.h"
+#include "ShadowMoments.h"
+
+using namespace std;
+using namespace DirectX;
+
+class ShadowMomentShader : public BaseShader
+{
+private:
+
+	// Stores the tile being filtered, the blur and how the depths are encoded
+	struct ShadowMomentBufferType
+	{
+		UINT tileOrigin[2];
+		UINT tileSize;
+		UINT blurRadius;
+		float filterMode;
+		float perspectiveDepth;
+		XMFLOAT2 exponents;
+		float verticalPass;
+		XMFLOAT3 padding;
+	};
+
+	// Stores how the lit shaders filter their shadows, matching ShadowFilterBuffer in the lit pixel shaders
+	struct ShadowFilterBufferType
+	{
+		float filterMode;
+		float lightBleedReduction;
+		float momentBias;
+		float depthBias;
+		XMFLOAT2 exponents;
+		XMFLOAT2 padding;
+	};
+
+public:
+
+	// Register the filter constant buffer and the moment sampler are bound to in the pixel shaders that sample shadows
+	static const int BUFFER_SLOT = 4;
+	static const int SAMPLER_SLOT = 1;
+
+	ShadowMomentShader(ID3D11Device* device, HWND hwnd);
+	~ShadowMomentShader();
+
+	// Creates a moment atlas to match a shadow atlas of the given size, or releases it when the size is zero (the hard filter needs none)
+	void resize(int atlasSize);
+
+	// Encodes and blurs one light's tile of the depth atlas into the moment atlas. perspective linearizes the depths first, as for the spot light
+	void filterTile(ID3D11DeviceContext* deviceContext, ID3D11ShaderResourceView* depthAtlas, const ShadowAtlasTile& tile, const ShadowFilterSettings& settings, bool perspective);
+
+	// Rebuilds the mip chain if any tile has been filtered since it was last built
+	void generateMips(ID3D11DeviceContext* deviceContext);
+
+	// Binds the filter settings and moment sampler for the lit pixel shaders. Stays bound for the rest of the frame
+	void setShaderParameters(ID3D11DeviceContext* deviceContext, const ShadowFilterSettings& settings);
+
+	ID3D11ShaderResourceView* getShaderResourceView() { return momentSRV; }
+	int getAtlasSize() const { return atlasSize; }
+
+	// GPU memory held by the moment atlas (with its mips) and the scratch texture used between the blur passes
+	unsigned long long getBytes() const;
+
+private:
+	void initShader(const wchar_t* cfile, const wchar_t* blank);
+	void releaseTextures();
+
+private:
+	ID3D11Buffer* momentBuffer;
+	ID3D11Buffer* filterBuffer;
+	ID3D11SamplerState* momentSampler;
+
+	int atlasSize;
+	bool mipsDirty;
+
+	// The moment atlas, with a full mip chain, and the scratch texture holding the horizontally blurred moments
+	ID3D11Texture2D* momentTexture;
+	ID3D11ShaderResourceView* momentSRV;
+	ID3D11UnorderedAccessView* momentUAV;
+	ID3D11Texture2D* scratchTexture;
+	ID3D11ShaderResourceView* scratchSRV;
+	ID3D11UnorderedAccessView* scratchUAV;
+};
@@ -0,0 +1,69 @@
+#include "ShadowTileClearShader.h"
+
+
+ShadowTileClearShader::ShadowTileClearShader(ID3D11Device* device, HWND hwnd) : BaseShader(device, hwnd)
+{
+	initShader(L"shadow_clear_vs.cso", NULL);
+}
+
+
+ShadowTileClearShader::~ShadowTileClearShader()
+{
+	// Release the depth state
+	if (depthAlwaysState)
+	{
+		depthAlwaysState->Release();
+		depthAlwaysState = 0;
+	}
+
+	// Release the layout
+	if (layout)
+	{
+		layout->Release();
+		layout = 0;
+	}
+
+	//Release base shader components
+	BaseShader::~BaseShader();
+}
+
+void ShadowTileClearShader::initShader(const wchar_t* vsFilename, const wchar_t* blank)
+{
+	D3D11_DEPTH_STENCIL_DESC depthDesc;
+
+	// Load (+ compile) shader file
+	loadVertexShader(vsFilename);
+
+	// Writes depth everywhere the triangle covers, whatever is already there
+	ZeroMemory(&depthDesc, sizeof(depthDesc));
+	depthDesc.DepthEnable = TRUE;
+	depthDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ALL;
+	depthDesc.DepthFunc = D3D11_COMPARISON_ALWAYS;
+	depthDesc.StencilEnable = FALSE;
+	depthAlwaysState = StateCache::get()->getDepthStencilState(depthDesc);
+}
+
+void ShadowTileClearShader::clear(ID3D11DeviceContext* deviceContext)
+{
+	// Remembers the current depth state, to put back afterwards
+	ID3D11DepthStencilState* previousState = 0;
+	UINT previousStencilRef = 0;
+	deviceContext->OMGetDepthStencilState(&previousState, &previousStencilRef);
+
+	// The triangle is generated from the vertex index, so nothing is bound to the input assembler
+	deviceContext->IASetInputLayout(NULL);
+	deviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	deviceContext->VSSetShader(vertexShader, NULL, 0);
+	deviceContext->HSSetShader(NULL, NULL, 0);
+	deviceContext->DSSetShader(NULL, NULL, 0);
+	deviceContext->GSSetShader(NULL, NULL, 0);
+	deviceContext->PSSetShader(NULL, NULL, 0);
+	deviceContext->OMSetDepthStencilState(depthAlwaysState, 0);
+	deviceContext->Draw(3, 0);
+
+	deviceContext->OMSetDepthStencilState(previousState, previousStencilRef);
+	if (previousState)
+	{
+		previousState->Release();
+	}
+}
@@ -0,0 +1,25 @@
+// Clears one tile of a depth texture to the far plane. ClearDepthStencilView always clears the whole view,
+// so tiles of the shadow atlas are cleared by drawing over them instead
+#pragma once
+
+#include "DXF.h"
+#include "StateCache.h"
+
+using namespace std;
+using namespace DirectX;
+
+class ShadowTileClearShader : public BaseShader
+{
+public:
+	ShadowTileClearShader(ID3D11Device* device, HWND hwnd);
+	~ShadowTileClearShader();
+
+	// Resets the depth inside the current viewport, leaving the depth state as it was
+	void clear(ID3D11DeviceContext* deviceContext);
+
+private:
+	void initShader(const wchar_t* vsFilename, const wchar_t* blank);
+
+private:
+	ID3D11DepthStencilState* depthAlwaysState;
+};
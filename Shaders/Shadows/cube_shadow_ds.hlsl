@@ -0,0 +1,90 @@
+// Cube Shadow Domain Shader
+// Displaces the tessellated terrain by the heightmap as the depth domain shader does, leaving it in world space for the geometry shader
+#include "heightmap_h.hlsli"
+#include "virtual_texture_h.hlsli"
+
+Texture2D texture0 : register(t0);
+Texture2D<uint4> pageTable : register(t1);
+Texture2D physicalTexture : register(t2);
+SamplerState sampler0 : register(s0);
+
+// Stores the terrain's world matrix, the faces' own matrices are applied in the geometry shader
+cbuffer MatrixBuffer : register(b0)
+{
+    matrix worldMatrix;
+};
+
+// Stores the inside and outside factors, for determining how the tessellator will partion the quad
+cbuffer TessBuffer : register(b1)
+{
+    float insideFactor;
+    float outsideFactor;
+    float2 padding;
+};
+
+// Stores the virtual texture's layout, used instead of texture0 when the heightmap is streamed
+cbuffer VirtualTextureBuffer : register(b2)
+{
+    float2 pagesMip0;
+    float pageSize;
+    float border;
+    float2 physicalSize;
+    float maxMip;
+    float virtualSize;
+    float domainMip;
+    float feedbackBias;
+    float virtualEnabled;
+    float padding3;
+};
+
+struct ConstantOutputType
+{
+    float edges[4] : SV_TessFactor;
+    float inside[2] : SV_InsideTessFactor;
+};
+
+struct InputType
+{
+    float3 position : POSITION;
+    float2 tex : TEXCOORD0;
+    uint face : FACE;
+};
+
+struct OutputType
+{
+    float3 worldPosition : POSITION;
+    uint face : FACE;
+};
+
+[domain("quad")]
+OutputType main(ConstantOutputType input, float2 uvwCoord : SV_DomainLocation, const OutputPatch<InputType, 4> patch)
+{
+    float3 vertexPosition;
+    OutputType output;
+
+    // Determine the new vertex position and texture coordinate at this partition by interpolating using the uvwCoord
+    float3 v1 = lerp(patch[0].position, patch[1].position, uvwCoord.y);
+    float3 v2 = lerp(patch[3].position, patch[2].position, uvwCoord.y);
+    vertexPosition = lerp(v1, v2, uvwCoord.x);
+    float2 t1 = lerp(patch[0].tex, patch[1].tex, uvwCoord.y);
+    float2 t2 = lerp(patch[3].tex, patch[2].tex, uvwCoord.y);
+    float2 texResult = lerp(t1, t2, uvwCoord.x);
+
+    // Determine the height at this partition's vertex position, from the virtual texture if it is being streamed
+    if (virtualEnabled)
+    {
+        vertexPosition.y = SampleVirtualHeight(texResult, domainMip, pageTable, physicalTexture, sampler0, pagesMip0, pageSize, border, physicalSize, maxMip) * 30;
+    }
+    else
+    {
+        vertexPosition.y = GetHeight(texResult.x, texResult.y, texture0, sampler0) * 30;
+    }
+
+    // Calculate the position of the new vertex against the world matrix only
+    output.worldPosition = mul(float4(vertexPosition, 1.0f), worldMatrix).xyz;
+
+    // Every control point of a patch belongs to the same instance, so any of them gives the face
+    output.face = patch[0].face;
+
+    return output;
+}
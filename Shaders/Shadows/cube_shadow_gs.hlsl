@@ -0,0 +1,59 @@
+// Cube Shadow Geometry Shader
+// Projects each triangle into its instance's cube face and sends it to that face's viewport in the shadow atlas,
+// dropping any triangle entirely outside the face so it is never rasterized
+
+// Stores each face's view projection and, per instance, the face it draws to
+cbuffer CubeShadowBuffer : register(b0)
+{
+    matrix faceViewProjection[6];
+    uint4 faceList[6];
+};
+
+struct InputType
+{
+    float3 worldPosition : POSITION;
+    uint face : FACE;
+};
+
+// Matches the depth pixel shader's input, with the viewport index last so the pixel shader can ignore it
+struct OutputType
+{
+    float4 position : SV_POSITION;
+    float4 depthPosition : TEXCOORD0;
+    uint viewport : SV_ViewportArrayIndex;
+};
+
+[maxvertexcount(3)]
+void main(triangle InputType input[3], inout TriangleStream<OutputType> triStream)
+{
+    OutputType output;
+    uint face = input[0].face;
+
+    // Calculate each vertex's position from this face's view
+    float4 clip[3];
+    for (int i = 0; i < 3; i++)
+    {
+        clip[i] = mul(float4(input[i].worldPosition, 1.0f), faceViewProjection[face]);
+    }
+
+    // A triangle with every vertex outside the same clip plane can't touch the face
+    bool3 left = bool3(clip[0].x < -clip[0].w, clip[1].x < -clip[1].w, clip[2].x < -clip[2].w);
+    bool3 right = bool3(clip[0].x > clip[0].w, clip[1].x > clip[1].w, clip[2].x > clip[2].w);
+    bool3 bottom = bool3(clip[0].y < -clip[0].w, clip[1].y < -clip[1].w, clip[2].y < -clip[2].w);
+    bool3 top = bool3(clip[0].y > clip[0].w, clip[1].y > clip[1].w, clip[2].y > clip[2].w);
+    bool3 behind = bool3(clip[0].z < 0.0f, clip[1].z < 0.0f, clip[2].z < 0.0f);
+    bool3 beyond = bool3(clip[0].z > clip[0].w, clip[1].z > clip[1].w, clip[2].z > clip[2].w);
+    if (all(left) || all(right) || all(bottom) || all(top) || all(behind) || all(beyond))
+    {
+        return;
+    }
+
+    // The faces' viewports are bound in face order
+    for (int j = 0; j < 3; j++)
+    {
+        output.position = clip[j];
+        output.depthPosition = clip[j];
+        output.viewport = face;
+        triStream.Append(output);
+    }
+}
@@ -0,0 +1,66 @@
+// Cube Shadow Hull Shader
+// Partitions the terrain's quads as the tessellation hull shader does, carrying each control point's cube face through
+
+// Stores the inside and outside factors, for determining how the tessellator will partion the quad
+cbuffer TessBuffer : register(b0)
+{
+    float insideFactor;
+    float outsideFactor;
+    float2 padding;
+};
+
+struct InputType
+{
+    float3 position : POSITION;
+    float2 tex : TEXCOORD0;
+    uint face : FACE;
+};
+
+struct ConstantOutputType
+{
+    float edges[4] : SV_TessFactor;
+    float inside[2] : SV_InsideTessFactor;
+};
+
+struct OutputType
+{
+    float3 position : POSITION;
+    float2 tex : TEXCOORD0;
+    uint face : FACE;
+};
+
+// Set the InputPatch to 4, too allow for Quad Tessellation
+ConstantOutputType PatchConstantFunction(InputPatch<InputType, 4> inputPatch, uint patchId : SV_PrimitiveID)
+{
+    ConstantOutputType output;
+
+    // Set the tessellation factors for the four edges of the quad
+    output.edges[0] = insideFactor;
+    output.edges[1] = insideFactor;
+    output.edges[2] = insideFactor;
+    output.edges[3] = insideFactor;
+
+    // Set the tessellation factor for tessallating inside the quad
+    output.inside[0] = outsideFactor;
+    output.inside[1] = outsideFactor;
+
+    return output;
+}
+
+[domain("quad")]
+[partitioning("integer")]
+[outputtopology("triangle_ccw")]
+[outputcontrolpoints(4)]
+[patchconstantfunc("PatchConstantFunction")]
+[maxtessfactor(64.0f)]
+OutputType main(InputPatch<InputType, 4> patch, uint pointId : SV_OutputControlPointID, uint patchId : SV_PrimitiveID)
+{
+    OutputType output;
+
+    // Sets the position, tex and face for this control point
+    output.position = patch[pointId].position;
+    output.tex = patch[pointId].tex;
+    output.face = patch[pointId].face;
+
+    return output;
+}
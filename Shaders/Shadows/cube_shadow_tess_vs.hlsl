@@ -0,0 +1,37 @@
+// Cube Shadow Tessellation Vertex Shader
+// Passes forward the control points to the hull shader, along with the cube face this instance draws to
+
+// Stores each face's view projection and, per instance, the face it draws to
+cbuffer CubeShadowBuffer : register(b1)
+{
+    matrix faceViewProjection[6];
+    uint4 faceList[6];
+};
+
+struct InputType
+{
+    float3 position : POSITION;
+    float2 tex : TEXCOORD0;
+    float3 normal : NORMAL;
+};
+
+struct OutputType
+{
+    float3 position : POSITION;
+    float2 tex : TEXCOORD0;
+    uint face : FACE;
+};
+
+OutputType main(InputType input, uint instanceId : SV_InstanceID)
+{
+    OutputType output;
+
+    // Pass the vertex position and texture coordinates into the hull shader
+    output.position = input.position;
+    output.tex = input.tex;
+
+    // Each instance is one face
+    output.face = faceList[instanceId].x;
+
+    return output;
+}
@@ -0,0 +1,41 @@
+// Cube Shadow Vertex Shader
+// Moves the mesh into world space, and picks the cube face this instance draws to from the list of faces that survived culling
+
+// Stores the mesh's world matrix, the faces' own matrices are applied in the geometry shader
+cbuffer MatrixBuffer : register(b0)
+{
+    matrix worldMatrix;
+};
+
+// Stores each face's view projection and, per instance, the face it draws to
+cbuffer CubeShadowBuffer : register(b1)
+{
+    matrix faceViewProjection[6];
+    uint4 faceList[6];
+};
+
+struct InputType
+{
+    float4 position : POSITION;
+    float2 tex : TEXCOORD0;
+    float3 normal : NORMAL;
+};
+
+struct OutputType
+{
+    float3 worldPosition : POSITION;
+    uint face : FACE;
+};
+
+OutputType main(InputType input, uint instanceId : SV_InstanceID)
+{
+    OutputType output;
+
+    // Calculate the position of the vertex against the world matrix only
+    output.worldPosition = mul(input.position, worldMatrix).xyz;
+
+    // Each instance is one face
+    output.face = faceList[instanceId].x;
+
+    return output;
+}
@@ -7,10 +7,26 @@ struct InputType
     float4 depthPosition : TEXCOORD0;
 };
 
+// Set by the camera depth target. Shadow maps only keep the depth buffer, so whatever is bound here when drawing them makes no difference
+cbuffer DepthStorageBuffer : register(b0)
+{
+    float nearPlane;
+    float farPlane;
+    float linearDepth;
+    float padding;
+};
+
 float4 main(InputType input) : SV_TARGET
 {
     float depthValue;
     
+    // W holds the distance along the view direction, so linear depth is just that scaled between the near and far planes
+    if (linearDepth)
+    {
+        depthValue = saturate((input.depthPosition.w - nearPlane) / (farPlane - nearPlane));
+        return float4(depthValue, depthValue, depthValue, 1.0f);
+    }
+    
 	// Get the depth value of the pixel by dividing the Z pixel depth by the homogeneous W coordinate.
     depthValue = input.depthPosition.z / input.depthPosition.w;
     return float4(depthValue, depthValue, depthValue, 1.0f);
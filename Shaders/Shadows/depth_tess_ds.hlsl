@@ -1,8 +1,11 @@
 // Tessellation domain shader
 // After tessellation the domain shader processes the all the vertices
 #include "heightmap_h.hlsli"
+#include "virtual_texture_h.hlsli"
 
 Texture2D texture0 : register(t0);
+Texture2D<uint4> pageTable : register(t1);
+Texture2D physicalTexture : register(t2);
 SamplerState sampler0 : register(s0);
 
 // Stores world, view and projection matrix data
@@ -21,6 +24,21 @@ cbuffer TessBuffer : register(b1)
     float2 padding;
 };
 
+// Stores the virtual texture's layout, used instead of texture0 when the heightmap is streamed
+cbuffer VirtualTextureBuffer : register(b2)
+{
+    float2 pagesMip0;
+    float pageSize;
+    float border;
+    float2 physicalSize;
+    float maxMip;
+    float virtualSize;
+    float domainMip;
+    float feedbackBias;
+    float virtualEnabled;
+    float padding3;
+};
+
 struct ConstantOutputType
 {
     float edges[4] : SV_TessFactor;
@@ -60,8 +78,15 @@ OutputType main(ConstantOutputType input, float2 uvwCoord : SV_DomainLocation, c
     float2 t2 = lerp(patch[3].tex, patch[2].tex, uvwCoord.y);
     float2 texResult = lerp(t1, t2, uvwCoord.x);
     
-    // Determine the height at this partition's vertex position
-    vertexPosition.y = GetHeight(texResult.x, texResult.y, texture0, sampler0) * 30;
+    // Determine the height at this partition's vertex position, from the virtual texture if it is being streamed
+    if (virtualEnabled)
+    {
+        vertexPosition.y = SampleVirtualHeight(texResult, domainMip, pageTable, physicalTexture, sampler0, pagesMip0, pageSize, border, physicalSize, maxMip) * 30;
+    }
+    else
+    {
+        vertexPosition.y = GetHeight(texResult.x, texResult.y, texture0, sampler0) * 30;
+    }
 		    
     // Calculate the position of the new vertex against the world, view, and projection matrices.
     output.position = mul(float4(vertexPosition, 1.0f), worldMatrix);
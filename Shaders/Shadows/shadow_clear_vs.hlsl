@@ -0,0 +1,9 @@
+// Shadow Tile Clear Vertex Shader
+// Covers the whole viewport with a single triangle on the far plane, generated from the vertex index so no mesh is needed.
+// Drawn with the depth test set to always pass, it resets just the tile of the shadow atlas the viewport is set to
+
+float4 main(uint vertexID : SV_VertexID) : SV_POSITION
+{
+    float2 corner = float2((vertexID << 1) & 2, vertexID & 2);
+    return float4(corner * float2(2.0f, -2.0f) + float2(-1.0f, 1.0f), 1.0f, 1.0f);
+}
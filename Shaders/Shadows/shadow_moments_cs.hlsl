@@ -0,0 +1,56 @@
+// Shadow Moments Compute Shader
+// Turns a light's tile of the depth atlas into moments and box blurs them, in two separable passes. The first pass reads the depths,
+// encodes them and blurs horizontally into the scratch texture, the second blurs that vertically into the moment atlas
+#include "light_h.hlsli"
+
+Texture2D<float> depthAtlas : register(t0);
+Texture2D<float4> momentSource : register(t1);
+RWTexture2D<float4> destination : register(u0);
+
+// Stores the tile being filtered, the blur and how the depths are encoded
+cbuffer ShadowMomentBuffer : register(b0)
+{
+    uint2 tileOrigin;
+    uint tileSize;
+    uint blurRadius;
+    float filterMode;
+    float perspectiveDepth;
+    float2 exponents;
+    float verticalPass;
+    float3 padding;
+};
+
+[numthreads(8, 8, 1)]
+void main(uint3 dispatchThreadID : SV_DispatchThreadID)
+{
+    if (dispatchThreadID.x >= tileSize || dispatchThreadID.y >= tileSize)
+    {
+        return;
+    }
+
+    // Averages the texels either side, clamping at the tile's edge so no other light's depths are ever blurred in
+    float4 total = float4(0, 0, 0, 0);
+    int radius = (int)blurRadius;
+    for (int i = -radius; i <= radius; i++)
+    {
+        int2 offset = verticalPass ? int2(0, i) : int2(i, 0);
+        int2 texel = (int2)tileOrigin + clamp((int2)dispatchThreadID.xy + offset, 0, (int)tileSize - 1);
+
+        if (verticalPass)
+        {
+            total += momentSource.Load(int3(texel, 0));
+        }
+        else
+        {
+            // The spot light's depths are linearized the same way its receivers are, so both sides are compared in the same space
+            float depth = depthAtlas.Load(int3(texel, 0));
+            if (perspectiveDepth)
+            {
+                depth = LinearizeDepth(depth, 0.1f, 200.0f) / 200;
+            }
+            total += EncodeShadowMoments(depth, filterMode, exponents);
+        }
+    }
+
+    destination[tileOrigin + dispatchThreadID.xy] = total / (radius * 2 + 1);
+}
@@ -1,9 +1,10 @@
 #include "tessellationshader.h"
+#include "MemoryTracker.h"
 
 
-TessellationShader::TessellationShader(ID3D11Device* device, HWND hwnd) : BaseShader(device, hwnd)
+TessellationShader::TessellationShader(ID3D11Device* device, HWND hwnd, bool gpuDriven) : BaseShader(device, hwnd)
 {
-	initShader(L"tessellation_quad_vs.cso", L"tessellation_quad_hs.cso", L"tessellation_quad_ds.cso", L"tessellation_quad_ps.cso");
+	initShader(gpuDriven ? L"gpu_patch_vs.cso" : L"tessellation_quad_vs.cso", gpuDriven ? L"gpu_patch_hs.cso" : L"tessellation_quad_hs.cso", L"tessellation_quad_ds.cso", L"tessellation_quad_ps.cso");
 }
 
 
@@ -27,6 +28,12 @@ TessellationShader::~TessellationShader()
 		tessBuffer->Release();
 		tessBuffer = 0;
 	}
+	// Release the virtual texture buffer
+	if (virtualTextureBuffer)
+	{
+		virtualTextureBuffer->Release();
+		virtualTextureBuffer = 0;
+	}
 	// Release the light buffer
 	if (lightBuffer)
 	{
@@ -61,6 +68,7 @@ void TessellationShader::initShader(const wchar_t* vsFilename, const wchar_t* ps
 	matrixBufferDesc.MiscFlags = 0;
 	matrixBufferDesc.StructureByteStride = 0;
 	renderer->CreateBuffer(&matrixBufferDesc, NULL, &matrixBuffer);
+	MemoryTracker::track(matrixBuffer, MEMORY_CONSTANTS, "Terrain matrices");
 
 	// Setup the description of then tessellation buffer.
 	D3D11_BUFFER_DESC tessBufferDesc;
@@ -71,19 +79,21 @@ void TessellationShader::initShader(const wchar_t* vsFilename, const wchar_t* ps
 	tessBufferDesc.MiscFlags = 0;
 	tessBufferDesc.StructureByteStride = 0;
 	renderer->CreateBuffer(&tessBufferDesc, NULL, &tessBuffer);
-
-	// Setup description of the Texture Sampler.
-	D3D11_SAMPLER_DESC samplerDesc;
-	samplerDesc.Filter = D3D11_FILTER_ANISOTROPIC;
-	samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_WRAP;
-	samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_WRAP;
-	samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_WRAP;
-	samplerDesc.MipLODBias = 0.0f;
-	samplerDesc.MaxAnisotropy = 1;
-	samplerDesc.ComparisonFunc = D3D11_COMPARISON_ALWAYS;
-	samplerDesc.MinLOD = 0;
-	samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
-	renderer->CreateSamplerState(&samplerDesc, &sampleState);
+	MemoryTracker::track(tessBuffer, MEMORY_CONSTANTS, "Terrain tessellation");
+
+	// Setup the description of the virtual texture buffer.
+	D3D11_BUFFER_DESC virtualTextureBufferDesc;
+	virtualTextureBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+	virtualTextureBufferDesc.ByteWidth = sizeof(VirtualTexture::VirtualTextureBufferType);
+	virtualTextureBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	virtualTextureBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	virtualTextureBufferDesc.MiscFlags = 0;
+	virtualTextureBufferDesc.StructureByteStride = 0;
+	renderer->CreateBuffer(&virtualTextureBufferDesc, NULL, &virtualTextureBuffer);
+	MemoryTracker::track(virtualTextureBuffer, MEMORY_CONSTANTS, "Terrain virtual texture");
+
+	// Same anisotropic, wrapping sampler as the lit shaders, so the cache hands back the one they share
+	sampleState = StateCache::get()->getSamplerState(StateCache::anisotropicWrap());
 
 	// Setup description of the Light Buffer
 	D3D11_BUFFER_DESC lightBufferDesc;
@@ -94,6 +104,7 @@ void TessellationShader::initShader(const wchar_t* vsFilename, const wchar_t* ps
 	lightBufferDesc.MiscFlags = 0;
 	lightBufferDesc.StructureByteStride = 0;
 	renderer->CreateBuffer(&lightBufferDesc, NULL, &lightBuffer);
+	MemoryTracker::track(lightBuffer, MEMORY_CONSTANTS, "Terrain lights");
 }
 
 void TessellationShader::initShader(const wchar_t* vsFilename, const wchar_t* hsFilename, const wchar_t* dsFilename, const wchar_t* psFilename)
@@ -107,19 +118,16 @@ void TessellationShader::initShader(const wchar_t* vsFilename, const wchar_t* hs
 }
 
 
-void TessellationShader::setShaderParameters(ID3D11DeviceContext* deviceContext, const XMMATRIX& worldMatrix, const XMMATRIX& viewMatrix, const XMMATRIX& projectionMatrix, ID3D11ShaderResourceView* heightMap, ID3D11ShaderResourceView* shadowMap1, ID3D11ShaderResourceView* shadowMap2, int tessFactor, Light* lights[], bool active[], float dropoff2, bool bumpMapping, float specInt, float specExp, Camera* cam, float cutOffAngle)
+void TessellationShader::setShaderParameters(ID3D11DeviceContext* deviceContext, const XMMATRIX& worldMatrix, const XMMATRIX& viewMatrix, const XMMATRIX& projectionMatrix, ID3D11ShaderResourceView* heightMap, ID3D11ShaderResourceView* shadowAtlas, ID3D11ShaderResourceView* momentAtlas, int tessFactor, Light* lights[], bool active[], float dropoff2, bool bumpMapping, float specInt, float specExp, Camera* cam, float cutOffAngle)
 {
-	HRESULT result;
-	D3D11_MAPPED_SUBRESOURCE mappedResource;
-
 	// Transpose the matrices to prepare them for the shader.
 	XMMATRIX tworld = XMMatrixTranspose(worldMatrix);
 	XMMATRIX tview = XMMatrixTranspose(viewMatrix);
 	XMMATRIX tproj = XMMatrixTranspose(projectionMatrix);
 
 	// Set matrix buffer with both world, view and projection matrices and send to Domain Shader
-	result = deviceContext->Map(matrixBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
-	MatrixBufferType* dataPtr = (MatrixBufferType*)mappedResource.pData;
+	MatrixBufferType matrices;
+	MatrixBufferType* dataPtr = &matrices;
 	dataPtr->worldMatrix = tworld;// worldMatrix;
 	dataPtr->viewMatrix = tview;
 	dataPtr->projectionMatrix = tproj;
@@ -131,26 +139,20 @@ void TessellationShader::setShaderParameters(ID3D11DeviceContext* deviceContext,
 	// Set spot light view matrix and projection matrix for use with generating shadows
 	dataPtr->lightViewMatrix2 = XMMatrixTranspose(lights[2]->getViewMatrix());
 	dataPtr->lightProjectionMatrix2 = XMMatrixTranspose(lights[2]->getProjectionMatrix());
+	ConstantRing::setConstants(constantRing, deviceContext, RING_STAGE_DS, 0, &matrices, sizeof(matrices), matrixBuffer);
 
-	deviceContext->Unmap(matrixBuffer, 0);
-	deviceContext->DSSetConstantBuffers(0, 1, &matrixBuffer);
-
-	// Set tessellation factors and send to Hull Shader, Domain Shader and Pixel Shader
-	TessBufferType* tessPtr;
-	deviceContext->Map(tessBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
-	tessPtr = (TessBufferType*)mappedResource.pData;
-	tessPtr->insideFactor = tessFactor;
-	tessPtr->outsideFactor = tessFactor;
-	tessPtr->padding = XMFLOAT2(0.0f, 0.0f);
-	deviceContext->Unmap(tessBuffer, 0);
-	deviceContext->HSSetConstantBuffers(0, 1, &tessBuffer);
-	deviceContext->DSSetConstantBuffers(1, 1, &tessBuffer);
-	deviceContext->PSSetConstantBuffers(1, 1, &tessBuffer);
+	// Set tessellation factors and send to Hull Shader, Domain Shader and Pixel Shader, which read it from different registers
+	TessBufferType tessData;
+	tessData.insideFactor = tessFactor;
+	tessData.outsideFactor = tessFactor;
+	tessData.bakedNormals = normalMap ? 1.0f : 0.0f;
+	tessData.padding = 0.0f;
+	ConstantRing::setConstants(constantRing, deviceContext, RING_STAGE_HS, 0, &tessData, sizeof(tessData), tessBuffer);
+	ConstantRing::setConstants(constantRing, deviceContext, RING_STAGE_DS | RING_STAGE_PS, 1, &tessData, sizeof(tessData), tessBuffer);
 
 	// Set light data and send to pixel shader
-	LightBufferType* lightPtr;
-	deviceContext->Map(lightBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
-	lightPtr = (LightBufferType*)mappedResource.pData;
+	LightBufferType lightData;
+	LightBufferType* lightPtr = &lightData;
 
 	// Directional Light data
 	lightPtr->ambient1 = lights[0]->getAmbientColour();
@@ -177,18 +179,52 @@ void TessellationShader::setShaderParameters(ID3D11DeviceContext* deviceContext,
 	lightPtr->active3 = active[2];
 	lightPtr->direction3 = lights[2]->getDirection();
 	lightPtr->cutoff = cutOffAngle;
-	deviceContext->Unmap(lightBuffer, 0);
-	deviceContext->PSSetConstantBuffers(0, 1, &lightBuffer);
+	ConstantRing::setConstants(constantRing, deviceContext, RING_STAGE_PS, 0, &lightData, sizeof(lightData), lightBuffer);
 
 	// Set sampler and texture for use in the Domain Shader
-	deviceContext->DSSetSamplers(0, 1, &sampleState);
-	deviceContext->DSSetShaderResources(0, 1, &heightMap);
+	StateCache::get()->setSamplers(deviceContext, STAGE_DS, 0, 1, &sampleState);
+	StateCache::get()->setShaderResources(deviceContext, STAGE_DS, 0, 1, &heightMap);
 
 	// Set sampler and textures for use in the Pixel Shader
-	deviceContext->PSSetSamplers(0, 1, &sampleState);
-	deviceContext->PSSetShaderResources(0, 1, &heightMap);
-	deviceContext->PSSetShaderResources(1, 1, &shadowMap1);
-	deviceContext->PSSetShaderResources(2, 1, &shadowMap2);
+	StateCache::get()->setSamplers(deviceContext, STAGE_PS, 0, 1, &sampleState);
+	StateCache::get()->setShaderResources(deviceContext, STAGE_PS, 0, 1, &heightMap);
+	StateCache::get()->setShaderResources(deviceContext, STAGE_PS, 1, 1, &shadowAtlas);
+	StateCache::get()->setShaderResources(deviceContext, STAGE_PS, 2, 1, &momentAtlas);
+	StateCache::get()->setShaderResources(deviceContext, STAGE_PS, 6, 1, &normalMap);
 }
 
+void TessellationShader::setVirtualTexture(ID3D11DeviceContext* deviceContext, VirtualTexture* virtualTexture, int tessFactor, bool enabled)
+{
+	// Set the virtual texture layout and send to Domain Shader and Pixel Shader
+	VirtualTexture::VirtualTextureBufferType layout;
+	virtualTexture->getShaderParameters(layout, tessFactor, enabled);
+	ConstantRing::setConstants(constantRing, deviceContext, RING_STAGE_DS | RING_STAGE_PS, 2, &layout, sizeof(layout), virtualTextureBuffer);
+
+	// Set the page table and physical page cache for use in the Domain Shader and Pixel Shader
+	ID3D11ShaderResourceView* pageTable = virtualTexture->getPageTableSRV();
+	ID3D11ShaderResourceView* physicalTexture = virtualTexture->getPhysicalSRV();
+	StateCache::get()->setShaderResources(deviceContext, STAGE_DS, 1, 1, &pageTable);
+	StateCache::get()->setShaderResources(deviceContext, STAGE_DS, 2, 1, &physicalTexture);
+	StateCache::get()->setShaderResources(deviceContext, STAGE_PS, 3, 1, &pageTable);
+	StateCache::get()->setShaderResources(deviceContext, STAGE_PS, 4, 1, &physicalTexture);
+}
 
+void TessellationShader::bindStages(ID3D11DeviceContext* deviceContext)
+{
+	deviceContext->IASetInputLayout(layout);
+	deviceContext->VSSetShader(vertexShader, NULL, 0);
+	deviceContext->HSSetShader(hullShader, NULL, 0);
+	deviceContext->DSSetShader(domainShader, NULL, 0);
+	deviceContext->GSSetShader(NULL, NULL, 0);
+	deviceContext->PSSetShader(pixelShader, NULL, 0);
+}
+
+void TessellationShader::renderPatches(ID3D11DeviceContext* deviceContext, TPlane* mesh, const vector<int>& patches)
+{
+	// Draws each visible patch's range of the index buffer
+	bindStages(deviceContext);
+	for (int patch : patches)
+	{
+		deviceContext->DrawIndexed(mesh->getPatchIndexCount(patch), mesh->getPatchIndexStart(patch), 0);
+	}
+}
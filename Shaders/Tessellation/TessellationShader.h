@@ -2,6 +2,9 @@
 #pragma once
 
 #include "DXF.h"
+#include "VirtualTexture.h"
+#include "Tplane.h"
+#include "ConstantRing.h"
 
 using namespace std;
 using namespace DirectX;
@@ -11,10 +14,26 @@ class TessellationShader : public BaseShader
 
 public:
 
-	TessellationShader(ID3D11Device* device, HWND hwnd);
+	// When gpuDriven is set, the patches are instanced from the GpuDrivenScene's visible lists with a tessellation factor per patch
+	TessellationShader(ID3D11Device* device, HWND hwnd, bool gpuDriven = false);
 	~TessellationShader();
 
-	void setShaderParameters(ID3D11DeviceContext* deviceContext, const XMMATRIX &world, const XMMATRIX &view, const XMMATRIX &projection, ID3D11ShaderResourceView* heightMap, ID3D11ShaderResourceView* shadowMap1, ID3D11ShaderResourceView* shadowMap2, int tessFactor, Light* lights[], bool active[], float dropoff2, bool bumpMapping, float specInt, float specExp, Camera* cam, float cutOffAngle);
+	void setShaderParameters(ID3D11DeviceContext* deviceContext, const XMMATRIX &world, const XMMATRIX &view, const XMMATRIX &projection, ID3D11ShaderResourceView* heightMap, ID3D11ShaderResourceView* shadowAtlas, ID3D11ShaderResourceView* momentAtlas, int tessFactor, Light* lights[], bool active[], float dropoff2, bool bumpMapping, float specInt, float specExp, Camera* cam, float cutOffAngle);
+
+	// Sends the matrices, tessellation factors, lights and virtual texture layout through the frame's constant ring, when given one
+	void setConstantRing(ConstantRing* ring) { constantRing = ring; }
+
+	// Binds the streamed heightmap, which the shaders sample instead of the heightmap texture while enabled
+	void setVirtualTexture(ID3D11DeviceContext* deviceContext, VirtualTexture* virtualTexture, int tessFactor, bool enabled);
+
+	// Binds a cooked normal map for per pixel normals, sampled in place of working them out from the heightmap. NULL goes back to the heightmap
+	void setNormalMap(ID3D11ShaderResourceView* lnormalMap) { normalMap = lnormalMap; }
+
+	// Binds the input layout and the vertex, hull, domain and pixel shaders without drawing anything, for callers that issue their own draws
+	void bindStages(ID3D11DeviceContext* deviceContext);
+
+	// Draws only the listed patches of the plane, in place of render, so culled patches are never tessellated
+	void renderPatches(ID3D11DeviceContext* deviceContext, TPlane* mesh, const vector<int>& patches);
 
 private:
 	void initShader(const wchar_t* vsFilename, const wchar_t* psFilename);
@@ -23,8 +42,11 @@ private:
 private:
 	ID3D11Buffer* matrixBuffer;
 	ID3D11Buffer* tessBuffer;
+	ID3D11Buffer* virtualTextureBuffer;
 	ID3D11Buffer* lightBuffer;
 	ID3D11SamplerState* sampleState;
+	ConstantRing* constantRing = 0;
+	ID3D11ShaderResourceView* normalMap = 0;
 
 	// Stores matrices to be used in vertex manipulation and shadow generation
 	struct MatrixBufferType
@@ -45,7 +67,8 @@ private:
 	{
 		float insideFactor;
 		float outsideFactor;
-		XMFLOAT2 padding;
+		float bakedNormals;
+		float padding;
 	};
 
 	// Stores light values to calculate lighting
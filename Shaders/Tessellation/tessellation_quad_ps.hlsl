@@ -4,12 +4,19 @@
 
 #include "light_h.hlsli"
 #include "heightmap_h.hlsli"
+#include "virtual_texture_h.hlsli"
 
 Texture2D heightMapTexture : register(t0);
-Texture2D shadowMap1 : register(t1);
-Texture2D shadowMap2 : register(t2);
+Texture2D shadowAtlas : register(t1);
+Texture2D momentAtlas : register(t2);
+Texture2D<uint4> pageTable : register(t3);
+Texture2D physicalTexture : register(t4);
+Texture2DArray horizonMap : register(t5);
+Texture2D normalMap : register(t6);
 
 SamplerState sampler0 : register(s0);
+SamplerState momentSampler : register(s1);
+SamplerState horizonSampler : register(s2);
 
 // Stores Directional, Point and Spot light Attributes
 cbuffer LightBuffer : register(b0)
@@ -44,7 +51,54 @@ cbuffer TessBuffer : register(b1)
 {
     float insideFactor;
     float outsideFactor;
-    float2 padding2;
+    float bakedNormals;
+    float padding2;
+};
+
+// Stores the virtual texture's layout, used instead of the heightmap texture when it is being streamed
+cbuffer VirtualTextureBuffer : register(b2)
+{
+    float2 pagesMip0;
+    float pageSize;
+    float border;
+    float2 physicalSize;
+    float maxMip;
+    float virtualSize;
+    float domainMip;
+    float feedbackBias;
+    float virtualEnabled;
+    float padding3;
+};
+
+// Where each light's tile sits in the shadow atlas, the directional light's first, the spot light's second, then the point light's six faces
+cbuffer ShadowAtlasBuffer : register(b3)
+{
+    float4 shadowTileRects[8];
+};
+
+// How the shadows are filtered, holding the mode, light bleed reduction, moment bias and depth bias, then EVSM's exponents
+cbuffer ShadowFilterBuffer : register(b4)
+{
+    float4 shadowFilter;
+    float2 evsmExponents;
+    float2 padding4;
+};
+
+// Every face of the point light's cube shadow map, whose tiles follow the spot light's in the shadow atlas, and whether the point light casts shadows
+cbuffer PointShadowBuffer : register(b5)
+{
+    matrix pointFaceViewProjection[6];
+    float pointShadows;
+    float3 padding5;
+};
+
+// Whether the terrain shadows itself through the horizon map, how soft the edge is and how many world units the map covers
+cbuffer HorizonBuffer : register(b6)
+{
+    float horizonEnabled;
+    float horizonSoftness;
+    float horizonWorldSize;
+    float padding6;
 };
 
 struct InputType
@@ -65,23 +119,56 @@ float4 main(InputType input) : SV_TARGET
     float4 lightColour[3];
     float activeStates[3] = { active1, active2, active3};
 
-	// Samples the texture
-    textureColour = heightMapTexture.Sample(sampler0, input.tex);
-    
-    // If using Per-Pixel normals, change the normal to be used in lighting calculations
-    if (bumpMapping)
+	// Samples the texture, the heightmap is greyscale so the virtual texture's single channel gives the same colour
+    if (virtualEnabled)
+    {
+        float mip = VirtualTextureMip(input.tex, virtualSize, 0);
+        float height = SampleVirtualHeight(input.tex, mip, pageTable, physicalTexture, sampler0, pagesMip0, pageSize, border, physicalSize, maxMip);
+        textureColour = float4(height, height, height, 1);
+        
+        // If using Per-Pixel normals, change the normal to be used in lighting calculations
+        if (bumpMapping)
+        {
+            input.normal = CalculateVirtualNormal(input.tex.x, input.tex.y, virtualSize, 30, mip, pageTable, physicalTexture, sampler0, pagesMip0, pageSize, border, physicalSize, maxMip);
+        }
+    }
+    else
     {
-        input.normal = CalculatePixelNormal(input.tex.x, input.tex.y, 2048, 30, heightMapTexture, sampler0);
+        textureColour = heightMapTexture.Sample(sampler0, input.tex);
+    
+        // If using Per-Pixel normals, change the normal to be used in lighting calculations
+        if (bumpMapping)
+        {
+            // The cooked normal map holds the same normals already worked out, X and Z, so one sample replaces five
+            if (bakedNormals)
+            {
+                float2 normalXZ = normalMap.Sample(sampler0, input.tex).rg * 2 - 1;
+                input.normal = float3(normalXZ.x, sqrt(saturate(1 - dot(normalXZ, normalXZ))), normalXZ.y);
+            }
+            else
+            {
+                input.normal = CalculatePixelNormal(input.tex.x, input.tex.y, 2048, 30, heightMapTexture, sampler0);
+            }
+        }
     }
     
     // Calculates shadows for the Directional Light, and also calculates lighting
-    lightColour[0] = shadowCalculation(lightDirection1, diffuseColour1, ambientColour1, input.normal, input.lightViewPos1, shadowMap1, 0.005f, sampler0);
+    lightColour[0] = shadowCalculation(lightDirection1, diffuseColour1, ambientColour1, input.normal, input.lightViewPos1, shadowAtlas, momentAtlas, shadowTileRects[0], 0.005f, sampler0, momentSampler, shadowFilter, evsmExponents);
     
     // Calculates lighting for the point light, as well as applying specular and attenuation values to affect those attributes
-    lightColour[1] = calculatePointLighting(lightPosition2, input.worldPosition, camPos, input.normal, diffuseColour2, ambientColour2, dropoff2, specIntensity, specExponent);
+    // When the point light casts shadows, they come from the face of its cube shadow map this pixel falls in
+    if (pointShadows)
+    {
+        int face = PointShadowFace(input.worldPosition - lightPosition2);
+        lightColour[1] = pointlightShadowCalculation(lightPosition2, input.worldPosition, camPos, input.normal, diffuseColour2, ambientColour2, dropoff2, specIntensity, specExponent, pointFaceViewProjection[face], shadowAtlas, momentAtlas, shadowTileRects[2 + face], 0.005f, sampler0, momentSampler, shadowFilter, evsmExponents);
+    }
+    else
+    {
+        lightColour[1] = calculatePointLighting(lightPosition2, input.worldPosition, camPos, input.normal, diffuseColour2, ambientColour2, dropoff2, specIntensity, specExponent);
+    }
     
     // Calcualtes shadows for the Spot Light, and also calculates lighting
-    lightColour[2] = spotlightShadowCalculation(lightPosition3, -lightDirection3, input.worldPosition, input.lightViewPos2, input.normal, diffuseColour3, ambientColour3, cutoff, shadowMap2, 0.005f, sampler0, input.tex);
+    lightColour[2] = spotlightShadowCalculation(lightPosition3, -lightDirection3, input.worldPosition, input.lightViewPos2, input.normal, diffuseColour3, ambientColour3, cutoff, shadowAtlas, momentAtlas, shadowTileRects[1], 0.005f, sampler0, momentSampler, shadowFilter, evsmExponents, input.tex);
     
      // Spot light checks allow for other lights to function, so the cutoff feature doesn't apply to every light in the scene
     if (lightDirection3.x == 0 && lightDirection3.y == 0 && lightDirection3.z == 0)
@@ -93,6 +180,15 @@ float4 main(InputType input) : SV_TARGET
         lightColour[2] = float4(0, 0, 0, 1);
     }
 	
+    // The terrain shadows the Directional and Spot Light through the horizon map instead of the shadow maps while it is enabled
+    // The Spot Light is treated as if it were further away than any ridge towards it
+    if (horizonEnabled)
+    {
+        float2 horizonUV = input.worldPosition.xz / horizonWorldSize;
+        lightColour[0].xyz *= HorizonVisibility(horizonMap, horizonSampler, horizonUV, -lightDirection1, horizonSoftness);
+        lightColour[2].xyz *= HorizonVisibility(horizonMap, horizonSampler, horizonUV, lightPosition3 - input.worldPosition, horizonSoftness);
+    }
+	
     // Checks if any of the lights are active, and if so, adds the colour to total colour variable
     for (int i = 0; i < 3; i++)
     {
@@ -1,5 +1,6 @@
 // Tessellated Plane Mesh, slightly adapted from the original Plane mesh to fit into the Tessellator stage of the DX11 Graphics Pipeline
 #include "Tplane.h"
+#include "MemoryTracker.h"
 
 // Initialise buffer and load texture.
 TPlane::TPlane(ID3D11Device* device, ID3D11DeviceContext* deviceContext, int lresolution)
@@ -29,8 +30,8 @@ void TPlane::initBuffers(ID3D11Device* device)
 	// Calculate the number of vertices in the terrain mesh.
 	vertexCount = (resolution - 1) * (resolution - 1) * 6;
 
-	// Set the index and vertice count
-	indexCount = vertexCount;
+	// Set the index and vertice count, each quad is a four control point patch
+	indexCount = (resolution - 1) * (resolution - 1) * 4;
 	vertices = new VertexType[vertexCount];
 	indices = new unsigned long[indexCount];
 
@@ -43,9 +44,8 @@ void TPlane::initBuffers(ID3D11Device* device)
 	{
 		for (i = 0; i < (resolution - 1); i++)
 		{
-			// Determine the indexes based on the specific spot of the quad
+			// Determine the first vertex based on the specific spot of the quad
 			int verticeIndex = (i * resolution + j) * 4;
-			int indiceIndex = (i * resolution + j) * 4;
 
 			// lower left (upper left)
 			positionX = (float)(i);
@@ -54,7 +54,6 @@ void TPlane::initBuffers(ID3D11Device* device)
 			vertices[verticeIndex].position = XMFLOAT3(positionX, 0.0f, positionZ);
 			vertices[verticeIndex].texture = XMFLOAT2(u, v + increment);
 			vertices[verticeIndex].normal = XMFLOAT3(0.0, 1.0, 0.0);
-			indices[indiceIndex] = verticeIndex;
 
 			// Upper left (bottom left)
 			positionX = (float)(i);
@@ -63,7 +62,6 @@ void TPlane::initBuffers(ID3D11Device* device)
 			vertices[verticeIndex + 1].position = XMFLOAT3(positionX, 0.0f, positionZ);
 			vertices[verticeIndex + 1].texture = XMFLOAT2(u, v);
 			vertices[verticeIndex + 1].normal = XMFLOAT3(0.0, 1.0, 0.0);
-			indices[indiceIndex + 1] = verticeIndex + 1;
 
 			// Bottom right (upper right)
 			positionX = (float)(i + 1);
@@ -72,7 +70,6 @@ void TPlane::initBuffers(ID3D11Device* device)
 			vertices[verticeIndex + 2].position = XMFLOAT3(positionX, 0.0f, positionZ);
 			vertices[verticeIndex + 2].texture = XMFLOAT2(u + increment, v);
 			vertices[verticeIndex + 2].normal = XMFLOAT3(0.0, 1.0, 0.0);
-			indices[indiceIndex + 2] = verticeIndex + 2;
 
 			// Upper right (bottom right)
 			positionX = (float)(i + 1);
@@ -81,7 +78,6 @@ void TPlane::initBuffers(ID3D11Device* device)
 			vertices[verticeIndex + 3].position = XMFLOAT3(positionX, 0.0f, positionZ);
 			vertices[verticeIndex + 3].texture = XMFLOAT2(u + increment, v + increment);
 			vertices[verticeIndex + 3].normal = XMFLOAT3(0.0, 1.0, 0.0);
-			indices[indiceIndex + 3] = verticeIndex + 3;
 
 			// Increment the U texture coord, which is equivalent to the X value
 			u += increment;
@@ -96,6 +92,48 @@ void TPlane::initBuffers(ID3D11Device* device)
 		v += increment;
 	}
 
+	// Order the indices patch by patch, so each patch is a contiguous range that can be drawn on its own
+	int quads = resolution - 1;
+	int patchesPerSide = (quads + PATCH_QUADS - 1) / PATCH_QUADS;
+	index = 0;
+	patchIndexStart.clear();
+	patchIndexCount.clear();
+	patchQuadRange.clear();
+	patchBounds.clear();
+	for (int patchJ = 0; patchJ < patchesPerSide; patchJ++)
+	{
+		for (int patchI = 0; patchI < patchesPerSide; patchI++)
+		{
+			int i0 = patchI * PATCH_QUADS;
+			int j0 = patchJ * PATCH_QUADS;
+			int i1 = min(i0 + PATCH_QUADS, quads);
+			int j1 = min(j0 + PATCH_QUADS, quads);
+
+			patchIndexStart.push_back(index);
+			for (j = j0; j < j1; j++)
+			{
+				for (i = i0; i < i1; i++)
+				{
+					int verticeIndex = (i * resolution + j) * 4;
+					indices[index++] = verticeIndex;
+					indices[index++] = verticeIndex + 1;
+					indices[index++] = verticeIndex + 2;
+					indices[index++] = verticeIndex + 3;
+				}
+			}
+			patchIndexCount.push_back(index - patchIndexStart.back());
+
+			// Store the quad range for bounds calculations, and start with a flat box until the heights are known
+			patchQuadRange.push_back(i0);
+			patchQuadRange.push_back(j0);
+			patchQuadRange.push_back(i1);
+			patchQuadRange.push_back(j1);
+			BoundingBox bounds;
+			BoundingBox::CreateFromPoints(bounds, XMVectorSet((float)i0, 0.0f, (float)j0, 1.0f), XMVectorSet((float)i1, 0.0f, (float)j1, 1.0f));
+			patchBounds.push_back(bounds);
+		}
+	}
+
 	// Set up the description of the static vertex buffer.
 	vertexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
 	vertexBufferDesc.ByteWidth = sizeof(VertexType) * vertexCount;
@@ -109,6 +147,7 @@ void TPlane::initBuffers(ID3D11Device* device)
 	vertexData.SysMemSlicePitch = 0;
 	// Now create the vertex buffer.
 	device->CreateBuffer(&vertexBufferDesc, &vertexData, &vertexBuffer);
+	MemoryTracker::track(vertexBuffer, MEMORY_GEOMETRY, "Terrain patch vertices");
 
 	// Set up the description of the static index buffer.
 	indexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
@@ -123,10 +162,161 @@ void TPlane::initBuffers(ID3D11Device* device)
 	indexData.SysMemSlicePitch = 0;
 	// Create the index buffer.
 	device->CreateBuffer(&indexBufferDesc, &indexData, &indexBuffer);
+	MemoryTracker::track(indexBuffer, MEMORY_GEOMETRY, "Terrain patch indices");
 
 	// Release the arrays now that the buffers have been created and loaded.
 	delete[] vertices;
 	vertices = 0;
 	delete[] indices;
 	indices = 0;
-}
\ No newline at end of file
+}
+
+void TPlane::computePatchBounds(const HeightField& heights, float heightScale)
+{
+	for (int patch = 0; patch < getPatchCount(); patch++)
+	{
+		fitPatch(heights, heightScale, patch);
+	}
+}
+
+void TPlane::refitPatchBounds(const HeightField& heights, float heightScale, int x0, int y0, int x1, int y1, vector<int>& refitted)
+{
+	refitted.clear();
+	for (int patch = 0; patch < getPatchCount(); patch++)
+	{
+		int texelX0, texelY0, texelX1, texelY1;
+		getPatchTexels(heights, patch, texelX0, texelY0, texelX1, texelY1);
+		if (texelsOverlap(texelX0, texelX1, x0, x1, heights.getWidth()) && texelsOverlap(texelY0, texelY1, y0, y1, heights.getHeight()))
+		{
+			fitPatch(heights, heightScale, patch);
+			refitted.push_back(patch);
+		}
+	}
+}
+
+void TPlane::getPatchTexels(const HeightField& heights, int patch, int& texelX0, int& texelY0, int& texelX1, int& texelY1) const
+{
+	// Vertex (x, z) samples the heightmap at texture coordinate (x, z) / resolution, see initBuffers
+	int i0 = patchQuadRange[patch * 4];
+	int j0 = patchQuadRange[patch * 4 + 1];
+	int i1 = patchQuadRange[patch * 4 + 2];
+	int j1 = patchQuadRange[patch * 4 + 3];
+
+	// Covers one extra texel on every side, as bilinear filtering blends in the neighbouring texels
+	texelX0 = (int)floorf((float)i0 / resolution * heights.getWidth()) - 1;
+	texelX1 = (int)ceilf((float)i1 / resolution * heights.getWidth()) + 1;
+	texelY0 = (int)floorf((float)j0 / resolution * heights.getHeight()) - 1;
+	texelY1 = (int)ceilf((float)j1 / resolution * heights.getHeight()) + 1;
+}
+
+void TPlane::fitPatch(const HeightField& heights, float heightScale, int patch)
+{
+	int texelX0, texelY0, texelX1, texelY1;
+	getPatchTexels(heights, patch, texelX0, texelY0, texelX1, texelY1);
+
+	float minHeight = 1.0f;
+	float maxHeight = 0.0f;
+	for (int y = texelY0; y <= texelY1; y++)
+	{
+		for (int x = texelX0; x <= texelX1; x++)
+		{
+			float height = heights.getTexel(x, y);
+			minHeight = min(minHeight, height);
+			maxHeight = max(maxHeight, height);
+		}
+	}
+
+	int i0 = patchQuadRange[patch * 4];
+	int j0 = patchQuadRange[patch * 4 + 1];
+	int i1 = patchQuadRange[patch * 4 + 2];
+	int j1 = patchQuadRange[patch * 4 + 3];
+	BoundingBox::CreateFromPoints(patchBounds[patch], XMVectorSet((float)i0, minHeight * heightScale, (float)j0, 1.0f), XMVectorSet((float)i1, maxHeight * heightScale, (float)j1, 1.0f));
+}
+
+bool TPlane::texelsOverlap(int a0, int a1, int b0, int b1, int size)
+{
+	// Ranges reaching past the edge wrap round, as the sampler does, so b is also tried a whole heightmap to either side
+	for (int shift = -size; shift <= size; shift += size)
+	{
+		if (a0 <= b1 + shift && b0 + shift <= a1)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+void TPlane::buildOccluderMesh(const HeightField& heights, float heightScale, int gridSize, vector<XMFLOAT3>& vertices, vector<unsigned int>& indices) const
+{
+	// Each grid vertex takes the lowest height within half a cell of it
+	vertices.clear();
+	for (int z = 0; z <= gridSize; z++)
+	{
+		for (int x = 0; x <= gridSize; x++)
+		{
+			vertices.push_back(fitOccluderVertex(heights, heightScale, gridSize, x, z));
+		}
+	}
+
+	// Two triangles per grid cell
+	indices.clear();
+	for (int z = 0; z < gridSize; z++)
+	{
+		for (int x = 0; x < gridSize; x++)
+		{
+			unsigned int corner = z * (gridSize + 1) + x;
+			indices.push_back(corner);
+			indices.push_back(corner + gridSize + 1);
+			indices.push_back(corner + 1);
+			indices.push_back(corner + 1);
+			indices.push_back(corner + gridSize + 1);
+			indices.push_back(corner + gridSize + 2);
+		}
+	}
+}
+
+void TPlane::refitOccluderMesh(const HeightField& heights, float heightScale, int gridSize, vector<XMFLOAT3>& vertices, int x0, int y0, int x1, int y1) const
+{
+	if ((int)vertices.size() != (gridSize + 1) * (gridSize + 1))
+	{
+		return;
+	}
+	for (int z = 0; z <= gridSize; z++)
+	{
+		for (int x = 0; x <= gridSize; x++)
+		{
+			int texelX0, texelY0, texelX1, texelY1;
+			getOccluderTexels(heights, gridSize, x, z, texelX0, texelY0, texelX1, texelY1);
+			if (texelsOverlap(texelX0, texelX1, x0, x1, heights.getWidth()) && texelsOverlap(texelY0, texelY1, y0, y1, heights.getHeight()))
+			{
+				vertices[z * (gridSize + 1) + x] = fitOccluderVertex(heights, heightScale, gridSize, x, z);
+			}
+		}
+	}
+}
+
+void TPlane::getOccluderTexels(const HeightField& heights, int gridSize, int x, int z, int& texelX0, int& texelY0, int& texelX1, int& texelY1) const
+{
+	float cellSize = (float)(resolution - 1) / gridSize;
+	texelX0 = (int)floorf((x - 0.5f) * cellSize / resolution * heights.getWidth());
+	texelX1 = (int)ceilf((x + 0.5f) * cellSize / resolution * heights.getWidth());
+	texelY0 = (int)floorf((z - 0.5f) * cellSize / resolution * heights.getHeight());
+	texelY1 = (int)ceilf((z + 0.5f) * cellSize / resolution * heights.getHeight());
+}
+
+XMFLOAT3 TPlane::fitOccluderVertex(const HeightField& heights, float heightScale, int gridSize, int x, int z) const
+{
+	int texelX0, texelY0, texelX1, texelY1;
+	getOccluderTexels(heights, gridSize, x, z, texelX0, texelY0, texelX1, texelY1);
+
+	float minHeight = 1.0f;
+	for (int texelY = texelY0; texelY <= texelY1; texelY++)
+	{
+		for (int texelX = texelX0; texelX <= texelX1; texelX++)
+		{
+			minHeight = min(minHeight, heights.getTexel(texelX, texelY));
+		}
+	}
+	float cellSize = (float)(resolution - 1) / gridSize;
+	return XMFLOAT3(x * cellSize, minHeight * heightScale, z * cellSize);
+}
@@ -1,5 +1,12 @@
 
 #include "BaseMesh.h"
+#include "HeightField.h"
+#include <DirectXCollision.h>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+using namespace DirectX;
 
 class TPlane : public BaseMesh
 {
@@ -17,7 +24,42 @@ public:
 	TPlane(ID3D11Device* device, ID3D11DeviceContext* deviceContext, int resolution = 100);
 	~TPlane();
 
+	// The index buffer is ordered patch by patch, so a square block of quads can be drawn (or culled) on its own
+	int getPatchCount() const { return (int)patchIndexStart.size(); }
+	int getPatchIndexStart(int patch) const { return patchIndexStart[patch]; }
+	int getPatchIndexCount(int patch) const { return patchIndexCount[patch]; }
+	const BoundingBox& getPatchBounds(int patch) const { return patchBounds[patch]; }
+
+	// Recalculates each patch's bounding box from the heights the domain shader will displace it by
+	void computePatchBounds(const HeightField& heights, float heightScale);
+
+	// Recalculates only the patches whose bounds read heightmap texels x0 to x1 and y0 to y1, listing the ones it refitted
+	void refitPatchBounds(const HeightField& heights, float heightScale, int x0, int y0, int x1, int y1, vector<int>& refitted);
+
+	// Builds a coarse grid covering the plane for use as an occluder. Each vertex takes the lowest height around it, so the grid never sticks out of the real terrain
+	void buildOccluderMesh(const HeightField& heights, float heightScale, int gridSize, vector<XMFLOAT3>& vertices, vector<unsigned int>& indices) const;
+
+	// Lowers or raises only the occluder grid's vertices that take their height from texels x0 to x1 and y0 to y1
+	void refitOccluderMesh(const HeightField& heights, float heightScale, int gridSize, vector<XMFLOAT3>& vertices, int x0, int y0, int x1, int y1) const;
+
+	// Number of quads along each side of a patch
+	static const int PATCH_QUADS = 11;
+
 protected:
 	void initBuffers(ID3D11Device* device);
+
+	// Heightmap texels a patch's bounds and an occluder vertex's height are taken from, which may reach past the edge
+	void getPatchTexels(const HeightField& heights, int patch, int& texelX0, int& texelY0, int& texelX1, int& texelY1) const;
+	void getOccluderTexels(const HeightField& heights, int gridSize, int x, int z, int& texelX0, int& texelY0, int& texelX1, int& texelY1) const;
+	void fitPatch(const HeightField& heights, float heightScale, int patch);
+	XMFLOAT3 fitOccluderVertex(const HeightField& heights, float heightScale, int gridSize, int x, int z) const;
+
+	// Whether texels a0 to a1 share any texel with b0 to b1, across a heightmap size texels wide
+	static bool texelsOverlap(int a0, int a1, int b0, int b1, int size);
 	int resolution;
+
+	vector<int> patchIndexStart;
+	vector<int> patchIndexCount;
+	vector<int> patchQuadRange;
+	vector<BoundingBox> patchBounds;
 };
\ No newline at end of file
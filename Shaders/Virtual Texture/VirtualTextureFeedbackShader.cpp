@@ -0,0 +1,144 @@
+#include "VirtualTextureFeedbackShader.h"
+#include "MemoryTracker.h"
+
+
+VirtualTextureFeedbackShader::VirtualTextureFeedbackShader(ID3D11Device* device, HWND hwnd) : BaseShader(device, hwnd)
+{
+	initShader(L"tessellation_quad_vs.cso", L"tessellation_quad_hs.cso", L"tessellation_quad_ds.cso", L"vt_feedback_ps.cso");
+}
+
+
+VirtualTextureFeedbackShader::~VirtualTextureFeedbackShader()
+{
+	// Release the sampler
+	if (sampleState)
+	{
+		sampleState->Release();
+		sampleState = 0;
+	}
+	// Release the matrix buffer
+	if (matrixBuffer)
+	{
+		matrixBuffer->Release();
+		matrixBuffer = 0;
+	}
+	// Release the tessellation buffer
+	if (tessBuffer)
+	{
+		tessBuffer->Release();
+		tessBuffer = 0;
+	}
+	// Release the virtual texture buffer
+	if (virtualTextureBuffer)
+	{
+		virtualTextureBuffer->Release();
+		virtualTextureBuffer = 0;
+	}
+	// Release layout
+	if (layout)
+	{
+		layout->Release();
+		layout = 0;
+	}
+
+	//Release base shader components
+	BaseShader::~BaseShader();
+}
+
+void VirtualTextureFeedbackShader::initShader(const wchar_t* vsFilename, const wchar_t* psFilename)
+{
+	// Load (+ compile) shader files
+	loadVertexShader(vsFilename);
+	loadPixelShader(psFilename);
+
+	// Setup the description of the dynamic matrix buffer.
+	D3D11_BUFFER_DESC matrixBufferDesc;
+	matrixBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+	matrixBufferDesc.ByteWidth = sizeof(MatrixBufferType);
+	matrixBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	matrixBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	matrixBufferDesc.MiscFlags = 0;
+	matrixBufferDesc.StructureByteStride = 0;
+	renderer->CreateBuffer(&matrixBufferDesc, NULL, &matrixBuffer);
+	MemoryTracker::track(matrixBuffer, MEMORY_CONSTANTS, "Feedback matrices");
+
+	// Setup the description of the tessellation buffer.
+	D3D11_BUFFER_DESC tessBufferDesc;
+	tessBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+	tessBufferDesc.ByteWidth = sizeof(TessBufferType);
+	tessBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	tessBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	tessBufferDesc.MiscFlags = 0;
+	tessBufferDesc.StructureByteStride = 0;
+	renderer->CreateBuffer(&tessBufferDesc, NULL, &tessBuffer);
+	MemoryTracker::track(tessBuffer, MEMORY_CONSTANTS, "Feedback tessellation");
+
+	// Setup the description of the virtual texture buffer.
+	D3D11_BUFFER_DESC virtualTextureBufferDesc;
+	virtualTextureBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+	virtualTextureBufferDesc.ByteWidth = sizeof(VirtualTexture::VirtualTextureBufferType);
+	virtualTextureBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	virtualTextureBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	virtualTextureBufferDesc.MiscFlags = 0;
+	virtualTextureBufferDesc.StructureByteStride = 0;
+	renderer->CreateBuffer(&virtualTextureBufferDesc, NULL, &virtualTextureBuffer);
+	MemoryTracker::track(virtualTextureBuffer, MEMORY_CONSTANTS, "Feedback virtual texture");
+
+	// Anisotropic and wrapping, shared with the other shaders through the state cache
+	sampleState = StateCache::get()->getSamplerState(StateCache::anisotropicWrap());
+}
+
+void VirtualTextureFeedbackShader::initShader(const wchar_t* vsFilename, const wchar_t* hsFilename, const wchar_t* dsFilename, const wchar_t* psFilename)
+{
+	// InitShader must be overwritten and it will load both vertex and pixel shaders + setup buffers
+	initShader(vsFilename, psFilename);
+
+	// Load other required shaders.
+	loadHullShader(hsFilename);
+	loadDomainShader(dsFilename);
+}
+
+
+void VirtualTextureFeedbackShader::setShaderParameters(ID3D11DeviceContext* deviceContext, const XMMATRIX& worldMatrix, const XMMATRIX& viewMatrix, const XMMATRIX& projectionMatrix, ID3D11ShaderResourceView* heightMap, int tessFactor, VirtualTexture* virtualTexture, bool virtualEnabled)
+{
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+
+	// Set matrix buffer and send to Domain Shader, the light matrices are not used by this pass
+	deviceContext->Map(matrixBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+	MatrixBufferType* dataPtr = (MatrixBufferType*)mappedResource.pData;
+	dataPtr->worldMatrix = XMMatrixTranspose(worldMatrix);
+	dataPtr->viewMatrix = XMMatrixTranspose(viewMatrix);
+	dataPtr->projectionMatrix = XMMatrixTranspose(projectionMatrix);
+	dataPtr->lightViewMatrix1 = XMMatrixIdentity();
+	dataPtr->lightProjectionMatrix1 = XMMatrixIdentity();
+	dataPtr->lightViewMatrix2 = XMMatrixIdentity();
+	dataPtr->lightProjectionMatrix2 = XMMatrixIdentity();
+	deviceContext->Unmap(matrixBuffer, 0);
+	StateCache::get()->setConstantBuffers(deviceContext, STAGE_DS, 0, 1, &matrixBuffer);
+
+	// Set tessellation factors and send to Hull Shader and Domain Shader
+	TessBufferType* tessPtr;
+	deviceContext->Map(tessBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+	tessPtr = (TessBufferType*)mappedResource.pData;
+	tessPtr->insideFactor = tessFactor;
+	tessPtr->outsideFactor = tessFactor;
+	tessPtr->padding = XMFLOAT2(0.0f, 0.0f);
+	deviceContext->Unmap(tessBuffer, 0);
+	StateCache::get()->setConstantBuffers(deviceContext, STAGE_HS, 0, 1, &tessBuffer);
+	StateCache::get()->setConstantBuffers(deviceContext, STAGE_DS, 1, 1, &tessBuffer);
+
+	// Set the virtual texture layout and send to Domain Shader and Pixel Shader
+	deviceContext->Map(virtualTextureBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+	virtualTexture->getShaderParameters(*(VirtualTexture::VirtualTextureBufferType*)mappedResource.pData, tessFactor, virtualEnabled);
+	deviceContext->Unmap(virtualTextureBuffer, 0);
+	StateCache::get()->setConstantBuffers(deviceContext, STAGE_DS, 2, 1, &virtualTextureBuffer);
+	StateCache::get()->setConstantBuffers(deviceContext, STAGE_PS, 0, 1, &virtualTextureBuffer);
+
+	// Set sampler and textures for use in the Domain Shader
+	ID3D11ShaderResourceView* pageTable = virtualTexture->getPageTableSRV();
+	ID3D11ShaderResourceView* physicalTexture = virtualTexture->getPhysicalSRV();
+	StateCache::get()->setSamplers(deviceContext, STAGE_DS, 0, 1, &sampleState);
+	StateCache::get()->setShaderResources(deviceContext, STAGE_DS, 0, 1, &heightMap);
+	StateCache::get()->setShaderResources(deviceContext, STAGE_DS, 1, 1, &pageTable);
+	StateCache::get()->setShaderResources(deviceContext, STAGE_DS, 2, 1, &physicalTexture);
+}
@@ -0,0 +1,52 @@
+// Renders the tessellated heightmap with the same displacement as the Tessellation Shader, but outputs the virtual texture page each pixel needs
+#pragma once
+
+#include "DXF.h"
+#include "StateCache.h"
+#include "VirtualTexture.h"
+
+using namespace std;
+using namespace DirectX;
+
+class VirtualTextureFeedbackShader : public BaseShader
+{
+
+public:
+
+	VirtualTextureFeedbackShader(ID3D11Device* device, HWND hwnd);
+	~VirtualTextureFeedbackShader();
+
+	void setShaderParameters(ID3D11DeviceContext* deviceContext, const XMMATRIX& world, const XMMATRIX& view, const XMMATRIX& projection, ID3D11ShaderResourceView* heightMap, int tessFactor, VirtualTexture* virtualTexture, bool virtualEnabled);
+
+private:
+	void initShader(const wchar_t* vsFilename, const wchar_t* psFilename);
+	void initShader(const wchar_t* vsFilename, const wchar_t* hsFilename, const wchar_t* dsFilename, const wchar_t* psFilename);
+
+private:
+	ID3D11Buffer* matrixBuffer;
+	ID3D11Buffer* tessBuffer;
+	ID3D11Buffer* virtualTextureBuffer;
+	ID3D11SamplerState* sampleState;
+
+	// Matches the Tessellation Shader's matrix buffer, as the same domain shader is used (the light matrices are unused here)
+	struct MatrixBufferType
+	{
+		XMMATRIX worldMatrix;
+		XMMATRIX viewMatrix;
+		XMMATRIX projectionMatrix;
+
+		XMMATRIX lightViewMatrix1;
+		XMMATRIX lightProjectionMatrix1;
+
+		XMMATRIX lightViewMatrix2;
+		XMMATRIX lightProjectionMatrix2;
+	};
+
+	// Stores the inside and outside factor, which determines how the quad is sliced
+	struct TessBufferType
+	{
+		float insideFactor;
+		float outsideFactor;
+		XMFLOAT2 padding;
+	};
+};
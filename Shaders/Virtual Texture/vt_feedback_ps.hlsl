@@ -0,0 +1,33 @@
+// Virtual Texture Feedback Pixel Shader
+// Writes the page (and mip) of the virtual heightmap each pixel would sample, so the CPU can stream in only the visible pages
+
+#include "virtual_texture_h.hlsli"
+
+// Stores the virtual texture's layout
+cbuffer VirtualTextureBuffer : register(b0)
+{
+    float2 pagesMip0;
+    float pageSize;
+    float border;
+    float2 physicalSize;
+    float maxMip;
+    float virtualSize;
+    float domainMip;
+    float feedbackBias;
+    float virtualEnabled;
+    float padding;
+};
+
+struct InputType
+{
+    float4 position : SV_POSITION;
+    float2 tex : TEXCOORD0;
+};
+
+uint main(InputType input) : SV_TARGET
+{
+    // The pixel shader's mip is biased to account for the smaller feedback target, and the domain shader samples at a fixed mip,
+    // so the finer of the two is requested (the coarser one is always requested as a fallback anyway)
+    float mip = min(VirtualTextureMip(input.tex, virtualSize, feedbackBias), domainMip);
+    return EncodeVirtualPage(input.tex, mip, pagesMip0, maxMip);
+}
@@ -0,0 +1,286 @@
+#include "FramePipeline.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// Weight given to each new frame's overlap, latency and timing figures
+static const double STATS_SMOOTHING = 0.05;
+
+// Ticks more than this far behind are dropped rather than run back to back, after a stall such as dragging the window
+static const int MAX_CATCH_UP_TICKS = 8;
+
+FramePipeline::FramePipeline(const TerrainQuery* lterrain, int ltickRate)
+{
+	terrain = lterrain;
+	tickRate = max(ltickRate, 1);
+	epoch = chrono::steady_clock::now();
+	stopping = false;
+	pendingMove = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	pendingTurn = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	pendingInputTime = -1.0;
+	memset(&edits, 0, sizeof(edits));
+	collision = false;
+	clearance = 1.0f;
+	memset(packets, 0, sizeof(packets));
+	front = 0;
+	busyNext = 0;
+	for (int i = 0; i < BUSY_HISTORY; i++)
+	{
+		busyStart[i] = busyEnd[i] = -1.0;
+	}
+	renderStart = 0.0;
+	lastInputTime = -1.0;
+	memset(&stats, 0, sizeof(stats));
+}
+
+FramePipeline::~FramePipeline()
+{
+	stop();
+}
+
+void FramePipeline::start(const FrameState& initial)
+{
+	stop();
+	{
+		lock_guard<mutex> guard(lock);
+		stopping = false;
+		pendingMove = XMFLOAT3(0.0f, 0.0f, 0.0f);
+		pendingTurn = XMFLOAT3(0.0f, 0.0f, 0.0f);
+		pendingInputTime = -1.0;
+		edits = initial;
+
+		// Both buffers start out as the initial state, so the first frames have something to draw before the first tick
+		for (int i = 0; i < 2; i++)
+		{
+			packets[i].previous = initial;
+			packets[i].current = initial;
+			packets[i].tick = 0;
+			packets[i].tickTime = now();
+			packets[i].inputTime = -1.0;
+		}
+	}
+	updateThread = thread(&FramePipeline::run, this, initial);
+}
+
+void FramePipeline::stop()
+{
+	if (!updateThread.joinable())
+	{
+		return;
+	}
+	{
+		lock_guard<mutex> guard(lock);
+		stopping = true;
+	}
+	wake.notify_all();
+	updateThread.join();
+}
+
+void FramePipeline::addInput(const XMFLOAT3& move, const XMFLOAT3& turn)
+{
+	if (move.x == 0.0f && move.y == 0.0f && move.z == 0.0f && turn.x == 0.0f && turn.y == 0.0f && turn.z == 0.0f)
+	{
+		return;
+	}
+	lock_guard<mutex> guard(lock);
+	pendingMove = XMFLOAT3(pendingMove.x + move.x, pendingMove.y + move.y, pendingMove.z + move.z);
+	pendingTurn = XMFLOAT3(pendingTurn.x + turn.x, pendingTurn.y + turn.y, pendingTurn.z + turn.z);
+	pendingInputTime = now();
+}
+
+void FramePipeline::setEdits(const FrameState& ledits)
+{
+	lock_guard<mutex> guard(lock);
+	edits = ledits;
+}
+
+void FramePipeline::setCameraCollision(bool enabled, float lclearance)
+{
+	lock_guard<mutex> guard(lock);
+	collision = enabled;
+	clearance = lclearance;
+}
+
+FrameState FramePipeline::acquire(FramePacket& packet)
+{
+	{
+		lock_guard<mutex> guard(lock);
+		packet = packets[front];
+	}
+
+	// Drawing a tick behind means now always falls between the two states, until the update thread falls behind
+	double tickSeconds = 1.0 / tickRate;
+	float t = (float)min(max((now() - packet.tickTime) / tickSeconds, 0.0), 1.0);
+	stats.interpolation = t;
+	return interpolate(packet.previous, packet.current, t);
+}
+
+void FramePipeline::beginRender()
+{
+	renderStart = now();
+}
+
+void FramePipeline::endRender(double inputTime, double gpuMilliseconds)
+{
+	double renderEnd = now();
+	double renderMilliseconds = (renderEnd - renderStart) * 1000.0;
+
+	// Adds up the parts of the recent ticks that fell inside this frame
+	double overlap = 0.0;
+	{
+		lock_guard<mutex> guard(lock);
+		for (int i = 0; i < BUSY_HISTORY; i++)
+		{
+			if (busyStart[i] >= 0.0)
+			{
+				overlap += max(min(busyEnd[i], renderEnd) - max(busyStart[i], renderStart), 0.0);
+			}
+		}
+	}
+	stats.renderMilliseconds += (renderMilliseconds - stats.renderMilliseconds) * STATS_SMOOTHING;
+	stats.overlapMilliseconds += (overlap * 1000.0 - stats.overlapMilliseconds) * STATS_SMOOTHING;
+	stats.overlapFraction = stats.renderMilliseconds > 0.0 ? stats.overlapMilliseconds / stats.renderMilliseconds : 0.0;
+
+	// Input is only measured on the first frame that shows it
+	if (inputTime >= 0.0 && inputTime > lastInputTime)
+	{
+		double latency = (renderEnd - inputTime) * 1000.0;
+		stats.inputToPresentMilliseconds += (latency - stats.inputToPresentMilliseconds) * STATS_SMOOTHING;
+		stats.inputToPhotonMilliseconds = stats.inputToPresentMilliseconds + gpuMilliseconds;
+		lastInputTime = inputTime;
+	}
+}
+
+double FramePipeline::now() const
+{
+	return chrono::duration<double>(chrono::steady_clock::now() - epoch).count();
+}
+
+FramePipelineStats FramePipeline::getStats()
+{
+	lock_guard<mutex> guard(lock);
+	return stats;
+}
+
+void FramePipeline::run(FrameState state)
+{
+	double tickSeconds = 1.0 / tickRate;
+	double nextTick = now() + tickSeconds;
+	uint64_t tick = 0;
+	FrameState previous = state;
+	while (true)
+	{
+		{
+			// Sleeps until the tick is due, waking early only to stop
+			unique_lock<mutex> guard(lock);
+			chrono::steady_clock::time_point due = epoch + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(nextTick));
+			if (wake.wait_until(guard, due, [this] { return stopping; }))
+			{
+				return;
+			}
+		}
+		double tickStart = now();
+
+		// Takes the input gathered since the last tick and the newest edits
+		XMFLOAT3 move, turn;
+		double inputTime;
+		{
+			lock_guard<mutex> guard(lock);
+			move = pendingMove;
+			turn = pendingTurn;
+			inputTime = pendingInputTime;
+			pendingMove = XMFLOAT3(0.0f, 0.0f, 0.0f);
+			pendingTurn = XMFLOAT3(0.0f, 0.0f, 0.0f);
+			pendingInputTime = -1.0;
+			XMFLOAT3 cameraPosition = state.cameraPosition;
+			XMFLOAT3 cameraRotation = state.cameraRotation;
+			state = edits;
+			state.cameraPosition = cameraPosition;
+			state.cameraRotation = cameraRotation;
+		}
+		step(state, move, turn);
+		tick++;
+
+		// Fills the back packet, then makes it the front one
+		FramePacket& packet = packets[1 - front];
+		packet.previous = previous;
+		packet.current = state;
+		packet.tick = tick;
+		packet.tickTime = nextTick;
+		packet.inputTime = inputTime;
+		previous = state;
+		double tickEnd = now();
+		{
+			lock_guard<mutex> guard(lock);
+			front = 1 - front;
+			busyStart[busyNext] = tickStart;
+			busyEnd[busyNext] = tickEnd;
+			busyNext = (busyNext + 1) % BUSY_HISTORY;
+			stats.updateMilliseconds += ((tickEnd - tickStart) * 1000.0 - stats.updateMilliseconds) * STATS_SMOOTHING;
+			stats.ticks = tick;
+		}
+
+		// Runs late ticks back to back to catch up, unless so far behind that they're dropped
+		nextTick += tickSeconds;
+		double behind = now() - nextTick;
+		if (behind > MAX_CATCH_UP_TICKS * tickSeconds)
+		{
+			uint64_t skipped = (uint64_t)(behind / tickSeconds);
+			nextTick += skipped * tickSeconds;
+			lock_guard<mutex> guard(lock);
+			stats.skippedTicks += skipped;
+		}
+	}
+}
+
+void FramePipeline::step(FrameState& state, const XMFLOAT3& move, const XMFLOAT3& turn)
+{
+	state.cameraPosition = XMFLOAT3(state.cameraPosition.x + move.x, state.cameraPosition.y + move.y, state.cameraPosition.z + move.z);
+	state.cameraRotation = XMFLOAT3(state.cameraRotation.x + turn.x, state.cameraRotation.y + turn.y, state.cameraRotation.z + turn.z);
+
+	// Lifts the camera back out of the terrain if it has been flown into it
+	bool collide;
+	float height;
+	{
+		lock_guard<mutex> guard(lock);
+		collide = collision;
+		height = clearance;
+	}
+	if (collide && terrain)
+	{
+		lock_guard<mutex> terrainGuard(terrainLock);
+		float ground = terrain->getHeight(state.cameraPosition.x, state.cameraPosition.z) + height;
+		state.cameraPosition.y = max(state.cameraPosition.y, ground);
+	}
+}
+
+FrameState FramePipeline::interpolate(const FrameState& a, const FrameState& b, float t)
+{
+	FrameState state = b;
+	XMStoreFloat3(&state.cameraPosition, XMVectorLerp(XMLoadFloat3(&a.cameraPosition), XMLoadFloat3(&b.cameraPosition), t));
+
+	// Rotations are in degrees, so each axis is turned the shorter way round
+	float from[3] = { a.cameraRotation.x, a.cameraRotation.y, a.cameraRotation.z };
+	float to[3] = { b.cameraRotation.x, b.cameraRotation.y, b.cameraRotation.z };
+	float blended[3];
+	for (int axis = 0; axis < 3; axis++)
+	{
+		float difference = remainderf(to[axis] - from[axis], 360.0f);
+		blended[axis] = from[axis] + difference * t;
+	}
+	state.cameraRotation = XMFLOAT3(blended[0], blended[1], blended[2]);
+
+	// Light and cube positions move smoothly when edited, everything else snaps to the newer state
+	for (int light = 0; light < 3; light++)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			state.lightPosition[light][axis] = a.lightPosition[light][axis] + (b.lightPosition[light][axis] - a.lightPosition[light][axis]) * t;
+		}
+	}
+	for (int axis = 0; axis < 3; axis++)
+	{
+		state.cubePosition[axis] = a.cubePosition[axis] + (b.cubePosition[axis] - a.cubePosition[axis]) * t;
+	}
+	return state;
+}
@@ -0,0 +1,152 @@
+// Runs the scene's simulation on its own thread at a fixed rate, so the render thread can draw one frame while the next is being updated.
+// The update thread steps the camera from the input the render thread samples, with the GUI's lights, cube and settings handed over as
+// edits, and publishes each tick as an immutable packet holding the previous and current state. The render thread copies the newest packet
+// out of a double buffer and draws a state interpolated between the two, one tick behind, so movement stays smooth whatever the frame rate
+#pragma once
+
+#include "TerrainQuery.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+using namespace std;
+using namespace DirectX;
+
+// Everything a frame is drawn from that the update thread owns. Lights are the directional (0), point (1) and spot (2) light,
+// in the order the light array holds them
+struct FrameState
+{
+	// Camera position and rotation in degrees, as the camera holds them
+	XMFLOAT3 cameraPosition;
+	XMFLOAT3 cameraRotation;
+
+	bool lightActive[3];
+	float lightDirection[3][3];
+	float lightPosition[3][3];
+	float lightDiffuse[3][4];
+	float lightAmbient[3][4];
+	float pointDropoff;
+	float spotCutoff;
+
+	float cubePosition[3];
+
+	int tessFactor;
+	bool pixelNormals;
+	float specIntensity;
+	float specExponent;
+};
+
+// One tick's output. Never written again once published
+struct FramePacket
+{
+	FrameState previous;
+	FrameState current;
+	uint64_t tick;
+
+	// Pipeline clock time the current state is for, and when the newest input it includes was sampled, or -1 if it includes none
+	double tickTime;
+	double inputTime;
+};
+
+struct FramePipelineStats
+{
+	// Update thread time per tick, and the render thread's CPU time per frame from starting the frame to presenting it
+	double updateMilliseconds;
+	double renderMilliseconds;
+
+	// Time in each frame the update thread was busy alongside the render thread, and as a fraction of the frame
+	double overlapMilliseconds;
+	double overlapFraction;
+
+	// From sampling input to presenting the frame showing it, and with the GPU's frame time added as an estimate of when it is displayed
+	double inputToPresentMilliseconds;
+	double inputToPhotonMilliseconds;
+
+	// How far between the packet's two states the last frame was drawn, and how many ticks the update thread has run and skipped
+	double interpolation;
+	uint64_t ticks;
+	uint64_t skippedTicks;
+};
+
+class FramePipeline
+{
+public:
+	// Ticks tickRate times a second once started. Terrain is used for camera collision, and may be NULL
+	FramePipeline(const TerrainQuery* lterrain, int ltickRate = 120);
+	~FramePipeline();
+
+	// Starts the update thread from a state, or stops it. Stopping waits for the tick in progress
+	void start(const FrameState& initial);
+	void stop();
+	bool isRunning() const { return updateThread.joinable(); }
+
+	// Adds camera movement, in world units and degrees, the render thread sampled since it last called this
+	void addInput(const XMFLOAT3& move, const XMFLOAT3& turn);
+
+	// Hands over the lights, cube and settings as last edited, taken up by the next tick. The camera in edits is ignored
+	void setEdits(const FrameState& edits);
+
+	// Keeps the camera clearance units above the terrain while collision is on
+	void setCameraCollision(bool enabled, float clearance);
+
+	// Held by the update thread while it reads the terrain, so anything changing the terrain's heights holds it too
+	mutex& getTerrainLock() { return terrainLock; }
+
+	// Copies the newest packet out and returns the state to draw now, between its previous and current state
+	FrameState acquire(FramePacket& packet);
+
+	// Mark the render thread's frame, from before acquiring the packet to after presenting. inputTime is when the input the frame shows
+	// was sampled, or -1 if it shows none, and gpuMilliseconds is the GPU's time for a frame
+	void beginRender();
+	void endRender(double inputTime, double gpuMilliseconds);
+
+	// Seconds on the pipeline's clock, which input and packets are timed by
+	double now() const;
+
+	FramePipelineStats getStats();
+	int getTickRate() const { return tickRate; }
+
+	// Blends two states, t of the way from a to b. Rotations take the shorter way round, and settings come from b
+	static FrameState interpolate(const FrameState& a, const FrameState& b, float t);
+
+private:
+	// Steps the update thread at the tick rate until stopped
+	void run(FrameState state);
+
+	// Moves one state forward a tick with the input gathered since the last one
+	void step(FrameState& state, const XMFLOAT3& move, const XMFLOAT3& turn);
+
+	const TerrainQuery* terrain;
+	int tickRate;
+	chrono::steady_clock::time_point epoch;
+
+	thread updateThread;
+	mutex lock;
+	condition_variable wake;
+	bool stopping;
+	mutex terrainLock;
+
+	// Written by the render thread under the lock, taken by the next tick
+	XMFLOAT3 pendingMove;
+	XMFLOAT3 pendingTurn;
+	double pendingInputTime;
+	FrameState edits;
+	bool collision;
+	float clearance;
+
+	// The update thread writes the back packet without the lock, then swaps it to the front under it
+	FramePacket packets[2];
+	int front;
+
+	// Start and end of the update thread's recent ticks, for measuring how much they overlap each frame
+	static const int BUSY_HISTORY = 64;
+	double busyStart[BUSY_HISTORY];
+	double busyEnd[BUSY_HISTORY];
+	int busyNext;
+
+	double renderStart;
+	double lastInputTime;
+	FramePipelineStats stats;
+};
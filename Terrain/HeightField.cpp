@@ -0,0 +1,156 @@
+#include "HeightField.h"
+#include "MemoryTracker.h"
+#include <cmath>
+
+HeightField::HeightField()
+{
+	width = 0;
+	height = 0;
+}
+
+HeightField::~HeightField()
+{
+}
+
+bool HeightField::loadFromTexture(ID3D11Device* device, ID3D11DeviceContext* deviceContext, ID3D11ShaderResourceView* texture)
+{
+	ID3D11Resource* resource = 0;
+	ID3D11Texture2D* sourceTexture = 0;
+	ID3D11Texture2D* stagingTexture = 0;
+	D3D11_TEXTURE2D_DESC textureDesc;
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+
+	if (!texture)
+	{
+		return false;
+	}
+
+	// Get the texture behind the shader resource view
+	texture->GetResource(&resource);
+	if (FAILED(resource->QueryInterface(__uuidof(ID3D11Texture2D), (void**)&sourceTexture)))
+	{
+		resource->Release();
+		return false;
+	}
+	resource->Release();
+
+	// Create a CPU readable copy of the texture, only the top mip is needed
+	sourceTexture->GetDesc(&textureDesc);
+	D3D11_TEXTURE2D_DESC stagingDesc = textureDesc;
+	stagingDesc.MipLevels = 1;
+	stagingDesc.ArraySize = 1;
+	stagingDesc.Usage = D3D11_USAGE_STAGING;
+	stagingDesc.BindFlags = 0;
+	stagingDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	stagingDesc.MiscFlags = 0;
+	if (FAILED(device->CreateTexture2D(&stagingDesc, NULL, &stagingTexture)))
+	{
+		sourceTexture->Release();
+		return false;
+	}
+	MemoryTracker::track(stagingTexture, MEMORY_STAGING, "Height field readback");
+	deviceContext->CopySubresourceRegion(stagingTexture, 0, 0, 0, 0, sourceTexture, 0, NULL);
+	sourceTexture->Release();
+
+	if (FAILED(deviceContext->Map(stagingTexture, 0, D3D11_MAP_READ, 0, &mappedResource)))
+	{
+		stagingTexture->Release();
+		return false;
+	}
+
+	resize(textureDesc.Width, textureDesc.Height);
+
+	// An SRGB texture, or an SRGB view of one, is decoded to linear when the shaders sample it, so its 8 bit values go through the same curve
+	D3D11_SHADER_RESOURCE_VIEW_DESC viewDesc;
+	texture->GetDesc(&viewDesc);
+	bool srgb = textureDesc.Format == DXGI_FORMAT_R8G8B8A8_UNORM_SRGB || textureDesc.Format == DXGI_FORMAT_B8G8R8A8_UNORM_SRGB ||
+		viewDesc.Format == DXGI_FORMAT_R8G8B8A8_UNORM_SRGB || viewDesc.Format == DXGI_FORMAT_B8G8R8A8_UNORM_SRGB;
+	float decode[256];
+	for (int i = 0; i < 256; i++)
+	{
+		float value = i / 255.0f;
+		decode[i] = !srgb ? value : value <= 0.04045f ? value / 12.92f : powf((value + 0.055f) / 1.055f, 2.4f);
+	}
+
+	// Converts each supported format's red channel to a 0-1 height, matching the value the shaders sample
+	bool supported = true;
+	for (int y = 0; y < height && supported; y++)
+	{
+		const unsigned char* row = (const unsigned char*)mappedResource.pData + y * mappedResource.RowPitch;
+		for (int x = 0; x < width; x++)
+		{
+			float value;
+			switch (textureDesc.Format)
+			{
+			case DXGI_FORMAT_R8G8B8A8_TYPELESS:
+			case DXGI_FORMAT_R8G8B8A8_UNORM:
+			case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+				value = decode[row[x * 4]];
+				break;
+			case DXGI_FORMAT_B8G8R8A8_TYPELESS:
+			case DXGI_FORMAT_B8G8R8A8_UNORM:
+			case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+			case DXGI_FORMAT_B8G8R8X8_UNORM:
+				value = decode[row[x * 4 + 2]];
+				break;
+			case DXGI_FORMAT_R8_UNORM:
+				value = row[x] / 255.0f;
+				break;
+			case DXGI_FORMAT_R16_UNORM:
+				value = ((const unsigned short*)row)[x] / 65535.0f;
+				break;
+			case DXGI_FORMAT_R16G16B16A16_UNORM:
+				value = ((const unsigned short*)row)[x * 4] / 65535.0f;
+				break;
+			case DXGI_FORMAT_R32_FLOAT:
+				value = ((const float*)row)[x];
+				break;
+			case DXGI_FORMAT_R32G32B32A32_FLOAT:
+				value = ((const float*)row)[x * 4];
+				break;
+			default:
+				supported = false;
+				value = 0.0f;
+				break;
+			}
+			heights[y * width + x] = value;
+		}
+	}
+
+	deviceContext->Unmap(stagingTexture, 0);
+	stagingTexture->Release();
+
+	return supported;
+}
+
+void HeightField::resize(int newWidth, int newHeight, float value)
+{
+	width = newWidth;
+	height = newHeight;
+	heights.assign((size_t)width * height, value);
+}
+
+float HeightField::getTexel(int x, int y) const
+{
+	// Wraps the coordinates, as the heightmap sampler uses D3D11_TEXTURE_ADDRESS_WRAP
+	x %= width;
+	y %= height;
+	if (x < 0)
+	{
+		x += width;
+	}
+	if (y < 0)
+	{
+		y += height;
+	}
+	return heights[y * width + x];
+}
+
+void HeightField::setTexel(int x, int y, float value)
+{
+	if (x < 0 || y < 0 || x >= width || y >= height)
+	{
+		return;
+	}
+	heights[y * width + x] = value;
+}
@@ -0,0 +1,36 @@
+// CPU-side copy of a heightmap, read back from the GPU texture so that systems running on the CPU can use the same height data as the shaders
+#pragma once
+
+#include "DXF.h"
+#include <vector>
+
+using namespace std;
+using namespace DirectX;
+
+class HeightField
+{
+public:
+	HeightField();
+	~HeightField();
+
+	// Copies the top mip of a loaded texture into the height field, only the X (red) channel is kept as that is all GetHeight reads
+	bool loadFromTexture(ID3D11Device* device, ID3D11DeviceContext* deviceContext, ID3D11ShaderResourceView* texture);
+
+	// Resizes the height field, clearing every texel to the given height
+	void resize(int width, int height, float value = 0.0f);
+
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+
+	// Returns the height of a texel, wrapping the coordinates the same way the shaders' sampler does
+	float getTexel(int x, int y) const;
+	void setTexel(int x, int y, float value);
+
+	float* getData() { return heights.data(); }
+	const float* getData() const { return heights.data(); }
+
+private:
+	int width;
+	int height;
+	vector<float> heights;
+};
@@ -0,0 +1,278 @@
+#include "HorizonMap.h"
+#include "MemoryTracker.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <thread>
+
+HorizonMap::HorizonMap(ID3D11Device* device, const HeightField* lheights, float lworldSize, float lheightScale, int ldownsample)
+{
+	heights = lheights;
+	worldSize = lworldSize;
+	heightScale = lheightScale;
+	downsample = max(ldownsample, 1);
+	size = heights->getWidth() / downsample;
+	threadCount = max((int)thread::hardware_concurrency(), 1);
+	lastRebuildTexels = 0;
+	lastBuildMilliseconds = 0.0;
+	horizonTexture = 0;
+	horizonSRV = 0;
+	horizonSampler = 0;
+	horizonBuffer = 0;
+	horizons.assign((size_t)size * size * DIRECTIONS, 0);
+	invalidateAll();
+	uploadAll = false;
+
+	// Two slices of four directions each, as bytes holding the sine of the horizon's elevation
+	if (size > 0)
+	{
+		D3D11_TEXTURE2D_DESC textureDesc;
+		ZeroMemory(&textureDesc, sizeof(textureDesc));
+		textureDesc.Width = size;
+		textureDesc.Height = size;
+		textureDesc.MipLevels = 1;
+		textureDesc.ArraySize = DIRECTIONS / 4;
+		textureDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+		textureDesc.SampleDesc.Count = 1;
+		textureDesc.Usage = D3D11_USAGE_DEFAULT;
+		textureDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+		device->CreateTexture2D(&textureDesc, NULL, &horizonTexture);
+		MemoryTracker::track(horizonTexture, MEMORY_TEXTURE, "Horizon map");
+
+		D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
+		ZeroMemory(&srvDesc, sizeof(srvDesc));
+		srvDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+		srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+		srvDesc.Texture2DArray.MipLevels = 1;
+		srvDesc.Texture2DArray.ArraySize = DIRECTIONS / 4;
+		device->CreateShaderResourceView(horizonTexture, &srvDesc, &horizonSRV);
+	}
+
+	// Bilinear and clamped, so the horizons blend between texels but never wrap around the edge of the terrain
+	horizonSampler = StateCache::get()->getSamplerState(StateCache::linearClamp());
+
+	D3D11_BUFFER_DESC bufferDesc;
+	bufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+	bufferDesc.ByteWidth = sizeof(HorizonBufferType);
+	bufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	bufferDesc.MiscFlags = 0;
+	bufferDesc.StructureByteStride = 0;
+	device->CreateBuffer(&bufferDesc, NULL, &horizonBuffer);
+	MemoryTracker::track(horizonBuffer, MEMORY_CONSTANTS, "Horizon map constants");
+}
+
+HorizonMap::~HorizonMap()
+{
+	// Release the horizon texture, its view, the sampler and the constant buffer
+	if (horizonSRV)
+	{
+		horizonSRV->Release();
+		horizonSRV = 0;
+	}
+	if (horizonTexture)
+	{
+		horizonTexture->Release();
+		horizonTexture = 0;
+	}
+	if (horizonSampler)
+	{
+		horizonSampler->Release();
+		horizonSampler = 0;
+	}
+	if (horizonBuffer)
+	{
+		horizonBuffer->Release();
+		horizonBuffer = 0;
+	}
+}
+
+void HorizonMap::invalidate(int x0, int y0, int x1, int y1)
+{
+	if (size <= 0)
+	{
+		return;
+	}
+
+	// Any texel within a ray's length of the change may have seen it on its horizon
+	int reach = (int)ceilf(maxDistance / (worldSize / size)) + 1;
+	int horizonX0 = max(x0 / downsample - reach, 0);
+	int horizonY0 = max(y0 / downsample - reach, 0);
+	int horizonX1 = min(x1 / downsample + reach, size - 1);
+	int horizonY1 = min(y1 / downsample + reach, size - 1);
+	if (horizonX0 > horizonX1 || horizonY0 > horizonY1)
+	{
+		return;
+	}
+
+	// Grows the waiting region to cover this one as well
+	if (dirtyX0 > dirtyX1)
+	{
+		dirtyX0 = horizonX0;
+		dirtyY0 = horizonY0;
+		dirtyX1 = horizonX1;
+		dirtyY1 = horizonY1;
+		return;
+	}
+	dirtyX0 = min(dirtyX0, horizonX0);
+	dirtyY0 = min(dirtyY0, horizonY0);
+	dirtyX1 = max(dirtyX1, horizonX1);
+	dirtyY1 = max(dirtyY1, horizonY1);
+}
+
+void HorizonMap::invalidateAll()
+{
+	dirtyX0 = 0;
+	dirtyY0 = 0;
+	dirtyX1 = size - 1;
+	dirtyY1 = size - 1;
+}
+
+bool HorizonMap::update(ID3D11DeviceContext* deviceContext)
+{
+	if (size <= 0)
+	{
+		return false;
+	}
+
+	// The CPU copy is still right when the texture was written over, so it only needs sending again
+	if (uploadAll)
+	{
+		upload(deviceContext, 0, 0, size - 1, size - 1);
+		uploadAll = false;
+	}
+	if (dirtyX0 > dirtyX1 || dirtyY0 > dirtyY1)
+	{
+		return false;
+	}
+	chrono::high_resolution_clock::time_point buildStart = chrono::high_resolution_clock::now();
+
+	// Splits the rows between the threads, each writing only its own rows
+	int rows = dirtyY1 - dirtyY0 + 1;
+	int workers = min(threadCount, rows);
+	vector<thread> threads;
+	for (int worker = 0; worker < workers; worker++)
+	{
+		int firstRow = dirtyY0 + rows * worker / workers;
+		int lastRow = dirtyY0 + rows * (worker + 1) / workers - 1;
+		threads.push_back(thread(&HorizonMap::buildRows, this, firstRow, lastRow, dirtyX0, dirtyX1));
+	}
+	for (thread& worker : threads)
+	{
+		worker.join();
+	}
+
+	// Uploads only the rebuilt region of each slice
+	upload(deviceContext, dirtyX0, dirtyY0, dirtyX1, dirtyY1);
+
+	lastRebuildTexels = rows * (dirtyX1 - dirtyX0 + 1);
+	lastBuildMilliseconds = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - buildStart).count();
+	dirtyX0 = 0;
+	dirtyX1 = -1;
+	return true;
+}
+
+void HorizonMap::upload(ID3D11DeviceContext* deviceContext, int x0, int y0, int x1, int y1)
+{
+	D3D11_BOX box;
+	box.left = x0;
+	box.top = y0;
+	box.front = 0;
+	box.right = x1 + 1;
+	box.bottom = y1 + 1;
+	box.back = 1;
+	for (int slice = 0; slice < DIRECTIONS / 4; slice++)
+	{
+		const uint8_t* source = &horizons[(((size_t)slice * size + y0) * size + x0) * 4];
+		deviceContext->UpdateSubresource(horizonTexture, D3D11CalcSubresource(0, slice, 1), &box, source, size * 4, 0);
+	}
+}
+
+float HorizonMap::sampleHeight(float worldX, float worldZ) const
+{
+	if (worldX < 0.0f || worldZ < 0.0f || worldX > worldSize || worldZ > worldSize)
+	{
+		return -1e6f;
+	}
+
+	// Texel centres sit half a texel in, as on the GPU
+	float x = worldX / worldSize * heights->getWidth() - 0.5f;
+	float y = worldZ / worldSize * heights->getHeight() - 0.5f;
+	int x0 = (int)floorf(x);
+	int y0 = (int)floorf(y);
+	float fx = x - x0;
+	float fy = y - y0;
+	float top = heights->getTexel(x0, y0) * (1.0f - fx) + heights->getTexel(x0 + 1, y0) * fx;
+	float bottom = heights->getTexel(x0, y0 + 1) * (1.0f - fx) + heights->getTexel(x0 + 1, y0 + 1) * fx;
+	return (top * (1.0f - fy) + bottom * fy) * heightScale;
+}
+
+void HorizonMap::buildRows(int y0, int y1, int x0, int x1)
+{
+	float texelWorld = worldSize / size;
+	float firstStep = worldSize / heights->getWidth();
+
+	for (int y = y0; y <= y1; y++)
+	{
+		float worldZ = (y + 0.5f) * texelWorld;
+		for (int x = x0; x <= x1; x += 4)
+		{
+			// Four neighbouring texels along the row are traced together, one in each lane
+			float worldX[4];
+			float base[4];
+			for (int lane = 0; lane < 4; lane++)
+			{
+				worldX[lane] = (min(x + lane, size - 1) + 0.5f) * texelWorld;
+				base[lane] = sampleHeight(worldX[lane], worldZ);
+			}
+			XMVECTOR baseHeights = XMVectorSet(base[0], base[1], base[2], base[3]);
+
+			XMVECTOR sines[DIRECTIONS];
+			for (int direction = 0; direction < DIRECTIONS; direction++)
+			{
+				float angle = XM_2PI * direction / DIRECTIONS;
+				float directionX = cosf(angle);
+				float directionZ = sinf(angle);
+
+				// Steps out along the ray, further apart the further out they are, keeping the steepest rise seen
+				XMVECTOR steepest = XMVectorZero();
+				for (float distance = firstStep; distance <= maxDistance; distance *= 1.2f)
+				{
+					float sampleZ = worldZ + directionZ * distance;
+					float offsetX = directionX * distance;
+					XMVECTOR sampled = XMVectorSet(sampleHeight(worldX[0] + offsetX, sampleZ), sampleHeight(worldX[1] + offsetX, sampleZ), sampleHeight(worldX[2] + offsetX, sampleZ), sampleHeight(worldX[3] + offsetX, sampleZ));
+					steepest = XMVectorMax(steepest, XMVectorScale(XMVectorSubtract(sampled, baseHeights), 1.0f / distance));
+				}
+
+				// Turns the slope into the sine of its elevation, which compares directly with the height of a normalized light direction
+				sines[direction] = XMVectorMultiply(steepest, XMVectorReciprocalSqrt(XMVectorAdd(XMVectorSplatOne(), XMVectorMultiply(steepest, steepest))));
+			}
+
+			// Stores every lane still inside the region
+			for (int lane = 0; lane < 4 && x + lane <= x1; lane++)
+			{
+				for (int direction = 0; direction < DIRECTIONS; direction++)
+				{
+					float sine = min(max(XMVectorGetByIndex(sines[direction], lane), 0.0f), 1.0f);
+					size_t texel = ((size_t)(direction / 4) * size + y) * size + x + lane;
+					horizons[texel * 4 + direction % 4] = (uint8_t)(sine * 255.0f + 0.5f);
+				}
+			}
+		}
+	}
+}
+
+void HorizonMap::setShaderParameters(ID3D11DeviceContext* deviceContext, bool enabled, float softness)
+{
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	deviceContext->Map(horizonBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+	HorizonBufferType* horizonPtr = (HorizonBufferType*)mappedResource.pData;
+	horizonPtr->enabled = enabled && horizonSRV ? 1.0f : 0.0f;
+	horizonPtr->softness = softness;
+	horizonPtr->worldSize = worldSize;
+	horizonPtr->padding = 0.0f;
+	deviceContext->Unmap(horizonBuffer, 0);
+	StateCache::get()->setConstantBuffers(deviceContext, STAGE_PS, BUFFER_SLOT, 1, &horizonBuffer);
+	StateCache::get()->setShaderResources(deviceContext, STAGE_PS, TEXTURE_SLOT, 1, &horizonSRV);
+	StateCache::get()->setSamplers(deviceContext, STAGE_PS, SAMPLER_SLOT, 1, &horizonSampler);
+}
@@ -0,0 +1,96 @@
+// Precomputed terrain self-shadowing. For every texel, and for each of DIRECTIONS directions around it, stores how high the terrain rises
+// towards that direction as the sine of the horizon's elevation. A light below the horizon in its own direction is blocked by the terrain,
+// so the terrain can shadow itself without ever being drawn into a shadow map. Built on the CPU, four texels at a time with DirectXMath's
+// SIMD vectors and split across every hardware thread, and rebuilt only around the parts of the heightmap that change
+#pragma once
+
+#include "DXF.h"
+#include "StateCache.h"
+#include "HeightField.h"
+#include <vector>
+#include <cstdint>
+
+using namespace std;
+using namespace DirectX;
+
+class HorizonMap
+{
+public:
+	// Directions are evenly spaced around the texel, starting along +X and turning towards +Z, four to each slice of the texture array
+	static const int DIRECTIONS = 8;
+
+	// Matches HorizonBuffer in the lit pixel shaders
+	struct HorizonBufferType
+	{
+		float enabled;
+		float softness;
+		float worldSize;
+		float padding;
+	};
+
+	// Registers the horizon map, its sampler and its constant buffer are bound to in the lit pixel shaders
+	static const int TEXTURE_SLOT = 5;
+	static const int SAMPLER_SLOT = 2;
+	static const int BUFFER_SLOT = 6;
+
+	// The heightmap covers worldSize units in X and Z with heights scaled by heightScale, and each horizon texel covers downsample
+	// heightmap texels. Everything is built on the first update
+	HorizonMap(ID3D11Device* device, const HeightField* heights, float worldSize, float heightScale, int downsample = 4);
+	~HorizonMap();
+
+	// Marks heightmap texels x0 to x1 and y0 to y1 as changed, so every horizon texel with a ray crossing them is rebuilt on the next update
+	void invalidate(int x0, int y0, int x1, int y1);
+	void invalidateAll();
+
+	// For when something else has written over the texture, such as a replayed command trace. The next update uploads the whole map
+	// again from the CPU copy, without rebuilding any of it
+	void invalidateGpuState() { uploadAll = true; }
+
+	// Rebuilds and uploads the changed region, if there is one. Returns whether anything was rebuilt
+	bool update(ID3D11DeviceContext* deviceContext);
+
+	// Binds the horizon map for the lit pixel shaders, which leave the terrain unshadowed by it when not enabled. Stays bound for the rest of the frame
+	void setShaderParameters(ID3D11DeviceContext* deviceContext, bool enabled, float softness);
+
+	ID3D11ShaderResourceView* getShaderResourceView() { return horizonSRV; }
+	int getSize() const { return size; }
+	int getThreadCount() const { return threadCount; }
+	int getLastRebuildTexels() const { return lastRebuildTexels; }
+	double getLastBuildMilliseconds() const { return lastBuildMilliseconds; }
+	unsigned long long getBytes() const { return (unsigned long long)size * size * DIRECTIONS; }
+
+	// Furthest the rays search for the horizon, in world units. Further occluders are ignored, and edits rebuild this far around them
+	float maxDistance = 40.0f;
+
+private:
+	// Builds the horizons of rows y0 to y1 between columns x0 and x1, four texels at a time
+	void buildRows(int y0, int y1, int x0, int x1);
+
+	// Bilinearly samples the heightmap in world units, returning far below the terrain outside it so nothing there can raise a horizon
+	float sampleHeight(float worldX, float worldZ) const;
+
+	// Uploads horizon texels x0 to x1 and y0 to y1 of both slices
+	void upload(ID3D11DeviceContext* deviceContext, int x0, int y0, int x1, int y1);
+
+	const HeightField* heights;
+	float worldSize;
+	float heightScale;
+	int downsample;
+	int size;
+	int threadCount;
+
+	// Sine of the horizon elevation in each direction, as bytes laid out as the two slices of the texture array
+	vector<uint8_t> horizons;
+
+	// Region of horizon texels waiting to be rebuilt, empty when x0 > x1
+	int dirtyX0, dirtyY0, dirtyX1, dirtyY1;
+	bool uploadAll;
+
+	int lastRebuildTexels;
+	double lastBuildMilliseconds;
+
+	ID3D11Texture2D* horizonTexture;
+	ID3D11ShaderResourceView* horizonSRV;
+	ID3D11SamplerState* horizonSampler;
+	ID3D11Buffer* horizonBuffer;
+};
@@ -0,0 +1,451 @@
+#include "TerrainEditor.h"
+#include "MemoryTracker.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+TerrainEditor::TerrainEditor(ID3D11Device* device, HeightField* lheights, float lworldSize, float lheightScale)
+{
+	heights = lheights;
+	worldSize = lworldSize;
+	heightScale = lheightScale;
+	width = heights->getWidth();
+	height = heights->getHeight();
+	tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+	tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+	dirtyTiles.assign((size_t)tilesX * tilesY, 0);
+	memset(&pending, 0, sizeof(pending));
+	memset(&stats, 0, sizeof(stats));
+	heightTexture = 0;
+	heightSRV = 0;
+	normalTexture = 0;
+	normalSRV = 0;
+	if (width == 0 || height == 0)
+	{
+		return;
+	}
+
+	// Each mip halves, rounding down, until it is 1 x 1, as the cooker's do
+	mipWidths.push_back(width);
+	mipHeights.push_back(height);
+	while (mipWidths.back() > 1 || mipHeights.back() > 1)
+	{
+		mipWidths.push_back(max(1, mipWidths.back() / 2));
+		mipHeights.push_back(max(1, mipHeights.back() / 2));
+	}
+	int mipCount = (int)mipWidths.size();
+	heightMips.resize(mipCount);
+	normalMips.resize(mipCount);
+	tileHeights.resize(TILE_SIZE * TILE_SIZE);
+	tileNormals.resize(TILE_SIZE * TILE_SIZE * 2);
+
+	// The whole top mip is only encoded here, for the textures' initial data, and dropped once they are created
+	vector<uint16_t> topHeights((size_t)width * height);
+	vector<uint8_t> topNormals((size_t)width * height * 2);
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			topHeights[(size_t)y * width + x] = encodeHeight(heights->getTexel(x, y));
+			encodeNormal(x, y, &topNormals[((size_t)y * width + x) * 2]);
+		}
+	}
+	for (int mip = 1; mip < mipCount; mip++)
+	{
+		heightMips[mip].resize((size_t)mipWidths[mip] * mipHeights[mip]);
+		normalMips[mip].resize((size_t)mipWidths[mip] * mipHeights[mip] * 2);
+		const uint16_t* parentHeights = mip == 1 ? topHeights.data() : heightMips[mip - 1].data();
+		const uint8_t* parentNormals = mip == 1 ? topNormals.data() : normalMips[mip - 1].data();
+		filterMip(mip, 0, 0, mipWidths[mip] - 1, mipHeights[mip] - 1, parentHeights, parentNormals, 0, 0, mipWidths[mip - 1]);
+	}
+
+	vector<D3D11_SUBRESOURCE_DATA> heightData(mipCount);
+	vector<D3D11_SUBRESOURCE_DATA> normalData(mipCount);
+	for (int mip = 0; mip < mipCount; mip++)
+	{
+		heightData[mip].pSysMem = mip == 0 ? topHeights.data() : heightMips[mip].data();
+		heightData[mip].SysMemPitch = mipWidths[mip] * sizeof(uint16_t);
+		heightData[mip].SysMemSlicePitch = 0;
+		normalData[mip].pSysMem = mip == 0 ? topNormals.data() : normalMips[mip].data();
+		normalData[mip].SysMemPitch = mipWidths[mip] * 2;
+		normalData[mip].SysMemSlicePitch = 0;
+	}
+
+	// Default usage, as only the dirty tiles' boxes are ever written again
+	D3D11_TEXTURE2D_DESC textureDesc;
+	ZeroMemory(&textureDesc, sizeof(textureDesc));
+	textureDesc.Width = width;
+	textureDesc.Height = height;
+	textureDesc.MipLevels = mipCount;
+	textureDesc.ArraySize = 1;
+	textureDesc.Format = DXGI_FORMAT_R16_UNORM;
+	textureDesc.SampleDesc.Count = 1;
+	textureDesc.Usage = D3D11_USAGE_DEFAULT;
+	textureDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	if (SUCCEEDED(device->CreateTexture2D(&textureDesc, heightData.data(), &heightTexture)))
+	{
+		MemoryTracker::track(heightTexture, MEMORY_TEXTURE, "Edited heightmap");
+		device->CreateShaderResourceView(heightTexture, NULL, &heightSRV);
+	}
+	textureDesc.Format = DXGI_FORMAT_R8G8_UNORM;
+	if (SUCCEEDED(device->CreateTexture2D(&textureDesc, normalData.data(), &normalTexture)))
+	{
+		MemoryTracker::track(normalTexture, MEMORY_TEXTURE, "Edited normal map");
+		device->CreateShaderResourceView(normalTexture, NULL, &normalSRV);
+	}
+}
+
+TerrainEditor::~TerrainEditor()
+{
+	// Release both textures and their views
+	if (heightSRV)
+	{
+		heightSRV->Release();
+		heightSRV = 0;
+	}
+	if (heightTexture)
+	{
+		heightTexture->Release();
+		heightTexture = 0;
+	}
+	if (normalSRV)
+	{
+		normalSRV->Release();
+		normalSRV = 0;
+	}
+	if (normalTexture)
+	{
+		normalTexture->Release();
+		normalTexture = 0;
+	}
+}
+
+bool TerrainEditor::applyBrush(TerrainBrush brush, float x, float z, float radius, float strength, TerrainEditRegion& region)
+{
+	if (!isValid() || radius <= 0.0f)
+	{
+		return false;
+	}
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+
+	// Texel i's centre is half a texel in from where it starts, as the sampler places it
+	float centreX = x / worldSize * width - 0.5f;
+	float centreY = z / worldSize * height - 0.5f;
+	float radiusX = radius / worldSize * width;
+	float radiusY = radius / worldSize * height;
+	int x0 = max((int)floorf(centreX - radiusX), 0);
+	int y0 = max((int)floorf(centreY - radiusY), 0);
+	int x1 = min((int)ceilf(centreX + radiusX), width - 1);
+	int y1 = min((int)ceilf(centreY + radiusY), height - 1);
+	if (x0 > x1 || y0 > y1)
+	{
+		return false;
+	}
+
+	// Smoothing averages the neighbours as they were before the brush, not as it leaves them
+	int sourcePitch = x1 - x0 + 3;
+	if (brush == TERRAIN_BRUSH_SMOOTH)
+	{
+		smoothSource.resize((size_t)sourcePitch * (y1 - y0 + 3));
+		for (int y = y0 - 1; y <= y1 + 1; y++)
+		{
+			for (int x = x0 - 1; x <= x1 + 1; x++)
+			{
+				smoothSource[(size_t)(y - y0 + 1) * sourcePitch + (x - x0 + 1)] = heights->getTexel(x, y);
+			}
+		}
+	}
+
+	float* data = heights->getData();
+	int changed = 0;
+	for (int y = y0; y <= y1; y++)
+	{
+		float dy = (y - centreY) / radiusY;
+		for (int x = x0; x <= x1; x++)
+		{
+			float dx = (x - centreX) / radiusX;
+			float distance = dx * dx + dy * dy;
+			if (distance >= 1.0f)
+			{
+				continue;
+			}
+
+			// Falls off smoothly to nothing at the edge of the brush
+			float weight = (1.0f - distance) * (1.0f - distance);
+			float& texel = data[(size_t)y * width + x];
+			float value = texel;
+			if (brush == TERRAIN_BRUSH_RAISE)
+			{
+				value += strength * weight;
+			}
+			else if (brush == TERRAIN_BRUSH_LOWER)
+			{
+				value -= strength * weight;
+			}
+			else
+			{
+				float sum = 0.0f;
+				for (int offsetY = 0; offsetY < 3; offsetY++)
+				{
+					const float* row = &smoothSource[(size_t)(y - y0 + offsetY) * sourcePitch + (x - x0)];
+					sum += row[0] + row[1] + row[2];
+				}
+				value += (sum / 9.0f - value) * min(strength * weight, 1.0f);
+			}
+			value = min(max(value, 0.0f), 1.0f);
+			if (value != texel)
+			{
+				texel = value;
+				changed++;
+			}
+		}
+	}
+
+	pending.brushMilliseconds += chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+	if (changed == 0)
+	{
+		return false;
+	}
+
+	// The normals a texel outside the brush read the texels it changed
+	markTiles(x0 - 1, y0 - 1, x1 + 1, y1 + 1);
+	region.x0 = x0;
+	region.y0 = y0;
+	region.x1 = x1;
+	region.y1 = y1;
+	pending.edits++;
+	pending.texelsChanged += changed;
+	stats.totalEdits++;
+	return true;
+}
+
+bool TerrainEditor::update(ID3D11DeviceContext* deviceContext)
+{
+	// The brushes applied since the last update are reported along with what this one uploads for them
+	unsigned long long totalEdits = stats.totalEdits;
+	stats = pending;
+	stats.totalEdits = totalEdits;
+	memset(&pending, 0, sizeof(pending));
+	if (dirtyList.empty())
+	{
+		return false;
+	}
+	stats.tilesUploaded = (int)dirtyList.size();
+
+	// Encodes each tile's top mip and the mip below it, which is filtered from the tile alone as tiles are an even size
+	for (int tile : dirtyList)
+	{
+		chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+		int tileX0 = (tile % tilesX) * TILE_SIZE;
+		int tileY0 = (tile / tilesX) * TILE_SIZE;
+		int tileX1 = min(tileX0 + TILE_SIZE, width) - 1;
+		int tileY1 = min(tileY0 + TILE_SIZE, height) - 1;
+		int pitch = tileX1 - tileX0 + 1;
+		for (int y = tileY0; y <= tileY1; y++)
+		{
+			for (int x = tileX0; x <= tileX1; x++)
+			{
+				int index = (y - tileY0) * pitch + (x - tileX0);
+				tileHeights[index] = encodeHeight(heights->getTexel(x, y));
+				encodeNormal(x, y, &tileNormals[index * 2]);
+			}
+		}
+		if (mipWidths.size() > 1)
+		{
+			filterMip(1, tileX0 / 2, tileY0 / 2, min(tileX1 / 2, mipWidths[1] - 1), min(tileY1 / 2, mipHeights[1] - 1), tileHeights.data(), tileNormals.data(), tileX0, tileY0, pitch);
+		}
+		stats.encodeMilliseconds += chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+
+		uploadRegion(deviceContext, 0, tileX0, tileY0, tileX1, tileY1, tileHeights.data(), tileNormals.data(), pitch);
+		if (mipWidths.size() > 1)
+		{
+			int mipX0 = tileX0 / 2;
+			int mipY0 = tileY0 / 2;
+			int mipPitch = mipWidths[1];
+			uploadRegion(deviceContext, 1, mipX0, mipY0, min(tileX1 / 2, mipWidths[1] - 1), min(tileY1 / 2, mipHeights[1] - 1), &heightMips[1][(size_t)mipY0 * mipPitch + mipX0], &normalMips[1][((size_t)mipY0 * mipPitch + mipX0) * 2], mipPitch);
+		}
+	}
+
+	// Every mip below is filtered from the stored mip above, once the whole of it is up to date. Once tiles shrink below a texel several
+	// share each one, so their regions are gathered and repeats dropped first
+	vector<TerrainEditRegion> regions;
+	for (int mip = 2; mip < (int)mipWidths.size(); mip++)
+	{
+		chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+		regions.clear();
+		for (int tile : dirtyList)
+		{
+			int tileX0 = (tile % tilesX) * TILE_SIZE;
+			int tileY0 = (tile / tilesX) * TILE_SIZE;
+			TerrainEditRegion region;
+			region.x0 = min(tileX0 >> mip, mipWidths[mip] - 1);
+			region.y0 = min(tileY0 >> mip, mipHeights[mip] - 1);
+			region.x1 = min((min(tileX0 + TILE_SIZE, width) - 1) >> mip, mipWidths[mip] - 1);
+			region.y1 = min((min(tileY0 + TILE_SIZE, height) - 1) >> mip, mipHeights[mip] - 1);
+			regions.push_back(region);
+		}
+		sort(regions.begin(), regions.end(), [](const TerrainEditRegion& a, const TerrainEditRegion& b) { return a.y0 != b.y0 ? a.y0 < b.y0 : a.x0 < b.x0; });
+		regions.erase(unique(regions.begin(), regions.end(), [](const TerrainEditRegion& a, const TerrainEditRegion& b) { return a.x0 == b.x0 && a.y0 == b.y0; }), regions.end());
+
+		int parentPitch = mipWidths[mip - 1];
+		for (const TerrainEditRegion& region : regions)
+		{
+			filterMip(mip, region.x0, region.y0, region.x1, region.y1, heightMips[mip - 1].data(), normalMips[mip - 1].data(), 0, 0, parentPitch);
+		}
+		stats.encodeMilliseconds += chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+
+		int mipPitch = mipWidths[mip];
+		for (const TerrainEditRegion& region : regions)
+		{
+			uploadRegion(deviceContext, mip, region.x0, region.y0, region.x1, region.y1, &heightMips[mip][(size_t)region.y0 * mipPitch + region.x0], &normalMips[mip][((size_t)region.y0 * mipPitch + region.x0) * 2], mipPitch);
+		}
+	}
+
+	for (int tile : dirtyList)
+	{
+		dirtyTiles[tile] = 0;
+	}
+	dirtyList.clear();
+	return true;
+}
+
+void TerrainEditor::invalidateGpuState()
+{
+	// Until the first edit the textures only ever held what they were created with
+	if (hasEdits())
+	{
+		markClippedTiles(0, 0, width - 1, height - 1);
+	}
+}
+
+unsigned long long TerrainEditor::getGpuBytes() const
+{
+	// Two bytes of height and two of normal for every texel of every mip
+	unsigned long long bytes = 0;
+	for (int mip = 0; mip < (int)mipWidths.size(); mip++)
+	{
+		bytes += (unsigned long long)mipWidths[mip] * mipHeights[mip] * 4;
+	}
+	return bytes;
+}
+
+unsigned long long TerrainEditor::getCpuBytes() const
+{
+	unsigned long long bytes = 0;
+	for (int mip = 1; mip < (int)mipWidths.size(); mip++)
+	{
+		bytes += heightMips[mip].size() * sizeof(uint16_t) + normalMips[mip].size();
+	}
+	return bytes;
+}
+
+void TerrainEditor::markTiles(int x0, int y0, int x1, int y1)
+{
+	// Whatever hangs over an edge is marked again shifted a whole heightmap across, which lands it on the far side
+	for (int shiftY = -height; shiftY <= height; shiftY += height)
+	{
+		for (int shiftX = -width; shiftX <= width; shiftX += width)
+		{
+			markClippedTiles(x0 + shiftX, y0 + shiftY, x1 + shiftX, y1 + shiftY);
+		}
+	}
+}
+
+void TerrainEditor::markClippedTiles(int x0, int y0, int x1, int y1)
+{
+	x0 = max(x0, 0);
+	y0 = max(y0, 0);
+	x1 = min(x1, width - 1);
+	y1 = min(y1, height - 1);
+	if (x0 > x1 || y0 > y1)
+	{
+		return;
+	}
+	for (int tileY = y0 / TILE_SIZE; tileY <= y1 / TILE_SIZE; tileY++)
+	{
+		for (int tileX = x0 / TILE_SIZE; tileX <= x1 / TILE_SIZE; tileX++)
+		{
+			int tile = tileY * tilesX + tileX;
+			if (!dirtyTiles[tile])
+			{
+				dirtyTiles[tile] = 1;
+				dirtyList.push_back(tile);
+			}
+		}
+	}
+}
+
+uint16_t TerrainEditor::encodeHeight(float value)
+{
+	return (uint16_t)(min(max(value, 0.0f), 1.0f) * 65535.0f + 0.5f);
+}
+
+void TerrainEditor::encodeNormal(int x, int y, uint8_t* normal) const
+{
+	// The same four tangents and crosses as the cooker, one texel apart
+	float spacing = worldSize / width;
+	XMVECTOR east = XMVectorSet(spacing, heights->getTexel(x + 1, y) * heightScale, 0.0f, 0.0f);
+	XMVECTOR west = XMVectorSet(-spacing, heights->getTexel(x - 1, y) * heightScale, 0.0f, 0.0f);
+	XMVECTOR north = XMVectorSet(0.0f, heights->getTexel(x, y + 1) * heightScale, spacing, 0.0f);
+	XMVECTOR south = XMVectorSet(0.0f, heights->getTexel(x, y - 1) * heightScale, -spacing, 0.0f);
+	XMVECTOR sum = XMVectorAdd(XMVectorAdd(XMVector3Cross(north, east), XMVector3Cross(east, south)), XMVectorAdd(XMVector3Cross(south, west), XMVector3Cross(west, north)));
+	XMFLOAT3 unit;
+	XMStoreFloat3(&unit, XMVector3Normalize(sum));
+	normal[0] = (uint8_t)((unit.x * 0.5f + 0.5f) * 255.0f + 0.5f);
+	normal[1] = (uint8_t)((unit.z * 0.5f + 0.5f) * 255.0f + 0.5f);
+}
+
+void TerrainEditor::filterMip(int mip, int x0, int y0, int x1, int y1, const uint16_t* parentHeights, const uint8_t* parentNormals, int parentX, int parentY, int parentPitch)
+{
+	int parentWidth = mipWidths[mip - 1];
+	int parentHeight = mipHeights[mip - 1];
+	int mipWidth = mipWidths[mip];
+	uint16_t* mipHeightData = heightMips[mip].data();
+	uint8_t* mipNormalData = normalMips[mip].data();
+	for (int y = y0; y <= y1; y++)
+	{
+		for (int x = x0; x <= x1; x++)
+		{
+			int sourceX0 = min(x * 2, parentWidth - 1) - parentX;
+			int sourceX1 = min(x * 2 + 1, parentWidth - 1) - parentX;
+			int sourceY0 = min(y * 2, parentHeight - 1) - parentY;
+			int sourceY1 = min(y * 2 + 1, parentHeight - 1) - parentY;
+			int corners[4] = { sourceY0 * parentPitch + sourceX0, sourceY0 * parentPitch + sourceX1, sourceY1 * parentPitch + sourceX0, sourceY1 * parentPitch + sourceX1 };
+
+			unsigned int heightSum = 0;
+			XMVECTOR normalSum = XMVectorZero();
+			for (int corner = 0; corner < 4; corner++)
+			{
+				heightSum += parentHeights[corners[corner]];
+				float normalX = parentNormals[corners[corner] * 2] / 255.0f * 2.0f - 1.0f;
+				float normalZ = parentNormals[corners[corner] * 2 + 1] / 255.0f * 2.0f - 1.0f;
+				normalSum = XMVectorAdd(normalSum, XMVectorSet(normalX, sqrtf(max(1.0f - normalX * normalX - normalZ * normalZ, 0.0f)), normalZ, 0.0f));
+			}
+			XMFLOAT3 unit;
+			XMStoreFloat3(&unit, XMVector3Normalize(normalSum));
+
+			size_t index = (size_t)y * mipWidth + x;
+			mipHeightData[index] = (uint16_t)((heightSum + 2) / 4);
+			mipNormalData[index * 2] = (uint8_t)((unit.x * 0.5f + 0.5f) * 255.0f + 0.5f);
+			mipNormalData[index * 2 + 1] = (uint8_t)((unit.z * 0.5f + 0.5f) * 255.0f + 0.5f);
+		}
+	}
+}
+
+void TerrainEditor::uploadRegion(ID3D11DeviceContext* deviceContext, int mip, int x0, int y0, int x1, int y1, const uint16_t* regionHeights, const uint8_t* regionNormals, int pitch)
+{
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+	D3D11_BOX box;
+	box.left = x0;
+	box.right = x1 + 1;
+	box.top = y0;
+	box.bottom = y1 + 1;
+	box.front = 0;
+	box.back = 1;
+	UINT subresource = D3D11CalcSubresource(mip, 0, (UINT)mipWidths.size());
+	deviceContext->UpdateSubresource(heightTexture, subresource, &box, regionHeights, pitch * sizeof(uint16_t), 0);
+	deviceContext->UpdateSubresource(normalTexture, subresource, &box, regionNormals, pitch * 2, 0);
+	stats.bytesUploaded += (unsigned long long)(x1 - x0 + 1) * (y1 - y0 + 1) * 4;
+	stats.uploadMilliseconds += chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+}
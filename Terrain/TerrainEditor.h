@@ -0,0 +1,129 @@
+// Edits the heightmap at runtime with raise, lower and smooth brushes. The heightmap is split into square tiles and a brush only marks the
+// tiles it changed, so the next update re-encodes and uploads just those, into every mip of an R16 height texture and an R8G8 normal texture
+// laid out as the baked normal map is. Mips below the top are kept on the CPU as uploaded, so a tile's mips are filtered from the mip above
+// it without going back over the whole heightmap. Each brush hands back the texels it changed, for the quadtree, horizon map and patch
+// bounds to refit the same region
+#pragma once
+
+#include "DXF.h"
+#include "HeightField.h"
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+using namespace DirectX;
+
+enum TerrainBrush
+{
+	TERRAIN_BRUSH_RAISE,
+	TERRAIN_BRUSH_LOWER,
+	TERRAIN_BRUSH_SMOOTH,
+	TERRAIN_BRUSHES
+};
+
+// Heightmap texels x0 to x1 and y0 to y1 a brush changed, inclusive
+struct TerrainEditRegion
+{
+	int x0;
+	int y0;
+	int x1;
+	int y1;
+};
+
+struct TerrainEditStats
+{
+	// Brushes applied since the previous update and the texels they changed, and the tiles and bytes of every mip the update uploaded
+	int edits;
+	int texelsChanged;
+	int tilesUploaded;
+	unsigned long long bytesUploaded;
+
+	// CPU time applying those brushes, encoding and filtering the dirty tiles' heights, normals and mips, and in UpdateSubresource
+	double brushMilliseconds;
+	double encodeMilliseconds;
+	double uploadMilliseconds;
+
+	unsigned long long totalEdits;
+};
+
+class TerrainEditor
+{
+public:
+	// Width and height in texels of the tiles edits are tracked and uploaded in
+	static const int TILE_SIZE = 64;
+
+	// Edits the heights in place, which cover worldSize units in X and Z scaled by heightScale. Builds both textures' mip chains from them
+	TerrainEditor(ID3D11Device* device, HeightField* heights, float worldSize, float heightScale);
+	~TerrainEditor();
+
+	bool isValid() const { return heightTexture != 0 && normalTexture != 0; }
+
+	// Applies a brush centred on world (x, z), falling off smoothly to nothing radius units away. Raising and lowering move the centre by
+	// strength in the heightmap's 0 to 1 range, smoothing moves it strength of the way towards the average of it and its eight neighbours.
+	// Returns whether any texel changed, and if so which
+	bool applyBrush(TerrainBrush brush, float x, float z, float radius, float strength, TerrainEditRegion& region);
+
+	// Re-encodes and uploads every mip of the tiles edited since the last update. Returns whether anything was uploaded
+	bool update(ID3D11DeviceContext* deviceContext);
+
+	// For when something else has written over the textures, such as a replayed command trace. Once anything has been edited every tile
+	// is marked, so the next update uploads the whole of both textures again
+	void invalidateGpuState();
+
+	ID3D11ShaderResourceView* getHeightSRV() { return heightSRV; }
+	ID3D11ShaderResourceView* getNormalSRV() { return normalSRV; }
+	bool hasEdits() const { return stats.totalEdits > 0; }
+	int getDirtyTileCount() const { return (int)dirtyList.size(); }
+	int getTileCount() const { return tilesX * tilesY; }
+	int getMipCount() const { return (int)mipWidths.size(); }
+	const TerrainEditStats& getStats() const { return stats; }
+	unsigned long long getGpuBytes() const;
+	unsigned long long getCpuBytes() const;
+
+private:
+	// Marks every tile holding texels x0 to x1 and y0 to y1. Texels past the edge wrap, as the normals there read the far side
+	void markTiles(int x0, int y0, int x1, int y1);
+	void markClippedTiles(int x0, int y0, int x1, int y1);
+
+	static uint16_t encodeHeight(float value);
+
+	// Writes the normal CalculatePixelNormal works out at texel (x, y), X and Z as unorm bytes as the cooker bakes them
+	void encodeNormal(int x, int y, uint8_t* normal) const;
+
+	// Box filters mip texels x0 to x1 and y0 to y1 from the mip above, whose texels start at parent texel (parentX, parentY) with rows
+	// parentPitch texels apart. Matches the cooker's filter, normals being summed as vectors and renormalized
+	void filterMip(int mip, int x0, int y0, int x1, int y1, const uint16_t* parentHeights, const uint8_t* parentNormals, int parentX, int parentY, int parentPitch);
+
+	// Uploads mip texels x0 to x1 and y0 to y1 of both textures from rows pitch texels apart
+	void uploadRegion(ID3D11DeviceContext* deviceContext, int mip, int x0, int y0, int x1, int y1, const uint16_t* regionHeights, const uint8_t* regionNormals, int pitch);
+
+	HeightField* heights;
+	float worldSize;
+	float heightScale;
+	int width;
+	int height;
+
+	int tilesX;
+	int tilesY;
+	vector<char> dirtyTiles;
+	vector<int> dirtyList;
+
+	// Every mip below the top, as uploaded. The top is only ever encoded a tile at a time, into the scratch buffers
+	vector<int> mipWidths;
+	vector<int> mipHeights;
+	vector<vector<uint16_t>> heightMips;
+	vector<vector<uint8_t>> normalMips;
+	vector<uint16_t> tileHeights;
+	vector<uint8_t> tileNormals;
+
+	// Heights under a smoothing brush and a texel around it, as they were before it
+	vector<float> smoothSource;
+
+	TerrainEditStats pending;
+	TerrainEditStats stats;
+
+	ID3D11Texture2D* heightTexture;
+	ID3D11ShaderResourceView* heightSRV;
+	ID3D11Texture2D* normalTexture;
+	ID3D11ShaderResourceView* normalSRV;
+};
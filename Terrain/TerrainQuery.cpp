@@ -0,0 +1,408 @@
+#include "TerrainQuery.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+// Clips the distances [t0, t1] to where the ray is between lower and upper along one axis. Returns false once nothing is left
+static bool clipSlab(float origin, float direction, float lower, float upper, float& t0, float& t1)
+{
+	if (fabsf(direction) < 1e-12f)
+	{
+		return origin >= lower && origin <= upper;
+	}
+	float inverse = 1.0f / direction;
+	float nearT = (lower - origin) * inverse;
+	float farT = (upper - origin) * inverse;
+	if (nearT > farT)
+	{
+		swap(nearT, farT);
+	}
+	t0 = max(t0, nearT);
+	t1 = min(t1, farT);
+	return t0 <= t1;
+}
+
+TerrainQuery::TerrainQuery(const HeightField* lheights, float lworldSize, float lheightScale)
+{
+	heights = lheights;
+	worldSize = lworldSize;
+	heightScale = lheightScale;
+	width = 0;
+	height = 0;
+	leafSize = 0;
+	lastNodesVisited = 0;
+	lastLeavesTested = 0;
+	rebuild();
+}
+
+void TerrainQuery::rebuild()
+{
+	width = heights ? heights->getWidth() : 0;
+	height = heights ? heights->getHeight() : 0;
+	minHeights.clear();
+	maxHeights.clear();
+	if (width <= 0 || height <= 0)
+	{
+		return;
+	}
+
+	// One level per halving, down to a single root node
+	leafSize = 1;
+	while (leafSize < max(width, height))
+	{
+		leafSize *= 2;
+	}
+	for (int size = leafSize; size >= 1; size /= 2)
+	{
+		minHeights.push_back(vector<float>((size_t)size * size, FLT_MAX));
+		maxHeights.push_back(vector<float>((size_t)size * size, -FLT_MAX));
+	}
+	invalidate(0, 0, width - 1, height - 1);
+}
+
+void TerrainQuery::invalidate(int x0, int y0, int x1, int y1)
+{
+	if (minHeights.empty())
+	{
+		return;
+	}
+
+	// A texel is part of the surface over its neighbours' leaves too, so they are refitted as well.
+	// Neighbours wrap like the sampler, so whatever hangs over an edge is refitted again shifted a whole heightmap across
+	for (int shiftY = -height; shiftY <= height; shiftY += height)
+	{
+		for (int shiftX = -width; shiftX <= width; shiftX += width)
+		{
+			refitClipped(x0 - 1 + shiftX, y0 - 1 + shiftY, x1 + 1 + shiftX, y1 + 1 + shiftY);
+		}
+	}
+}
+
+void TerrainQuery::refitClipped(int x0, int y0, int x1, int y1)
+{
+	x0 = max(x0, 0);
+	y0 = max(y0, 0);
+	x1 = min(x1, width - 1);
+	y1 = min(y1, height - 1);
+	if (x0 > x1 || y0 > y1)
+	{
+		return;
+	}
+	for (int y = y0; y <= y1; y++)
+	{
+		for (int x = x0; x <= x1; x++)
+		{
+			fitLeaf(x, y);
+		}
+	}
+
+	// Each node above holds the range of its four children
+	for (int level = 1; level < (int)minHeights.size(); level++)
+	{
+		x0 /= 2;
+		y0 /= 2;
+		x1 /= 2;
+		y1 /= 2;
+		int size = leafSize >> level;
+		const vector<float>& childMin = minHeights[level - 1];
+		const vector<float>& childMax = maxHeights[level - 1];
+		for (int y = y0; y <= y1; y++)
+		{
+			for (int x = x0; x <= x1; x++)
+			{
+				size_t child = (size_t)(y * 2) * (size * 2) + x * 2;
+				size_t below = child + size * 2;
+				minHeights[level][(size_t)y * size + x] = min(min(childMin[child], childMin[child + 1]), min(childMin[below], childMin[below + 1]));
+				maxHeights[level][(size_t)y * size + x] = max(max(childMax[child], childMax[child + 1]), max(childMax[below], childMax[below + 1]));
+			}
+		}
+	}
+}
+
+void TerrainQuery::fitLeaf(int x, int y)
+{
+	// The leaf spans half a texel either side of the texel's centre, where it blends towards each neighbour
+	float lowest = FLT_MAX;
+	float highest = -FLT_MAX;
+	for (int j = -1; j <= 1; j++)
+	{
+		for (int i = -1; i <= 1; i++)
+		{
+			float value = getTexel(x + i, y + j);
+			lowest = min(lowest, value);
+			highest = max(highest, value);
+		}
+	}
+	minHeights[0][(size_t)y * leafSize + x] = lowest;
+	maxHeights[0][(size_t)y * leafSize + x] = highest;
+}
+
+float TerrainQuery::getTexel(int x, int y) const
+{
+	return heights->getTexel(x, y);
+}
+
+float TerrainQuery::getHeight(float x, float z) const
+{
+	if (width <= 0 || height <= 0)
+	{
+		return 0.0f;
+	}
+
+	// Texel centres sit at half texel offsets, so the sample position is shifted back by half a texel before splitting into texel and fraction
+	float sampleX = x / worldSize * width - 0.5f;
+	float sampleY = z / worldSize * height - 0.5f;
+	float floorX = floorf(sampleX);
+	float floorY = floorf(sampleY);
+	float fractionX = sampleX - floorX;
+	float fractionY = sampleY - floorY;
+	int texelX = (int)floorX;
+	int texelY = (int)floorY;
+
+	float top = getTexel(texelX, texelY) + (getTexel(texelX + 1, texelY) - getTexel(texelX, texelY)) * fractionX;
+	float bottom = getTexel(texelX, texelY + 1) + (getTexel(texelX + 1, texelY + 1) - getTexel(texelX, texelY + 1)) * fractionX;
+	return (top + (bottom - top) * fractionY) * heightScale;
+}
+
+void TerrainQuery::getHeights(const float* x, const float* z, float* results, int count) const
+{
+	if (width <= 0 || height <= 0)
+	{
+		fill(results, results + count, 0.0f);
+		return;
+	}
+
+	const float* data = heights->getData();
+	XMVECTOR scaleX = XMVectorReplicate(width / worldSize);
+	XMVECTOR scaleY = XMVectorReplicate(height / worldSize);
+	XMVECTOR half = XMVectorReplicate(0.5f);
+	XMVECTOR scale = XMVectorReplicate(heightScale);
+
+	int i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		// Splits four sample positions into texels and fractions at once
+		XMVECTOR sampleX = XMVectorSubtract(XMVectorMultiply(XMLoadFloat4((const XMFLOAT4*)&x[i]), scaleX), half);
+		XMVECTOR sampleY = XMVectorSubtract(XMVectorMultiply(XMLoadFloat4((const XMFLOAT4*)&z[i]), scaleY), half);
+		XMVECTOR floorX = XMVectorFloor(sampleX);
+		XMVECTOR floorY = XMVectorFloor(sampleY);
+		XMFLOAT4 texelX, texelY;
+		XMStoreFloat4(&texelX, floorX);
+		XMStoreFloat4(&texelY, floorY);
+
+		// Gathers each lane's four texels, wrapping as the sampler does. SSE has no gather, so this part is scalar
+		const float* lanesX = &texelX.x;
+		const float* lanesY = &texelY.x;
+		XMFLOAT4 corners[4];
+		float* cornerLanes[4] = { &corners[0].x, &corners[1].x, &corners[2].x, &corners[3].x };
+		for (int lane = 0; lane < 4; lane++)
+		{
+			int x0 = (int)lanesX[lane] % width;
+			int y0 = (int)lanesY[lane] % height;
+			x0 += x0 < 0 ? width : 0;
+			y0 += y0 < 0 ? height : 0;
+			int x1 = x0 + 1 == width ? 0 : x0 + 1;
+			int y1 = y0 + 1 == height ? 0 : y0 + 1;
+			cornerLanes[0][lane] = data[(size_t)y0 * width + x0];
+			cornerLanes[1][lane] = data[(size_t)y0 * width + x1];
+			cornerLanes[2][lane] = data[(size_t)y1 * width + x0];
+			cornerLanes[3][lane] = data[(size_t)y1 * width + x1];
+		}
+
+		XMVECTOR fractionX = XMVectorSubtract(sampleX, floorX);
+		XMVECTOR fractionY = XMVectorSubtract(sampleY, floorY);
+		XMVECTOR top = XMVectorLerpV(XMLoadFloat4(&corners[0]), XMLoadFloat4(&corners[1]), fractionX);
+		XMVECTOR bottom = XMVectorLerpV(XMLoadFloat4(&corners[2]), XMLoadFloat4(&corners[3]), fractionX);
+		XMStoreFloat4((XMFLOAT4*)&results[i], XMVectorMultiply(XMVectorLerpV(top, bottom, fractionY), scale));
+	}
+	for (; i < count; i++)
+	{
+		results[i] = getHeight(x[i], z[i]);
+	}
+}
+
+unsigned long long TerrainQuery::getBytes() const
+{
+	unsigned long long bytes = 0;
+	for (size_t level = 0; level < minHeights.size(); level++)
+	{
+		bytes += (minHeights[level].size() + maxHeights[level].size()) * sizeof(float);
+	}
+	return bytes;
+}
+
+bool TerrainQuery::raycast(const XMFLOAT3& origin, const XMFLOAT3& direction, float maxDistance, TerrainHit& hit) const
+{
+	lastNodesVisited = 0;
+	lastLeavesTested = 0;
+	if (minHeights.empty())
+	{
+		return false;
+	}
+
+	// Children are visited nearest first: the one on the ray's starting side of both splits, then the two beside it, then the far one.
+	// The ray can only cross one of the two beside it, so their order doesn't matter, and the first leaf hit is the nearest
+	int firstX = direction.x < 0.0f ? 1 : 0;
+	int firstY = direction.z < 0.0f ? 1 : 0;
+	float cellWidth = worldSize / width;
+	float cellHeight = worldSize / height;
+
+	struct Node
+	{
+		int level;
+		int x;
+		int y;
+	};
+	Node stack[64 * 3 + 1];
+	int top = 0;
+	stack[top++] = { (int)minHeights.size() - 1, 0, 0 };
+	while (top > 0)
+	{
+		Node node = stack[--top];
+		lastNodesVisited++;
+		float lowest = minHeights[node.level][(size_t)node.y * (leafSize >> node.level) + node.x];
+		float highest = maxHeights[node.level][(size_t)node.y * (leafSize >> node.level) + node.x];
+		if (lowest > highest)
+		{
+			continue;
+		}
+
+		// Skips the node unless the ray passes through the box of its footprint and height range
+		int span = 1 << node.level;
+		float t0 = 0.0f;
+		float t1 = maxDistance;
+		if (!clipSlab(origin.x, direction.x, node.x * span * cellWidth, min((node.x + 1) * span, width) * cellWidth, t0, t1) ||
+			!clipSlab(origin.z, direction.z, node.y * span * cellHeight, min((node.y + 1) * span, height) * cellHeight, t0, t1) ||
+			!clipSlab(origin.y, direction.y, lowest * heightScale, highest * heightScale, t0, t1))
+		{
+			continue;
+		}
+
+		if (node.level == 0)
+		{
+			lastLeavesTested++;
+			float t;
+			if (intersectLeaf(node.x, node.y, origin, direction, t0, t1, t))
+			{
+				hit.distance = t;
+				hit.position = XMFLOAT3(origin.x + direction.x * t, origin.y + direction.y * t, origin.z + direction.z * t);
+				return true;
+			}
+			continue;
+		}
+
+		// Pushed far to near, so the nearest child is popped first
+		const int order[4][2] = { { 1 - firstX, 1 - firstY }, { 1 - firstX, firstY }, { firstX, 1 - firstY }, { firstX, firstY } };
+		for (int child = 0; child < 4; child++)
+		{
+			stack[top++] = { node.level - 1, node.x * 2 + order[child][0], node.y * 2 + order[child][1] };
+		}
+	}
+	return false;
+}
+
+bool TerrainQuery::intersectSegment(const XMFLOAT3& start, const XMFLOAT3& end, TerrainHit& hit) const
+{
+	XMFLOAT3 direction(end.x - start.x, end.y - start.y, end.z - start.z);
+	return raycast(start, direction, 1.0f, hit);
+}
+
+bool TerrainQuery::intersectLeaf(int x, int y, const XMFLOAT3& origin, const XMFLOAT3& direction, float t0, float t1, float& t) const
+{
+	float cellWidth = worldSize / width;
+	float cellHeight = worldSize / height;
+
+	// The texel's centre lines split the leaf into four bilinear patches, each between a different four texels
+	float splits[4] = { t0, t1, t1, t1 };
+	int splitCount = 1;
+	float centreX = (x + 0.5f) * cellWidth;
+	float centreY = (y + 0.5f) * cellHeight;
+	if (fabsf(direction.x) > 1e-12f)
+	{
+		float crossing = (centreX - origin.x) / direction.x;
+		if (crossing > t0 && crossing < t1)
+		{
+			splits[splitCount++] = crossing;
+		}
+	}
+	if (fabsf(direction.z) > 1e-12f)
+	{
+		float crossing = (centreY - origin.z) / direction.z;
+		if (crossing > t0 && crossing < t1)
+		{
+			splits[splitCount++] = crossing;
+		}
+	}
+	sort(splits, splits + splitCount);
+	splits[splitCount] = t1;
+
+	for (int piece = 0; piece < splitCount; piece++)
+	{
+		float start = splits[piece];
+		float end = splits[piece + 1];
+		float middle = (start + end) * 0.5f;
+
+		// Finds the patch from the middle of the piece. The fractions across it are written as linear in the distance s from the start of the
+		// piece rather than from the ray's origin, which would leave the quadratic's terms far larger than their sum and lose it to rounding
+		float startX = origin.x + direction.x * start;
+		float startY = origin.y + direction.y * start;
+		float startZ = origin.z + direction.z * start;
+		int texelX = (int)floorf((origin.x + direction.x * middle) / cellWidth - 0.5f);
+		int texelY = (int)floorf((origin.z + direction.z * middle) / cellHeight - 0.5f);
+		float ax = startX / cellWidth - 0.5f - texelX;
+		float bx = direction.x / cellWidth;
+		float az = startZ / cellHeight - 0.5f - texelY;
+		float bz = direction.z / cellHeight;
+
+		// h = h00 + e fx + f fz + g fx fz, so the height above the ray is a quadratic in s
+		float h00 = getTexel(texelX, texelY);
+		float e = getTexel(texelX + 1, texelY) - h00;
+		float f = getTexel(texelX, texelY + 1) - h00;
+		float g = getTexel(texelX + 1, texelY + 1) - h00 - e - f;
+		float a = heightScale * g * bx * bz;
+		float b = heightScale * (e * bx + f * bz + g * (ax * bz + az * bx)) - direction.y;
+		float c = heightScale * (h00 + e * ax + f * az + g * ax * az) - startY;
+
+		// Roots of a s^2 + b s + c, using the form that doesn't lose precision when a is small
+		float roots[2];
+		int rootCount = 0;
+		if (fabsf(a) < 1e-9f)
+		{
+			if (fabsf(b) > 1e-12f)
+			{
+				roots[rootCount++] = -c / b;
+			}
+		}
+		else
+		{
+			float discriminant = b * b - 4.0f * a * c;
+			if (discriminant >= 0.0f)
+			{
+				float q = -0.5f * (b + copysignf(sqrtf(discriminant), b));
+				roots[rootCount++] = q / a;
+				if (q != 0.0f)
+				{
+					roots[rootCount++] = c / q;
+				}
+			}
+		}
+
+		// The nearest root inside the piece, allowing for rounding at its ends
+		float length = end - start;
+		float tolerance = length * 1e-4f + 1e-6f;
+		float nearest = FLT_MAX;
+		for (int root = 0; root < rootCount; root++)
+		{
+			if (roots[root] >= -tolerance && roots[root] <= length + tolerance)
+			{
+				nearest = min(nearest, roots[root]);
+			}
+		}
+		if (nearest != FLT_MAX)
+		{
+			t = start + min(max(nearest, 0.0f), length);
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,85 @@
+// Answers height and ray queries against the terrain on the CPU, for camera collision, placing objects and picking. Heights are sampled from
+// the height field exactly as the domain shader samples the heightmap: bilinearly between texel centres, wrapping at the edges, scaled by the
+// height scale, over a plane worldSize units across starting at the origin. The tessellated mesh is flat between its vertices, so the surface
+// here is what the terrain converges on as the tessellation rises, and matches it exactly at every vertex.
+// Rays walk a min-max quadtree over the heightmap's texels, front to back, only testing the bilinear surface in leaves the ray's height range
+// overlaps, so a ray costs about the depth of the tree rather than the number of texels it crosses
+#pragma once
+
+#include "HeightField.h"
+#include <DirectXMath.h>
+#include <vector>
+
+using namespace std;
+using namespace DirectX;
+
+struct TerrainHit
+{
+	// Distance along the ray, in units of its direction's length, and where it meets the surface
+	float distance;
+	XMFLOAT3 position;
+};
+
+class TerrainQuery
+{
+public:
+	// The height field covers worldSize units in X and Z with heights scaled by heightScale, as in the tessellation domain shader
+	TerrainQuery(const HeightField* heights, float worldSize, float heightScale);
+
+	// Builds the quadtree over the whole height field, after it has been loaded or resized
+	void rebuild();
+
+	// Refits the quadtree over heightmap texels x0 to x1 and y0 to y1 after they change, and every node above them
+	void invalidate(int x0, int y0, int x1, int y1);
+
+	// Height of the surface at world (x, z)
+	float getHeight(float x, float z) const;
+
+	// Heights at count points, four at a time with DirectXMath's SIMD vectors
+	void getHeights(const float* x, const float* z, float* results, int count) const;
+
+	// Finds where a ray first meets the surface within maxDistance of its origin. Only the part of the ray over the terrain is tested
+	bool raycast(const XMFLOAT3& origin, const XMFLOAT3& direction, float maxDistance, TerrainHit& hit) const;
+
+	// Finds where the segment from start to end first meets the surface, with the hit's distance as a fraction of the segment
+	bool intersectSegment(const XMFLOAT3& start, const XMFLOAT3& end, TerrainHit& hit) const;
+
+	float getWorldSize() const { return worldSize; }
+	float getHeightScale() const { return heightScale; }
+	int getLevelCount() const { return (int)minHeights.size(); }
+
+	// Bytes of the quadtree's height ranges
+	unsigned long long getBytes() const;
+
+	// Quadtree nodes and leaves the last raycast tested, to show how far it had to descend
+	int getLastNodesVisited() const { return lastNodesVisited; }
+	int getLastLeavesTested() const { return lastLeavesTested; }
+
+private:
+	// Height field texel with the coordinates wrapped, as the sampler addresses them
+	float getTexel(int x, int y) const;
+
+	// Fits one leaf, which covers a texel's footprint and so the bilinear surface between it and its eight neighbours
+	void fitLeaf(int x, int y);
+
+	// Refits the leaves of texels x0 to x1 and y0 to y1 that lie inside the height field, and every node above them
+	void refitClipped(int x0, int y0, int x1, int y1);
+
+	// Tests the ray against the bilinear surface over one leaf between distances t0 and t1, returning the nearest hit
+	bool intersectLeaf(int x, int y, const XMFLOAT3& origin, const XMFLOAT3& direction, float t0, float t1, float& t) const;
+
+	const HeightField* heights;
+	float worldSize;
+	float heightScale;
+	int width;
+	int height;
+
+	// Minimum and maximum texel height under every node, level 0 being the leaves, each level a square power of two across.
+	// Leaves past the edge of a height field that isn't square or a power of two hold an empty range, so rays skip them
+	vector<vector<float>> minHeights;
+	vector<vector<float>> maxHeights;
+	int leafSize;
+
+	mutable int lastNodesVisited;
+	mutable int lastLeavesTested;
+};
@@ -0,0 +1,557 @@
+#include "VirtualTexture.h"
+#include "MemoryTracker.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+VirtualTexture::VirtualTexture(ID3D11Device* device, const wchar_t* lfilename, int lcacheSize, int screenWidth, int screenHeight, int lfeedbackScale)
+{
+	filename = lfilename;
+	// The page table stores each slot's x and y in 8 bits, and the cache needs at least one page to stream into
+	cacheSize = max(min(lcacheSize, 255), 1);
+	feedbackScale = max(lfeedbackScale, 1);
+	frameIndex = 0;
+	pageTableDirty = true;
+	stopLoader = false;
+	memset(&stats, 0, sizeof(stats));
+
+	physicalTexture = 0;
+	physicalSRV = 0;
+	pageTableTexture = 0;
+	pageTableSRV = 0;
+	feedbackTexture = 0;
+	feedbackRTV = 0;
+	feedbackDepth = 0;
+	feedbackDSV = 0;
+	feedbackIndex = 0;
+	for (int i = 0; i < FEEDBACK_LATENCY; i++)
+	{
+		feedbackStaging[i] = 0;
+		feedbackWritten[i] = false;
+	}
+
+	if (!file.open(lfilename))
+	{
+		return;
+	}
+	paddedPageSize = file.getPaddedPageSize();
+
+	createResources(device, screenWidth / feedbackScale, screenHeight / feedbackScale);
+
+	// Every slot starts out free
+	slots.resize(cacheSize * cacheSize);
+	for (size_t i = 0; i < slots.size(); i++)
+	{
+		slots[i].key = 0;
+		slots[i].occupied = false;
+		slots[i].pinned = false;
+		slots[i].lastUsedFrame = 0;
+		lru.push_back((int)i);
+		slots[i].lruPosition = prev(lru.end());
+	}
+
+	// The coarsest mip is always resident, so every page table entry has something to fall back to
+	int maxMip = file.getHeader().mipCount - 1;
+	for (int y = 0; y < file.getPagesY(maxMip); y++)
+	{
+		for (int x = 0; x < file.getPagesX(maxMip); x++)
+		{
+			LoadedPage page;
+			page.key = makeKey(maxMip, x, y);
+			if (file.readPage(maxMip, x, y, page.data))
+			{
+				int slot = allocateSlot();
+				if (slot < 0)
+				{
+					break;
+				}
+				slots[slot].key = page.key;
+				slots[slot].occupied = true;
+				slots[slot].pinned = true;
+				residentPages[page.key] = slot;
+				pendingPages.insert(page.key);
+				loadedPages.push_back(page);
+			}
+		}
+	}
+
+	loader = thread(&VirtualTexture::streamingThread, this);
+}
+
+VirtualTexture::~VirtualTexture()
+{
+	// Stop the streaming thread before releasing anything it could be using
+	if (loader.joinable())
+	{
+		{
+			lock_guard<mutex> lock(loaderMutex);
+			stopLoader = true;
+		}
+		loaderCondition.notify_all();
+		loader.join();
+	}
+
+	// Release the page cache, page table and feedback resources
+	if (physicalSRV)
+	{
+		physicalSRV->Release();
+		physicalSRV = 0;
+	}
+	if (physicalTexture)
+	{
+		physicalTexture->Release();
+		physicalTexture = 0;
+	}
+	if (pageTableSRV)
+	{
+		pageTableSRV->Release();
+		pageTableSRV = 0;
+	}
+	if (pageTableTexture)
+	{
+		pageTableTexture->Release();
+		pageTableTexture = 0;
+	}
+	if (feedbackRTV)
+	{
+		feedbackRTV->Release();
+		feedbackRTV = 0;
+	}
+	if (feedbackTexture)
+	{
+		feedbackTexture->Release();
+		feedbackTexture = 0;
+	}
+	if (feedbackDSV)
+	{
+		feedbackDSV->Release();
+		feedbackDSV = 0;
+	}
+	if (feedbackDepth)
+	{
+		feedbackDepth->Release();
+		feedbackDepth = 0;
+	}
+	for (int i = 0; i < FEEDBACK_LATENCY; i++)
+	{
+		if (feedbackStaging[i])
+		{
+			feedbackStaging[i]->Release();
+			feedbackStaging[i] = 0;
+		}
+	}
+}
+
+void VirtualTexture::createResources(ID3D11Device* device, int feedbackWidth, int feedbackHeight)
+{
+	const VirtualTextureHeader& header = file.getHeader();
+
+	// Physical page cache, a fixed size 16-bit texture holding cacheSize x cacheSize pages
+	D3D11_TEXTURE2D_DESC physicalDesc;
+	ZeroMemory(&physicalDesc, sizeof(physicalDesc));
+	physicalDesc.Width = cacheSize * paddedPageSize;
+	physicalDesc.Height = cacheSize * paddedPageSize;
+	physicalDesc.MipLevels = 1;
+	physicalDesc.ArraySize = 1;
+	physicalDesc.Format = DXGI_FORMAT_R16_UNORM;
+	physicalDesc.SampleDesc.Count = 1;
+	physicalDesc.Usage = D3D11_USAGE_DEFAULT;
+	physicalDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	device->CreateTexture2D(&physicalDesc, NULL, &physicalTexture);
+	MemoryTracker::track(physicalTexture, MEMORY_STREAMING, "Virtual texture pages");
+	device->CreateShaderResourceView(physicalTexture, NULL, &physicalSRV);
+
+	// Page table, one texel per page and one mip per virtual texture mip. Each texel stores the slot and the mip actually resident
+	D3D11_TEXTURE2D_DESC pageTableDesc;
+	ZeroMemory(&pageTableDesc, sizeof(pageTableDesc));
+	pageTableDesc.Width = header.pagesX;
+	pageTableDesc.Height = header.pagesY;
+	pageTableDesc.MipLevels = header.mipCount;
+	pageTableDesc.ArraySize = 1;
+	pageTableDesc.Format = DXGI_FORMAT_R8G8B8A8_UINT;
+	pageTableDesc.SampleDesc.Count = 1;
+	pageTableDesc.Usage = D3D11_USAGE_DEFAULT;
+	pageTableDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	device->CreateTexture2D(&pageTableDesc, NULL, &pageTableTexture);
+	MemoryTracker::track(pageTableTexture, MEMORY_STREAMING, "Virtual texture page table");
+	device->CreateShaderResourceView(pageTableTexture, NULL, &pageTableSRV);
+
+	pageTable.resize(header.mipCount);
+	for (uint32_t mip = 0; mip < header.mipCount; mip++)
+	{
+		pageTable[mip].assign(file.getPagesX(mip) * file.getPagesY(mip), 0);
+	}
+
+	// Feedback target, each texel stores the requested page's key plus one so that a cleared texel means no request
+	D3D11_TEXTURE2D_DESC feedbackDesc;
+	ZeroMemory(&feedbackDesc, sizeof(feedbackDesc));
+	feedbackDesc.Width = max(1, feedbackWidth);
+	feedbackDesc.Height = max(1, feedbackHeight);
+	feedbackDesc.MipLevels = 1;
+	feedbackDesc.ArraySize = 1;
+	feedbackDesc.Format = DXGI_FORMAT_R32_UINT;
+	feedbackDesc.SampleDesc.Count = 1;
+	feedbackDesc.Usage = D3D11_USAGE_DEFAULT;
+	feedbackDesc.BindFlags = D3D11_BIND_RENDER_TARGET;
+	device->CreateTexture2D(&feedbackDesc, NULL, &feedbackTexture);
+	MemoryTracker::track(feedbackTexture, MEMORY_RENDER_TARGET, "Virtual texture feedback");
+	device->CreateRenderTargetView(feedbackTexture, NULL, &feedbackRTV);
+
+	D3D11_TEXTURE2D_DESC stagingDesc = feedbackDesc;
+	stagingDesc.Usage = D3D11_USAGE_STAGING;
+	stagingDesc.BindFlags = 0;
+	stagingDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	for (int i = 0; i < FEEDBACK_LATENCY; i++)
+	{
+		device->CreateTexture2D(&stagingDesc, NULL, &feedbackStaging[i]);
+		MemoryTracker::track(feedbackStaging[i], MEMORY_STAGING, "Virtual texture feedback readback");
+	}
+
+	// Depth buffer for the feedback pass, so hidden terrain does not request pages
+	D3D11_TEXTURE2D_DESC depthDesc = feedbackDesc;
+	depthDesc.Format = DXGI_FORMAT_D32_FLOAT;
+	depthDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL;
+	device->CreateTexture2D(&depthDesc, NULL, &feedbackDepth);
+	MemoryTracker::track(feedbackDepth, MEMORY_DEPTH, "Virtual texture feedback depth");
+	device->CreateDepthStencilView(feedbackDepth, NULL, &feedbackDSV);
+
+	feedbackViewport.TopLeftX = 0.0f;
+	feedbackViewport.TopLeftY = 0.0f;
+	feedbackViewport.Width = (float)feedbackDesc.Width;
+	feedbackViewport.Height = (float)feedbackDesc.Height;
+	feedbackViewport.MinDepth = 0.0f;
+	feedbackViewport.MaxDepth = 1.0f;
+}
+
+void VirtualTexture::beginFeedback(ID3D11DeviceContext* deviceContext)
+{
+	float clearColour[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	deviceContext->OMSetRenderTargets(1, &feedbackRTV, feedbackDSV);
+	deviceContext->ClearRenderTargetView(feedbackRTV, clearColour);
+	deviceContext->ClearDepthStencilView(feedbackDSV, D3D11_CLEAR_DEPTH, 1.0f, 0);
+	deviceContext->RSSetViewports(1, &feedbackViewport);
+}
+
+void VirtualTexture::endFeedback(ID3D11DeviceContext* deviceContext)
+{
+	deviceContext->CopyResource(feedbackStaging[feedbackIndex], feedbackTexture);
+	feedbackWritten[feedbackIndex] = true;
+	feedbackIndex = (feedbackIndex + 1) % FEEDBACK_LATENCY;
+}
+
+void VirtualTexture::update(ID3D11DeviceContext* deviceContext)
+{
+	if (!isValid())
+	{
+		return;
+	}
+
+	frameIndex++;
+	stats.pageHits = 0;
+	stats.pageMisses = 0;
+	stats.pagesUploaded = 0;
+	stats.pagesDropped = 0;
+	stats.uploadBytes = 0;
+
+	readFeedback(deviceContext);
+	uploadPages(deviceContext);
+
+	if (pageTableDirty)
+	{
+		rebuildPageTable(deviceContext);
+	}
+
+	stats.residentPages = (int)residentPages.size();
+	stats.pendingPages = (int)pendingPages.size();
+}
+
+void VirtualTexture::invalidateGpuState()
+{
+	// Pinned pages never leave their slots, so anything written there was the same page again
+	for (CacheSlot& slot : slots)
+	{
+		if (slot.occupied && !slot.pinned)
+		{
+			residentPages.erase(slot.key);
+			slot.occupied = false;
+		}
+	}
+	pageTableDirty = true;
+
+	for (int i = 0; i < FEEDBACK_LATENCY; i++)
+	{
+		feedbackWritten[i] = false;
+	}
+}
+
+void VirtualTexture::readFeedback(ID3D11DeviceContext* deviceContext)
+{
+	// The oldest copy in the ring is the one about to be overwritten, and has had the most time to finish on the GPU
+	ID3D11Texture2D* staging = feedbackStaging[feedbackIndex];
+	if (!feedbackWritten[feedbackIndex])
+	{
+		return;
+	}
+
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	if (deviceContext->Map(staging, 0, D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &mappedResource) != S_OK)
+	{
+		return;
+	}
+
+	// Gather the unique pages that were visible, along with every coarser page above them so that fallbacks stay resident too
+	unordered_set<PageKey> visible;
+	int maxMip = file.getHeader().mipCount - 1;
+	for (UINT y = 0; y < (UINT)feedbackViewport.Height; y++)
+	{
+		const unsigned int* row = (const unsigned int*)((const unsigned char*)mappedResource.pData + y * mappedResource.RowPitch);
+		unsigned int previous = 0;
+		for (UINT x = 0; x < (UINT)feedbackViewport.Width; x++)
+		{
+			// Neighbouring texels usually request the same page, so skip straight over repeats
+			if (row[x] == 0 || row[x] == previous)
+			{
+				continue;
+			}
+			previous = row[x];
+
+			// A request coarser than the file's coarsest mip is moved down to it, doubling the page coordinates once per mip it moves so
+			// they stay over the same part of the texture, and keeping them inside that mip's pages
+			PageKey key = row[x] - 1;
+			int mip = min(keyMip(key), maxMip);
+			int shift = keyMip(key) - mip;
+			int pageX = min(keyX(key) << shift, file.getPagesX(mip) - 1);
+			int pageY = min(keyY(key) << shift, file.getPagesY(mip) - 1);
+			for (; mip <= maxMip; mip++)
+			{
+				if (!visible.insert(makeKey(mip, pageX, pageY)).second)
+				{
+					break;
+				}
+				pageX /= 2;
+				pageY /= 2;
+			}
+		}
+	}
+	deviceContext->Unmap(staging, 0);
+	feedbackWritten[feedbackIndex] = false;
+
+	// Drop requests that were never started, the new feedback supersedes them
+	{
+		lock_guard<mutex> lock(loaderMutex);
+		for (PageKey key : loadQueue)
+		{
+			pendingPages.erase(key);
+		}
+		loadQueue.clear();
+	}
+
+	// Request coarse pages first, so that a usable fallback streams in before the detail
+	vector<PageKey> requests(visible.begin(), visible.end());
+	sort(requests.begin(), requests.end(), [](PageKey a, PageKey b) { return keyMip(a) > keyMip(b); });
+	for (PageKey key : requests)
+	{
+		requestPage(key);
+	}
+	loaderCondition.notify_one();
+}
+
+void VirtualTexture::requestPage(PageKey key)
+{
+	auto resident = residentPages.find(key);
+	if (resident != residentPages.end())
+	{
+		stats.pageHits++;
+		touchSlot(resident->second);
+		return;
+	}
+
+	stats.pageMisses++;
+	if (pendingPages.insert(key).second)
+	{
+		lock_guard<mutex> lock(loaderMutex);
+		loadQueue.push_back(key);
+	}
+}
+
+void VirtualTexture::uploadPages(ID3D11DeviceContext* deviceContext)
+{
+	int uploads = 0;
+	while (true)
+	{
+		LoadedPage page;
+		{
+			lock_guard<mutex> lock(loaderMutex);
+			if (loadedPages.empty())
+			{
+				break;
+			}
+
+			// Pinned pages were placed in the cache when the texture was opened and are always uploaded, everything else is budgeted
+			bool pinned = residentPages.count(loadedPages.front().key) > 0;
+			if (!pinned && uploads >= maxUploadsPerFrame)
+			{
+				break;
+			}
+			page = move(loadedPages.front());
+			loadedPages.pop_front();
+		}
+		pendingPages.erase(page.key);
+
+		int slot;
+		auto resident = residentPages.find(page.key);
+		if (resident != residentPages.end())
+		{
+			slot = resident->second;
+		}
+		else
+		{
+			slot = allocateSlot();
+			if (slot < 0)
+			{
+				// Every slot is in use this frame, so the cache is too small for the view
+				stats.pagesDropped++;
+				continue;
+			}
+			slots[slot].key = page.key;
+			slots[slot].occupied = true;
+			residentPages[page.key] = slot;
+			uploads++;
+		}
+		touchSlot(slot);
+
+		// Copy the page into its slot of the physical cache
+		D3D11_BOX box;
+		box.left = (slot % cacheSize) * paddedPageSize;
+		box.top = (slot / cacheSize) * paddedPageSize;
+		box.front = 0;
+		box.right = box.left + paddedPageSize;
+		box.bottom = box.top + paddedPageSize;
+		box.back = 1;
+		deviceContext->UpdateSubresource(physicalTexture, 0, &box, page.data.data(), paddedPageSize * sizeof(uint16_t), 0);
+
+		stats.pagesUploaded++;
+		stats.uploadBytes += file.getPageBytes();
+		stats.totalUploadBytes += file.getPageBytes();
+		pageTableDirty = true;
+	}
+}
+
+int VirtualTexture::allocateSlot()
+{
+	// Walk from the least recently used end, skipping pinned slots and pages needed this frame
+	for (auto it = lru.rbegin(); it != lru.rend(); ++it)
+	{
+		CacheSlot& slot = slots[*it];
+		if (!slot.occupied)
+		{
+			return *it;
+		}
+		if (!slot.pinned && slot.lastUsedFrame < frameIndex)
+		{
+			residentPages.erase(slot.key);
+			slot.occupied = false;
+			pageTableDirty = true;
+			return *it;
+		}
+	}
+	return -1;
+}
+
+void VirtualTexture::touchSlot(int slot)
+{
+	slots[slot].lastUsedFrame = frameIndex;
+	lru.splice(lru.begin(), lru, slots[slot].lruPosition);
+}
+
+void VirtualTexture::rebuildPageTable(ID3D11DeviceContext* deviceContext)
+{
+	// Working down from the coarsest mip, each entry points at its own page if resident, otherwise at its parent's entry
+	int mipCount = file.getHeader().mipCount;
+	for (int mip = mipCount - 1; mip >= 0; mip--)
+	{
+		int pagesX = file.getPagesX(mip);
+		int pagesY = file.getPagesY(mip);
+		for (int y = 0; y < pagesY; y++)
+		{
+			for (int x = 0; x < pagesX; x++)
+			{
+				unsigned int entry = 0;
+				auto resident = residentPages.find(makeKey(mip, x, y));
+				if (resident != residentPages.end())
+				{
+					unsigned int slotX = resident->second % cacheSize;
+					unsigned int slotY = resident->second / cacheSize;
+					entry = slotX | (slotY << 8) | ((unsigned int)mip << 16) | (1u << 24);
+				}
+				else if (mip < mipCount - 1)
+				{
+					int parentPagesX = file.getPagesX(mip + 1);
+					int parentX = min(x / 2, parentPagesX - 1);
+					int parentY = min(y / 2, file.getPagesY(mip + 1) - 1);
+					entry = pageTable[mip + 1][parentY * parentPagesX + parentX];
+				}
+				pageTable[mip][y * pagesX + x] = entry;
+			}
+		}
+		deviceContext->UpdateSubresource(pageTableTexture, mip, NULL, pageTable[mip].data(), pagesX * sizeof(unsigned int), 0);
+	}
+	pageTableDirty = false;
+}
+
+void VirtualTexture::streamingThread()
+{
+	// Reads requested pages from disk in the order they were queued, handing them back to the main thread to upload
+	VirtualTextureFile reader;
+	reader.open(filename.c_str());
+
+	while (true)
+	{
+		PageKey key;
+		{
+			unique_lock<mutex> lock(loaderMutex);
+			loaderCondition.wait(lock, [this] { return stopLoader || !loadQueue.empty(); });
+			if (stopLoader)
+			{
+				return;
+			}
+			key = loadQueue.front();
+			loadQueue.pop_front();
+		}
+
+		LoadedPage page;
+		page.key = key;
+		bool loaded = reader.readPage(keyMip(key), keyX(key), keyY(key), page.data);
+
+		lock_guard<mutex> lock(loaderMutex);
+		if (loaded)
+		{
+			loadedPages.push_back(move(page));
+		}
+	}
+}
+
+void VirtualTexture::getShaderParameters(VirtualTextureBufferType& parameters, int tessFactor, bool enabled) const
+{
+	const VirtualTextureHeader& header = file.getHeader();
+	parameters.pagesMip0 = XMFLOAT2((float)header.pagesX, (float)header.pagesY);
+	parameters.pageSize = (float)header.pageSize;
+	parameters.border = (float)header.border;
+	parameters.physicalSize = XMFLOAT2((float)(cacheSize * paddedPageSize), (float)(cacheSize * paddedPageSize));
+	parameters.maxMip = (float)(header.mipCount - 1);
+	parameters.virtualSize = (float)header.width;
+
+	// The domain shader places a vertex every 1 / (100 * tessFactor) of the texture, so finer mips would only alias
+	float texelsPerVertex = (float)header.width / (100.0f * max(tessFactor, 1));
+	parameters.domainMip = max(0.0f, log2f(texelsPerVertex));
+
+	// The feedback target is smaller than the screen, so its derivatives are larger by the same ratio
+	parameters.feedbackBias = -log2f((float)feedbackScale);
+	parameters.enabled = (enabled && isValid()) ? 1.0f : 0.0f;
+	parameters.padding = 0.0f;
+}
+
+unsigned long long VirtualTexture::getPhysicalBytes() const
+{
+	return (unsigned long long)cacheSize * paddedPageSize * cacheSize * paddedPageSize * sizeof(uint16_t);
+}
@@ -0,0 +1,155 @@
+// Sparse virtual texture for the heightmap. Only the pages the camera can see are kept in a fixed-size physical page cache on the GPU,
+// with a page table texture redirecting virtual coordinates into that cache. A low resolution feedback pass records which pages and mips
+// are visible, and missing pages are streamed in from a tiled file on a background thread in least recently used order
+#pragma once
+
+#include "DXF.h"
+#include "VirtualTextureFile.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace std;
+using namespace DirectX;
+
+// Page cache counters, reset every frame apart from the totals
+struct VirtualTextureStats
+{
+	int pageHits;
+	int pageMisses;
+	int pagesUploaded;
+	int pagesDropped;
+	int residentPages;
+	int pendingPages;
+	unsigned long long uploadBytes;
+	unsigned long long totalUploadBytes;
+};
+
+class VirtualTexture
+{
+public:
+	// Values sent to the shaders so that they can translate virtual texture coordinates into the physical page cache
+	struct VirtualTextureBufferType
+	{
+		XMFLOAT2 pagesMip0;
+		float pageSize;
+		float border;
+		XMFLOAT2 physicalSize;
+		float maxMip;
+		float virtualSize;
+		float domainMip;
+		float feedbackBias;
+		float enabled;
+		float padding;
+	};
+
+	// Opens a tiled texture and creates a physical cache of cacheSize x cacheSize pages, as well as a feedback target feedbackScale times smaller than the screen
+	VirtualTexture(ID3D11Device* device, const wchar_t* filename, int cacheSize, int screenWidth, int screenHeight, int feedbackScale = 8);
+	~VirtualTexture();
+
+	bool isValid() const { return physicalTexture != 0; }
+
+	// Binds the feedback target, which the VirtualTextureFeedbackShader writes visible page requests to
+	void beginFeedback(ID3D11DeviceContext* deviceContext);
+
+	// Copies the feedback target into the staging ring so it can be read back without stalling a few frames later
+	void endFeedback(ID3D11DeviceContext* deviceContext);
+
+	// Processes the oldest available feedback, queues missing pages and uploads the pages the streaming thread has finished loading
+	void update(ID3D11DeviceContext* deviceContext);
+
+	// For when something else has written over the page cache and page table, such as a replayed command trace. Every page that isn't
+	// pinned is evicted to be streamed in again, the page table is rebuilt and feedback still waiting to be read back is dropped
+	void invalidateGpuState();
+
+	// Fills the shader constants, domainMip being the mip the domain shader should sample at for the current tessellation factor
+	void getShaderParameters(VirtualTextureBufferType& parameters, int tessFactor, bool enabled) const;
+
+	ID3D11ShaderResourceView* getPageTableSRV() { return pageTableSRV; }
+	ID3D11ShaderResourceView* getPhysicalSRV() { return physicalSRV; }
+	const VirtualTextureStats& getStats() const { return stats; }
+	int getCacheSize() const { return cacheSize; }
+	unsigned long long getPhysicalBytes() const;
+
+	// Limits how many pages are copied to the GPU each frame, to keep the upload cost bounded
+	int maxUploadsPerFrame = 16;
+
+private:
+	// Identifies a page of the virtual texture, packed as mip (4 bits), y (14 bits) and x (14 bits) to match the feedback shader
+	typedef unsigned int PageKey;
+	static PageKey makeKey(int mip, int x, int y) { return ((PageKey)mip << 28) | ((PageKey)y << 14) | (PageKey)x; }
+	static int keyMip(PageKey key) { return (int)(key >> 28); }
+	static int keyY(PageKey key) { return (int)((key >> 14) & 0x3FFF); }
+	static int keyX(PageKey key) { return (int)(key & 0x3FFF); }
+
+	// A slot in the physical page cache
+	struct CacheSlot
+	{
+		PageKey key;
+		bool occupied;
+		bool pinned;
+		unsigned long long lastUsedFrame;
+		list<int>::iterator lruPosition;
+	};
+
+	// A page the streaming thread has finished reading from disk
+	struct LoadedPage
+	{
+		PageKey key;
+		vector<uint16_t> data;
+	};
+
+	void createResources(ID3D11Device* device, int feedbackWidth, int feedbackHeight);
+	void readFeedback(ID3D11DeviceContext* deviceContext);
+	void requestPage(PageKey key);
+	void uploadPages(ID3D11DeviceContext* deviceContext);
+	int allocateSlot();
+	void touchSlot(int slot);
+	void rebuildPageTable(ID3D11DeviceContext* deviceContext);
+	void streamingThread();
+
+	VirtualTextureFile file;
+	wstring filename;
+	int cacheSize;
+	int feedbackScale;
+	int paddedPageSize;
+	unsigned long long frameIndex;
+	VirtualTextureStats stats;
+
+	// Physical page cache, and the page table with one mip per virtual texture mip
+	ID3D11Texture2D* physicalTexture;
+	ID3D11ShaderResourceView* physicalSRV;
+	ID3D11Texture2D* pageTableTexture;
+	ID3D11ShaderResourceView* pageTableSRV;
+	vector<vector<unsigned int>> pageTable;
+	bool pageTableDirty;
+
+	// Low resolution feedback target, and a ring of staging copies so that reading it back never waits on the GPU
+	static const int FEEDBACK_LATENCY = 3;
+	ID3D11Texture2D* feedbackTexture;
+	ID3D11RenderTargetView* feedbackRTV;
+	ID3D11Texture2D* feedbackDepth;
+	ID3D11DepthStencilView* feedbackDSV;
+	ID3D11Texture2D* feedbackStaging[FEEDBACK_LATENCY];
+	bool feedbackWritten[FEEDBACK_LATENCY];
+	int feedbackIndex;
+	D3D11_VIEWPORT feedbackViewport;
+
+	// Cache bookkeeping, the front of the LRU list being the most recently used slot
+	vector<CacheSlot> slots;
+	list<int> lru;
+	unordered_map<PageKey, int> residentPages;
+	unordered_set<PageKey> pendingPages;
+
+	// Streaming thread and the queues shared with it
+	thread loader;
+	mutex loaderMutex;
+	condition_variable loaderCondition;
+	deque<PageKey> loadQueue;
+	deque<LoadedPage> loadedPages;
+	bool stopLoader;
+};
@@ -0,0 +1,205 @@
+#include "VirtualTextureFile.h"
+#include "HeightField.h"
+#include <algorithm>
+#include <cstring>
+
+static const uint32_t VIRTUAL_TEXTURE_VERSION = 1;
+
+VirtualTextureFile::VirtualTextureFile()
+{
+	memset(&header, 0, sizeof(header));
+}
+
+VirtualTextureFile::~VirtualTextureFile()
+{
+	close();
+}
+
+bool VirtualTextureFile::build(const HeightField& source, const wchar_t* filename, int pageSize, int border)
+{
+	int width = source.getWidth();
+	int height = source.getHeight();
+
+	// Pages must tile every mip exactly, so only power of two textures at least one page in size are supported
+	if (width < pageSize || height < pageSize || (width & (width - 1)) != 0 || (height & (height - 1)) != 0 || (pageSize & (pageSize - 1)) != 0)
+	{
+		return false;
+	}
+
+	VirtualTextureHeader fileHeader;
+	memcpy(fileHeader.magic, "VTEX", 4);
+	fileHeader.version = VIRTUAL_TEXTURE_VERSION;
+	fileHeader.width = width;
+	fileHeader.height = height;
+	fileHeader.pageSize = pageSize;
+	fileHeader.border = border;
+	fileHeader.pagesX = width / pageSize;
+	fileHeader.pagesY = height / pageSize;
+	fileHeader.bytesPerTexel = sizeof(uint16_t);
+
+	// Mips continue until a single page covers the whole texture along the longest side
+	fileHeader.mipCount = 1;
+	while ((fileHeader.pagesX >> (fileHeader.mipCount - 1)) > 1 || (fileHeader.pagesY >> (fileHeader.mipCount - 1)) > 1)
+	{
+		fileHeader.mipCount++;
+	}
+
+	// Build the mip chain with a 2x2 box filter
+	vector<vector<float>> mips(fileHeader.mipCount);
+	mips[0].assign(source.getData(), source.getData() + (size_t)width * height);
+	for (uint32_t mip = 1; mip < fileHeader.mipCount; mip++)
+	{
+		int parentWidth = max(1, width >> (mip - 1));
+		int parentHeight = max(1, height >> (mip - 1));
+		int mipWidth = max(1, width >> mip);
+		int mipHeight = max(1, height >> mip);
+		mips[mip].resize((size_t)mipWidth * mipHeight);
+		for (int y = 0; y < mipHeight; y++)
+		{
+			for (int x = 0; x < mipWidth; x++)
+			{
+				int x0 = min(x * 2, parentWidth - 1);
+				int x1 = min(x * 2 + 1, parentWidth - 1);
+				int y0 = min(y * 2, parentHeight - 1);
+				int y1 = min(y * 2 + 1, parentHeight - 1);
+				const vector<float>& parent = mips[mip - 1];
+				mips[mip][y * mipWidth + x] = (parent[y0 * parentWidth + x0] + parent[y0 * parentWidth + x1] + parent[y1 * parentWidth + x0] + parent[y1 * parentWidth + x1]) * 0.25f;
+			}
+		}
+	}
+
+	// Count the pages and lay out the offset table
+	uint64_t totalPages = 0;
+	for (uint32_t mip = 0; mip < fileHeader.mipCount; mip++)
+	{
+		totalPages += (uint64_t)max(1u, fileHeader.pagesX >> mip) * max(1u, fileHeader.pagesY >> mip);
+	}
+
+	ofstream output(filename, ios::binary | ios::trunc);
+	if (!output.is_open())
+	{
+		return false;
+	}
+
+	int paddedSize = pageSize + border * 2;
+	uint64_t pageBytes = (uint64_t)paddedSize * paddedSize * sizeof(uint16_t);
+	uint64_t dataStart = sizeof(VirtualTextureHeader) + totalPages * sizeof(uint64_t);
+
+	output.write((const char*)&fileHeader, sizeof(fileHeader));
+	for (uint64_t page = 0; page < totalPages; page++)
+	{
+		uint64_t offset = dataStart + page * pageBytes;
+		output.write((const char*)&offset, sizeof(offset));
+	}
+
+	// Write every page, including a border copied from the neighbouring pages (wrapping, to match the heightmap sampler)
+	vector<uint16_t> pageData((size_t)paddedSize * paddedSize);
+	for (uint32_t mip = 0; mip < fileHeader.mipCount; mip++)
+	{
+		int mipWidth = max(1, width >> mip);
+		int mipHeight = max(1, height >> mip);
+		int pagesX = max(1u, fileHeader.pagesX >> mip);
+		int pagesY = max(1u, fileHeader.pagesY >> mip);
+		const vector<float>& texels = mips[mip];
+
+		for (int pageY = 0; pageY < pagesY; pageY++)
+		{
+			for (int pageX = 0; pageX < pagesX; pageX++)
+			{
+				for (int y = 0; y < paddedSize; y++)
+				{
+					int sourceY = ((pageY * pageSize + y - border) % mipHeight + mipHeight) % mipHeight;
+					for (int x = 0; x < paddedSize; x++)
+					{
+						int sourceX = ((pageX * pageSize + x - border) % mipWidth + mipWidth) % mipWidth;
+						float value = min(max(texels[sourceY * mipWidth + sourceX], 0.0f), 1.0f);
+						pageData[y * paddedSize + x] = (uint16_t)(value * 65535.0f + 0.5f);
+					}
+				}
+				output.write((const char*)pageData.data(), pageBytes);
+			}
+		}
+	}
+
+	return output.good();
+}
+
+bool VirtualTextureFile::open(const wchar_t* filename)
+{
+	close();
+
+	file.open(filename, ios::binary);
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	// Validate the header before trusting any of the sizes in it
+	file.read((char*)&header, sizeof(header));
+	if (!file.good() || memcmp(header.magic, "VTEX", 4) != 0 || header.version != VIRTUAL_TEXTURE_VERSION || header.mipCount == 0 || header.mipCount > 16)
+	{
+		close();
+		return false;
+	}
+
+	// Read the page offset table, and note where each mip starts within it
+	int totalPages = 0;
+	mipFirstPage.resize(header.mipCount);
+	for (uint32_t mip = 0; mip < header.mipCount; mip++)
+	{
+		mipFirstPage[mip] = totalPages;
+		totalPages += getPagesX(mip) * getPagesY(mip);
+	}
+	pageOffsets.resize(totalPages);
+	file.read((char*)pageOffsets.data(), totalPages * sizeof(uint64_t));
+	if (!file.good())
+	{
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+void VirtualTextureFile::close()
+{
+	if (file.is_open())
+	{
+		file.close();
+	}
+	pageOffsets.clear();
+	mipFirstPage.clear();
+}
+
+bool VirtualTextureFile::readPage(int mip, int pageX, int pageY, vector<uint16_t>& data)
+{
+	int index = getPageIndex(mip, pageX, pageY);
+	if (index < 0)
+	{
+		return false;
+	}
+
+	data.resize(getPageBytes() / sizeof(uint16_t));
+	file.seekg(pageOffsets[index]);
+	file.read((char*)data.data(), getPageBytes());
+	return file.good();
+}
+
+int VirtualTextureFile::getPagesX(int mip) const
+{
+	return max(1u, header.pagesX >> mip);
+}
+
+int VirtualTextureFile::getPagesY(int mip) const
+{
+	return max(1u, header.pagesY >> mip);
+}
+
+int VirtualTextureFile::getPageIndex(int mip, int pageX, int pageY) const
+{
+	if (!file.is_open() || mip < 0 || mip >= (int)header.mipCount || pageX < 0 || pageY < 0 || pageX >= getPagesX(mip) || pageY >= getPagesY(mip))
+	{
+		return -1;
+	}
+	return mipFirstPage[mip] + pageY * getPagesX(mip) + pageX;
+}
@@ -0,0 +1,59 @@
+// Tiled on-disk format for virtual textures. Each mip of the source is split into fixed-size pages (with a border for bilinear filtering)
+// that can be streamed in individually, so the full texture never has to be resident in memory
+#pragma once
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+using namespace std;
+
+class HeightField;
+
+// File header, followed by one 64-bit offset per page (mip-major, then row-major) and the page data itself
+struct VirtualTextureHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t width;
+	uint32_t height;
+	uint32_t pageSize;
+	uint32_t border;
+	uint32_t mipCount;
+	uint32_t pagesX;
+	uint32_t pagesY;
+	uint32_t bytesPerTexel;
+};
+
+class VirtualTextureFile
+{
+public:
+	VirtualTextureFile();
+	~VirtualTextureFile();
+
+	// Cooks a height field into a tiled file as 16-bit unorm pages. Width and height must be powers of two and at least one page in size
+	static bool build(const HeightField& source, const wchar_t* filename, int pageSize = 128, int border = 4);
+
+	bool open(const wchar_t* filename);
+	void close();
+	bool isOpen() const { return file.is_open(); }
+
+	// Reads a single page's texels (including its border) into data
+	bool readPage(int mip, int pageX, int pageY, vector<uint16_t>& data);
+
+	const VirtualTextureHeader& getHeader() const { return header; }
+	int getPagesX(int mip) const;
+	int getPagesY(int mip) const;
+	int getPaddedPageSize() const { return header.pageSize + header.border * 2; }
+	int getPageBytes() const { return getPaddedPageSize() * getPaddedPageSize() * header.bytesPerTexel; }
+
+	// Returns the index of a page in the offset table
+	int getPageIndex(int mip, int pageX, int pageY) const;
+
+private:
+	ifstream file;
+	VirtualTextureHeader header;
+	vector<uint64_t> pageOffsets;
+	vector<int> mipFirstPage;
+};